@@ -0,0 +1,199 @@
+/**
+ * @file codecbench.cpp
+ * @brief Microbenchmark of the control message codecs of Protocol
+ *
+ * Encodes and decodes the same messages over and over for each case and
+ * reports the time per message, with the line protocol of version 1 next
+ * to the frames of version 2 so the two can be compared. The "stream"
+ * cases read many small frames back to back from a buffer as a Receiver
+ * reads its connections. Results are written as one JSON document.
+ *
+ * Usage: landrop-codec-bench [--milliseconds 300] [--output file]
+ */
+
+#include "../landrop-plus/network/framecodec.h"
+#include "../landrop-plus/network/protocol.h"
+#include <QBuffer>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <QTextStream>
+#include <functional>
+
+namespace
+{
+    /** Messages handled between two clock reads */
+    const int BATCH = 1000;
+
+    /** Keeps the results of the cases from being optimized away */
+    volatile quint64 sink = 0;
+
+    /**
+     * @brief Runs @p step in batches for @p milliseconds and reports the time per call.
+     */
+    QJsonObject measure(const QString &name, qint64 milliseconds, const std::function<quint64()> &step)
+    {
+        // Warm up caches and allocators
+        for (int i = 0; i < BATCH; ++i)
+            sink += step();
+
+        QElapsedTimer timer;
+        qint64 calls = 0;
+        timer.start();
+        while (timer.elapsed() < milliseconds)
+        {
+            for (int i = 0; i < BATCH; ++i)
+                sink += step();
+            calls += BATCH;
+        }
+        qint64 elapsed = timer.nsecsElapsed();
+
+        QJsonObject result;
+        result["case"] = name;
+        result["messages"] = calls;
+        result["nsPerMessage"] = double(elapsed) / double(calls);
+        result["messagesPerSecond"] = double(calls) * 1e9 / double(elapsed);
+        return result;
+    }
+
+    /** @brief Message as readMessage() returns it: the type byte then the payload. */
+    QByteArray messageOf(const QByteArray &frame)
+    {
+        QByteArray message = frame.mid(FrameCodec::Prefix::SIZE - 1);
+        message[0] = frame[0];
+        return message;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("landrop-codec-bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Microbenchmark of the LANDrop protocol codecs.");
+    parser.addHelpOption();
+    QCommandLineOption millisecondsOption("milliseconds", "Time each case runs for.", "ms", "300");
+    QCommandLineOption outputOption("output", "File the JSON results are written to, standard output if none.", "file");
+    parser.addOptions({millisecondsOption, outputOption});
+    parser.process(app);
+
+    QTextStream errors(stderr);
+    bool ok = false;
+    qint64 milliseconds = parser.value(millisecondsOption).toLongLong(&ok);
+    if (!ok || milliseconds <= 0)
+    {
+        errors << "landrop-codec-bench: invalid --milliseconds\n";
+        return 2;
+    }
+
+    Protocol::TransferHeader header;
+    header.fileName = "holiday/IMG_2041.jpg";
+    header.fileSize = 4718592;
+    header.transferId = Protocol::newTransferId();
+    header.options.insert("hash", "blake2b");
+    header.options.insert("mtime", "1717171717");
+    const QByteArray headerLine = header.encode(Protocol::VERSION_1).trimmed();
+    const QByteArray headerMessage = messageOf(header.encode(Protocol::VERSION_2));
+
+    const QByteArray sessionLine = Protocol::encodeSessionAck(Protocol::VERSION_1, 12).trimmed();
+    const QByteArray sessionMessage = messageOf(Protocol::encodeSessionAck(Protocol::VERSION_2, 12));
+    const QByteArray catalogLine = Protocol::encodeCatalogRequest(Protocol::VERSION_1, 400, 17, 0xfeed).trimmed();
+    const QByteArray catalogMessage = messageOf(Protocol::encodeCatalogRequest(Protocol::VERSION_2, 400, 17, 0xfeed));
+
+    // A connection's worth of small frames, read back to back
+    QByteArray stream;
+    for (int i = 0; i < BATCH; ++i)
+        stream += Protocol::encodeSessionAck(Protocol::VERSION_2, i);
+    QBuffer buffer(&stream);
+    buffer.open(QIODevice::ReadOnly);
+    int streamPosition = BATCH;
+    int prefixAt = 0;
+
+    QJsonArray results;
+    results.append(measure("header.decode.v1", milliseconds, [&]()
+                           {
+        Protocol::TransferHeader decoded;
+        Protocol::TransferHeader::decode(headerLine, &decoded);
+        return quint64(decoded.fileSize); }));
+    results.append(measure("header.decode.v2", milliseconds, [&]()
+                           {
+        Protocol::TransferHeader decoded;
+        Protocol::TransferHeader::decode(headerMessage, &decoded);
+        return quint64(decoded.fileSize); }));
+    results.append(measure("header.encode.v2", milliseconds, [&]()
+                           { return quint64(header.encode(Protocol::VERSION_2).size()); }));
+    results.append(measure("session.decode.v1", milliseconds, [&]()
+                           {
+        int count = 0;
+        Protocol::decodeSessionAck(sessionLine, &count);
+        return quint64(count); }));
+    results.append(measure("session.decode.v2", milliseconds, [&]()
+                           {
+        int count = 0;
+        Protocol::decodeSessionAck(sessionMessage, &count);
+        return quint64(count); }));
+    results.append(measure("session.encode.v2", milliseconds, [&]()
+                           { return quint64(Protocol::encodeSessionAck(Protocol::VERSION_2, 12).size()); }));
+    results.append(measure("catalogRequest.decode.v1", milliseconds, [&]()
+                           {
+        int offset = 0;
+        quint64 since = 0;
+        Protocol::decodeCatalogRequest(catalogLine, &offset, &since);
+        return quint64(offset) + since; }));
+    results.append(measure("catalogRequest.decode.v2", milliseconds, [&]()
+                           {
+        int offset = 0;
+        quint64 since = 0;
+        Protocol::decodeCatalogRequest(catalogMessage, &offset, &since);
+        return quint64(offset) + since; }));
+    results.append(measure("prefix.read", milliseconds, [&]()
+                           {
+        quint8 type = 0;
+        quint32 length = 0;
+        FrameCodec::Prefix::read(stream.constData() + prefixAt, FrameCodec::Prefix::SIZE, type, length);
+        prefixAt = (prefixAt + FrameCodec::Prefix::SIZE + int(length)) % stream.size();
+        return quint64(type) + length; }));
+    results.append(measure("stream.read.v2", milliseconds, [&]()
+                           {
+        if (streamPosition == BATCH)
+        {
+            buffer.seek(0);
+            streamPosition = 0;
+        }
+        ++streamPosition;
+        QByteArray message;
+        Protocol::readMessage(&buffer, Protocol::VERSION_2, &message);
+        int count = 0;
+        Protocol::decodeSessionAck(message, &count);
+        return quint64(count); }));
+
+    QJsonObject report;
+    report["time"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    report["host"] = QSysInfo::machineHostName();
+    report["cpu"] = QSysInfo::currentCpuArchitecture();
+    report["qt"] = QString(qVersion());
+    report["results"] = results;
+
+    QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+    if (parser.isSet(outputOption))
+    {
+        QFile output(parser.value(outputOption));
+        if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate) || output.write(json) != json.size())
+        {
+            errors << "landrop-codec-bench: cannot write " << output.fileName() << "\n";
+            return 2;
+        }
+    }
+    else
+    {
+        QTextStream(stdout) << json;
+    }
+    return 0;
+}
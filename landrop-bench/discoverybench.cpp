@@ -0,0 +1,337 @@
+/**
+ * @file discoverybench.cpp
+ * @brief Load benchmark of BroadcastDiscoveryService and the widgets showing its peers
+ *
+ * A PeerSimulator on its own thread plays the virtual peers, the service,
+ * a UserListWidget and a SharedFilesWidget run on the main thread as in
+ * the application. Once a second the benchmark samples the datagrams the
+ * service read and sent, its userListUpdated() emissions, the CPU time of
+ * the main thread and the resident memory. At the end it reports CPU per
+ * datagram, emission rates, memory growth per peer, how long the widgets
+ * took to handle each change (UI latency), and how long a new or changed
+ * peer took from its datagram to the widgets, as one JSON document.
+ *
+ * The service binds the fixed discovery port, no LANDrop instance may run
+ * on the machine meanwhile. Virtual peers use addresses of 127.0.0.0/8,
+ * which Linux routes to loopback as a whole; other systems need those
+ * addresses configured on the loopback interface first.
+ *
+ * Usage: landrop-discovery-bench [--peers 300] [--format text|binary|mixed] [--duration 60] [--output file]
+ */
+
+#include "peersimulator.h"
+#include "processusage.h"
+#include "../landrop-plus/config/config.h"
+#include "../landrop-plus/network/transfermetrics.h"
+#include "../landrop-plus/services/broadcastdiscoveryservice.h"
+#include "../landrop-plus/ui/sharedfileswidget.h"
+#include "../landrop-plus/ui/userlistwidget.h"
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QFile>
+#include <QHBoxLayout>
+#include <QHostAddress>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <QTextStream>
+#include <QThread>
+#include <QTimer>
+#include <algorithm>
+
+namespace
+{
+    /**
+     * @brief Durations in milliseconds, summarized once the run is over.
+     */
+    struct Samples
+    {
+        QList<double> values;
+
+        void add(double value) { values.append(value); }
+
+        QJsonObject summary() const
+        {
+            QList<double> sorted = values;
+            std::sort(sorted.begin(), sorted.end());
+            auto percentile = [&sorted](int percent)
+            {
+                return sorted.isEmpty() ? 0.0 : sorted[qMin<qsizetype>(sorted.size() - 1, sorted.size() * percent / 100)];
+            };
+
+            double total = 0;
+            for (double value : sorted)
+                total += value;
+
+            QJsonObject object;
+            object["count"] = qint64(sorted.size());
+            object["meanMs"] = sorted.isEmpty() ? 0.0 : total / sorted.size();
+            object["p50Ms"] = percentile(50);
+            object["p99Ms"] = percentile(99);
+            object["maxMs"] = sorted.isEmpty() ? 0.0 : sorted.last();
+            return object;
+        }
+    };
+
+    bool parseFormat(const QString &text, PeerSimulator::Format *format)
+    {
+        if (text == "text")
+            *format = PeerSimulator::Format::Text;
+        else if (text == "binary")
+            *format = PeerSimulator::Format::Binary;
+        else if (text == "mixed")
+            *format = PeerSimulator::Format::Mixed;
+        else
+            return false;
+        return true;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    // Runs without a display unless the widgets are to be seen
+    bool show = false;
+    for (int i = 1; i < argc; ++i)
+        show = show || QByteArray(argv[i]) == "--show";
+    if (!show && !qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication app(argc, argv);
+    QCoreApplication::setApplicationName("landrop-discovery-bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Load benchmark of LANDrop peer discovery");
+    parser.addHelpOption();
+    QCommandLineOption peersOption("peers", "Virtual peers.", "count", "300");
+    QCommandLineOption formatOption("format", "Announcement format: text, binary or mixed.", "format", "mixed");
+    QCommandLineOption intervalOption("interval", "Milliseconds between two announcements of a peer.", "ms", "5000");
+    QCommandLineOption filesOption("files", "Files listed by each text peer.", "count", "8");
+    QCommandLineOption changesOption("changes", "Changing announcements per second, over all peers.", "rate", "1");
+    QCommandLineOption rampOption("ramp", "Milliseconds over which the peers join.", "ms", "5000");
+    QCommandLineOption durationOption("duration", "Seconds the benchmark runs.", "seconds", "60");
+    QCommandLineOption addressOption("first-address", "Address of the first virtual peer.", "address", "127.1.0.1");
+    QCommandLineOption outputOption("output", "File the JSON results are written to, standard output if none.", "file");
+    QCommandLineOption showOption("show", "Shows the widgets while the benchmark runs.");
+    parser.addOptions({peersOption, formatOption, intervalOption, filesOption, changesOption, rampOption,
+                       durationOption, addressOption, outputOption, showOption});
+    parser.process(app);
+
+    PeerSimulator::Settings settings;
+    settings.peerCount = parser.value(peersOption).toInt();
+    settings.announceIntervalMs = parser.value(intervalOption).toInt();
+    settings.filesPerPeer = qMax(0, parser.value(filesOption).toInt());
+    settings.changesPerSecond = qMax(0.0, parser.value(changesOption).toDouble());
+    settings.rampMs = qMax(0, parser.value(rampOption).toInt());
+    QHostAddress firstAddress(parser.value(addressOption));
+    int duration = parser.value(durationOption).toInt();
+    QTextStream errors(stderr);
+    if (settings.peerCount <= 0 || settings.announceIntervalMs <= 0 || duration <= 0 ||
+        !parseFormat(parser.value(formatOption), &settings.format) ||
+        firstAddress.protocol() != QAbstractSocket::IPv4Protocol)
+    {
+        errors << "landrop-discovery-bench: invalid option value\n";
+        return 2;
+    }
+    settings.firstAddress = firstAddress.toIPv4Address();
+    qint64 fileLimit = ProcessUsage::raiseFileLimit();
+    if (fileLimit >= 0 && fileLimit < settings.peerCount + 64)
+        errors << "landrop-discovery-bench: only " << fileLimit << " files may be open, some peers will be left out\n";
+
+    // Only the broadcasts are measured, without mDNS next to them
+    Config::reset();
+    Config::getMdnsDiscoveryEnabled() = false;
+    TransferMetrics::reset();
+
+    QElapsedTimer clock;
+    clock.start();
+    qint64 rssBefore = ProcessUsage::currentRss();
+
+    BroadcastDiscoveryService service;
+    QUdpSocket probe;
+    if (probe.bind(QHostAddress::Any, settings.targetPort, QUdpSocket::DontShareAddress))
+    {
+        errors << "landrop-discovery-bench: the service could not bind the discovery port\n";
+        return 2;
+    }
+
+    // Signals are handled in connection order: the first marks the start,
+    // the widgets handle it, the last measures how long they took
+    qint64 handlingStart = 0;
+    int userListUpdates = 0;
+    int added = 0;
+    int changed = 0;
+    int removed = 0;
+    Samples uiLatency;
+    Samples addLatency;
+    Samples changeLatency;
+    auto begin = [&]()
+    {
+        handlingStart = clock.nsecsElapsed();
+    };
+    auto handled = [&]()
+    {
+        uiLatency.add((clock.nsecsElapsed() - handlingStart) / 1e6);
+    };
+    QObject::connect(&service, &BroadcastDiscoveryService::peerAdded, &app, begin);
+    QObject::connect(&service, &BroadcastDiscoveryService::peerChanged, &app, begin);
+    QObject::connect(&service, &BroadcastDiscoveryService::peerRemoved, &app, begin);
+    QObject::connect(&service, &BroadcastDiscoveryService::userListUpdated, &app, [&]()
+                     { userListUpdates++; });
+
+    QWidget window;
+    QHBoxLayout *layout = new QHBoxLayout(&window);
+    UserListWidget *userList = new UserListWidget(&service, &window);
+    SharedFilesWidget *sharedFiles = new SharedFilesWidget(&window);
+    layout->addWidget(userList);
+    layout->addWidget(sharedFiles);
+    QObject::connect(&service, &BroadcastDiscoveryService::peerAdded, sharedFiles, &SharedFilesWidget::onPeerAdded);
+    QObject::connect(&service, &BroadcastDiscoveryService::peerChanged, sharedFiles, &SharedFilesWidget::onPeerChanged);
+    QObject::connect(&service, &BroadcastDiscoveryService::peerRemoved, sharedFiles, &SharedFilesWidget::onPeerRemoved);
+    window.resize(1000, 600);
+    if (parser.isSet(showOption))
+        window.show();
+
+    QThread simulatorThread;
+    PeerSimulator *simulator = new PeerSimulator(settings, clock);
+    simulator->moveToThread(&simulatorThread);
+    QObject::connect(&simulatorThread, &QThread::finished, simulator, &QObject::deleteLater);
+
+    QObject::connect(&service, &BroadcastDiscoveryService::peerAdded, &app, [&](const LANDropUser &user)
+                     {
+        handled();
+        added++;
+        qint64 sentAt = simulator->firstSentAt(user.ipAddress);
+        if (sentAt >= 0)
+            addLatency.add(clock.elapsed() - sentAt); });
+    QObject::connect(&service, &BroadcastDiscoveryService::peerChanged, &app, [&](const LANDropUser &user, int)
+                     {
+        handled();
+        changed++;
+        qint64 sentAt = simulator->changeSentAt(user.ipAddress);
+        if (sentAt >= 0)
+            changeLatency.add(clock.elapsed() - sentAt); });
+    QObject::connect(&service, &BroadcastDiscoveryService::peerRemoved, &app, [&](const QString &)
+                     {
+        handled();
+        removed++; });
+
+    // One sample a second of what happened since the previous one
+    QJsonArray series;
+    double cpuBefore = ProcessUsage::threadCpuSeconds();
+    double lastCpu = cpuBefore;
+    qint64 lastReceived = 0;
+    qint64 lastSent = 0;
+    int lastUpdates = 0;
+    int maxPeers = 0;
+    QTimer sampler;
+    QObject::connect(&sampler, &QTimer::timeout, &app, [&]()
+                     {
+        TransferMetrics::Totals totals = TransferMetrics::totals();
+        double cpu = ProcessUsage::threadCpuSeconds();
+        int peerCount = int(service.users().size());
+        maxPeers = qMax(maxPeers, peerCount);
+
+        QJsonObject sample;
+        sample["second"] = qRound(clock.elapsed() / 1000.0);
+        sample["peers"] = peerCount;
+        sample["datagramsReceived"] = totals.discoveryReceived - lastReceived;
+        sample["datagramsSent"] = totals.discoverySent - lastSent;
+        sample["userListUpdates"] = userListUpdates - lastUpdates;
+        sample["cpuMs"] = (cpu - lastCpu) * 1000;
+        sample["rssBytes"] = ProcessUsage::currentRss();
+        series.append(sample);
+
+        lastReceived = totals.discoveryReceived;
+        lastSent = totals.discoverySent;
+        lastUpdates = userListUpdates;
+        lastCpu = cpu; });
+
+    simulatorThread.start();
+    QMetaObject::invokeMethod(simulator, &PeerSimulator::start, Qt::QueuedConnection);
+    sampler.start(1000);
+    QTimer::singleShot(duration * 1000, &app, &QCoreApplication::quit);
+    app.exec();
+    sampler.stop();
+
+    QMetaObject::invokeMethod(simulator, &PeerSimulator::stop, Qt::BlockingQueuedConnection);
+    qint64 simulatorSent = simulator->sent;
+    qint64 simulatorReceived = simulator->received;
+    int unbound = simulator->failed;
+    simulatorThread.quit();
+    simulatorThread.wait();
+
+    double seconds = clock.elapsed() / 1000.0;
+    double cpu = ProcessUsage::threadCpuSeconds() - cpuBefore;
+    qint64 rssAfter = ProcessUsage::currentRss();
+    TransferMetrics::Totals totals = TransferMetrics::totals();
+    BroadcastDiscoveryService::ParseStats parseStats = service.parseStats();
+    int finalPeers = int(service.users().size());
+
+    QJsonObject simulation;
+    simulation["peers"] = settings.peerCount;
+    simulation["peersLeftOut"] = unbound;
+    simulation["format"] = parser.value(formatOption);
+    simulation["announceIntervalMs"] = settings.announceIntervalMs;
+    simulation["filesPerPeer"] = settings.filesPerPeer;
+    simulation["changesPerSecond"] = settings.changesPerSecond;
+    simulation["datagramsSent"] = simulatorSent;
+    simulation["datagramsReceived"] = simulatorReceived;
+
+    QJsonObject serviceResult;
+    serviceResult["peersFinal"] = finalPeers;
+    serviceResult["peersMax"] = maxPeers;
+    serviceResult["datagramsReceived"] = totals.discoveryReceived;
+    serviceResult["datagramsSent"] = totals.discoverySent;
+    serviceResult["datagramsParsed"] = parseStats.parsed;
+    serviceResult["datagramsSkipped"] = parseStats.skipped;
+    serviceResult["skipRate"] = parseStats.skipRate();
+    serviceResult["cpuSeconds"] = cpu;
+    serviceResult["cpuMicrosecondsPerDatagram"] = totals.discoveryReceived > 0 ? cpu * 1e6 / totals.discoveryReceived : 0.0;
+    serviceResult["userListUpdates"] = userListUpdates;
+    serviceResult["userListUpdatesPerSecond"] = seconds > 0 ? userListUpdates / seconds : 0.0;
+    serviceResult["peersAdded"] = added;
+    serviceResult["peersChanged"] = changed;
+    serviceResult["peersRemoved"] = removed;
+
+    QJsonObject memory;
+    memory["rssBeforeBytes"] = rssBefore;
+    memory["rssAfterBytes"] = rssAfter;
+    memory["growthBytes"] = rssAfter - rssBefore;
+    memory["growthBytesPerPeer"] = maxPeers > 0 ? double(rssAfter - rssBefore) / maxPeers : 0.0;
+    memory["peakRssBytes"] = ProcessUsage::peakRss();
+
+    QJsonObject latency;
+    latency["widgetHandling"] = uiLatency.summary();
+    latency["peerAdded"] = addLatency.summary();
+    latency["peerChanged"] = changeLatency.summary();
+
+    QJsonObject report;
+    report["time"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    report["host"] = QSysInfo::machineHostName();
+    report["os"] = QSysInfo::prettyProductName();
+    report["qt"] = QString(qVersion());
+    report["seconds"] = seconds;
+    report["simulation"] = simulation;
+    report["service"] = serviceResult;
+    report["memory"] = memory;
+    report["latency"] = latency;
+    report["series"] = series;
+
+    QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+    if (parser.isSet(outputOption))
+    {
+        QFile output(parser.value(outputOption));
+        if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate) || output.write(json) != json.size())
+        {
+            errors << "landrop-discovery-bench: cannot write " << output.fileName() << "\n";
+            return 2;
+        }
+    }
+    else
+    {
+        QTextStream(stdout) << json;
+    }
+    return 0;
+}
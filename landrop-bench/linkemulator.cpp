@@ -0,0 +1,156 @@
+/**
+ * @file linkemulator.cpp
+ */
+
+#include "linkemulator.h"
+#include <QHostAddress>
+
+LinkEmulator::LinkEmulator(quint16 targetPort, int latencyMs, qint64 rate, QObject *parent)
+    : QObject(parent),
+      targetPort(targetPort),
+      latencyMs(qMax(0, latencyMs)),
+      rate(qMax<qint64>(0, rate)),
+      tickTimer(new QTimer(this))
+{
+    connect(&server, &QTcpServer::newConnection, this, &LinkEmulator::onNewConnection);
+    connect(tickTimer, &QTimer::timeout, this, &LinkEmulator::pump);
+    tickTimer->setTimerType(Qt::PreciseTimer);
+    clock.start();
+}
+
+LinkEmulator::~LinkEmulator()
+{
+    qDeleteAll(pipes);
+}
+
+/**
+ * @brief Starts accepting connections on a free loopback port.
+ */
+bool LinkEmulator::listen()
+{
+    if (!server.listen(QHostAddress::LocalHost, 0))
+        return false;
+    tickTimer->start(TICK_MS);
+    return true;
+}
+
+/**
+ * @brief Relays a new connection to the target port.
+ */
+void LinkEmulator::onNewConnection()
+{
+    while (server.hasPendingConnections())
+    {
+        QTcpSocket *client = server.nextPendingConnection();
+        QTcpSocket *target = new QTcpSocket(this);
+        client->setReadBufferSize(READ_BUFFER);
+        target->setReadBufferSize(READ_BUFFER);
+
+        Pipe *pipe = new Pipe;
+        pipe->up.from = client;
+        pipe->up.to = target;
+        pipe->down.from = target;
+        pipe->down.to = client;
+        pipes.append(pipe);
+
+        for (Flow *flow : {&pipe->up, &pipe->down})
+        {
+            connect(flow->from, &QTcpSocket::readyRead, this, [this, flow]()
+                    { read(*flow); });
+            connect(flow->from, &QTcpSocket::disconnected, this, [this, flow]()
+                    {
+                read(*flow);
+                flow->closed = true; });
+        }
+        target->connectToHost(QHostAddress::LocalHost, targetPort);
+    }
+}
+
+/**
+ * @brief Holds what a side sent until its latency passed.
+ */
+void LinkEmulator::read(Flow &flow)
+{
+    // Data beyond the read-ahead stays in the socket until the link caught up
+    qint64 room = READ_BUFFER - flow.heldBytes;
+    if (room <= 0)
+        return;
+
+    QByteArray data = flow.from->read(room);
+    if (data.isEmpty())
+        return;
+
+    Chunk chunk;
+    chunk.due = clock.elapsed() + latencyMs;
+    chunk.data = data;
+    flow.heldBytes += data.size();
+    flow.held.append(chunk);
+}
+
+/**
+ * @brief Writes the held data whose latency passed, within the link budget.
+ *
+ * @return Whether the flow is closed and has nothing left to write
+ */
+bool LinkEmulator::drain(Flow &flow, qint64 now, qint64 &budget)
+{
+    if (flow.to->state() != QAbstractSocket::ConnectedState)
+        return flow.closed && flow.to->state() == QAbstractSocket::UnconnectedState;
+
+    while (!flow.held.isEmpty() && flow.held.first().due <= now && (rate == 0 || budget > 0))
+    {
+        Chunk &chunk = flow.held.first();
+        qint64 length = rate == 0 ? chunk.data.size() : qMin<qint64>(chunk.data.size(), budget);
+        flow.to->write(chunk.data.constData(), length);
+        flow.heldBytes -= length;
+        budget -= length;
+        if (length == chunk.data.size())
+            flow.held.removeFirst();
+        else
+            chunk.data.remove(0, int(length));
+    }
+
+    // Room was made, read what waited in the socket
+    if (flow.from->bytesAvailable() > 0)
+        read(flow);
+
+    if (flow.closed && flow.held.isEmpty())
+    {
+        flow.to->disconnectFromHost();
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Refills the link budget and moves the data that is due.
+ */
+void LinkEmulator::pump()
+{
+    qint64 now = clock.elapsed();
+    if (rate > 0)
+    {
+        // Late ticks are made up for, but an idle link does not save up a burst
+        budget = qMin(budget + rate * (now - lastPump) / 1000, rate * BURST_MS / 1000 + 64 * 1024);
+    }
+    lastPump = now;
+
+    for (int i = pipes.size() - 1; i >= 0; --i)
+    {
+        Pipe *pipe = pipes[i];
+        bool upDone = drain(pipe->up, now, budget);
+        bool downDone = drain(pipe->down, now, budget);
+        if (upDone && downDone)
+            closePipe(pipe);
+    }
+}
+
+void LinkEmulator::closePipe(Pipe *pipe)
+{
+    pipes.removeOne(pipe);
+    pipe->up.from->disconnect(this);
+    pipe->down.from->disconnect(this);
+    pipe->up.from->deleteLater();
+    pipe->down.from->deleteLater();
+    delete pipe;
+}
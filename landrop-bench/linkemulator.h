@@ -0,0 +1,97 @@
+/**
+ * @file linkemulator.h
+ * @brief TCP relay adding latency and a bandwidth cap in front of a local port
+ */
+
+#ifndef LINKEMULATOR_H
+#define LINKEMULATOR_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QList>
+
+/**
+ * @class LinkEmulator
+ * @brief Stands for a slower network link between the benchmark's Sender and Receiver.
+ *
+ * Every connection accepted on port() is relayed to the target port on
+ * the loopback interface. Data read on either side is held for the one-way
+ * latency before it is written to the other side, and all connections
+ * together are written at no more than the rate given, like a shared link.
+ * Sockets read at most READ_BUFFER bytes ahead, so a full link pushes back
+ * on the sender through TCP flow control.
+ */
+class LinkEmulator : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @param targetPort Port the connections are relayed to
+     * @param latencyMs One-way delay in milliseconds
+     * @param rate Bytes per second of the link, 0 for no cap
+     */
+    LinkEmulator(quint16 targetPort, int latencyMs, qint64 rate, QObject *parent = nullptr);
+    ~LinkEmulator();
+
+    bool listen();
+    quint16 port() const { return server.serverPort(); }
+
+    /** Bytes each socket reads ahead of the link */
+    static const qint64 READ_BUFFER = 1024 * 1024;
+
+    /** Milliseconds between two writes of the held data */
+    static const int TICK_MS = 2;
+
+    /** Milliseconds of link budget that may be saved up */
+    static const int BURST_MS = 20;
+
+private slots:
+    void onNewConnection();
+    void pump();
+
+private:
+    struct Chunk
+    {
+        qint64 due = 0;
+        QByteArray data;
+    };
+
+    /** One direction of a relayed connection */
+    struct Flow
+    {
+        QTcpSocket *from = nullptr;
+        QTcpSocket *to = nullptr;
+        QList<Chunk> held;
+        qint64 heldBytes = 0;
+        bool closed = false;
+    };
+
+    struct Pipe
+    {
+        Flow up;
+        Flow down;
+    };
+
+    void read(Flow &flow);
+    bool drain(Flow &flow, qint64 now, qint64 &budget);
+    void closePipe(Pipe *pipe);
+
+    QTcpServer server;
+    quint16 targetPort;
+    int latencyMs;
+    qint64 rate;
+
+    QList<Pipe *> pipes;
+    QTimer *tickTimer;
+    QElapsedTimer clock;
+    qint64 lastPump = 0;
+
+    /** Bytes the link may still write, refilled at rate */
+    qint64 budget = 0;
+};
+
+#endif // LINKEMULATOR_H
@@ -0,0 +1,397 @@
+/**
+ * @file main.cpp
+ * @brief Loopback throughput benchmark of Sender and Receiver
+ *
+ * Sends generated files from a Sender to a Receiver in the same process,
+ * over loopback or through a LinkEmulator, for every combination of file
+ * size, file count, buffer size and concurrency asked for. Each case
+ * reports its throughput, the CPU time spent per GB and the peak resident
+ * memory, and the results are written as one JSON document to compare
+ * releases with.
+ *
+ * Usage: landrop-bench [--sizes 1K,1M,1G,10G] [--counts 1,16] [--buffers 65536]
+ *                      [--concurrency 1,4] [--latency ms] [--rate 100M] [--output file]
+ *                      [--trace file]
+ *
+ * With --trace, every transfer of the run is recorded as a Chrome trace
+ * (see TransferTrace) to open in Perfetto.
+ */
+
+#include "linkemulator.h"
+#include "processusage.h"
+#include "../landrop-plus/config/config.h"
+#include "../landrop-plus/network/receiver.h"
+#include "../landrop-plus/network/sender.h"
+#include "../landrop-plus/network/transfertrace.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+#include <QTimer>
+
+namespace
+{
+    /** One combination of the sweep */
+    struct BenchCase
+    {
+        qint64 fileSize = 0;
+        int fileCount = 1;
+        int bufferSize = 65536;
+        int concurrency = 1;
+    };
+
+    struct BenchResult
+    {
+        bool ok = false;
+        qint64 bytes = 0;
+        double seconds = 0;
+        double cpuSeconds = 0;
+        qint64 peakRss = 0;
+    };
+
+    /**
+     * @brief Parses a byte count with an optional K, M or G suffix (powers of 1024).
+     *
+     * @return The count, -1 if @p text is not one
+     */
+    qint64 parseSize(QString text)
+    {
+        text = text.trimmed().toUpper();
+        if (text.endsWith('B'))
+            text.chop(1);
+        qint64 unit = 1;
+        if (text.endsWith('K'))
+            unit = 1024;
+        else if (text.endsWith('M'))
+            unit = 1024 * 1024;
+        else if (text.endsWith('G'))
+            unit = qint64(1024) * 1024 * 1024;
+        if (unit > 1)
+            text.chop(1);
+
+        bool ok = false;
+        double value = text.toDouble(&ok);
+        return ok && value >= 0 ? qint64(value * unit) : -1;
+    }
+
+    /**
+     * @brief Parses a comma separated list of sizes.
+     *
+     * @return The sizes, empty if one of them is not valid
+     */
+    QList<qint64> parseList(const QString &text)
+    {
+        QList<qint64> values;
+        for (const QString &part : text.split(',', Qt::SkipEmptyParts))
+        {
+            qint64 value = parseSize(part);
+            if (value < 0)
+                return QList<qint64>();
+            values.append(value);
+        }
+        return values;
+    }
+
+    /**
+     * @brief Writes a file of @p size pseudo-random bytes, unless it is there already.
+     *
+     * Each file gets its own bytes so none can be deduplicated against another.
+     */
+    bool makeSourceFile(const QString &filePath, qint64 size, quint32 seed)
+    {
+        QFile file(filePath);
+        if (file.exists() && file.size() == size)
+            return true;
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            return false;
+
+        QRandomGenerator generator(seed);
+        QByteArray block(1024 * 1024, '\0');
+        for (qint64 written = 0; written < size;)
+        {
+            generator.fillRange(reinterpret_cast<quint32 *>(block.data()), block.size() / 4);
+            qint64 length = qMin<qint64>(block.size(), size - written);
+            if (file.write(block.constData(), length) != length)
+                return false;
+            written += length;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Sends the files of one case and measures it.
+     *
+     * @param files Source files to send
+     * @param port Port the Senders connect to, the Receiver's or the link's
+     */
+    BenchResult runCase(const BenchCase &benchCase, const QStringList &files, Receiver &receiver, quint16 port,
+                        int timeoutSeconds)
+    {
+        BenchResult result;
+        QEventLoop loop;
+        QTimer timeout;
+        timeout.setSingleShot(true);
+        QObject::connect(&timeout, &QTimer::timeout, &loop, &QEventLoop::quit);
+
+        int next = 0;
+        int received = 0;
+        bool failed = false;
+        QList<Sender *> senders;
+
+        QMetaObject::Connection receivedConnection =
+            QObject::connect(&receiver, &Receiver::fileReceivedSuccessfully, &loop,
+                             [&](const QString &, const QByteArray &)
+                             {
+                if (++received == files.size())
+                    loop.quit(); });
+
+        // Each Sender takes the next file once its previous one went through
+        auto sendNext = [&](Sender *sender)
+        {
+            if (next < files.size())
+                sender->sendFile(files[next++], "127.0.0.1", port);
+        };
+        for (int i = 0; i < qMin(benchCase.concurrency, int(files.size())); ++i)
+        {
+            Sender *sender = new Sender();
+            senders.append(sender);
+            QObject::connect(sender, &Sender::transferFinished, &loop, [&, sender]()
+                             { QTimer::singleShot(0, &loop, [&, sender]()
+                                                  { sendNext(sender); }); });
+            auto fail = [&]()
+            {
+                failed = true;
+                loop.quit();
+            };
+            QObject::connect(sender, &Sender::transferError, &loop, fail);
+            QObject::connect(sender, &Sender::transferRefused, &loop, fail);
+        }
+
+        ProcessUsage::resetPeakRss();
+        double cpuBefore = ProcessUsage::cpuSeconds();
+        QElapsedTimer clock;
+        clock.start();
+
+        for (Sender *sender : senders)
+            sendNext(sender);
+        timeout.start(timeoutSeconds * 1000);
+        if (!files.isEmpty())
+            loop.exec();
+
+        result.seconds = clock.nsecsElapsed() / 1e9;
+        result.cpuSeconds = ProcessUsage::cpuSeconds() - cpuBefore;
+        result.peakRss = ProcessUsage::peakRss();
+        result.ok = !failed && received == files.size();
+        result.bytes = qint64(received) * benchCase.fileSize;
+
+        QObject::disconnect(receivedConnection);
+        qDeleteAll(senders);
+        return result;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("landrop-bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Loopback throughput benchmark of the LANDrop Sender and Receiver");
+    parser.addHelpOption();
+    QCommandLineOption sizesOption("sizes", "File sizes, with K, M or G suffixes.", "list", "1K,1M,64M,1G,10G");
+    QCommandLineOption countsOption("counts", "Files sent per case.", "list", "1,16");
+    QCommandLineOption buffersOption("buffers", "Values of the bufferSize setting.", "list", "64K,1M");
+    QCommandLineOption concurrencyOption("concurrency", "Transfers running at once.", "list", "1,4");
+    QCommandLineOption latencyOption("latency", "One-way link latency in milliseconds.", "ms", "0");
+    QCommandLineOption rateOption("rate", "Link bandwidth in bytes per second, 0 for none.", "bytes", "0");
+    QCommandLineOption maxTotalOption("max-total", "Cases sending more bytes than this are skipped.", "bytes", "10G");
+    QCommandLineOption timeoutOption("timeout", "Seconds a case may run.", "seconds", "900");
+    QCommandLineOption workDirOption("work-dir", "Folder the files are generated in.", "path", QDir::tempPath());
+    QCommandLineOption outputOption("output", "File the JSON results are written to, standard output if none.", "file");
+    QCommandLineOption traceOption("trace", "File a Chrome trace of the transfers is recorded to.", "file");
+    parser.addOptions({sizesOption, countsOption, buffersOption, concurrencyOption, latencyOption, rateOption,
+                       maxTotalOption, timeoutOption, workDirOption, outputOption, traceOption});
+    parser.process(app);
+
+    QList<qint64> sizes = parseList(parser.value(sizesOption));
+    QList<qint64> counts = parseList(parser.value(countsOption));
+    QList<qint64> buffers = parseList(parser.value(buffersOption));
+    QList<qint64> concurrencies = parseList(parser.value(concurrencyOption));
+    int latency = parser.value(latencyOption).toInt();
+    qint64 rate = parseSize(parser.value(rateOption));
+    qint64 maxTotal = parseSize(parser.value(maxTotalOption));
+    int timeoutSeconds = qMax(1, parser.value(timeoutOption).toInt());
+    QTextStream errors(stderr);
+    if (sizes.isEmpty() || counts.isEmpty() || buffers.isEmpty() || concurrencies.isEmpty() || rate < 0 || maxTotal < 0)
+    {
+        errors << "landrop-bench: invalid option value\n";
+        return 2;
+    }
+
+    QTemporaryDir workDir(QDir(parser.value(workDirOption)).filePath("landrop-bench-XXXXXX"));
+    if (!workDir.isValid())
+    {
+        errors << "landrop-bench: cannot create a folder in " << parser.value(workDirOption) << "\n";
+        return 2;
+    }
+    QDir sourceDir(workDir.filePath("source"));
+    sourceDir.mkpath(".");
+
+    // Every byte goes over the wire: nothing is skipped, resumed or shrunk
+    Config::reset();
+    Config::getContentIndexPath() = workDir.filePath("content-index.log");
+    Config::getDedupEnabled() = false;
+    Config::getDeltaSyncEnabled() = false;
+    Config::getResumeEnabled() = false;
+    Config::getCompressionEnabled() = false;
+
+    if (parser.isSet(traceOption) && !TransferTrace::start(parser.value(traceOption)))
+    {
+        errors << "landrop-bench: cannot write " << parser.value(traceOption) << "\n";
+        return 2;
+    }
+
+    int receiveThreads = Config::getReceiveThreads();
+    if (receiveThreads <= 0)
+        receiveThreads = qBound(1, QThread::idealThreadCount(), 8);
+    Receiver receiver;
+    receiver.setWorkerCount(receiveThreads);
+    if (!receiver.startServer(0))
+    {
+        errors << "landrop-bench: cannot start the receiver\n";
+        return 2;
+    }
+    QObject::connect(&receiver, &Receiver::fileTransferRequested, &receiver,
+                     [&receiver](const QString &, const QString &, QTcpSocket *socket)
+                     { receiver.acceptTransfer(socket); });
+
+    quint16 port = receiver.getServerPort();
+    LinkEmulator *link = nullptr;
+    if (latency > 0 || rate > 0)
+    {
+        link = new LinkEmulator(port, latency, rate, &app);
+        if (!link->listen())
+        {
+            errors << "landrop-bench: cannot start the link emulator\n";
+            return 2;
+        }
+        port = link->port();
+    }
+
+    QJsonArray results;
+    bool allOk = true;
+    for (qint64 size : sizes)
+    {
+        for (qint64 count : counts)
+        {
+            if (count <= 0 || size * count > maxTotal)
+            {
+                errors << "skipped " << size << " bytes x " << count << ", above --max-total\n";
+                continue;
+            }
+
+            QStringList files;
+            for (int i = 0; i < count; ++i)
+            {
+                QString filePath = sourceDir.filePath(QString("bench-%1-%2.bin").arg(size).arg(i));
+                if (!makeSourceFile(filePath, size, quint32(size * 31 + i)))
+                {
+                    errors << "landrop-bench: cannot write " << filePath << "\n";
+                    return 2;
+                }
+                files.append(filePath);
+            }
+
+            for (qint64 buffer : buffers)
+            {
+                for (qint64 concurrency : concurrencies)
+                {
+                    BenchCase benchCase;
+                    benchCase.fileSize = size;
+                    benchCase.fileCount = int(count);
+                    benchCase.bufferSize = int(qMax<qint64>(1, buffer));
+                    benchCase.concurrency = int(qMax<qint64>(1, concurrency));
+                    Config::getBufferSize() = benchCase.bufferSize;
+
+                    // Received into a folder of its own, removed after the case
+                    QDir receivedDir(workDir.filePath("received"));
+                    receivedDir.removeRecursively();
+                    receivedDir.mkpath(".");
+                    Config::getReceivedFilesPath() = receivedDir.path();
+
+                    BenchResult result = runCase(benchCase, files, receiver, port, timeoutSeconds);
+                    allOk = allOk && result.ok;
+                    double gigabytes = result.bytes / 1e9;
+
+                    QJsonObject entry;
+                    entry["fileSize"] = benchCase.fileSize;
+                    entry["fileCount"] = benchCase.fileCount;
+                    entry["bufferSize"] = benchCase.bufferSize;
+                    entry["concurrency"] = benchCase.concurrency;
+                    entry["ok"] = result.ok;
+                    entry["bytes"] = result.bytes;
+                    entry["seconds"] = result.seconds;
+                    entry["mbPerSecond"] = result.seconds > 0 ? result.bytes / 1e6 / result.seconds : 0.0;
+                    entry["cpuSecondsPerGB"] = gigabytes > 0 ? result.cpuSeconds / gigabytes : 0.0;
+                    entry["peakRssBytes"] = result.peakRss;
+                    results.append(entry);
+
+                    errors << size << " bytes x " << count << ", buffer " << benchCase.bufferSize << ", concurrency "
+                           << benchCase.concurrency << ": " << entry["mbPerSecond"].toDouble() << " MB/s"
+                           << (result.ok ? "" : " (failed)") << "\n";
+                    errors.flush();
+                    receivedDir.removeRecursively();
+                }
+            }
+        }
+    }
+
+    QJsonObject linkInfo;
+    linkInfo["latencyMs"] = latency;
+    linkInfo["rate"] = rate;
+
+    QJsonObject settings;
+    settings["receiveThreads"] = receiveThreads;
+    settings["zeroCopy"] = Config::getZeroCopyEnabled();
+    settings["integrityCheck"] = Config::getIntegrityCheckEnabled();
+    settings["stripeCount"] = Config::getStripeCount();
+
+    QJsonObject report;
+    report["time"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    report["host"] = QSysInfo::machineHostName();
+    report["os"] = QSysInfo::prettyProductName();
+    report["cpu"] = QSysInfo::currentCpuArchitecture();
+    report["threads"] = QThread::idealThreadCount();
+    report["qt"] = QString(qVersion());
+    report["link"] = linkInfo;
+    report["settings"] = settings;
+    report["results"] = results;
+    TransferTrace::stop();
+
+    QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+    if (parser.isSet(outputOption))
+    {
+        QFile output(parser.value(outputOption));
+        if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate) || output.write(json) != json.size())
+        {
+            errors << "landrop-bench: cannot write " << output.fileName() << "\n";
+            return 2;
+        }
+    }
+    else
+    {
+        QTextStream(stdout) << json;
+    }
+    return allOk ? 0 : 1;
+}
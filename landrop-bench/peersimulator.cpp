@@ -0,0 +1,184 @@
+/**
+ * @file peersimulator.cpp
+ */
+
+#include "peersimulator.h"
+#include "../landrop-plus/network/discoverymessage.h"
+#include <QHostAddress>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QRandomGenerator>
+
+/**
+ * @param clock Clock the send times are read on, shared with the measuring side
+ */
+PeerSimulator::PeerSimulator(const Settings &settings, const QElapsedTimer &clock, QObject *parent)
+    : QObject(parent),
+      settings(settings),
+      clock(clock),
+      tickTimer(new QTimer(this))
+{
+    connect(tickTimer, &QTimer::timeout, this, &PeerSimulator::tick);
+}
+
+PeerSimulator::~PeerSimulator()
+{
+    stop();
+}
+
+QString PeerSimulator::addressOf(int peer) const
+{
+    return QHostAddress(settings.firstAddress + quint32(peer)).toString();
+}
+
+qint64 PeerSimulator::firstSentAt(const QString &ipAddress) const
+{
+    QMutexLocker lock(&timesMutex);
+    return firstSent.value(ipAddress, -1);
+}
+
+qint64 PeerSimulator::changeSentAt(const QString &ipAddress) const
+{
+    QMutexLocker lock(&timesMutex);
+    return changeSent.value(ipAddress, -1);
+}
+
+/**
+ * @brief Opens the sockets of the peers and starts announcing.
+ *
+ * Peers join evenly over rampMs, then announce at random phases of the interval.
+ */
+void PeerSimulator::start()
+{
+    qint64 now = clock.elapsed();
+    for (int i = 0; i < settings.peerCount; ++i)
+    {
+        Peer peer;
+        peer.address = addressOf(i);
+        peer.socket = new QUdpSocket(this);
+        if (!peer.socket->bind(QHostAddress(peer.address), 0))
+        {
+            delete peer.socket;
+            failed++;
+            continue;
+        }
+        connect(peer.socket, &QUdpSocket::readyRead, this, [this, socket = peer.socket]()
+                { drain(socket); });
+
+        peer.binary = settings.format == Format::Binary || (settings.format == Format::Mixed && i % 2 == 1);
+        peer.nextAnnounce = now + (settings.peerCount > 1 ? qint64(settings.rampMs) * i / settings.peerCount : 0);
+        peers.append(peer);
+    }
+    lastTick = now;
+    tickTimer->start(TICK_MS);
+}
+
+void PeerSimulator::stop()
+{
+    tickTimer->stop();
+    for (Peer &peer : peers)
+        delete peer.socket;
+    peers.clear();
+}
+
+/**
+ * @brief Sends the announcements and heartbeats that are due.
+ */
+void PeerSimulator::tick()
+{
+    qint64 now = clock.elapsed();
+    changesDue += settings.changesPerSecond * (now - lastTick) / 1000.0;
+    lastTick = now;
+    const QHostAddress target(QHostAddress::LocalHost);
+
+    for (Peer &peer : peers)
+    {
+        if (now >= peer.nextAnnounce)
+        {
+            bool first = !peer.announced;
+            bool change = !first && changesDue >= 1;
+            if (change)
+            {
+                changesDue -= 1;
+                peer.generation++;
+            }
+
+            if (peer.socket->writeDatagram(announcement(peer), target, settings.targetPort) > 0)
+            {
+                sent++;
+                peer.announced = true;
+                QMutexLocker lock(&timesMutex);
+                if (first)
+                    firstSent.insert(peer.address, now);
+                if (change)
+                    changeSent.insert(peer.address, now);
+            }
+
+            // Random phase within the interval, so the peers do not announce in step
+            qint64 interval = settings.announceIntervalMs;
+            peer.nextAnnounce = now + interval / 2 + QRandomGenerator::global()->bounded(interval + 1);
+        }
+
+        if (peer.binary && peer.announced && now >= peer.nextHeartbeat)
+        {
+            DiscoveryMessage::HeartbeatMessage heartbeat;
+            heartbeat.sequence = ++peer.heartbeatSequence;
+            heartbeat.interval = quint16(settings.heartbeatIntervalMs);
+            if (peer.socket->writeDatagram(heartbeat.encode(), target, settings.targetPort) > 0)
+                sent++;
+            peer.nextHeartbeat = now + settings.heartbeatIntervalMs;
+        }
+    }
+}
+
+/**
+ * @brief Announcement of a peer in its format, as of its generation.
+ */
+QByteArray PeerSimulator::announcement(const Peer &peer) const
+{
+    QString hostname = "sim-" + peer.address;
+    // Binary peers change their port, text ones their files
+    quint16 transferPort = quint16(peer.binary ? 20000 + peer.generation % 1000 : 20000);
+
+    if (peer.binary)
+    {
+        DiscoveryMessage::Announcement message;
+        message.type = DiscoveryMessage::Request;
+        message.discoveryPort = peer.socket->localPort();
+        message.transferPort = transferPort;
+        message.transferVersion = 2;
+        message.hostname = hostname;
+        return message.encode();
+    }
+
+    // Older peers list their files in the announcement itself
+    QJsonArray files;
+    for (int i = 0; i < settings.filesPerPeer; ++i)
+    {
+        QJsonObject file;
+        QString path = QString("folder-%1/file-%2-%3.bin").arg(i % 3).arg(i).arg(peer.generation);
+        file["name"] = path.mid(path.lastIndexOf('/') + 1);
+        file["path"] = path;
+        file["size"] = QString::number(1024 * (i + 1));
+        file["type"] = "file";
+        files.append(file);
+    }
+    QByteArray listing = QJsonDocument(files).toJson(QJsonDocument::Compact);
+    return "LANDROP_DISCOVERY_V1|" + QByteArray::number(peer.socket->localPort()) + '|' +
+           QByteArray::number(transferPort) + '|' + hostname.toUtf8() + '|' + listing + "|P2";
+}
+
+/**
+ * @brief Reads and counts the responses and heartbeats of the service.
+ */
+void PeerSimulator::drain(QUdpSocket *socket)
+{
+    while (socket->hasPendingDatagrams())
+    {
+        QByteArray datagram(int(qMax<qint64>(0, socket->pendingDatagramSize())), '\0');
+        if (socket->readDatagram(datagram.data(), datagram.size()) >= 0)
+            received++;
+    }
+}
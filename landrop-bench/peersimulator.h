@@ -0,0 +1,134 @@
+/**
+ * @file peersimulator.h
+ * @brief Virtual LANDrop peers announcing themselves to one discovery service
+ */
+
+#ifndef PEERSIMULATOR_H
+#define PEERSIMULATOR_H
+
+#include <QObject>
+#include <QUdpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QList>
+#include <atomic>
+
+/**
+ * @class PeerSimulator
+ * @brief Plays hundreds or thousands of peers towards a BroadcastDiscoveryService.
+ *
+ * Each virtual peer has a UDP socket of its own on a loopback address
+ * (127.1.0.1, 127.1.0.2, ... by default), so the service sees as many
+ * senders as there are peers. Peers announce themselves every interval,
+ * spread evenly over it, as text LANDROP_DISCOVERY_V1 lines carrying their
+ * files or as binary DiscoveryMessage requests followed by heartbeats, and
+ * read what the service sends back. A number of announcements per second
+ * change the peer's files (text) or transfer port (binary), so the change
+ * path is measured next to the repeated announcements the service skips.
+ *
+ * Lives on a thread of its own; the counters and send times are read from
+ * the thread of the service.
+ */
+class PeerSimulator : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class Format
+    {
+        Text,
+        Binary,
+        Mixed
+    };
+
+    struct Settings
+    {
+        int peerCount = 300;
+        Format format = Format::Mixed;
+
+        /** Milliseconds between two announcements of a peer */
+        int announceIntervalMs = 5000;
+
+        /** Milliseconds between two heartbeats of a binary peer */
+        int heartbeatIntervalMs = 1000;
+
+        /** Files listed by each text peer */
+        int filesPerPeer = 8;
+
+        /** Announcements per second, over all peers, that change something */
+        double changesPerSecond = 1;
+
+        /** Milliseconds over which the peers join, 0 for all at once */
+        int rampMs = 5000;
+
+        /** First address, peers take the following ones */
+        quint32 firstAddress = (127u << 24) | (1u << 16) | 1u;
+
+        /** Discovery port of the service */
+        quint16 targetPort = 12346;
+    };
+
+    PeerSimulator(const Settings &settings, const QElapsedTimer &clock, QObject *parent = nullptr);
+    ~PeerSimulator();
+
+    /** @brief Address of a virtual peer, as the service reports it. */
+    QString addressOf(int peer) const;
+
+    /** @brief Clock reading the peer at @p ipAddress first announced itself at, -1 if it did not yet. */
+    qint64 firstSentAt(const QString &ipAddress) const;
+
+    /** @brief Clock reading of the last changing announcement of a peer, -1 if none. */
+    qint64 changeSentAt(const QString &ipAddress) const;
+
+    /** Datagrams sent and received by all peers */
+    std::atomic<qint64> sent{0};
+    std::atomic<qint64> received{0};
+
+    /** Sockets that could not be bound, their peers are left out */
+    std::atomic<int> failed{0};
+
+    /** Milliseconds between two runs of the send loop */
+    static const int TICK_MS = 5;
+
+public slots:
+    void start();
+    void stop();
+
+private slots:
+    void tick();
+
+private:
+    struct Peer
+    {
+        QUdpSocket *socket = nullptr;
+        QString address;
+        bool binary = false;
+        bool announced = false;
+        qint64 nextAnnounce = 0;
+        qint64 nextHeartbeat = 0;
+        quint32 heartbeatSequence = 0;
+
+        /** Bumped by every change, it makes the announcement differ */
+        int generation = 0;
+    };
+
+    QByteArray announcement(const Peer &peer) const;
+    void drain(QUdpSocket *socket);
+
+    Settings settings;
+    QElapsedTimer clock;
+    QList<Peer> peers;
+    QTimer *tickTimer;
+
+    /** Announcements still owed to reach changesPerSecond */
+    double changesDue = 0;
+    qint64 lastTick = 0;
+
+    mutable QMutex timesMutex;
+    QHash<QString, qint64> firstSent;
+    QHash<QString, qint64> changeSent;
+};
+
+#endif // PEERSIMULATOR_H
@@ -0,0 +1,135 @@
+/**
+ * @file processusage.cpp
+ */
+
+#include "processusage.h"
+#include <QByteArray>
+#include <QFile>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#if defined(Q_OS_WIN)
+    double seconds(const FILETIME &time)
+    {
+        return (qint64(time.dwHighDateTime) << 32 | time.dwLowDateTime) / 1e7;
+    }
+#endif
+}
+
+double ProcessUsage::cpuSeconds()
+{
+#if defined(Q_OS_WIN)
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+        return 0;
+    return seconds(kernel) + seconds(user);
+#else
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#endif
+}
+
+double ProcessUsage::threadCpuSeconds()
+{
+#if defined(Q_OS_WIN)
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+        return 0;
+    return seconds(kernel) + seconds(user);
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+    timespec time{};
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0)
+        return 0;
+    return time.tv_sec + time.tv_nsec / 1e9;
+#else
+    return cpuSeconds();
+#endif
+}
+
+void ProcessUsage::resetPeakRss()
+{
+#if defined(Q_OS_LINUX)
+    QFile clearRefs("/proc/self/clear_refs");
+    if (clearRefs.open(QIODevice::WriteOnly))
+        clearRefs.write("5");
+#endif
+}
+
+qint64 ProcessUsage::peakRss()
+{
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return qint64(counters.PeakWorkingSetSize);
+#else
+#if defined(Q_OS_LINUX)
+    QFile status("/proc/self/status");
+    if (status.open(QIODevice::ReadOnly))
+    {
+        for (QByteArray line = status.readLine(); !line.isEmpty(); line = status.readLine())
+        {
+            if (line.startsWith("VmHWM:"))
+                return line.mid(6).trimmed().split(' ').first().toLongLong() * 1024;
+        }
+    }
+#endif
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(Q_OS_MACOS)
+    return qint64(usage.ru_maxrss);
+#else
+    return qint64(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+qint64 ProcessUsage::currentRss()
+{
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return qint64(counters.WorkingSetSize);
+#elif defined(Q_OS_LINUX)
+    // Second field of statm: resident pages
+    QFile statm("/proc/self/statm");
+    if (statm.open(QIODevice::ReadOnly))
+    {
+        QList<QByteArray> fields = statm.readAll().split(' ');
+        if (fields.size() > 1)
+            return fields[1].toLongLong() * sysconf(_SC_PAGESIZE);
+    }
+    return peakRss();
+#else
+    return peakRss();
+#endif
+}
+
+qint64 ProcessUsage::raiseFileLimit()
+{
+#if defined(Q_OS_WIN)
+    return -1;
+#else
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+        return -1;
+    if (limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        getrlimit(RLIMIT_NOFILE, &limit);
+    }
+    return limit.rlim_cur == RLIM_INFINITY ? -1 : qint64(limit.rlim_cur);
+#endif
+}
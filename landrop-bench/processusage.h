@@ -0,0 +1,43 @@
+/**
+ * @file processusage.h
+ * @brief CPU time and memory of the benchmark process
+ */
+
+#ifndef PROCESSUSAGE_H
+#define PROCESSUSAGE_H
+
+#include <QtGlobal>
+
+/**
+ * @namespace ProcessUsage
+ * @brief What the running process used so far, read from the system.
+ *
+ * Memory figures are resident bytes. Where the system offers no current
+ * figure, currentRss() falls back on the peak.
+ */
+namespace ProcessUsage
+{
+    /** @brief User and system CPU seconds of the process. */
+    double cpuSeconds();
+
+    /** @brief User and system CPU seconds of the calling thread. */
+    double threadCpuSeconds();
+
+    /** @brief Lets peakRss() measure from now on, where the system allows it (Linux). */
+    void resetPeakRss();
+
+    /** @brief Peak resident memory, since resetPeakRss() or the start of the process. */
+    qint64 peakRss();
+
+    /** @brief Resident memory now. */
+    qint64 currentRss();
+
+    /**
+     * @brief Raises the limit of open files to the hard limit, for benchmarks opening many sockets.
+     *
+     * @return The limit now in force, -1 where there is none to raise
+     */
+    qint64 raiseFileLimit();
+}
+
+#endif // PROCESSUSAGE_H
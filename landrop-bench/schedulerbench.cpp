@@ -0,0 +1,190 @@
+/**
+ * @file schedulerbench.cpp
+ * @brief Throughput benchmark of the transfer scheduler of FileTransferManager
+ *
+ * Sends the same set of small files to a Receiver in the same process over
+ * loopback once per active transfer limit, each file as a transfer of its
+ * own, and reports how long every run took. A limit of 0 starts every
+ * transfer at once, so the runs show what queueing costs or gains against
+ * contention. Results are written as one JSON document.
+ *
+ * Usage: landrop-scheduler-bench [--files 48] [--size 262144] [--limits 0,4] [--output file]
+ */
+
+#include "../landrop-plus/config/config.h"
+#include "../landrop-plus/network/receiver.h"
+#include "../landrop-plus/services/broadcastdiscoveryservice.h"
+#include "../landrop-plus/services/filetransfermanager.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QTimer>
+
+namespace
+{
+    /** Longest time a run may take before it is reported as failed */
+    const int RUN_TIMEOUT_MS = 120000;
+
+    /**
+     * @brief Sends @p files with at most @p limit active transfers and reports the time taken.
+     *
+     * @return The result of the run, with "ok" false if a file did not arrive in time
+     */
+    QJsonObject run(const QStringList &files, qint64 fileSize, int limit)
+    {
+        QJsonObject result;
+        result["limit"] = limit;
+        result["files"] = int(files.size());
+        result["fileBytes"] = fileSize;
+
+        Config::reset();
+        QTemporaryDir targetDir;
+        if (!targetDir.isValid())
+        {
+            result["ok"] = false;
+            return result;
+        }
+        Config::getReceivedFilesPath() = targetDir.path();
+        // One Sender per file, so every file is a transfer of its own
+        Config::getStripeCount() = 2;
+        Config::getStripeThreshold() = 1;
+        Config::getMaxActiveTransfers() = limit;
+        Config::getMaxTransfersPerPeer() = limit;
+
+        Receiver receiver;
+        if (!receiver.startServer(0))
+        {
+            result["ok"] = false;
+            return result;
+        }
+        QObject::connect(&receiver, &Receiver::fileTransferRequested, &receiver,
+                         [&receiver](const QString &, const QString &, QTcpSocket *socket)
+                         { receiver.acceptTransfer(socket); });
+
+        int received = 0;
+        QEventLoop loop;
+        QObject::connect(&receiver, &Receiver::fileReceivedSuccessfully, &loop,
+                         [&](const QString &, const QByteArray &)
+                         {
+            if (++received == files.size())
+                loop.quit(); });
+        QTimer::singleShot(RUN_TIMEOUT_MS, &loop, &QEventLoop::quit);
+
+        FileTransferManager manager;
+        QElapsedTimer timer;
+        timer.start();
+        manager.sendFilesToUsers(files, {LANDropUser("127.0.0.1", "bench", receiver.getServerPort(), "1")});
+        if (received < files.size())
+            loop.exec();
+        qint64 elapsed = qMax<qint64>(1, timer.elapsed());
+
+        result["ok"] = received == files.size();
+        result["received"] = received;
+        result["milliseconds"] = elapsed;
+        result["mibPerSecond"] = double(received) * double(fileSize) / (1024.0 * 1024.0) / (double(elapsed) / 1000.0);
+        return result;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("landrop-scheduler-bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Throughput benchmark of the LANDrop transfer scheduler.");
+    parser.addHelpOption();
+    QCommandLineOption filesOption("files", "Number of files sent in each run.", "count", "48");
+    QCommandLineOption sizeOption("size", "Size of each file in bytes.", "bytes", "262144");
+    QCommandLineOption limitsOption("limits", "Comma separated active transfer limits, 0 for none.", "list", "0,4");
+    QCommandLineOption outputOption("output", "File the JSON results are written to, standard output if none.", "file");
+    parser.addOptions({filesOption, sizeOption, limitsOption, outputOption});
+    parser.process(app);
+
+    QTextStream errors(stderr);
+    bool ok = false;
+    int fileCount = parser.value(filesOption).toInt(&ok);
+    if (!ok || fileCount <= 0)
+    {
+        errors << "landrop-scheduler-bench: invalid --files\n";
+        return 2;
+    }
+    qint64 fileSize = parser.value(sizeOption).toLongLong(&ok);
+    if (!ok || fileSize <= 0)
+    {
+        errors << "landrop-scheduler-bench: invalid --size\n";
+        return 2;
+    }
+    QList<int> limits;
+    for (const QString &value : parser.value(limitsOption).split(',', Qt::SkipEmptyParts))
+    {
+        int limit = value.trimmed().toInt(&ok);
+        if (!ok || limit < 0)
+        {
+            errors << "landrop-scheduler-bench: invalid --limits\n";
+            return 2;
+        }
+        limits.append(limit);
+    }
+    if (limits.isEmpty())
+    {
+        errors << "landrop-scheduler-bench: invalid --limits\n";
+        return 2;
+    }
+
+    QTemporaryDir sourceDir;
+    if (!sourceDir.isValid())
+    {
+        errors << "landrop-scheduler-bench: cannot create a temporary folder\n";
+        return 2;
+    }
+    QStringList files;
+    for (int i = 0; i < fileCount; ++i)
+    {
+        QFile file(sourceDir.path() + QString("/bench%1.bin").arg(i));
+        if (!file.open(QIODevice::WriteOnly) || file.write(QByteArray(int(fileSize), char('a' + i % 26))) != fileSize)
+        {
+            errors << "landrop-scheduler-bench: cannot write " << file.fileName() << "\n";
+            return 2;
+        }
+        files.append(file.fileName());
+    }
+
+    QJsonArray results;
+    for (int limit : std::as_const(limits))
+        results.append(run(files, fileSize, limit));
+    Config::reset();
+
+    QJsonObject report;
+    report["time"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    report["host"] = QSysInfo::machineHostName();
+    report["cpu"] = QSysInfo::currentCpuArchitecture();
+    report["qt"] = QString(qVersion());
+    report["results"] = results;
+
+    QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+    if (parser.isSet(outputOption))
+    {
+        QFile output(parser.value(outputOption));
+        if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate) || output.write(json) != json.size())
+        {
+            errors << "landrop-scheduler-bench: cannot write " << output.fileName() << "\n";
+            return 2;
+        }
+    }
+    else
+    {
+        QTextStream(stdout) << json;
+    }
+    return 0;
+}
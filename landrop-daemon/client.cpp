@@ -0,0 +1,390 @@
+/**
+ * @file client.cpp
+ * @brief Command line LANDrop client
+ *
+ * Speaks the protocol of landrop-plus through its FileTransferManager, so
+ * files sent with it take the same paths as from the desktop application:
+ * batches, archives of small files, striping, resume, delta and fan-out
+ * to several recipients, all driven by the transfer scheduler.
+ *
+ * Usage: landrop-client peers [--wait seconds]
+ *        landrop-client send --to name [--to name...] [--manifest file] [--concurrency n]
+ *                            [--per-peer n] [--wait seconds] [--protocol 1|2]
+ *                            [--settings file] [--progress] [path or glob...]
+ *
+ * Recipients are looked up by host name or address among the peers
+ * discovery finds within --wait seconds, which gives their port and
+ * protocol. Names discovery does not find, for instance when the
+ * discovery port is taken by a daemon on this machine, are resolved as
+ * host[:port] through DNS.
+ *
+ * Paths may be globs, where "*" and "?" match within a folder and "**"
+ * across folders. They are expanded here, so quoted ones work in any
+ * shell. A manifest lists one path or glob per line, relative to the
+ * manifest's folder, "#" starting a comment.
+ *
+ * "send" prints the outcome of every transfer and the aggregate
+ * throughput, and exits with 0 once every file was received, 1 if one
+ * failed or was refused, 2 on bad arguments.
+ */
+
+#include "quithandler.h"
+#include "transferreporter.h"
+#include "../landrop-plus/config/config.h"
+#include "../landrop-plus/network/protocol.h"
+#include "../landrop-plus/services/broadcastdiscoveryservice.h"
+#include "../landrop-plus/services/filetransfermanager.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QEventLoop>
+#include <QFileInfo>
+#include <QHostInfo>
+#include <QRegularExpression>
+#include <QTextStream>
+#include <QTimer>
+
+namespace
+{
+    /**
+     * @brief Lists the peers discovery finds within @p seconds.
+     */
+    int listPeers(int seconds)
+    {
+        BroadcastDiscoveryService discovery;
+        if (!discovery.isDiscovering())
+        {
+            // Discovery listens on a fixed port, one process per machine has it
+            QTextStream(stderr) << "landrop-client: the discovery port is taken, by landropd or LANDrop on this machine?\n";
+            return 1;
+        }
+
+        QEventLoop loop;
+        QTimer::singleShot(seconds * 1000, &loop, &QEventLoop::quit);
+        loop.exec();
+
+        QTextStream out(stdout);
+        for (const LANDropUser &user : discovery.users())
+        {
+            out << user.ipAddress << ":" << user.transferPort << "\t" << user.hostname << "\tv" << user.version
+                << "\t" << user.sharedFileCount() << " shared\n";
+        }
+        return 0;
+    }
+
+    bool isGlob(const QString &path)
+    {
+        return path.contains('*') || path.contains('?') || path.contains('[');
+    }
+
+    /**
+     * @brief Regular expression of a glob matched against paths relative to its base folder.
+     *
+     * "*" and "?" stay within a folder, "**\/" spans any number of them.
+     */
+    QRegularExpression globExpression(const QString &glob)
+    {
+        QString pattern;
+        for (int i = 0; i < glob.size(); ++i)
+        {
+            QChar c = glob.at(i);
+            if (c == '*' && glob.mid(i, 3) == "**/")
+            {
+                pattern += "(?:.*/)?";
+                i += 2;
+            }
+            else if (c == '*' && glob.mid(i, 2) == "**")
+            {
+                pattern += ".*";
+                i += 1;
+            }
+            else if (c == '*')
+                pattern += "[^/]*";
+            else if (c == '?')
+                pattern += "[^/]";
+            else if (c == '[')
+            {
+                int close = glob.indexOf(']', i + 1);
+                if (close < 0)
+                {
+                    pattern += "\\[";
+                    continue;
+                }
+                QString set = glob.mid(i + 1, close - i - 1);
+                if (set.startsWith('!'))
+                    set[0] = '^';
+                pattern += '[' + set + ']';
+                i = close;
+            }
+            else
+                pattern += QRegularExpression::escape(QString(c));
+        }
+        return QRegularExpression(QRegularExpression::anchoredPattern(pattern));
+    }
+
+    /**
+     * @brief Files matching a glob, sorted, or the path itself when it is none.
+     */
+    QStringList expand(const QString &path)
+    {
+        QString normalized = QDir::fromNativeSeparators(path);
+        if (!isGlob(normalized))
+            return {normalized};
+
+        // The folders before the first wildcard are walked from
+        QStringList parts = normalized.split('/');
+        QStringList baseParts;
+        while (!parts.isEmpty() && !isGlob(parts.first()))
+            baseParts.append(parts.takeFirst());
+        QString base = baseParts.isEmpty() ? QString(".") : baseParts.join('/');
+        if (base.isEmpty())
+            base = "/";
+        QString rest = parts.join('/');
+        QRegularExpression expression = globExpression(rest);
+        bool recursive = rest.contains('/') || rest.contains("**");
+
+        QStringList matches;
+        QDir baseDir(base);
+        QDirIterator it(base, QDir::Files | QDir::NoDotAndDotDot,
+                        recursive ? QDirIterator::Subdirectories : QDirIterator::NoIteratorFlags);
+        while (it.hasNext())
+        {
+            QString file = it.next();
+            if (expression.match(baseDir.relativeFilePath(file)).hasMatch())
+                matches.append(file);
+        }
+        matches.sort();
+        return matches;
+    }
+
+    /**
+     * @brief Paths and globs of a manifest, relative ones taken from its folder.
+     *
+     * @return false if the manifest cannot be read
+     */
+    bool readManifest(const QString &manifestPath, QStringList *paths)
+    {
+        QFile manifest(manifestPath);
+        if (!manifest.open(QIODevice::ReadOnly | QIODevice::Text))
+            return false;
+
+        QDir folder = QFileInfo(manifestPath).absoluteDir();
+        while (!manifest.atEnd())
+        {
+            QString line = QString::fromUtf8(manifest.readLine()).trimmed();
+            if (line.isEmpty() || line.startsWith('#'))
+                continue;
+            paths->append(QDir::isAbsolutePath(line) ? line : folder.filePath(line));
+        }
+        return true;
+    }
+
+    /**
+     * @brief Finds the recipients among the peers discovery announces.
+     *
+     * Waits up to @p seconds, less once every name was found.
+     *
+     * @param names Host names or addresses, an optional ":port" is ignored here
+     * @return Peer found for each name, by name
+     */
+    QMap<QString, LANDropUser> discoverTargets(const QStringList &names, int seconds)
+    {
+        QMap<QString, LANDropUser> found;
+        BroadcastDiscoveryService discovery;
+        if (!discovery.isDiscovering() || seconds <= 0)
+            return found;
+
+        auto match = [&]()
+        {
+            for (const LANDropUser &user : discovery.users())
+            {
+                for (const QString &name : names)
+                {
+                    QString host = name.section(':', 0, 0);
+                    if (!found.contains(name) &&
+                        (user.hostname.compare(host, Qt::CaseInsensitive) == 0 || user.ipAddress == host ||
+                         user.hostname.section('.', 0, 0).compare(host, Qt::CaseInsensitive) == 0))
+                        found.insert(name, user);
+                }
+            }
+            return found.size() == names.size();
+        };
+
+        QEventLoop loop;
+        QTimer::singleShot(seconds * 1000, &loop, &QEventLoop::quit);
+        QObject::connect(&discovery, &BroadcastDiscoveryService::userListUpdated, &loop, [&]()
+                         {
+            if (match())
+                loop.quit(); });
+        if (!match())
+            loop.exec();
+        return found;
+    }
+
+    /**
+     * @brief Resolves a recipient given as host[:port] through DNS.
+     *
+     * @return The recipient, with an empty address if it cannot be resolved
+     */
+    LANDropUser resolveTarget(const QString &target, const QString &version)
+    {
+        QString host = target;
+        quint16 port = quint16(Config::getPort());
+        int colon = target.lastIndexOf(':');
+        if (colon > 0 && target.indexOf(':') == colon)
+        {
+            host = target.left(colon);
+            port = quint16(target.mid(colon + 1).toUInt());
+        }
+
+        // Transfers connect to addresses, names are resolved once here
+        QHostAddress address(host);
+        if (address.isNull())
+        {
+            for (const QHostAddress &candidate : QHostInfo::fromName(host).addresses())
+            {
+                if (candidate.protocol() == QAbstractSocket::IPv4Protocol)
+                {
+                    address = candidate;
+                    break;
+                }
+            }
+        }
+        if (address.isNull() || port == 0)
+            return LANDropUser();
+        return LANDropUser(address.toString(), host, port, version);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("landrop-client");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Sends files to LANDrop peers and lists the peers on the network.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("command", "peers or send");
+    parser.addPositionalArgument("paths", "Files, folders and globs to send.", "[paths...]");
+    QCommandLineOption waitOption("wait", "Seconds peers are looked for.", "seconds", "3");
+    QCommandLineOption toOption("to", "Recipient host name or address, repeat for several.", "name[:port]");
+    QCommandLineOption manifestOption("manifest", "File listing the paths and globs to send, one per line.", "file");
+    QCommandLineOption concurrencyOption("concurrency", "Transfers running at once, 0 for no limit.", "n");
+    QCommandLineOption perPeerOption("per-peer", "Transfers running at once to one recipient, 0 for no limit.", "n");
+    QCommandLineOption protocolOption("protocol", "Protocol version of recipients not found by discovery.", "version",
+                                      QString::number(Protocol::VERSION_2));
+    QCommandLineOption settingsOption("settings", "Settings file the transfer options are read from.", "file");
+    QCommandLineOption progressOption("progress", "Print the progress of every transfer.");
+    parser.addOptions({waitOption, toOption, manifestOption, concurrencyOption, perPeerOption, protocolOption,
+                       settingsOption, progressOption});
+    parser.process(app);
+    QTextStream errors(stderr);
+
+    // Without a settings file the defaults apply, nothing is written
+    Config::reset();
+    if (parser.isSet(settingsOption))
+    {
+        Config::getSettingsPath() = parser.value(settingsOption);
+        Config::readFromFile();
+    }
+
+    QStringList arguments = parser.positionalArguments();
+    QString command = arguments.value(0);
+    int waitSeconds = qMax(0, parser.value(waitOption).toInt());
+    if (command == "peers")
+        return listPeers(qMax(1, waitSeconds));
+    if (command != "send")
+        parser.showHelp(2);
+
+    QStringList patterns = arguments.mid(1);
+    if (parser.isSet(manifestOption) && !readManifest(parser.value(manifestOption), &patterns))
+    {
+        errors << "landrop-client: cannot read " << parser.value(manifestOption) << "\n";
+        return 2;
+    }
+    QStringList targets = parser.values(toOption);
+    if (patterns.isEmpty() || targets.isEmpty())
+    {
+        errors << "landrop-client: send needs --to and at least one path\n";
+        return 2;
+    }
+
+    QStringList files;
+    QStringList folders;
+    for (const QString &pattern : patterns)
+    {
+        QStringList matches = expand(pattern);
+        if (matches.isEmpty())
+        {
+            errors << "landrop-client: nothing matches " << pattern << "\n";
+            return 2;
+        }
+        for (const QString &path : matches)
+        {
+            QFileInfo info(path);
+            QString absolute = info.absoluteFilePath();
+            if (info.isDir() && !folders.contains(absolute))
+                folders.append(absolute);
+            else if (info.isFile() && !files.contains(absolute))
+                files.append(absolute);
+            else if (!info.exists())
+            {
+                errors << "landrop-client: no such file " << path << "\n";
+                return 2;
+            }
+        }
+    }
+
+    QMap<QString, LANDropUser> discovered = discoverTargets(targets, waitSeconds);
+    QList<LANDropUser> recipients;
+    for (const QString &target : targets)
+    {
+        LANDropUser user = discovered.contains(target) ? discovered.value(target)
+                                                       : resolveTarget(target, parser.value(protocolOption));
+        if (user.ipAddress.isEmpty())
+        {
+            errors << "landrop-client: cannot find " << target << "\n";
+            return 2;
+        }
+        // A port given explicitly wins over the announced one
+        if (discovered.contains(target) && target.count(':') == 1)
+            user.transferPort = quint16(target.section(':', 1).toUInt());
+        recipients.append(user);
+    }
+
+    // The scheduler runs this many at once, the others wait for a slot
+    if (parser.isSet(concurrencyOption))
+        Config::getMaxActiveTransfers() = qMax(0, parser.value(concurrencyOption).toInt());
+    if (parser.isSet(perPeerOption))
+        Config::getMaxTransfersPerPeer() = qMax(0, parser.value(perPeerOption).toInt());
+    else if (parser.isSet(concurrencyOption))
+        Config::getMaxTransfersPerPeer() = Config::getMaxActiveTransfers();
+
+    QuitHandler::install();
+    FileTransferManager manager;
+    manager.setDiscoveredUsers(recipients);
+    TransferReporter reporter(&manager);
+    reporter.setShowProgress(parser.isSet(progressOption));
+    QObject::connect(&reporter, &TransferReporter::idle, &app, &QCoreApplication::quit);
+
+    if (!files.isEmpty())
+        manager.sendFilesToUsers(files, recipients);
+    for (const QString &folder : folders)
+        manager.sendFolderToUsers(folder, recipients);
+
+    app.exec();
+
+    if (reporter.sessionCount() == 0)
+    {
+        errors << "landrop-client: nothing to send\n";
+        return 1;
+    }
+    reporter.printSummary();
+    if (!reporter.isIdle())
+    {
+        errors << "landrop-client: interrupted\n";
+        return 1;
+    }
+    return reporter.failedCount() == 0 ? 0 : 1;
+}
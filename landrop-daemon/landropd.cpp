@@ -0,0 +1,199 @@
+/**
+ * @file landropd.cpp
+ * @brief Headless LANDrop daemon
+ *
+ * Runs the receiver, the shared folder and discovery of landrop-plus
+ * without a user interface, for machines with no display. Incoming
+ * transfers are accepted by the auto-accept policy and rules (see
+ * AutoAcceptPolicy), those they do not cover are refused, as nobody is there to ask. The transfer scheduler,
+ * the receiver worker threads and every setting of the settings file
+ * apply as in the desktop application.
+ *
+ * With encryption enabled a self-signed certificate is created on first
+ * run if none exists (see SecureTransport::prepareServer()), and the
+ * daemon does not start without a usable one.
+ *
+ * Usage: landropd [--settings file] [--receive-dir dir] [--share-dir dir] [--port n]
+ *                 [--auto-accept none|peers|all] [--accept-rules file]
+ *                 [--tls-cert file --tls-key file] [--require-encryption] [--no-discovery] [--metrics file]
+ *                 [--trace file] [--progress]
+ */
+
+#include "quithandler.h"
+#include "transferreporter.h"
+#include "../landrop-plus/config/config.h"
+#include "../landrop-plus/network/securetransport.h"
+#include "../landrop-plus/network/transfertrace.h"
+#include "../landrop-plus/services/broadcastdiscoveryservice.h"
+#include "../landrop-plus/services/filetransfermanager.h"
+#include "../landrop-plus/services/sharedfilemanager.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QTextStream>
+
+namespace
+{
+    /** Auto-accept names, by Config::getAutoAccept() value */
+    const QStringList AUTO_ACCEPT_NAMES = {"none", "peers", "all"};
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("landropd");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless LANDrop: receives, serves the shared folder and announces itself.");
+    parser.addHelpOption();
+    QCommandLineOption settingsOption("settings", "Settings file, created with the defaults if missing.", "file",
+                                      Config::getSettingsPath());
+    QCommandLineOption receiveOption("receive-dir", "Folder received files are saved in.", "dir");
+    QCommandLineOption shareOption("share-dir", "Folder shared with the peers.", "dir");
+    QCommandLineOption portOption("port", "TCP port transfers are received on.", "port");
+    QCommandLineOption autoAcceptOption("auto-accept",
+                                        "Transfers accepted without asking: none, peers (discovered ones) or all.",
+                                        "policy");
+    QCommandLineOption rulesOption("accept-rules", "JSON rules accepting transfers from trusted peers.", "file",
+                                   Config::getAutoAcceptRulesPath());
+    QCommandLineOption certificateOption("tls-cert", "PEM certificate, encrypts transfers with TLS 1.3.", "file");
+    QCommandLineOption keyOption("tls-key", "PEM private key of the certificate.", "file");
+    QCommandLineOption requireOption("require-encryption", "Refuse unencrypted connections, implies encryption.");
+    QCommandLineOption noDiscoveryOption("no-discovery", "Neither announce this machine nor look for peers.");
+    QCommandLineOption metricsOption("metrics", "File the transfer metrics are written to every second.", "file");
+    QCommandLineOption traceOption("trace", "File a Chrome trace of the transfers is recorded to.", "file");
+    QCommandLineOption progressOption("progress", "Log the progress of every transfer.");
+    parser.addOptions({settingsOption, receiveOption, shareOption, portOption, autoAcceptOption, rulesOption,
+                       certificateOption, keyOption, requireOption, noDiscoveryOption, metricsOption, traceOption,
+                       progressOption});
+    parser.process(app);
+    QTextStream errors(stderr);
+
+    // Options override the settings file for this run only
+    QString settingsPath = parser.value(settingsOption);
+    Config::getSettingsPath() = settingsPath;
+    Config::readFromFile();
+    Config::getSettingsPath() = settingsPath;
+
+    if (parser.isSet(receiveOption))
+        Config::getReceivedFilesPath() = parser.value(receiveOption);
+    if (parser.isSet(shareOption))
+        Config::getSharedFolderPath() = parser.value(shareOption);
+    if (parser.isSet(portOption))
+    {
+        bool ok = false;
+        int port = parser.value(portOption).toInt(&ok);
+        if (!ok || port <= 0 || port > 65535)
+        {
+            errors << "landropd: invalid port " << parser.value(portOption) << "\n";
+            return 2;
+        }
+        Config::getPort() = port;
+    }
+    if (parser.isSet(autoAcceptOption))
+    {
+        int policy = AUTO_ACCEPT_NAMES.indexOf(parser.value(autoAcceptOption));
+        if (policy < 0)
+        {
+            errors << "landropd: invalid auto-accept policy " << parser.value(autoAcceptOption) << "\n";
+            return 2;
+        }
+        Config::getAutoAccept() = policy;
+    }
+    Config::getAutoAcceptRulesPath() = parser.value(rulesOption);
+    if (parser.isSet(certificateOption) || parser.isSet(keyOption))
+    {
+        if (!parser.isSet(certificateOption) || !parser.isSet(keyOption))
+        {
+            errors << "landropd: --tls-cert and --tls-key go together\n";
+            return 2;
+        }
+        Config::getTlsCertificatePath() = parser.value(certificateOption);
+        Config::getTlsKeyPath() = parser.value(keyOption);
+        Config::getEncryptionEnabled() = true;
+    }
+    if (parser.isSet(requireOption))
+        Config::getEncryptionRequired() = true;
+    if ((Config::getEncryptionEnabled() || Config::getEncryptionRequired()) && !SecureTransport::enabled())
+    {
+        errors << "landropd: encryption is enabled but no TLS library is available\n";
+        return 2;
+    }
+    QString tlsError;
+    if (SecureTransport::enabled() && !SecureTransport::prepareServer(&tlsError))
+    {
+        errors << "landropd: " << tlsError << "\n";
+        return 2;
+    }
+    if (parser.isSet(metricsOption))
+        Config::getMetricsDumpPath() = parser.value(metricsOption);
+    if (parser.isSet(traceOption))
+        Config::getTracePath() = parser.value(traceOption);
+
+    QDir().mkpath(Config::getReceivedFilesPath());
+    QDir().mkpath(Config::getSharedFolderPath());
+    if (!Config::getTracePath().isEmpty() && !TransferTrace::start(Config::getTracePath()))
+    {
+        errors << "landropd: cannot write " << Config::getTracePath() << "\n";
+        return 2;
+    }
+    QuitHandler::install();
+
+    FileTransferManager manager;
+    if (!manager.reloadAutoAcceptRules())
+    {
+        errors << "landropd: invalid auto-accept rules in " << Config::getAutoAcceptRulesPath() << "\n";
+        return 2;
+    }
+    TransferReporter reporter(&manager);
+    reporter.setShowProgress(parser.isSet(progressOption));
+
+    // Nobody can answer a request here, what the policy leaves out is refused
+    QObject::connect(&manager, &FileTransferManager::batchTransferRequested, &manager,
+                     [&manager](const QMap<QString, qint64> &files, const QMap<QString, QTcpSocket *> &sockets)
+                     {
+        for (auto it = files.constBegin(); it != files.constEnd(); ++it)
+            manager.rejectIncomingTransfer(sockets.value(it.key()), it.key()); });
+
+    manager.setupReceiver();
+    if (!manager.getReceiver())
+    {
+        errors << "landropd: cannot listen on port " << Config::getPort() << "\n";
+        return 1;
+    }
+
+    SharedFileManager sharedFiles;
+    sharedFiles.startWatching();
+
+    BroadcastDiscoveryService *discovery = nullptr;
+    if (!parser.isSet(noDiscoveryOption))
+    {
+        discovery = new BroadcastDiscoveryService(&app);
+        discovery->setSharedFileManager(&sharedFiles);
+        QObject::connect(discovery, &BroadcastDiscoveryService::userListUpdated, &manager,
+                         &FileTransferManager::setDiscoveredUsers);
+        QObject::connect(discovery, &BroadcastDiscoveryService::peerAdded, &reporter, [](const LANDropUser &user)
+                         { TransferReporter::print(QString("Peer %1 (%2) found").arg(user.hostname, user.ipAddress)); });
+        QObject::connect(discovery, &BroadcastDiscoveryService::peerRemoved, &reporter, [](const QString &ipAddress)
+                         { TransferReporter::print(QString("Peer %1 gone").arg(ipAddress)); });
+    }
+
+    int ruleCount = manager.getAutoAcceptPolicy().rules().size();
+    TransferReporter::print(QString("Listening on port %1, saving to %2, sharing %3, auto-accept %4, %5 rules%6%7")
+                                .arg(Config::getPort())
+                                .arg(QDir(Config::getReceivedFilesPath()).absolutePath(),
+                                     QDir(Config::getSharedFolderPath()).absolutePath(),
+                                     AUTO_ACCEPT_NAMES.value(Config::getAutoAccept()))
+                                .arg(ruleCount)
+                                .arg(discovery ? QString() : QString(", discovery off"))
+                                .arg(SecureTransport::required() ? QString(", TLS only")
+                                     : SecureTransport::enabled() ? QString(", TLS") : QString()));
+    if (Config::getAutoAccept() == 0 && ruleCount == 0)
+        TransferReporter::print("Every incoming transfer is refused, see --auto-accept and --accept-rules");
+
+    int result = app.exec();
+    TransferReporter::print("Stopping");
+    delete discovery;
+    TransferTrace::stop();
+    return result;
+}
@@ -0,0 +1,66 @@
+/**
+ * @file quithandler.cpp
+ */
+
+#include "quithandler.h"
+#include <QCoreApplication>
+#include <QMetaObject>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#else
+#include <QSocketNotifier>
+#include <csignal>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#if defined(Q_OS_WIN)
+    BOOL WINAPI onConsoleEvent(DWORD)
+    {
+        QMetaObject::invokeMethod(QCoreApplication::instance(), "quit", Qt::QueuedConnection);
+        return TRUE;
+    }
+#else
+    /** Written by the signal handler, read by the event loop */
+    int signalPipe[2] = {-1, -1};
+
+    void onSignal(int)
+    {
+        // Only async-signal-safe calls here, the event loop does the rest
+        char byte = 1;
+        ssize_t written = ::write(signalPipe[0], &byte, 1);
+        Q_UNUSED(written);
+    }
+#endif
+}
+
+void QuitHandler::install()
+{
+#if defined(Q_OS_WIN)
+    SetConsoleCtrlHandler(onConsoleEvent, TRUE);
+#else
+    if (signalPipe[0] >= 0 || ::socketpair(AF_UNIX, SOCK_STREAM, 0, signalPipe) != 0)
+        return;
+
+    QSocketNotifier *notifier = new QSocketNotifier(signalPipe[1], QSocketNotifier::Read, QCoreApplication::instance());
+    QObject::connect(notifier, &QSocketNotifier::activated, QCoreApplication::instance(), []()
+                     {
+        char byte;
+        ssize_t read = ::read(signalPipe[1], &byte, 1);
+        Q_UNUSED(read);
+        QCoreApplication::quit(); });
+
+    struct sigaction action = {};
+    action.sa_handler = onSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    // The kernel send path on a connection the peer closed would raise it
+    signal(SIGPIPE, SIG_IGN);
+#endif
+}
@@ -0,0 +1,22 @@
+/**
+ * @file quithandler.h
+ * @brief Clean shutdown of the headless programs on a termination signal
+ */
+
+#ifndef QUITHANDLER_H
+#define QUITHANDLER_H
+
+/**
+ * @namespace QuitHandler
+ * @brief Turns SIGINT and SIGTERM (console close events on Windows) into QCoreApplication::quit().
+ *
+ * The event loop returns normally, so the transfer threads are stopped,
+ * partial files are kept for resuming and a trace being recorded is closed.
+ */
+namespace QuitHandler
+{
+    /** @brief Installs the handlers, once QCoreApplication exists. */
+    void install();
+}
+
+#endif // QUITHANDLER_H
@@ -0,0 +1,211 @@
+/**
+ * @file transferreporter.cpp
+ */
+
+#include "transferreporter.h"
+#include <QDateTime>
+#include <QTextStream>
+#include <algorithm>
+
+namespace
+{
+    QString statusName(TransferStatus status)
+    {
+        switch (status)
+        {
+        case TransferStatus::FINISHED:
+            return "finished";
+        case TransferStatus::CANCELLED:
+            return "refused";
+        case TransferStatus::ERROR:
+            return "failed";
+        case TransferStatus::IN_PROGRESS:
+            return "running";
+        default:
+            return "waiting";
+        }
+    }
+}
+
+/**
+ * @brief Starts following the sessions of @p manager.
+ */
+TransferReporter::TransferReporter(FileTransferManager *manager, QObject *parent)
+    : QObject(parent), manager(manager), idleTimer(new QTimer(this))
+{
+    clock.start();
+    connect(manager, &FileTransferManager::transferSessionCreated, this, &TransferReporter::onSessionCreated);
+    connect(manager, &FileTransferManager::transferStatusChanged, this, &TransferReporter::onStatusChanged);
+    connect(manager, &FileTransferManager::transferProgressBatchUpdated, this, &TransferReporter::onProgressUpdated);
+
+    idleTimer->setInterval(250);
+    connect(idleTimer, &QTimer::timeout, this, &TransferReporter::checkIdle);
+    idleTimer->start();
+}
+
+QList<TransferReporter::Record> TransferReporter::sessions() const
+{
+    QList<Record> list = records.values();
+    std::sort(list.begin(), list.end(), [](const Record &a, const Record &b)
+              { return a.sessionId < b.sessionId; });
+    return list;
+}
+
+/**
+ * @brief Whether every session resolved and the manager has nothing left to start.
+ */
+bool TransferReporter::isIdle() const
+{
+    for (const Record &record : records)
+    {
+        if (!record.resolved())
+            return false;
+    }
+    return manager->getActiveTransferCount() == 0 && manager->getQueuedTransferCount() == 0 &&
+           manager->getPendingFolderCount() == 0;
+}
+
+void TransferReporter::printSummary() const
+{
+    QTextStream out(stdout);
+    out << QString("%1  %2  %3  %4  %5\n")
+               .arg("STATUS", -8)
+               .arg("SIZE", 10)
+               .arg("TIME", 8)
+               .arg("RATE", 12)
+               .arg("FILE");
+
+    qint64 bytes = 0;
+    qint64 first = -1;
+    qint64 last = -1;
+    for (const Record &record : sessions())
+    {
+        qint64 start = record.startedMs >= 0 ? record.startedMs : record.createdMs;
+        qint64 end = record.resolved() ? record.endedMs : clock.elapsed();
+        qint64 duration = qMax<qint64>(0, end - start);
+        bool done = (record.status == TransferStatus::FINISHED);
+        QString rate = done && duration > 0 ? formatBytes(record.size * 1000 / duration) + "/s" : QString("-");
+        out << QString("%1  %2  %3  %4  %5 -> %6\n")
+                   .arg(statusName(record.status), -8)
+                   .arg(formatBytes(record.size), 10)
+                   .arg(QString::number(duration / 1000.0, 'f', 1) + " s", 8)
+                   .arg(rate, 12)
+                   .arg(record.fileName, record.recipient);
+
+        if (done)
+            bytes += record.size;
+        first = first < 0 ? start : qMin(first, start);
+        last = qMax(last, end);
+    }
+
+    qint64 wall = qMax<qint64>(0, last - first);
+    out << QString("%1 of %2 transfers finished, %3 in %4 s, %5/s\n")
+               .arg(finished)
+               .arg(records.size())
+               .arg(formatBytes(bytes))
+               .arg(wall / 1000.0, 0, 'f', 1)
+               .arg(formatBytes(wall > 0 ? bytes * 1000 / wall : 0));
+    out.flush();
+}
+
+void TransferReporter::print(const QString &message)
+{
+    static QTextStream out(stdout);
+    out << QDateTime::currentDateTime().toString("HH:mm:ss") << "  " << message << Qt::endl;
+}
+
+QString TransferReporter::formatBytes(qint64 bytes)
+{
+    const char *units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+    double value = bytes;
+    int unit = 0;
+    while (value >= 1024 && unit < 4)
+    {
+        value /= 1024;
+        unit++;
+    }
+    return unit == 0 ? QString("%1 B").arg(bytes) : QString("%1 %2").arg(value, 0, 'f', 1).arg(units[unit]);
+}
+
+void TransferReporter::onSessionCreated(int sessionId, const QString &fileName, const QString &recipient)
+{
+    Record record;
+    record.sessionId = sessionId;
+    record.fileName = fileName;
+    record.recipient = recipient;
+    record.size = manager->getSession(sessionId).fileSize;
+    record.createdMs = clock.elapsed();
+
+    // Outgoing sessions are named after the file and the recipient
+    QString suffix = " @" + recipient;
+    if (record.fileName.endsWith(suffix))
+        record.fileName.chop(suffix.size());
+    records.insert(sessionId, record);
+
+    QString sizeText = record.size > 0 ? QString(" (%1)").arg(formatBytes(record.size)) : QString();
+    if (recipient == "Incoming")
+        print(QString("Incoming %1%2").arg(record.fileName, sizeText));
+    else
+        print(QString("Queued %1%2 for %3").arg(record.fileName, sizeText, recipient));
+}
+
+void TransferReporter::onStatusChanged(int sessionId, TransferStatus status)
+{
+    auto found = records.find(sessionId);
+    if (found == records.end() || found->resolved())
+        return;
+
+    Record &record = found.value();
+    record.status = status;
+    switch (status)
+    {
+    case TransferStatus::IN_PROGRESS:
+        if (record.startedMs < 0)
+            record.startedMs = clock.elapsed();
+        break;
+    case TransferStatus::FINISHED:
+    case TransferStatus::CANCELLED:
+    case TransferStatus::ERROR:
+        record.endedMs = clock.elapsed();
+        if (status == TransferStatus::FINISHED)
+            finished++;
+        else
+            failed++;
+        print(QString("%1 %2").arg(record.fileName, statusName(status)));
+        break;
+    default:
+        break;
+    }
+    checkIdle();
+}
+
+void TransferReporter::onProgressUpdated(const QList<TransferProgress> &updates)
+{
+    if (!showProgress)
+        return;
+
+    for (const TransferProgress &update : updates)
+    {
+        int step = update.progress / PROGRESS_STEP * PROGRESS_STEP;
+        if (!records.contains(update.sessionId) || step <= reportedProgress.value(update.sessionId) || step >= 100)
+            continue;
+        reportedProgress.insert(update.sessionId, step);
+
+        QString rate = update.bytesPerSecond > 0 ? QString(", %1/s").arg(formatBytes(update.bytesPerSecond)) : QString();
+        QString eta = update.secondsRemaining >= 0 ? QString(", %1 s left").arg(update.secondsRemaining) : QString();
+        print(QString("  %1 %2%%3%4").arg(records.value(update.sessionId).fileName).arg(step).arg(rate, eta));
+    }
+}
+
+/**
+ * @brief Emits idle() when nothing is left to wait for.
+ *
+ * Polled until then, so a folder that turns out empty ends the wait too.
+ */
+void TransferReporter::checkIdle()
+{
+    if (!isIdle())
+        return;
+    idleTimer->stop();
+    emit idle();
+}
@@ -0,0 +1,100 @@
+/**
+ * @file transferreporter.h
+ * @brief Console log of the transfers of a FileTransferManager
+ */
+
+#ifndef TRANSFERREPORTER_H
+#define TRANSFERREPORTER_H
+
+#include "../landrop-plus/services/filetransfermanager.h"
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QTimer>
+
+/**
+ * @class TransferReporter
+ * @brief Prints a line for every transfer session that starts or changes state.
+ *
+ * Used by landropd, which logs what it receives and serves, and by
+ * landrop-client, which waits with idle() for what it sent to resolve and
+ * prints the outcome of every session with printSummary(). Progress
+ * lines, every PROGRESS_STEP percent, are printed on request.
+ */
+class TransferReporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** Percent between two progress lines */
+    static const int PROGRESS_STEP = 10;
+
+    /** What became of one session. */
+    struct Record
+    {
+        int sessionId = -1;
+        QString fileName;
+        QString recipient;
+        qint64 size = 0;
+        TransferStatus status = TransferStatus::WAITING;
+
+        /** Milliseconds on the reporter's clock, -1 until it happened */
+        qint64 createdMs = 0;
+        qint64 startedMs = -1;
+        qint64 endedMs = -1;
+
+        bool resolved() const { return endedMs >= 0; }
+    };
+
+    explicit TransferReporter(FileTransferManager *manager, QObject *parent = nullptr);
+
+    void setShowProgress(bool show) { showProgress = show; }
+
+    int sessionCount() const { return records.size(); }
+    int finishedCount() const { return finished; }
+    int failedCount() const { return failed; }
+
+    /** @brief Every session seen, in creation order. */
+    QList<Record> sessions() const;
+
+    bool isIdle() const;
+
+    /** @brief Prints a table of the sessions, then the totals and the aggregate throughput. */
+    void printSummary() const;
+
+    /** @brief Prints a timestamped line on the standard output. */
+    static void print(const QString &message);
+
+    /** @brief Byte count with a binary unit, "1.5 MiB". */
+    static QString formatBytes(qint64 bytes);
+
+signals:
+    /** @brief Emitted when every session seen so far resolved and nothing is queued or being listed. */
+    void idle();
+
+private slots:
+    void onSessionCreated(int sessionId, const QString &fileName, const QString &recipient);
+    void onStatusChanged(int sessionId, TransferStatus status);
+    void onProgressUpdated(const QList<TransferProgress> &updates);
+    void checkIdle();
+
+private:
+    FileTransferManager *manager;
+
+    QHash<int, Record> records;
+
+    /** Last progress printed per session */
+    QHash<int, int> reportedProgress;
+
+    bool showProgress = false;
+    int finished = 0;
+    int failed = 0;
+
+    /** Runs from construction, session times are read on it */
+    QElapsedTimer clock;
+
+    /** Folders are listed before their sessions exist, idle() waits for them */
+    QTimer *idleTimer;
+};
+
+#endif // TRANSFERREPORTER_H
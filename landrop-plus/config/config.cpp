@@ -3,44 +3,477 @@
  */
 
 #include "config.h"
+#include <QAtomicInteger>
 #include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QTcpServer>
+#include <QThread>
 #include <QCoreApplication>
 
-// Thread-safe static accessors with guaranteed initialization order
+namespace
+{
+    /** Every setting, the GUI thread's copy or the one of another thread (see Config::publish()). */
+    struct Values
+    {
+        QString receivedFilesPath = "./Received Files";
+        QString sharedFolderPath = "./Shared Files";
+        QString settingsPath = "./settings.txt";
+        QString sharedIndexPath = "./shared-index.json";
+        QString contentIndexPath = "./content-index.log";
+        QString historyPath = "./transfer-history.log";
+        QString autoAcceptRulesPath = "./auto-accept.json";
+        QString transferProfilesPath = "./profiles.json";
+        QString tlsCertificatePath = "./landrop-cert.pem";
+        QString tlsKeyPath = "./landrop-key.pem";
+        QString trustedPeersPath = "./trusted-peers.txt";
+        int port = 5556;
+        int bufferSize = 65536;
+        bool zeroCopyEnabled = true;
+        qint64 mappedSourceThreshold = 16 * 1024 * 1024;
+        int stripeCount = 4;
+        qint64 stripeThreshold = 256 * 1024 * 1024;
+        qint64 maxSendWindow = 8 * 1024 * 1024;
+        int transferThreads = 0;
+        bool resumeEnabled = true;
+        bool deltaSyncEnabled = true;
+        qint64 deltaThreshold = 8 * 1024 * 1024;
+        bool compressionEnabled = false;
+        int compressionLevel = 1;
+        bool integrityCheckEnabled = true;
+        qint64 globalRateLimit = 0;
+        qint64 peerRateLimit = 0;
+        qint64 sessionRateLimit = 0;
+        bool fanoutEnabled = true;
+        qint64 fanoutThreshold = 64 * 1024 * 1024;
+        qint64 fanoutWindow = 32 * 1024 * 1024;
+        bool chainRelayEnabled = false;
+        bool multicastEnabled = false;
+        QString multicastGroup = "239.255.76.68";
+        int multicastPort = 12347;
+        qint64 multicastRate = 20 * 1024 * 1024;
+        int maxActiveTransfers = 8;
+        int maxTransfersPerPeer = 2;
+        bool smallFilesFirst = false;
+        bool archiveEnabled = false;
+        qint64 archiveThreshold = 256 * 1024;
+        int connectionIdleTimeout = 30;
+        bool writeBehindEnabled = true;
+        int writeDurability = 1;
+        int durabilityInterval = 64;
+        int diskQueueDepth = 4;
+        int receiveThreads = 0;
+        bool mdnsDiscoveryEnabled = true;
+        qint64 hashRateLimit = 32 * 1024 * 1024;
+        bool dedupEnabled = true;
+        bool dedupHardLinks = false;
+        int uploadSlots = 4;
+        int uploadSlotsPerPeer = 2;
+        int uploadQueueLength = 64;
+        qint64 serveCacheSize = 512 * 1024 * 1024;
+        QString metricsDumpPath = QString();
+        QString tracePath = QString();
+        int autoAccept = 0;
+        bool encryptionEnabled = false;
+        bool encryptionRequired = false;
+        bool sparseFilesEnabled = true;
+        bool bondingEnabled = false;
+        QString datagramPeers = QString();
+        int commitWindow = 20;
+        qint64 yieldRate = 256 * 1024;
+        int interactiveSlots = 2;
+        int maxPendingConnections = 32;
+        qint64 pendingReceiveBuffer = 64 * 1024;
+        qint64 receiveBufferSize = 4 * 1024 * 1024;
+        qint64 receiveMemoryBudget = 512 * 1024 * 1024;
+        int connectStagger = 100;
+        bool registryEnabled = false;
+        int registryPort = 12347;
+        QString registryServers = QString();
+        QString subscribedFolders = QString();
+        QString buttonStyleSheet = "QPushButton {background-color: black; height: 30px; color: white; border: 1px solid #ffb300; padding: 5px; border-radius: 5px; font-weight: bold;} QPushButton:hover {background-color: #333333;} QPushButton:pressed {background-color: #666666;}";
+        QString disabledButtonStyleSheet = "QPushButton {background-color: rgba(0, 0, 0, 40%); color: rgba(255, 255, 255, 40%); border: 1px solid rgba(255, 179, 0, 40%); padding: 5px; border-radius: 5px; font-weight: bold;}";
+    };
+
+    /** Copy the GUI thread reads and writes */
+    Values &mainValues()
+    {
+        static Values values;
+        return values;
+    }
+
+    /** Copy last published by the GUI thread, and how often it was */
+    QMutex publishedMutex;
+    QAtomicInteger<quint64> publishedGeneration(1);
+
+    Values &publishedValues()
+    {
+        static Values values;
+        return values;
+    }
+
+    /** Copy of a thread other than the GUI thread, and the publication it holds */
+    struct ThreadValues
+    {
+        Values values;
+        quint64 generation = 0;
+    };
+
+    bool onMainThread()
+    {
+        QCoreApplication *application = QCoreApplication::instance();
+        return !application || QThread::currentThread() == application->thread();
+    }
+
+    /**
+     * @brief Settings of the calling thread.
+     *
+     * Other threads take the published copy again the first time they read
+     * a setting after a publication; their references stay valid.
+     */
+    Values &values()
+    {
+        if (onMainThread())
+            return mainValues();
+
+        thread_local ThreadValues local;
+        quint64 generation = publishedGeneration.loadAcquire();
+        if (local.generation != generation)
+        {
+            QMutexLocker lock(&publishedMutex);
+            local.values = publishedValues();
+            local.generation = generation;
+        }
+        return local.values;
+    }
+}
+
+// Accessors of the calling thread's copy, see values()
 QString& Config::getReceivedFilesPath() {
-    static QString receivedFilesPath = "./Received Files";
-    return receivedFilesPath;
+    return values().receivedFilesPath;
 }
 
 QString& Config::getSharedFolderPath() {
-    static QString sharedFolderPath = "./Shared Files";
-    return sharedFolderPath;
+    return values().sharedFolderPath;
 }
 
 QString& Config::getSettingsPath() {
-    static QString settingsPath = "./settings.txt";
-    return settingsPath;
+    return values().settingsPath;
+}
+
+QString& Config::getSharedIndexPath() {
+    return values().sharedIndexPath;
+}
+
+QString& Config::getContentIndexPath() {
+    return values().contentIndexPath;
+}
+
+QString& Config::getHistoryPath() {
+    return values().historyPath;
+}
+
+QString& Config::getAutoAcceptRulesPath() {
+    return values().autoAcceptRulesPath;
+}
+
+QString& Config::getTransferProfilesPath() {
+    return values().transferProfilesPath;
+}
+
+QString& Config::getTlsCertificatePath() {
+    return values().tlsCertificatePath;
+}
+
+QString& Config::getTlsKeyPath() {
+    return values().tlsKeyPath;
+}
+
+QString& Config::getTrustedPeersPath() {
+    return values().trustedPeersPath;
 }
 
 int& Config::getPort() {
-    static int port = 5556;
-    return port;
+    return values().port;
 }
 
 int& Config::getBufferSize() {
-    static int bufferSize = 65536;
-    return bufferSize;
+    return values().bufferSize;
+}
+
+bool& Config::getZeroCopyEnabled() {
+    return values().zeroCopyEnabled;
+}
+
+qint64& Config::getMappedSourceThreshold() {
+    return values().mappedSourceThreshold;
+}
+
+int& Config::getStripeCount() {
+    return values().stripeCount;
+}
+
+qint64& Config::getStripeThreshold() {
+    return values().stripeThreshold;
+}
+
+qint64& Config::getMaxSendWindow() {
+    return values().maxSendWindow;
+}
+
+int& Config::getTransferThreads() {
+    return values().transferThreads;
+}
+
+bool& Config::getResumeEnabled() {
+    return values().resumeEnabled;
+}
+
+bool& Config::getDeltaSyncEnabled() {
+    return values().deltaSyncEnabled;
+}
+
+qint64& Config::getDeltaThreshold() {
+    return values().deltaThreshold;
+}
+
+bool& Config::getCompressionEnabled() {
+    return values().compressionEnabled;
+}
+
+int& Config::getCompressionLevel() {
+    return values().compressionLevel;
+}
+
+bool& Config::getIntegrityCheckEnabled() {
+    return values().integrityCheckEnabled;
+}
+
+qint64& Config::getGlobalRateLimit() {
+    return values().globalRateLimit;
+}
+
+qint64& Config::getPeerRateLimit() {
+    return values().peerRateLimit;
+}
+
+qint64& Config::getSessionRateLimit() {
+    return values().sessionRateLimit;
+}
+
+bool& Config::getFanoutEnabled() {
+    return values().fanoutEnabled;
+}
+
+qint64& Config::getFanoutThreshold() {
+    return values().fanoutThreshold;
+}
+
+qint64& Config::getFanoutWindow() {
+    return values().fanoutWindow;
+}
+
+bool& Config::getChainRelayEnabled() {
+    return values().chainRelayEnabled;
+}
+
+bool& Config::getMulticastEnabled() {
+    return values().multicastEnabled;
+}
+
+QString& Config::getMulticastGroup() {
+    return values().multicastGroup;
+}
+
+int& Config::getMulticastPort() {
+    return values().multicastPort;
+}
+
+qint64& Config::getMulticastRate() {
+    return values().multicastRate;
+}
+
+int& Config::getMaxActiveTransfers() {
+    return values().maxActiveTransfers;
+}
+
+int& Config::getMaxTransfersPerPeer() {
+    return values().maxTransfersPerPeer;
+}
+
+bool& Config::getSmallFilesFirst() {
+    return values().smallFilesFirst;
+}
+
+bool& Config::getArchiveEnabled() {
+    return values().archiveEnabled;
+}
+
+qint64& Config::getArchiveThreshold() {
+    return values().archiveThreshold;
+}
+
+int& Config::getConnectionIdleTimeout() {
+    return values().connectionIdleTimeout;
+}
+
+bool& Config::getWriteBehindEnabled() {
+    return values().writeBehindEnabled;
+}
+
+int& Config::getWriteDurability() {
+    return values().writeDurability;
+}
+
+int& Config::getDurabilityInterval() {
+    return values().durabilityInterval;
+}
+
+int& Config::getDiskQueueDepth() {
+    return values().diskQueueDepth;
+}
+
+int& Config::getReceiveThreads() {
+    return values().receiveThreads;
+}
+
+bool& Config::getMdnsDiscoveryEnabled() {
+    return values().mdnsDiscoveryEnabled;
+}
+
+qint64& Config::getHashRateLimit() {
+    return values().hashRateLimit;
+}
+
+bool& Config::getDedupEnabled() {
+    return values().dedupEnabled;
+}
+
+bool& Config::getDedupHardLinks() {
+    return values().dedupHardLinks;
+}
+
+int& Config::getUploadSlots() {
+    return values().uploadSlots;
+}
+
+int& Config::getUploadSlotsPerPeer() {
+    return values().uploadSlotsPerPeer;
+}
+
+int& Config::getUploadQueueLength() {
+    return values().uploadQueueLength;
+}
+
+qint64& Config::getServeCacheSize() {
+    return values().serveCacheSize;
+}
+
+QString& Config::getMetricsDumpPath() {
+    return values().metricsDumpPath;
+}
+
+QString& Config::getTracePath() {
+    return values().tracePath;
+}
+
+int& Config::getAutoAccept() {
+    return values().autoAccept;
+}
+
+bool& Config::getEncryptionEnabled() {
+    return values().encryptionEnabled;
+}
+
+bool& Config::getEncryptionRequired() {
+    return values().encryptionRequired;
+}
+
+bool& Config::getSparseFilesEnabled() {
+    return values().sparseFilesEnabled;
+}
+
+bool& Config::getBondingEnabled() {
+    return values().bondingEnabled;
+}
+
+QString& Config::getDatagramPeers() {
+    return values().datagramPeers;
+}
+
+int& Config::getCommitWindow() {
+    return values().commitWindow;
+}
+
+qint64& Config::getYieldRate() {
+    return values().yieldRate;
+}
+
+int& Config::getInteractiveSlots() {
+    return values().interactiveSlots;
+}
+
+int& Config::getMaxPendingConnections() {
+    return values().maxPendingConnections;
+}
+
+qint64& Config::getPendingReceiveBuffer() {
+    return values().pendingReceiveBuffer;
+}
+
+qint64& Config::getReceiveBufferSize() {
+    return values().receiveBufferSize;
+}
+
+qint64& Config::getReceiveMemoryBudget() {
+    return values().receiveMemoryBudget;
+}
+
+int& Config::getConnectStagger() {
+    return values().connectStagger;
+}
+
+bool& Config::getRegistryEnabled() {
+    return values().registryEnabled;
+}
+
+int& Config::getRegistryPort() {
+    return values().registryPort;
+}
+
+QString& Config::getRegistryServers() {
+    return values().registryServers;
+}
+
+QString& Config::getSubscribedFolders() {
+    return values().subscribedFolders;
 }
 
 QString& Config::getButtonStyleSheet() {
-    static QString buttonStyleSheet = "QPushButton {background-color: black; height: 30px; color: white; border: 1px solid #ffb300; padding: 5px; border-radius: 5px; font-weight: bold;} QPushButton:hover {background-color: #333333;} QPushButton:pressed {background-color: #666666;}";
-    return buttonStyleSheet;
+    return values().buttonStyleSheet;
 }
 
 QString& Config::getDisabledButtonStyleSheet() {
-    static QString disabledButtonStyleSheet = "QPushButton {background-color: rgba(0, 0, 0, 40%); color: rgba(255, 255, 255, 40%); border: 1px solid rgba(255, 179, 0, 40%); padding: 5px; border-radius: 5px; font-weight: bold;}";
-    return disabledButtonStyleSheet;
+    return values().disabledButtonStyleSheet;
+}
+
+/**
+ * @brief Hands the GUI thread's settings to the other threads.
+ *
+ * Settings are written on the GUI thread only. Worker and pool threads
+ * read a copy of their own, replaced by the one published here when they
+ * next read a setting, so a transfer never reads a value while the GUI
+ * thread writes it. TransferEngine publishes whenever it hands work to a
+ * worker; reset(), readFromFile() and writeToFile() publish what they set. Does nothing
+ * on other threads.
+ */
+void Config::publish(){
+    if (!onMainThread())
+        return;
+
+    QMutexLocker lock(&publishedMutex);
+    publishedValues() = mainValues();
+    publishedGeneration.fetchAndAddOrdered(1);
 }
 
 /**
@@ -50,8 +483,79 @@ void Config::reset(){
     getReceivedFilesPath() = "./Received Files";
     getSharedFolderPath() = "./Shared Files";
     getSettingsPath() = "./settings.txt";
+    getSharedIndexPath() = "./shared-index.json";
+    getContentIndexPath() = "./content-index.log";
+    getHistoryPath() = "./transfer-history.log";
+    getAutoAcceptRulesPath() = "./auto-accept.json";
+    getTransferProfilesPath() = "./profiles.json";
+    getTlsCertificatePath() = "./landrop-cert.pem";
+    getTlsKeyPath() = "./landrop-key.pem";
+    getTrustedPeersPath() = "./trusted-peers.txt";
     getPort() = 5556;
     getBufferSize() = 65536;
+    getZeroCopyEnabled() = true;
+    getMappedSourceThreshold() = 16 * 1024 * 1024;
+    getStripeCount() = 4;
+    getStripeThreshold() = 256 * 1024 * 1024;
+    getMaxSendWindow() = 8 * 1024 * 1024;
+    getTransferThreads() = 0;
+    getResumeEnabled() = true;
+    getDeltaSyncEnabled() = true;
+    getDeltaThreshold() = 8 * 1024 * 1024;
+    getCompressionEnabled() = false;
+    getCompressionLevel() = 1;
+    getIntegrityCheckEnabled() = true;
+    getGlobalRateLimit() = 0;
+    getPeerRateLimit() = 0;
+    getSessionRateLimit() = 0;
+    getFanoutEnabled() = true;
+    getFanoutThreshold() = 64 * 1024 * 1024;
+    getFanoutWindow() = 32 * 1024 * 1024;
+    getChainRelayEnabled() = false;
+    getMulticastEnabled() = false;
+    getMulticastGroup() = "239.255.76.68";
+    getMulticastPort() = 12347;
+    getMulticastRate() = 20 * 1024 * 1024;
+    getMaxActiveTransfers() = 8;
+    getMaxTransfersPerPeer() = 2;
+    getSmallFilesFirst() = false;
+    getArchiveEnabled() = false;
+    getArchiveThreshold() = 256 * 1024;
+    getConnectionIdleTimeout() = 30;
+    getWriteBehindEnabled() = true;
+    getWriteDurability() = 1;
+    getDurabilityInterval() = 64;
+    getDiskQueueDepth() = 4;
+    getReceiveThreads() = 0;
+    getMdnsDiscoveryEnabled() = true;
+    getHashRateLimit() = 32 * 1024 * 1024;
+    getDedupEnabled() = true;
+    getDedupHardLinks() = false;
+    getUploadSlots() = 4;
+    getUploadSlotsPerPeer() = 2;
+    getUploadQueueLength() = 64;
+    getServeCacheSize() = 512 * 1024 * 1024;
+    getMetricsDumpPath() = QString();
+    getTracePath() = QString();
+    getAutoAccept() = 0;
+    getEncryptionEnabled() = false;
+    getEncryptionRequired() = false;
+    getSparseFilesEnabled() = true;
+    getBondingEnabled() = false;
+    getDatagramPeers() = QString();
+    getCommitWindow() = 20;
+    getYieldRate() = 256 * 1024;
+    getInteractiveSlots() = 2;
+    getMaxPendingConnections() = 32;
+    getPendingReceiveBuffer() = 64 * 1024;
+    getReceiveBufferSize() = 4 * 1024 * 1024;
+    getReceiveMemoryBudget() = 512 * 1024 * 1024;
+    getConnectStagger() = 100;
+    getRegistryEnabled() = false;
+    getRegistryPort() = 12347;
+    getRegistryServers() = QString();
+    getSubscribedFolders() = QString();
+    publish();
 }
 
 /**
@@ -60,7 +564,8 @@ void Config::reset(){
  * Saves the current configuration (received files path, port, and buffer size)
  * to the settings file in a simple text format.
  *
- * @note File format: line 1 = receivedFilesPath, line 2 = port, line 3 = bufferSize
+ * @note File format: line 1 = receivedFilesPath, line 2 = port, line 3 = bufferSize,
+ *       followed by optional "key=value" lines for newer settings.
  */
 void Config::writeToFile(){
     QFile file(Config::getSettingsPath());
@@ -71,9 +576,136 @@ void Config::writeToFile(){
         file.write(QString::number(Config::getPort()).toUtf8());
         file.write("\n");
         file.write(QString::number(Config::getBufferSize()).toUtf8());
+        file.write("\n");
+        file.write(QByteArray("zeroCopy=") + (Config::getZeroCopyEnabled() ? "1" : "0"));
+        file.write("\n");
+        file.write("mmapThreshold=" + QByteArray::number(Config::getMappedSourceThreshold()));
+        file.write("\n");
+        file.write("stripes=" + QByteArray::number(Config::getStripeCount()));
+        file.write("\n");
+        file.write("stripeThreshold=" + QByteArray::number(Config::getStripeThreshold()));
+        file.write("\n");
+        file.write("maxSendWindow=" + QByteArray::number(Config::getMaxSendWindow()));
+        file.write("\n");
+        file.write("transferThreads=" + QByteArray::number(Config::getTransferThreads()));
+        file.write("\n");
+        file.write(QByteArray("resume=") + (Config::getResumeEnabled() ? "1" : "0"));
+        file.write("\n");
+        file.write(QByteArray("deltaSync=") + (Config::getDeltaSyncEnabled() ? "1" : "0"));
+        file.write("\n");
+        file.write("deltaThreshold=" + QByteArray::number(Config::getDeltaThreshold()));
+        file.write("\n");
+        file.write(QByteArray("compression=") + (Config::getCompressionEnabled() ? "1" : "0"));
+        file.write("\n");
+        file.write("compressionLevel=" + QByteArray::number(Config::getCompressionLevel()));
+        file.write("\n");
+        file.write(QByteArray("verify=") + (Config::getIntegrityCheckEnabled() ? "1" : "0"));
+        file.write("\n");
+        file.write("rateLimit=" + QByteArray::number(Config::getGlobalRateLimit()));
+        file.write("\n");
+        file.write("peerRateLimit=" + QByteArray::number(Config::getPeerRateLimit()));
+        file.write("\n");
+        file.write("sessionRateLimit=" + QByteArray::number(Config::getSessionRateLimit()));
+        file.write("\n");
+        file.write(QByteArray("fanout=") + (Config::getFanoutEnabled() ? "1" : "0"));
+        file.write("\n");
+        file.write("fanoutThreshold=" + QByteArray::number(Config::getFanoutThreshold()));
+        file.write("\n");
+        file.write("fanoutWindow=" + QByteArray::number(Config::getFanoutWindow()));
+        file.write("\n");
+        file.write(QByteArray("chainRelay=") + (Config::getChainRelayEnabled() ? "1" : "0"));
+        file.write("\n");
+        file.write(QByteArray("multicast=") + (Config::getMulticastEnabled() ? "1" : "0"));
+        file.write("\n");
+        file.write("multicastGroup=" + Config::getMulticastGroup().toUtf8());
+        file.write("\n");
+        file.write("multicastPort=" + QByteArray::number(Config::getMulticastPort()));
+        file.write("\n");
+        file.write("multicastRate=" + QByteArray::number(Config::getMulticastRate()));
+        file.write("\n");
+        file.write("maxActiveTransfers=" + QByteArray::number(Config::getMaxActiveTransfers()));
+        file.write("\n");
+        file.write("maxTransfersPerPeer=" + QByteArray::number(Config::getMaxTransfersPerPeer()));
+        file.write("\n");
+        file.write(QByteArray("smallFilesFirst=") + (Config::getSmallFilesFirst() ? "1" : "0"));
+        file.write("\n");
+        file.write(QByteArray("archive=") + (Config::getArchiveEnabled() ? "1" : "0"));
+        file.write("\n");
+        file.write("archiveThreshold=" + QByteArray::number(Config::getArchiveThreshold()));
+        file.write("\n");
+        file.write("connectionIdleTimeout=" + QByteArray::number(Config::getConnectionIdleTimeout()));
+        file.write("\n");
+        file.write(QByteArray("writeBehind=") + (Config::getWriteBehindEnabled() ? "1" : "0"));
+        file.write("\n");
+        file.write("writeDurability=" + QByteArray::number(Config::getWriteDurability()));
+        file.write("\n");
+        file.write("durabilityInterval=" + QByteArray::number(Config::getDurabilityInterval()));
+        file.write("\n");
+        file.write("diskQueueDepth=" + QByteArray::number(Config::getDiskQueueDepth()));
+        file.write("\n");
+        file.write("receiveThreads=" + QByteArray::number(Config::getReceiveThreads()));
+        file.write("\n");
+        file.write(QByteArray("mdnsDiscovery=") + (Config::getMdnsDiscoveryEnabled() ? "1" : "0"));
+        file.write("\n");
+        file.write("hashRateLimit=" + QByteArray::number(Config::getHashRateLimit()));
+        file.write("\n");
+        file.write(QByteArray("dedup=") + (Config::getDedupEnabled() ? "1" : "0"));
+        file.write("\n");
+        file.write(QByteArray("dedupHardLinks=") + (Config::getDedupHardLinks() ? "1" : "0"));
+        file.write("\n");
+        file.write("uploadSlots=" + QByteArray::number(Config::getUploadSlots()));
+        file.write("\n");
+        file.write("uploadSlotsPerPeer=" + QByteArray::number(Config::getUploadSlotsPerPeer()));
+        file.write("\n");
+        file.write("uploadQueue=" + QByteArray::number(Config::getUploadQueueLength()));
+        file.write("\n");
+        file.write("serveCache=" + QByteArray::number(Config::getServeCacheSize()));
+        file.write("\n");
+        file.write("metricsDump=" + Config::getMetricsDumpPath().toUtf8());
+        file.write("\n");
+        file.write("trace=" + Config::getTracePath().toUtf8());
+        file.write("\n");
+        file.write("autoAccept=" + QByteArray::number(Config::getAutoAccept()));
+        file.write("\n");
+        file.write(QByteArray("encryption=") + (Config::getEncryptionEnabled() ? "1" : "0"));
+        file.write("\n");
+        file.write(QByteArray("requireEncryption=") + (Config::getEncryptionRequired() ? "1" : "0"));
+        file.write("\n");
+        file.write(QByteArray("sparseFiles=") + (Config::getSparseFilesEnabled() ? "1" : "0"));
+        file.write("\n");
+        file.write(QByteArray("bonding=") + (Config::getBondingEnabled() ? "1" : "0"));
+        file.write("\n");
+        file.write("datagramPeers=" + Config::getDatagramPeers().toUtf8());
+        file.write("\n");
+        file.write("commitWindow=" + QByteArray::number(Config::getCommitWindow()));
+        file.write("\n");
+        file.write("yieldRate=" + QByteArray::number(Config::getYieldRate()));
+        file.write("\n");
+        file.write("interactiveSlots=" + QByteArray::number(Config::getInteractiveSlots()));
+        file.write("\n");
+        file.write("maxPendingConnections=" + QByteArray::number(Config::getMaxPendingConnections()));
+        file.write("\n");
+        file.write("pendingReceiveBuffer=" + QByteArray::number(Config::getPendingReceiveBuffer()));
+        file.write("\n");
+        file.write("receiveBufferSize=" + QByteArray::number(Config::getReceiveBufferSize()));
+        file.write("\n");
+        file.write("receiveMemoryBudget=" + QByteArray::number(Config::getReceiveMemoryBudget()));
+        file.write("\n");
+        file.write("connectStagger=" + QByteArray::number(Config::getConnectStagger()));
+        file.write("\n");
+        file.write(QByteArray("registryEnabled=") + (Config::getRegistryEnabled() ? "1" : "0"));
+        file.write("\n");
+        file.write("registryPort=" + QByteArray::number(Config::getRegistryPort()));
+        file.write("\n");
+        file.write("registryServers=" + Config::getRegistryServers().toUtf8());
+        file.write("\n");
+        file.write("subscribedFolders=" + Config::getSubscribedFolders().toUtf8());
         file.resize(file.pos());
     }
     file.close();
+
+    // Settings are saved once changed, transfers started from now on read them
+    publish();
 }
 
 /**
@@ -101,6 +733,140 @@ void Config::readFromFile(){
                     if(portOk && bufferOk && newPort > 0 && newPort < 65536 && newBuffer > 0){
                         Config::getPort() = newPort;
                         Config::getBufferSize() = newBuffer;
+
+                        // Optional settings, older files simply stop after line 3
+                        while(!file.atEnd()){
+                            QByteArray line = file.readLine().trimmed();
+                            int separator = line.indexOf('=');
+                            if(separator <= 0)
+                                continue;
+                            QByteArray key = line.left(separator).trimmed();
+                            QByteArray value = line.mid(separator + 1).trimmed();
+                            if(key == "zeroCopy")
+                                Config::getZeroCopyEnabled() = (value != "0");
+                            else if(key == "mmapThreshold")
+                                Config::getMappedSourceThreshold() = qMax<qint64>(0, value.toLongLong());
+                            else if(key == "stripes")
+                                Config::getStripeCount() = qBound(1, value.toInt(), 16);
+                            else if(key == "stripeThreshold")
+                                Config::getStripeThreshold() = qMax<qint64>(0, value.toLongLong());
+                            else if(key == "maxSendWindow")
+                                Config::getMaxSendWindow() = qMax<qint64>(64 * 1024, value.toLongLong());
+                            else if(key == "transferThreads")
+                                Config::getTransferThreads() = qBound(0, value.toInt(), 16);
+                            else if(key == "resume")
+                                Config::getResumeEnabled() = (value != "0");
+                            else if(key == "deltaSync")
+                                Config::getDeltaSyncEnabled() = (value != "0");
+                            else if(key == "deltaThreshold")
+                                Config::getDeltaThreshold() = qMax<qint64>(0, value.toLongLong());
+                            else if(key == "compression")
+                                Config::getCompressionEnabled() = (value != "0");
+                            else if(key == "compressionLevel")
+                                Config::getCompressionLevel() = qBound(1, value.toInt(), 9);
+                            else if(key == "verify")
+                                Config::getIntegrityCheckEnabled() = (value != "0");
+                            else if(key == "rateLimit")
+                                Config::getGlobalRateLimit() = qMax<qint64>(0, value.toLongLong());
+                            else if(key == "peerRateLimit")
+                                Config::getPeerRateLimit() = qMax<qint64>(0, value.toLongLong());
+                            else if(key == "sessionRateLimit")
+                                Config::getSessionRateLimit() = qMax<qint64>(0, value.toLongLong());
+                            else if(key == "fanout")
+                                Config::getFanoutEnabled() = (value != "0");
+                            else if(key == "fanoutThreshold")
+                                Config::getFanoutThreshold() = qMax<qint64>(0, value.toLongLong());
+                            else if(key == "fanoutWindow")
+                                Config::getFanoutWindow() = qMax<qint64>(1024 * 1024, value.toLongLong());
+                            else if(key == "chainRelay")
+                                Config::getChainRelayEnabled() = (value != "0");
+                            else if(key == "multicast")
+                                Config::getMulticastEnabled() = (value != "0");
+                            else if(key == "multicastGroup")
+                                Config::getMulticastGroup() = value.isEmpty() ? QString("239.255.76.68") : QString::fromUtf8(value);
+                            else if(key == "multicastPort")
+                                Config::getMulticastPort() = qBound(1, value.toInt(), 65535);
+                            else if(key == "multicastRate")
+                                Config::getMulticastRate() = qMax<qint64>(64 * 1024, value.toLongLong());
+                            else if(key == "maxActiveTransfers")
+                                Config::getMaxActiveTransfers() = qMax(0, value.toInt());
+                            else if(key == "maxTransfersPerPeer")
+                                Config::getMaxTransfersPerPeer() = qMax(0, value.toInt());
+                            else if(key == "smallFilesFirst")
+                                Config::getSmallFilesFirst() = (value != "0");
+                            else if(key == "archive")
+                                Config::getArchiveEnabled() = (value != "0");
+                            else if(key == "archiveThreshold")
+                                Config::getArchiveThreshold() = qMax<qint64>(1, value.toLongLong());
+                            else if(key == "connectionIdleTimeout")
+                                Config::getConnectionIdleTimeout() = qMax(0, value.toInt());
+                            else if(key == "writeBehind")
+                                Config::getWriteBehindEnabled() = (value != "0");
+                            else if(key == "writeDurability")
+                                Config::getWriteDurability() = qBound(0, value.toInt(), 2);
+                            else if(key == "durabilityInterval")
+                                Config::getDurabilityInterval() = qMax(1, value.toInt());
+                            else if(key == "diskQueueDepth")
+                                Config::getDiskQueueDepth() = qBound(1, value.toInt(), 32);
+                            else if(key == "receiveThreads")
+                                Config::getReceiveThreads() = qMax(0, value.toInt());
+                            else if(key == "mdnsDiscovery")
+                                Config::getMdnsDiscoveryEnabled() = (value != "0");
+                            else if(key == "hashRateLimit")
+                                Config::getHashRateLimit() = qMax<qint64>(0, value.toLongLong());
+                            else if(key == "dedup")
+                                Config::getDedupEnabled() = (value != "0");
+                            else if(key == "dedupHardLinks")
+                                Config::getDedupHardLinks() = (value != "0");
+                            else if(key == "uploadSlots")
+                                Config::getUploadSlots() = qMax(0, value.toInt());
+                            else if(key == "uploadSlotsPerPeer")
+                                Config::getUploadSlotsPerPeer() = qMax(0, value.toInt());
+                            else if(key == "uploadQueue")
+                                Config::getUploadQueueLength() = qMax(0, value.toInt());
+                            else if(key == "serveCache")
+                                Config::getServeCacheSize() = qMax<qint64>(0, value.toLongLong());
+                            else if(key == "metricsDump")
+                                Config::getMetricsDumpPath() = QString::fromUtf8(value);
+                            else if(key == "trace")
+                                Config::getTracePath() = QString::fromUtf8(value);
+                            else if(key == "autoAccept")
+                                Config::getAutoAccept() = qBound(0, value.toInt(), 2);
+                            else if(key == "encryption")
+                                Config::getEncryptionEnabled() = (value != "0");
+                            else if(key == "requireEncryption")
+                                Config::getEncryptionRequired() = (value != "0");
+                            else if(key == "sparseFiles")
+                                Config::getSparseFilesEnabled() = (value != "0");
+                            else if(key == "bonding")
+                                Config::getBondingEnabled() = (value != "0");
+                            else if(key == "datagramPeers")
+                                Config::getDatagramPeers() = QString::fromUtf8(value);
+                            else if(key == "commitWindow")
+                                Config::getCommitWindow() = qBound(0, value.toInt(), 1000);
+                            else if(key == "yieldRate")
+                                Config::getYieldRate() = qMax<qint64>(1024, value.toLongLong());
+                            else if(key == "interactiveSlots")
+                                Config::getInteractiveSlots() = qMax(1, value.toInt());
+                            else if(key == "maxPendingConnections")
+                                Config::getMaxPendingConnections() = qMax(0, value.toInt());
+                            else if(key == "pendingReceiveBuffer")
+                                Config::getPendingReceiveBuffer() = qMax<qint64>(4096, value.toLongLong());
+                            else if(key == "receiveBufferSize")
+                                Config::getReceiveBufferSize() = qMax<qint64>(64 * 1024, value.toLongLong());
+                            else if(key == "receiveMemoryBudget")
+                                Config::getReceiveMemoryBudget() = qMax<qint64>(0, value.toLongLong());
+                            else if(key == "connectStagger")
+                                Config::getConnectStagger() = qMax(0, value.toInt());
+                            else if(key == "registryEnabled")
+                                Config::getRegistryEnabled() = (value != "0");
+                            else if(key == "registryPort")
+                                Config::getRegistryPort() = qBound(1, value.toInt(), 65535);
+                            else if(key == "registryServers")
+                                Config::getRegistryServers() = QString::fromUtf8(value);
+                            else if(key == "subscribedFolders")
+                                Config::getSubscribedFolders() = QString::fromUtf8(value);
+                        }
                     } else {
                         Config::reset();
                         writeToFile();
@@ -120,6 +886,7 @@ void Config::readFromFile(){
         Config::reset();
         writeToFile();
     }
+    publish();
 }
 
 /**
@@ -14,6 +14,9 @@
  * 
  * This class provides static access to application-wide configuration settings
  * including file paths, network ports, and UI styling.
+ *
+ * Settings are changed on the GUI thread; other threads read the copy
+ * last handed to them with publish().
  */
 class Config
 {
@@ -32,6 +35,46 @@ public:
      * @brief Get path to the configuration settings file.
      */
     static QString& getSettingsPath();
+
+    /**
+     * @brief Get path to the persistent index of the shared folder.
+     */
+    static QString& getSharedIndexPath();
+
+    /**
+     * @brief Get path to the log of file contents known by hash, used to deduplicate transfers.
+     */
+    static QString& getContentIndexPath();
+
+    /**
+     * @brief Get path to the append-only log of finished transfers, its index is kept beside it (see HistoryStore).
+     */
+    static QString& getHistoryPath();
+
+    /**
+     * @brief Get path to the JSON rules accepting transfers from trusted peers (see AutoAcceptPolicy).
+     */
+    static QString& getAutoAcceptRulesPath();
+
+    /**
+     * @brief Get path to the JSON transfer profiles assigned to peers and subnets (see TransferProfiles).
+     */
+    static QString& getTransferProfilesPath();
+
+    /**
+     * @brief Get path to the PEM certificate presented to encrypted connections.
+     */
+    static QString& getTlsCertificatePath();
+
+    /**
+     * @brief Get path to the PEM private key of the TLS certificate.
+     */
+    static QString& getTlsKeyPath();
+
+    /**
+     * @brief Get path to the certificate digests pinned for each peer, one "address digest" line each (see SecureTransport).
+     */
+    static QString& getTrustedPeersPath();
     
     /**
      * @brief Get TCP port number for file transfer operations.
@@ -42,6 +85,316 @@ public:
      * @brief Get buffer size in bytes for file transfer operations.
      */
     static int& getBufferSize();
+
+    /**
+     * @brief Get whether outgoing file data is handed to the kernel (sendfile/TransmitFile).
+     */
+    static bool& getZeroCopyEnabled();
+
+    /**
+     * @brief Get file size in bytes from which outgoing files are read through memory mapping.
+     */
+    static qint64& getMappedSourceThreshold();
+
+    /**
+     * @brief Get maximum number of parallel connections a single file is striped over.
+     */
+    static int& getStripeCount();
+
+    /**
+     * @brief Get file size in bytes from which outgoing files are offered as striped transfers.
+     */
+    static qint64& getStripeThreshold();
+
+    /**
+     * @brief Get upper bound in bytes of file data queued on one outgoing connection.
+     */
+    static qint64& getMaxSendWindow();
+
+    /**
+     * @brief Get number of worker threads running transfers (0 = one per core, at most 4).
+     */
+    static int& getTransferThreads();
+
+    /**
+     * @brief Get whether interrupted transfers keep their partial data and continue where they stopped.
+     */
+    static bool& getResumeEnabled();
+
+    /**
+     * @brief Get whether files the receiver already has are updated by sending only changed blocks.
+     */
+    static bool& getDeltaSyncEnabled();
+
+    /**
+     * @brief Get file size in bytes from which outgoing files offer a delta transfer.
+     */
+    static qint64& getDeltaThreshold();
+
+    /**
+     * @brief Get whether file data may be compressed on the wire when both peers agree.
+     */
+    static bool& getCompressionEnabled();
+
+    /**
+     * @brief Get zlib level (1-9) offered for compressed transfers.
+     */
+    static int& getCompressionLevel();
+
+    /**
+     * @brief Get whether received files are checked against the sender's hash when both peers agree.
+     */
+    static bool& getIntegrityCheckEnabled();
+
+    /**
+     * @brief Get total transfer rate of all connections in bytes per second (0 for unlimited).
+     */
+    static qint64& getGlobalRateLimit();
+
+    /**
+     * @brief Get transfer rate allowed to or from each peer in bytes per second (0 for unlimited).
+     */
+    static qint64& getPeerRateLimit();
+
+    /**
+     * @brief Get transfer rate of each single transfer connection in bytes per second (0 for unlimited).
+     */
+    static qint64& getSessionRateLimit();
+
+    /**
+     * @brief Get whether a large file sent to several users is read once and streamed to all of them.
+     */
+    static bool& getFanoutEnabled();
+
+    /**
+     * @brief Get file size in bytes from which a file sent to several users is fanned out.
+     */
+    static qint64& getFanoutThreshold();
+
+    /**
+     * @brief Get how far in bytes the fastest recipient of a fan-out may run ahead of the slowest.
+     */
+    static qint64& getFanoutWindow();
+
+    /**
+     * @brief Get whether a large file sent to several users is relayed from one recipient to the next instead of sent to each.
+     */
+    static bool& getChainRelayEnabled();
+
+    /**
+     * @brief Get whether a large file sent to several users is multicast to them over UDP instead of sent to each.
+     */
+    static bool& getMulticastEnabled();
+
+    /**
+     * @brief Get IPv4 multicast group of multicast transfers.
+     */
+    static QString& getMulticastGroup();
+
+    /**
+     * @brief Get UDP port multicast transfers are received on, next to the discovery port.
+     */
+    static int& getMulticastPort();
+
+    /**
+     * @brief Get rate in bytes per second at which multicast transfers send their blocks.
+     */
+    static qint64& getMulticastRate();
+
+    /**
+     * @brief Get number of outgoing transfers running at once, the others wait in a queue (0 for unlimited).
+     */
+    static int& getMaxActiveTransfers();
+
+    /**
+     * @brief Get number of outgoing transfers running at once to each peer (0 for unlimited).
+     */
+    static int& getMaxTransfersPerPeer();
+
+    /**
+     * @brief Get whether queued transfers start smallest first instead of in the order they were requested.
+     */
+    static bool& getSmallFilesFirst();
+
+    /**
+     * @brief Get whether small files sent together are packed into one archive transfer unpacked by the receiver.
+     */
+    static bool& getArchiveEnabled();
+
+    /**
+     * @brief Get file size in bytes below which files sent together are packed into an archive.
+     */
+    static qint64& getArchiveThreshold();
+
+    /**
+     * @brief Get how long an idle pooled connection to a peer is kept open in seconds (0 disables the pool).
+     */
+    static int& getConnectionIdleTimeout();
+
+    /**
+     * @brief Get whether received data is collected in large buffers and written on a pool thread.
+     */
+    static bool& getWriteBehindEnabled();
+
+    /**
+     * @brief Get when received data is forced to disk: 0 never, 1 on completion, 2 also every durability interval.
+     */
+    static int& getWriteDurability();
+
+    /**
+     * @brief Get the amount of received data in MiB between two syncs with durability mode 2.
+     */
+    static int& getDurabilityInterval();
+
+    /**
+     * @brief Get the number of disk requests kept in flight per file, reads ahead of an outgoing transfer and writes behind an incoming one.
+     */
+    static int& getDiskQueueDepth();
+
+    /**
+     * @brief Get number of worker threads serving incoming connections (0 = one per core, at most 8, 1 = on the receiver's thread).
+     */
+    static int& getReceiveThreads();
+
+    /**
+     * @brief Get whether peers are also discovered and announced over mDNS (DNS-SD).
+     */
+    static bool& getMdnsDiscoveryEnabled();
+
+    /**
+     * @brief Get disk read rate allowed to the background hashing of shared files in bytes per second (0 for unlimited).
+     */
+    static qint64& getHashRateLimit();
+
+    /**
+     * @brief Get whether a file the receiver already holds with the same content is copied locally instead of sent.
+     */
+    static bool& getDedupEnabled();
+
+    /**
+     * @brief Get whether deduplicated files may be hard links to the copy they match when the file system cannot clone.
+     */
+    static bool& getDedupHardLinks();
+
+    /**
+     * @brief Get maximum number of shared files served to peers at once, 0 for no limit.
+     */
+    static int& getUploadSlots();
+
+    /**
+     * @brief Get maximum number of shared files served to the same peer at once, 0 for no limit.
+     */
+    static int& getUploadSlotsPerPeer();
+
+    /**
+     * @brief Get maximum number of shared file requests waiting for an upload slot, further ones are refused.
+     */
+    static int& getUploadQueueLength();
+
+    /**
+     * @brief Get bytes of shared file mappings kept for files served to peers, 0 to disable the cache.
+     */
+    static qint64& getServeCacheSize();
+
+    /**
+     * @brief Get path the transfer metrics are written to as JSON every second, empty to write none.
+     */
+    static QString& getMetricsDumpPath();
+
+    /**
+     * @brief Get path a timeline of the transfers is recorded to in the Chrome trace format, empty to record none.
+     */
+    static QString& getTracePath();
+
+    /**
+     * @brief Get which incoming transfers are accepted without asking: 0 none, 1 from discovered peers, 2 all.
+     */
+    static int& getAutoAccept();
+
+    /**
+     * @brief Whether transfer connections are encrypted with TLS 1.3 (see SecureTransport).
+     */
+    static bool& getEncryptionEnabled();
+
+    /**
+     * @brief Whether unencrypted connections are refused and only TLS is spoken, implies getEncryptionEnabled().
+     */
+    static bool& getEncryptionRequired();
+
+    /**
+     * @brief Whether the holes of sparse files are sent as a map instead of zeros (see SparseFile).
+     */
+    static bool& getSparseFilesEnabled();
+
+    /**
+     * @brief Whether the stripes of a transfer are spread over every local interface and peer address (see PathBonding).
+     */
+    static bool& getBondingEnabled();
+
+    /**
+     * @brief Get the peers whose transfers carry their data over UDP, comma separated addresses or "*" for all (see DatagramTransport).
+     */
+    static QString& getDatagramPeers();
+
+    /**
+     * @brief Get the time in milliseconds completed files wait to be synced and renamed together with the next ones (see GroupCommit).
+     */
+    static int& getCommitWindow();
+
+    /**
+     * @brief Get the rate in bytes per second transfers of a lower lane are held to while a higher lane moves data (see TransferPriority).
+     */
+    static qint64& getYieldRate();
+
+    /**
+     * @brief Get the number of interactive transfers running beside the transfer limits.
+     */
+    static int& getInteractiveSlots();
+
+    /**
+     * @brief Get maximum number of incoming connections waiting for the user's answer, further ones wait in the listen backlog; 0 for no limit.
+     */
+    static int& getMaxPendingConnections();
+
+    /**
+     * @brief Get read buffer in bytes of a connection until its transfer is accepted.
+     */
+    static qint64& getPendingReceiveBuffer();
+
+    /**
+     * @brief Get read buffer in bytes of a connection receiving data, compressed transfers get room for two frames.
+     */
+    static qint64& getReceiveBufferSize();
+
+    /**
+     * @brief Get bytes all read buffers of incoming connections may take together, 0 for no limit.
+     */
+    static qint64& getReceiveMemoryBudget();
+
+    /**
+     * @brief Get milliseconds a connection attempt to the next address of a peer starts after the previous one.
+     */
+    static int& getConnectStagger();
+
+    /**
+     * @brief Get whether this instance is a rendezvous relaying the peers of other subnets that register with it (see RegistryDiscoveryBackend).
+     */
+    static bool& getRegistryEnabled();
+
+    /**
+     * @brief Get the UDP port rendezvous instances listen on for registrations.
+     */
+    static int& getRegistryPort();
+
+    /**
+     * @brief Get the rendezvous instances to register with, comma separated addresses with an optional ":port".
+     */
+    static QString& getRegistryServers();
+
+    /**
+     * @brief Get the shared folders of other peers mirrored in the background, "hostname/folder" entries separated by '|' (see SubscriptionMirror).
+     */
+    static QString& getSubscribedFolders();
     
     /**
      * @brief Get CSS stylesheet for enabled UI buttons.
@@ -53,6 +406,7 @@ public:
      */
     static QString& getDisabledButtonStyleSheet();
 
+    static void publish();
     static void reset();
     static void readFromFile();
     static void writeToFile();
@@ -0,0 +1,19 @@
+#ifndef TRANSFERPRIORITY_H
+#define TRANSFERPRIORITY_H
+
+/**
+ * @enum TransferPriority
+ * @brief Lane a transfer runs in; lower lanes yield to higher ones.
+ *
+ * Queued transfers start in lane order. Interactive transfers have slots
+ * of their own beyond the transfer limits, and while a transfer of a
+ * higher lane moves data, the transfers of lower lanes are held to
+ * Config::getYieldRate() by the BandwidthShaper.
+ */
+enum class TransferPriority {
+    BACKGROUND,   ///< Bulk data that may wait for everything else
+    NORMAL,       ///< Default lane
+    INTERACTIVE   ///< Small files someone is waiting for
+};
+
+#endif // TRANSFERPRIORITY_H
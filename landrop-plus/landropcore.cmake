@@ -0,0 +1,160 @@
+# landropCore: configuration, protocol, transfer and discovery code of
+# LANDrop, everything but the user interface. Linked by the desktop
+# application and the headless daemon.
+#
+# Included from landrop-plus/CMakeLists.txt, or by a project building
+# without it, so it finds the Qt modules it needs itself.
+
+if(TARGET landropCore)
+    return()
+endif()
+
+find_package(QT NAMES Qt6 Qt5 REQUIRED COMPONENTS Core)
+find_package(Qt${QT_VERSION_MAJOR} REQUIRED COMPONENTS Core Network)
+
+set(LANDROP_CORE_SOURCES
+    core/transferstatus.h
+    core/transferpriority.h
+
+    config/config.cpp
+    config/config.h
+
+    network/sender.cpp
+    network/sender.h
+    network/receiver.cpp
+    network/receiver.h
+    network/progresscounter.cpp
+    network/progresscounter.h
+    network/receiverserver.cpp
+    network/receiverserver.h
+    network/filewriter.cpp
+    network/filewriter.h
+    network/resumestate.cpp
+    network/resumestate.h
+    network/contentindex.cpp
+    network/contentindex.h
+    network/swarmdownload.cpp
+    network/swarmdownload.h
+    network/deltasync.cpp
+    network/deltasync.h
+    network/compression.cpp
+    network/compression.h
+    network/streamhasher.cpp
+    network/streamhasher.h
+    network/bufferpool.cpp
+    network/bufferpool.h
+    network/bandwidthshaper.cpp
+    network/bandwidthshaper.h
+    network/zerocopy.cpp
+    network/zerocopy.h
+    network/transfersource.cpp
+    network/transfersource.h
+    network/servecache.cpp
+    network/servecache.h
+    network/uploadslots.cpp
+    network/uploadslots.h
+    network/receivebudget.cpp
+    network/receivebudget.h
+    network/transfermetrics.cpp
+    network/transfermetrics.h
+    network/transfertrace.cpp
+    network/transfertrace.h
+    network/diskio.cpp
+    network/diskio.h
+    network/sendwindow.cpp
+    network/sendwindow.h
+    network/transferprofiles.cpp
+    network/transferprofiles.h
+    network/protocol.cpp
+    network/protocol.h
+    network/framecodec.h
+    network/blockmap.cpp
+    network/sparsefile.cpp
+    network/pathbonding.cpp
+    network/blockmap.h
+    network/sparsefile.h
+    network/pathbonding.h
+    network/connectionrace.cpp
+    network/connectionrace.h
+    network/datagramtransport.cpp
+    network/datagramtransport.h
+    network/groupcommit.cpp
+    network/groupcommit.h
+    network/securetransport.cpp
+    network/securetransport.h
+    network/sharedcatalog.cpp
+    network/sharedcatalog.h
+    network/discoverymessage.cpp
+    network/discoverymessage.h
+    network/mdns.cpp
+    network/mdns.h
+    network/catalogfetcher.cpp
+    network/catalogfetcher.h
+    network/peersession.cpp
+    network/peersession.h
+    network/fanoutsender.cpp
+    network/fanoutsender.h
+    network/chainrelay.cpp
+    network/chainrelay.h
+    network/multicast.cpp
+    network/multicast.h
+    network/multicastsender.cpp
+    network/multicastsender.h
+    network/archive.cpp
+    network/archive.h
+    network/archivesender.cpp
+    network/archivesender.h
+
+    services/networkmanager.cpp
+    services/networkmanager.h
+    services/interfacesnapshot.cpp
+    services/interfacesnapshot.h
+    services/broadcastdiscoveryservice.cpp
+    services/broadcastdiscoveryservice.h
+    services/discoverypacing.cpp
+    services/discoverypacing.h
+    services/discoverybackend.cpp
+    services/discoverybackend.h
+    services/mdnsdiscoverybackend.cpp
+    services/mdnsdiscoverybackend.h
+    services/registrydiscoverybackend.cpp
+    services/registrydiscoverybackend.h
+    services/sharedfilemanager.cpp
+    services/sharedfilemanager.h
+    services/filetransfermanager.cpp
+    services/filetransfermanager.h
+    services/transferengine.cpp
+    services/transferengine.h
+    services/directorywalker.cpp
+    services/directorywalker.h
+    services/connectionpool.cpp
+    services/connectionpool.h
+    services/progressaggregator.cpp
+    services/progressaggregator.h
+    services/autoacceptpolicy.cpp
+    services/autoacceptpolicy.h
+    services/subscriptionmirror.cpp
+    services/subscriptionmirror.h
+    services/historystore.cpp
+    services/historystore.h
+    services/catalogsearch.cpp
+    services/catalogsearch.h
+)
+list(TRANSFORM LANDROP_CORE_SOURCES PREPEND "${CMAKE_CURRENT_LIST_DIR}/")
+
+add_library(landropCore STATIC ${LANDROP_CORE_SOURCES})
+set_target_properties(landropCore PROPERTIES
+    AUTOMOC ON
+    CXX_STANDARD 17
+    CXX_STANDARD_REQUIRED ON
+)
+
+target_link_libraries(landropCore PUBLIC
+    Qt${QT_VERSION_MAJOR}::Core
+    Qt${QT_VERSION_MAJOR}::Network
+)
+
+# TransmitFile lives in mswsock on Windows
+if(WIN32)
+    target_link_libraries(landropCore PUBLIC ws2_32 mswsock)
+endif()
@@ -6,6 +6,9 @@
 #include <QApplication>
 #include "ui/mainwindow.h"
 #include "config/config.h"
+#include "network/transfertrace.h"
+#include "network/transfermetrics.h"
+#include <QElapsedTimer>
 
 #ifdef Q_OS_WIN
 #include <windows.h>
@@ -24,10 +27,19 @@ int main(int argc, char *argv[])
 #endif
 
     // Load configuration from persistent storage
+    QElapsedTimer clock;
+    clock.start();
     Config::readFromFile();
+    TransferMetrics::setStartupPhase("config", clock.elapsed());
 
     // Create Qt application instance
     QApplication app(argc, argv);
+
+    // Record a timeline of the transfers when asked to
+    if (!Config::getTracePath().isEmpty())
+        TransferTrace::start(Config::getTracePath());
+
+    // Services start from the event loop, the window shows first
     MainWindow w;
     w.show();
 
@@ -35,5 +47,7 @@ int main(int argc, char *argv[])
     app.setWindowIcon(QIcon(":/resources/image.ico"));
 
     // Start event loop
-    return app.exec();
+    int result = app.exec();
+    TransferTrace::stop();
+    return result;
 }
\ No newline at end of file
@@ -0,0 +1,279 @@
+/**
+ * @file archive.cpp
+ */
+
+#include "archive.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QtEndian>
+
+QList<Archive::Entry> Archive::entriesFor(const QStringList &filePaths)
+{
+    QString root;
+    for (const QString &filePath : filePaths)
+    {
+        QString parent = QFileInfo(filePath).absolutePath();
+        if (root.isNull())
+        {
+            root = parent;
+            continue;
+        }
+        while (parent != root && !parent.startsWith(root.endsWith('/') ? root : root + '/'))
+        {
+            QString up = QFileInfo(root).path();
+            if (up == root)
+                break;
+            root = up;
+        }
+    }
+
+    QDir rootDir(root);
+    QList<Entry> entries;
+    for (const QString &filePath : filePaths)
+    {
+        QFileInfo fi(filePath);
+        Entry entry;
+        entry.filePath = fi.absoluteFilePath();
+        entry.name = rootDir.relativeFilePath(entry.filePath);
+        entry.size = fi.size();
+        entry.modified = fi.lastModified().toMSecsSinceEpoch();
+        entries.append(entry);
+    }
+    return entries;
+}
+
+qint64 Archive::streamSize(const QList<Entry> &entries)
+{
+    qint64 size = 0;
+    for (const Entry &entry : entries)
+        size += ENTRY_HEADER + entry.name.toUtf8().size() + (entry.type == File ? entry.size : 0);
+    return size;
+}
+
+QByteArray Archive::encodeEntryHeader(const Entry &entry)
+{
+    QByteArray path = entry.name.toUtf8();
+    QByteArray header(ENTRY_HEADER, '\0');
+    header[0] = char(entry.type);
+    qToBigEndian<quint16>(quint16(path.size()), header.data() + 1);
+    qToBigEndian<quint64>(quint64(entry.type == File ? entry.size : 0), header.data() + 3);
+    qToBigEndian<qint64>(entry.modified, header.data() + 11);
+    return header + path;
+}
+
+/**
+ * Rejects empty and absolute paths, drive letters, backslashes and ".."
+ * components.
+ */
+bool Archive::isSafeName(const QString &name)
+{
+    if (name.isEmpty() || name.startsWith('/') || name.contains('\\') || name.contains(':') || QDir::isAbsolutePath(name))
+        return false;
+
+    for (const QString &part : name.split('/'))
+    {
+        if (part.isEmpty() || part == "." || part == "..")
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @param entries Files of the archive, in stream order
+ */
+ArchiveReader::ArchiveReader(const QList<Archive::Entry> &entries)
+    : entries(entries)
+{
+}
+
+/**
+ * @brief Appends the next part of the stream.
+ *
+ * Stops at the end of the current entry, so one call never reads from two
+ * files.
+ *
+ * @param maxSize Largest number of bytes appended
+ * @param data Receives the bytes
+ * @return false if a file could not be read or changed size since it was listed
+ */
+bool ArchiveReader::read(qint64 maxSize, QByteArray *data)
+{
+    if (atEnd() || maxSize <= 0)
+        return true;
+
+    const Archive::Entry &entry = entries.at(index);
+    if (entry.type == Archive::Directory)
+    {
+        data->append(Archive::encodeEntryHeader(entry));
+        ++index;
+        return true;
+    }
+
+    if (entryOffset == 0)
+    {
+        file.setFileName(entry.filePath);
+        if (!file.open(QIODevice::ReadOnly) || file.size() != entry.size)
+        {
+            file.close();
+            return false;
+        }
+        QByteArray header = Archive::encodeEntryHeader(entry);
+        data->append(header);
+        entryOffset = header.size();
+        maxSize -= header.size();
+    }
+
+    qint64 headerSize = Archive::ENTRY_HEADER + entry.name.toUtf8().size();
+    qint64 left = entry.size - (entryOffset - headerSize);
+    qint64 length = qMin(qMax<qint64>(0, maxSize), left);
+    if (length > 0)
+    {
+        QByteArray chunk = file.read(length);
+        if (chunk.size() != length)
+        {
+            file.close();
+            return false;
+        }
+        data->append(chunk);
+        entryOffset += length;
+        left -= length;
+    }
+
+    if (left == 0)
+    {
+        file.close();
+        entryOffset = 0;
+        ++index;
+    }
+    return true;
+}
+
+/**
+ * @param directory Folder the files are written to
+ * @param expectedCount Number of entries the sender announced
+ */
+ArchiveUnpacker::ArchiveUnpacker(const QString &directory, int expectedCount)
+    : directory(directory),
+      expected(expectedCount)
+{
+}
+
+/**
+ * @brief Destructor, closes the file being written.
+ */
+ArchiveUnpacker::~ArchiveUnpacker()
+{
+    delete current;
+}
+
+/**
+ * @brief Parses and writes the next bytes of the stream.
+ *
+ * @param data Bytes following the ones written before
+ * @return false if the stream is malformed, names an unsafe path, holds more
+ *         entries than announced, or a file could not be written
+ */
+bool ArchiveUnpacker::write(const QByteArray &data)
+{
+    qint64 offset = 0;
+    while (offset < data.size())
+    {
+        if (current)
+        {
+            qint64 length = qMin(remaining, qint64(data.size()) - offset);
+            if (current->write(data.constData() + offset, length) != length)
+                return false;
+            offset += length;
+            remaining -= length;
+            if (remaining == 0)
+                closeEntry();
+            continue;
+        }
+
+        if (unpacked >= expected)
+            return false;
+
+        // Entry header first, then its path
+        qint64 needed = Archive::ENTRY_HEADER - pendingHeader.size();
+        if (needed <= 0)
+            needed += qFromBigEndian<quint16>(pendingHeader.constData() + 1);
+        qint64 length = qMin(needed, qint64(data.size()) - offset);
+        pendingHeader.append(data.constData() + offset, int(length));
+        offset += length;
+
+        if (pendingHeader.size() >= Archive::ENTRY_HEADER &&
+            pendingHeader.size() == Archive::ENTRY_HEADER + qFromBigEndian<quint16>(pendingHeader.constData() + 1) &&
+            !openEntry())
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Creates the file or folder named by the complete entry header.
+ */
+bool ArchiveUnpacker::openEntry()
+{
+    quint8 type = quint8(pendingHeader.at(0));
+    quint16 pathLength = qFromBigEndian<quint16>(pendingHeader.constData() + 1);
+    qint64 size = qint64(qFromBigEndian<quint64>(pendingHeader.constData() + 3));
+    modified = qFromBigEndian<qint64>(pendingHeader.constData() + 11);
+    QString name = QString::fromUtf8(pendingHeader.constData() + Archive::ENTRY_HEADER, pathLength);
+    pendingHeader.clear();
+    if (pathLength == 0 || pathLength > Archive::MAX_PATH || size < 0 || !Archive::isSafeName(name) ||
+        type > Archive::Directory || (type == Archive::Directory && size != 0))
+        return false;
+
+    QString filePath = QDir(directory).filePath(name);
+    if (type == Archive::Directory)
+    {
+        // Folder modification times are not kept, writing their files changes them anyway
+        if (!QDir().mkpath(filePath))
+            return false;
+        ++unpacked;
+        return true;
+    }
+
+    QDir().mkpath(QFileInfo(filePath).path());
+    current = new QFile(filePath);
+    if (!current->open(QIODevice::WriteOnly))
+    {
+        delete current;
+        current = nullptr;
+        return false;
+    }
+    written.append(filePath);
+    remaining = size;
+
+    // Empty files have no data to wait for
+    if (remaining == 0)
+        closeEntry();
+    return true;
+}
+
+void ArchiveUnpacker::closeEntry()
+{
+    // Set on the open file, after its last write
+    if (modified > 0)
+    {
+        current->flush();
+        current->setFileTime(QDateTime::fromMSecsSinceEpoch(modified), QFileDevice::FileModificationTime);
+    }
+    current->close();
+    delete current;
+    current = nullptr;
+    ++unpacked;
+}
+
+/**
+ * @brief Removes every file the archive wrote, used when the transfer failed.
+ */
+void ArchiveUnpacker::discard()
+{
+    delete current;
+    current = nullptr;
+    for (const QString &filePath : written)
+        QFile::remove(filePath);
+    written.clear();
+}
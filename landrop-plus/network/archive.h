@@ -0,0 +1,148 @@
+/**
+ * @file archive.h
+ * @brief Streaming archive packing many small files into one transfer
+ */
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+/**
+ * @namespace Archive
+ * @brief Stream format of archive transfers.
+ *
+ * An archive transfer carries several files as one stream, announced with
+ * an "archive=<count>" header option and confirmed with "archive=1". Each
+ * entry is an entry header, its type, the 16-bit length of its relative
+ * path, its 64-bit size and modification time in milliseconds since the
+ * epoch (big-endian, 0 when unknown), followed by the UTF-8 path and, for
+ * files, the data. Directory entries carry no data and recreate empty
+ * folders of a sent tree.
+ *
+ * The header's file size is the size of the whole stream, so progress,
+ * bandwidth caps and the hash trailer work on the stream as on a file.
+ */
+namespace Archive
+{
+    /** Bytes of an entry header in front of the path. */
+    const int ENTRY_HEADER = 19;
+
+    /** Entry types. */
+    enum Type : quint8
+    {
+        File = 0,
+        Directory = 1
+    };
+
+    /** Longest relative path accepted in bytes. */
+    const int MAX_PATH = 4096;
+
+    /**
+     * @brief One file of an archive.
+     */
+    struct Entry
+    {
+        /** Local file the data is read from, unused on the receiving side. */
+        QString filePath;
+
+        /** Path relative to the archive root, '/' separated. */
+        QString name;
+
+        Type type = File;
+
+        /** Size of the file, 0 for a directory. */
+        qint64 size = 0;
+
+        /** Modification time in milliseconds since the epoch, 0 when unknown. */
+        qint64 modified = 0;
+    };
+
+    /**
+     * @brief Lists files as entries named relative to their common parent folder.
+     */
+    QList<Entry> entriesFor(const QStringList &filePaths);
+
+    /** @brief Size of the stream carrying @p entries. */
+    qint64 streamSize(const QList<Entry> &entries);
+
+    QByteArray encodeEntryHeader(const Entry &entry);
+
+    /**
+     * @brief Whether a relative path stays inside the folder it is unpacked to.
+     */
+    bool isSafeName(const QString &name);
+}
+
+/**
+ * @class ArchiveReader
+ * @brief Produces the stream of an archive, opening one file at a time.
+ */
+class ArchiveReader
+{
+public:
+    explicit ArchiveReader(const QList<Archive::Entry> &entries);
+
+    bool read(qint64 maxSize, QByteArray *data);
+
+    /** @brief Whether every entry was read. */
+    bool atEnd() const { return index >= entries.size(); }
+
+private:
+    QList<Archive::Entry> entries;
+    int index = 0;
+    QFile file;
+
+    /** Bytes of the current entry read so far, its header included. */
+    qint64 entryOffset = 0;
+};
+
+/**
+ * @class ArchiveUnpacker
+ * @brief Writes the files of an archive stream as its data arrives.
+ *
+ * Entries may be split anywhere between reads. Existing files of the same
+ * name are overwritten, as for single files.
+ */
+class ArchiveUnpacker
+{
+public:
+    ArchiveUnpacker(const QString &directory, int expectedCount);
+    ~ArchiveUnpacker();
+
+    bool write(const QByteArray &data);
+    void discard();
+
+    /** @brief Whether every announced entry was written completely. */
+    bool isComplete() const { return unpacked == expected && !current; }
+
+    /** @brief Number of entries written completely so far. */
+    int unpackedCount() const { return unpacked; }
+
+private:
+    bool openEntry();
+    void closeEntry();
+
+    /** Modification time given to the file being written, 0 to keep the current one. */
+    qint64 modified = 0;
+
+    QString directory;
+    int expected;
+    int unpacked = 0;
+
+    /** Part of the entry header received so far. */
+    QByteArray pendingHeader;
+
+    /** File being written and its bytes still expected. */
+    QFile *current = nullptr;
+    qint64 remaining = 0;
+
+    /** Files created so far, removed by discard(). */
+    QStringList written;
+};
+
+#endif // ARCHIVE_H
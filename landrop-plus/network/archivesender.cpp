@@ -0,0 +1,281 @@
+/**
+ * @file archivesender.cpp
+ */
+
+#include "archivesender.h"
+#include <QHostAddress>
+#include <QDebug>
+
+/**
+ * @brief Constructs a new ArchiveSender.
+ *
+ * @param parent Parent QObject
+ */
+ArchiveSender::ArchiveSender(QObject *parent)
+    : QObject(parent),
+      timer(new QTimer(this)),
+      throttleTimer(new QTimer(this))
+{
+    timer->setSingleShot(true);
+    throttleTimer->setSingleShot(true);
+    connect(timer, &QTimer::timeout, this, [this]()
+            {
+        // qDebug() << "ArchiveSender: Timeout for" << receiverIP;
+        fail(); });
+    connect(throttleTimer, &QTimer::timeout, this, &ArchiveSender::pump);
+}
+
+/**
+ * @brief Destructor, closes the connection.
+ */
+ArchiveSender::~ArchiveSender()
+{
+    if (socket)
+    {
+        socket->blockSignals(true);
+        socket->abort();
+    }
+    delete hasher;
+    delete reader;
+}
+
+QString ArchiveSender::archiveName(int fileCount)
+{
+    return QString("%1 files").arg(fileCount);
+}
+
+/**
+ * @brief Connects to the receiver and announces the archive.
+ *
+ * @param filePaths Files to pack, named relative to their common parent folder
+ * @param receiverIP Address of the receiver
+ * @param port Transfer port of the receiver
+ * @param version Protocol version the receiver advertised
+ */
+void ArchiveSender::sendFiles(const QStringList &filePaths, const QString &receiverIP, quint16 port, int version)
+{
+    sendEntries(Archive::entriesFor(filePaths), archiveName(filePaths.size()), receiverIP, port, version);
+}
+
+/**
+ * @brief Connects to the receiver and announces prepared entries.
+ *
+ * @param entries Files and folders to send, in stream order
+ * @param name Name the archive is announced and reported with
+ * @param receiverIP Address of the receiver
+ * @param port Transfer port of the receiver
+ * @param version Protocol version the receiver advertised
+ */
+void ArchiveSender::sendEntries(const QList<Archive::Entry> &entries, const QString &name, const QString &receiverIP,
+                                quint16 port, int version)
+{
+    this->receiverIP = receiverIP;
+    this->version = version;
+    this->name = name;
+    this->entries = entries;
+    streamSize = Archive::streamSize(entries);
+    reader = new ArchiveReader(entries);
+
+    socket = new QTcpSocket(this);
+    connect(socket, &QTcpSocket::connected, this, &ArchiveSender::onConnected);
+    connect(socket, &QTcpSocket::readyRead, this, &ArchiveSender::onReadyRead);
+    connect(socket, &QTcpSocket::bytesWritten, this, &ArchiveSender::onBytesWritten);
+    connect(socket, &QTcpSocket::disconnected, this, &ArchiveSender::onDisconnected);
+    connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::errorOccurred),
+            this, [this](QAbstractSocket::SocketError socketError)
+            {
+        // The receiver closing the connection is handled in onDisconnected()
+        if (socketError != QAbstractSocket::RemoteHostClosedError)
+            fail(); });
+
+    socket->connectToHost(QHostAddress(receiverIP), port);
+    timer->start(10000); // 10 second connection timeout
+}
+
+void ArchiveSender::onConnected()
+{
+    timer->stop();
+
+    Protocol::TransferHeader header;
+    header.fileName = name;
+    header.fileSize = streamSize;
+    header.transferId = Protocol::newTransferId();
+    header.options.insert("archive", QByteArray::number(entries.size()));
+    if (Config::getIntegrityCheckEnabled())
+        header.options.insert("hash", StreamHasher::ALGORITHM);
+
+    QByteArray message = header.encode(version);
+    if (version >= Protocol::VERSION_2)
+        message.prepend(Protocol::PREAMBLE_V2);
+    dataMark = message.size();
+    socket->write(message);
+    socket->flush();
+
+    timer->start(30000); // 30 second response timeout
+}
+
+/**
+ * @brief Applies the receiver's answer to the header.
+ */
+void ArchiveSender::onReadyRead()
+{
+    if (streaming)
+    {
+        // Nothing else is expected from the receiver
+        socket->readAll();
+        return;
+    }
+
+    QByteArray message;
+    Protocol::ReadStatus status = Protocol::readMessage(socket, version, &message);
+    if (status == Protocol::ReadStatus::Incomplete)
+        return;
+
+    timer->stop();
+    Protocol::TransferReply reply;
+    if (status != Protocol::ReadStatus::Complete || !Protocol::TransferReply::decode(message, &reply))
+    {
+        fail();
+        return;
+    }
+
+    if (!reply.accepted)
+    {
+        emit transferRefused(0);
+        finish();
+        return;
+    }
+
+    // A receiver that does not unpack archives would store the raw stream
+    QByteArray hash = reply.options.value("hash");
+    if (reply.options.value("archive") != "1" || (!hash.isEmpty() && hash != StreamHasher::ALGORITHM))
+    {
+        fail();
+        return;
+    }
+
+    if (!hash.isEmpty())
+        hasher = new StreamHasher();
+    streaming = true;
+    emit transferAccepted(0);
+    pump();
+}
+
+/**
+ * @brief Accounts for written bytes, reports progress and refills.
+ *
+ * @param bytes Number of bytes Qt handed to the operating system
+ */
+void ArchiveSender::onBytesWritten(qint64 bytes)
+{
+    flushed += bytes;
+    if (!streaming || done)
+        return;
+
+    window.recordWritten(bytes, socket->bytesToWrite());
+
+    qint64 data = qMax<qint64>(0, flushed - dataMark);
+    int percent = streamSize > 0 ? static_cast<int>(qMin<qint64>(100, data * 100 / streamSize)) : 100;
+    if (percent != lastProgress)
+    {
+        lastProgress = percent;
+        emit progressUpdated(0, percent);
+    }
+
+    if (trailerQueued && socket->bytesToWrite() == 0)
+    {
+        emit transferFinished(0);
+        finish();
+        socket->disconnectFromHost();
+    }
+    else if (socket->bytesToWrite() <= window.lowWater())
+    {
+        pump();
+    }
+}
+
+void ArchiveSender::onDisconnected()
+{
+    if (!done)
+        fail();
+}
+
+/**
+ * @brief Queues the stream up to the window, then the trailer.
+ */
+void ArchiveSender::pump()
+{
+    if (done || !streaming || trailerQueued)
+        return;
+
+    while (!reader->atEnd() && socket->bytesToWrite() < window.highWater())
+    {
+        int wait = BandwidthShaper::delay(receiverIP, &bucket);
+        if (wait > 0)
+        {
+            if (!throttleTimer->isActive())
+                throttleTimer->start(wait);
+            return;
+        }
+
+        QByteArray chunk;
+        if (!reader->read(window.chunkSize(), &chunk) || position + chunk.size() > streamSize ||
+            socket->write(chunk) != chunk.size())
+        {
+            fail();
+            return;
+        }
+        if (hasher)
+            hasher->addData(chunk);
+        position += chunk.size();
+        BandwidthShaper::consume(receiverIP, &bucket, chunk.size());
+    }
+
+    if (!reader->atEnd())
+        return;
+
+    trailerQueued = true;
+    if (hasher)
+    {
+        QByteArray digest = hasher->result();
+        QByteArray trailer = Protocol::encodeTrailer(version, digest);
+        if (digest.isEmpty() || socket->write(trailer) != trailer.size())
+        {
+            fail();
+            return;
+        }
+    }
+
+    // Nothing left to flush, so no bytesWritten() will finish the transfer
+    if (socket->bytesToWrite() == 0)
+    {
+        emit transferFinished(0);
+        finish();
+        socket->disconnectFromHost();
+    }
+}
+
+void ArchiveSender::fail()
+{
+    if (done)
+        return;
+
+    emit transferError(0);
+    finish();
+    if (socket && socket->state() != QAbstractSocket::UnconnectedState)
+        socket->abort();
+}
+
+/**
+ * @brief Emits archiveFinished() once.
+ */
+void ArchiveSender::finish()
+{
+    if (done)
+        return;
+
+    done = true;
+    timer->stop();
+    throttleTimer->stop();
+    emit archiveFinished();
+}
@@ -0,0 +1,121 @@
+/**
+ * @file archivesender.h
+ * @brief Sends many small files to one receiver as a single archive stream
+ */
+
+#ifndef ARCHIVESENDER_H
+#define ARCHIVESENDER_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QStringList>
+#include "../config/config.h"
+#include "protocol.h"
+#include "archive.h"
+#include "sendwindow.h"
+#include "streamhasher.h"
+#include "bandwidthshaper.h"
+
+/**
+ * @class ArchiveSender
+ * @brief Packs files into one archive transfer (see Archive).
+ *
+ * The receiver answers a single header for all the files and unpacks them
+ * on the fly, so a tree of tiny files costs one round trip and one request
+ * instead of one per file. Archive transfers are plain single-connection
+ * data with an optional hash trailer over the whole stream; a receiver that
+ * does not confirm the archive option is not sent any data.
+ *
+ * Signals carry the index of the transfer like the other multi-file
+ * senders, it is always 0.
+ */
+class ArchiveSender : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ArchiveSender(QObject *parent = nullptr);
+    ~ArchiveSender();
+
+    void sendFiles(const QStringList &filePaths, const QString &receiverIP, quint16 port, int version = Protocol::VERSION_1);
+    void sendEntries(const QList<Archive::Entry> &entries, const QString &name, const QString &receiverIP, quint16 port,
+                     int version = Protocol::VERSION_1);
+
+    /** @brief Lane of the bandwidth shaper the archive moves in. */
+    void setPriority(TransferPriority priority) { bucket.setPriority(priority); }
+
+    /**
+     * @brief Name the archive is announced with.
+     */
+    static QString archiveName(int fileCount);
+
+signals:
+    /** @brief Signal emitted when the receiver accepts the archive. */
+    void transferAccepted(int index);
+
+    /** @brief Signal emitted when the receiver declines the archive. */
+    void transferRefused(int index);
+
+    /**
+     * @brief Signal emitted when transfer progress is updated.
+     * @param index Always 0
+     * @param percent Completion percentage of the whole stream (0-100)
+     */
+    void progressUpdated(int index, int percent);
+
+    /** @brief Signal emitted once the whole stream was sent. */
+    void transferFinished(int index);
+
+    /** @brief Signal emitted when the archive could not be sent. */
+    void transferError(int index);
+
+    /** @brief Signal emitted once the transfer is resolved. */
+    void archiveFinished();
+
+private:
+    void onConnected();
+    void onReadyRead();
+    void onBytesWritten(qint64 bytes);
+    void onDisconnected();
+    void pump();
+    void fail();
+    void finish();
+
+    QString receiverIP;
+    int version = Protocol::VERSION_1;
+    QString name;
+    QList<Archive::Entry> entries;
+    qint64 streamSize = 0;
+    ArchiveReader *reader = nullptr;
+    QTcpSocket *socket = nullptr;
+
+    /** Whether the receiver accepted and data is being streamed. */
+    bool streaming = false;
+
+    /** Whether archiveFinished() was emitted. */
+    bool done = false;
+
+    /** Stream offset queued on the socket so far. */
+    qint64 position = 0;
+
+    /** Bytes queued before the stream, and bytes handed to the operating system. */
+    qint64 dataMark = 0;
+    qint64 flushed = 0;
+
+    bool trailerQueued = false;
+    int lastProgress = -1;
+    AdaptiveSendWindow window;
+    TokenBucket bucket;
+
+    /** Hashes the stream for a verifying receiver, null otherwise. */
+    StreamHasher *hasher = nullptr;
+
+    /** Connection timeout, then response timeout. */
+    QTimer *timer;
+
+    /** Timer continuing after a bandwidth cap paused the stream. */
+    QTimer *throttleTimer;
+};
+
+#endif // ARCHIVESENDER_H
@@ -0,0 +1,238 @@
+/**
+ * @file bandwidthshaper.cpp
+ */
+
+#include "bandwidthshaper.h"
+#include "transferprofiles.h"
+#include "../config/config.h"
+#include <QHash>
+#include <QHostAddress>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QAtomicInteger>
+#include <cmath>
+
+namespace
+{
+    /** Longest single pause, so a lowered or removed cap is picked up quickly. */
+    const int MAX_DELAY = 1000;
+
+    QMutex shaperMutex;
+    TokenBucket globalBucket;
+    QHash<QString, TokenBucket> peerBuckets;
+
+    const int LANE_COUNT = int(TransferPriority::INTERACTIVE) + 1;
+
+    /** Shared buckets of the lanes while they yield to a higher one. */
+    TokenBucket yieldBuckets[LANE_COUNT];
+
+    /** Time each lane last moved data, plus one so 0 means never. */
+    QAtomicInteger<qint64> laneActiveAt[LANE_COUNT];
+
+    qint64 laneNow()
+    {
+        static QElapsedTimer clock = []()
+        {
+            QElapsedTimer started;
+            started.start();
+            return started;
+        }();
+        return clock.elapsed() + 1;
+    }
+
+    bool laneActive(int lane, qint64 now)
+    {
+        qint64 at = laneActiveAt[lane].loadRelaxed();
+        return at > 0 && now - at <= BandwidthShaper::LANE_ACTIVE_MS;
+    }
+
+    /**
+     * @brief Whether a lane above the session's one is moving data.
+     */
+    bool outranked(const TokenBucket *session)
+    {
+        if (!session)
+            return false;
+        qint64 now = laneNow();
+        for (int lane = int(session->priority()) + 1; lane < LANE_COUNT; ++lane)
+        {
+            if (laneActive(lane, now))
+                return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Whether connections of more than one lane are moving data.
+     */
+    bool contended()
+    {
+        qint64 now = laneNow();
+        int active = 0;
+        for (int lane = 0; lane < LANE_COUNT; ++lane)
+            active += laneActive(lane, now) ? 1 : 0;
+        return active > 1;
+    }
+
+    /**
+     * @brief Whether a global, peer, session or profile cap is configured.
+     */
+    bool capped()
+    {
+        return Config::getGlobalRateLimit() > 0 || Config::getPeerRateLimit() > 0 ||
+               Config::getSessionRateLimit() > 0 || TransferProfiles::limitsRates();
+    }
+
+    /**
+     * @brief Same key for an IPv4 peer whether it is seen as IPv4 or IPv4-mapped IPv6.
+     */
+    QString peerKey(const QString &peer)
+    {
+        QHostAddress address(peer);
+        bool isIPv4 = false;
+        quint32 ipv4 = address.toIPv4Address(&isIPv4);
+        return isIPv4 ? QHostAddress(ipv4).toString() : peer;
+    }
+
+    /**
+     * @brief Updates the rates of the buckets a call involves from Config and the peer's profile.
+     */
+    TokenBucket *prepare(const QString &peer, TokenBucket *session)
+    {
+        TransferProfiles::Settings settings = TransferProfiles::settings(peer);
+        globalBucket.setRate(Config::getGlobalRateLimit());
+        if (session)
+            session->setRate(settings.sessionRateLimit);
+
+        if (peer.isEmpty() || settings.peerRateLimit <= 0)
+            return nullptr;
+        TokenBucket *peerBucket = &peerBuckets[peerKey(peer)];
+        peerBucket->setRate(settings.peerRateLimit);
+        return peerBucket;
+    }
+}
+
+/**
+ * @param bytesPerSecond New rate, 0 or less for unlimited
+ */
+void TokenBucket::setRate(qint64 bytesPerSecond)
+{
+    bytesPerSecond = qMax<qint64>(0, bytesPerSecond);
+    if (bytesPerSecond == this->bytesPerSecond)
+        return;
+
+    // A bucket that was never used starts with a full burst on its first refill
+    if (clock.isValid())
+        refill();
+    this->bytesPerSecond = bytesPerSecond;
+    if (clock.isValid())
+        tokens = qMin(tokens, double(bytesPerSecond * BURST_MS / 1000));
+}
+
+/**
+ * @brief Milliseconds until the bucket is no longer in debt.
+ * @return 0 if unlimited or data may be moved now
+ */
+int TokenBucket::delay()
+{
+    if (bytesPerSecond <= 0)
+        return 0;
+
+    refill();
+    if (tokens > 0)
+        return 0;
+    return qBound(1, int(std::ceil(-tokens * 1000.0 / double(bytesPerSecond))), MAX_DELAY);
+}
+
+/**
+ * @brief Charges bytes that were moved; unlimited buckets keep no balance.
+ */
+void TokenBucket::consume(qint64 bytes)
+{
+    if (bytesPerSecond <= 0)
+        return;
+
+    refill();
+    tokens -= double(bytes);
+}
+
+/**
+ * @brief Adds the tokens earned since the last call, up to the burst size.
+ */
+void TokenBucket::refill()
+{
+    double burst = double(bytesPerSecond * BURST_MS / 1000);
+    if (!clock.isValid())
+    {
+        clock.start();
+        tokens = burst;
+        return;
+    }
+
+    double elapsed = double(clock.nsecsElapsed()) / 1e9;
+    clock.restart();
+    tokens = qMin(burst, tokens + elapsed * double(bytesPerSecond));
+}
+
+bool BandwidthShaper::isLimited()
+{
+    return capped() || contended();
+}
+
+bool BandwidthShaper::isShaping(const TokenBucket *session)
+{
+    return capped() || outranked(session);
+}
+
+qint64 BandwidthShaper::step(qint64 wanted)
+{
+    return isLimited() ? qMin(wanted, MAX_STEP) : wanted;
+}
+
+int BandwidthShaper::delay(const QString &peer, TokenBucket *session)
+{
+    if (!isShaping(session))
+        return 0;
+
+    bool yielding = outranked(session);
+    QMutexLocker lock(&shaperMutex);
+    TokenBucket *peerBucket = prepare(peer, session);
+    int wait = globalBucket.delay();
+    if (peerBucket)
+        wait = qMax(wait, peerBucket->delay());
+    if (session)
+        wait = qMax(wait, session->delay());
+    if (yielding)
+    {
+        // A lane paused by the yield still counts as busy, so its next block stays small
+        laneActiveAt[int(session->priority())].storeRelaxed(laneNow());
+        TokenBucket &yieldBucket = yieldBuckets[int(session->priority())];
+        yieldBucket.setRate(Config::getYieldRate());
+        wait = qMax(wait, yieldBucket.delay());
+    }
+    return wait;
+}
+
+void BandwidthShaper::consume(const QString &peer, TokenBucket *session, qint64 bytes)
+{
+    if (bytes <= 0)
+        return;
+    if (session)
+        laneActiveAt[int(session->priority())].storeRelaxed(laneNow());
+    if (!isShaping(session))
+        return;
+
+    QMutexLocker lock(&shaperMutex);
+    TokenBucket *peerBucket = prepare(peer, session);
+    globalBucket.consume(bytes);
+    if (peerBucket)
+        peerBucket->consume(bytes);
+    if (session)
+        session->consume(bytes);
+    if (outranked(session))
+    {
+        TokenBucket &yieldBucket = yieldBuckets[int(session->priority())];
+        yieldBucket.setRate(Config::getYieldRate());
+        yieldBucket.consume(bytes);
+    }
+}
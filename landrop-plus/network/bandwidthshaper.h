@@ -0,0 +1,115 @@
+/**
+ * @file bandwidthshaper.h
+ * @brief Token-bucket rate limits shared by every transfer connection
+ */
+
+#ifndef BANDWIDTHSHAPER_H
+#define BANDWIDTHSHAPER_H
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QtGlobal>
+#include "../core/transferpriority.h"
+
+/**
+ * @class TokenBucket
+ * @brief Allows a byte rate with a short burst, spending ahead on credit.
+ *
+ * Connections send or read a block whenever the bucket is not empty and
+ * pay for it afterwards, so the balance may go negative; delay() then says
+ * how long the connection has to pause until the debt is paid back.
+ */
+class TokenBucket
+{
+public:
+    void setRate(qint64 bytesPerSecond);
+
+    /** @brief Allowed rate in bytes per second, 0 when unlimited. */
+    qint64 rate() const { return bytesPerSecond; }
+
+    /** @brief Sets the lane of the connection the bucket belongs to. */
+    void setPriority(TransferPriority priority) { lane = priority; }
+
+    /** @brief Lane of the connection, NORMAL unless set. */
+    TransferPriority priority() const { return lane; }
+
+    int delay();
+    void consume(qint64 bytes);
+
+private:
+    /** Burst allowed after an idle period, in milliseconds of the rate. */
+    static const qint64 BURST_MS = 250;
+
+    void refill();
+
+    qint64 bytesPerSecond = 0;
+    double tokens = 0;
+    QElapsedTimer clock;
+    TransferPriority lane = TransferPriority::NORMAL;
+};
+
+/**
+ * @namespace BandwidthShaper
+ * @brief Applies the global, per-peer and per-session caps of Config.
+ *
+ * Every Sender, PeerSession and Receiver connection asks delay() before it
+ * moves the next block and reports the bytes it moved with consume(). The
+ * global bucket is shared by all connections in both directions, the peer
+ * buckets by all connections to or from one address, and the session bucket
+ * belongs to the caller. Caps are read from Config on every call, so a
+ * changed limit applies to running transfers straight away; a peer with a
+ * profile takes its peer and session caps from the profile (see
+ * TransferProfiles), which a reload changes just as promptly.
+ *
+ * The session bucket also tells the lane of its connection (see
+ * TransferPriority). While a higher lane moved data within LANE_ACTIVE_MS,
+ * all connections of a lower lane share one bucket at
+ * Config::getYieldRate(), so a bulk transfer leaves the link to an
+ * interactive one without stalling completely.
+ *
+ * Without a cap, only the connections of an outranked lane take the shared
+ * lock; the highest active lane, or several connections of one lane, stay
+ * on the atomic lane clocks.
+ */
+namespace BandwidthShaper
+{
+    /** Largest block moved between two checks while a cap is set. */
+    const qint64 MAX_STEP = 64 * 1024;
+
+    /** Time a lane counts as busy after it last moved data, in milliseconds. */
+    const int LANE_ACTIVE_MS = 200;
+
+    /**
+     * @brief Whether any cap is configured or connections of several lanes are moving data.
+     */
+    bool isLimited();
+
+    /**
+     * @brief Whether delay() and consume() have buckets to update for the session's connection.
+     *
+     * True when a cap is configured, or a lane above the session's one is
+     * moving data; otherwise both return without taking the shared lock.
+     */
+    bool isShaping(const TokenBucket *session);
+
+    /**
+     * @brief Limits a block to MAX_STEP while shaping, so pauses stay short.
+     */
+    qint64 step(qint64 wanted);
+
+    /**
+     * @brief Time the caller has to wait before moving more data.
+     *
+     * @param peer Address of the remote side
+     * @param session Bucket of the caller's connection
+     * @return Milliseconds to wait, 0 if data may be moved now
+     */
+    int delay(const QString &peer, TokenBucket *session);
+
+    /**
+     * @brief Charges moved bytes to the global, peer and session buckets.
+     */
+    void consume(const QString &peer, TokenBucket *session, qint64 bytes);
+}
+
+#endif // BANDWIDTHSHAPER_H
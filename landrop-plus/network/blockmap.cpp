@@ -0,0 +1,201 @@
+/**
+ * @file blockmap.cpp
+ */
+
+#include "blockmap.h"
+#include <QtEndian>
+#include <cstring>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+namespace
+{
+#if !defined(__SSE4_2__) && !defined(__ARM_FEATURE_CRC32)
+    /** Reflected CRC-32C polynomial */
+    const quint32 POLYNOMIAL = 0x82F63B78;
+
+    /**
+     * @brief Tables processing eight bytes per step (slicing-by-8).
+     */
+    struct CrcTables
+    {
+        quint32 table[8][256];
+
+        CrcTables()
+        {
+            for (quint32 i = 0; i < 256; ++i)
+            {
+                quint32 crc = i;
+                for (int bit = 0; bit < 8; ++bit)
+                    crc = (crc & 1) ? (crc >> 1) ^ POLYNOMIAL : crc >> 1;
+                table[0][i] = crc;
+            }
+            for (quint32 i = 0; i < 256; ++i)
+            {
+                for (int k = 1; k < 8; ++k)
+                    table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+            }
+        }
+    };
+
+    const CrcTables &crcTables()
+    {
+        static const CrcTables tables;
+        return tables;
+    }
+#endif
+}
+
+BlockMap::BlockMap(qint64 fileSize, qint64 blockSize)
+    : size(qMax<qint64>(0, fileSize)),
+      block(qMax<qint64>(1, blockSize))
+{
+    int blockCount = int((size + block - 1) / block);
+    held.resize(blockCount);
+    checksums.fill(0, blockCount);
+}
+
+qint64 BlockMap::blockSizeFor(qint64 fileSize)
+{
+    qint64 blockSize = MIN_BLOCK_SIZE;
+    while ((fileSize + blockSize - 1) / blockSize > MAX_BLOCKS)
+        blockSize *= 2;
+    return blockSize;
+}
+
+quint32 BlockMap::checksum(const char *data, qint64 length, quint32 previous)
+{
+    quint32 crc = ~previous;
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+
+#if defined(__SSE4_2__)
+    quint64 wide = crc;
+    for (; length >= 8; bytes += 8, length -= 8)
+    {
+        quint64 word;
+        memcpy(&word, bytes, 8);
+        wide = _mm_crc32_u64(wide, word);
+    }
+    crc = quint32(wide);
+    for (; length > 0; ++bytes, --length)
+        crc = _mm_crc32_u8(crc, *bytes);
+#elif defined(__ARM_FEATURE_CRC32)
+    for (; length >= 8; bytes += 8, length -= 8)
+    {
+        quint64 word;
+        memcpy(&word, bytes, 8);
+        crc = __crc32cd(crc, word);
+    }
+    for (; length > 0; ++bytes, --length)
+        crc = __crc32cb(crc, *bytes);
+#else
+    const CrcTables &tables = crcTables();
+    for (; length >= 8; bytes += 8, length -= 8)
+    {
+        quint32 low = qFromLittleEndian<quint32>(bytes) ^ crc;
+        quint32 high = qFromLittleEndian<quint32>(bytes + 4);
+        crc = tables.table[7][low & 0xFF] ^ tables.table[6][(low >> 8) & 0xFF] ^
+              tables.table[5][(low >> 16) & 0xFF] ^ tables.table[4][low >> 24] ^
+              tables.table[3][high & 0xFF] ^ tables.table[2][(high >> 8) & 0xFF] ^
+              tables.table[1][(high >> 16) & 0xFF] ^ tables.table[0][high >> 24];
+    }
+    for (; length > 0; ++bytes, --length)
+        crc = (crc >> 8) ^ tables.table[0][(crc ^ *bytes) & 0xFF];
+#endif
+
+    return ~crc;
+}
+
+quint32 BlockMap::checksum(const QByteArray &data, quint32 previous)
+{
+    return checksum(data.constData(), data.size(), previous);
+}
+
+QByteArray BlockMap::encodeChecksums(const QVector<quint32> &checksums)
+{
+    QByteArray encoded(checksums.size() * 4, Qt::Uninitialized);
+    for (int i = 0; i < checksums.size(); ++i)
+        qToBigEndian<quint32>(checksums[i], encoded.data() + i * 4);
+    return encoded;
+}
+
+bool BlockMap::decodeChecksums(const QByteArray &encoded, QVector<quint32> *checksums)
+{
+    checksums->clear();
+    if (encoded.size() % 4 != 0)
+        return false;
+    checksums->reserve(encoded.size() / 4);
+    for (int offset = 0; offset < encoded.size(); offset += 4)
+        checksums->append(qFromBigEndian<quint32>(encoded.constData() + offset));
+    return true;
+}
+
+qint64 BlockMap::blockLength(int index) const
+{
+    return qMax<qint64>(0, qMin(block, size - index * block));
+}
+
+void BlockMap::setHeld(int index, quint32 blockChecksum)
+{
+    if (index < 0 || index >= held.size())
+        return;
+    if (!held.testBit(index))
+        heldBlocks++;
+    held.setBit(index);
+    checksums[index] = blockChecksum;
+}
+
+void BlockMap::clearHeld(int index)
+{
+    if (index < 0 || index >= held.size() || !held.testBit(index))
+        return;
+    held.clearBit(index);
+    checksums[index] = 0;
+    heldBlocks--;
+}
+
+QByteArray BlockMap::bitmap() const
+{
+    QByteArray bits((held.size() + 7) / 8, '\0');
+    for (int i = 0; i < held.size(); ++i)
+    {
+        if (held.testBit(i))
+            bits[i / 8] = char(uchar(bits[i / 8]) | (1 << (i % 8)));
+    }
+    return bits;
+}
+
+QVector<quint32> BlockMap::heldChecksums() const
+{
+    QVector<quint32> sums;
+    sums.reserve(heldBlocks);
+    for (int i = 0; i < held.size(); ++i)
+    {
+        if (held.testBit(i))
+            sums.append(checksums[i]);
+    }
+    return sums;
+}
+
+bool BlockMap::restore(const QByteArray &bitmapData, const QVector<quint32> &heldSums)
+{
+    if (bitmapData.size() != (held.size() + 7) / 8)
+        return false;
+
+    QList<int> indexes;
+    for (int i = 0; i < held.size(); ++i)
+    {
+        if (uchar(bitmapData[i / 8]) & (1 << (i % 8)))
+            indexes.append(i);
+    }
+    if (indexes.size() != heldSums.size())
+        return false;
+
+    for (int i = 0; i < indexes.size(); ++i)
+        setHeld(indexes[i], heldSums[i]);
+    return true;
+}
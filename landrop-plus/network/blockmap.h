@@ -0,0 +1,102 @@
+/**
+ * @file blockmap.h
+ * @brief Fixed-size blocks of a file, their checksums and which of them are held
+ */
+
+#ifndef BLOCKMAP_H
+#define BLOCKMAP_H
+
+#include <QBitArray>
+#include <QByteArray>
+#include <QVector>
+
+/**
+ * @class BlockMap
+ * @brief Splits a file into blocks of one size and records the verified ones.
+ *
+ * Each block is checked with a CRC-32C of its bytes: a corrupted block is
+ * found and received again on its own instead of failing the whole file.
+ * SwarmDownload checks every block as it arrives against the checksum the
+ * peer sent with it; a Sender lists the checksums of all blocks in its hash
+ * trailer, so the Receiver can ask for the blocks that do not match (see
+ * Protocol::encodeTrailer()). The blocks held and their checksums are saved
+ * with ResumeState::saveBlocks(), a download resumed after a crash keeps
+ * every block still matching its checksum.
+ */
+class BlockMap
+{
+public:
+    BlockMap() = default;
+    BlockMap(qint64 fileSize, qint64 blockSize);
+
+    /** Smallest block size used for transfers */
+    static const qint64 MIN_BLOCK_SIZE = 1024 * 1024;
+
+    /** Most blocks of a file, larger files get larger blocks */
+    static const int MAX_BLOCKS = 16384;
+
+    /** Times a transfer asks for its corrupted blocks again before it fails */
+    static const int MAX_REPAIR_ROUNDS = 3;
+
+    /**
+     * @brief Block size of a file: MIN_BLOCK_SIZE, doubled until it has at most MAX_BLOCKS blocks.
+     */
+    static qint64 blockSizeFor(qint64 fileSize);
+
+    /**
+     * @brief CRC-32C (Castagnoli) of a buffer.
+     *
+     * Uses the CPU's CRC instruction when the build targets it (SSE 4.2,
+     * ARMv8 CRC), a table otherwise.
+     *
+     * @param previous Checksum of the data before, to checksum a block in parts
+     */
+    static quint32 checksum(const char *data, qint64 length, quint32 previous = 0);
+    static quint32 checksum(const QByteArray &data, quint32 previous = 0);
+
+    /**
+     * @brief Checksums as big-endian 32-bit values, back to back.
+     */
+    static QByteArray encodeChecksums(const QVector<quint32> &checksums);
+    static bool decodeChecksums(const QByteArray &encoded, QVector<quint32> *checksums);
+
+    qint64 fileSize() const { return size; }
+    qint64 blockSize() const { return block; }
+    int count() const { return held.size(); }
+    int heldCount() const { return heldBlocks; }
+    bool isComplete() const { return heldBlocks == held.size(); }
+
+    qint64 blockOffset(int index) const { return index * block; }
+    qint64 blockLength(int index) const;
+
+    bool isHeld(int index) const { return held.testBit(index); }
+    quint32 checksumOf(int index) const { return checksums.value(index); }
+    void setHeld(int index, quint32 blockChecksum);
+    void clearHeld(int index);
+
+    /**
+     * @brief Bitmap of the blocks held, one bit per block in file order.
+     */
+    QByteArray bitmap() const;
+
+    /**
+     * @brief Checksums of the blocks held, in file order.
+     */
+    QVector<quint32> heldChecksums() const;
+
+    /**
+     * @brief Marks blocks held from bitmap() and heldChecksums() of the same file.
+     *
+     * @return false if they do not describe this map's blocks (nothing is marked)
+     */
+    bool restore(const QByteArray &bitmapData, const QVector<quint32> &heldSums);
+
+private:
+    qint64 size = 0;
+    qint64 block = MIN_BLOCK_SIZE;
+    QBitArray held;
+    QVector<quint32> checksums;
+    int heldBlocks = 0;
+};
+
+#endif // BLOCKMAP_H
@@ -0,0 +1,138 @@
+/**
+ * @file bufferpool.cpp
+ */
+
+#include "bufferpool.h"
+#include <QAtomicInteger>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+
+namespace
+{
+    QMutex poolMutex;
+    QHash<qint64, QList<QByteArray>> idle;
+
+    QAtomicInteger<qint64> allocations;
+    QAtomicInteger<qint64> reuses;
+    QAtomicInteger<qint64> idleBytes;
+    QAtomicInteger<qint64> peakIdleBytes;
+
+    void addIdle(qint64 bytes)
+    {
+        qint64 now = idleBytes.fetchAndAddRelaxed(bytes) + bytes;
+        qint64 peak = peakIdleBytes.loadRelaxed();
+        while (now > peak && !peakIdleBytes.testAndSetRelaxed(peak, now))
+            peak = peakIdleBytes.loadRelaxed();
+    }
+
+    /**
+     * @brief Buffers the calling thread released last, taken again without the mutex.
+     *
+     * A connection reading block after block hands back the buffer it
+     * acquires next, so its steady state never reaches the shared lists.
+     */
+    struct ThreadCache
+    {
+        QList<QByteArray> buffers;
+
+        ~ThreadCache()
+        {
+            for (const QByteArray &buffer : std::as_const(buffers))
+                idleBytes.fetchAndAddRelaxed(-buffer.capacity());
+        }
+    };
+
+    thread_local ThreadCache cache;
+}
+
+QByteArray BufferPool::acquire(qint64 size)
+{
+    if (size <= 0)
+        return QByteArray();
+
+    QByteArray buffer;
+    for (int i = int(cache.buffers.size()) - 1; i >= 0; --i)
+    {
+        if (cache.buffers.at(i).capacity() == size)
+        {
+            buffer = cache.buffers.takeAt(i);
+            break;
+        }
+    }
+
+    if (buffer.isNull())
+    {
+        QMutexLocker lock(&poolMutex);
+        auto it = idle.find(size);
+        if (it == idle.end() || it->isEmpty())
+        {
+            lock.unlock();
+            allocations.fetchAndAddRelaxed(1);
+            return QByteArray(int(size), Qt::Uninitialized);
+        }
+        buffer = it->takeLast();
+    }
+
+    idleBytes.fetchAndAddRelaxed(-size);
+    reuses.fetchAndAddRelaxed(1);
+
+    // Shrunk by its last user, the capacity is still there
+    buffer.resize(size);
+    return buffer;
+}
+
+void BufferPool::release(QByteArray &buffer)
+{
+    qint64 capacity = buffer.capacity();
+    if (capacity <= 0 || !buffer.isDetached() || idleBytes.loadRelaxed() + capacity > MAX_IDLE_BYTES)
+    {
+        buffer = QByteArray();
+        return;
+    }
+
+    addIdle(capacity);
+    if (cache.buffers.size() < THREAD_BUFFERS)
+    {
+        cache.buffers.append(std::move(buffer));
+    }
+    else
+    {
+        QMutexLocker lock(&poolMutex);
+        idle[capacity].append(std::move(buffer));
+    }
+    buffer = QByteArray();
+}
+
+BufferPool::Stats BufferPool::stats()
+{
+    Stats stats;
+    stats.allocations = allocations.loadRelaxed();
+    stats.reuses = reuses.loadRelaxed();
+    stats.idleBytes = idleBytes.loadRelaxed();
+    stats.peakIdleBytes = peakIdleBytes.loadRelaxed();
+    return stats;
+}
+
+void BufferPool::resetStats()
+{
+    allocations.storeRelaxed(0);
+    reuses.storeRelaxed(0);
+    peakIdleBytes.storeRelaxed(idleBytes.loadRelaxed());
+}
+
+void BufferPool::clear()
+{
+    qint64 freed = 0;
+    for (const QByteArray &buffer : std::as_const(cache.buffers))
+        freed += buffer.capacity();
+    cache.buffers.clear();
+
+    QMutexLocker lock(&poolMutex);
+    for (auto it = idle.constBegin(); it != idle.constEnd(); ++it)
+        freed += it.key() * it->size();
+    idle.clear();
+    lock.unlock();
+    idleBytes.fetchAndAddRelaxed(-freed);
+}
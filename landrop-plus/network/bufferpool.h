@@ -0,0 +1,77 @@
+/**
+ * @file bufferpool.h
+ * @brief Reusable data buffers shared by the send and receive paths
+ */
+
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <QByteArray>
+#include <QtGlobal>
+
+/**
+ * @namespace BufferPool
+ * @brief Free lists of data buffers, one per buffer size.
+ *
+ * The data path reads every chunk into a buffer taken with acquire() and
+ * hands it back with release() once the bytes were written out, so a
+ * running transfer reuses the same few blocks instead of allocating one per
+ * chunk. Buffers are ordinary QByteArrays: a buffer still shared by another
+ * holder (a hasher queue, a relay) is not taken back and is freed by its
+ * last holder as usual.
+ *
+ * At most MAX_IDLE_BYTES are kept idle; stats() tells how often the pool
+ * had to allocate, which stays flat once transfers reached their steady
+ * state.
+ *
+ * Thread-safe, used by the disk and hashing threads as well. Each thread
+ * keeps the last THREAD_BUFFERS buffers it released for itself, so the
+ * steady state of a data path takes neither a lock nor an allocation; the
+ * shared free lists behind them are locked.
+ */
+namespace BufferPool
+{
+    /** Idle bytes kept for reuse at most. */
+    const qint64 MAX_IDLE_BYTES = 64 * 1024 * 1024;
+
+    /** Released buffers each thread keeps for its own next acquire(). */
+    const int THREAD_BUFFERS = 4;
+
+    /** Counters of the pool since the start or resetStats(). */
+    struct Stats
+    {
+        /** Buffers allocated because none of the size was idle. */
+        qint64 allocations = 0;
+
+        /** Buffers handed out again from the pool. */
+        qint64 reuses = 0;
+
+        /** Bytes of the buffers idle in the pool now. */
+        qint64 idleBytes = 0;
+
+        /** Largest amount of idle bytes held at once. */
+        qint64 peakIdleBytes = 0;
+    };
+
+    /**
+     * @brief Takes a detached buffer of @p size bytes, contents undefined.
+     */
+    QByteArray acquire(qint64 size);
+
+    /**
+     * @brief Gives a buffer taken with acquire() back for reuse and empties @p buffer.
+     *
+     * The buffer's capacity decides which acquire() size gets it again.
+     */
+    void release(QByteArray &buffer);
+
+    Stats stats();
+    void resetStats();
+
+    /**
+     * @brief Frees the idle buffers of the shared lists and of the calling thread.
+     */
+    void clear();
+}
+
+#endif // BUFFERPOOL_H
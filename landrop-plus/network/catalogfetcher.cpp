@@ -0,0 +1,181 @@
+/**
+ * @file catalogfetcher.cpp
+ */
+
+#include "catalogfetcher.h"
+#include "sharedcatalog.h"
+#include <QHostAddress>
+#include <QJsonDocument>
+
+/**
+ * @brief Constructs a new CatalogFetcher.
+ *
+ * @param parent Parent QObject
+ */
+CatalogFetcher::CatalogFetcher(QObject *parent)
+    : QObject(parent),
+      timer(new QTimer(this))
+{
+    timer->setSingleShot(true);
+    connect(timer, &QTimer::timeout, this, &CatalogFetcher::fail);
+}
+
+/**
+ * @brief Destructor, closes the connection.
+ */
+CatalogFetcher::~CatalogFetcher()
+{
+    if (socket)
+    {
+        socket->blockSignals(true);
+        socket->abort();
+    }
+}
+
+/**
+ * @brief Sets the copy of the catalog already held, called before fetch().
+ *
+ * @param files Entries held
+ * @param generation Generation of the peer's catalog they were fetched at
+ * @param catalogVersion Version of the entries held
+ */
+void CatalogFetcher::setBase(const QJsonArray &files, quint64 generation, quint64 catalogVersion)
+{
+    baseFiles = files;
+    baseGeneration = generation;
+    baseVersion = catalogVersion;
+}
+
+/**
+ * @brief Connects to the peer and asks for the first page.
+ *
+ * @param ownerIP Address of the peer
+ * @param ownerPort Transfer port of the peer
+ * @param version Protocol version the peer advertised
+ */
+void CatalogFetcher::fetch(const QString &ownerIP, quint16 ownerPort, int version)
+{
+    this->ownerIP = ownerIP;
+    this->version = version;
+
+    socket = new QTcpSocket(this);
+    connect(socket, &QTcpSocket::connected, this, &CatalogFetcher::onConnected);
+    connect(socket, &QTcpSocket::readyRead, this, &CatalogFetcher::onReadyRead);
+    connect(socket, &QTcpSocket::disconnected, this, &CatalogFetcher::fail);
+    connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::errorOccurred),
+            this, &CatalogFetcher::fail);
+
+    socket->connectToHost(QHostAddress(ownerIP), ownerPort);
+    timer->start(CONNECT_TIMEOUT);
+}
+
+void CatalogFetcher::onConnected()
+{
+    if (version >= Protocol::VERSION_2)
+        socket->write(Protocol::PREAMBLE_V2);
+    requestPage();
+}
+
+void CatalogFetcher::requestPage()
+{
+    socket->write(Protocol::encodeCatalogRequest(version, int(entries.size()), baseGeneration, baseVersion));
+    socket->flush();
+    timer->start(PAGE_TIMEOUT);
+}
+
+void CatalogFetcher::onReadyRead()
+{
+    while (!done)
+    {
+        QByteArray message;
+        Protocol::ReadStatus status = Protocol::readMessage(socket, version, &message);
+        if (status == Protocol::ReadStatus::Incomplete)
+            return;
+
+        Protocol::CatalogPage page;
+        if (status != Protocol::ReadStatus::Complete || !Protocol::CatalogPage::decode(message, &page) ||
+            !applyPage(page))
+        {
+            fail();
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Appends a page, then asks for the next one or reports the catalog.
+ *
+ * @return false if the page does not continue the catalog being fetched
+ */
+bool CatalogFetcher::applyPage(const Protocol::CatalogPage &page)
+{
+    if (page.total > SharedCatalog::MAX_ENTRIES)
+        return false;
+
+    if (received && (page.catalogVersion != catalogVersion || page.delta != delta))
+    {
+        // Replaced on the peer between two pages
+        if (restarted)
+            return false;
+        restarted = true;
+        received = false;
+        entries = QJsonArray();
+        requestPage();
+        return true;
+    }
+    if (page.offset != entries.size())
+        return false;
+
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(qUncompress(page.data), &error);
+    if (error.error != QJsonParseError::NoError || !doc.isArray())
+        return false;
+    QJsonArray pageEntries = doc.array();
+    if (pageEntries.isEmpty() && page.offset < page.total)
+        return false;
+
+    received = true;
+    delta = page.delta;
+    catalogVersion = page.catalogVersion;
+    generation = page.generation;
+    for (const QJsonValue &entry : pageEntries)
+        entries.append(entry);
+    if (entries.size() > page.total)
+        return false;
+
+    if (entries.size() < page.total)
+    {
+        requestPage();
+        return true;
+    }
+
+    QJsonArray files = entries;
+    if (delta)
+    {
+        files = SharedCatalog::applyDelta(baseFiles, entries);
+        if (files.size() > SharedCatalog::MAX_ENTRIES || SharedCatalog::versionOf(files) != catalogVersion)
+            return false;
+    }
+
+    done = true;
+    timer->stop();
+    socket->blockSignals(true);
+    socket->disconnectFromHost();
+    emit catalogFetched(ownerIP, catalogVersion, generation, files);
+    return true;
+}
+
+void CatalogFetcher::fail()
+{
+    if (done)
+        return;
+
+    done = true;
+    timer->stop();
+    if (socket)
+    {
+        socket->blockSignals(true);
+        socket->abort();
+    }
+    emit fetchFailed(ownerIP);
+}
@@ -0,0 +1,86 @@
+/**
+ * @file catalogfetcher.h
+ * @brief Downloads a peer's shared files catalog over its transfer port
+ */
+
+#ifndef CATALOGFETCHER_H
+#define CATALOGFETCHER_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QJsonArray>
+#include "protocol.h"
+
+/**
+ * @class CatalogFetcher
+ * @brief Asks a peer for its catalog one page at a time (see SharedCatalog).
+ *
+ * Pages are requested on a single connection until the announced total was
+ * received. A catalog replaced on the peer meanwhile is fetched again from
+ * its first page, once.
+ *
+ * Given the copy already held with setBase(), only the changes since its
+ * generation are asked for; the peer answers with the whole catalog when
+ * it cannot continue that copy. A catalog rebuilt from changes is checked
+ * against the version the peer sent.
+ */
+class CatalogFetcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit CatalogFetcher(QObject *parent = nullptr);
+    ~CatalogFetcher();
+
+    void setBase(const QJsonArray &files, quint64 generation, quint64 catalogVersion);
+    void fetch(const QString &ownerIP, quint16 ownerPort, int version = Protocol::VERSION_1);
+
+signals:
+    /**
+     * @brief Signal emitted once the whole catalog arrived.
+     * @param ownerIP Address of the peer
+     * @param catalogVersion Version of the catalog received
+     * @param generation Generation of the catalog on the peer, to ask for changes since next time
+     * @param files Shared files of the peer
+     */
+    void catalogFetched(const QString &ownerIP, quint64 catalogVersion, quint64 generation, const QJsonArray &files);
+
+    /** @brief Signal emitted when the catalog could not be fetched. */
+    void fetchFailed(const QString &ownerIP);
+
+private:
+    void onConnected();
+    void onReadyRead();
+    bool applyPage(const Protocol::CatalogPage &page);
+    void requestPage();
+    void fail();
+
+    QString ownerIP;
+    int version = Protocol::VERSION_1;
+    QTcpSocket *socket = nullptr;
+
+    /** Copy held before the fetch, the changes are applied to it. */
+    QJsonArray baseFiles;
+    quint64 baseGeneration = 0;
+    quint64 baseVersion = 0;
+
+    /** Entries or changes received so far and the catalog they belong to. */
+    QJsonArray entries;
+    bool received = false;
+    bool delta = false;
+    quint64 catalogVersion = 0;
+    quint64 generation = 0;
+    bool restarted = false;
+
+    /** Whether catalogFetched() or fetchFailed() was emitted. */
+    bool done = false;
+
+    /** Connection timeout, then timeout of each page. */
+    QTimer *timer;
+
+    static const int CONNECT_TIMEOUT = 5000;
+    static const int PAGE_TIMEOUT = 10000;
+};
+
+#endif // CATALOGFETCHER_H
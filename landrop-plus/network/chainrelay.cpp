@@ -0,0 +1,419 @@
+/**
+ * @file chainrelay.cpp
+ */
+
+#include "chainrelay.h"
+#include "bufferpool.h"
+#include <QHostAddress>
+#include <QDebug>
+
+/**
+ * @brief Constructs a new ChainRelay.
+ *
+ * @param parent Parent QObject
+ */
+ChainRelay::ChainRelay(QObject *parent)
+    : QObject(parent),
+      timer(new QTimer(this)),
+      throttleTimer(new QTimer(this))
+{
+    timer->setSingleShot(true);
+    throttleTimer->setSingleShot(true);
+    connect(timer, &QTimer::timeout, this, [this]()
+            {
+        // qDebug() << "ChainRelay: Timeout for node" << current;
+        failNode(); });
+    connect(throttleTimer, &QTimer::timeout, this, &ChainRelay::pump);
+}
+
+/**
+ * @brief Destructor, closes the connection to the next node.
+ */
+ChainRelay::~ChainRelay()
+{
+    closeSocket();
+    delete hasher;
+    delete file;
+}
+
+/**
+ * @brief Starts sending a file down a chain of nodes.
+ *
+ * @param filePath Local file the data is read from
+ * @param fileName Name the file is announced with
+ * @param fileSize Size of the complete file
+ * @param chain Nodes in relay order
+ * @param available Bytes of the file already on disk
+ */
+void ChainRelay::start(const QString &filePath, const QString &fileName, qint64 fileSize,
+                       const QList<FanoutTarget> &chain, qint64 available)
+{
+    this->filePath = filePath;
+    this->fileName = fileName;
+    this->fileSize = fileSize;
+    this->chain = chain;
+    this->available = qBound<qint64>(0, available, fileSize);
+    current = -1;
+    done = false;
+    inputComplete = false;
+
+    // Unbuffered, so data appended by the receiver after a read is seen
+    file = new QFile(filePath);
+    if (!file->open(QIODevice::ReadOnly | QIODevice::Unbuffered))
+    {
+        abort();
+        return;
+    }
+
+    connectNext();
+}
+
+/**
+ * @brief Makes more of the file available for forwarding.
+ *
+ * @param end File offset up to which the data is on disk
+ */
+void ChainRelay::setAvailable(qint64 end)
+{
+    if (end <= available)
+        return;
+    available = qMin(end, fileSize);
+    pump();
+}
+
+/**
+ * @brief Marks the local copy as complete, so the end of the file can be sent.
+ */
+void ChainRelay::finishInput()
+{
+    inputComplete = true;
+    available = fileSize;
+    pump();
+}
+
+/**
+ * @brief Stops relaying, failing the node served and every node behind it.
+ *
+ * Used when the local copy will not be completed.
+ */
+void ChainRelay::abort()
+{
+    if (done)
+        return;
+
+    closeSocket();
+    for (int index = qMax(0, current); index < chain.size(); ++index)
+        emit nodeFailed(index);
+    current = chain.size();
+    finish();
+}
+
+/**
+ * @brief Connects to the node after the current one.
+ */
+void ChainRelay::connectNext()
+{
+    closeSocket();
+    throttleTimer->stop();
+    if (++current >= chain.size())
+    {
+        finish();
+        return;
+    }
+
+    streaming = false;
+    position = 0;
+    dataMark = 0;
+    flushed = 0;
+    verified = false;
+    trailerQueued = false;
+    lastProgress = -1;
+    window.reset();
+    delete hasher;
+    hasher = nullptr;
+
+    socket = new QTcpSocket(this);
+    connect(socket, &QTcpSocket::connected, this, &ChainRelay::onConnected);
+    connect(socket, &QTcpSocket::readyRead, this, &ChainRelay::onReadyRead);
+    connect(socket, &QTcpSocket::bytesWritten, this, &ChainRelay::onBytesWritten);
+    connect(socket, &QTcpSocket::disconnected, this, &ChainRelay::onDisconnected);
+    connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::errorOccurred),
+            this, [this](QAbstractSocket::SocketError socketError)
+            {
+        // A node closing the connection is handled in onDisconnected()
+        if (socketError != QAbstractSocket::RemoteHostClosedError)
+            failNode(); });
+
+    const FanoutTarget &node = chain.at(current);
+    socket->connectToHost(QHostAddress(node.address), node.port);
+    timer->start(10000); // 10 second connection timeout
+}
+
+/**
+ * @brief Announces the file with the rest of the chain to the next node.
+ */
+void ChainRelay::onConnected()
+{
+    timer->stop();
+
+    Protocol::TransferHeader header;
+    header.fileName = fileName;
+    header.fileSize = fileSize;
+    header.transferId = Protocol::newTransferId();
+    if (Config::getIntegrityCheckEnabled())
+        header.options.insert("hash", StreamHasher::ALGORITHM);
+    if (current + 1 < chain.size())
+        header.options.insert("relay", encodeChain(chain.mid(current + 1)));
+
+    int version = chain.at(current).version;
+    QByteArray message = header.encode(version);
+    if (version >= Protocol::VERSION_2)
+        message.prepend(Protocol::PREAMBLE_V2);
+    dataMark = message.size();
+    socket->write(message);
+    socket->flush();
+
+    timer->start(30000); // 30 second response timeout
+}
+
+/**
+ * @brief Applies the next node's answer to the header.
+ */
+void ChainRelay::onReadyRead()
+{
+    if (streaming)
+    {
+        // Nothing else is expected from a node
+        socket->readAll();
+        return;
+    }
+
+    QByteArray message;
+    Protocol::ReadStatus status = Protocol::readMessage(socket, chain.at(current).version, &message);
+    if (status == Protocol::ReadStatus::Incomplete)
+        return;
+
+    timer->stop();
+    Protocol::TransferReply reply;
+    if (status != Protocol::ReadStatus::Complete || !Protocol::TransferReply::decode(message, &reply))
+    {
+        failNode();
+        return;
+    }
+
+    QByteArray hash = reply.options.value("hash");
+    if (reply.accepted && !hash.isEmpty() && hash != StreamHasher::ALGORITHM)
+    {
+        failNode();
+        return;
+    }
+
+    if (!reply.accepted)
+    {
+        // The rest of the chain is re-parented onto this relay
+        emit nodeRefused(current);
+        connectNext();
+        return;
+    }
+
+    verified = !hash.isEmpty();
+    if (verified)
+        hasher = new StreamHasher();
+    streaming = true;
+    for (int index = current; index < chain.size(); ++index)
+        emit nodeAccepted(index);
+    pump();
+}
+
+/**
+ * @brief Accounts for written bytes, reports progress and refills.
+ *
+ * @param bytes Number of bytes Qt handed to the operating system
+ */
+void ChainRelay::onBytesWritten(qint64 bytes)
+{
+    flushed += bytes;
+    if (!streaming)
+        return;
+
+    window.recordWritten(bytes, socket->bytesToWrite());
+
+    qint64 data = qMax<qint64>(0, flushed - dataMark);
+    int percent = fileSize > 0 ? static_cast<int>(qMin<qint64>(100, data * 100 / fileSize)) : 100;
+    if (percent != lastProgress)
+    {
+        lastProgress = percent;
+        for (int index = current; index < chain.size(); ++index)
+            emit progressUpdated(index, percent);
+    }
+
+    if (trailerQueued && socket->bytesToWrite() == 0)
+        finishNode();
+    else if (socket->bytesToWrite() <= window.lowWater())
+        pump();
+}
+
+/**
+ * @brief Re-parents the chain when the next node closes before the end.
+ */
+void ChainRelay::onDisconnected()
+{
+    if (!done)
+        failNode();
+}
+
+/**
+ * @brief Queues the data on disk up to the window, then the trailer.
+ */
+void ChainRelay::pump()
+{
+    if (done || !streaming || trailerQueued)
+        return;
+
+    while (position < available && socket->bytesToWrite() < window.highWater())
+    {
+        int wait = BandwidthShaper::delay(chain.at(current).address, &bucket);
+        if (wait > 0)
+        {
+            if (!throttleTimer->isActive())
+                throttleTimer->start(wait);
+            return;
+        }
+
+        qint64 length = qMin(qMin(CHUNK_SIZE, window.chunkSize()), available - position);
+        if (file->pos() != position && !file->seek(position))
+        {
+            abort();
+            return;
+        }
+        QByteArray chunk = BufferPool::acquire(CHUNK_SIZE);
+        if (file->read(chunk.data(), length) != length)
+        {
+            // The local copy cannot be forwarded to anyone
+            abort();
+            return;
+        }
+        chunk.resize(int(length));
+
+        if (socket->write(chunk) != chunk.size())
+        {
+            failNode();
+            return;
+        }
+        if (hasher)
+            hasher->addData(chunk);
+        position += length;
+        BandwidthShaper::consume(chain.at(current).address, &bucket, length);
+        BufferPool::release(chunk);
+    }
+
+    if (position < fileSize || !inputComplete)
+        return;
+
+    trailerQueued = true;
+    if (verified)
+    {
+        QByteArray digest = hasher->result();
+        QByteArray trailer = Protocol::encodeTrailer(chain.at(current).version, digest);
+        if (digest.isEmpty() || socket->write(trailer) != trailer.size())
+        {
+            failNode();
+            return;
+        }
+    }
+
+    // Nothing left to flush, so no bytesWritten() will finish this node
+    if (socket->bytesToWrite() == 0)
+        finishNode();
+}
+
+/**
+ * @brief Reports the current node as failed and moves on to the next one.
+ */
+void ChainRelay::failNode()
+{
+    if (done)
+        return;
+
+    emit nodeFailed(current);
+    connectNext();
+}
+
+/**
+ * @brief Hands the rest of the chain to the node that received the file.
+ */
+void ChainRelay::finishNode()
+{
+    for (int index = current; index < chain.size(); ++index)
+        emit nodeFinished(index);
+    current = chain.size();
+    socket->disconnectFromHost();
+    finish();
+}
+
+void ChainRelay::closeSocket()
+{
+    timer->stop();
+    if (socket)
+    {
+        socket->blockSignals(true);
+        if (socket->state() != QAbstractSocket::UnconnectedState)
+            socket->abort();
+        socket->deleteLater();
+        socket = nullptr;
+    }
+}
+
+/**
+ * @brief Emits relayFinished() once.
+ */
+void ChainRelay::finish()
+{
+    if (done)
+        return;
+
+    done = true;
+    throttleTimer->stop();
+    delete hasher;
+    hasher = nullptr;
+    if (file)
+        file->close();
+    emit relayFinished();
+}
+
+/**
+ * Nodes are written as "address/port/version" separated by ','.
+ */
+QByteArray ChainRelay::encodeChain(const QList<FanoutTarget> &chain)
+{
+    QList<QByteArray> nodes;
+    for (const FanoutTarget &node : chain)
+        nodes.append(node.address.toUtf8() + '/' + QByteArray::number(node.port) + '/' + QByteArray::number(node.version));
+    return nodes.join(',');
+}
+
+QList<FanoutTarget> ChainRelay::decodeChain(const QByteArray &option)
+{
+    QList<FanoutTarget> chain;
+    if (option.isEmpty())
+        return chain;
+
+    for (const QByteArray &field : option.split(','))
+    {
+        QList<QByteArray> parts = field.split('/');
+        bool portOk = false;
+        bool versionOk = false;
+        FanoutTarget node;
+        if (parts.size() == 3)
+        {
+            node.address = QString::fromUtf8(parts[0]);
+            node.port = parts[1].toUShort(&portOk);
+            node.version = parts[2].toInt(&versionOk);
+        }
+        if (!portOk || !versionOk || node.port == 0 || QHostAddress(node.address).isNull() ||
+            node.version < Protocol::VERSION_1 || node.version > Protocol::VERSION_2)
+            return QList<FanoutTarget>();
+        chain.append(node);
+    }
+    return chain;
+}
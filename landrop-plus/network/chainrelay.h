@@ -0,0 +1,159 @@
+/**
+ * @file chainrelay.h
+ * @brief Forwards a file along a chain of receivers while it is written
+ */
+
+#ifndef CHAINRELAY_H
+#define CHAINRELAY_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QFile>
+#include <QList>
+#include "../config/config.h"
+#include "protocol.h"
+#include "sendwindow.h"
+#include "streamhasher.h"
+#include "bandwidthshaper.h"
+#include "fanoutsender.h"
+
+/**
+ * @class ChainRelay
+ * @brief Sends a file to the first node of a chain, which passes it on.
+ *
+ * The header to the next node carries the rest of the chain in a "relay"
+ * option. A receiver that accepts such a header writes the file to disk and
+ * forwards it to the next node with its own ChainRelay at the same time,
+ * so every link of the chain runs in parallel and the whole chain takes
+ * about as long as one transfer.
+ *
+ * The relay reads the file back from disk up to the offset written so far
+ * (setAvailable()); the sender of the chain starts with the whole file.
+ * When the next node refuses, cannot be reached or drops out, the relay
+ * re-parents the rest of the chain: it connects to the node after it and
+ * sends the file again from the start.
+ *
+ * Relayed transfers are plain single-connection data with an optional
+ * hash trailer, like fan-outs. The trailer is only sent once the local copy
+ * is complete (finishInput()), so a relay whose own input failed never
+ * confirms the data it forwarded.
+ */
+class ChainRelay : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ChainRelay(QObject *parent = nullptr);
+    ~ChainRelay();
+
+    void start(const QString &filePath, const QString &fileName, qint64 fileSize,
+               const QList<FanoutTarget> &chain, qint64 available);
+    void setAvailable(qint64 end);
+    void finishInput();
+    void abort();
+
+    /**
+     * @brief Encodes chain nodes as the value of the "relay" header option.
+     */
+    static QByteArray encodeChain(const QList<FanoutTarget> &chain);
+
+    /**
+     * @brief Parses the "relay" header option.
+     * @return The nodes, empty if the option is malformed
+     */
+    static QList<FanoutTarget> decodeChain(const QByteArray &option);
+
+signals:
+    /**
+     * @brief Signal emitted when a node accepts the file.
+     * @param index Position of the node in the chain
+     */
+    void nodeAccepted(int index);
+
+    /** @brief Signal emitted when a node declines the file; the chain skips it. */
+    void nodeRefused(int index);
+
+    /**
+     * @brief Signal emitted when the progress of the next node changes.
+     *
+     * Also emitted for every node behind it, which gets the file through it.
+     *
+     * @param index Position of the node in the chain
+     * @param percent Completion percentage (0-100)
+     */
+    void progressUpdated(int index, int percent);
+
+    /** @brief Signal emitted once a node was sent the whole file. */
+    void nodeFinished(int index);
+
+    /** @brief Signal emitted when a node fails; the chain skips it. */
+    void nodeFailed(int index);
+
+    /** @brief Signal emitted once the relay has nothing left to do. */
+    void relayFinished();
+
+private:
+    /** Size of each read from the file. */
+    static constexpr qint64 CHUNK_SIZE = 256 * 1024;
+
+    void connectNext();
+    void onConnected();
+    void onReadyRead();
+    void onBytesWritten(qint64 bytes);
+    void onDisconnected();
+    void pump();
+    void failNode();
+    void finishNode();
+    void closeSocket();
+    void finish();
+
+    QString filePath;
+    QString fileName;
+    qint64 fileSize = 0;
+    QList<FanoutTarget> chain;
+
+    /** Node currently served, -1 before the first one. */
+    int current = -1;
+
+    /** File offset written to disk so far, readable for forwarding. */
+    qint64 available = 0;
+
+    /** Whether the local copy is complete and verified. */
+    bool inputComplete = false;
+
+    /** Whether relayFinished() was emitted. */
+    bool done = false;
+
+    QFile *file = nullptr;
+    QTcpSocket *socket = nullptr;
+
+    /** Whether the node accepted and data is being streamed to it. */
+    bool streaming = false;
+
+    /** File offset queued on the socket so far. */
+    qint64 position = 0;
+
+    /** Bytes queued before the file data, and bytes handed to the operating system. */
+    qint64 dataMark = 0;
+    qint64 flushed = 0;
+
+    /** Whether the node asked for the trailer, and whether it is queued. */
+    bool verified = false;
+    bool trailerQueued = false;
+
+    int lastProgress = -1;
+    AdaptiveSendWindow window;
+    TokenBucket bucket;
+
+    /** Hashes the data sent to a verifying node, null otherwise. */
+    StreamHasher *hasher = nullptr;
+
+    /** Connection timeout, then response timeout. */
+    QTimer *timer;
+
+    /** Timer continuing after a bandwidth cap paused the relay. */
+    QTimer *throttleTimer;
+};
+
+#endif // CHAINRELAY_H
@@ -0,0 +1,108 @@
+/**
+ * @file compression.cpp
+ */
+
+#include "compression.h"
+#include <QtEndian>
+
+const QByteArray Compression::CODEC_ZLIB = "zlib";
+
+namespace
+{
+    void appendFrame(QByteArray &out, char type, const char *payload, qint64 length)
+    {
+        char field[4];
+        qToBigEndian<quint32>(quint32(length), field);
+        out.append(type);
+        out.append(field, 4);
+        out.append(payload, length);
+    }
+}
+
+/**
+ * @param level zlib level, from 1 (fastest) to 9 (smallest)
+ */
+BlockCompressor::BlockCompressor(int level)
+    : compressionLevel(qBound(1, level, 9))
+{
+}
+
+/**
+ * @brief Encodes one chunk of the file as a frame.
+ *
+ * @param data Chunk of file data
+ * @param length Length of the chunk
+ * @return 'Z' frame if compressing saved at least a tenth, 'R' frame otherwise
+ */
+QByteArray BlockCompressor::encode(const char *data, qint64 length)
+{
+    QByteArray frame;
+    rawTotal += length;
+
+    if (skipRemaining > 0)
+    {
+        --skipRemaining;
+        appendFrame(frame, 'R', data, length);
+        wireTotal += frame.size();
+        return frame;
+    }
+
+    QByteArray packed = qCompress(reinterpret_cast<const uchar *>(data), int(length), compressionLevel);
+    if (packed.size() < length - length / 10)
+    {
+        incompressibleRun = 0;
+        appendFrame(frame, 'Z', packed.constData(), packed.size());
+    }
+    else
+    {
+        // Already compressed data, stop wasting CPU on it for a while
+        if (++incompressibleRun >= PAUSE_AFTER)
+        {
+            incompressibleRun = 0;
+            skipRemaining = PAUSE_CHUNKS;
+        }
+        appendFrame(frame, 'R', data, length);
+    }
+
+    wireTotal += frame.size();
+    return frame;
+}
+
+bool Compression::readFrames(QIODevice *device, qint64 maxRaw, QByteArray *decoded)
+{
+    qint64 produced = 0;
+    while (produced < maxRaw && device->bytesAvailable() >= 5)
+    {
+        char header[5];
+        device->peek(header, 5);
+        char type = header[0];
+        qint64 length = qFromBigEndian<quint32>(header + 1);
+        if ((type != 'Z' && type != 'R') || length > MAX_FRAME)
+            return false;
+        if (device->bytesAvailable() < 5 + length)
+            break;
+
+        // qUncompress() allocates the size a 'Z' payload announces, so check it first
+        qint64 remaining = maxRaw - produced;
+        qint64 rawLength = length;
+        if (type == 'Z')
+        {
+            char head[9];
+            if (length < 4 || device->peek(head, 9) != 9)
+                return false;
+            rawLength = qFromBigEndian<quint32>(head + 5);
+        }
+        if (rawLength > MAX_FRAME || rawLength > remaining)
+            return false;
+
+        device->read(header, 5);
+        QByteArray payload = device->read(length);
+        QByteArray block = (type == 'R') ? payload : qUncompress(payload);
+        if (block.size() != rawLength)
+            return false;
+
+        decoded->append(block);
+        produced += block.size();
+    }
+    return true;
+}
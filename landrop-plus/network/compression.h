@@ -0,0 +1,86 @@
+/**
+ * @file compression.h
+ * @brief Optional per-block compression of file data on the wire
+ */
+
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QtGlobal>
+
+/**
+ * @namespace Compression
+ * @brief Framing of compressed file data.
+ *
+ * Once a transfer negotiated "compress=zlib", its data is a sequence of
+ * frames, each holding one chunk of the file:
+ * - 'Z' + 32-bit big-endian length + qCompress() output
+ * - 'R' + 32-bit big-endian length + raw bytes
+ */
+namespace Compression
+{
+    /** Codec name offered in headers and confirmed in replies. */
+    extern const QByteArray CODEC_ZLIB;
+
+    /** Largest frame payload a receiver accepts. */
+    const qint64 MAX_FRAME = 8 * 1024 * 1024;
+
+    /**
+     * @brief Decodes the complete frames waiting on a device.
+     *
+     * Incomplete frames are left unread, as is anything following the
+     * frame that completes @p maxRaw bytes of file data.
+     *
+     * @param device Connection to read from
+     * @param maxRaw File bytes still expected
+     * @param decoded Receives the file data of the decoded frames
+     * @return false if a frame is malformed or holds more than MAX_FRAME or @p maxRaw bytes
+     */
+    bool readFrames(QIODevice *device, qint64 maxRaw, QByteArray *decoded);
+}
+
+/**
+ * @class BlockCompressor
+ * @brief Compresses outgoing chunks while they compress well.
+ *
+ * Each chunk is compressed and sent raw instead when that saves less than
+ * a tenth of it. After a few incompressible chunks in a row (media,
+ * archives) compression is skipped for a while and only probed again now
+ * and then, so it costs almost no CPU on data that does not shrink.
+ */
+class BlockCompressor
+{
+public:
+    explicit BlockCompressor(int level = 1);
+
+    QByteArray encode(const char *data, qint64 length);
+
+    /** @brief zlib level used for compressed frames. */
+    int level() const { return compressionLevel; }
+
+    /** @brief Whether chunks are currently being compressed. */
+    bool isActive() const { return skipRemaining == 0; }
+
+    /** @brief File bytes encoded so far. */
+    qint64 rawBytes() const { return rawTotal; }
+
+    /** @brief Frame bytes produced so far. */
+    qint64 wireBytes() const { return wireTotal; }
+
+private:
+    /** Incompressible chunks in a row before compression pauses. */
+    static const int PAUSE_AFTER = 4;
+
+    /** Chunks sent raw before compression is probed again. */
+    static const int PAUSE_CHUNKS = 256;
+
+    int compressionLevel;
+    int incompressibleRun = 0;
+    int skipRemaining = 0;
+    qint64 rawTotal = 0;
+    qint64 wireTotal = 0;
+};
+
+#endif // COMPRESSION_H
@@ -0,0 +1,180 @@
+/**
+ * @file connectionrace.cpp
+ */
+
+#include "connectionrace.h"
+#include "pathbonding.h"
+#include "securetransport.h"
+#include "../config/config.h"
+#include <QHostAddress>
+#include <QMutex>
+#include <QMutexLocker>
+
+namespace
+{
+    QMutex raceMutex;
+
+    /** Address each peer was last reached at */
+    QHash<QString, QString> lastReached;
+}
+
+/**
+ * @brief Constructs an idle race.
+ *
+ * @param parent Parent QObject
+ */
+ConnectionRace::ConnectionRace(QObject *parent)
+    : QObject(parent), staggerTimer(new QTimer(this))
+{
+    staggerTimer->setSingleShot(true);
+    connect(staggerTimer, &QTimer::timeout, this, &ConnectionRace::startNext);
+}
+
+ConnectionRace::~ConnectionRace()
+{
+    abort();
+}
+
+/**
+ * @brief Starts connecting to a peer, aborting a race still running.
+ *
+ * Emits established() or failed() once decided.
+ *
+ * @param peer Address the peer is known by
+ * @param port Transfer port of the peer
+ */
+void ConnectionRace::start(const QString &peer, quint16 port)
+{
+    abort();
+    this->peer = peer;
+    this->port = port;
+    addresses = candidates(peer);
+    next = 0;
+    startNext();
+}
+
+/**
+ * @brief Stops every attempt without signalling.
+ */
+void ConnectionRace::abort()
+{
+    staggerTimer->stop();
+    for (auto it = attempts.constBegin(); it != attempts.constEnd(); ++it)
+    {
+        QTcpSocket *socket = it.key();
+        socket->blockSignals(true);
+        socket->abort();
+        socket->deleteLater();
+    }
+    attempts.clear();
+    addresses.clear();
+    next = 0;
+}
+
+/**
+ * @brief Addresses to try for a peer, in the order they are started.
+ *
+ * @param peer Address the peer is known by
+ */
+QStringList ConnectionRace::candidates(const QString &peer)
+{
+    QStringList ordered;
+    {
+        QMutexLocker lock(&raceMutex);
+        QString reached = lastReached.value(peer);
+        if (!reached.isEmpty())
+            ordered.append(reached);
+    }
+    if (!ordered.contains(peer))
+        ordered.append(peer);
+
+    QStringList families[2];
+    const QStringList announced = PathBonding::peerAddresses(peer);
+    for (const QString &address : announced)
+    {
+        QHostAddress host(address);
+        if (host.isNull() || ordered.contains(address))
+            continue;
+        families[host.protocol() == QAbstractSocket::IPv6Protocol ? 1 : 0].append(address);
+    }
+
+    // Alternate families, starting with the one the peer was not discovered on
+    int family = QHostAddress(peer).protocol() == QAbstractSocket::IPv6Protocol ? 0 : 1;
+    while (!families[0].isEmpty() || !families[1].isEmpty())
+    {
+        if (!families[family].isEmpty())
+            ordered.append(families[family].takeFirst());
+        family = 1 - family;
+    }
+    return ordered;
+}
+
+/**
+ * @brief Records the address a peer was reached at, tried first next time.
+ */
+void ConnectionRace::remember(const QString &peer, const QString &address)
+{
+    QMutexLocker lock(&raceMutex);
+    if (address == peer)
+        lastReached.remove(peer);
+    else
+        lastReached.insert(peer, address);
+}
+
+/**
+ * @brief Starts the attempt to the next address and arms the stagger for the one after.
+ */
+void ConnectionRace::startNext()
+{
+    if (next >= addresses.size())
+        return;
+
+    QString address = addresses[next++];
+    QTcpSocket *socket = SecureTransport::createSocket(this);
+    attempts.insert(socket, address);
+
+    SecureTransport::onReady(socket, this, [this, socket]()
+                             { win(socket); });
+    connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::errorOccurred),
+            this, [this, socket](QAbstractSocket::SocketError)
+            { onAttemptFailed(socket); });
+
+    SecureTransport::connectToPeer(socket, address, port);
+    if (next < addresses.size())
+        staggerTimer->start(qMax(0, Config::getConnectStagger()));
+}
+
+/**
+ * @brief Drops a failed attempt; the next address starts right away.
+ */
+void ConnectionRace::onAttemptFailed(QTcpSocket *socket)
+{
+    if (!attempts.remove(socket))
+        return;
+    socket->blockSignals(true);
+    socket->deleteLater();
+
+    if (next < addresses.size())
+    {
+        staggerTimer->stop();
+        startNext();
+    }
+    else if (attempts.isEmpty())
+    {
+        emit failed();
+    }
+}
+
+/**
+ * @brief Hands the first ready connection over and aborts the others.
+ */
+void ConnectionRace::win(QTcpSocket *socket)
+{
+    QString address = attempts.take(socket);
+    disconnect(socket, nullptr, this, nullptr);
+    socket->setParent(nullptr);
+    abort();
+
+    remember(peer, address);
+    emit established(socket, address);
+}
@@ -0,0 +1,81 @@
+/**
+ * @file connectionrace.h
+ * @brief Connects to a peer over whichever of its addresses answers first
+ */
+
+#ifndef CONNECTIONRACE_H
+#define CONNECTIONRACE_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QTcpSocket>
+#include <QTimer>
+
+/**
+ * @class ConnectionRace
+ * @brief Races connections to every address of a peer and keeps the first that is ready.
+ *
+ * A peer that moved to another network, or whose Wi-Fi address went stale,
+ * would otherwise cost a sender the whole connection timeout. Peers list
+ * the IPv4 and routable IPv6 addresses of all their interfaces in
+ * discovery (see PathBonding::peerAddresses()); candidates() orders them
+ * the way RFC 8305 ("happy eyeballs") does: the address that last
+ * worked first, then the address the peer was discovered at, then the
+ * others alternating between address families.
+ *
+ * The attempts start Config::getConnectStagger() after one another, or as
+ * soon as the previous one failed. The first connection ready to carry
+ * the protocol, after its TLS handshake when encrypted (see
+ * SecureTransport), wins; the others are aborted.
+ */
+class ConnectionRace : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ConnectionRace(QObject *parent = nullptr);
+    ~ConnectionRace();
+
+    void start(const QString &peer, quint16 port);
+    void abort();
+
+    /** @brief Whether attempts are still running. */
+    bool isRunning() const { return !attempts.isEmpty() || next < addresses.size(); }
+
+    static QStringList candidates(const QString &peer);
+    static void remember(const QString &peer, const QString &address);
+
+signals:
+    /**
+     * @brief Signal emitted once a connection is ready.
+     * @param socket The winning connection, without parent; the receiver of the signal takes it over
+     * @param address Address of the peer it goes to
+     */
+    void established(QTcpSocket *socket, const QString &address);
+
+    /** @brief Signal emitted when every address failed. */
+    void failed();
+
+private:
+    void startNext();
+    void onAttemptFailed(QTcpSocket *socket);
+    void win(QTcpSocket *socket);
+
+    QString peer;
+    quint16 port = 0;
+
+    /** Addresses to try in order, and the next one to start. */
+    QStringList addresses;
+    int next = 0;
+
+    /** Connections still racing, with the address of each. */
+    QHash<QTcpSocket *, QString> attempts;
+
+    /** Starts the next attempt while the previous ones are still pending. */
+    QTimer *staggerTimer;
+};
+
+#endif // CONNECTIONRACE_H
@@ -0,0 +1,279 @@
+/**
+ * @file contentindex.cpp
+ */
+
+#include "contentindex.h"
+#include "../config/config.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMultiHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+
+#if defined(Q_OS_LINUX)
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#elif defined(Q_OS_MACOS)
+#include <sys/clonefile.h>
+#include <unistd.h>
+#elif defined(Q_OS_WIN)
+#include <windows.h>
+#endif
+
+namespace
+{
+    /** Lines the log may hold beyond its live entries before it is rewritten on load. */
+    const int COMPACT_SLACK = 256;
+
+    struct Entry
+    {
+        QByteArray hash;
+        qint64 size = 0;
+        qint64 modified = 0;
+
+        /** Whether the entry is in the log */
+        bool logged = false;
+    };
+
+    QMutex indexMutex;
+    QHash<QString, Entry> entries;
+    QMultiHash<QByteArray, QString> pathsByHash;
+
+    /** Log the logged entries were read from, empty until loaded */
+    QString loadedLog;
+
+    bool matches(const Entry &entry, const QFileInfo &fileInfo)
+    {
+        return fileInfo.isFile() && fileInfo.size() == entry.size &&
+               fileInfo.lastModified().toMSecsSinceEpoch() == entry.modified;
+    }
+
+    void insert(const QString &filePath, const Entry &entry)
+    {
+        auto old = entries.constFind(filePath);
+        if (old != entries.constEnd())
+            pathsByHash.remove(old->hash, filePath);
+        entries.insert(filePath, entry);
+        pathsByHash.insert(entry.hash, filePath);
+    }
+
+    /**
+     * @brief Log line of an entry: "hash|size|mtime|path".
+     */
+    QByteArray logLine(const QString &filePath, const Entry &entry)
+    {
+        return entry.hash + '|' + QByteArray::number(entry.size) + '|' + QByteArray::number(entry.modified) + '|' +
+               filePath.toUtf8() + '\n';
+    }
+
+    /**
+     * @brief Reads the log of the configured path, once. Called with the mutex held.
+     *
+     * Later lines replace earlier ones of the same file; a log holding many
+     * replaced lines is rewritten with the live entries only.
+     */
+    void ensureLoaded()
+    {
+        QString logPath = Config::getContentIndexPath();
+        if (loadedLog == logPath)
+            return;
+
+        // Entries of another log are forgotten, remembered ones are kept
+        for (auto it = entries.begin(); it != entries.end();)
+        {
+            if (it->logged)
+            {
+                pathsByHash.remove(it->hash, it.key());
+                it = entries.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        loadedLog = logPath;
+
+        QFile log(logPath);
+        if (!log.open(QIODevice::ReadOnly))
+            return;
+
+        int lines = 0;
+        while (!log.atEnd())
+        {
+            QByteArray line = log.readLine();
+            line.chop(line.endsWith('\n') ? 1 : 0);
+            QList<QByteArray> fields = line.split('|');
+            if (fields.size() < 4 || fields[0].isEmpty())
+                continue;
+
+            Entry entry;
+            entry.hash = fields[0];
+            entry.size = fields[1].toLongLong();
+            entry.modified = fields[2].toLongLong();
+            entry.logged = true;
+
+            // The path is the rest of the line, it may hold '|' itself
+            int pathStart = fields[0].size() + fields[1].size() + fields[2].size() + 3;
+            insert(QString::fromUtf8(line.mid(pathStart)), entry);
+            ++lines;
+        }
+        log.close();
+
+        int live = 0;
+        for (const Entry &entry : entries)
+            live += entry.logged ? 1 : 0;
+        if (lines <= 2 * live + COMPACT_SLACK)
+            return;
+
+        QSaveFile compacted(logPath);
+        if (!compacted.open(QIODevice::WriteOnly))
+            return;
+        for (auto it = entries.constBegin(); it != entries.constEnd(); ++it)
+        {
+            if (it->logged)
+                compacted.write(logLine(it.key(), *it));
+        }
+        compacted.commit();
+    }
+
+    /**
+     * @brief Asks the file system for a copy-on-write clone of @p source at @p target.
+     */
+    bool reflink(const QString &source, const QString &target)
+    {
+#if defined(Q_OS_LINUX) && defined(FICLONE)
+        int in = ::open(QFile::encodeName(source).constData(), O_RDONLY | O_CLOEXEC);
+        if (in < 0)
+            return false;
+        int out = ::open(QFile::encodeName(target).constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (out < 0)
+        {
+            ::close(in);
+            return false;
+        }
+        bool cloned = ::ioctl(out, FICLONE, in) == 0;
+        ::close(out);
+        ::close(in);
+        if (!cloned)
+            ::unlink(QFile::encodeName(target).constData());
+        return cloned;
+#elif defined(Q_OS_MACOS)
+        return ::clonefile(QFile::encodeName(source).constData(), QFile::encodeName(target).constData(), 0) == 0;
+#else
+        Q_UNUSED(source)
+        Q_UNUSED(target)
+        return false;
+#endif
+    }
+
+    bool hardLink(const QString &source, const QString &target)
+    {
+#if defined(Q_OS_WIN)
+        return CreateHardLinkW(reinterpret_cast<LPCWSTR>(QDir::toNativeSeparators(target).utf16()),
+                               reinterpret_cast<LPCWSTR>(QDir::toNativeSeparators(source).utf16()), nullptr) != 0;
+#else
+        return ::link(QFile::encodeName(source).constData(), QFile::encodeName(target).constData()) == 0;
+#endif
+    }
+}
+
+void ContentIndex::record(const QString &filePath, const QByteArray &hash)
+{
+    QFileInfo fileInfo(filePath);
+    if (hash.isEmpty() || !fileInfo.isFile())
+        return;
+
+    Entry entry;
+    entry.hash = hash.toLower();
+    entry.size = fileInfo.size();
+    entry.modified = fileInfo.lastModified().toMSecsSinceEpoch();
+    entry.logged = true;
+    QString path = fileInfo.absoluteFilePath();
+
+    QMutexLocker lock(&indexMutex);
+    ensureLoaded();
+    auto old = entries.constFind(path);
+    if (old != entries.constEnd() && old->logged && old->hash == entry.hash && old->size == entry.size &&
+        old->modified == entry.modified)
+        return;
+    insert(path, entry);
+
+    QFile log(Config::getContentIndexPath());
+    if (log.open(QIODevice::WriteOnly | QIODevice::Append))
+        log.write(logLine(path, entry));
+}
+
+void ContentIndex::remember(const QString &filePath, qint64 size, qint64 modified, const QByteArray &hash)
+{
+    if (hash.isEmpty())
+        return;
+
+    Entry entry;
+    entry.hash = hash.toLower();
+    entry.size = size;
+    entry.modified = modified;
+    QString path = QFileInfo(filePath).absoluteFilePath();
+
+    QMutexLocker lock(&indexMutex);
+    ensureLoaded();
+
+    // A logged entry of the same state stays, it survives a restart
+    auto old = entries.constFind(path);
+    if (old != entries.constEnd() && old->logged && old->hash == entry.hash && old->size == size && old->modified == modified)
+        return;
+    insert(path, entry);
+}
+
+QByteArray ContentIndex::hashOf(const QString &filePath)
+{
+    QFileInfo fileInfo(filePath);
+    QMutexLocker lock(&indexMutex);
+    ensureLoaded();
+    auto it = entries.constFind(fileInfo.absoluteFilePath());
+    if (it == entries.constEnd() || !matches(*it, fileInfo))
+        return QByteArray();
+    return it->hash;
+}
+
+QString ContentIndex::find(const QByteArray &hash, qint64 size)
+{
+    QMutexLocker lock(&indexMutex);
+    ensureLoaded();
+    const QList<QString> paths = pathsByHash.values(hash.toLower());
+    for (const QString &path : paths)
+    {
+        const Entry &entry = entries[path];
+        if (entry.size == size && matches(entry, QFileInfo(path)))
+            return path;
+    }
+    return QString();
+}
+
+bool ContentIndex::cloneFile(const QString &source, const QString &target)
+{
+    // Made next to the target, so replacing it is a rename
+    QString temporary = target + ".landrop-dedup";
+    QFile::remove(temporary);
+
+    bool made = reflink(source, temporary) || (Config::getDedupHardLinks() && hardLink(source, temporary)) ||
+                QFile::copy(source, temporary);
+    if (!made)
+    {
+        QFile::remove(temporary);
+        return false;
+    }
+
+    QFile::remove(target);
+    if (!QFile::rename(temporary, target))
+    {
+        QFile::remove(temporary);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file contentindex.h
+ * @brief Local files known by the hash of their contents
+ */
+
+#ifndef CONTENTINDEX_H
+#define CONTENTINDEX_H
+
+#include <QByteArray>
+#include <QString>
+
+/**
+ * @namespace ContentIndex
+ * @brief Finds a local copy of some contents, so a transfer does not have to carry them.
+ *
+ * Hashes are the hex BLAKE2b-256 digests the transfer trailer and the
+ * shared folder index use. Files are recorded with their size and
+ * modification time and only reported while both still match, so a
+ * changed or deleted file is never taken for its old contents.
+ *
+ * Received files whose trailer matched, and files sent with a trailer, are
+ * appended to the log at Config::getContentIndexPath() and known again
+ * after a restart. Files of the shared folder are remembered without being
+ * logged, SharedFileManager keeps their hashes in its own index.
+ *
+ * A sender knowing the hash of its file offers it as "content=<hex>". A
+ * receiver finding a copy answers "OK|have=1" and clones that copy into
+ * place instead of receiving the data. All functions are thread-safe.
+ */
+namespace ContentIndex
+{
+    /**
+     * @brief Records the hash of a file as it is now and logs it.
+     *
+     * @param filePath File whose contents were hashed
+     * @param hash Hex BLAKE2b-256 of the contents
+     */
+    void record(const QString &filePath, const QByteArray &hash);
+
+    /**
+     * @brief Remembers the hash of a file until the application exits, without logging it.
+     *
+     * @param filePath File whose contents were hashed
+     * @param size Size the file had when hashed
+     * @param modified Modification time in milliseconds since the epoch the file had when hashed
+     * @param hash Hex BLAKE2b-256 of the contents
+     */
+    void remember(const QString &filePath, qint64 size, qint64 modified, const QByteArray &hash);
+
+    /**
+     * @brief Hash of a file, if it was recorded and did not change since.
+     *
+     * @return The hex hash, empty when unknown
+     */
+    QByteArray hashOf(const QString &filePath);
+
+    /**
+     * @brief Path of an unchanged local file with the given contents.
+     *
+     * @param hash Hex BLAKE2b-256 of the contents
+     * @param size Size of the contents
+     * @return Absolute path of the file, empty if there is none
+     */
+    QString find(const QByteArray &hash, qint64 size);
+
+    /**
+     * @brief Makes @p target a copy of @p source without sending anything over the network.
+     *
+     * The file system is asked for a copy-on-write clone first. If it cannot
+     * clone, a hard link is made when Config::getDedupHardLinks() allows it,
+     * or else the data is copied locally. An existing target is replaced.
+     *
+     * @return false if no copy could be made, the target is then unchanged
+     */
+    bool cloneFile(const QString &source, const QString &target);
+}
+
+#endif // CONTENTINDEX_H
@@ -0,0 +1,356 @@
+/**
+ * @file datagramtransport.cpp
+ */
+
+#include "datagramtransport.h"
+#include "../config/config.h"
+#include <QNetworkDatagram>
+#include <QStringList>
+#include <QtEndian>
+
+const QByteArray DatagramTransport::ACK_MAGIC = "LDAK";
+
+namespace
+{
+    /** Pacing gains of the steady state, one per round trip: probe up, drain, then cruise */
+    const double CYCLE_GAINS[] = {1.25, 0.75, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0};
+    const int CYCLE_LENGTH = 8;
+
+    /** Bytes in flight allowed in the steady state, in bandwidth-delay products */
+    const double WINDOW_GAIN = 2.0;
+
+    /** Growth of the bandwidth per round trip below which startup ends after FLAT_ROUNDS */
+    const double STARTUP_GROWTH = 1.25;
+    const int FLAT_ROUNDS = 3;
+
+    /** Shortest delivery rate sample and round trip used for the sample window, in microseconds */
+    const qint64 MIN_INTERVAL = 5000;
+}
+
+QByteArray DatagramTransport::Ack::encode() const
+{
+    QByteArray datagram(ACK_SIZE, Qt::Uninitialized);
+    memcpy(datagram.data(), ACK_MAGIC.constData(), 4);
+    qToBigEndian<quint32>(token, datagram.data() + 4);
+    qToBigEndian<quint32>(index, datagram.data() + 8);
+    qToBigEndian<quint64>(received, datagram.data() + 12);
+    return datagram;
+}
+
+bool DatagramTransport::Ack::decode(const QByteArray &datagram, Ack *ack)
+{
+    if (datagram.size() != ACK_SIZE || !datagram.startsWith(ACK_MAGIC))
+        return false;
+
+    ack->token = qFromBigEndian<quint32>(datagram.constData() + 4);
+    ack->index = qFromBigEndian<quint32>(datagram.constData() + 8);
+    ack->received = qFromBigEndian<quint64>(datagram.constData() + 12);
+    return true;
+}
+
+bool DatagramTransport::selectedFor(const QString &peer)
+{
+    const QStringList peers = Config::getDatagramPeers().split(',', Qt::SkipEmptyParts);
+    for (const QString &entry : peers)
+    {
+        QString trimmed = entry.trimmed();
+        if (trimmed == "*" || trimmed == peer)
+            return true;
+    }
+    return false;
+}
+
+QByteArray DatagramTransport::encodeChannel(const Multicast::Channel &channel)
+{
+    return QByteArray::number(channel.port) + '/' + QByteArray::number(channel.token) + '/' +
+           QByteArray::number(channel.blockSize);
+}
+
+bool DatagramTransport::decodeChannel(const QByteArray &option, Multicast::Channel *channel)
+{
+    QList<QByteArray> parts = option.split('/');
+    if (parts.size() != 3)
+        return false;
+
+    bool portOk = false;
+    bool tokenOk = false;
+    bool sizeOk = false;
+    channel->group = QHostAddress();
+    channel->port = parts[0].toUShort(&portOk);
+    channel->token = parts[1].toUInt(&tokenOk);
+    channel->blockSize = parts[2].toInt(&sizeOk);
+    return portOk && tokenOk && sizeOk && channel->port != 0 && channel->blockSize > 0 &&
+           channel->blockSize <= 65507 - Multicast::HEADER_SIZE;
+}
+
+/**
+ * @param filePath File to send
+ * @param fileSize Size of the file as announced
+ * @param peer Address of the receiver
+ * @param channel Port, token and block size the receiver answered with
+ * @param parent Parent QObject
+ */
+DatagramSender::DatagramSender(const QString &filePath, qint64 fileSize, const QString &peer,
+                               const Multicast::Channel &channel, QObject *parent)
+    : QObject(parent),
+      file(filePath),
+      fileSize(fileSize),
+      peer(peer),
+      peerAddress(peer),
+      channel(channel),
+      blockCount(channel.blockCount(fileSize)),
+      udp(new QUdpSocket(this)),
+      paceTimer(new QTimer(this)),
+      drainTimer(new QTimer(this)),
+      sent(SENT_RING)
+{
+    paceTimer->setTimerType(Qt::PreciseTimer);
+    paceTimer->setInterval(1);
+    drainTimer->setSingleShot(true);
+    connect(paceTimer, &QTimer::timeout, this, &DatagramSender::sendBlocks);
+    connect(drainTimer, &QTimer::timeout, this, &DatagramSender::roundSent);
+    connect(udp, &QUdpSocket::readyRead, this, &DatagramSender::onReadyRead);
+}
+
+/**
+ * @brief Opens the file and starts the first round.
+ *
+ * @return false if the file cannot be read or no port bound
+ */
+bool DatagramSender::start()
+{
+    if (!file.open(QIODevice::ReadOnly) || !udp->bind(QHostAddress(QHostAddress::AnyIPv4), 0))
+        return false;
+    udp->setSocketOption(QAbstractSocket::SendBufferSizeSocketOption, SOCKET_BUFFER);
+
+    pending = QBitArray(int(blockCount), true);
+    pendingCount = blockCount;
+    nextBlock = 0;
+    clock.start();
+    lastPace = 0;
+    lastAckTime = 0;
+    if (pendingCount == 0)
+        endRound();
+    else
+        paceTimer->start();
+    return true;
+}
+
+/**
+ * @brief Starts a round sending the blocks the receiver reported missing.
+ *
+ * @param ranges Inclusive ranges of block indices
+ */
+void DatagramSender::resend(const Multicast::Ranges &ranges)
+{
+    for (const QPair<quint32, quint32> &range : ranges)
+    {
+        for (quint32 index = range.first; index <= range.second && index < blockCount; ++index)
+        {
+            if (!pending.testBit(int(index)))
+            {
+                pending.setBit(int(index));
+                ++pendingCount;
+            }
+        }
+    }
+
+    nextBlock = 0;
+    if (pendingCount == 0)
+        endRound();
+    else
+        paceTimer->start();
+}
+
+double DatagramSender::pacingRate() const
+{
+    double base = bottleneck > 0 ? bottleneck : INITIAL_RATE;
+    return base * (startup ? STARTUP_GAIN : CYCLE_GAINS[cycleIndex]);
+}
+
+/**
+ * @brief Bytes allowed in flight, a few bandwidth-delay products once those are known.
+ */
+qint64 DatagramSender::window() const
+{
+    if (bottleneck <= 0 || rttMin < 0)
+        return qint64(INITIAL_WINDOW);
+    double product = bottleneck * double(qMax(rttMin, MIN_INTERVAL)) / 1e6;
+    return qMax(qint64(INITIAL_WINDOW), qint64(product * (startup ? STARTUP_GAIN : WINDOW_GAIN)));
+}
+
+qint64 DatagramSender::blockLength(quint32 index) const
+{
+    return qMin<qint64>(channel.blockSize, fileSize - qint64(index) * channel.blockSize);
+}
+
+/**
+ * @brief Sends the blocks the pacing rate and the window allow since the last tick.
+ */
+void DatagramSender::sendBlocks()
+{
+    qint64 now = clock.nsecsElapsed() / 1000;
+    double rate = pacingRate();
+    budget = qMin(budget + rate * double(now - lastPace) / 1e6, qMax(4.0 * channel.blockSize, rate / 100));
+    lastPace = now;
+
+    // Nothing acknowledged for a while, e.g. while roaming: what is in flight is lost
+    if (inFlight() >= window() && now - lastAckTime > STALL_TIME)
+    {
+        ackedMark = sentBytes;
+        lastAckTime = now;
+    }
+
+    while (pendingCount > 0 && budget > 0 && inFlight() < window())
+    {
+        if (BandwidthShaper::delay(peer, &bucket) > 0)
+            return;
+
+        while (!pending.testBit(int(nextBlock)))
+            ++nextBlock;
+
+        QByteArray data;
+        if (!readBlock(nextBlock, &data))
+        {
+            paceTimer->stop();
+            emit failed();
+            return;
+        }
+
+        QByteArray datagram = Multicast::encodeBlock(channel.token, nextBlock, data);
+        if (udp->writeDatagram(datagram, peerAddress, channel.port) != datagram.size())
+            return; // Send buffer full, retried on the next tick
+
+        Sent &entry = sent[int(nextBlock % SENT_RING)];
+        entry.index = nextBlock;
+        entry.time = now;
+        entry.sentBefore = sentBytes;
+        sentBytes += data.size();
+
+        pending.clearBit(int(nextBlock));
+        --pendingCount;
+        ++nextBlock;
+        budget -= datagram.size();
+        BandwidthShaper::consume(peer, &bucket, datagram.size());
+    }
+
+    if (pendingCount == 0)
+        endRound();
+}
+
+/**
+ * @brief Cuts one block out of the file, reading a larger chunk when needed.
+ */
+bool DatagramSender::readBlock(quint32 index, QByteArray *data)
+{
+    qint64 offset = qint64(index) * channel.blockSize;
+    qint64 length = blockLength(index);
+    if (readBufferOffset < 0 || offset < readBufferOffset || offset + length > readBufferOffset + readBuffer.size())
+    {
+        qint64 start = offset - offset % READ_SIZE;
+        qint64 wanted = qMin<qint64>(READ_SIZE, fileSize - start);
+        if (!file.seek(start))
+            return false;
+        readBuffer = file.read(wanted);
+        readBufferOffset = start;
+        if (readBuffer.size() != wanted)
+            return false;
+    }
+
+    *data = readBuffer.mid(int(offset - readBufferOffset), int(length));
+    return true;
+}
+
+/**
+ * @brief Stops pacing and reports the round once its last blocks had time to arrive.
+ */
+void DatagramSender::endRound()
+{
+    paceTimer->stop();
+    qint64 drain = rttMin < 0 ? 20 : qBound<qint64>(20, 2 * rttMin / 1000, 1000);
+    drainTimer->start(int(drain));
+}
+
+void DatagramSender::onReadyRead()
+{
+    while (udp->hasPendingDatagrams())
+    {
+        QNetworkDatagram datagram = udp->receiveDatagram();
+        DatagramTransport::Ack ack;
+        if (DatagramTransport::Ack::decode(datagram.data(), &ack) && ack.token == channel.token)
+            onAck(ack);
+    }
+}
+
+/**
+ * @brief Updates the round trip, the data in flight and the delivery rate with an acknowledgement.
+ */
+void DatagramSender::onAck(const DatagramTransport::Ack &ack)
+{
+    qint64 now = clock.nsecsElapsed() / 1000;
+    lastAckTime = now;
+
+    // A block sent again since has a new entry, an older acknowledgement of it is not sampled
+    const Sent &entry = sent[int(ack.index % SENT_RING)];
+    if (entry.index == ack.index)
+    {
+        qint64 rtt = now - entry.time;
+        if (rttMin < 0 || rtt < rttMin)
+            rttMin = rtt;
+        ackedMark = qMax(ackedMark, entry.sentBefore + blockLength(ack.index));
+    }
+
+    qint64 received = qint64(qMin<quint64>(ack.received, quint64(fileSize)));
+    if (rateMarkTime < 0)
+    {
+        rateMarkTime = now;
+        rateMarkReceived = received;
+    }
+    else if (now - rateMarkTime >= qMax(rttMin, MIN_INTERVAL))
+    {
+        addBandwidthSample(double(received - rateMarkReceived) * 1e6 / double(now - rateMarkTime), now);
+        rateMarkTime = now;
+        rateMarkReceived = received;
+    }
+
+    if (received > ackedBytes)
+    {
+        ackedBytes = received;
+        emit acknowledgedChanged(ackedBytes);
+    }
+}
+
+/**
+ * @brief Keeps the maximum delivery rate of the last round trips and advances the gain cycle.
+ */
+void DatagramSender::addBandwidthSample(double rate, qint64 now)
+{
+    qint64 rtt = qMax(rttMin, MIN_INTERVAL);
+    bandwidthSamples.append(qMakePair(now, rate));
+    while (!bandwidthSamples.isEmpty() && bandwidthSamples.first().first < now - BANDWIDTH_ROUNDS * rtt)
+        bandwidthSamples.removeFirst();
+
+    bottleneck = 0;
+    for (const QPair<qint64, double> &sample : bandwidthSamples)
+        bottleneck = qMax(bottleneck, sample.second);
+
+    if (now - roundStart < rtt)
+        return;
+    roundStart = now;
+
+    if (startup)
+    {
+        // Startup ends once a few round trips did not raise the bandwidth much
+        if (bottleneck >= fullBandwidth * STARTUP_GROWTH)
+        {
+            fullBandwidth = bottleneck;
+            flatRounds = 0;
+        }
+        else if (++flatRounds >= FLAT_ROUNDS)
+        {
+            startup = false;
+        }
+        return;
+    }
+    cycleIndex = (cycleIndex + 1) % CYCLE_LENGTH;
+}
@@ -0,0 +1,230 @@
+/**
+ * @file datagramtransport.h
+ * @brief File data over UDP with rate-based congestion control, for lossy links
+ */
+
+#ifndef DATAGRAMTRANSPORT_H
+#define DATAGRAMTRANSPORT_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QBitArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QList>
+#include <QPair>
+#include <QTimer>
+#include <QUdpSocket>
+#include <QVector>
+#include "multicast.h"
+#include "bandwidthshaper.h"
+
+/**
+ * @namespace DatagramTransport
+ * @brief Carries the data of one file over UDP while its connection only carries control messages.
+ *
+ * A single TCP flow backs off sharply on every loss, which collapses on a
+ * congested Wi-Fi link. For the peers in Config::getDatagramPeers(), the
+ * sender offers "udp=1"; a receiver willing to take the data over UDP binds
+ * a port of its own and answers "udp=port/token/blocksize". The blocks then
+ * go as unicast Multicast datagrams, written by a MulticastReceiver, and
+ * losses are repaired in rounds of Protocol::RepairMessage on the TCP
+ * connection exactly as for a multicast transfer.
+ *
+ * The receiver answers the blocks with an Ack datagram per read: the
+ * token, the last block index read and the bytes received so far. The
+ * sender estimates the bottleneck bandwidth from the delivery rate and the
+ * round trip from the echoed index, paces at that rate and keeps at most
+ * two bandwidth-delay products in flight, the way BBR does; losses do not
+ * slow it down, so a lossy link keeps its throughput.
+ *
+ * Every file has its own port and token, so a loss only delays the file it
+ * hit. Datagrams are matched by token rather than by address: the receiver
+ * takes blocks from any address and acknowledges to the latest one, and
+ * the sender takes acknowledgements from any address, so the flow goes on
+ * when a laptop roams between access points.
+ */
+namespace DatagramTransport
+{
+    /** First bytes of every acknowledgement. */
+    extern const QByteArray ACK_MAGIC;
+
+    /** Bytes of an acknowledgement datagram. */
+    const int ACK_SIZE = 20;
+
+    /** Repair rounds after which a file still incomplete fails. */
+    const int MAX_ROUNDS = 20;
+
+    /**
+     * @brief Feedback of a unicast receiver after each read.
+     */
+    struct Ack
+    {
+        quint32 token = 0;
+
+        /** Index of the last block read. */
+        quint32 index = 0;
+
+        /** Bytes of the file received so far, each block counted once. */
+        quint64 received = 0;
+
+        QByteArray encode() const;
+        static bool decode(const QByteArray &datagram, Ack *ack);
+    };
+
+    /**
+     * @brief Whether transfers to a peer should carry their data over UDP.
+     *
+     * @param peer Address of the receiver
+     */
+    bool selectedFor(const QString &peer);
+
+    /** @brief Encodes the "udp" reply option of a receiver's channel. */
+    QByteArray encodeChannel(const Multicast::Channel &channel);
+
+    /**
+     * @brief Parses the "udp" reply option.
+     * @return false unless it names a port, a token and a usable block size
+     */
+    bool decodeChannel(const QByteArray &option, Multicast::Channel *channel);
+}
+
+/**
+ * @class DatagramSender
+ * @brief Sends the blocks of one file to one receiver, paced by the measured bandwidth.
+ *
+ * The first round sends every block; each later round only the blocks the
+ * receiver reported missing (see resend()). roundSent() follows a short
+ * drain time once the last block of a round left, so blocks still on their
+ * way are not reported missing.
+ */
+class DatagramSender : public QObject
+{
+    Q_OBJECT
+
+public:
+    DatagramSender(const QString &filePath, qint64 fileSize, const QString &peer, const Multicast::Channel &channel,
+                   QObject *parent = nullptr);
+
+    bool start();
+    void resend(const Multicast::Ranges &ranges);
+
+    /** @brief Bytes the receiver acknowledged. */
+    qint64 acknowledged() const { return ackedBytes; }
+
+    /** @brief Current pacing rate in bytes per second. */
+    double pacingRate() const;
+
+    /** @brief Estimated bottleneck bandwidth in bytes per second, 0 before the first acknowledgement. */
+    double bandwidth() const { return bottleneck; }
+
+    /** @brief Smallest round trip measured in microseconds, -1 before the first acknowledgement. */
+    qint64 minRtt() const { return rttMin; }
+
+signals:
+    /** @brief Signal emitted when the receiver acknowledged more data. */
+    void acknowledgedChanged(qint64 bytes);
+
+    /** @brief Signal emitted once every block of the round was sent and had time to arrive. */
+    void roundSent();
+
+    /** @brief Signal emitted when the file cannot be read any more. */
+    void failed();
+
+private slots:
+    void sendBlocks();
+    void onReadyRead();
+
+private:
+    /** One datagram sent, looked up by block index when acknowledged. */
+    struct Sent
+    {
+        quint32 index = 0xffffffff;
+        qint64 time = 0;
+        qint64 sentBefore = 0;
+    };
+
+    /** Recent sends remembered for round trips, more than this many in flight are not sampled. */
+    static const int SENT_RING = 65536;
+
+    /** Pacing rate before the first acknowledgement, in bytes per second. */
+    static constexpr double INITIAL_RATE = 4.0 * 1024 * 1024;
+
+    /** Gain while the bandwidth is still probed upwards, 2/ln(2). */
+    static constexpr double STARTUP_GAIN = 2.885;
+
+    /** Window of the bandwidth samples in round trips. */
+    static const int BANDWIDTH_ROUNDS = 10;
+
+    /** Bytes in flight before the bandwidth-delay product is known. */
+    static const qint64 INITIAL_WINDOW = 128 * 1024;
+
+    /** Time without acknowledgement after which the data in flight counts as lost, in microseconds. */
+    static const qint64 STALL_TIME = 500000;
+
+    /** Send buffer asked for, so bursts between timer ticks fit. */
+    static const int SOCKET_BUFFER = 4 * 1024 * 1024;
+
+    /** Bytes read from the file at once. */
+    static const qint64 READ_SIZE = 256 * 1024;
+
+    bool readBlock(quint32 index, QByteArray *data);
+    void onAck(const DatagramTransport::Ack &ack);
+    void addBandwidthSample(double rate, qint64 now);
+    qint64 inFlight() const { return sentBytes - ackedMark; }
+    qint64 window() const;
+    qint64 blockLength(quint32 index) const;
+    void endRound();
+
+    QFile file;
+    qint64 fileSize;
+    QString peer;
+    QHostAddress peerAddress;
+    Multicast::Channel channel;
+    quint32 blockCount;
+    QUdpSocket *udp;
+    QTimer *paceTimer;
+    QTimer *drainTimer;
+    QElapsedTimer clock;
+
+    /** Blocks of the current round still to send and the next to look at. */
+    QBitArray pending;
+    quint32 pendingCount = 0;
+    quint32 nextBlock = 0;
+
+    /** Last chunk read from the file, blocks are cut from it. */
+    QByteArray readBuffer;
+    qint64 readBufferOffset = -1;
+
+    /** Bytes sent in total, remembered with each send to tell what is still in flight. */
+    qint64 sentBytes = 0;
+    QVector<Sent> sent;
+    qint64 ackedBytes = 0;
+
+    /** Bytes sent up to the last acknowledged block, what was sent after it is in flight. */
+    qint64 ackedMark = 0;
+    qint64 lastAckTime = 0;
+
+    /** Start of the current delivery rate sample. */
+    qint64 rateMarkTime = -1;
+    qint64 rateMarkReceived = 0;
+
+    /** Delivery rate samples of the last BANDWIDTH_ROUNDS round trips and their maximum. */
+    QList<QPair<qint64, double>> bandwidthSamples;
+    double bottleneck = 0;
+    qint64 rttMin = -1;
+
+    /** Startup until the bandwidth stops growing, then the gain cycle probing up and draining. */
+    bool startup = true;
+    double fullBandwidth = 0;
+    int flatRounds = 0;
+    qint64 roundStart = 0;
+    int cycleIndex = 0;
+
+    /** Byte budget of the pacing timer. */
+    double budget = 0;
+    qint64 lastPace = 0;
+    TokenBucket bucket;
+};
+
+#endif // DATAGRAMTRANSPORT_H
@@ -0,0 +1,369 @@
+/**
+ * @file deltasync.cpp
+ */
+
+#include "deltasync.h"
+#include <QCryptographicHash>
+#include <QtEndian>
+#include <cmath>
+
+namespace
+{
+    /** Bytes read from the new file at a time by the encoder. */
+    const qint64 READ_AHEAD = 1024 * 1024;
+
+    /** 16-bit tag of a rolling checksum, filtering lookups before the hash. */
+    inline int tagOf(quint32 weak)
+    {
+        return int(((weak >> 16) + weak) & 0xffff);
+    }
+
+    void appendOperation(QByteArray &out, char op, quint32 value)
+    {
+        char field[4];
+        qToBigEndian<quint32>(value, field);
+        out.append(op);
+        out.append(field, 4);
+    }
+}
+
+QString DeltaSync::rebuildPath(const QString &filePath)
+{
+    return filePath + ".landrop-delta";
+}
+
+qint64 DeltaSync::blockSizeFor(qint64 fileSize)
+{
+    // One signature record per block keeps the signature near sqrt(size) * 24
+    qint64 root = qint64(std::sqrt(double(qMax<qint64>(0, fileSize))));
+    return qBound<qint64>(8 * 1024, root & ~qint64(1023), 1024 * 1024);
+}
+
+quint32 DeltaSync::weakChecksum(const char *data, qint64 length)
+{
+    quint32 a = 0;
+    quint32 b = 0;
+    for (qint64 i = 0; i < length; ++i)
+    {
+        quint32 byte = static_cast<unsigned char>(data[i]);
+        a += byte;
+        b += quint32(length - i) * byte;
+    }
+    return (a & 0xffff) | ((b & 0xffff) << 16);
+}
+
+qint64 DeltaSync::Signature::blockLength(int index) const
+{
+    qint64 start = qint64(index) * blockSize;
+    return qBound<qint64>(0, basisSize - start, blockSize);
+}
+
+QByteArray DeltaSync::Signature::encode() const
+{
+    QByteArray data;
+    data.reserve(weak.size() * SIGNATURE_RECORD);
+    for (int i = 0; i < weak.size(); ++i)
+    {
+        char field[4];
+        qToBigEndian<quint32>(weak[i], field);
+        data.append(field, 4);
+        data.append(strong[i]);
+    }
+    return data;
+}
+
+/**
+ * @brief Parses a signature received after the delta reply.
+ * @return false if the length does not match the block count of the old copy
+ */
+bool DeltaSync::Signature::decode(const QByteArray &data, qint64 blockSize, qint64 basisSize, Signature *signature)
+{
+    if (blockSize <= 0 || basisSize < 0 || data.size() % SIGNATURE_RECORD != 0)
+        return false;
+
+    qint64 count = (basisSize + blockSize - 1) / blockSize;
+    if (data.size() / SIGNATURE_RECORD != count)
+        return false;
+
+    signature->blockSize = blockSize;
+    signature->basisSize = basisSize;
+    signature->weak.clear();
+    signature->strong.clear();
+    for (qint64 offset = 0; offset < data.size(); offset += SIGNATURE_RECORD)
+    {
+        signature->weak.append(qFromBigEndian<quint32>(data.constData() + offset));
+        signature->strong.append(data.mid(offset + 4, SIGNATURE_RECORD - 4));
+    }
+    return true;
+}
+
+/**
+ * @brief Reads the old copy block by block and checksums every block.
+ * @return false if the copy could not be read completely
+ */
+bool DeltaSync::Signature::compute(QIODevice *basis, qint64 blockSize, Signature *signature)
+{
+    if (blockSize <= 0 || !basis->seek(0))
+        return false;
+
+    signature->blockSize = blockSize;
+    signature->basisSize = basis->size();
+    signature->weak.clear();
+    signature->strong.clear();
+
+    qint64 remaining = signature->basisSize;
+    while (remaining > 0)
+    {
+        QByteArray block = basis->read(qMin(blockSize, remaining));
+        if (block.isEmpty())
+            return false;
+
+        signature->weak.append(weakChecksum(block.constData(), block.size()));
+        signature->strong.append(QCryptographicHash::hash(block, QCryptographicHash::Sha1));
+        remaining -= block.size();
+    }
+    return true;
+}
+
+/**
+ * @brief Prepares the lookup tables of a signature.
+ *
+ * @param file Open new file, read from the start
+ * @param fileSize Size of the new file
+ * @param signature Signature of the receiver's old copy
+ */
+DeltaEncoder::DeltaEncoder(QIODevice *file, qint64 fileSize, const DeltaSync::Signature &signature)
+    : file(file), fileSize(fileSize), signature(signature), tags(65536, false)
+{
+    for (int i = 0; i < signature.weak.size(); ++i)
+    {
+        blocks.insert(signature.weak[i], i);
+        tags[tagOf(signature.weak[i])] = true;
+    }
+}
+
+/**
+ * @brief Produces the next part of the delta stream.
+ *
+ * The window slides one byte at a time while nothing matches; bytes it
+ * leaves behind become literal data, sent in runs of at most MAX_LITERAL.
+ *
+ * @param maxBytes Output size after which the encoder stops
+ * @return Encoded operations, empty once atEnd() or hasError()
+ */
+QByteArray DeltaEncoder::next(qint64 maxBytes)
+{
+    QByteArray out;
+    const qint64 blockSize = signature.blockSize;
+
+    while (!finished && !failed && out.size() < maxBytes)
+    {
+        if (pos >= fileSize)
+        {
+            flushLiteral(out);
+            out.append('E');
+            finished = true;
+            break;
+        }
+
+        if (!rolling)
+        {
+            windowLength = qMin(blockSize, fileSize - pos);
+            if (!ensure(pos + windowLength))
+            {
+                failed = true;
+                break;
+            }
+            quint32 weak = DeltaSync::weakChecksum(buffer.constData() + (pos - bufferStart), windowLength);
+            a = weak & 0xffff;
+            b = weak >> 16;
+            rolling = true;
+        }
+
+        int index = findMatch(a | (b << 16), windowLength);
+        if (index >= 0)
+        {
+            flushLiteral(out);
+            appendOperation(out, 'B', quint32(index));
+            pos += windowLength;
+            matched += windowLength;
+            literalStart = pos;
+            rolling = false;
+            continue;
+        }
+
+        // Slide the window by one byte, shrinking it at the end of the file
+        quint32 outgoing = byteAt(pos);
+        qint64 end = pos + windowLength;
+        if (end < fileSize)
+        {
+            if (!ensure(end + 1))
+            {
+                failed = true;
+                break;
+            }
+            quint32 incoming = byteAt(end);
+            a = (a - outgoing + incoming) & 0xffff;
+            b = (b - quint32(windowLength) * outgoing + a) & 0xffff;
+        }
+        else
+        {
+            a = (a - outgoing) & 0xffff;
+            b = (b - quint32(windowLength) * outgoing) & 0xffff;
+            --windowLength;
+        }
+        ++pos;
+
+        if (pos - literalStart >= DeltaSync::MAX_LITERAL)
+            flushLiteral(out);
+    }
+    return out;
+}
+
+/**
+ * @brief Makes sure the buffer holds the file up to @p end.
+ *
+ * Bytes before the pending literal are dropped before reading more.
+ */
+bool DeltaEncoder::ensure(qint64 end)
+{
+    if (end <= bufferStart + buffer.size())
+        return true;
+
+    if (literalStart > bufferStart)
+    {
+        buffer.remove(0, literalStart - bufferStart);
+        bufferStart = literalStart;
+    }
+
+    qint64 bufferEnd = bufferStart + buffer.size();
+    qint64 length = qMin(qMax(READ_AHEAD, end - bufferEnd), fileSize - bufferEnd);
+    if (!file->seek(bufferEnd))
+        return false;
+
+    buffer.append(file->read(length));
+    return bufferStart + buffer.size() >= end;
+}
+
+unsigned char DeltaEncoder::byteAt(qint64 offset) const
+{
+    return static_cast<unsigned char>(buffer.at(offset - bufferStart));
+}
+
+/**
+ * @brief Finds a block of the old copy equal to the current window.
+ * @return Block index, or -1 if none matches
+ */
+int DeltaEncoder::findMatch(quint32 weak, qint64 length)
+{
+    if (length <= 0 || !tags[tagOf(weak)])
+        return -1;
+
+    QByteArray strong;
+    for (auto it = blocks.constFind(weak); it != blocks.constEnd() && it.key() == weak; ++it)
+    {
+        if (signature.blockLength(it.value()) != length)
+            continue;
+
+        if (strong.isEmpty())
+        {
+            QByteArray window = QByteArray::fromRawData(buffer.constData() + (pos - bufferStart), length);
+            strong = QCryptographicHash::hash(window, QCryptographicHash::Sha1);
+        }
+        if (signature.strong[it.value()] == strong)
+            return it.value();
+    }
+    return -1;
+}
+
+/**
+ * @brief Appends the bytes between the last operation and the window as a literal.
+ */
+void DeltaEncoder::flushLiteral(QByteArray &out)
+{
+    qint64 length = pos - literalStart;
+    if (length <= 0)
+        return;
+
+    appendOperation(out, 'L', quint32(length));
+    out.append(buffer.constData() + (literalStart - bufferStart), length);
+    literalStart = pos;
+}
+
+/**
+ * @param basisPath Receiver's old copy of the file
+ * @param output Open file the rebuilt data is written to
+ * @param blockSize Block size of the signature sent to the sender
+ * @param expectedSize Size of the rebuilt file announced by the sender
+ */
+DeltaDecoder::DeltaDecoder(const QString &basisPath, QFile *output, qint64 blockSize, qint64 expectedSize)
+    : basis(basisPath), output(output), blockSize(blockSize), expectedSize(expectedSize)
+{
+}
+
+/**
+ * @brief Opens the old copy blocks are copied from.
+ */
+bool DeltaDecoder::open()
+{
+    return blockSize > 0 && basis.open(QIODevice::ReadOnly);
+}
+
+/**
+ * @brief Applies the delta operations waiting on a device.
+ *
+ * Incomplete operation headers are left unread, and so is anything after
+ * the end operation.
+ *
+ * @return false if the stream is malformed, would exceed the expected size,
+ *         or the output could not be written
+ */
+bool DeltaDecoder::readFrom(QIODevice *device)
+{
+    while (!finished && device->bytesAvailable() > 0)
+    {
+        if (literalRemaining > 0)
+        {
+            QByteArray data = device->read(qMin(literalRemaining, device->bytesAvailable()));
+            if (data.isEmpty() || output->write(data) != data.size())
+                return false;
+            literalRemaining -= data.size();
+            outputSize += data.size();
+            continue;
+        }
+
+        char header[5];
+        device->peek(header, 1);
+        if (header[0] == 'E')
+        {
+            device->read(header, 1);
+            finished = true;
+            break;
+        }
+        if (header[0] != 'L' && header[0] != 'B')
+            return false;
+        if (device->bytesAvailable() < 5)
+            break;
+
+        device->read(header, 5);
+        quint32 value = qFromBigEndian<quint32>(header + 1);
+        if (header[0] == 'L')
+        {
+            if (qint64(value) > expectedSize - outputSize)
+                return false;
+            literalRemaining = value;
+            continue;
+        }
+
+        // Copy one block of the old copy
+        qint64 start = qint64(value) * blockSize;
+        qint64 length = qMin(blockSize, basis.size() - start);
+        if (start >= basis.size() || length > expectedSize - outputSize || !basis.seek(start))
+            return false;
+        QByteArray block = basis.read(length);
+        if (block.isEmpty() || output->write(block) != block.size())
+            return false;
+        outputSize += block.size();
+    }
+    return true;
+}
@@ -0,0 +1,167 @@
+/**
+ * @file deltasync.h
+ * @brief Block signatures and delta streams for updating an existing copy of a file
+ */
+
+#ifndef DELTASYNC_H
+#define DELTASYNC_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QIODevice>
+#include <QList>
+#include <QString>
+#include <vector>
+
+/**
+ * @namespace DeltaSync
+ * @brief rsync-style comparison of a new file against the receiver's old copy.
+ *
+ * The receiver splits its existing copy into fixed-size blocks and sends a
+ * signature holding a rolling checksum and a SHA-1 for each block. The
+ * sender slides a window over the new file, and wherever the rolling
+ * checksum and then the SHA-1 match a block, sends a reference to it
+ * instead of the bytes.
+ *
+ * Delta stream, after the "OK|delta=B;base=N;sig=S" reply and its S
+ * signature bytes (B: block size, N: size of the old copy):
+ * - 'L' + 32-bit big-endian length + bytes: literal data
+ * - 'B' + 32-bit big-endian index: copy block index of the old copy
+ * - 'E': end of the file
+ */
+namespace DeltaSync
+{
+    /** Bytes per block in an encoded signature: rolling checksum + SHA-1. */
+    const int SIGNATURE_RECORD = 4 + 20;
+
+    /** Longest literal run sent as one operation. */
+    const qint64 MAX_LITERAL = 64 * 1024;
+
+    /**
+     * @brief Path the receiver rebuilds a file at before it replaces the old copy.
+     */
+    QString rebuildPath(const QString &filePath);
+
+    /**
+     * @brief Block size used for an old copy of the given size (about its square root).
+     */
+    qint64 blockSizeFor(qint64 fileSize);
+
+    /**
+     * @brief rsync rolling checksum of a block.
+     */
+    quint32 weakChecksum(const char *data, qint64 length);
+
+    /**
+     * @brief Checksums of every block of the receiver's old copy.
+     */
+    struct Signature
+    {
+        qint64 blockSize = 0;
+        qint64 basisSize = 0;
+        QList<quint32> weak;
+        QList<QByteArray> strong;
+
+        /** @brief Length of block @p index, the last one may be shorter. */
+        qint64 blockLength(int index) const;
+
+        QByteArray encode() const;
+        static bool decode(const QByteArray &data, qint64 blockSize, qint64 basisSize, Signature *signature);
+        static bool compute(QIODevice *basis, qint64 blockSize, Signature *signature);
+    };
+}
+
+/**
+ * @class DeltaEncoder
+ * @brief Produces the delta stream of a file against a signature, piece by piece.
+ *
+ * The sender pulls output with next() as its send window allows, so large
+ * files are never held in memory.
+ */
+class DeltaEncoder
+{
+public:
+    DeltaEncoder(QIODevice *file, qint64 fileSize, const DeltaSync::Signature &signature);
+
+    QByteArray next(qint64 maxBytes);
+
+    /** @brief Whether the end operation was produced. */
+    bool atEnd() const { return finished; }
+
+    /** @brief Whether reading the file failed. */
+    bool hasError() const { return failed; }
+
+    /** @brief Offset of the file scanned so far. */
+    qint64 position() const { return pos; }
+
+    /** @brief Number of bytes covered by block references so far. */
+    qint64 matchedBytes() const { return matched; }
+
+private:
+    bool ensure(qint64 end);
+    unsigned char byteAt(qint64 offset) const;
+    int findMatch(quint32 weak, qint64 length);
+    void flushLiteral(QByteArray &out);
+
+    QIODevice *file;
+    qint64 fileSize;
+    DeltaSync::Signature signature;
+
+    /** Block indices by rolling checksum, behind a 16-bit tag filter. */
+    QMultiHash<quint32, int> blocks;
+    std::vector<bool> tags;
+
+    /** File bytes from bufferStart on, kept from the pending literal onwards. */
+    QByteArray buffer;
+    qint64 bufferStart = 0;
+
+    qint64 pos = 0;
+    qint64 literalStart = 0;
+    qint64 windowLength = 0;
+    quint32 a = 0;
+    quint32 b = 0;
+    bool rolling = false;
+    bool finished = false;
+    bool failed = false;
+    qint64 matched = 0;
+};
+
+/**
+ * @class DeltaDecoder
+ * @brief Rebuilds a file from a delta stream and the receiver's old copy.
+ *
+ * The output never grows past the size announced for the file: a block
+ * reference costs five bytes of stream and copies a whole block, so a
+ * stream is refused as soon as an operation would go beyond it.
+ */
+class DeltaDecoder
+{
+public:
+    DeltaDecoder(const QString &basisPath, QFile *output, qint64 blockSize, qint64 expectedSize);
+
+    bool open();
+    bool readFrom(QIODevice *device);
+
+    /** @brief Whether the end operation was received. */
+    bool isFinished() const { return finished; }
+
+    /** @brief Number of bytes written to the output so far. */
+    qint64 written() const { return outputSize; }
+
+private:
+    QFile basis;
+    QFile *output;
+    qint64 blockSize;
+
+    /** Size of the rebuilt file announced in the transfer header. */
+    qint64 expectedSize;
+
+    /** Literal bytes still expected for the current operation. */
+    qint64 literalRemaining = 0;
+
+    qint64 outputSize = 0;
+    bool finished = false;
+};
+
+#endif // DELTASYNC_H
@@ -0,0 +1,214 @@
+/**
+ * @file discoverymessage.cpp
+ */
+
+#include "discoverymessage.h"
+#include <QtEndian>
+
+const QByteArray DiscoveryMessage::MAGIC = "LDDS";
+
+namespace
+{
+    template <typename T>
+    void appendNumber(QByteArray &out, T value)
+    {
+        char field[sizeof(T)];
+        qToBigEndian<T>(value, field);
+        out.append(field, sizeof(T));
+    }
+
+    /**
+     * @brief Reads the fields of a datagram in order, failing on truncation.
+     */
+    class DatagramReader
+    {
+    public:
+        explicit DatagramReader(const QByteArray &datagram) : data(datagram), pos(DiscoveryMessage::MAGIC.size()) {}
+
+        template <typename T>
+        T number()
+        {
+            if (!ok || data.size() - pos < int(sizeof(T)))
+            {
+                ok = false;
+                return 0;
+            }
+            T value = qFromBigEndian<T>(data.constData() + pos);
+            pos += sizeof(T);
+            return value;
+        }
+
+        QByteArray bytes(int length)
+        {
+            if (!ok || length < 0 || data.size() - pos < length)
+            {
+                ok = false;
+                return QByteArray();
+            }
+            QByteArray value = data.mid(pos, length);
+            pos += length;
+            return value;
+        }
+
+        bool valid() const { return ok; }
+
+    private:
+        const QByteArray &data;
+        int pos;
+        bool ok = true;
+    };
+}
+
+QByteArray DiscoveryMessage::Announcement::encode() const
+{
+    QByteArray name = hostname.toUtf8().left(0xffff);
+    QByteArray datagram;
+    datagram.reserve(HEADER_SIZE + 2 + name.size() + 2);
+    datagram.append(MAGIC);
+    appendNumber<quint8>(datagram, FORMAT_VERSION);
+    appendNumber<quint8>(datagram, quint8(type));
+    appendNumber<quint16>(datagram, discoveryPort);
+    appendNumber<quint16>(datagram, transferPort);
+    appendNumber<quint8>(datagram, transferVersion);
+    appendNumber<quint64>(datagram, catalogVersion);
+    appendNumber<quint16>(datagram, quint16(name.size()));
+    datagram.append(name);
+
+    appendNumber<quint16>(datagram, quint16(qMin<qsizetype>(options.size(), 0xffff)));
+    int written = 0;
+    for (auto it = options.constBegin(); it != options.constEnd() && written < 0xffff; ++it, ++written)
+    {
+        QByteArray key = it.key().left(0xff);
+        QByteArray value = it.value().left(0xffff);
+        appendNumber<quint8>(datagram, quint8(key.size()));
+        datagram.append(key);
+        appendNumber<quint16>(datagram, quint16(value.size()));
+        datagram.append(value);
+    }
+    return datagram;
+}
+
+bool DiscoveryMessage::Announcement::decode(const QByteArray &datagram, Announcement *announcement)
+{
+    if (datagram.size() < HEADER_SIZE || !isBinary(datagram))
+        return false;
+
+    DatagramReader reader(datagram);
+    quint8 format = reader.number<quint8>();
+    quint8 type = reader.number<quint8>();
+    announcement->discoveryPort = reader.number<quint16>();
+    announcement->transferPort = reader.number<quint16>();
+    announcement->transferVersion = reader.number<quint8>();
+    announcement->catalogVersion = reader.number<quint64>();
+    announcement->hostname = QString::fromUtf8(reader.bytes(reader.number<quint16>()));
+
+    announcement->options.clear();
+    quint16 count = reader.number<quint16>();
+    for (quint16 i = 0; i < count && reader.valid(); ++i)
+    {
+        QByteArray key = reader.bytes(reader.number<quint8>());
+        QByteArray value = reader.bytes(reader.number<quint16>());
+        announcement->options.insert(key, value);
+    }
+
+    if (!reader.valid() || format == 0 || (type != Request && type != Response && type != Register) ||
+        announcement->hostname.isEmpty() ||
+        announcement->transferVersion == 0)
+        return false;
+
+    announcement->type = Type(type);
+    return true;
+}
+
+QByteArray DiscoveryMessage::HeartbeatMessage::encode() const
+{
+    QByteArray datagram;
+    datagram.reserve(HEARTBEAT_SIZE);
+    datagram.append(MAGIC);
+    appendNumber<quint8>(datagram, FORMAT_VERSION);
+    appendNumber<quint8>(datagram, quint8(Heartbeat));
+    appendNumber<quint32>(datagram, sequence);
+    appendNumber<quint16>(datagram, interval);
+    appendNumber<quint64>(datagram, catalogVersion);
+    return datagram;
+}
+
+bool DiscoveryMessage::HeartbeatMessage::decode(const QByteArray &datagram, HeartbeatMessage *heartbeat)
+{
+    if (datagram.size() < HEARTBEAT_SIZE || !isBinary(datagram))
+        return false;
+
+    DatagramReader reader(datagram);
+    quint8 format = reader.number<quint8>();
+    quint8 type = reader.number<quint8>();
+    heartbeat->sequence = reader.number<quint32>();
+    heartbeat->interval = reader.number<quint16>();
+    heartbeat->catalogVersion = reader.number<quint64>();
+    return reader.valid() && format != 0 && type == Heartbeat && heartbeat->interval > 0;
+}
+
+QList<QByteArray> DiscoveryMessage::RegisteredPeers::encode(int maxSize) const
+{
+    QByteArray header = MAGIC;
+    appendNumber<quint8>(header, FORMAT_VERSION);
+    appendNumber<quint8>(header, quint8(PeerList));
+
+    QList<QByteArray> datagrams;
+    QByteArray entries;
+    quint16 count = 0;
+    auto flush = [&]()
+    {
+        QByteArray datagram = header;
+        appendNumber<quint16>(datagram, count);
+        datagrams.append(datagram + entries);
+        entries.clear();
+        count = 0;
+    };
+
+    for (const Peer &peer : peers)
+    {
+        QByteArray address = peer.address.toUtf8().left(0xff);
+        QByteArray announced = peer.announcement.encode();
+        if (announced.size() > 0xffff)
+            continue;
+
+        QByteArray entry;
+        appendNumber<quint8>(entry, quint8(address.size()));
+        entry.append(address);
+        appendNumber<quint16>(entry, quint16(announced.size()));
+        entry.append(announced);
+
+        if (count > 0 && (header.size() + 2 + entries.size() + entry.size() > maxSize || count == 0xffff))
+            flush();
+        entries.append(entry);
+        ++count;
+    }
+    if (count > 0 || datagrams.isEmpty())
+        flush();
+    return datagrams;
+}
+
+bool DiscoveryMessage::RegisteredPeers::decode(const QByteArray &datagram, RegisteredPeers *list)
+{
+    if (!isBinary(datagram))
+        return false;
+
+    DatagramReader reader(datagram);
+    quint8 format = reader.number<quint8>();
+    quint8 type = reader.number<quint8>();
+    quint16 count = reader.number<quint16>();
+    if (!reader.valid() || format == 0 || type != PeerList)
+        return false;
+
+    list->peers.clear();
+    for (quint16 i = 0; i < count; ++i)
+    {
+        Peer peer;
+        peer.address = QString::fromUtf8(reader.bytes(reader.number<quint8>()));
+        QByteArray announced = reader.bytes(reader.number<quint16>());
+        if (!reader.valid() || peer.address.isEmpty() || !Announcement::decode(announced, &peer.announcement))
+            return false;
+        list->peers.append(peer);
+    }
+    return true;
+}
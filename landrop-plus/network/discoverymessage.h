@@ -0,0 +1,136 @@
+/**
+ * @file discoverymessage.h
+ * @brief Binary datagram format of peer discovery
+ */
+
+#ifndef DISCOVERYMESSAGE_H
+#define DISCOVERYMESSAGE_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include <QString>
+
+/**
+ * @namespace DiscoveryMessage
+ * @brief Binary encoding of discovery requests and responses.
+ *
+ * A datagram is MAGIC, the 8-bit format version and message type, the
+ * 16-bit discovery and transfer ports, the 8-bit transfer protocol version
+ * and the 64-bit catalog version (big-endian), then the hostname as UTF-8
+ * with a 16-bit length and a 16-bit count of (8-bit key length, key,
+ * 16-bit value length, value) options carrying further metadata.
+ *
+ * Known peers keep each other alive with a HeartbeatMessage. Peers of
+ * other subnets register their announcement with a rendezvous instance,
+ * which answers with a PeerList.
+ *
+ * Later format versions only append fields, so a datagram of a newer
+ * version is read up to what this one knows. Peers that only speak the
+ * "LANDROP_DISCOVERY_V1|..." text lines are still answered in text.
+ */
+namespace DiscoveryMessage
+{
+    /** First bytes of every datagram, no text message starts with them. */
+    extern const QByteArray MAGIC;
+
+    /** Format version written. */
+    const quint8 FORMAT_VERSION = 1;
+
+    /** Bytes in front of the hostname. */
+    const int HEADER_SIZE = 19;
+
+    enum Type : quint8
+    {
+        Request = 1,  ///< Broadcast announcement, answered by a Response
+        Response = 2, ///< Answer sent to the requesting peer only
+        Heartbeat = 3, ///< Liveness of a known peer, see HeartbeatMessage
+        Register = 4,  ///< Announcement sent to a rendezvous instance, answered by a PeerList
+        PeerList = 5   ///< Peers registered with a rendezvous instance, see RegisteredPeers
+    };
+
+    /** Bytes of a heartbeat datagram. */
+    const int HEARTBEAT_SIZE = 20;
+
+    /**
+     * @brief Fields of one discovery datagram.
+     */
+    struct Announcement
+    {
+        Type type = Request;
+        quint16 discoveryPort = 0;
+        quint16 transferPort = 0;
+        quint8 transferVersion = 1;
+
+        /** Version of the sender's SharedCatalog, 0 when it shares nothing. */
+        quint64 catalogVersion = 0;
+
+        QString hostname;
+        QMap<QByteArray, QByteArray> options;
+
+        QByteArray encode() const;
+
+        /**
+         * @brief Reads a datagram.
+         * @return false if it is not a complete binary discovery datagram
+         */
+        static bool decode(const QByteArray &datagram, Announcement *announcement);
+    };
+
+    /**
+     * @brief Sent to the known peers in place of repeated announcements.
+     *
+     * Broadcast once to the peers of our subnets, unicast to the others.
+     *
+     * MAGIC, the format version and type, then the 32-bit sequence number,
+     * the 16-bit interval until the next heartbeat in milliseconds and the
+     * 64-bit catalog version. The sender is identified by its address.
+     */
+    struct HeartbeatMessage
+    {
+        quint32 sequence = 0;
+        quint16 interval = 0;
+        quint64 catalogVersion = 0;
+
+        QByteArray encode() const;
+
+        /**
+         * @brief Reads a datagram.
+         * @return false if it is not a heartbeat
+         */
+        static bool decode(const QByteArray &datagram, HeartbeatMessage *heartbeat);
+    };
+
+    /**
+     * @brief Peers a rendezvous instance relays to the ones registering with it.
+     *
+     * MAGIC, the format version and type, a 16-bit count, then for each
+     * peer its address as text with an 8-bit length and its announcement
+     * with a 16-bit length. Long lists are split over several datagrams,
+     * each a valid list of its own.
+     */
+    struct RegisteredPeers
+    {
+        struct Peer
+        {
+            QString address;
+            Announcement announcement;
+        };
+
+        QList<Peer> peers;
+
+        /** @brief Datagrams of at most @p maxSize bytes listing every peer, one if there are none. */
+        QList<QByteArray> encode(int maxSize) const;
+
+        /**
+         * @brief Reads a datagram.
+         * @return false if it is not a complete peer list
+         */
+        static bool decode(const QByteArray &datagram, RegisteredPeers *list);
+    };
+
+    /** @brief Whether a datagram is in the binary format, from its first bytes. */
+    inline bool isBinary(const QByteArray &datagram) { return datagram.startsWith(MAGIC); }
+}
+
+#endif // DISCOVERYMESSAGE_H
@@ -0,0 +1,105 @@
+/**
+ * @file diskio.cpp
+ */
+
+#include "diskio.h"
+#include <QThread>
+#include <QThreadPool>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <io.h>
+#elif defined(Q_OS_UNIX)
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+QThreadPool *DiskIo::pool()
+{
+    // Enough threads for a few files with their queue depth in flight each
+    static QThreadPool *diskPool = []()
+    {
+        QThreadPool *created = new QThreadPool();
+        created->setMaxThreadCount(qBound(4, QThread::idealThreadCount() * 2, 16));
+        return created;
+    }();
+    return diskPool;
+}
+
+qint64 DiskIo::readAt(int fileDescriptor, qint64 offset, char *data, qint64 length)
+{
+    if (fileDescriptor < 0 || offset < 0 || length < 0)
+        return -1;
+
+    qint64 total = 0;
+    while (total < length)
+    {
+#if defined(Q_OS_WIN)
+        HANDLE fileHandle = reinterpret_cast<HANDLE>(_get_osfhandle(fileDescriptor));
+        if (fileHandle == INVALID_HANDLE_VALUE)
+            return -1;
+
+        OVERLAPPED position = {};
+        quint64 at = quint64(offset + total);
+        position.Offset = DWORD(at & 0xFFFFFFFF);
+        position.OffsetHigh = DWORD(at >> 32);
+        DWORD chunk = DWORD(qMin<qint64>(length - total, 0x40000000));
+        DWORD bytesRead = 0;
+        if (!ReadFile(fileHandle, data + total, chunk, &bytesRead, &position))
+            return GetLastError() == ERROR_HANDLE_EOF ? total : -1;
+        qint64 result = bytesRead;
+#elif defined(Q_OS_UNIX)
+        ssize_t result;
+        do {
+            result = ::pread(fileDescriptor, data + total, size_t(length - total), off_t(offset + total));
+        } while (result < 0 && errno == EINTR);
+        if (result < 0)
+            return -1;
+#else
+        Q_UNUSED(data);
+        return -1;
+#endif
+        if (result == 0)
+            break;
+        total += result;
+    }
+    return total;
+}
+
+bool DiskIo::writeAt(int fileDescriptor, qint64 offset, const char *data, qint64 length)
+{
+    if (fileDescriptor < 0 || offset < 0 || length < 0)
+        return false;
+
+    qint64 total = 0;
+    while (total < length)
+    {
+#if defined(Q_OS_WIN)
+        HANDLE fileHandle = reinterpret_cast<HANDLE>(_get_osfhandle(fileDescriptor));
+        if (fileHandle == INVALID_HANDLE_VALUE)
+            return false;
+
+        OVERLAPPED position = {};
+        quint64 at = quint64(offset + total);
+        position.Offset = DWORD(at & 0xFFFFFFFF);
+        position.OffsetHigh = DWORD(at >> 32);
+        DWORD chunk = DWORD(qMin<qint64>(length - total, 0x40000000));
+        DWORD written = 0;
+        if (!WriteFile(fileHandle, data + total, chunk, &written, &position) || written == 0)
+            return false;
+        total += written;
+#elif defined(Q_OS_UNIX)
+        ssize_t written;
+        do {
+            written = ::pwrite(fileDescriptor, data + total, size_t(length - total), off_t(offset + total));
+        } while (written < 0 && errno == EINTR);
+        if (written <= 0)
+            return false;
+        total += written;
+#else
+        Q_UNUSED(data);
+        return false;
+#endif
+    }
+    return true;
+}
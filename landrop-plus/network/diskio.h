@@ -0,0 +1,49 @@
+/**
+ * @file diskio.h
+ * @brief Positional file I/O run on a dedicated pool of disk threads
+ */
+
+#ifndef DISKIO_H
+#define DISKIO_H
+
+#include <QtGlobal>
+
+class QThreadPool;
+
+/**
+ * @namespace DiskIo
+ * @brief Reads and writes at absolute file offsets, safe to issue concurrently.
+ *
+ * On POSIX systems this uses pread(2)/pwrite(2), on Windows ReadFile and
+ * WriteFile with the offset in an OVERLAPPED structure. Neither moves a
+ * shared file position, so several requests can be in flight on the same
+ * descriptor from different threads; ReadAheadSource and FileWriter use
+ * this to keep disk and network busy at the same time.
+ *
+ * Requests are run on pool(), kept apart from QThreadPool::globalInstance()
+ * so blocking disk calls never hold up hashing.
+ */
+namespace DiskIo
+{
+    /**
+     * @brief Pool that runs blocking disk requests.
+     */
+    QThreadPool *pool();
+
+    /**
+     * @brief Reads up to @p length bytes at @p offset.
+     *
+     * @param fileDescriptor C runtime descriptor of the open file (QFile::handle())
+     * @return Bytes read, fewer only at the end of the file, -1 on error
+     */
+    qint64 readAt(int fileDescriptor, qint64 offset, char *data, qint64 length);
+
+    /**
+     * @brief Writes @p length bytes at @p offset.
+     *
+     * @return false if not every byte could be written
+     */
+    bool writeAt(int fileDescriptor, qint64 offset, const char *data, qint64 length);
+}
+
+#endif // DISKIO_H
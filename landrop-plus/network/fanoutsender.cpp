@@ -0,0 +1,511 @@
+/**
+ * @file fanoutsender.cpp
+ */
+
+#include "fanoutsender.h"
+#include "bufferpool.h"
+#include <QFileInfo>
+#include <QHostAddress>
+#include <QDebug>
+
+/**
+ * @brief Constructs a new FanoutSender.
+ *
+ * @param parent Parent QObject
+ */
+FanoutSender::FanoutSender(QObject *parent)
+    : QObject(parent),
+      throttleTimer(new QTimer(this)),
+      stallTimer(new QTimer(this))
+{
+    throttleTimer->setSingleShot(true);
+    stallTimer->setSingleShot(true);
+    connect(throttleTimer, &QTimer::timeout, this, &FanoutSender::pump);
+    connect(stallTimer, &QTimer::timeout, this, &FanoutSender::dropStalled);
+}
+
+/**
+ * @brief Destructor, closes every connection.
+ */
+FanoutSender::~FanoutSender()
+{
+    clear();
+}
+
+/**
+ * @brief Drops all connections and buffered chunks.
+ */
+void FanoutSender::clear()
+{
+    throttleTimer->stop();
+    stallTimer->stop();
+    for (Peer &peer : peers)
+    {
+        closePeer(peer);
+        delete peer.timer;
+    }
+    peers.clear();
+    chunks.clear();
+    bufferedBytes = 0;
+    delete hasher;
+    hasher = nullptr;
+    digest.clear();
+    delete file;
+    file = nullptr;
+}
+
+/**
+ * @brief Starts sending one file to every target.
+ *
+ * Each target gets its own connection and header; the data is streamed
+ * once every target answered.
+ *
+ * @param filePath Absolute path of the file to send
+ * @param targets Receivers of the file
+ */
+void FanoutSender::sendFile(const QString &filePath, const QList<FanoutTarget> &targets)
+{
+    clear();
+    streaming = false;
+    completed = false;
+    chunksStart = 0;
+    readOffset = 0;
+
+    file = new QFile(filePath);
+    bool readable = file->open(QIODevice::ReadOnly);
+    fileSize = readable ? file->size() : 0;
+
+    for (const FanoutTarget &target : targets)
+    {
+        Peer peer;
+        peer.target = target;
+        peer.timer = new QTimer(this);
+        peer.timer->setSingleShot(true);
+        peers.append(peer);
+    }
+
+    for (int index = 0; index < peers.size(); ++index)
+    {
+        Peer &peer = peers[index];
+        if (!readable)
+        {
+            peer.state = PeerState::Done;
+            emit transferError(index);
+            continue;
+        }
+
+        peer.socket = new QTcpSocket(this);
+        connect(peer.socket, &QTcpSocket::connected, this, [this, index]()
+                { onConnected(index); });
+        connect(peer.socket, &QTcpSocket::readyRead, this, [this, index]()
+                { onReadyRead(index); });
+        connect(peer.socket, &QTcpSocket::bytesWritten, this, [this, index](qint64 bytes)
+                { onBytesWritten(index, bytes); });
+        connect(peer.socket, &QTcpSocket::disconnected, this, [this, index]()
+                { onDisconnected(index); });
+        connect(peer.socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::errorOccurred),
+                this, [this, index](QAbstractSocket::SocketError socketError)
+                {
+            // A receiver closing the connection is handled in onDisconnected()
+            if (socketError == QAbstractSocket::RemoteHostClosedError)
+                return;
+            failPeer(index);
+            pump(); });
+        connect(peer.timer, &QTimer::timeout, this, [this, index]()
+                {
+            // qDebug() << "FanoutSender: Timeout for receiver" << index;
+            failPeer(index);
+            pump(); });
+
+        peer.socket->connectToHost(QHostAddress(peer.target.address), peer.target.port);
+        peer.timer->start(10000); // 10 second connection timeout
+    }
+
+    pump();
+}
+
+/**
+ * @brief Announces the file to a receiver.
+ *
+ * @param index Position of the receiver in the target list
+ */
+void FanoutSender::onConnected(int index)
+{
+    Peer &peer = peers[index];
+    peer.timer->stop();
+
+    Protocol::TransferHeader header;
+    header.fileName = QFileInfo(file->fileName()).fileName();
+    header.fileSize = fileSize;
+    header.transferId = Protocol::newTransferId();
+    if (Config::getIntegrityCheckEnabled())
+        header.options.insert("hash", StreamHasher::ALGORITHM);
+
+    QByteArray message = header.encode(peer.target.version);
+    if (peer.target.version >= Protocol::VERSION_2)
+        message.prepend(Protocol::PREAMBLE_V2);
+    peer.dataMark = message.size();
+    peer.socket->write(message);
+    peer.socket->flush();
+
+    peer.state = PeerState::Waiting;
+    peer.timer->start(30000); // 30 second response timeout
+}
+
+/**
+ * @brief Applies a receiver's answer to the header.
+ *
+ * @param index Position of the receiver in the target list
+ */
+void FanoutSender::onReadyRead(int index)
+{
+    Peer &peer = peers[index];
+    if (peer.state != PeerState::Waiting)
+    {
+        // Nothing else is expected from a receiver
+        if (peer.socket)
+            peer.socket->readAll();
+        return;
+    }
+
+    QByteArray message;
+    Protocol::ReadStatus status = Protocol::readMessage(peer.socket, peer.target.version, &message);
+    if (status == Protocol::ReadStatus::Incomplete)
+        return;
+
+    peer.timer->stop();
+    Protocol::TransferReply reply;
+    QByteArray hash;
+    if (status == Protocol::ReadStatus::Complete && Protocol::TransferReply::decode(message, &reply))
+        hash = reply.options.value("hash");
+
+    if (status != Protocol::ReadStatus::Complete || (reply.accepted && !hash.isEmpty() && hash != StreamHasher::ALGORITHM))
+    {
+        failPeer(index);
+    }
+    else if (reply.accepted)
+    {
+        peer.verified = !hash.isEmpty();
+        peer.state = PeerState::Accepted;
+        emit transferAccepted(index);
+    }
+    else
+    {
+        peer.state = PeerState::Done;
+        emit transferRefused(index);
+        closePeer(peer);
+    }
+    pump();
+}
+
+/**
+ * @brief Accounts for written bytes, reports progress and refills.
+ *
+ * @param index Position of the receiver in the target list
+ * @param bytes Number of bytes Qt handed to the operating system
+ */
+void FanoutSender::onBytesWritten(int index, qint64 bytes)
+{
+    Peer &peer = peers[index];
+    peer.flushed += bytes;
+    if (!peer.socket || peer.state != PeerState::Accepted)
+        return;
+
+    peer.window.recordWritten(bytes, peer.socket->bytesToWrite());
+
+    qint64 data = qMax<qint64>(0, peer.flushed - peer.dataMark);
+    int percent = fileSize > 0 ? static_cast<int>(qMin<qint64>(100, data * 100 / fileSize)) : 100;
+    if (percent != peer.lastProgress)
+    {
+        peer.lastProgress = percent;
+        emit sendStatsUpdated(index, peer.window.chunkSize(), peer.window.highWater(), peer.window.throughput());
+        emit progressUpdated(index, percent);
+    }
+
+    if (peer.trailerQueued && peer.socket->bytesToWrite() == 0)
+    {
+        peer.state = PeerState::Done;
+        peer.socket->disconnectFromHost();
+        emit transferFinished(index);
+        pump();
+        return;
+    }
+
+    if (peer.socket->bytesToWrite() <= peer.window.lowWater())
+        pump();
+}
+
+/**
+ * @brief Fails a receiver that closed the connection before the end.
+ *
+ * @param index Position of the receiver in the target list
+ */
+void FanoutSender::onDisconnected(int index)
+{
+    Peer &peer = peers[index];
+    if (peer.state != PeerState::Done)
+    {
+        failPeer(index);
+        pump();
+        return;
+    }
+
+    // Closed after the whole file was flushed
+    if (peer.socket)
+    {
+        peer.socket->deleteLater();
+        peer.socket = nullptr;
+    }
+}
+
+/**
+ * @brief Reports a receiver as failed and closes its connection.
+ *
+ * @param index Position of the receiver in the target list
+ */
+void FanoutSender::failPeer(int index)
+{
+    Peer &peer = peers[index];
+    if (peer.state == PeerState::Done)
+        return;
+
+    peer.state = PeerState::Done;
+    closePeer(peer);
+    emit transferError(index);
+}
+
+void FanoutSender::closePeer(Peer &peer)
+{
+    if (peer.timer)
+        peer.timer->stop();
+    if (peer.socket)
+    {
+        peer.socket->blockSignals(true);
+        if (peer.socket->state() != QAbstractSocket::UnconnectedState)
+            peer.socket->abort();
+        peer.socket->deleteLater();
+        peer.socket = nullptr;
+    }
+}
+
+/**
+ * @brief Moves data from the file to the receivers as far as they allow.
+ *
+ * Streaming starts once no receiver is still connecting or deciding. Each
+ * round queues the held chunks on every receiver below its window, drops
+ * the chunks all of them have queued and reads one more chunk when a
+ * receiver is waiting for it.
+ */
+void FanoutSender::pump()
+{
+    if (!streaming)
+    {
+        for (const Peer &peer : peers)
+        {
+            if (peer.state == PeerState::Connecting || peer.state == PeerState::Waiting)
+                return;
+        }
+        streaming = true;
+
+        for (const Peer &peer : peers)
+        {
+            if (peer.state == PeerState::Accepted && peer.verified && !hasher)
+                hasher = new StreamHasher();
+        }
+    }
+
+    bool progressed = true;
+    while (progressed)
+    {
+        progressed = false;
+        for (int index = 0; index < peers.size(); ++index)
+        {
+            if (feed(index))
+                progressed = true;
+        }
+        releaseChunks();
+        if (readChunk())
+            progressed = true;
+    }
+
+    finishIfResolved();
+}
+
+/**
+ * @brief Queues held chunks on one receiver up to its window.
+ *
+ * The trailer follows the last chunk when the receiver verifies the file.
+ *
+ * @param index Position of the receiver in the target list
+ * @return true if anything was queued or the receiver changed state
+ */
+bool FanoutSender::feed(int index)
+{
+    Peer &peer = peers[index];
+    if (peer.state != PeerState::Accepted || !peer.socket || peer.trailerQueued)
+        return false;
+
+    bool queued = false;
+    while (peer.position < readOffset && peer.socket->bytesToWrite() < peer.window.highWater())
+    {
+        int wait = BandwidthShaper::delay(peer.target.address, &peer.bucket);
+        if (wait > 0)
+        {
+            if (!throttleTimer->isActive())
+                throttleTimer->start(wait);
+            return queued;
+        }
+
+        // Positions move in whole chunks, all of them CHUNK_SIZE but the last
+        const QByteArray &chunk = chunks.at(int((peer.position - chunksStart) / CHUNK_SIZE));
+        if (peer.socket->write(chunk) != chunk.size())
+        {
+            failPeer(index);
+            return true;
+        }
+        peer.position += chunk.size();
+        BandwidthShaper::consume(peer.target.address, &peer.bucket, chunk.size());
+        queued = true;
+    }
+
+    if (peer.position < fileSize)
+        return queued;
+
+    peer.trailerQueued = true;
+    if (peer.verified)
+    {
+        if (hasher)
+        {
+            digest = hasher->result();
+            delete hasher;
+            hasher = nullptr;
+        }
+        QByteArray trailer = Protocol::encodeTrailer(peer.target.version, digest);
+        if (digest.isEmpty() || peer.socket->write(trailer) != trailer.size())
+        {
+            failPeer(index);
+            return true;
+        }
+    }
+
+    // Nothing left to flush, so no bytesWritten() will finish this receiver
+    if (peer.socket->bytesToWrite() == 0)
+    {
+        peer.state = PeerState::Done;
+        peer.socket->disconnectFromHost();
+        emit transferFinished(index);
+    }
+    return true;
+}
+
+/**
+ * @brief Reads the next chunk when a receiver is waiting for it.
+ *
+ * @return true if a chunk was read
+ */
+bool FanoutSender::readChunk()
+{
+    if (readOffset >= fileSize || bufferedBytes >= Config::getFanoutWindow())
+        return false;
+
+    bool wanted = false;
+    for (const Peer &peer : peers)
+    {
+        if (peer.state == PeerState::Accepted && peer.socket && peer.position >= readOffset &&
+            peer.socket->bytesToWrite() < peer.window.highWater())
+            wanted = true;
+    }
+    if (!wanted)
+        return false;
+
+    qint64 length = qMin(CHUNK_SIZE, fileSize - readOffset);
+    QByteArray chunk = BufferPool::acquire(CHUNK_SIZE);
+    if (file->read(chunk.data(), length) != length)
+    {
+        // The file cannot be sent to anyone any more
+        for (int index = 0; index < peers.size(); ++index)
+            failPeer(index);
+        return false;
+    }
+
+    chunk.resize(int(length));
+    if (hasher)
+        hasher->addData(chunk);
+    chunks.append(chunk);
+    readOffset += length;
+    bufferedBytes += length;
+    return true;
+}
+
+/**
+ * @brief Drops the chunks every receiver has queued.
+ *
+ * Watches for a receiver holding the window full; progress of the slowest
+ * receiver restarts the watch.
+ */
+void FanoutSender::releaseChunks()
+{
+    qint64 slowest = readOffset;
+    for (const Peer &peer : peers)
+    {
+        if (peer.state == PeerState::Accepted)
+            slowest = qMin(slowest, peer.position);
+    }
+
+    bool released = false;
+    while (!chunks.isEmpty() && chunksStart + chunks.first().size() <= slowest)
+    {
+        chunksStart += chunks.first().size();
+        bufferedBytes -= chunks.first().size();
+        BufferPool::release(chunks.first());
+        chunks.removeFirst();
+        released = true;
+    }
+
+    if (released)
+        stallTimer->stop();
+    if (!stallTimer->isActive() && bufferedBytes >= Config::getFanoutWindow() && readOffset < fileSize)
+        stallTimer->start(STALL_TIMEOUT);
+}
+
+/**
+ * @brief Fails the receivers that kept the full window from moving.
+ */
+void FanoutSender::dropStalled()
+{
+    for (int index = 0; index < peers.size(); ++index)
+    {
+        if (peers[index].state == PeerState::Accepted && peers[index].position <= chunksStart)
+        {
+            // qDebug() << "FanoutSender: Receiver" << index << "stalled the fan-out";
+            failPeer(index);
+        }
+    }
+    pump();
+}
+
+/**
+ * @brief Emits fanoutFinished() once every receiver is resolved.
+ */
+void FanoutSender::finishIfResolved()
+{
+    if (completed)
+        return;
+
+    for (const Peer &peer : peers)
+    {
+        if (peer.state != PeerState::Done)
+            return;
+    }
+
+    completed = true;
+    throttleTimer->stop();
+    stallTimer->stop();
+    chunks.clear();
+    bufferedBytes = 0;
+    delete hasher;
+    hasher = nullptr;
+    if (file)
+        file->close();
+    emit fanoutFinished();
+}
@@ -0,0 +1,195 @@
+/**
+ * @file fanoutsender.h
+ * @brief Sends one file to many receivers from a single read of the file
+ */
+
+#ifndef FANOUTSENDER_H
+#define FANOUTSENDER_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QFile>
+#include <QList>
+#include "../config/config.h"
+#include "protocol.h"
+#include "sendwindow.h"
+#include "streamhasher.h"
+#include "bandwidthshaper.h"
+
+/**
+ * @brief Address of one receiver of a fan-out.
+ */
+struct FanoutTarget
+{
+    QString address;
+    quint16 port = 0;
+
+    /** Protocol version the receiver advertised. */
+    int version = Protocol::VERSION_1;
+};
+
+/**
+ * @class FanoutSender
+ * @brief Streams one file to several receivers, reading each chunk once.
+ *
+ * Every receiver gets its own connection and header. Once all of them have
+ * answered, the file is read chunk by chunk into a shared list of
+ * implicitly shared buffers and the same chunks are queued on every
+ * accepting connection, so the file is read from disk once however many
+ * receivers there are.
+ *
+ * A chunk is dropped once the slowest receiver has queued it. Reading stops
+ * while the chunks held reach Config::getFanoutWindow(), so a slow receiver
+ * holds the others back instead of growing the buffer. A receiver that
+ * makes no progress for STALL_TIMEOUT while the window is full is dropped
+ * with transferError().
+ *
+ * Fan-out transfers are plain single-connection data: striping, resume,
+ * delta and compression are per-receiver decisions and are not offered.
+ * The file hash is computed once and sent to every receiver that asked.
+ */
+class FanoutSender : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FanoutSender(QObject *parent = nullptr);
+    ~FanoutSender();
+
+    void sendFile(const QString &filePath, const QList<FanoutTarget> &targets);
+
+    /** @brief Number of receivers of the fan-out. */
+    int getRecipientCount() const { return peers.size(); }
+
+    /** @brief Bytes of file data currently held for the receivers. */
+    qint64 getBufferedBytes() const { return bufferedBytes; }
+
+signals:
+    /**
+     * @brief Signal emitted when a receiver accepts the file.
+     * @param index Position of the receiver in the target list
+     */
+    void transferAccepted(int index);
+
+    /** @brief Signal emitted when a receiver declines the file. */
+    void transferRefused(int index);
+
+    /**
+     * @brief Signal emitted when the progress of one receiver changes.
+     * @param index Position of the receiver in the target list
+     * @param percent Completion percentage (0-100)
+     */
+    void progressUpdated(int index, int percent);
+
+    /** @brief Signal emitted once a receiver was sent the whole file. */
+    void transferFinished(int index);
+
+    /** @brief Signal emitted when the transfer to a receiver fails. */
+    void transferError(int index);
+
+    /**
+     * @brief Signal emitted with the send window state of one receiver.
+     * @param index Position of the receiver in the target list
+     * @param chunkSize Current chunk size in bytes.
+     * @param sendWindow Current limit of queued bytes.
+     * @param throughput Measured throughput in bytes per second.
+     */
+    void sendStatsUpdated(int index, qint64 chunkSize, qint64 sendWindow, qint64 throughput);
+
+    /** @brief Signal emitted once every receiver is resolved. */
+    void fanoutFinished();
+
+private:
+    /** Progress of one receiver. */
+    enum class PeerState
+    {
+        Connecting, ///< Connection not established yet
+        Waiting,    ///< Header sent, no answer yet
+        Accepted,   ///< Receiving the file
+        Done        ///< Finished, refused or failed
+    };
+
+    /**
+     * @brief Connection and position of one receiver.
+     */
+    struct Peer
+    {
+        FanoutTarget target;
+        QTcpSocket *socket = nullptr;
+
+        /** Connection timeout, then response timeout. */
+        QTimer *timer = nullptr;
+
+        PeerState state = PeerState::Connecting;
+
+        /** File offset queued on the socket so far. */
+        qint64 position = 0;
+
+        /** Bytes queued before the file data (preamble and header). */
+        qint64 dataMark = 0;
+
+        /** Bytes Qt handed to the operating system. */
+        qint64 flushed = 0;
+
+        /** Whether the receiver asked for the trailer, and whether it is queued. */
+        bool verified = false;
+        bool trailerQueued = false;
+
+        int lastProgress = -1;
+        AdaptiveSendWindow window;
+        TokenBucket bucket;
+    };
+
+    /** Size of each chunk read from the file. */
+    static constexpr qint64 CHUNK_SIZE = 256 * 1024;
+
+    /** Time a receiver may hold the full window back before it is dropped. */
+    static const int STALL_TIMEOUT = 30000;
+
+    void onConnected(int index);
+    void onReadyRead(int index);
+    void onBytesWritten(int index, qint64 bytes);
+    void onDisconnected(int index);
+    void failPeer(int index);
+    void closePeer(Peer &peer);
+    void pump();
+    bool feed(int index);
+    bool readChunk();
+    void releaseChunks();
+    void dropStalled();
+    void finishIfResolved();
+    void clear();
+
+    /** File of the fan-out, open while chunks are read. */
+    QFile *file = nullptr;
+    qint64 fileSize = 0;
+
+    QList<Peer> peers;
+
+    /** Whether every receiver answered and data is being streamed. */
+    bool streaming = false;
+
+    /** Whether fanoutFinished() was emitted. */
+    bool completed = false;
+
+    /** Chunks read and not queued on every receiver yet, in file order. */
+    QList<QByteArray> chunks;
+
+    /** File offset of the first held chunk, and of the end of the last one. */
+    qint64 chunksStart = 0;
+    qint64 readOffset = 0;
+    qint64 bufferedBytes = 0;
+
+    /** Hashes the file once for every receiver that verifies it, null otherwise. */
+    StreamHasher *hasher = nullptr;
+    QByteArray digest;
+
+    /** Timer continuing after a bandwidth cap paused a receiver. */
+    QTimer *throttleTimer;
+
+    /** Timer dropping the slowest receiver while it holds the window full. */
+    QTimer *stallTimer;
+};
+
+#endif // FANOUTSENDER_H
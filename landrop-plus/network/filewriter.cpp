@@ -0,0 +1,286 @@
+/**
+ * @file filewriter.cpp
+ */
+
+#include "filewriter.h"
+#include "diskio.h"
+#include "bufferpool.h"
+#include "../config/config.h"
+#include <QMutexLocker>
+
+#if defined(Q_OS_LINUX)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#elif defined(Q_OS_WIN)
+#include <windows.h>
+#include <io.h>
+#elif defined(Q_OS_UNIX)
+#include <unistd.h>
+#endif
+
+/**
+ * @param filePath Destination file, already created by the receiver
+ * @param expectedSize Announced size the file is preallocated to
+ * @param durability One of Durability, -1 for Config::getWriteDurability()
+ */
+FileWriter::FileWriter(const QString &filePath, qint64 expectedSize, int durability)
+    : file(filePath),
+      durability(durability >= 0 ? durability : Config::getWriteDurability()),
+      syncInterval(qint64(Config::getDurabilityInterval()) * 1024 * 1024),
+      maxWriting(qMax(1, Config::getDiskQueueDepth()))
+{
+    // Unbuffered, the runs are the buffers
+    if (!file.open(QIODevice::ReadWrite | QIODevice::Unbuffered))
+    {
+        failed.storeRelaxed(1);
+        return;
+    }
+    preallocate(file, expectedSize);
+}
+
+/**
+ * @brief Waits for the pool thread to finish with this writer.
+ *
+ * Collected data is dropped; finish() writes it.
+ */
+FileWriter::~FileWriter()
+{
+    QMutexLocker lock(&mutex);
+    while (writing > 0)
+        changed.wait(&mutex);
+}
+
+/**
+ * @brief Queues a block at its absolute file offset.
+ *
+ * @param offset File offset of the first byte
+ * @param data Block to write, must not be raw data that is reused afterwards
+ * @return false once a write failed
+ */
+bool FileWriter::write(qint64 offset, const QByteArray &data)
+{
+    if (hasFailed())
+        return false;
+    if (data.isEmpty())
+        return true;
+
+    for (int i = 0; i < runs.size(); ++i)
+    {
+        Run &run = runs[i];
+        if (run.offset + run.data.size() != offset)
+            continue;
+
+        // A full run is written and the block starts the next one
+        if (run.data.size() + data.size() > BUFFER_SIZE)
+        {
+            submit(runs.takeAt(i));
+            break;
+        }
+
+        run.data.append(data);
+        if (run.data.size() >= BUFFER_SIZE)
+            submit(runs.takeAt(i));
+        return true;
+    }
+
+    if (runs.size() >= MAX_RUNS)
+        submit(runs.takeFirst());
+
+    Run run;
+    run.offset = offset;
+    run.data = BufferPool::acquire(BUFFER_SIZE);
+    run.data.resize(0);
+    run.data.append(data);
+    runs.append(run);
+    return true;
+}
+
+/**
+ * @brief Writes every collected run and waits until the disk has them.
+ *
+ * Called before the file is read back from another handle.
+ */
+void FileWriter::waitForWritten()
+{
+    while (!runs.isEmpty())
+        submit(runs.takeFirst());
+
+    QMutexLocker lock(&mutex);
+    while (writing > 0)
+        changed.wait(&mutex);
+}
+
+/**
+ * @brief Writes what is left and closes the file.
+ *
+ * A complete file is synced once committed, along with the others
+ * completing at the same time (see GroupCommit).
+ *
+ * @return false if a write failed
+ */
+bool FileWriter::finish()
+{
+    waitForWritten();
+
+    QMutexLocker lock(&mutex);
+    if (file.isOpen())
+        file.close();
+    return !failed.loadRelaxed();
+}
+
+/**
+ * @brief End of the written data that continues from @p offset.
+ *
+ * Data still collected or queued does not count, so the result is safe to
+ * record as a resume point.
+ */
+qint64 FileWriter::writtenUpTo(qint64 offset)
+{
+    QMutexLocker lock(&mutex);
+    auto it = written.upperBound(offset);
+    if (it == written.begin())
+        return offset;
+    --it;
+    return qMax(offset, it.value());
+}
+
+bool FileWriter::hasFailed()
+{
+    return failed.loadRelaxed();
+}
+
+void FileWriter::submit(const Run &run)
+{
+    QMutexLocker lock(&mutex);
+    while (queuedBytes > MAX_QUEUED)
+        changed.wait(&mutex);
+
+    queue.append(run);
+    queuedBytes += run.data.size();
+    // One more write in flight for each run waiting, up to the queue depth
+    if (writing < maxWriting && writing < queue.size())
+    {
+        ++writing;
+        DiskIo::pool()->start([this]()
+                              { drain(); });
+    }
+}
+
+/**
+ * @brief Writes queued runs until the queue is empty.
+ *
+ * Several of these run at once when data arrives faster than one write
+ * completes; the positional writes do not share a file position.
+ */
+void FileWriter::drain()
+{
+    for (;;)
+    {
+        Run item;
+        {
+            QMutexLocker lock(&mutex);
+            if (queue.isEmpty() || failed.loadRelaxed())
+            {
+                for (const Run &dropped : queue)
+                    queuedBytes -= dropped.data.size();
+                queue.clear();
+                --writing;
+                changed.wakeAll();
+                return;
+            }
+            item = queue.takeFirst();
+        }
+
+        bool ok = DiskIo::writeAt(file.handle(), item.offset, item.data.constData(), item.data.size());
+        bool sync = false;
+        {
+            QMutexLocker lock(&mutex);
+            unsynced += item.data.size();
+            if (ok && durability == DurableInterval && unsynced >= syncInterval)
+            {
+                sync = true;
+                unsynced = 0;
+            }
+        }
+        if (sync)
+            ok = syncToDisk(file);
+
+        QMutexLocker lock(&mutex);
+        if (!ok)
+        {
+            failed.storeRelaxed(1);
+        }
+        else
+        {
+            // Merge with the ranges it touches
+            qint64 start = item.offset;
+            qint64 end = item.offset + item.data.size();
+            auto it = written.upperBound(start);
+            if (it != written.begin())
+            {
+                auto before = it;
+                --before;
+                if (before.value() >= start)
+                    it = before;
+            }
+            while (it != written.end() && it.key() <= end)
+            {
+                start = qMin(start, it.key());
+                end = qMax(end, it.value());
+                it = written.erase(it);
+            }
+            written.insert(start, end);
+        }
+        queuedBytes -= item.data.size();
+        BufferPool::release(item.data);
+        changed.wakeAll();
+    }
+}
+
+/**
+ * @brief Reserves disk space for a file without changing its size.
+ *
+ * @return false if the platform has no way to do it or it failed
+ */
+bool FileWriter::preallocate(QFile &file, qint64 size)
+{
+    if (size <= 0 || file.handle() < 0)
+        return false;
+
+#if defined(Q_OS_LINUX)
+    int result;
+    do {
+        result = ::fallocate(file.handle(), FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size));
+    } while (result < 0 && errno == EINTR);
+    return result == 0;
+#elif defined(Q_OS_WIN)
+    // SetFileValidData needs a privilege, the allocation size only reserves clusters
+    HANDLE fileHandle = reinterpret_cast<HANDLE>(_get_osfhandle(file.handle()));
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return false;
+    FILE_ALLOCATION_INFO allocation;
+    allocation.AllocationSize.QuadPart = size;
+    return SetFileInformationByHandle(fileHandle, FileAllocationInfo, &allocation, sizeof(allocation)) != 0;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Forces written data of a file to the disk.
+ */
+bool FileWriter::syncToDisk(QFile &file)
+{
+    if (file.handle() < 0)
+        return false;
+
+#if defined(Q_OS_WIN)
+    HANDLE fileHandle = reinterpret_cast<HANDLE>(_get_osfhandle(file.handle()));
+    return fileHandle != INVALID_HANDLE_VALUE && FlushFileBuffers(fileHandle) != 0;
+#elif defined(Q_OS_UNIX)
+    return ::fsync(file.handle()) == 0;
+#else
+    return file.flush();
+#endif
+}
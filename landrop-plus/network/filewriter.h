@@ -0,0 +1,110 @@
+/**
+ * @file filewriter.h
+ * @brief Write-behind stage between received data and the destination file
+ */
+
+#ifndef FILEWRITER_H
+#define FILEWRITER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QMap>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QString>
+#include <QWaitCondition>
+
+/**
+ * @class FileWriter
+ * @brief Collects received blocks into large buffers and writes them on a pool thread.
+ *
+ * The connection's thread only appends to a buffer per contiguous run of
+ * offsets (one per stripe connection), so a fast link costs one write call
+ * per BUFFER_SIZE bytes instead of one per readyRead. Full buffers are
+ * written through a handle of their own on the disk threads (see DiskIo),
+ * up to Config::getDiskQueueDepth() of them at once.
+ * Queued data is bounded, so a slow disk throttles the transfer instead of
+ * growing without limit.
+ *
+ * The destination is preallocated to the announced size without changing
+ * its length (fallocate(FALLOC_FL_KEEP_SIZE) on Linux, the allocation size
+ * on Windows), so a partial file still ends where its data ends.
+ *
+ * How received data is made durable follows Config::getWriteDurability();
+ * the sync of a complete file is left to GroupCommit.
+ */
+class FileWriter
+{
+public:
+    /** When written data is forced to the disk. */
+    enum Durability
+    {
+        DurableNever = 0,        ///< Left to the operating system
+        DurableOnCompletion = 1, ///< Once, when the file is complete and committed
+        DurableInterval = 2      ///< Every Config::getDurabilityInterval() MiB, and on completion
+    };
+
+    FileWriter(const QString &filePath, qint64 expectedSize, int durability = -1);
+    ~FileWriter();
+
+    bool write(qint64 offset, const QByteArray &data);
+    void waitForWritten();
+    bool finish();
+    qint64 writtenUpTo(qint64 offset);
+
+    /** @brief Whether a write failed, the file is then incomplete. */
+    bool hasFailed();
+
+    static bool preallocate(QFile &file, qint64 size);
+    static bool syncToDisk(QFile &file);
+
+    /** Bytes collected per run before it is written. */
+    static const qint64 BUFFER_SIZE = 4 * 1024 * 1024;
+
+private:
+    /** Bytes queued before write() waits for the disk. */
+    static const qint64 MAX_QUEUED = 64 * 1024 * 1024;
+
+    /** Runs collected at once, more come from out of order data. */
+    static const int MAX_RUNS = 16;
+
+    /** Data of consecutive offsets. */
+    struct Run
+    {
+        qint64 offset = 0;
+        QByteArray data;
+    };
+
+    void submit(const Run &run);
+    void drain();
+
+    QFile file;
+    int durability;
+    qint64 syncInterval;
+
+    /** Writes kept in flight at most */
+    int maxWriting;
+
+    /** Runs being collected, only used by the connection's thread */
+    QList<Run> runs;
+
+    QMutex mutex;
+    QWaitCondition changed;
+    QList<Run> queue;
+    qint64 queuedBytes = 0;
+
+    /** Writers running on the disk threads */
+    int writing = 0;
+
+    /** Set by the disk threads, read by write() without taking the mutex */
+    QAtomicInt failed;
+
+    /** Written ranges, start to end, merged when they touch */
+    QMap<qint64, qint64> written;
+
+    /** Bytes written since the last sync */
+    qint64 unsynced = 0;
+};
+
+#endif // FILEWRITER_H
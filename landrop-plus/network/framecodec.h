@@ -0,0 +1,120 @@
+/**
+ * @file framecodec.h
+ * @brief Fixed-layout codecs for the frames of protocol version 2
+ */
+
+#ifndef FRAMECODEC_H
+#define FRAMECODEC_H
+
+#include <QByteArray>
+#include <QtGlobal>
+#include <type_traits>
+
+/**
+ * @namespace FrameCodec
+ * @brief Encodes and decodes frames whose payload is a fixed list of big-endian numbers.
+ *
+ * A layout is a list of field types; its size and the offset of every
+ * field are constants, so reading one is a bounds check and a few loads
+ * with no allocation. Numbers are assembled with shifts, which compilers
+ * turn into a plain load (and a byte swap on little-endian hosts), and
+ * which also work in constant expressions.
+ *
+ * Protocol uses these for the fixed part of its frames; variable fields
+ * (strings, options) still go through its own reader.
+ */
+namespace FrameCodec
+{
+    /** @brief Reads a big-endian number. */
+    template <typename T>
+    constexpr T load(const char *data)
+    {
+        static_assert(std::is_integral<T>::value, "fields are integers");
+        typedef typename std::make_unsigned<T>::type Unsigned;
+        Unsigned value = 0;
+        for (int i = 0; i < int(sizeof(T)); ++i)
+            value = Unsigned((value << 8) | Unsigned(quint8(data[i])));
+        return T(value);
+    }
+
+    /** @brief Writes a big-endian number. */
+    template <typename T>
+    constexpr void store(char *data, T value)
+    {
+        static_assert(std::is_integral<T>::value, "fields are integers");
+        typedef typename std::make_unsigned<T>::type Unsigned;
+        Unsigned bits = Unsigned(value);
+        for (int i = int(sizeof(T)) - 1; i >= 0; --i)
+        {
+            data[i] = char(quint8(bits & 0xff));
+            bits = Unsigned(bits >> 8);
+        }
+    }
+
+    /**
+     * @brief Consecutive big-endian fields of the given types, without padding.
+     */
+    template <typename... Fields>
+    struct Layout
+    {
+        /** Bytes taken by the fields */
+        static constexpr int SIZE = (0 + ... + int(sizeof(Fields)));
+
+        /** @brief Writes the fields at @p out, which holds SIZE bytes. */
+        static constexpr void write(char *out, Fields... values)
+        {
+            int at = 0;
+            ((store<Fields>(out + at, values), at += int(sizeof(Fields))), ...);
+        }
+
+        /**
+         * @brief Reads the fields from the start of @p data.
+         * @return false if @p size is shorter than SIZE, the fields are left as they were then
+         */
+        static constexpr bool read(const char *data, qsizetype size, Fields &...values)
+        {
+            if (size < SIZE)
+                return false;
+            int at = 0;
+            ((values = load<Fields>(data + at), at += int(sizeof(Fields))), ...);
+            return true;
+        }
+    };
+
+    /** Type byte and payload length in front of every frame. */
+    typedef Layout<quint8, quint32> Prefix;
+
+    /**
+     * @brief Frame of type @p Type whose payload is the fields given.
+     *
+     * Decoding takes a message as Protocol::readMessage() returns it: the
+     * type byte then the payload. Bytes after the fields are allowed, so a
+     * longer layout can add fields to a shorter one.
+     */
+    template <quint8 Type, typename... Fields>
+    struct Frame
+    {
+        typedef Layout<Fields...> Payload;
+
+        /** Bytes of the message, type byte included */
+        static constexpr int MESSAGE_SIZE = 1 + Payload::SIZE;
+
+        /** @brief Whole frame, prefix included, in one allocation. */
+        static QByteArray encode(Fields... values)
+        {
+            QByteArray out(Prefix::SIZE + Payload::SIZE, Qt::Uninitialized);
+            Prefix::write(out.data(), Type, quint32(Payload::SIZE));
+            Payload::write(out.data() + Prefix::SIZE, values...);
+            return out;
+        }
+
+        /** @return false if @p message is not of this type or too short */
+        static bool decode(const QByteArray &message, Fields &...values)
+        {
+            return !message.isEmpty() && quint8(message.at(0)) == Type &&
+                   Payload::read(message.constData() + 1, message.size() - 1, values...);
+        }
+    };
+}
+
+#endif // FRAMECODEC_H
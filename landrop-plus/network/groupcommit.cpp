@@ -0,0 +1,171 @@
+/**
+ * @file groupcommit.cpp
+ */
+
+#include "groupcommit.h"
+#include "filewriter.h"
+#include "../config/config.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPointer>
+#include <QSet>
+#include <QThread>
+#include <QThreadPool>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#elif defined(Q_OS_UNIX)
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+const QString GroupCommit::PART_SUFFIX = ".part";
+
+namespace
+{
+    /** One file waiting for the next batch. */
+    struct Entry
+    {
+        QString filePath;
+        QPointer<QObject> context;
+        std::function<void(bool)> done;
+    };
+
+    QMutex commitMutex;
+    QList<Entry> batch;
+    bool scheduled = false;
+
+    /**
+     * @brief Single thread running the batches, so their order is kept and disk threads are not held up.
+     */
+    QThreadPool *commitPool()
+    {
+        static QThreadPool *pool = []()
+        {
+            QThreadPool *created = new QThreadPool();
+            created->setMaxThreadCount(1);
+            return created;
+        }();
+        return pool;
+    }
+
+    bool syncFile(const QString &filePath)
+    {
+        // Windows only flushes through a handle open for writing
+        QFile file(filePath);
+        return file.open(QIODevice::ReadWrite) && FileWriter::syncToDisk(file);
+    }
+
+    /**
+     * @brief Makes the renames in a directory durable.
+     */
+    bool syncDirectory(const QString &path)
+    {
+#if defined(Q_OS_UNIX)
+        int descriptor = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_DIRECTORY);
+        if (descriptor < 0)
+            return false;
+        bool synced = ::fsync(descriptor) == 0;
+        ::close(descriptor);
+        return synced;
+#else
+        // MOVEFILE_WRITE_THROUGH already waited for the rename
+        Q_UNUSED(path);
+        return true;
+#endif
+    }
+
+    void commitBatch()
+    {
+        QThread::msleep(qMax(0, Config::getCommitWindow()));
+
+        QList<Entry> entries;
+        {
+            QMutexLocker lock(&commitMutex);
+            entries.swap(batch);
+            scheduled = false;
+        }
+
+        bool durable = Config::getWriteDurability() != FileWriter::DurableNever;
+        QList<bool> results;
+        QSet<QString> directories;
+        for (const Entry &entry : entries)
+        {
+            bool ok = !durable || syncFile(entry.filePath);
+            if (ok && GroupCommit::isPart(entry.filePath))
+                ok = GroupCommit::renameOver(entry.filePath, GroupCommit::finalPath(entry.filePath));
+            if (ok)
+                directories.insert(QFileInfo(entry.filePath).absolutePath());
+            results.append(ok);
+        }
+
+        bool directoriesSynced = true;
+        if (durable)
+        {
+            for (const QString &directory : directories)
+                directoriesSynced = syncDirectory(directory) && directoriesSynced;
+        }
+
+        for (int i = 0; i < entries.size(); ++i)
+        {
+            const Entry &entry = entries[i];
+            if (!entry.context)
+                continue;
+            bool ok = results[i] && directoriesSynced;
+            std::function<void(bool)> done = entry.done;
+            QMetaObject::invokeMethod(entry.context, [done, ok]()
+                                      { done(ok); }, Qt::QueuedConnection);
+        }
+    }
+}
+
+QString GroupCommit::partPath(const QString &filePath)
+{
+    return filePath + PART_SUFFIX;
+}
+
+bool GroupCommit::isPart(const QString &filePath)
+{
+    return filePath.endsWith(PART_SUFFIX);
+}
+
+QString GroupCommit::finalPath(const QString &partPath)
+{
+    return isPart(partPath) ? partPath.left(partPath.size() - PART_SUFFIX.size()) : partPath;
+}
+
+void GroupCommit::submit(const QString &filePath, QObject *context, const std::function<void(bool)> &done)
+{
+    Entry entry;
+    entry.filePath = filePath;
+    entry.context = context;
+    entry.done = done;
+
+    QMutexLocker lock(&commitMutex);
+    batch.append(entry);
+    if (scheduled)
+        return;
+
+    // The first file of a batch waits for the others completing right after it
+    scheduled = true;
+    commitPool()->start(commitBatch);
+}
+
+bool GroupCommit::renameOver(const QString &source, const QString &target)
+{
+#if defined(Q_OS_WIN)
+    return MoveFileExW(reinterpret_cast<LPCWSTR>(QDir::toNativeSeparators(source).utf16()),
+                       reinterpret_cast<LPCWSTR>(QDir::toNativeSeparators(target).utf16()),
+                       MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#elif defined(Q_OS_UNIX)
+    return ::rename(QFile::encodeName(source).constData(), QFile::encodeName(target).constData()) == 0;
+#else
+    QFile::remove(target);
+    return QFile::rename(source, target);
+#endif
+}
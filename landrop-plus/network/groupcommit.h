@@ -0,0 +1,60 @@
+/**
+ * @file groupcommit.h
+ * @brief Received files staged under a temporary name, synced and renamed in batches
+ */
+
+#ifndef GROUPCOMMIT_H
+#define GROUPCOMMIT_H
+
+#include <QObject>
+#include <QString>
+#include <functional>
+
+/**
+ * @namespace GroupCommit
+ * @brief Makes completed files durable and visible under their name, several at once.
+ *
+ * A file is received as "<name>.part" (see partPath()), so other tools never
+ * see a half-written file under its final name. Once it is complete and
+ * verified, submit() queues it: files completing within
+ * Config::getCommitWindow() of the first one are synced to the disk one
+ * after the other on a commit thread, renamed over their final names, and
+ * each directory is synced once for all its renames. A burst of small files
+ * thus costs one directory sync per batch rather than a sync per file, and
+ * a crash leaves either the previous copy or the complete new one.
+ *
+ * Syncing follows Config::getWriteDurability(); with durability off the
+ * files are only renamed.
+ */
+namespace GroupCommit
+{
+    /** Suffix of a file still being received. */
+    extern const QString PART_SUFFIX;
+
+    /** @brief Name a file is received under until it is committed. */
+    QString partPath(const QString &filePath);
+
+    /** @brief Whether @p filePath names a file still being received. */
+    bool isPart(const QString &filePath);
+
+    /** @brief Name a staged file gets once committed. */
+    QString finalPath(const QString &partPath);
+
+    /**
+     * @brief Queues a complete, closed file to be synced and renamed with the next batch.
+     *
+     * @param filePath Staged file, or a file written in place which is only synced
+     * @param context Object in whose thread @p done runs, it is not called once the object is gone
+     * @param done Called with whether the file reached the disk under its final name
+     */
+    void submit(const QString &filePath, QObject *context, const std::function<void(bool)> &done);
+
+    /**
+     * @brief Replaces @p target with @p source in one step.
+     *
+     * @return false if the file could not be renamed
+     */
+    bool renameOver(const QString &source, const QString &target);
+}
+
+#endif // GROUPCOMMIT_H
@@ -0,0 +1,266 @@
+/**
+ * @file mdns.cpp
+ */
+
+#include "mdns.h"
+#include <QtEndian>
+
+const QHostAddress Mdns::GROUP = QHostAddress(QStringLiteral("224.0.0.251"));
+
+namespace
+{
+    /** Compression pointers followed per name at most, against loops. */
+    const int MAX_JUMPS = 16;
+
+    template <typename T>
+    void appendNumber(QByteArray &out, T value)
+    {
+        char field[sizeof(T)];
+        qToBigEndian<T>(value, field);
+        out.append(field, sizeof(T));
+    }
+
+    void appendName(QByteArray &out, const QByteArray &name)
+    {
+        for (const QByteArray &label : name.split('.'))
+        {
+            if (label.isEmpty())
+                continue;
+            QByteArray bounded = label.left(63);
+            out.append(char(bounded.size()));
+            out.append(bounded);
+        }
+        out.append('\0');
+    }
+
+    /**
+     * @brief Reads the fields of a message in order, failing on truncation.
+     */
+    class MessageReader
+    {
+    public:
+        explicit MessageReader(const QByteArray &message) : data(message) {}
+
+        template <typename T>
+        T number()
+        {
+            if (!ok || data.size() - pos < int(sizeof(T)))
+            {
+                ok = false;
+                return 0;
+            }
+            T value = qFromBigEndian<T>(data.constData() + pos);
+            pos += sizeof(T);
+            return value;
+        }
+
+        QByteArray bytes(int length)
+        {
+            if (!ok || length < 0 || data.size() - pos < length)
+            {
+                ok = false;
+                return QByteArray();
+            }
+            QByteArray value = data.mid(pos, length);
+            pos += length;
+            return value;
+        }
+
+        /**
+         * @brief Reads a name, following compression pointers.
+         */
+        QByteArray name()
+        {
+            QByteArray result;
+            int at = pos;
+            int jumps = 0;
+            bool jumped = false;
+            while (ok)
+            {
+                if (at >= data.size())
+                {
+                    ok = false;
+                    break;
+                }
+                quint8 length = quint8(data.at(at));
+                if ((length & 0xc0) == 0xc0)
+                {
+                    if (at + 1 >= data.size() || ++jumps > MAX_JUMPS)
+                    {
+                        ok = false;
+                        break;
+                    }
+                    int target = ((length & 0x3f) << 8) | quint8(data.at(at + 1));
+                    if (!jumped)
+                        pos = at + 2;
+                    jumped = true;
+                    at = target;
+                    continue;
+                }
+                if (length == 0)
+                {
+                    if (!jumped)
+                        pos = at + 1;
+                    break;
+                }
+                if (length > 63 || at + 1 + length > data.size())
+                {
+                    ok = false;
+                    break;
+                }
+                if (!result.isEmpty())
+                    result.append('.');
+                result.append(data.constData() + at + 1, length);
+                at += 1 + length;
+            }
+            return result;
+        }
+
+        int position() const { return pos; }
+        void seek(int position) { pos = position; }
+        bool valid() const { return ok; }
+
+    private:
+        const QByteArray &data;
+        int pos = 0;
+        bool ok = true;
+    };
+}
+
+bool Mdns::sameName(const QByteArray &a, const QByteArray &b)
+{
+    return a.compare(b, Qt::CaseInsensitive) == 0;
+}
+
+QByteArray Mdns::Message::encode() const
+{
+    QByteArray out;
+    appendNumber<quint16>(out, 0);
+    appendNumber<quint16>(out, response ? 0x8400 : 0); // response, authoritative
+    appendNumber<quint16>(out, quint16(questions.size()));
+    appendNumber<quint16>(out, quint16(records.size()));
+    appendNumber<quint16>(out, 0);
+    appendNumber<quint16>(out, 0);
+
+    for (const Question &question : questions)
+    {
+        appendName(out, question.name);
+        appendNumber<quint16>(out, question.type);
+        appendNumber<quint16>(out, CLASS_IN);
+    }
+
+    for (const Record &record : records)
+    {
+        appendName(out, record.name);
+        appendNumber<quint16>(out, record.type);
+        appendNumber<quint16>(out, CLASS_IN | (record.cacheFlush ? CACHE_FLUSH : 0));
+        appendNumber<quint32>(out, record.ttl);
+
+        QByteArray rdata;
+        switch (record.type)
+        {
+        case TYPE_PTR:
+            appendName(rdata, record.target);
+            break;
+        case TYPE_SRV:
+            appendNumber<quint16>(rdata, 0); // priority
+            appendNumber<quint16>(rdata, 0); // weight
+            appendNumber<quint16>(rdata, record.port);
+            appendName(rdata, record.target);
+            break;
+        case TYPE_TXT:
+            for (auto it = record.txt.constBegin(); it != record.txt.constEnd(); ++it)
+            {
+                QByteArray entry = (it.key() + '=' + it.value()).left(255);
+                rdata.append(char(entry.size()));
+                rdata.append(entry);
+            }
+            if (rdata.isEmpty())
+                rdata.append('\0');
+            break;
+        case TYPE_A:
+            appendNumber<quint32>(rdata, record.address.toIPv4Address());
+            break;
+        }
+        appendNumber<quint16>(out, quint16(rdata.size()));
+        out.append(rdata);
+    }
+    return out;
+}
+
+bool Mdns::Message::decode(const QByteArray &data, Message *message)
+{
+    MessageReader reader(data);
+    reader.number<quint16>(); // id
+    quint16 flags = reader.number<quint16>();
+    quint16 questionCount = reader.number<quint16>();
+    int recordCount = reader.number<quint16>();
+    recordCount += reader.number<quint16>();
+    recordCount += reader.number<quint16>();
+    if (!reader.valid())
+        return false;
+
+    message->response = flags & 0x8000;
+    message->questions.clear();
+    message->records.clear();
+
+    for (int i = 0; i < questionCount && reader.valid(); ++i)
+    {
+        Question question;
+        question.name = reader.name();
+        question.type = reader.number<quint16>();
+        reader.number<quint16>(); // class, unicast response bit
+        message->questions.append(question);
+    }
+
+    for (int i = 0; i < recordCount && reader.valid(); ++i)
+    {
+        Record record;
+        record.name = reader.name();
+        record.type = reader.number<quint16>();
+        record.cacheFlush = reader.number<quint16>() & CACHE_FLUSH;
+        record.ttl = reader.number<quint32>();
+        quint16 length = reader.number<quint16>();
+        int end = reader.position() + length;
+        if (!reader.valid() || end > data.size())
+            return false;
+
+        bool known = true;
+        switch (record.type)
+        {
+        case TYPE_PTR:
+            record.target = reader.name();
+            break;
+        case TYPE_SRV:
+            reader.number<quint16>();
+            reader.number<quint16>();
+            record.port = reader.number<quint16>();
+            record.target = reader.name();
+            break;
+        case TYPE_TXT:
+            while (reader.valid() && reader.position() < end)
+            {
+                QByteArray entry = reader.bytes(reader.number<quint8>());
+                int equals = entry.indexOf('=');
+                if (equals > 0)
+                    record.txt.insert(entry.left(equals).toLower(), entry.mid(equals + 1));
+                else if (!entry.isEmpty())
+                    record.txt.insert(entry.toLower(), QByteArray());
+            }
+            break;
+        case TYPE_A:
+            if (length != 4)
+                return false;
+            record.address = QHostAddress(reader.number<quint32>());
+            break;
+        default:
+            known = false;
+            break;
+        }
+
+        reader.seek(end);
+        if (known)
+            message->records.append(record);
+    }
+    return reader.valid();
+}
@@ -0,0 +1,100 @@
+/**
+ * @file mdns.h
+ * @brief Wire format of multicast DNS messages
+ */
+
+#ifndef MDNS_H
+#define MDNS_H
+
+#include <QByteArray>
+#include <QHostAddress>
+#include <QList>
+#include <QMap>
+
+/**
+ * @namespace Mdns
+ * @brief Multicast DNS (RFC 6762) messages used for DNS-SD (RFC 6763).
+ *
+ * Only the records DNS-SD needs are read: PTR, SRV, TXT and A. Names are
+ * dotted, without the trailing dot, and compared case-insensitively.
+ * Compressed names are read but never written, LANDrop messages are small.
+ */
+namespace Mdns
+{
+    /** IPv4 multicast group and port of mDNS. */
+    extern const QHostAddress GROUP;
+    const quint16 PORT = 5353;
+
+    enum RecordType : quint16
+    {
+        TYPE_A = 1,
+        TYPE_PTR = 12,
+        TYPE_TXT = 16,
+        TYPE_SRV = 33,
+        TYPE_ANY = 255
+    };
+
+    const quint16 CLASS_IN = 1;
+
+    /** Class bit of records replacing every cached record of their name and type. */
+    const quint16 CACHE_FLUSH = 0x8000;
+
+    /** Largest message read or written, as for a single Ethernet frame. */
+    const int MAX_MESSAGE = 9000;
+
+    struct Question
+    {
+        QByteArray name;
+        quint16 type = TYPE_ANY;
+    };
+
+    /**
+     * @brief One resource record, with the fields of its type decoded.
+     */
+    struct Record
+    {
+        QByteArray name;
+        quint16 type = TYPE_A;
+
+        /** Seconds the record can be cached, 0 to withdraw it. */
+        quint32 ttl = 0;
+
+        /** Whether caches drop other records of the name and type. */
+        bool cacheFlush = false;
+
+        /** PTR: instance name. SRV: host name. */
+        QByteArray target;
+
+        /** SRV: service port. */
+        quint16 port = 0;
+
+        /** TXT: key=value strings. */
+        QMap<QByteArray, QByteArray> txt;
+
+        /** A: host address. */
+        QHostAddress address;
+    };
+
+    /**
+     * @brief Queries or response with every record section merged.
+     */
+    struct Message
+    {
+        bool response = false;
+        QList<Question> questions;
+        QList<Record> records;
+
+        QByteArray encode() const;
+
+        /**
+         * @brief Reads a message, skipping records of other types.
+         * @return false if it is malformed
+         */
+        static bool decode(const QByteArray &data, Message *message);
+    };
+
+    /** @brief Whether two names are equal, ignoring ASCII case. */
+    bool sameName(const QByteArray &a, const QByteArray &b);
+}
+
+#endif // MDNS_H
@@ -0,0 +1,193 @@
+/**
+ * @file multicast.cpp
+ */
+
+#include "multicast.h"
+#include "datagramtransport.h"
+#include <QNetworkDatagram>
+#include <QtEndian>
+
+const QByteArray Multicast::MAGIC = "LDMC";
+
+quint32 Multicast::Channel::blockCount(qint64 fileSize) const
+{
+    if (blockSize <= 0 || fileSize <= 0)
+        return 0;
+    return quint32((fileSize + blockSize - 1) / blockSize);
+}
+
+QByteArray Multicast::Channel::encode() const
+{
+    return group.toString().toUtf8() + '/' + QByteArray::number(port) + '/' +
+           QByteArray::number(token) + '/' + QByteArray::number(blockSize);
+}
+
+/**
+ * @brief Parses the "mcast" option of a transfer header.
+ * @return false unless it names a multicast group, a port and a usable block size
+ */
+bool Multicast::Channel::decode(const QByteArray &option, Channel *channel)
+{
+    QList<QByteArray> parts = option.split('/');
+    if (parts.size() != 4)
+        return false;
+
+    bool portOk = false;
+    bool tokenOk = false;
+    bool sizeOk = false;
+    channel->group = QHostAddress(QString::fromUtf8(parts[0]));
+    channel->port = parts[1].toUShort(&portOk);
+    channel->token = parts[2].toUInt(&tokenOk);
+    channel->blockSize = parts[3].toInt(&sizeOk);
+    return portOk && tokenOk && sizeOk && channel->port != 0 && channel->group.isMulticast() &&
+           channel->blockSize > 0 && channel->blockSize <= 65507 - HEADER_SIZE;
+}
+
+QByteArray Multicast::encodeBlock(quint32 token, quint32 index, const QByteArray &data)
+{
+    QByteArray datagram;
+    datagram.reserve(HEADER_SIZE + data.size());
+    datagram.append(MAGIC);
+    char field[4];
+    qToBigEndian<quint32>(token, field);
+    datagram.append(field, 4);
+    qToBigEndian<quint32>(index, field);
+    datagram.append(field, 4);
+    datagram.append(data);
+    return datagram;
+}
+
+bool Multicast::decodeBlock(const QByteArray &datagram, quint32 *token, quint32 *index, QByteArray *data)
+{
+    if (datagram.size() <= HEADER_SIZE || !datagram.startsWith(MAGIC))
+        return false;
+
+    *token = qFromBigEndian<quint32>(datagram.constData() + 4);
+    *index = qFromBigEndian<quint32>(datagram.constData() + 8);
+    *data = datagram.mid(HEADER_SIZE);
+    return true;
+}
+
+/**
+ * @param file Open destination file, blocks are written at their offset
+ * @param fileSize Size of the complete file
+ * @param channel Multicast transfer to join
+ * @param parent Parent QObject
+ */
+MulticastReceiver::MulticastReceiver(QFile *file, qint64 fileSize, const Multicast::Channel &channel, QObject *parent)
+    : QObject(parent),
+      socket(new QUdpSocket(this)),
+      file(file),
+      fileSize(fileSize),
+      channel(channel),
+      blocks(int(channel.blockCount(fileSize)), false),
+      missingBlocks(channel.blockCount(fileSize))
+{
+    connect(socket, &QUdpSocket::readyRead, this, &MulticastReceiver::onReadyRead);
+}
+
+bool MulticastReceiver::isUnicast() const
+{
+    return !channel.group.isMulticast();
+}
+
+/**
+ * @brief Binds the shared multicast port and joins the group, or binds a free port for unicast blocks.
+ *
+ * @return false if the group cannot be joined; the file then has to be sent over TCP
+ */
+bool MulticastReceiver::open()
+{
+    if (isUnicast())
+    {
+        if (!socket->bind(QHostAddress(QHostAddress::AnyIPv4), 0))
+            return false;
+        socket->setSocketOption(QAbstractSocket::ReceiveBufferSizeSocketOption, SOCKET_BUFFER);
+        return true;
+    }
+
+    QHostAddress any = channel.group.protocol() == QAbstractSocket::IPv6Protocol ? QHostAddress::AnyIPv6 : QHostAddress::AnyIPv4;
+    if (!socket->bind(any, channel.port, QUdpSocket::ShareAddress | QUdpSocket::ReuseAddressHint))
+        return false;
+    if (!socket->joinMulticastGroup(channel.group))
+    {
+        socket->close();
+        return false;
+    }
+    socket->setSocketOption(QAbstractSocket::ReceiveBufferSizeSocketOption, SOCKET_BUFFER);
+    return true;
+}
+
+/**
+ * @brief Lists the blocks still missing.
+ *
+ * @param maxRanges Largest number of ranges returned, the rest waits for the next round
+ */
+Multicast::Ranges MulticastReceiver::missingRanges(int maxRanges) const
+{
+    Multicast::Ranges ranges;
+    int index = 0;
+    while (index < blocks.size() && ranges.size() < maxRanges)
+    {
+        if (blocks.testBit(index))
+        {
+            ++index;
+            continue;
+        }
+        int last = index;
+        while (last + 1 < blocks.size() && !blocks.testBit(last + 1))
+            ++last;
+        ranges.append(qMakePair(quint32(index), quint32(last)));
+        index = last + 1;
+    }
+    return ranges;
+}
+
+void MulticastReceiver::onReadyRead()
+{
+    bool written = false;
+    QHostAddress lastSender;
+    quint16 lastSenderPort = 0;
+    quint32 lastIndex = 0;
+    while (socket->hasPendingDatagrams())
+    {
+        QNetworkDatagram datagram = socket->receiveDatagram();
+        quint32 token = 0;
+        quint32 index = 0;
+        QByteArray data;
+        if (!Multicast::decodeBlock(datagram.data(), &token, &index, &data) || token != channel.token ||
+            index >= quint32(blocks.size()) || blocks.testBit(int(index)))
+            continue;
+
+        // Every block but the last is full
+        qint64 offset = qint64(index) * channel.blockSize;
+        if (data.size() != qMin<qint64>(channel.blockSize, fileSize - offset))
+            continue;
+
+        if ((file->pos() != offset && !file->seek(offset)) || file->write(data) != data.size())
+        {
+            emit writeFailed();
+            return;
+        }
+        blocks.setBit(int(index));
+        --missingBlocks;
+        receivedBytes += data.size();
+        written = true;
+        lastSender = datagram.senderAddress();
+        lastSenderPort = quint16(datagram.senderPort());
+        lastIndex = index;
+    }
+
+    // Feedback for the pacing of the sender, wherever it sends from now
+    if (written && isUnicast())
+    {
+        DatagramTransport::Ack ack;
+        ack.token = channel.token;
+        ack.index = lastIndex;
+        ack.received = quint64(receivedBytes);
+        socket->writeDatagram(ack.encode(), lastSender, lastSenderPort);
+    }
+
+    if (written)
+        emit dataWritten();
+}
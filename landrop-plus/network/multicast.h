@@ -0,0 +1,131 @@
+/**
+ * @file multicast.h
+ * @brief UDP multicast channel carrying one file to a whole subnet
+ */
+
+#ifndef MULTICAST_H
+#define MULTICAST_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QBitArray>
+#include <QFile>
+#include <QHostAddress>
+#include <QList>
+#include <QPair>
+#include <QUdpSocket>
+
+/**
+ * @namespace Multicast
+ * @brief Datagram format of multicast transfers.
+ *
+ * The sender still opens a TCP connection to every receiver and announces
+ * the file with a "mcast=group/port/token/blocksize" option; a receiver that
+ * joins the group confirms it with "mcast=1". The file is then multicast as
+ * numbered blocks, each datagram being MAGIC, the 32-bit token and block
+ * index (big-endian) and the block. Blocks are written at their offset as
+ * they arrive, in any order.
+ *
+ * Losses are repaired in rounds over the TCP connections with
+ * Protocol::RepairMessage: after each round the sender asks every receiver
+ * which blocks are missing, and multicasts the union of them again.
+ */
+namespace Multicast
+{
+    /** First bytes of every datagram. */
+    extern const QByteArray MAGIC;
+
+    /** Bytes in front of the block data of a datagram. */
+    const int HEADER_SIZE = 12;
+
+    /** Block size keeping a datagram within a 1500-byte Ethernet frame. */
+    const int BLOCK_SIZE = 1400;
+
+    /** Missing ranges a receiver reports per round at most. */
+    const int MAX_RANGES = 4096;
+
+    /** Inclusive ranges of block indices. */
+    typedef QList<QPair<quint32, quint32>> Ranges;
+
+    /**
+     * @brief Group, port and token of one multicast transfer.
+     */
+    struct Channel
+    {
+        QHostAddress group;
+        quint16 port = 0;
+        quint32 token = 0;
+        int blockSize = BLOCK_SIZE;
+
+        /** @brief Number of blocks a file of @p fileSize bytes is split into. */
+        quint32 blockCount(qint64 fileSize) const;
+
+        QByteArray encode() const;
+        static bool decode(const QByteArray &option, Channel *channel);
+    };
+
+    QByteArray encodeBlock(quint32 token, quint32 index, const QByteArray &data);
+
+    /**
+     * @brief Splits a datagram into its token, block index and block data.
+     * @return false if the datagram is not a multicast block
+     */
+    bool decodeBlock(const QByteArray &datagram, quint32 *token, quint32 *index, QByteArray *data);
+}
+
+/**
+ * @class MulticastReceiver
+ * @brief Joins the group of one multicast transfer and writes its blocks.
+ *
+ * Datagrams of other transfers sharing the port are ignored by token. A
+ * channel without a multicast group receives unicast blocks of a
+ * DatagramTransport flow instead: open() binds a port of its own (see
+ * port()) and every read is answered with a DatagramTransport::Ack to the
+ * address the last block came from.
+ */
+class MulticastReceiver : public QObject
+{
+    Q_OBJECT
+
+public:
+    MulticastReceiver(QFile *file, qint64 fileSize, const Multicast::Channel &channel, QObject *parent = nullptr);
+
+    bool open();
+
+    /** @brief Port bound by open(). */
+    quint16 port() const { return socket->localPort(); }
+
+    /** @brief Bytes of the file received so far. */
+    qint64 received() const { return receivedBytes; }
+
+    /** @brief Whether every block arrived. */
+    bool isComplete() const { return missingBlocks == 0; }
+
+    Multicast::Ranges missingRanges(int maxRanges) const;
+
+signals:
+    /** @brief Signal emitted after new blocks were written. */
+    void dataWritten();
+
+    /** @brief Signal emitted when a block could not be written. */
+    void writeFailed();
+
+private slots:
+    void onReadyRead();
+
+private:
+    bool isUnicast() const;
+
+    /** Receive buffer asked for, so bursts survive a busy event loop. */
+    static const int SOCKET_BUFFER = 4 * 1024 * 1024;
+
+    QUdpSocket *socket;
+    QFile *file;
+    qint64 fileSize;
+    Multicast::Channel channel;
+    QBitArray blocks;
+    quint32 missingBlocks;
+    qint64 receivedBytes = 0;
+};
+
+#endif // MULTICAST_H
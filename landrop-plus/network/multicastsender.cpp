@@ -0,0 +1,646 @@
+/**
+ * @file multicastsender.cpp
+ */
+
+#include "multicastsender.h"
+#include <QFileInfo>
+#include <QHostAddress>
+#include <QRandomGenerator>
+#include <QDebug>
+
+/**
+ * @brief Constructs a new MulticastSender.
+ *
+ * @param parent Parent QObject
+ */
+MulticastSender::MulticastSender(QObject *parent)
+    : QObject(parent),
+      udp(new QUdpSocket(this)),
+      paceTimer(new QTimer(this)),
+      roundTimer(new QTimer(this)),
+      throttleTimer(new QTimer(this))
+{
+    paceTimer->setTimerType(Qt::PreciseTimer);
+    paceTimer->setInterval(1);
+    roundTimer->setSingleShot(true);
+    throttleTimer->setSingleShot(true);
+    connect(paceTimer, &QTimer::timeout, this, &MulticastSender::sendBlocks);
+    connect(roundTimer, &QTimer::timeout, this, &MulticastSender::onRoundTimeout);
+    connect(throttleTimer, &QTimer::timeout, this, [this]()
+            {
+        for (int index = 0; index < peers.size(); ++index)
+            feedUnicast(index); });
+}
+
+/**
+ * @brief Destructor, closes every connection.
+ */
+MulticastSender::~MulticastSender()
+{
+    clear();
+}
+
+/**
+ * @brief Drops all connections and the file.
+ */
+void MulticastSender::clear()
+{
+    paceTimer->stop();
+    roundTimer->stop();
+    throttleTimer->stop();
+    for (Peer &peer : peers)
+        closePeer(peer);
+    peers.clear();
+    delete hasher;
+    hasher = nullptr;
+    digest.clear();
+    readBuffer.clear();
+    readBufferOffset = -1;
+    delete file;
+    file = nullptr;
+}
+
+/**
+ * @brief Starts sending one file to every target.
+ *
+ * @param filePath Absolute path of the file to send
+ * @param targets Receivers of the file
+ */
+void MulticastSender::sendFile(const QString &filePath, const QList<FanoutTarget> &targets)
+{
+    clear();
+    this->filePath = filePath;
+    started = false;
+    completed = false;
+    round = 0;
+    roundEnded = false;
+
+    file = new QFile(filePath);
+    bool readable = file->open(QIODevice::ReadOnly);
+    fileSize = readable ? file->size() : 0;
+
+    channel.group = QHostAddress(Config::getMulticastGroup());
+    channel.port = quint16(Config::getMulticastPort());
+    channel.token = QRandomGenerator::global()->generate();
+    channel.blockSize = Multicast::BLOCK_SIZE;
+    blockCount = channel.blockCount(fileSize);
+    pending = QBitArray(int(blockCount), true);
+    pendingCount = blockCount;
+    nextBlock = 0;
+    missing = QBitArray(int(blockCount), false);
+
+    if (readable && udp->state() == QAbstractSocket::UnconnectedState)
+    {
+        udp->bind(QHostAddress(QHostAddress::AnyIPv4), 0);
+        udp->setSocketOption(QAbstractSocket::MulticastTtlOption, 1);
+        udp->setSocketOption(QAbstractSocket::MulticastLoopbackOption, 1);
+    }
+
+    for (const FanoutTarget &target : targets)
+    {
+        Peer peer;
+        peer.target = target;
+        peers.append(peer);
+    }
+
+    for (int index = 0; index < peers.size(); ++index)
+    {
+        Peer &peer = peers[index];
+        if (!readable || !channel.group.isMulticast())
+        {
+            peer.state = PeerState::Done;
+            emit transferError(index);
+            continue;
+        }
+
+        peer.socket = new QTcpSocket(this);
+        connect(peer.socket, &QTcpSocket::connected, this, [this, index]()
+                { onConnected(index); });
+        connect(peer.socket, &QTcpSocket::readyRead, this, [this, index]()
+                { onReadyRead(index); });
+        connect(peer.socket, &QTcpSocket::bytesWritten, this, [this, index]()
+                { onBytesWritten(index); });
+        connect(peer.socket, &QTcpSocket::disconnected, this, [this, index]()
+                { onDisconnected(index); });
+        connect(peer.socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::errorOccurred),
+                this, [this, index](QAbstractSocket::SocketError socketError)
+                {
+            // A receiver closing the connection is handled in onDisconnected()
+            if (socketError != QAbstractSocket::RemoteHostClosedError)
+                failPeer(index); });
+        peer.socket->connectToHost(QHostAddress(peer.target.address), peer.target.port);
+    }
+
+    roundTimer->start(ROUND_TIMEOUT);
+    startIfResolved();
+    finishIfResolved();
+}
+
+/**
+ * @brief Announces the file and the multicast channel to a receiver.
+ *
+ * @param index Position of the receiver in the target list
+ */
+void MulticastSender::onConnected(int index)
+{
+    Peer &peer = peers[index];
+
+    Protocol::TransferHeader header;
+    header.fileName = QFileInfo(filePath).fileName();
+    header.fileSize = fileSize;
+    header.transferId = Protocol::newTransferId();
+    header.options.insert("mcast", channel.encode());
+    if (Config::getIntegrityCheckEnabled())
+        header.options.insert("hash", StreamHasher::ALGORITHM);
+
+    QByteArray message = header.encode(peer.target.version);
+    if (peer.target.version >= Protocol::VERSION_2)
+        message.prepend(Protocol::PREAMBLE_V2);
+    peer.socket->write(message);
+    peer.socket->flush();
+    peer.state = PeerState::Waiting;
+}
+
+/**
+ * @brief Reads the reply to the header, then repair answers.
+ *
+ * @param index Position of the receiver in the target list
+ */
+void MulticastSender::onReadyRead(int index)
+{
+    while (peers[index].socket && peers[index].state != PeerState::Done)
+    {
+        Peer &peer = peers[index];
+        if (peer.state == PeerState::Unicast)
+        {
+            // Nothing is expected from a receiver of plain data
+            peer.socket->readAll();
+            return;
+        }
+
+        QByteArray message;
+        Protocol::ReadStatus status = Protocol::readMessage(peer.socket, peer.target.version, &message);
+        if (status == Protocol::ReadStatus::Incomplete)
+            return;
+        if (status == Protocol::ReadStatus::Malformed)
+        {
+            failPeer(index);
+            return;
+        }
+
+        if (peer.state == PeerState::Waiting)
+            applyReply(index, message);
+        else
+            applyRepair(index, message);
+    }
+}
+
+/**
+ * @brief Applies a receiver's answer to the header.
+ */
+void MulticastSender::applyReply(int index, const QByteArray &message)
+{
+    Peer &peer = peers[index];
+    Protocol::TransferReply reply;
+    if (!Protocol::TransferReply::decode(message, &reply))
+    {
+        failPeer(index);
+        return;
+    }
+
+    QByteArray hash = reply.options.value("hash");
+    if (reply.accepted && !hash.isEmpty() && hash != StreamHasher::ALGORITHM)
+    {
+        failPeer(index);
+        return;
+    }
+
+    if (!reply.accepted)
+    {
+        peer.state = PeerState::Done;
+        closePeer(peer);
+        emit transferRefused(index);
+    }
+    else
+    {
+        peer.verified = !hash.isEmpty();
+        emit transferAccepted(index);
+        if (reply.options.value("mcast") == "1")
+        {
+            peer.state = PeerState::Joined;
+            if (peer.verified && !hasher)
+                hasher = new StreamHasher();
+        }
+        else
+        {
+            // Could not join the group, the data goes over TCP
+            peer.state = PeerState::Unicast;
+            peer.file = new QFile(filePath);
+            if (!peer.file->open(QIODevice::ReadOnly))
+            {
+                failPeer(index);
+                return;
+            }
+            if (peer.verified)
+                peer.hasher = new StreamHasher();
+            feedUnicast(index);
+        }
+    }
+
+    startIfResolved();
+    finishIfResolved();
+}
+
+/**
+ * @brief Applies a receiver's answer to the end of a round.
+ */
+void MulticastSender::applyRepair(int index, const QByteArray &message)
+{
+    Peer &peer = peers[index];
+    Protocol::RepairMessage repair;
+    if (!Protocol::RepairMessage::decode(message, &repair) || repair.kind == Protocol::RepairMessage::RoundEnd)
+    {
+        failPeer(index);
+        return;
+    }
+    if (repair.round != round || !roundEnded)
+        return;
+
+    if (repair.kind == Protocol::RepairMessage::Done)
+    {
+        finishPeer(index);
+    }
+    else
+    {
+        quint32 missed = 0;
+        for (const QPair<quint32, quint32> &range : repair.ranges)
+        {
+            for (quint32 block = range.first; block <= range.second && block < blockCount; ++block)
+            {
+                missing.setBit(int(block));
+                ++missed;
+            }
+        }
+        peer.answeredRound = round;
+        reportProgress(index, blockCount > 0 ? int(qint64(blockCount - qMin(missed, blockCount)) * 100 / blockCount) : 100);
+    }
+
+    nextRoundIfAnswered();
+}
+
+/**
+ * @brief Starts multicasting once no receiver is still connecting or deciding.
+ */
+void MulticastSender::startIfResolved()
+{
+    if (started)
+        return;
+
+    bool joined = false;
+    for (const Peer &peer : peers)
+    {
+        if (peer.state == PeerState::Connecting || peer.state == PeerState::Waiting)
+            return;
+        joined = joined || peer.state == PeerState::Joined;
+    }
+
+    started = true;
+    roundTimer->stop();
+    if (!joined)
+        return;
+
+    budget = 0;
+    paceClock.start();
+    paceTimer->start();
+    sendBlocks();
+}
+
+/**
+ * @brief Multicasts the pending blocks of the round within the rate.
+ */
+void MulticastSender::sendBlocks()
+{
+    double rate = double(qMax<qint64>(64 * 1024, Config::getMulticastRate()));
+    budget = qMin(budget + rate * double(paceClock.restart()) / 1000.0, qMax(64.0 * 1024, rate / 100));
+
+    while (pendingCount > 0 && budget > 0)
+    {
+        if (BandwidthShaper::delay(channel.group.toString(), &bucket) > 0)
+            return;
+
+        while (!pending.testBit(int(nextBlock)))
+            ++nextBlock;
+
+        QByteArray data;
+        if (!readBlock(nextBlock, &data))
+        {
+            // The file cannot be sent to anyone any more
+            for (int index = 0; index < peers.size(); ++index)
+                failPeer(index);
+            return;
+        }
+
+        QByteArray datagram = Multicast::encodeBlock(channel.token, nextBlock, data);
+        if (udp->writeDatagram(datagram, channel.group, channel.port) != datagram.size())
+            return; // Send buffer full, retried on the next tick
+
+        pending.clearBit(int(nextBlock));
+        --pendingCount;
+        ++nextBlock;
+        budget -= datagram.size();
+        BandwidthShaper::consume(channel.group.toString(), &bucket, datagram.size());
+
+        if (round == 0 && blockCount > 0)
+        {
+            int percent = int(qint64(nextBlock) * 100 / blockCount);
+            for (int index = 0; index < peers.size(); ++index)
+            {
+                if (peers[index].state == PeerState::Joined)
+                    reportProgress(index, percent);
+            }
+        }
+    }
+
+    if (pendingCount == 0)
+        endRound();
+}
+
+/**
+ * @brief Cuts one block out of the file, reading a larger chunk when needed.
+ *
+ * Chunks of the first round are read in order, which is when the file is hashed.
+ */
+bool MulticastSender::readBlock(quint32 index, QByteArray *data)
+{
+    qint64 offset = qint64(index) * channel.blockSize;
+    qint64 length = qMin<qint64>(channel.blockSize, fileSize - offset);
+    if (readBufferOffset < 0 || offset < readBufferOffset || offset + length > readBufferOffset + readBuffer.size())
+    {
+        qint64 start = offset - offset % READ_SIZE;
+        if (!file->seek(start))
+            return false;
+        bool sequential = (start == readBufferOffset + readBuffer.size());
+        readBuffer = file->read(qMin(READ_SIZE, fileSize - start));
+        readBufferOffset = start;
+        if (readBuffer.size() != qMin(READ_SIZE, fileSize - start))
+            return false;
+        if (hasher && round == 0 && (sequential || start == 0))
+            hasher->addData(readBuffer);
+    }
+
+    *data = readBuffer.mid(int(offset - readBufferOffset), int(length));
+    return true;
+}
+
+/**
+ * @brief Asks every joined receiver which blocks it still misses.
+ */
+void MulticastSender::endRound()
+{
+    paceTimer->stop();
+    if (roundEnded)
+        return;
+    roundEnded = true;
+
+    if (round == 0 && hasher)
+    {
+        digest = hasher->result();
+        delete hasher;
+        hasher = nullptr;
+    }
+
+    for (int index = 0; index < peers.size(); ++index)
+    {
+        Peer &peer = peers[index];
+        if (peer.state != PeerState::Joined)
+            continue;
+
+        Protocol::RepairMessage repair;
+        repair.kind = Protocol::RepairMessage::RoundEnd;
+        repair.round = round;
+        if (peer.verified)
+            repair.digest = digest;
+        peer.socket->write(repair.encode(peer.target.version));
+        peer.socket->flush();
+    }
+
+    roundTimer->start(ROUND_TIMEOUT);
+    nextRoundIfAnswered();
+}
+
+/**
+ * @brief Starts the next round once every joined receiver answered this one.
+ */
+void MulticastSender::nextRoundIfAnswered()
+{
+    if (!roundEnded)
+        return;
+
+    bool joined = false;
+    for (const Peer &peer : peers)
+    {
+        if (peer.state == PeerState::Joined && peer.answeredRound < round)
+            return;
+        joined = joined || peer.state == PeerState::Joined;
+    }
+
+    roundTimer->stop();
+    if (!joined)
+    {
+        finishIfResolved();
+        return;
+    }
+
+    if (round + 1 >= MAX_ROUNDS)
+    {
+        // qDebug() << "MulticastSender: Receivers still miss blocks after" << MAX_ROUNDS << "rounds";
+        for (int index = 0; index < peers.size(); ++index)
+        {
+            if (peers[index].state == PeerState::Joined)
+                failPeer(index);
+        }
+        return;
+    }
+
+    ++round;
+    pending = missing;
+    pendingCount = quint32(pending.count(true));
+    missing = QBitArray(int(blockCount), false);
+    nextBlock = 0;
+    roundEnded = false;
+    paceClock.restart();
+    paceTimer->start();
+    sendBlocks();
+}
+
+/**
+ * @brief Fails the receivers that did not answer in time.
+ */
+void MulticastSender::onRoundTimeout()
+{
+    for (int index = 0; index < peers.size(); ++index)
+    {
+        const Peer &peer = peers[index];
+        if (peer.state == PeerState::Connecting || peer.state == PeerState::Waiting ||
+            (peer.state == PeerState::Joined && roundEnded && peer.answeredRound < round))
+        {
+            // qDebug() << "MulticastSender: Timeout for receiver" << index;
+            failPeer(index);
+        }
+    }
+}
+
+/**
+ * @brief Queues plain file data on a receiver that did not join the group.
+ *
+ * @param index Position of the receiver in the target list
+ */
+void MulticastSender::feedUnicast(int index)
+{
+    Peer &peer = peers[index];
+    if (peer.state != PeerState::Unicast || peer.trailerQueued)
+        return;
+
+    while (peer.position < fileSize && peer.socket->bytesToWrite() < UNICAST_WINDOW)
+    {
+        int wait = BandwidthShaper::delay(peer.target.address, &peer.bucket);
+        if (wait > 0)
+        {
+            if (!throttleTimer->isActive())
+                throttleTimer->start(wait);
+            return;
+        }
+
+        QByteArray chunk = peer.file->read(qMin(READ_SIZE, fileSize - peer.position));
+        if (chunk.isEmpty() || peer.socket->write(chunk) != chunk.size())
+        {
+            failPeer(index);
+            return;
+        }
+        if (peer.hasher)
+            peer.hasher->addData(chunk);
+        peer.position += chunk.size();
+        BandwidthShaper::consume(peer.target.address, &peer.bucket, chunk.size());
+    }
+
+    if (peer.position < fileSize)
+        return;
+
+    peer.trailerQueued = true;
+    if (peer.hasher)
+    {
+        QByteArray trailer = Protocol::encodeTrailer(peer.target.version, peer.hasher->result());
+        if (peer.socket->write(trailer) != trailer.size())
+        {
+            failPeer(index);
+            return;
+        }
+    }
+    if (peer.socket->bytesToWrite() == 0)
+        finishPeer(index);
+}
+
+/**
+ * @brief Reports progress of a unicast fallback and refills it.
+ */
+void MulticastSender::onBytesWritten(int index)
+{
+    Peer &peer = peers[index];
+    if (peer.state != PeerState::Unicast)
+        return;
+
+    qint64 queued = peer.position - peer.socket->bytesToWrite();
+    reportProgress(index, fileSize > 0 ? int(qBound<qint64>(0, queued * 100 / fileSize, 100)) : 100);
+    if (peer.trailerQueued && peer.socket->bytesToWrite() == 0)
+        finishPeer(index);
+    else
+        feedUnicast(index);
+}
+
+/**
+ * @brief Fails a receiver that closed the connection before the end.
+ */
+void MulticastSender::onDisconnected(int index)
+{
+    if (peers[index].state != PeerState::Done)
+        failPeer(index);
+}
+
+void MulticastSender::reportProgress(int index, int percent)
+{
+    Peer &peer = peers[index];
+    if (percent == peer.lastProgress)
+        return;
+    peer.lastProgress = percent;
+    emit progressUpdated(index, percent);
+}
+
+/**
+ * @brief Reports a receiver as failed and closes its connection.
+ */
+void MulticastSender::failPeer(int index)
+{
+    Peer &peer = peers[index];
+    if (peer.state == PeerState::Done)
+        return;
+
+    peer.state = PeerState::Done;
+    closePeer(peer);
+    emit transferError(index);
+    startIfResolved();
+    nextRoundIfAnswered();
+    finishIfResolved();
+}
+
+/**
+ * @brief Reports a receiver as complete and closes its connection.
+ */
+void MulticastSender::finishPeer(int index)
+{
+    Peer &peer = peers[index];
+    peer.state = PeerState::Done;
+    reportProgress(index, 100);
+    peer.socket->disconnectFromHost();
+    emit transferFinished(index);
+    finishIfResolved();
+}
+
+void MulticastSender::closePeer(Peer &peer)
+{
+    if (peer.socket)
+    {
+        peer.socket->blockSignals(true);
+        if (peer.socket->state() != QAbstractSocket::UnconnectedState)
+            peer.socket->abort();
+        peer.socket->deleteLater();
+        peer.socket = nullptr;
+    }
+    delete peer.hasher;
+    peer.hasher = nullptr;
+    delete peer.file;
+    peer.file = nullptr;
+}
+
+/**
+ * @brief Emits multicastFinished() once every receiver is resolved.
+ */
+void MulticastSender::finishIfResolved()
+{
+    if (completed)
+        return;
+
+    for (const Peer &peer : peers)
+    {
+        if (peer.state != PeerState::Done)
+            return;
+    }
+
+    completed = true;
+    paceTimer->stop();
+    roundTimer->stop();
+    throttleTimer->stop();
+    readBuffer.clear();
+    if (file)
+        file->close();
+    emit multicastFinished();
+}
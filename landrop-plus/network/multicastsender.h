@@ -0,0 +1,191 @@
+/**
+ * @file multicastsender.h
+ * @brief Sends one file to a whole subnet over UDP multicast
+ */
+
+#ifndef MULTICASTSENDER_H
+#define MULTICASTSENDER_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QUdpSocket>
+#include <QTimer>
+#include <QFile>
+#include <QBitArray>
+#include <QElapsedTimer>
+#include <QList>
+#include "../config/config.h"
+#include "protocol.h"
+#include "multicast.h"
+#include "streamhasher.h"
+#include "bandwidthshaper.h"
+#include "fanoutsender.h"
+
+/**
+ * @class MulticastSender
+ * @brief Multicasts one file to every receiver, repairing losses in rounds.
+ *
+ * Every receiver gets a TCP connection for the header and the repair
+ * messages (see Multicast). Once all of them have answered, the blocks are
+ * multicast at Config::getMulticastRate(). At the end of each round the
+ * receivers report their missing blocks, and the next round multicasts
+ * the union of them; a receiver that still misses blocks after MAX_ROUNDS,
+ * or does not answer within ROUND_TIMEOUT, fails.
+ *
+ * A receiver that accepts the file without joining the group (an older
+ * peer, or one that cannot bind the port) gets the file as plain data on
+ * its TCP connection instead.
+ */
+class MulticastSender : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MulticastSender(QObject *parent = nullptr);
+    ~MulticastSender();
+
+    void sendFile(const QString &filePath, const QList<FanoutTarget> &targets);
+
+    /** @brief Number of the current repair round, 0 for the first pass. */
+    int getRound() const { return round; }
+
+signals:
+    /**
+     * @brief Signal emitted when a receiver accepts the file.
+     * @param index Position of the receiver in the target list
+     */
+    void transferAccepted(int index);
+
+    /** @brief Signal emitted when a receiver declines the file. */
+    void transferRefused(int index);
+
+    /**
+     * @brief Signal emitted when the progress of one receiver changes.
+     * @param index Position of the receiver in the target list
+     * @param percent Completion percentage (0-100)
+     */
+    void progressUpdated(int index, int percent);
+
+    /** @brief Signal emitted once a receiver has the whole file. */
+    void transferFinished(int index);
+
+    /** @brief Signal emitted when the transfer to a receiver fails. */
+    void transferError(int index);
+
+    /** @brief Signal emitted once every receiver is resolved. */
+    void multicastFinished();
+
+private:
+    /** Progress of one receiver. */
+    enum class PeerState
+    {
+        Connecting, ///< Connection not established yet
+        Waiting,    ///< Header sent, no answer yet
+        Joined,     ///< Receiving the multicast blocks
+        Unicast,    ///< Receiving the file on its TCP connection
+        Done        ///< Finished, refused or failed
+    };
+
+    /**
+     * @brief Connection and state of one receiver.
+     */
+    struct Peer
+    {
+        FanoutTarget target;
+        QTcpSocket *socket = nullptr;
+        PeerState state = PeerState::Connecting;
+
+        /** Whether the receiver asked for the digest. */
+        bool verified = false;
+
+        /** Last round the receiver answered. */
+        int answeredRound = -1;
+
+        int lastProgress = -1;
+
+        /** Unicast fallback: file offset queued so far and its own reader and hasher. */
+        qint64 position = 0;
+        QFile *file = nullptr;
+        StreamHasher *hasher = nullptr;
+        bool trailerQueued = false;
+        TokenBucket bucket;
+    };
+
+    /** Rounds after which receivers still missing blocks fail. */
+    static const int MAX_ROUNDS = 20;
+
+    /** Time receivers have to answer a header or a round in milliseconds. */
+    static const int ROUND_TIMEOUT = 30000;
+
+    /** Bytes read from the file at once. */
+    static constexpr qint64 READ_SIZE = 256 * 1024;
+
+    /** Queued bytes of a unicast fallback connection before it waits. */
+    static const qint64 UNICAST_WINDOW = 1024 * 1024;
+
+    void onConnected(int index);
+    void onReadyRead(int index);
+    void onBytesWritten(int index);
+    void onDisconnected(int index);
+    void applyReply(int index, const QByteArray &message);
+    void applyRepair(int index, const QByteArray &message);
+    void failPeer(int index);
+    void finishPeer(int index);
+    void closePeer(Peer &peer);
+    void startIfResolved();
+    void sendBlocks();
+    void endRound();
+    void onRoundTimeout();
+    void nextRoundIfAnswered();
+    void feedUnicast(int index);
+    bool readBlock(quint32 index, QByteArray *data);
+    void reportProgress(int index, int percent);
+    void finishIfResolved();
+    void clear();
+
+    QString filePath;
+    QFile *file = nullptr;
+    qint64 fileSize = 0;
+    QList<Peer> peers;
+
+    Multicast::Channel channel;
+    quint32 blockCount = 0;
+    QUdpSocket *udp;
+
+    /** Whether every receiver answered the header. */
+    bool started = false;
+
+    /** Whether multicastFinished() was emitted. */
+    bool completed = false;
+
+    /** Current round, the blocks it still has to send and the next block to look at. */
+    int round = 0;
+    QBitArray pending;
+    quint32 nextBlock = 0;
+    quint32 pendingCount = 0;
+
+    /** Whether the end of the current round was announced. */
+    bool roundEnded = false;
+
+    /** Blocks the receivers reported missing for the next round. */
+    QBitArray missing;
+
+    /** Last chunk read from the file, blocks are cut from it. */
+    QByteArray readBuffer;
+    qint64 readBufferOffset = -1;
+
+    /** Hashes the file during the first round, once any receiver verifies it. */
+    StreamHasher *hasher = nullptr;
+    QByteArray digest;
+
+    /** Byte budget of the pacing timer. */
+    QElapsedTimer paceClock;
+    double budget = 0;
+    TokenBucket bucket;
+
+    QTimer *paceTimer;
+    QTimer *roundTimer;
+    QTimer *throttleTimer;
+};
+
+#endif // MULTICASTSENDER_H
@@ -0,0 +1,193 @@
+/**
+ * @file pathbonding.cpp
+ */
+
+#include "pathbonding.h"
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QNetworkInterface>
+
+namespace
+{
+    /** Weight of a new sample in the throughput of its path */
+    const double SAMPLE_WEIGHT = 0.5;
+
+    QMutex bondingMutex;
+    QHash<QString, QStringList> addressesByPeer;
+    QHash<QString, double> throughputByPath;
+
+    QString keyOf(const PathBonding::Path &path)
+    {
+        return path.local.toString() + '>' + path.remote;
+    }
+
+    /**
+     * @brief IPv4 address entries of the interfaces that are up, loopback excluded.
+     */
+    QList<QNetworkAddressEntry> localEntries()
+    {
+        QList<QNetworkAddressEntry> entries;
+        const QList<QNetworkInterface> interfaces = QNetworkInterface::allInterfaces();
+        for (const QNetworkInterface &interface : interfaces)
+        {
+            QNetworkInterface::InterfaceFlags flags = interface.flags();
+            if (!(flags & QNetworkInterface::IsUp) || !(flags & QNetworkInterface::IsRunning) ||
+                (flags & QNetworkInterface::IsLoopBack))
+                continue;
+
+            const QList<QNetworkAddressEntry> addressEntries = interface.addressEntries();
+            for (const QNetworkAddressEntry &entry : addressEntries)
+            {
+                if (entry.ip().protocol() == QAbstractSocket::IPv4Protocol)
+                    entries.append(entry);
+            }
+        }
+        return entries;
+    }
+}
+
+QStringList PathBonding::localAddresses()
+{
+    QStringList addresses;
+    const QList<QNetworkAddressEntry> entries = localEntries();
+    for (const QNetworkAddressEntry &entry : entries)
+        addresses.append(entry.ip().toString());
+    return addresses;
+}
+
+QStringList PathBonding::reachableAddresses()
+{
+    QStringList addresses = localAddresses();
+    const QList<QNetworkInterface> interfaces = QNetworkInterface::allInterfaces();
+    for (const QNetworkInterface &interface : interfaces)
+    {
+        QNetworkInterface::InterfaceFlags flags = interface.flags();
+        if (!(flags & QNetworkInterface::IsUp) || !(flags & QNetworkInterface::IsRunning) ||
+            (flags & QNetworkInterface::IsLoopBack))
+            continue;
+
+        // Link-local addresses need the scope of the receiving side's interface
+        const QList<QNetworkAddressEntry> addressEntries = interface.addressEntries();
+        for (const QNetworkAddressEntry &entry : addressEntries)
+        {
+            QHostAddress ip = entry.ip();
+            if (ip.protocol() == QAbstractSocket::IPv6Protocol && !ip.isLinkLocal() && !ip.isLoopback())
+                addresses.append(ip.toString());
+        }
+    }
+    return addresses;
+}
+
+void PathBonding::setPeerAddresses(const QString &peer, const QStringList &addresses)
+{
+    QMutexLocker lock(&bondingMutex);
+    if (addresses.isEmpty())
+        addressesByPeer.remove(peer);
+    else
+        addressesByPeer.insert(peer, addresses);
+}
+
+void PathBonding::removePeer(const QString &peer)
+{
+    QMutexLocker lock(&bondingMutex);
+    addressesByPeer.remove(peer);
+}
+
+QStringList PathBonding::peerAddresses(const QString &peer)
+{
+    QMutexLocker lock(&bondingMutex);
+    return addressesByPeer.value(peer);
+}
+
+QList<PathBonding::Path> PathBonding::paths(const QHostAddress &local, const QString &peer, int count)
+{
+    Path primary;
+    primary.local = local;
+    primary.remote = peer;
+    QList<Path> distinct;
+    distinct.append(primary);
+
+    // The peer's other interfaces first, so a second link also ends on a second interface there
+    QStringList remotes = peerAddresses(peer);
+    remotes.removeAll(peer);
+    remotes.append(peer);
+
+    const QList<QNetworkAddressEntry> entries = localEntries();
+    for (const QNetworkAddressEntry &entry : entries)
+    {
+        if (entry.ip() == local)
+            continue;
+        for (const QString &remote : remotes)
+        {
+            if (QHostAddress(remote).isInSubnet(entry.ip(), entry.prefixLength()))
+            {
+                Path path;
+                path.local = entry.ip();
+                path.remote = remote;
+                distinct.append(path);
+                break;
+            }
+        }
+    }
+
+    QList<Path> result;
+    for (int i = 0; i < count; ++i)
+        result.append(distinct[i % distinct.size()]);
+    return result;
+}
+
+void PathBonding::recordThroughput(const Path &path, qint64 bytes, qint64 elapsedMs)
+{
+    if (bytes < MIN_SAMPLE || elapsedMs <= 0)
+        return;
+
+    double sample = double(bytes) * 1000.0 / double(elapsedMs);
+    QMutexLocker lock(&bondingMutex);
+    QString key = keyOf(path);
+    auto known = throughputByPath.constFind(key);
+    if (known == throughputByPath.constEnd())
+        throughputByPath.insert(key, sample);
+    else
+        throughputByPath.insert(key, known.value() * (1.0 - SAMPLE_WEIGHT) + sample * SAMPLE_WEIGHT);
+}
+
+double PathBonding::throughput(const Path &path)
+{
+    QMutexLocker lock(&bondingMutex);
+    return throughputByPath.value(keyOf(path), 0.0);
+}
+
+QList<int> PathBonding::weights(const QList<Path> &paths)
+{
+    QHash<QString, int> sharing;
+    QList<double> measured;
+    double measuredSum = 0;
+    for (const Path &path : paths)
+    {
+        sharing[keyOf(path)]++;
+        double rate = throughput(path);
+        measured.append(rate);
+        measuredSum += rate;
+    }
+
+    int measuredCount = 0;
+    for (double rate : measured)
+        measuredCount += rate > 0 ? 1 : 0;
+    double average = measuredCount > 0 ? measuredSum / measuredCount : 1.0;
+
+    QList<double> shares;
+    double total = 0;
+    for (int i = 0; i < paths.size(); ++i)
+    {
+        double rate = measured[i] > 0 ? measured[i] : average;
+        double share = rate / sharing.value(keyOf(paths[i]));
+        shares.append(share);
+        total += share;
+    }
+
+    QList<int> result;
+    for (double share : shares)
+        result.append(qMax(1, int(share * WEIGHT_TOTAL / total)));
+    return result;
+}
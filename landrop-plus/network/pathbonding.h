@@ -0,0 +1,112 @@
+/**
+ * @file pathbonding.h
+ * @brief Network paths between this host and a peer, for striping a transfer over several
+ */
+
+#ifndef PATHBONDING_H
+#define PATHBONDING_H
+
+#include <QHostAddress>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+/**
+ * @namespace PathBonding
+ * @brief Spreads the stripes of a transfer over several local interfaces and peer addresses.
+ *
+ * Hosts are often connected twice, by cable and by Wi-Fi, while discovery
+ * and the primary connection only use one address. Peers announce the
+ * addresses of all their interfaces in discovery ("addrs"), which are kept
+ * here. With Config::getBondingEnabled(), a striped transfer binds each
+ * secondary connection to another local interface and connects it to the
+ * peer address on the same subnet, so the bandwidth of the links adds up.
+ *
+ * The throughput of every path is measured when a stripe over it
+ * completes. The sender offers the stripe weights following from it as
+ * "weights=w0,w1,..." and both sides split the file accordingly (see
+ * Protocol::stripeRange()), so stripes on a slower link carry less and all
+ * of them end at about the same time. All functions are thread-safe.
+ */
+namespace PathBonding
+{
+    /**
+     * @brief Local address a connection is bound to and peer address it goes to.
+     */
+    struct Path
+    {
+        /** Local address to bind, null to let the system choose. */
+        QHostAddress local;
+        QString remote;
+
+        bool operator==(const Path &other) const { return local == other.local && remote == other.remote; }
+    };
+
+    /** Smallest transfer over a path measured, shorter ones mostly show the connection setup. */
+    const qint64 MIN_SAMPLE = 1024 * 1024;
+
+    /** Sum of the weights offered for a transfer. */
+    const int WEIGHT_TOTAL = 1000;
+
+    /**
+     * @brief IPv4 addresses of the interfaces that are up, loopback excluded.
+     */
+    QStringList localAddresses();
+
+    /**
+     * @brief Addresses others may connect to: localAddresses() and the routable IPv6 ones.
+     */
+    QStringList reachableAddresses();
+
+    /**
+     * @brief Records the addresses a peer announced, replacing those known before.
+     *
+     * @param peer Address the peer is known by
+     * @param addresses Addresses of all its interfaces
+     */
+    void setPeerAddresses(const QString &peer, const QStringList &addresses);
+
+    /** @brief Forgets the addresses of a peer that is gone. */
+    void removePeer(const QString &peer);
+
+    /** @brief Addresses a peer announced, empty if it did not. */
+    QStringList peerAddresses(const QString &peer);
+
+    /**
+     * @brief Paths for the connections of a striped transfer.
+     *
+     * The first is the primary connection's own path. The others pair
+     * each further local interface with a peer address on its subnet and
+     * are handed out in turn, so with fewer paths than connections several
+     * connections share one.
+     *
+     * @param local Local address of the primary connection
+     * @param peer Address the primary connection goes to
+     * @param count Number of connections
+     */
+    QList<Path> paths(const QHostAddress &local, const QString &peer, int count);
+
+    /**
+     * @brief Updates the measured throughput of a path with a completed transfer over it.
+     *
+     * @param path Path the data went over
+     * @param bytes Bytes sent, samples below MIN_SAMPLE are ignored
+     * @param elapsedMs Time they took
+     */
+    void recordThroughput(const Path &path, qint64 bytes, qint64 elapsedMs);
+
+    /** @brief Measured throughput of a path in bytes per second, 0 if it was not measured yet. */
+    double throughput(const Path &path);
+
+    /**
+     * @brief Share of the file each connection carries, following the throughput of its path.
+     *
+     * Connections sharing a path share its throughput; paths not measured
+     * yet count as the average of the others.
+     *
+     * @return One weight per path, summing to about WEIGHT_TOTAL
+     */
+    QList<int> weights(const QList<Path> &paths);
+}
+
+#endif // PATHBONDING_H
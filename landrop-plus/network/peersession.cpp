@@ -0,0 +1,618 @@
+/**
+ * @file peersession.cpp
+ */
+
+#include "peersession.h"
+#include "protocol.h"
+#include "securetransport.h"
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDebug>
+
+/**
+ * @brief Constructs a new PeerSession.
+ *
+ * Sets up the connection and response timeouts, which fail every file of
+ * the batch that is not resolved yet.
+ *
+ * @param parent Parent QObject
+ */
+PeerSession::PeerSession(QObject *parent)
+    : QObject(parent),
+      connectionTimer(new QTimer(this)),
+      responseTimer(new QTimer(this)),
+      throttleTimer(new QTimer(this)),
+      race(new ConnectionRace(this))
+{
+    connectionTimer->setSingleShot(true);
+    responseTimer->setSingleShot(true);
+    throttleTimer->setSingleShot(true);
+    connect(throttleTimer, &QTimer::timeout, this, &PeerSession::fillSocket);
+
+    connect(connectionTimer, &QTimer::timeout, this, [this]()
+            {
+        // qDebug() << "PeerSession: Connection timeout";
+        failRemaining(); });
+
+    connect(race, &ConnectionRace::established, this, [this](QTcpSocket *connection, const QString &)
+            {
+        connection->setParent(this);
+        socket = connection;
+        attachSocket();
+        onConnected(); });
+    connect(race, &ConnectionRace::failed, this, &PeerSession::failRemaining);
+
+    connect(responseTimer, &QTimer::timeout, this, [this]()
+            {
+        // qDebug() << "PeerSession: Response timeout - no OK/NO received";
+        failRemaining(); });
+}
+
+/**
+ * @brief Destructor, closes the connection and any open file.
+ */
+PeerSession::~PeerSession()
+{
+    closeConnection();
+    delete warmConnection;
+}
+
+/**
+ * @brief Starts sending a batch of files to one receiver.
+ *
+ * Missing files are reported through transferError() straight away; the
+ * others are announced on a single connection.
+ *
+ * @param filePaths Absolute paths of the files to send
+ * @param receiverIP IP address of the receiver
+ * @param receiverPort TCP port of the receiver
+ * @param version Protocol version the receiver advertised
+ * @param connection Connected, unused socket to the receiver taken from a
+ *        ConnectionPool, used for the first connection; null to connect now
+ */
+void PeerSession::sendFiles(const QStringList &filePaths, const QString &receiverIP, quint16 receiverPort, int version,
+                            QTcpSocket *connection)
+{
+    closeConnection();
+    delete warmConnection;
+    warmConnection = connection;
+    if (warmConnection)
+        warmConnection->setParent(this);
+
+    files = filePaths;
+    receiverAddress = receiverIP;
+    port = receiverPort;
+    protocolVersion = version;
+    mode = Mode::Probing;
+    completed = false;
+    sizes.clear();
+    states.clear();
+    offsets.clear();
+    verified.clear();
+
+    for (int index = 0; index < files.size(); ++index)
+    {
+        QFileInfo info(files[index]);
+        sizes.append(info.size());
+        offsets.append(0);
+        verified.append(false);
+        states.append(info.exists() ? FileState::Pending : FileState::Done);
+    }
+
+    for (int index = 0; index < files.size(); ++index)
+    {
+        if (states[index] == FileState::Done)
+            emit transferError(index);
+    }
+
+    openConnection();
+}
+
+/**
+ * @brief Opens a connection for the files that are still pending.
+ *
+ * Emits sessionFinished() instead when nothing is left to send.
+ */
+void PeerSession::openConnection()
+{
+    headerOrder.clear();
+    for (int index = 0; index < states.size(); ++index)
+    {
+        if (states[index] == FileState::Pending)
+            headerOrder.append(index);
+    }
+
+    if (headerOrder.isEmpty())
+    {
+        if (!completed)
+        {
+            completed = true;
+            emit sessionFinished();
+        }
+        return;
+    }
+
+    // Without session support every file gets a connection of its own
+    if (mode == Mode::Legacy)
+        headerOrder = headerOrder.mid(0, 1);
+
+    replyIndex = 0;
+    acceptedQueue.clear();
+    inFlight.clear();
+    bytesQueued = 0;
+    bytesFlushed = 0;
+    lastProgress = -1;
+    sendWindow.reset(receiverAddress);
+    sessionBucket = TokenBucket();
+    sessionBucket.setPriority(lane);
+
+    if (warmConnection)
+    {
+        socket = warmConnection;
+        warmConnection = nullptr;
+        attachSocket();
+        onConnected();
+        return;
+    }
+
+    // Every address the receiver announced is tried, see ConnectionRace
+    race->start(receiverAddress, port);
+    connectionTimer->start(10000); // 10 second connection timeout
+}
+
+/**
+ * @brief Connects the signals of a connection ready to carry the batch.
+ */
+void PeerSession::attachSocket()
+{
+    connect(socket, &QTcpSocket::readyRead, this, &PeerSession::onReadyRead);
+    connect(socket, &QTcpSocket::bytesWritten, this, &PeerSession::onBytesWritten);
+    connect(socket, &QTcpSocket::disconnected, this, &PeerSession::onDisconnected);
+    connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::errorOccurred),
+            this, [this](QAbstractSocket::SocketError socketError)
+            {
+        // A receiver closing the connection is handled in onDisconnected()
+        if (socketError != QAbstractSocket::RemoteHostClosedError)
+            failRemaining(); });
+}
+
+/**
+ * @brief Drops the current connection and the file being read, if any.
+ */
+void PeerSession::closeConnection()
+{
+    connectionTimer->stop();
+    race->abort();
+    responseTimer->stop();
+    throttleTimer->stop();
+
+    if (socket)
+    {
+        socket->blockSignals(true);
+        if (socket->state() != QAbstractSocket::UnconnectedState)
+            socket->abort();
+        socket->deleteLater();
+        socket = nullptr;
+    }
+    if (source)
+    {
+        source->close();
+        delete source;
+        source = nullptr;
+    }
+    delete hasher;
+    hasher = nullptr;
+    sendingIndex = -1;
+}
+
+/**
+ * @brief Announces the first file, offering a session when more follow.
+ */
+void PeerSession::onConnected()
+{
+    connectionTimer->stop();
+
+    int sessionCount = (mode == Mode::Legacy) ? 1 : headerOrder.size();
+    if (sessionCount < 2)
+        mode = Mode::Legacy;
+
+    if (protocolVersion >= Protocol::VERSION_2)
+    {
+        bytesQueued += Protocol::PREAMBLE_V2.size();
+        socket->write(Protocol::PREAMBLE_V2);
+    }
+    writeHeader(headerOrder.first(), sessionCount);
+    responseTimer->start(30000); // 30 second response timeout
+}
+
+/**
+ * @brief Writes the transfer header of one file.
+ *
+ * @param index Position of the file in the batch
+ * @param sessionCount Number of files announced on this connection
+ */
+void PeerSession::writeHeader(int index, int sessionCount)
+{
+    QFileInfo info(files[index]);
+    Protocol::TransferHeader header;
+    header.fileName = info.fileName();
+    header.fileSize = sizes[index];
+    header.transferId = Protocol::newTransferId();
+    if (sessionCount > 1)
+    {
+        header.options.insert("session", QByteArray::number(sessionCount));
+        header.options.insert("manifest", "1");
+    }
+    if (Config::getResumeEnabled())
+        header.options.insert("mtime", QByteArray::number(info.lastModified().toMSecsSinceEpoch()));
+    if (Config::getIntegrityCheckEnabled())
+        header.options.insert("hash", StreamHasher::ALGORITHM);
+
+    QByteArray line = header.encode(protocolVersion);
+    bytesQueued += line.size();
+    socket->write(line);
+}
+
+/**
+ * @brief Processes the session acknowledgement and the per-file replies.
+ */
+void PeerSession::onReadyRead()
+{
+    QByteArray line;
+    while (socket)
+    {
+        Protocol::ReadStatus status = Protocol::readMessage(socket, protocolVersion, &line);
+        if (status == Protocol::ReadStatus::Incomplete)
+            break;
+        if (status == Protocol::ReadStatus::Malformed)
+        {
+            failRemaining();
+            return;
+        }
+
+        int acknowledged = 0;
+        if (mode == Mode::Probing && Protocol::decodeSessionAck(line, &acknowledged))
+        {
+            // The receiver keeps the connection open for the whole batch
+            mode = Mode::Session;
+            for (int i = 1; i < headerOrder.size(); ++i)
+                writeHeader(headerOrder[i], headerOrder.size());
+            responseTimer->start(30000);
+            continue;
+        }
+
+        if (mode == Mode::Probing)
+        {
+            // Answered the first header directly: the receiver has no sessions
+            mode = Mode::Legacy;
+            headerOrder = headerOrder.mid(0, 1);
+        }
+
+        handleReply(line);
+    }
+}
+
+/**
+ * @brief Applies the receiver's answer to the next announced file, or to all of them.
+ *
+ * A receiver that knows manifests answers the whole session with one
+ * Protocol::BatchReply once the user decided on every file.
+ *
+ * @param line "OK", "OK|offset=N", "OK|hash=blake2b" or "NO", "BATCH|bitmap...", or a reply frame
+ */
+void PeerSession::handleReply(const QByteArray &line)
+{
+    Protocol::BatchReply batch;
+    if (Protocol::BatchReply::decode(line, &batch))
+    {
+        if (batch.replies.size() != headerOrder.size() - replyIndex)
+        {
+            failRemaining();
+            return;
+        }
+        for (const Protocol::TransferReply &reply : batch.replies)
+        {
+            if (!socket || !applyReply(reply))
+                return;
+        }
+        return;
+    }
+
+    Protocol::TransferReply reply;
+    if (!Protocol::TransferReply::decode(line, &reply))
+    {
+        failRemaining();
+        return;
+    }
+    applyReply(reply);
+}
+
+/**
+ * @brief Applies one reply to the next announced file.
+ *
+ * @return false if the reply was not valid and the session was failed
+ */
+bool PeerSession::applyReply(const Protocol::TransferReply &reply)
+{
+    if (replyIndex >= headerOrder.size())
+    {
+        failRemaining();
+        return false;
+    }
+
+    int index = headerOrder[replyIndex++];
+    if (replyIndex < headerOrder.size())
+        responseTimer->start(30000);
+    else
+        responseTimer->stop();
+
+    if (reply.accepted)
+    {
+        // The receiver kept a partial copy and expects the rest only
+        qint64 offset = reply.options.value("offset", "0").toLongLong();
+        QByteArray hash = reply.options.value("hash");
+        if (offset < 0 || (offset > 0 && offset >= sizes[index]) ||
+            (!hash.isEmpty() && hash != StreamHasher::ALGORITHM))
+        {
+            failRemaining();
+            return false;
+        }
+
+        offsets[index] = offset;
+        verified[index] = !hash.isEmpty();
+        states[index] = FileState::Accepted;
+        emit transferAccepted(index);
+        acceptedQueue.append(index);
+        fillSocket();
+    }
+    else
+    {
+        states[index] = FileState::Done;
+        emit transferRefused(index);
+        finishIfResolved();
+    }
+    return true;
+}
+
+/**
+ * @brief Opens the next accepted file for reading.
+ *
+ * @return false if no accepted file is waiting
+ */
+bool PeerSession::beginNextFile()
+{
+    if (acceptedQueue.isEmpty())
+        return false;
+
+    int index = acceptedQueue.takeFirst();
+    source = TransferSource::create(files[index]);
+    if (!source->open())
+    {
+        // The receiver expects this file's bytes next, the stream cannot go on
+        delete source;
+        source = nullptr;
+        failRemaining();
+        return false;
+    }
+
+    sendingIndex = index;
+    position = offsets[index];
+
+    if (verified[index])
+    {
+        // Read back on a pool thread while the data is on its way
+        hasher = new StreamHasher();
+        hasher->addFileRange(files[index], 0, sizes[index]);
+    }
+
+    InFlight entry;
+    entry.index = index;
+    entry.offset = position;
+    entry.startMark = bytesQueued;
+    entry.endMark = bytesQueued + sizes[index] - position;
+    inFlight.append(entry);
+    return true;
+}
+
+/**
+ * @brief Keeps the socket filled up to the adaptive window.
+ *
+ * Accepted files are streamed back to back, so the connection never idles
+ * between two small files. A bandwidth cap pauses the loop and throttleTimer
+ * continues it.
+ */
+void PeerSession::fillSocket()
+{
+    while (socket && socket->bytesToWrite() < sendWindow.highWater())
+    {
+        if (sendingIndex < 0 && !beginNextFile())
+            break;
+
+        qint64 size = sizes[sendingIndex];
+        if (position >= size)
+        {
+            if (!endCurrentFile())
+                return;
+            continue;
+        }
+
+        int wait = BandwidthShaper::delay(receiverAddress, &sessionBucket);
+        if (wait > 0)
+        {
+            if (!throttleTimer->isActive())
+                throttleTimer->start(wait);
+            break;
+        }
+
+        // Back here once the disk caught up, the socket drains meanwhile
+        if (!source->readyAt(position, this, [this]() { fillSocket(); }))
+            break;
+
+        const char *data = nullptr;
+        qint64 length = source->readChunk(position, BandwidthShaper::step(qMin<qint64>(sendWindow.chunkSize(), size - position)), &data);
+        if (length <= 0 || socket->write(data, length) < 1)
+        {
+            failRemaining();
+            return;
+        }
+
+        position += length;
+        bytesQueued += length;
+        BandwidthShaper::consume(receiverAddress, &sessionBucket, length);
+
+        // The trailer has to be queued before the file counts as flushed
+        if (position >= size && !endCurrentFile())
+            return;
+    }
+
+    drainFlushed();
+}
+
+/**
+ * @brief Closes the file just queued, writing its trailer first when verified.
+ *
+ * @return false if the trailer could not be written (the session is failed)
+ */
+bool PeerSession::endCurrentFile()
+{
+    if (hasher)
+    {
+        QByteArray digest = hasher->result();
+        delete hasher;
+        hasher = nullptr;
+        QByteArray trailer = Protocol::encodeTrailer(protocolVersion, digest);
+        if (digest.isEmpty() || socket->write(trailer) != trailer.size())
+        {
+            failRemaining();
+            return false;
+        }
+        bytesQueued += trailer.size();
+        inFlight.last().endMark += trailer.size();
+    }
+
+    source->close();
+    delete source;
+    source = nullptr;
+    sendingIndex = -1;
+    return true;
+}
+
+/**
+ * @brief Accounts for written bytes and refills the socket.
+ *
+ * @param bytes Number of bytes Qt handed to the operating system
+ */
+void PeerSession::onBytesWritten(qint64 bytes)
+{
+    bytesFlushed += bytes;
+    drainFlushed();
+    if (!socket)
+        return;
+
+    sendWindow.recordWritten(bytes, socket->bytesToWrite());
+    if (socket->bytesToWrite() <= sendWindow.lowWater())
+        fillSocket();
+}
+
+/**
+ * @brief Reports progress and completion of the files queued on the socket.
+ */
+void PeerSession::drainFlushed()
+{
+    while (!inFlight.isEmpty() && inFlight.first().endMark <= bytesFlushed)
+    {
+        int index = inFlight.takeFirst().index;
+        states[index] = FileState::Done;
+        reportProgress(index, 100);
+        lastProgress = -1;
+        emit transferFinished(index);
+        if (!socket) return;
+    }
+
+    if (!inFlight.isEmpty())
+    {
+        const InFlight &current = inFlight.first();
+        qint64 size = sizes[current.index];
+        if (bytesFlushed > current.startMark && size > 0)
+            reportProgress(current.index, static_cast<int>(qMin<qint64>(100, (current.offset + bytesFlushed - current.startMark) * 100 / size)));
+    }
+
+    finishIfResolved();
+}
+
+/**
+ * @brief Emits the progress of a file when its percentage changed.
+ *
+ * @param index Position of the file in the batch
+ * @param percent Completion percentage
+ */
+void PeerSession::reportProgress(int index, int percent)
+{
+    if (percent == lastProgress)
+        return;
+
+    lastProgress = percent;
+    emit sendStatsUpdated(index, sendWindow.chunkSize(), sendWindow.highWater(), sendWindow.throughput());
+    emit progressUpdated(index, percent);
+}
+
+/**
+ * @brief Closes the connection once every file it announced is resolved.
+ */
+void PeerSession::finishIfResolved()
+{
+    if (!socket)
+        return;
+
+    for (int index : headerOrder)
+    {
+        if (states[index] != FileState::Done)
+            return;
+    }
+
+    if (socket->state() != QAbstractSocket::UnconnectedState)
+        socket->disconnectFromHost();
+}
+
+/**
+ * @brief Moves on to the next connection, or ends the session.
+ *
+ * Files the receiver did not get before the connection closed are failed.
+ */
+void PeerSession::onDisconnected()
+{
+    for (int index : headerOrder)
+    {
+        if (states[index] != FileState::Done)
+        {
+            states[index] = FileState::Done;
+            emit transferError(index);
+        }
+    }
+
+    closeConnection();
+    openConnection();
+}
+
+/**
+ * @brief Fails every file that is not resolved and ends the session.
+ */
+void PeerSession::failRemaining()
+{
+    closeConnection();
+
+    for (int index = 0; index < states.size(); ++index)
+    {
+        if (states[index] != FileState::Done)
+        {
+            states[index] = FileState::Done;
+            emit transferError(index);
+        }
+    }
+
+    if (!completed)
+    {
+        completed = true;
+        emit sessionFinished();
+    }
+}
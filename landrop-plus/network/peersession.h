@@ -0,0 +1,240 @@
+/**
+ * @file peersession.h
+ * @brief Persistent connection carrying a batch of files to one receiver
+ */
+
+#ifndef PEERSESSION_H
+#define PEERSESSION_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QTimer>
+#include <QStringList>
+#include <QList>
+
+#include "../config/config.h"
+#include "protocol.h"
+#include "transfersource.h"
+#include "connectionrace.h"
+#include "sendwindow.h"
+#include "streamhasher.h"
+#include "bandwidthshaper.h"
+
+/**
+ * @class PeerSession
+ * @brief Sends many files to one receiver over a single TCP connection.
+ *
+ * The first header offers a session with "session=N". A receiver that
+ * supports sessions acknowledges right away with "SESSION|N", after which
+ * the remaining headers are sent back to back and answered in order. The
+ * header also offers "manifest=1": a receiver that knows manifests treats
+ * the headers as one batch and answers them together with a single
+ * Protocol::BatchReply, older ones answer each header on its own. Each
+ * accepted file is then streamed as exactly fileSize bytes, in header order,
+ * without any further handshake. Files the receiver verifies are each
+ * followed by their "HASH|<hex digest>" trailer line. With a v2 receiver
+ * the same messages travel as binary frames after Protocol::PREAMBLE_V2.
+ *
+ * Receivers that do not know sessions simply answer the first header; the
+ * batch then falls back to one connection per file, sent one after another.
+ */
+class PeerSession : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PeerSession(QObject *parent = nullptr);
+    ~PeerSession();
+
+    void sendFiles(const QStringList &filePaths, const QString &receiverIP, quint16 port, int version = Protocol::VERSION_1,
+                   QTcpSocket *connection = nullptr);
+
+    /** @brief Lane of the bandwidth shaper the next batch moves in. */
+    void setPriority(TransferPriority priority)
+    {
+        lane = priority;
+        sessionBucket.setPriority(priority);
+    }
+
+    /** @brief Number of files in the batch. */
+    int getFileCount() const { return files.size(); }
+
+    /** @brief Current chunk size of the connection in bytes. */
+    qint64 getChunkSize() const { return sendWindow.chunkSize(); }
+
+    /** @brief Current limit of queued bytes on the connection. */
+    qint64 getSendWindow() const { return sendWindow.highWater(); }
+
+    /** @brief Measured throughput of the connection in bytes per second. */
+    qint64 getThroughput() const { return sendWindow.throughput(); }
+
+private slots:
+    void onConnected();
+    void onReadyRead();
+    void onBytesWritten(qint64 bytes);
+    void onDisconnected();
+
+signals:
+    /**
+     * @brief Signal emitted when the receiver accepts one file of the batch.
+     * @param index Position of the file in the batch.
+     */
+    void transferAccepted(int index);
+
+    /**
+     * @brief Signal emitted when the receiver refuses one file of the batch.
+     * @param index Position of the file in the batch.
+     */
+    void transferRefused(int index);
+
+    /**
+     * @brief Signal emitted when the progress of one file changes.
+     * @param index Position of the file in the batch.
+     * @param percent Completion percentage.
+     */
+    void progressUpdated(int index, int percent);
+
+    /**
+     * @brief Signal emitted when one file has been sent completely.
+     * @param index Position of the file in the batch.
+     */
+    void transferFinished(int index);
+
+    /**
+     * @brief Signal emitted when one file could not be sent.
+     * @param index Position of the file in the batch.
+     */
+    void transferError(int index);
+
+    /**
+     * @brief Signal emitted along with progressUpdated() with the send window state.
+     * @param index Position of the file in the batch.
+     * @param chunkSize Current chunk size in bytes.
+     * @param sendWindow Current limit of queued bytes.
+     * @param throughput Measured throughput in bytes per second.
+     */
+    void sendStatsUpdated(int index, qint64 chunkSize, qint64 sendWindow, qint64 throughput);
+
+    /** @brief Signal emitted once every file of the batch is resolved. */
+    void sessionFinished();
+
+private:
+    /** How the current connection is used. */
+    enum class Mode
+    {
+        Probing, ///< First header sent, receiver capabilities unknown
+        Session, ///< Receiver acknowledged, all headers share the connection
+        Legacy   ///< One connection per file
+    };
+
+    /** Outcome of a file in the batch. */
+    enum class FileState
+    {
+        Pending,
+        Accepted,
+        Done
+    };
+
+    /**
+     * @brief One file of the batch whose bytes are queued on the socket.
+     */
+    struct InFlight
+    {
+        int index = -1;
+        qint64 offset = 0;
+        qint64 startMark = 0;
+        qint64 endMark = 0;
+    };
+
+    /** Socket of the current connection. */
+    QTcpSocket *socket = nullptr;
+
+    /** Pooled connection the first header goes out on, null once used. */
+    QTcpSocket *warmConnection = nullptr;
+
+    /** Timer for connection timeout handling. */
+    QTimer *connectionTimer;
+
+    /** Timer for response timeout handling. */
+    QTimer *responseTimer;
+
+    /** Timer refilling the socket after a bandwidth cap paused it. */
+    QTimer *throttleTimer;
+
+    /** Connects to whichever address of the receiver answers first. */
+    ConnectionRace *race;
+
+    /** Rate limit of the current connection. */
+    TokenBucket sessionBucket;
+
+    /** Lane of the batch, kept over resets. */
+    TransferPriority lane = TransferPriority::NORMAL;
+
+    /** Receiver address and port. */
+    QString receiverAddress;
+    quint16 port = 0;
+
+    /** Wire protocol version used with the receiver. */
+    int protocolVersion = Protocol::VERSION_1;
+
+    /** Files of the batch, their sizes and outcomes. */
+    QStringList files;
+    QList<qint64> sizes;
+    QList<FileState> states;
+
+    /** Offsets the receiver asked each file to continue from. */
+    QList<qint64> offsets;
+
+    /** Whether the receiver asked for each file's trailer. */
+    QList<bool> verified;
+
+    Mode mode = Mode::Probing;
+
+    /** Files announced on the current connection, in header order. */
+    QList<int> headerOrder;
+
+    /** Position in headerOrder of the next expected reply. */
+    int replyIndex = 0;
+
+    /** Accepted files not streamed yet, in header order. */
+    QList<int> acceptedQueue;
+
+    /** File currently read from disk, -1 when idle. */
+    int sendingIndex = -1;
+    TransferSource *source = nullptr;
+    StreamHasher *hasher = nullptr;
+    qint64 position = 0;
+
+    /** Chunk size and queue limits of the connection. */
+    AdaptiveSendWindow sendWindow;
+
+    /** Files whose bytes are queued but not yet written out. */
+    QList<InFlight> inFlight;
+
+    /** Last percentage reported for the file at the head of inFlight. */
+    int lastProgress = -1;
+
+    /** Bytes queued and bytes written on the current connection. */
+    qint64 bytesQueued = 0;
+    qint64 bytesFlushed = 0;
+
+    /** Whether sessionFinished() was emitted. */
+    bool completed = false;
+
+    void openConnection();
+    void closeConnection();
+    void attachSocket();
+    void writeHeader(int index, int sessionCount);
+    void handleReply(const QByteArray &line);
+    bool applyReply(const Protocol::TransferReply &reply);
+    bool beginNextFile();
+    bool endCurrentFile();
+    void fillSocket();
+    void drainFlushed();
+    void reportProgress(int index, int percent);
+    void failRemaining();
+    void finishIfResolved();
+};
+
+#endif // PEERSESSION_H
@@ -0,0 +1,52 @@
+/**
+ * @file progresscounter.cpp
+ */
+
+#include "progresscounter.h"
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWeakPointer>
+
+namespace
+{
+    struct alignas(64) Shard
+    {
+        QMutex mutex;
+        QHash<QByteArray, QWeakPointer<ProgressCounter>> counters;
+    };
+
+    Shard shards[ProgressCounters::SHARDS];
+
+    Shard &shardOf(const QByteArray &transferId)
+    {
+        return shards[qHash(transferId) % ProgressCounters::SHARDS];
+    }
+}
+
+QSharedPointer<ProgressCounter> ProgressCounters::open(const QByteArray &transferId, qint64 size)
+{
+    QSharedPointer<ProgressCounter> counter(new ProgressCounter);
+    counter->size.storeRelaxed(size);
+
+    Shard &shard = shardOf(transferId);
+    QMutexLocker lock(&shard.mutex);
+
+    // Counters nobody holds any more are dropped as the shard is written
+    for (auto it = shard.counters.begin(); it != shard.counters.end();)
+    {
+        if (it->isNull())
+            it = shard.counters.erase(it);
+        else
+            ++it;
+    }
+    shard.counters.insert(transferId, counter);
+    return counter;
+}
+
+QSharedPointer<ProgressCounter> ProgressCounters::find(const QByteArray &transferId)
+{
+    Shard &shard = shardOf(transferId);
+    QMutexLocker lock(&shard.mutex);
+    return shard.counters.value(transferId).toStrongRef();
+}
@@ -0,0 +1,56 @@
+/**
+ * @file progresscounter.h
+ * @brief Byte counters of incoming transfers, written by workers and read without locks
+ */
+
+#ifndef PROGRESSCOUNTER_H
+#define PROGRESSCOUNTER_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QSharedPointer>
+
+/**
+ * @brief Bytes received of one transfer.
+ *
+ * Only the worker receiving the transfer writes it, with relaxed stores;
+ * ProgressAggregator reads it on its ticks. Each counter takes a cache
+ * line of its own, so workers updating neighbouring counters do not
+ * invalidate each other's lines.
+ */
+struct alignas(64) ProgressCounter
+{
+    /** Bytes of the file present, resumed ones included */
+    QAtomicInteger<qint64> bytes;
+
+    /** Size of the file */
+    QAtomicInteger<qint64> size;
+
+    /** Set while ProgressAggregator reads the counter, the worker then stops posting progress signals */
+    QAtomicInt watched;
+};
+
+static_assert(sizeof(ProgressCounter) % 64 == 0, "counters fill whole cache lines");
+
+/**
+ * @namespace ProgressCounters
+ * @brief Finds the counter of an incoming transfer by its transfer ID.
+ *
+ * The table is split into SHARDS parts locked separately, so workers
+ * opening counters at the same time rarely wait for each other. Locks are
+ * only taken when a transfer is announced and looked up, never for a byte
+ * count. Entries go away with the last reference to their counter.
+ */
+namespace ProgressCounters
+{
+    /** Independently locked parts of the table. */
+    const int SHARDS = 16;
+
+    /** @brief New counter of a transfer announced with @p size bytes. */
+    QSharedPointer<ProgressCounter> open(const QByteArray &transferId, qint64 size);
+
+    /** @brief Counter of a transfer, null if none is open. */
+    QSharedPointer<ProgressCounter> find(const QByteArray &transferId);
+}
+
+#endif // PROGRESSCOUNTER_H
@@ -0,0 +1,1009 @@
+/**
+ * @file protocol.cpp
+ */
+
+#include "protocol.h"
+#include "blockmap.h"
+#include "framecodec.h"
+#include <QList>
+#include <QRandomGenerator>
+
+const QByteArray Protocol::PREAMBLE_V2 = QByteArray("\0LD2", 4);
+const QByteArray Protocol::STRIPE_PREFIX = "STRIPE|";
+const QByteArray Protocol::SESSION_PREFIX = "SESSION|";
+const QByteArray Protocol::BATCH_PREFIX = "BATCH|";
+const QByteArray Protocol::TRAILER_PREFIX = "HASH|";
+const QByteArray Protocol::DOWNLOAD_PREFIX = "DOWNLOAD_REQUEST|";
+const QByteArray Protocol::DOWNLOAD_IN_BAND = "inline";
+const QByteArray Protocol::REPAIR_PREFIX = "REPAIR|";
+const QByteArray Protocol::CATALOG_REQUEST_PREFIX = "CATALOG_REQUEST|";
+const QByteArray Protocol::CATALOG_PAGE_PREFIX = "CATALOG|";
+const QByteArray Protocol::RANGE_REQUEST_PREFIX = "RANGE_REQUEST|";
+const QByteArray Protocol::SPARSE_PREFIX = "SPARSE|";
+
+namespace
+{
+    /** Frames made of numbers only */
+    typedef FrameCodec::Frame<Protocol::FRAME_SESSION, quint32> SessionAckFrame;
+    typedef FrameCodec::Frame<Protocol::FRAME_CATALOG_REQUEST, quint32> CatalogRequestFrame;
+    typedef FrameCodec::Frame<Protocol::FRAME_CATALOG_REQUEST, quint32, quint64, quint64> CatalogDeltaRequestFrame;
+
+    template <typename T>
+    void appendNumber(QByteArray &out, T value)
+    {
+        char field[sizeof(T)];
+        FrameCodec::store<T>(field, value);
+        out.append(field, sizeof(T));
+    }
+
+    void appendString(QByteArray &out, const QByteArray &value)
+    {
+        QByteArray bounded = value.left(0xffff);
+        appendNumber<quint16>(out, quint16(bounded.size()));
+        out.append(bounded);
+    }
+
+    void appendOptions(QByteArray &out, const Protocol::Options &options)
+    {
+        appendNumber<quint16>(out, quint16(qMin<qsizetype>(options.size(), 0xffff)));
+        for (auto it = options.constBegin(); it != options.constEnd(); ++it)
+        {
+            QByteArray key = it.key().left(0xff);
+            out.append(char(key.size()));
+            out.append(key);
+            appendString(out, it.value());
+        }
+    }
+
+    QByteArray frame(Protocol::FrameType type, const QByteArray &payload)
+    {
+        QByteArray out;
+        out.reserve(5 + payload.size());
+        out.append(char(type));
+        appendNumber<quint32>(out, quint32(payload.size()));
+        out.append(payload);
+        return out;
+    }
+
+    bool isFrame(const QByteArray &message, Protocol::FrameType type)
+    {
+        return !message.isEmpty() && quint8(message.at(0)) == type;
+    }
+
+    /**
+     * @brief Bounds-checked reader over the payload of a v2 message.
+     */
+    class FrameReader
+    {
+    public:
+        explicit FrameReader(const QByteArray &message) : data(message), pos(1) {}
+
+        template <typename T>
+        T number()
+        {
+            if (!ok || data.size() - pos < int(sizeof(T)))
+            {
+                ok = false;
+                return 0;
+            }
+            T value = FrameCodec::load<T>(data.constData() + pos);
+            pos += sizeof(T);
+            return value;
+        }
+
+        QByteArray bytes(int length)
+        {
+            if (!ok || length < 0 || data.size() - pos < length)
+            {
+                ok = false;
+                return QByteArray();
+            }
+            QByteArray value = data.mid(pos, length);
+            pos += length;
+            return value;
+        }
+
+        QByteArray string() { return bytes(number<quint16>()); }
+
+        Protocol::Options options()
+        {
+            Protocol::Options result;
+            int count = number<quint16>();
+            for (int i = 0; ok && i < count; ++i)
+            {
+                QByteArray key = bytes(number<quint8>());
+                QByteArray value = string();
+                if (ok && !key.isEmpty())
+                    result.insert(key, value);
+            }
+            return result;
+        }
+
+        /** @brief Whether every read so far was within the payload. */
+        bool valid() const { return ok; }
+
+        /** @brief Whether the whole payload was read, later fields are optional. */
+        bool atEnd() const { return pos >= data.size(); }
+
+    private:
+        const QByteArray &data;
+        int pos;
+        bool ok = true;
+    };
+}
+
+/**
+ * @brief Serializes options as "key=value;key=value".
+ */
+QByteArray Protocol::encodeOptions(const Options &options)
+{
+    QByteArray field;
+    for (auto it = options.constBegin(); it != options.constEnd(); ++it)
+    {
+        if (!field.isEmpty())
+            field += ';';
+        field += it.key() + '=' + it.value();
+    }
+    return field;
+}
+
+/**
+ * @brief Parses an options field, ignoring malformed entries.
+ */
+Protocol::Options Protocol::decodeOptions(const QByteArray &field)
+{
+    Options options;
+    for (const QByteArray &entry : field.split(';'))
+    {
+        int separator = entry.indexOf('=');
+        if (separator <= 0)
+            continue;
+        options.insert(entry.left(separator).trimmed(), entry.mid(separator + 1).trimmed());
+    }
+    return options;
+}
+
+/**
+ * @brief Capability bits matching the options a peer sent.
+ */
+quint32 Protocol::capabilitiesOf(const Options &options)
+{
+    quint32 capabilities = 0;
+    if (options.contains("stripes"))
+        capabilities |= CAP_STRIPES;
+    if (options.contains("mtime") || options.contains("offset"))
+        capabilities |= CAP_RESUME;
+    if (options.contains("delta"))
+        capabilities |= CAP_DELTA;
+    if (options.contains("compress"))
+        capabilities |= CAP_COMPRESSION;
+    if (options.contains("hash"))
+        capabilities |= CAP_HASH;
+    if (options.contains("session"))
+        capabilities |= CAP_SESSION;
+    if (options.contains("mcast"))
+        capabilities |= CAP_MULTICAST;
+    if (options.contains("archive"))
+        capabilities |= CAP_ARCHIVE;
+    if (options.contains("content") || options.contains("have"))
+        capabilities |= CAP_DEDUP;
+    if (options.contains("manifest"))
+        capabilities |= CAP_MANIFEST;
+    return capabilities;
+}
+
+int Protocol::versionFromDiscovery(const QString &advertised)
+{
+    return advertised.trimmed() == QString::number(VERSION_2) ? VERSION_2 : VERSION_1;
+}
+
+Protocol::ReadStatus Protocol::readMessage(QIODevice *device, int version, QByteArray *message)
+{
+    if (version < VERSION_2)
+    {
+        if (!device->canReadLine())
+            return device->bytesAvailable() > MAX_CONTROL_FRAME ? ReadStatus::Malformed : ReadStatus::Incomplete;
+        *message = device->readLine();
+        return ReadStatus::Complete;
+    }
+
+    char header[FrameCodec::Prefix::SIZE];
+    quint8 type = 0;
+    quint32 length = 0;
+    if (!FrameCodec::Prefix::read(header, device->peek(header, sizeof(header)), type, length))
+        return ReadStatus::Incomplete;
+
+    if (type < FRAME_HEADER || type > FRAME_SPARSE_MAP || length > MAX_CONTROL_FRAME)
+        return ReadStatus::Malformed;
+    if (device->bytesAvailable() < FrameCodec::Prefix::SIZE + qint64(length))
+        return ReadStatus::Incomplete;
+
+    // The type byte stays in front of the payload, read in one go
+    QByteArray frame(1 + qsizetype(length), Qt::Uninitialized);
+    device->skip(FrameCodec::Prefix::SIZE);
+    frame[0] = char(type);
+    if (device->read(frame.data() + 1, length) != qint64(length))
+        return ReadStatus::Malformed;
+    *message = frame;
+    return ReadStatus::Complete;
+}
+
+QByteArray Protocol::newTransferId()
+{
+    return QByteArray::number(QRandomGenerator::global()->generate64(), 16).rightJustified(16, '0');
+}
+
+QByteArray Protocol::TransferHeader::encode(int version) const
+{
+    Options sent = options;
+    if (!transferId.isEmpty())
+        sent.insert("id", transferId);
+
+    if (version >= VERSION_2)
+    {
+        QByteArray payload;
+        appendNumber<quint64>(payload, quint64(fileSize));
+        appendNumber<quint32>(payload, capabilitiesOf(sent));
+        appendString(payload, fileName.toUtf8());
+        appendOptions(payload, sent);
+        return frame(FRAME_HEADER, payload);
+    }
+
+    QByteArray line = fileName.toUtf8() + '|' + QByteArray::number(fileSize);
+    if (!sent.isEmpty())
+        line += '|' + encodeOptions(sent);
+    return line + '\n';
+}
+
+/**
+ * @brief Parses a "filename|filesize[|options]" line.
+ * @return false if the line is not a valid transfer header
+ */
+bool Protocol::TransferHeader::decode(const QByteArray &line, TransferHeader *header)
+{
+    if (isFrame(line, FRAME_HEADER))
+    {
+        FrameReader reader(line);
+        header->fileSize = qint64(reader.number<quint64>());
+        header->capabilities = reader.number<quint32>();
+        header->fileName = QString::fromUtf8(reader.string());
+        header->options = reader.options();
+        header->transferId = header->options.take("id");
+        return reader.valid() && !header->fileName.isEmpty() && header->fileSize >= 0;
+    }
+
+    QList<QByteArray> fields = line.trimmed().split('|');
+    if (fields.size() < 2)
+        return false;
+
+    bool ok = false;
+    header->fileName = QString::fromUtf8(fields[0]);
+    header->fileSize = fields[1].toLongLong(&ok);
+    header->options = fields.size() > 2 ? decodeOptions(fields[2]) : Options();
+    header->transferId = header->options.take("id");
+    header->capabilities = capabilitiesOf(header->options);
+    return ok && !header->fileName.isEmpty() && header->fileSize >= 0;
+}
+
+QByteArray Protocol::TransferReply::encode(int version) const
+{
+    if (version >= VERSION_2)
+    {
+        QByteArray payload;
+        payload.append(char(accepted ? 1 : 0));
+        appendNumber<quint32>(payload, accepted ? capabilitiesOf(options) : 0);
+        appendOptions(payload, accepted ? options : Options());
+        return frame(FRAME_REPLY, payload);
+    }
+
+    QByteArray line = accepted ? "OK" : "NO";
+    if (accepted && !options.isEmpty())
+        line += '|' + encodeOptions(options);
+    return line + '\n';
+}
+
+/**
+ * @brief Parses "OK", "NO" or "OK|options".
+ * @return false if the line is neither an acceptance nor a refusal
+ */
+bool Protocol::TransferReply::decode(const QByteArray &line, TransferReply *reply)
+{
+    if (isFrame(line, FRAME_REPLY))
+    {
+        FrameReader reader(line);
+        reply->accepted = (reader.number<quint8>() != 0);
+        reply->capabilities = reader.number<quint32>();
+        reply->options = reader.options();
+        return reader.valid();
+    }
+
+    QByteArray trimmed = line.trimmed();
+    int separator = trimmed.indexOf('|');
+    QByteArray verdict = separator < 0 ? trimmed : trimmed.left(separator);
+
+    if (verdict != "OK" && verdict != "NO")
+        return false;
+
+    reply->accepted = (verdict == "OK");
+    reply->options = separator < 0 ? Options() : decodeOptions(trimmed.mid(separator + 1));
+    reply->capabilities = capabilitiesOf(reply->options);
+    return true;
+}
+
+QByteArray Protocol::BatchReply::encode(int version) const
+{
+    if (version >= VERSION_2)
+    {
+        QByteArray payload;
+        appendNumber<quint32>(payload, quint32(replies.size()));
+        for (const TransferReply &reply : replies)
+        {
+            payload.append(char(reply.accepted ? 1 : 0));
+            appendNumber<quint32>(payload, reply.accepted ? capabilitiesOf(reply.options) : 0);
+            appendOptions(payload, reply.accepted ? reply.options : Options());
+        }
+        return frame(FRAME_BATCH_REPLY, payload);
+    }
+
+    QByteArray bitmap;
+    QByteArray details;
+    for (int index = 0; index < replies.size(); ++index)
+    {
+        const TransferReply &reply = replies[index];
+        bitmap += reply.accepted ? '1' : '0';
+        if (reply.accepted && !reply.options.isEmpty())
+            details += '|' + QByteArray::number(index) + ':' + encodeOptions(reply.options);
+    }
+    return BATCH_PREFIX + bitmap + details + '\n';
+}
+
+/**
+ * @brief Parses "BATCH|bitmap[|index:options...]" or a batch reply frame.
+ * @return false if the message is not a batch reply
+ */
+bool Protocol::BatchReply::decode(const QByteArray &message, BatchReply *batch)
+{
+    batch->replies.clear();
+    if (isFrame(message, FRAME_BATCH_REPLY))
+    {
+        FrameReader reader(message);
+        int count = int(reader.number<quint32>());
+        for (int i = 0; reader.valid() && i < count; ++i)
+        {
+            TransferReply reply;
+            reply.accepted = (reader.number<quint8>() != 0);
+            reply.capabilities = reader.number<quint32>();
+            reply.options = reader.options();
+            batch->replies.append(reply);
+        }
+        return reader.valid();
+    }
+
+    QByteArray line = message.trimmed();
+    if (!line.startsWith(BATCH_PREFIX))
+        return false;
+
+    QList<QByteArray> fields = line.mid(BATCH_PREFIX.size()).split('|');
+    for (char bit : fields.first())
+    {
+        if (bit != '0' && bit != '1')
+            return false;
+        TransferReply reply;
+        reply.accepted = (bit == '1');
+        batch->replies.append(reply);
+    }
+
+    for (int i = 1; i < fields.size(); ++i)
+    {
+        int separator = fields[i].indexOf(':');
+        bool ok = false;
+        int index = fields[i].left(separator).toInt(&ok);
+        if (separator <= 0 || !ok || index < 0 || index >= batch->replies.size() || !batch->replies[index].accepted)
+            return false;
+        batch->replies[index].options = decodeOptions(fields[i].mid(separator + 1));
+        batch->replies[index].capabilities = capabilitiesOf(batch->replies[index].options);
+    }
+    return true;
+}
+
+QByteArray Protocol::encodeStripeJoin(int version, const QByteArray &token, int index)
+{
+    if (version < VERSION_2)
+        return STRIPE_PREFIX + token + '|' + QByteArray::number(index) + '\n';
+
+    QByteArray payload;
+    appendString(payload, token);
+    appendNumber<quint32>(payload, quint32(index));
+    return frame(FRAME_STRIPE, payload);
+}
+
+/**
+ * @brief Parses "STRIPE|token|index" or a stripe frame.
+ * @return false if the message does not announce a stripe
+ */
+bool Protocol::decodeStripeJoin(const QByteArray &message, QByteArray *token, int *index)
+{
+    if (isFrame(message, FRAME_STRIPE))
+    {
+        FrameReader reader(message);
+        *token = reader.string();
+        *index = int(reader.number<quint32>());
+        return reader.valid();
+    }
+
+    QByteArray line = message.trimmed();
+    if (!line.startsWith(STRIPE_PREFIX))
+        return false;
+    QList<QByteArray> parts = line.split('|');
+    if (parts.size() < 3)
+        return false;
+    *token = parts[1];
+    *index = parts[2].toInt();
+    return true;
+}
+
+QByteArray Protocol::encodeSessionAck(int version, int count)
+{
+    if (version < VERSION_2)
+        return SESSION_PREFIX + QByteArray::number(count) + '\n';
+
+    return SessionAckFrame::encode(quint32(count));
+}
+
+bool Protocol::decodeSessionAck(const QByteArray &message, int *count)
+{
+    quint32 frameCount = 0;
+    if (SessionAckFrame::decode(message, frameCount))
+    {
+        *count = int(frameCount);
+        return true;
+    }
+    if (isFrame(message, FRAME_SESSION))
+        return false;
+
+    QByteArray line = message.trimmed();
+    if (!line.startsWith(SESSION_PREFIX))
+        return false;
+    *count = line.mid(SESSION_PREFIX.size()).toInt();
+    return true;
+}
+
+/**
+ * @param digest Raw digest of the file
+ * @param blockSums CRC-32C of each block of the file, when the receiver asked for them
+ */
+QByteArray Protocol::encodeTrailer(int version, const QByteArray &digest, const QVector<quint32> &blockSums)
+{
+    QByteArray sums = BlockMap::encodeChecksums(blockSums);
+    if (version < VERSION_2)
+    {
+        QByteArray line = TRAILER_PREFIX + digest.toHex();
+        if (!sums.isEmpty())
+            line += '|' + sums.toBase64();
+        return line + '\n';
+    }
+    return frame(FRAME_TRAILER, digest + sums);
+}
+
+/**
+ * @param digest Receives the raw digest
+ * @param blockSums Receives the block checksums, empty if the trailer has none
+ */
+bool Protocol::decodeTrailer(const QByteArray &message, QByteArray *digest, QVector<quint32> *blockSums)
+{
+    QByteArray sums;
+    if (isFrame(message, FRAME_TRAILER))
+    {
+        *digest = message.mid(1, DIGEST_SIZE);
+        sums = message.mid(1 + DIGEST_SIZE);
+    }
+    else
+    {
+        QByteArray line = message.trimmed();
+        if (!line.startsWith(TRAILER_PREFIX))
+            return false;
+        QList<QByteArray> fields = line.mid(TRAILER_PREFIX.size()).split('|');
+        *digest = QByteArray::fromHex(fields[0]);
+        if (fields.size() > 1)
+            sums = QByteArray::fromBase64(fields[1]);
+    }
+
+    if (blockSums)
+        return BlockMap::decodeChecksums(sums, blockSums);
+    return true;
+}
+
+/**
+ * @param port Port the file is sent to when it is not sent on the request connection
+ * @param inBand Whether to ask for the file on the request connection
+ */
+QByteArray Protocol::encodeDownloadRequest(int version, const QString &relativePath, const QString &fileName, quint16 port,
+                                           bool inBand, qint64 offset, qint64 length)
+{
+    Options range;
+    if (offset > 0)
+        range.insert("offset", QByteArray::number(offset));
+    if (length >= 0)
+        range.insert("length", QByteArray::number(length));
+
+    if (version < VERSION_2)
+    {
+        QByteArray line = DOWNLOAD_PREFIX + relativePath.toUtf8() + '|' + fileName.toUtf8() + '|' + QByteArray::number(port);
+        if (inBand || !range.isEmpty())
+            line += '|' + (inBand ? DOWNLOAD_IN_BAND : QByteArray());
+        if (!range.isEmpty())
+            line += '|' + encodeOptions(range);
+        return line + '\n';
+    }
+
+    QByteArray payload;
+    appendString(payload, relativePath.toUtf8());
+    appendString(payload, fileName.toUtf8());
+    appendNumber<quint16>(payload, port);
+    if (inBand || !range.isEmpty())
+        payload.append(char(inBand ? 1 : 0));
+    if (!range.isEmpty())
+        appendOptions(payload, range);
+    return frame(FRAME_DOWNLOAD, payload);
+}
+
+/**
+ * @brief Parses "DOWNLOAD_REQUEST|relativePath|fileName|clientPort[|inline][|offset=N;length=M]" or a download frame.
+ *
+ * Older peers only read the first fields and send the whole file, a
+ * requester asking for a range has to accept that.
+ *
+ * @param inBand Receives whether the file is wanted on the request connection, may be null
+ * @param offset Receives the first byte wanted, 0 from the start; may be null
+ * @param length Receives the bytes wanted, -1 up to the end of the file; may be null
+ * @return false if the message is not a download request
+ */
+bool Protocol::decodeDownloadRequest(const QByteArray &message, QString *relativePath, QString *fileName, quint16 *port,
+                                     bool *inBand, qint64 *offset, qint64 *length)
+{
+    bool wanted = false;
+    Options range;
+    if (isFrame(message, FRAME_DOWNLOAD))
+    {
+        FrameReader reader(message);
+        *relativePath = QString::fromUtf8(reader.string());
+        *fileName = QString::fromUtf8(reader.string());
+        *port = reader.number<quint16>();
+        wanted = reader.valid() && !reader.atEnd() && reader.number<quint8>() == 1;
+        if (reader.valid() && !reader.atEnd())
+            range = reader.options();
+        if (!reader.valid())
+            return false;
+    }
+    else
+    {
+        QByteArray line = message.trimmed();
+        if (!line.startsWith(DOWNLOAD_PREFIX))
+            return false;
+        QStringList parts = QString::fromUtf8(line).split('|');
+        if (parts.size() < 4)
+            return false;
+        *relativePath = parts[1];
+        *fileName = parts[2];
+        *port = parts[3].toUShort();
+        wanted = parts.size() > 4 && parts[4].toUtf8() == DOWNLOAD_IN_BAND;
+        if (parts.size() > 5)
+            range = decodeOptions(parts[5].toUtf8());
+    }
+
+    if (inBand)
+        *inBand = wanted;
+    if (offset)
+        *offset = qMax<qint64>(0, range.value("offset", "0").toLongLong());
+    if (length)
+        *length = qMax<qint64>(-1, range.value("length", "-1").toLongLong());
+    return true;
+}
+
+QByteArray Protocol::encodeCatalogRequest(int version, int offset, quint64 sinceGeneration, quint64 baseVersion)
+{
+    if (version < VERSION_2)
+    {
+        QByteArray line = CATALOG_REQUEST_PREFIX + QByteArray::number(offset);
+        if (sinceGeneration > 0)
+            line += '|' + QByteArray::number(sinceGeneration) + '|' + QByteArray::number(baseVersion, 16);
+        return line + '\n';
+    }
+
+    if (sinceGeneration > 0)
+        return CatalogDeltaRequestFrame::encode(quint32(offset), sinceGeneration, baseVersion);
+    return CatalogRequestFrame::encode(quint32(offset));
+}
+
+/**
+ * @brief Parses "CATALOG_REQUEST|offset[|generation|hex version]" or a catalog request frame.
+ * @param offset Receives the first entry wanted
+ * @param sinceGeneration Receives the generation the requester holds, 0 if none; may be null
+ * @param baseVersion Receives the version of the requester's copy; may be null
+ * @return false if the message is not a catalog request
+ */
+bool Protocol::decodeCatalogRequest(const QByteArray &message, int *offset, quint64 *sinceGeneration,
+                                    quint64 *baseVersion)
+{
+    quint64 since = 0;
+    quint64 base = 0;
+    bool ok = false;
+    if (isFrame(message, FRAME_CATALOG_REQUEST))
+    {
+        // The generation and version are there in full or not at all
+        quint32 first = 0;
+        if (message.size() > CatalogRequestFrame::MESSAGE_SIZE)
+            ok = CatalogDeltaRequestFrame::decode(message, first, since, base);
+        else
+            ok = CatalogRequestFrame::decode(message, first);
+        *offset = int(first);
+        ok = ok && *offset >= 0;
+    }
+    else
+    {
+        QByteArray line = message.trimmed();
+        if (!line.startsWith(CATALOG_REQUEST_PREFIX))
+            return false;
+        QList<QByteArray> fields = line.mid(CATALOG_REQUEST_PREFIX.size()).split('|');
+        *offset = fields[0].toInt(&ok);
+        ok = ok && *offset >= 0;
+        if (ok && fields.size() >= 3)
+        {
+            bool generationOk = false;
+            bool versionOk = false;
+            since = fields[1].toULongLong(&generationOk);
+            base = fields[2].toULongLong(&versionOk, 16);
+            if (!generationOk || !versionOk)
+                since = base = 0;
+        }
+    }
+
+    if (sinceGeneration)
+        *sinceGeneration = since;
+    if (baseVersion)
+        *baseVersion = base;
+    return ok;
+}
+
+QByteArray Protocol::encodeRangeRequest(int version, const QString &relativePath, const QByteArray &content, qint64 offset,
+                                        qint64 length)
+{
+    if (version < VERSION_2)
+        return RANGE_REQUEST_PREFIX + content + '|' + QByteArray::number(offset) + '|' + QByteArray::number(length) + '|' +
+               relativePath.toUtf8() + '\n';
+
+    QByteArray payload;
+    appendString(payload, content);
+    appendNumber<quint64>(payload, quint64(offset));
+    appendNumber<quint64>(payload, quint64(length));
+    appendString(payload, relativePath.toUtf8());
+    return frame(FRAME_RANGE_REQUEST, payload);
+}
+
+/**
+ * @brief Parses "RANGE_REQUEST|hex content|offset|length|relativePath" or a range request frame.
+ *
+ * The path is the last field, so it may contain '|'. The reply is a
+ * TransferReply whose "length" option gives the bytes following it.
+ *
+ * @param content Receives the hex hash the requester expects the file to have, may be empty
+ * @return false if the message is not a range request
+ */
+bool Protocol::decodeRangeRequest(const QByteArray &message, QString *relativePath, QByteArray *content, qint64 *offset,
+                                  qint64 *length)
+{
+    if (isFrame(message, FRAME_RANGE_REQUEST))
+    {
+        FrameReader reader(message);
+        *content = reader.string();
+        *offset = qint64(reader.number<quint64>());
+        *length = qint64(reader.number<quint64>());
+        *relativePath = QString::fromUtf8(reader.string());
+        return reader.valid() && *offset >= 0 && *length >= 0;
+    }
+
+    QByteArray line = message.trimmed();
+    if (!line.startsWith(RANGE_REQUEST_PREFIX))
+        return false;
+    QList<QByteArray> fields = line.mid(RANGE_REQUEST_PREFIX.size()).split('|');
+    if (fields.size() < 4)
+        return false;
+    bool offsetOk = false;
+    bool lengthOk = false;
+    *content = fields[0];
+    *offset = fields[1].toLongLong(&offsetOk);
+    *length = fields[2].toLongLong(&lengthOk);
+    int pathStart = RANGE_REQUEST_PREFIX.size() + fields[0].size() + fields[1].size() + fields[2].size() + 3;
+    *relativePath = QString::fromUtf8(line.mid(pathStart));
+    return offsetOk && lengthOk && *offset >= 0 && *length >= 0;
+}
+
+/**
+ * @param ranges Offset and length of each data range, in file order
+ */
+QByteArray Protocol::encodeSparseMap(int version, const QList<QPair<qint64, qint64>> &ranges)
+{
+    if (version < VERSION_2)
+    {
+        QByteArray line = SPARSE_PREFIX;
+        for (int i = 0; i < ranges.size(); ++i)
+        {
+            if (i > 0)
+                line += ',';
+            line += QByteArray::number(ranges[i].first) + ':' + QByteArray::number(ranges[i].second);
+        }
+        return line + '\n';
+    }
+
+    QByteArray payload;
+    appendNumber<quint32>(payload, quint32(ranges.size()));
+    for (const QPair<qint64, qint64> &range : ranges)
+    {
+        appendNumber<quint64>(payload, quint64(range.first));
+        appendNumber<quint64>(payload, quint64(range.second));
+    }
+    return frame(FRAME_SPARSE_MAP, payload);
+}
+
+/**
+ * @brief Parses the data ranges of a sparse file.
+ * @return false if the message is not a sparse map, or its ranges overlap
+ *         or are out of order
+ */
+bool Protocol::decodeSparseMap(const QByteArray &message, QList<QPair<qint64, qint64>> *ranges)
+{
+    ranges->clear();
+    if (isFrame(message, FRAME_SPARSE_MAP))
+    {
+        FrameReader reader(message);
+        quint32 count = reader.number<quint32>();
+        for (quint32 i = 0; reader.valid() && i < count; ++i)
+        {
+            qint64 offset = qint64(reader.number<quint64>());
+            qint64 length = qint64(reader.number<quint64>());
+            ranges->append(qMakePair(offset, length));
+        }
+        if (!reader.valid())
+            return false;
+    }
+    else
+    {
+        QByteArray line = message.trimmed();
+        if (!line.startsWith(SPARSE_PREFIX))
+            return false;
+        QByteArray fields = line.mid(SPARSE_PREFIX.size());
+        for (const QByteArray &field : fields.split(','))
+        {
+            if (field.isEmpty() && fields.isEmpty())
+                break;
+            int separator = field.indexOf(':');
+            bool offsetOk = false;
+            bool lengthOk = false;
+            qint64 offset = field.left(separator).toLongLong(&offsetOk);
+            qint64 length = field.mid(separator + 1).toLongLong(&lengthOk);
+            if (separator <= 0 || !offsetOk || !lengthOk)
+                return false;
+            ranges->append(qMakePair(offset, length));
+        }
+    }
+
+    qint64 end = 0;
+    for (const QPair<qint64, qint64> &range : *ranges)
+    {
+        if (range.first < end || range.second <= 0)
+            return false;
+        end = range.first + range.second;
+    }
+    return true;
+}
+
+QByteArray Protocol::CatalogPage::encode(int version) const
+{
+    if (version < VERSION_2)
+        return CATALOG_PAGE_PREFIX + QByteArray::number(catalogVersion, 16) + '|' + QByteArray::number(total) + '|' +
+               QByteArray::number(offset) + '|' + data.toBase64() + '|' + QByteArray::number(generation) + '|' +
+               (delta ? "delta" : "full") + '\n';
+
+    QByteArray payload;
+    appendNumber<quint64>(payload, catalogVersion);
+    appendNumber<quint64>(payload, generation);
+    appendNumber<quint8>(payload, delta ? 1 : 0);
+    appendNumber<quint32>(payload, quint32(total));
+    appendNumber<quint32>(payload, quint32(offset));
+    payload.append(data);
+    return frame(FRAME_CATALOG_PAGE, payload);
+}
+
+/**
+ * @brief Parses a catalog page line or frame.
+ * @return false if the message is not a valid catalog page
+ */
+bool Protocol::CatalogPage::decode(const QByteArray &message, CatalogPage *page)
+{
+    if (isFrame(message, FRAME_CATALOG_PAGE))
+    {
+        FrameReader reader(message);
+        page->catalogVersion = reader.number<quint64>();
+        page->generation = reader.number<quint64>();
+        page->delta = reader.number<quint8>() == 1;
+        page->total = int(reader.number<quint32>());
+        page->offset = int(reader.number<quint32>());
+        page->data = message.mid(1 + 8 + 8 + 1 + 4 + 4);
+        return reader.valid() && page->total >= 0 && page->offset >= 0 && page->offset <= page->total;
+    }
+
+    QByteArray line = message.trimmed();
+    if (!line.startsWith(CATALOG_PAGE_PREFIX))
+        return false;
+    QList<QByteArray> fields = line.split('|');
+    if (fields.size() != 7)
+        return false;
+    bool versionOk = false;
+    bool totalOk = false;
+    bool offsetOk = false;
+    bool generationOk = false;
+    page->catalogVersion = fields[1].toULongLong(&versionOk, 16);
+    page->total = fields[2].toInt(&totalOk);
+    page->offset = fields[3].toInt(&offsetOk);
+    page->data = QByteArray::fromBase64(fields[4]);
+    page->generation = fields[5].toULongLong(&generationOk);
+    page->delta = (fields[6] == "delta");
+    return versionOk && totalOk && offsetOk && generationOk && page->total >= 0 && page->offset >= 0 &&
+           page->offset <= page->total;
+}
+
+QByteArray Protocol::RepairMessage::encode(int version) const
+{
+    if (version >= VERSION_2)
+    {
+        QByteArray payload;
+        payload.append(char(kind));
+        appendNumber<quint32>(payload, quint32(round));
+        appendString(payload, digest);
+        appendNumber<quint32>(payload, quint32(ranges.size()));
+        for (const QPair<quint32, quint32> &range : ranges)
+        {
+            appendNumber<quint32>(payload, range.first);
+            appendNumber<quint32>(payload, range.second);
+        }
+        return frame(FRAME_REPAIR, payload);
+    }
+
+    QByteArray line = REPAIR_PREFIX;
+    if (kind == RoundEnd)
+        line += "END|" + QByteArray::number(round) + '|' + digest.toHex();
+    else if (kind == Missing)
+    {
+        line += "NACK|" + QByteArray::number(round) + '|';
+        for (int i = 0; i < ranges.size(); ++i)
+        {
+            if (i > 0)
+                line += ',';
+            line += QByteArray::number(ranges[i].first) + '-' + QByteArray::number(ranges[i].second);
+        }
+    }
+    else
+        line += "DONE|" + QByteArray::number(round);
+    return line + '\n';
+}
+
+/**
+ * @brief Parses a repair line or frame.
+ * @return false if the message is not a valid repair message
+ */
+bool Protocol::RepairMessage::decode(const QByteArray &message, RepairMessage *repair)
+{
+    repair->ranges.clear();
+    repair->digest.clear();
+
+    if (isFrame(message, FRAME_REPAIR))
+    {
+        FrameReader reader(message);
+        quint8 kind = reader.number<quint8>();
+        repair->round = int(reader.number<quint32>());
+        repair->digest = reader.string();
+        quint32 count = reader.number<quint32>();
+        for (quint32 i = 0; reader.valid() && i < count; ++i)
+        {
+            quint32 first = reader.number<quint32>();
+            quint32 last = reader.number<quint32>();
+            repair->ranges.append(qMakePair(first, last));
+        }
+        repair->kind = Kind(kind);
+        return reader.valid() && kind >= RoundEnd && kind <= Done;
+    }
+
+    QByteArray line = message.trimmed();
+    if (!line.startsWith(REPAIR_PREFIX))
+        return false;
+    QList<QByteArray> parts = line.mid(REPAIR_PREFIX.size()).split('|');
+    if (parts.size() < 2)
+        return false;
+
+    bool ok = false;
+    repair->round = parts[1].toInt(&ok);
+    if (!ok)
+        return false;
+
+    if (parts[0] == "END")
+    {
+        repair->kind = RoundEnd;
+        repair->digest = parts.size() > 2 ? QByteArray::fromHex(parts[2]) : QByteArray();
+        return true;
+    }
+    if (parts[0] == "DONE")
+    {
+        repair->kind = Done;
+        return true;
+    }
+    if (parts[0] != "NACK" || parts.size() < 3)
+        return false;
+
+    repair->kind = Missing;
+    for (const QByteArray &field : parts[2].split(','))
+    {
+        int separator = field.indexOf('-');
+        bool firstOk = false;
+        bool lastOk = false;
+        quint32 first = field.left(separator).toUInt(&firstOk);
+        quint32 last = field.mid(separator + 1).toUInt(&lastOk);
+        if (separator <= 0 || !firstOk || !lastOk || last < first)
+            return false;
+        repair->ranges.append(qMakePair(first, last));
+    }
+    return true;
+}
+
+void Protocol::stripeRange(qint64 fileSize, int stripeCount, int index, qint64 *offset, qint64 *end,
+                           const QList<int> &weights)
+{
+    if (stripeCount < 1)
+        stripeCount = 1;
+    if (weights.size() < stripeCount)
+    {
+        *offset = fileSize / stripeCount * index;
+        *end = (index >= stripeCount - 1) ? fileSize : fileSize / stripeCount * (index + 1);
+        return;
+    }
+
+    qint64 total = 0;
+    qint64 before = 0;
+    for (int i = 0; i < stripeCount; ++i)
+    {
+        total += weights[i];
+        if (i < index)
+            before += weights[i];
+    }
+
+    // Split without overflowing fileSize * weight
+    auto share = [fileSize, total](qint64 weight)
+    { return fileSize / total * weight + fileSize % total * weight / total; };
+    *offset = share(before);
+    *end = (index >= stripeCount - 1) ? fileSize : share(before + weights[index]);
+}
+
+QByteArray Protocol::encodeWeights(const QList<int> &weights)
+{
+    QList<QByteArray> fields;
+    for (int weight : weights)
+        fields.append(QByteArray::number(weight));
+    return fields.join(',');
+}
+
+bool Protocol::decodeWeights(const QByteArray &value, QList<int> *weights)
+{
+    weights->clear();
+    const QList<QByteArray> fields = value.split(',');
+    for (const QByteArray &field : fields)
+    {
+        bool isNumber = false;
+        int weight = field.toInt(&isNumber);
+        if (!isNumber || weight <= 0)
+        {
+            weights->clear();
+            return false;
+        }
+        weights->append(weight);
+    }
+    return true;
+}
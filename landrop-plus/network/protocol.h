@@ -0,0 +1,313 @@
+/**
+ * @file protocol.h
+ * @brief Encoding helpers for the LANDrop TCP transfer protocol
+ */
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QList>
+#include <QMap>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+/**
+ * @namespace Protocol
+ * @brief Header and reply lines exchanged before file data.
+ *
+ * The base protocol is "filename|filesize\n" answered by "OK\n" or "NO\n".
+ * Newer peers append a third '|' field of ';'-separated key=value options.
+ * Older receivers only read the first two fields and keep answering a plain
+ * "OK", so options are always optional for both sides.
+ *
+ * Version 2 replaces the text lines with length-prefixed binary frames, so
+ * names may contain any character. A v2 connection starts with PREAMBLE_V2;
+ * every control message is then a frame of one type byte, a 32-bit
+ * big-endian payload length and the payload. Strings are UTF-8 with a
+ * 16-bit length, options a 16-bit count of (8-bit key length, key, 16-bit
+ * value length, value) entries. Headers and replies also carry a
+ * capability bitmap of the features the peer supports. File data is not
+ * framed: it follows the reply (or signature) exactly as in version 1, so
+ * kernel sends and striping work unchanged.
+ *
+ * Senders only use version 2 with peers that advertise it in discovery;
+ * receivers accept both on the same port.
+ */
+namespace Protocol
+{
+    typedef QMap<QByteArray, QByteArray> Options;
+
+    /** Text protocol understood by every LANDrop peer. */
+    const int VERSION_1 = 1;
+
+    /** Binary framed protocol. */
+    const int VERSION_2 = 2;
+
+    /** First bytes of a v2 connection; a v1 header never starts with a NUL byte. */
+    extern const QByteArray PREAMBLE_V2;
+
+    /** Frame types of version 2. */
+    enum FrameType : quint8
+    {
+        FRAME_HEADER = 1,   ///< Transfer header, file data follows once accepted
+        FRAME_REPLY = 2,    ///< Receiver's answer to a header
+        FRAME_TRAILER = 3,  ///< Raw digest after the file data, then any block checksums
+        FRAME_STRIPE = 4,   ///< Secondary connection joining a striped transfer
+        FRAME_SESSION = 5,  ///< Acknowledgement of a multi-file session
+        FRAME_DOWNLOAD = 6, ///< Request to send a shared file back
+        FRAME_REPAIR = 7,   ///< Repair round of a multicast transfer or of corrupted blocks
+        FRAME_CATALOG_REQUEST = 8, ///< Request for a page of the shared files catalog
+        FRAME_CATALOG_PAGE = 9,    ///< Page of the shared files catalog
+        FRAME_RANGE_REQUEST = 10,  ///< Request for a byte range of a shared file
+        FRAME_BATCH_REPLY = 11,    ///< Receiver's answer to every header of a manifest session
+        FRAME_SPARSE_MAP = 12      ///< Data ranges of a sparse file, before its data
+    };
+
+    /** Capability bits carried by v2 headers and replies. */
+    enum Capability : quint32
+    {
+        CAP_STRIPES = 0x01,
+        CAP_RESUME = 0x02,
+        CAP_DELTA = 0x04,
+        CAP_COMPRESSION = 0x08,
+        CAP_HASH = 0x10,
+        CAP_SESSION = 0x20,
+        CAP_MULTICAST = 0x40,
+        CAP_ARCHIVE = 0x80,
+        CAP_DEDUP = 0x100,
+        CAP_MANIFEST = 0x200
+    };
+
+    /** Largest control frame payload accepted. */
+    const qint64 MAX_CONTROL_FRAME = 1024 * 1024;
+
+    /** Size of the raw digest in a trailer (BLAKE2b-256). */
+    const int DIGEST_SIZE = 32;
+
+    /** Outcome of readMessage(). */
+    enum class ReadStatus
+    {
+        Incomplete, ///< The next message has not fully arrived
+        Complete,   ///< A message was read
+        Malformed   ///< The stream is not valid for its version
+    };
+
+    /** Prefix of secondary connections carrying one byte range of a striped file. */
+    extern const QByteArray STRIPE_PREFIX;
+
+    /** Prefix of the receiver's acknowledgement of a multi-file session ("SESSION|N"). */
+    extern const QByteArray SESSION_PREFIX;
+
+    /** Prefix of the receiver's single answer to a manifest session ("BATCH|bitmap[|index:options...]"). */
+    extern const QByteArray BATCH_PREFIX;
+
+    /** Prefix of the v1 trailer line carrying the hex digest ("HASH|<hex>[|base64 block checksums]"). */
+    extern const QByteArray TRAILER_PREFIX;
+
+    /** Prefix of a v1 request to send a shared file back. */
+    extern const QByteArray DOWNLOAD_PREFIX;
+
+    /**
+     * Fifth field of a v1 download request asking for the file on the request
+     * connection itself. Older peers ignore it and connect back to the port.
+     * A byte range, when asked for, follows as "offset=N;length=M".
+     */
+    extern const QByteArray DOWNLOAD_IN_BAND;
+
+    /** Prefix of v1 repair messages of a multicast transfer. */
+    extern const QByteArray REPAIR_PREFIX;
+
+    /** Prefix of a v1 request for a page of the shared files catalog. */
+    extern const QByteArray CATALOG_REQUEST_PREFIX;
+
+    /** Prefix of a v1 page of the shared files catalog. */
+    extern const QByteArray CATALOG_PAGE_PREFIX;
+
+    /** Prefix of a v1 request for a byte range of a shared file. */
+    extern const QByteArray RANGE_REQUEST_PREFIX;
+
+    /** Prefix of the v1 data ranges of a sparse file ("SPARSE|offset:length,..."). */
+    extern const QByteArray SPARSE_PREFIX;
+
+    /**
+     * @brief Metadata line sent by the sender when a connection opens.
+     */
+    struct TransferHeader
+    {
+        QString fileName;
+        qint64 fileSize = -1;
+        Options options;
+
+        /**
+         * Identifier the sender gave the transfer, carried as the "id" option
+         * and empty for older senders. Names are not unique, the identifier is.
+         */
+        QByteArray transferId;
+
+        /** Capability bits, derived from the options in version 1. */
+        quint32 capabilities = 0;
+
+        QByteArray encode(int version = VERSION_1) const;
+        static bool decode(const QByteArray &line, TransferHeader *header);
+    };
+
+    /**
+     * @brief Receiver's answer to a TransferHeader.
+     */
+    struct TransferReply
+    {
+        bool accepted = false;
+        Options options;
+
+        /** Capability bits of the features agreed on. */
+        quint32 capabilities = 0;
+
+        QByteArray encode(int version = VERSION_1) const;
+        static bool decode(const QByteArray &line, TransferReply *reply);
+    };
+
+    /**
+     * @brief Receiver's one answer to all the headers of a manifest session.
+     *
+     * A sender offering "session=N;manifest=1" announces the whole batch
+     * before any answer is due; a receiver that knows manifests waits for
+     * the user's decision on every file and answers them all at once, one
+     * reply per header in header order. In version 1:
+     * "BATCH|1011|0:offset=N;hash=blake2b|2:hash=blake2b", a bitmap of the
+     * accepted files followed by the options of the replies that have some.
+     */
+    struct BatchReply
+    {
+        QList<TransferReply> replies;
+
+        QByteArray encode(int version = VERSION_1) const;
+        static bool decode(const QByteArray &message, BatchReply *batch);
+    };
+
+    /**
+     * @brief Control message of a multicast transfer's repair rounds.
+     *
+     * The sender ends each round with RoundEnd, carrying the file digest
+     * when the receiver verifies it. The receiver answers with the block
+     * ranges it still misses, or Done once the file is complete.
+     * In version 1: "REPAIR|END|round|hex digest",
+     * "REPAIR|NACK|round|first-last,..." and "REPAIR|DONE|round".
+     */
+    struct RepairMessage
+    {
+        enum Kind : quint8
+        {
+            RoundEnd = 1,
+            Missing = 2,
+            Done = 3
+        };
+
+        Kind kind = RoundEnd;
+        int round = 0;
+        QByteArray digest;
+
+        /** Inclusive ranges of missing block indices. */
+        QList<QPair<quint32, quint32>> ranges;
+
+        QByteArray encode(int version) const;
+        static bool decode(const QByteArray &message, RepairMessage *repair);
+    };
+
+    /**
+     * @brief One page of a peer's shared files catalog.
+     *
+     * Entries offset to offset + page size of the catalog identified by
+     * catalogVersion, or of its changes since the generation the requester
+     * holds when delta is set, as a compact JSON array compressed with
+     * qCompress(). In version 1:
+     * "CATALOG|hex version|total|offset|base64 data|generation|full or delta".
+     */
+    struct CatalogPage
+    {
+        quint64 catalogVersion = 0;
+        quint64 generation = 0;
+        bool delta = false;
+        int total = 0;
+        int offset = 0;
+        QByteArray data;
+
+        QByteArray encode(int version) const;
+        static bool decode(const QByteArray &message, CatalogPage *page);
+    };
+
+    QByteArray encodeOptions(const Options &options);
+    Options decodeOptions(const QByteArray &field);
+    quint32 capabilitiesOf(const Options &options);
+
+    /** @brief Random identifier for a TransferHeader, 16 hexadecimal digits. */
+    QByteArray newTransferId();
+
+    /**
+     * @brief Protocol version to use with a peer found by discovery.
+     * @param advertised Version string of the LANDropUser
+     */
+    int versionFromDiscovery(const QString &advertised);
+
+    /**
+     * @brief Reads the next control message of a connection.
+     *
+     * Version 1 messages are text lines, version 2 messages are frames
+     * returned as the type byte followed by the payload. Nothing is consumed
+     * until the whole message arrived, so file data behind it stays unread.
+     */
+    ReadStatus readMessage(QIODevice *device, int version, QByteArray *message);
+
+    QByteArray encodeStripeJoin(int version, const QByteArray &token, int index);
+    bool decodeStripeJoin(const QByteArray &message, QByteArray *token, int *index);
+    QByteArray encodeSessionAck(int version, int count);
+    bool decodeSessionAck(const QByteArray &message, int *count);
+    QByteArray encodeTrailer(int version, const QByteArray &digest, const QVector<quint32> &blockSums = {});
+    bool decodeTrailer(const QByteArray &message, QByteArray *digest, QVector<quint32> *blockSums = nullptr);
+    QByteArray encodeDownloadRequest(int version, const QString &relativePath, const QString &fileName, quint16 port,
+                                     bool inBand = false, qint64 offset = 0, qint64 length = -1);
+    bool decodeDownloadRequest(const QByteArray &message, QString *relativePath, QString *fileName, quint16 *port,
+                               bool *inBand = nullptr, qint64 *offset = nullptr, qint64 *length = nullptr);
+    QByteArray encodeCatalogRequest(int version, int offset, quint64 sinceGeneration = 0, quint64 baseVersion = 0);
+    bool decodeCatalogRequest(const QByteArray &message, int *offset, quint64 *sinceGeneration = nullptr,
+                              quint64 *baseVersion = nullptr);
+    QByteArray encodeRangeRequest(int version, const QString &relativePath, const QByteArray &content, qint64 offset,
+                                  qint64 length);
+    bool decodeRangeRequest(const QByteArray &message, QString *relativePath, QByteArray *content, qint64 *offset,
+                            qint64 *length);
+    QByteArray encodeSparseMap(int version, const QList<QPair<qint64, qint64>> &ranges);
+    bool decodeSparseMap(const QByteArray &message, QList<QPair<qint64, qint64>> *ranges);
+
+    /**
+     * @brief Computes the byte range carried by one stripe of a file.
+     *
+     * Stripes are equal unless weights are given for each of them, as
+     * offered in "weights=w0,w1,..." (see PathBonding); extra weights of
+     * stripes that were not agreed on are ignored.
+     *
+     * @param fileSize Total size of the file
+     * @param stripeCount Number of stripes the file is split into
+     * @param index Stripe index, 0 being the primary connection
+     * @param offset Receives the first byte of the range
+     * @param end Receives one past the last byte of the range
+     * @param weights Share of each stripe, positive
+     */
+    void stripeRange(qint64 fileSize, int stripeCount, int index, qint64 *offset, qint64 *end,
+                     const QList<int> &weights = QList<int>());
+
+    /**
+     * @brief Encodes stripe weights as the value of a "weights" option.
+     */
+    QByteArray encodeWeights(const QList<int> &weights);
+
+    /**
+     * @brief Reads the value of a "weights" option.
+     *
+     * @return false if a weight is not a positive number
+     */
+    bool decodeWeights(const QByteArray &value, QList<int> *weights);
+}
+
+#endif // PROTOCOL_H
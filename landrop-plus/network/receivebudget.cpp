@@ -0,0 +1,70 @@
+/**
+ * @file receivebudget.cpp
+ */
+
+#include "receivebudget.h"
+#include "../config/config.h"
+#include <QMutex>
+#include <QMutexLocker>
+
+namespace
+{
+    QMutex budgetMutex;
+    qint64 reservedBytes = 0;
+    int pending = 0;
+}
+
+bool ReceiveBudget::reserve(qint64 bytes)
+{
+    QMutexLocker lock(&budgetMutex);
+    qint64 budget = Config::getReceiveMemoryBudget();
+    if (budget > 0 && reservedBytes + bytes > budget)
+        return false;
+    reservedBytes += bytes;
+    return true;
+}
+
+void ReceiveBudget::force(qint64 bytes)
+{
+    QMutexLocker lock(&budgetMutex);
+    reservedBytes += bytes;
+}
+
+void ReceiveBudget::release(qint64 bytes)
+{
+    QMutexLocker lock(&budgetMutex);
+    reservedBytes = qMax<qint64>(0, reservedBytes - bytes);
+}
+
+qint64 ReceiveBudget::reserved()
+{
+    QMutexLocker lock(&budgetMutex);
+    return reservedBytes;
+}
+
+bool ReceiveBudget::enterPending()
+{
+    QMutexLocker lock(&budgetMutex);
+    ++pending;
+    int limit = Config::getMaxPendingConnections();
+    return limit <= 0 || pending < limit;
+}
+
+void ReceiveBudget::leavePending()
+{
+    QMutexLocker lock(&budgetMutex);
+    pending = qMax(0, pending - 1);
+}
+
+int ReceiveBudget::pendingCount()
+{
+    QMutexLocker lock(&budgetMutex);
+    return pending;
+}
+
+bool ReceiveBudget::admitsMore()
+{
+    QMutexLocker lock(&budgetMutex);
+    int limit = Config::getMaxPendingConnections();
+    return limit <= 0 || pending < limit;
+}
@@ -0,0 +1,65 @@
+/**
+ * @file receivebudget.h
+ * @brief Memory the read buffers of incoming connections may take, and connections waiting for an answer
+ */
+
+#ifndef RECEIVEBUDGET_H
+#define RECEIVEBUDGET_H
+
+#include <QtGlobal>
+
+/**
+ * @namespace ReceiveBudget
+ * @brief Bounds what a burst of incoming transfers costs the receiver.
+ *
+ * Every connection of the receiver holds a reservation for its read
+ * buffer. A connection waiting for the user's answer only gets
+ * Config::getPendingReceiveBuffer(), enough for its headers; once its
+ * transfer is accepted it asks for the full Config::getReceiveBufferSize(),
+ * and reading pauses until the reservations of all connections together
+ * leave room for it within Config::getReceiveMemoryBudget(). Unread data
+ * stays with the sender through TCP flow control meanwhile.
+ *
+ * The connections waiting for an answer are counted as well; beyond
+ * Config::getMaxPendingConnections() the receiver stops accepting, so
+ * further senders wait in the listen backlog of the system.
+ *
+ * Shared by the receiver and its workers. Thread-safe.
+ */
+namespace ReceiveBudget
+{
+    /**
+     * @brief Reserves buffer memory if it fits the budget.
+     *
+     * @param bytes Bytes wanted
+     * @return false, reserving nothing, if the budget has no room for them
+     */
+    bool reserve(qint64 bytes);
+
+    /** @brief Reserves buffer memory regardless of the budget, for the small buffers of new connections. */
+    void force(qint64 bytes);
+
+    /** @brief Gives back memory reserved with reserve() or force(). */
+    void release(qint64 bytes);
+
+    /** @brief Bytes reserved by all connections. */
+    qint64 reserved();
+
+    /**
+     * @brief Counts a connection that arrived and whose transfer is not answered yet.
+     *
+     * @return false if the maximum of waiting connections is reached with it
+     */
+    bool enterPending();
+
+    /** @brief Stops counting a connection once answered, closed or not a transfer. */
+    void leavePending();
+
+    /** @brief Connections waiting for an answer. */
+    int pendingCount();
+
+    /** @brief Whether another connection may be accepted. */
+    bool admitsMore();
+}
+
+#endif // RECEIVEBUDGET_H
@@ -4,32 +4,110 @@
 
 #include "receiver.h"
 #include "sender.h"
+#include "protocol.h"
+#include "securetransport.h"
+#include "blockmap.h"
+#include "resumestate.h"
+#include "sparsefile.h"
+#include "contentindex.h"
+#include "sharedcatalog.h"
+#include "transfersource.h"
+#include "uploadslots.h"
+#include "datagramtransport.h"
+#include "groupcommit.h"
+#include "receivebudget.h"
+#include "transferprofiles.h"
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QNetworkInterface>
 #include <QTimer>
+#include <QUuid>
+#include <QMetaType>
+#include <QPointer>
+#include <QRandomGenerator>
 
 /**
  * @brief Constructs a new Receiver instance.
  *
  * Initializes the TCP server and directory handler, then connects the
- * newConnection signal to handle incoming client connections.
+ * server's accepted connections to handle incoming clients.
  *
  * @param parent Parent QObject
  */
 Receiver::Receiver(QObject *parent)
     : QObject(parent),
-      server(new QTcpServer(this)),
+      server(new ReceiverServer(this)),
       directory(new QDir())
 {
-    connect(server, &QTcpServer::newConnection, this, &Receiver::onNewConnection);
+    connect(server, &ReceiverServer::connectionAccepted, this, &Receiver::onConnectionAccepted);
 }
 
 /**
- * @brief Destructor for Receiver, clean up  directory.
+ * @brief Destructor for Receiver, deletes the workers in their threads and clean up directory.
  */
 Receiver::~Receiver()
 {
+    for (int i = 0; i < workers.size(); ++i)
+    {
+        Receiver *worker = workers[i];
+        QMetaObject::invokeMethod(worker, [worker]()
+                                  { delete worker; }, Qt::BlockingQueuedConnection);
+        workerThreads[i]->quit();
+        workerThreads[i]->wait();
+    }
+    qDeleteAll(workerThreads);
     delete directory;
+
+    // Connections still open are deleted with this receiver
+    for (qint64 reservation : bufferReservations)
+        ReceiveBudget::release(reservation);
+    for (int i = 0; i < undecidedSockets.size(); ++i)
+        ReceiveBudget::leavePending();
+}
+
+/**
+ * @brief Serves incoming connections on worker threads.
+ *
+ * Each worker is a Receiver of its own receiving the connections handed to
+ * it round-robin, so transfers from many senders are spread over several
+ * cores. Called before startServer(); a count below 2 keeps every
+ * connection on this receiver's thread.
+ *
+ * @param count Number of worker threads
+ */
+void Receiver::setWorkerCount(int count)
+{
+    if (!workers.isEmpty() || count < 2)
+        return;
+
+    // Argument types of the signals crossing from the workers
+    qRegisterMetaType<TransferStatus>("TransferStatus");
+    qRegisterMetaType<QTcpSocket *>("QTcpSocket*");
+
+    registry = QSharedPointer<ReceiverRegistry>(new ReceiverRegistry);
+    for (int i = 0; i < count; ++i)
+    {
+        Receiver *worker = new Receiver();
+        worker->registry = registry;
+
+        // Emitted in the worker's thread, delivered like signals of this receiver
+        connect(worker, &Receiver::fileTransferRequested, this, &Receiver::fileTransferRequested, Qt::DirectConnection);
+        connect(worker, &Receiver::batchAnnounced, this, &Receiver::batchAnnounced, Qt::DirectConnection);
+        connect(worker, &Receiver::fileReceivedSuccessfully, this, &Receiver::fileReceivedSuccessfully, Qt::DirectConnection);
+        connect(worker, &Receiver::transferProgressUpdated, this, &Receiver::transferProgressUpdated, Qt::DirectConnection);
+        connect(worker, &Receiver::transferStatusUpdated, this, &Receiver::transferStatusUpdated, Qt::DirectConnection);
+        connect(worker, &Receiver::transferStripeCountNegotiated, this, &Receiver::transferStripeCountNegotiated,
+                Qt::DirectConnection);
+        connect(worker, &Receiver::transferCompressionNegotiated, this, &Receiver::transferCompressionNegotiated,
+                Qt::DirectConnection);
+
+        QThread *thread = new QThread();
+        thread->setObjectName(QString("ReceiverWorker%1").arg(i));
+        thread->start();
+        worker->moveToThread(thread);
+        workers.append(worker);
+        workerThreads.append(thread);
+    }
 }
 
 /**
@@ -60,6 +138,24 @@ bool Receiver::startServer(quint16 port)
     return true;
 }
 
+/**
+ * @brief Moves the server to another port, the connections open stay.
+ *
+ * Only the listening socket is replaced: transfers running keep their
+ * connections, new ones arrive on the new port.
+ *
+ * @param port Port to listen on, an available one if it is taken
+ * @return false if no port could be listened on
+ */
+bool Receiver::rebind(quint16 port)
+{
+    if (server->isListening() && server->serverPort() == port)
+        return true;
+
+    server->close();
+    return startServer(port);
+}
+
 /**
  * @brief Retrieves the actual port number the server is listening on.
  *
@@ -73,14 +169,189 @@ quint16 Receiver::getServerPort() const
 /**
  * @brief Handles new TCP client connections.
  *
- * Called when a new client connects to the server. Sets up signal connections
- * for handling incoming data and client disconnections.
+ * Called when a new client connects to the server. Opens the socket of the
+ * connection here, or hands the descriptor to the next worker which opens
+ * it in its own thread.
+ *
+ * The connection counts as waiting for an answer until its transfer is
+ * decided; once Config::getMaxPendingConnections() wait, the server stops
+ * accepting until one of them is answered (see ReceiveBudget).
+ *
+ * @param socketDescriptor Native descriptor of the accepted connection
+ */
+void Receiver::onConnectionAccepted(qintptr socketDescriptor)
+{
+    if (!ReceiveBudget::enterPending())
+    {
+        server->pauseAccepting();
+        if (!admissionTimer)
+        {
+            admissionTimer = new QTimer(this);
+            admissionTimer->setInterval(ADMISSION_POLL);
+            connect(admissionTimer, &QTimer::timeout, this, &Receiver::resumeAccepting);
+        }
+        admissionTimer->start();
+    }
+
+    if (!workers.isEmpty())
+    {
+        Receiver *worker = workers[nextWorker];
+        nextWorker = (nextWorker + 1) % workers.size();
+        Config::publish();
+        QMetaObject::invokeMethod(worker, [worker, socketDescriptor]()
+                                  { worker->openConnection(socketDescriptor); }, Qt::QueuedConnection);
+        return;
+    }
+
+    openConnection(socketDescriptor);
+}
+
+/**
+ * @brief Opens the socket of an accepted connection in this receiver's thread.
+ *
+ * @param socketDescriptor Native descriptor of the connection, counted as waiting by onConnectionAccepted()
+ */
+void Receiver::openConnection(qintptr socketDescriptor)
+{
+    QTcpSocket *clientSocket = SecureTransport::createSocket(this);
+    if (!clientSocket->setSocketDescriptor(socketDescriptor))
+    {
+        delete clientSocket;
+        ReceiveBudget::leavePending();
+        return;
+    }
+    undecidedSockets.insert(clientSocket);
+    setupConnection(clientSocket);
+}
+
+/**
+ * @brief Accepts connections again once fewer than the maximum wait for an answer.
+ */
+void Receiver::resumeAccepting()
+{
+    if (!ReceiveBudget::admitsMore())
+        return;
+    admissionTimer->stop();
+    server->resumeAccepting();
+}
+
+/**
+ * @brief Stops counting a connection as waiting for an answer.
+ */
+void Receiver::leavePending(QTcpSocket *socket)
+{
+    if (undecidedSockets.remove(socket))
+        ReceiveBudget::leavePending();
+}
+
+/**
+ * @brief Gives a connection a read buffer of @p size, reserved whatever the budget.
+ */
+void Receiver::setBuffer(QTcpSocket *socket, qint64 size)
+{
+    ReceiveBudget::release(bufferReservations.value(socket));
+    ReceiveBudget::force(size);
+    bufferReservations[socket] = size;
+    socket->setReadBufferSize(size);
+}
+
+/**
+ * @brief Grows the read buffer of a connection receiving data, if the receive budget has room.
+ *
+ * A compressed transfer needs room for a whole frame (see RECEIVE_BUFFER).
+ *
+ * @param socket Connection about to be read
+ * @param primary Primary connection of its transfer
+ * @return false if reading has to wait for other connections to give memory back
+ */
+bool Receiver::growBuffer(QTcpSocket *socket, QTcpSocket *primary)
+{
+    qint64 wanted = Config::getReceiveBufferSize();
+    auto fileInfo = pendingFiles.constFind(primary);
+    if (fileInfo != pendingFiles.constEnd() && fileInfo->compressed)
+        wanted = qMax(wanted, RECEIVE_BUFFER);
+
+    qint64 held = bufferReservations.value(socket);
+    if (held >= wanted)
+        return true;
+    if (!ReceiveBudget::reserve(wanted - held))
+        return false;
+
+    bufferReservations[socket] = wanted;
+    socket->setReadBufferSize(wanted);
+    return true;
+}
+
+/**
+ * @brief Grows a full small buffer to hold the largest control message.
+ *
+ * Headers rarely exceed Config::getPendingReceiveBuffer(), but one that
+ * does would otherwise never complete.
+ *
+ * @param socket Connection whose message is incomplete
+ */
+void Receiver::makeRoomForMessage(QTcpSocket *socket)
+{
+    qint64 room = 2 * Protocol::MAX_CONTROL_FRAME;
+    qint64 size = socket->readBufferSize();
+    if (size > 0 && size < room && socket->bytesAvailable() >= size)
+        setBuffer(socket, room);
+}
+
+/**
+ * @brief Gives back the read buffer of a connection closed or handed over.
+ */
+void Receiver::releaseBuffer(QTcpSocket *socket)
+{
+    ReceiveBudget::release(bufferReservations.take(socket));
+    leavePending(socket);
+}
+
+/**
+ * @brief Sets up signal connections for handling incoming data and client disconnections.
+ *
+ * The connection starts with the small buffer of Config::getPendingReceiveBuffer()
+ * and gets a larger one once its data is read (see growBuffer()).
+ */
+void Receiver::setupConnection(QTcpSocket *socket)
+{
+    setBuffer(socket, Config::getPendingReceiveBuffer());
+    connect(socket, &QTcpSocket::readyRead, this, &Receiver::onReadyRead);
+    connect(socket, &QTcpSocket::disconnected, this, &Receiver::onDisconnected);
+    track(socket);
+}
+
+/**
+ * @brief Records this receiver as the owner of a connection, when it is a worker.
+ */
+void Receiver::track(QTcpSocket *socket)
+{
+    if (!registry)
+        return;
+    ReceiverRegistry::Shard &shard = registry->shardOf(socket);
+    QMutexLocker lock(&shard.mutex);
+    shard.owners.insert(socket, this);
+}
+
+void Receiver::untrack(QTcpSocket *socket)
+{
+    if (!registry)
+        return;
+    ReceiverRegistry::Shard &shard = registry->shardOf(socket);
+    QMutexLocker lock(&shard.mutex);
+    shard.owners.remove(socket);
+}
+
+/**
+ * @brief Worker serving a connection, null if it is not served by a worker (any more).
  */
-void Receiver::onNewConnection()
+Receiver *Receiver::ownerOf(QTcpSocket *socket) const
 {
-    QTcpSocket *clientSocket = server->nextPendingConnection();
-    connect(clientSocket, &QTcpSocket::readyRead, this, &Receiver::onReadyRead);
-    connect(clientSocket, &QTcpSocket::disconnected, this, &Receiver::onDisconnected);
+    if (!registry)
+        return nullptr;
+    ReceiverRegistry::Shard &shard = registry->shardOf(socket);
+    QMutexLocker lock(&shard.mutex);
+    return shard.owners.value(socket);
 }
 
 /**
@@ -90,8 +361,29 @@ void Receiver::onNewConnection()
  * and download requests.
  *
  * Protocol formats:
- * - Regular transfer: "filename|filesize\n"
- * - Download request: "DOWNLOAD_REQUEST|relativePath|fileName|clientPort\n"
+ * - Regular transfer: "filename|filesize[|options]\n"
+ * - Download request: "DOWNLOAD_REQUEST|relativePath|fileName|clientPort[|inline][|offset=N;length=M]\n",
+ *   answered on the same connection when it has "inline", with only the
+ *   range asked for when it has one
+ * - Catalog request: "CATALOG_REQUEST|offset[|generation|version]\n", answered
+ *   with one page of the shared files catalog or of its changes since the
+ *   generation given; the connection stays open for the next one
+ * - Range request: "RANGE_REQUEST|content|offset|length|relativePath\n",
+ *   answered with "OK|length=N\n" and N bytes of a shared file; the
+ *   connection stays open for the next one (see SwarmDownload)
+ * - Stripe of an accepted transfer: "STRIPE|token|index\n" followed by data
+ * - Session: "filename|filesize|session=N\n" acknowledged with "SESSION|N\n",
+ *   followed by N-1 more headers on the same connection; with "manifest=1"
+ *   as well, the N files are answered together with one "BATCH|..." reply
+ * - Verified files: the data is followed by "HASH|<hex digest>\n"
+ *
+ * A connection opening with Protocol::PREAMBLE_V2 sends the same messages
+ * as binary frames instead (see Protocol::readMessage()); the replies on it
+ * are framed as well. One opening with a TLS handshake carries either form
+ * once it is encrypted (see SecureTransport).
+ *
+ * The first message is only parsed once it arrived completely, however it
+ * was split. Data sent after a header stays buffered until the user answered.
  *
  * @note Emits fileTransferRequested() for new transfers requiring user approval
  * @note Emits transferProgressUpdated() during file reception
@@ -102,159 +394,2265 @@ void Receiver::onReadyRead()
     QTcpSocket *clientSocket = qobject_cast<QTcpSocket *>(sender());
     if (!clientSocket) return;
 
+    auto traced = pendingFiles.constFind(clientSocket);
+    TransferTrace::Span span("readyRead", "receive", traced != pendingFiles.constEnd() ? traced->metricsId : 0);
+
+    if (stripeSockets.contains(clientSocket))
+    {
+        receiveStripeData(clientSocket);
+        return;
+    }
+
+    if (sessionConnections.contains(clientSocket))
+    {
+        receiveSessionInput(clientSocket);
+        return;
+    }
+
     if (!pendingFiles.contains(clientSocket))
     {
-        // Handle new connection - read metadata
-        QByteArray line = clientSocket->readLine().trimmed();
-        if (line.isEmpty() || !line.contains('|'))
+        // Handle new connection - detect the protocol version, then read metadata
+        if (!socketVersions.contains(clientSocket))
         {
-            clientSocket->disconnectFromHost();
-            return;
+            // Encrypted connections start with a TLS handshake, the protocol follows it
+            if (SecureTransport::acceptHandshake(clientSocket))
+                return;
+            if (SecureTransport::required() && !SecureTransport::isEncrypted(clientSocket))
+            {
+                clientSocket->disconnectFromHost();
+                return;
+            }
+
+            QByteArray start = clientSocket->peek(Protocol::PREAMBLE_V2.size());
+            if (start.size() < Protocol::PREAMBLE_V2.size() && Protocol::PREAMBLE_V2.startsWith(start))
+                return;
+            bool framed = (start == Protocol::PREAMBLE_V2);
+            if (framed)
+                clientSocket->read(Protocol::PREAMBLE_V2.size());
+            socketVersions[clientSocket] = framed ? Protocol::VERSION_2 : Protocol::VERSION_1;
         }
-        
-        QString message = QString::fromUtf8(line);
+        int version = socketVersions.value(clientSocket);
 
-        // Check if this is a download request
-        if (message.startsWith("DOWNLOAD_REQUEST|"))
+        // The header may arrive in several reads, it is only parsed once complete
+        QByteArray line;
+        Protocol::ReadStatus status = Protocol::readMessage(clientSocket, version, &line);
+        if (status == Protocol::ReadStatus::Incomplete)
         {
-            QStringList parts = message.split('|');
-            if (parts.size() >= 4)
+            makeRoomForMessage(clientSocket);
+            if (version < Protocol::VERSION_2 && !partialHeaders.contains(clientSocket))
             {
-                QString relativePath = parts[1];
-                QString fileName = parts[2];
-                quint16 clientPort = parts[3].toUShort();
-                QString clientIP = clientSocket->peerAddress().toString();
-                handleDownloadRequest(clientIP, relativePath, fileName, clientPort);
+                partialHeaders.insert(clientSocket);
+                QTimer::singleShot(LEGACY_HEADER_WAIT, clientSocket, [this, clientSocket]()
+                                   { receiveLegacyHeader(clientSocket); });
             }
-            clientSocket->disconnectFromHost();
             return;
         }
-
-        // Regular file transfer - parse metadata
-        QList<QByteArray> data = line.split('|');
-        if (data.size() < 2)
+        partialHeaders.remove(clientSocket);
+        if (status == Protocol::ReadStatus::Malformed)
         {
             clientSocket->disconnectFromHost();
             return;
         }
+        handleHeader(clientSocket, version >= Protocol::VERSION_2 ? line : line.trimmed(), version);
+    }
+    else
+    {
+        // Handle file data transfer
+        receiveFileData(clientSocket);
+    }
+}
 
-        QString fileName = data[0];
-        qint64 fileSize = data[1].toLongLong();
+/**
+ * @brief Takes the bytes of a v1 header still missing its newline as the whole line.
+ *
+ * Older senders do not end download requests with a newline, so a header
+ * that stayed incomplete for LEGACY_HEADER_WAIT is parsed as it is.
+ *
+ * @param socket Connection whose header is incomplete
+ */
+void Receiver::receiveLegacyHeader(QTcpSocket *socket)
+{
+    if (!partialHeaders.remove(socket) || pendingFiles.contains(socket) || sessionConnections.contains(socket))
+        return;
+
+    if (socket->canReadLine())
+    {
+        // The newline arrived meanwhile and is waiting for onReadyRead()
+        return;
+    }
+    handleHeader(socket, socket->readAll().trimmed(), Protocol::VERSION_1);
+}
+
+/**
+ * @brief Acts on the complete first message of a connection.
+ *
+ * @param clientSocket Connection the message arrived on
+ * @param line Download or catalog request, stripe join or transfer header
+ * @param version Protocol version of the connection
+ */
+void Receiver::handleHeader(QTcpSocket *clientSocket, const QByteArray &line, int version)
+{
+    if (version < Protocol::VERSION_2 && (line.isEmpty() || !line.contains('|')))
+    {
+        clientSocket->disconnectFromHost();
+        return;
+    }
 
-        if (fileName.isEmpty() || fileSize < 0)
+    // Check if this is a download request
+    QString relativePath;
+    QString fileName;
+    quint16 clientPort = 0;
+    bool inBand = false;
+    qint64 downloadOffset = 0;
+    qint64 downloadLength = -1;
+    if (Protocol::decodeDownloadRequest(line, &relativePath, &fileName, &clientPort, &inBand, &downloadOffset,
+                                        &downloadLength))
+    {
+        leavePending(clientSocket);
+        if (inBand)
         {
-            clientSocket->disconnectFromHost();
+            serveDownload(clientSocket, relativePath, version, downloadOffset, downloadLength);
             return;
         }
 
-        pendingFiles[clientSocket].name = fileName;
-        pendingFiles[clientSocket].size = fileSize;
-        pendingFiles[clientSocket].totalReceived = 0;
-        pendingFiles[clientSocket].file = nullptr;
-        emit fileTransferRequested(fileName, QString::number(fileSize), clientSocket);
+        QString clientIP = clientSocket->peerAddress().toString();
+        handleDownloadRequest(clientIP, relativePath, fileName, clientPort, version, downloadOffset, downloadLength);
+        clientSocket->disconnectFromHost();
+        return;
     }
-    else
+
+    // Page of the shared files catalog, or of its changes since a generation
+    int catalogOffset = 0;
+    quint64 sinceGeneration = 0;
+    quint64 baseVersion = 0;
+    if (Protocol::decodeCatalogRequest(line, &catalogOffset, &sinceGeneration, &baseVersion))
     {
-        // Handle file data transfer
-        FileDefinition &fileInfo = pendingFiles[clientSocket];
-        QFile *file = fileInfo.file;
+        leavePending(clientSocket);
+        clientSocket->write(SharedCatalog::page(catalogOffset, sinceGeneration, baseVersion).encode(version));
+        return;
+    }
 
-        if (!file || !file->isOpen())
-        {
-            return;
-        }
+    // Byte range of a shared file, for a download spread over several peers
+    QByteArray content;
+    qint64 rangeOffset = 0;
+    qint64 rangeLength = 0;
+    if (Protocol::decodeRangeRequest(line, &relativePath, &content, &rangeOffset, &rangeLength))
+    {
+        leavePending(clientSocket);
+        serveRange(clientSocket, relativePath, content, rangeOffset, rangeLength, version);
+        return;
+    }
 
-        QByteArray data = clientSocket->readAll();
-        if (data.isEmpty()) return;
+    // Secondary connection joining a striped transfer
+    QByteArray token;
+    int index = 0;
+    if (Protocol::decodeStripeJoin(line, &token, &index))
+    {
+        leavePending(clientSocket);
+        handleStripeConnection(clientSocket, token, index);
+        return;
+    }
 
-        qint64 written = file->write(data);
-        if (written == -1)
-        {
-            emit transferStatusUpdated(fileInfo.name, TransferStatus::CANCELLED);
-            clientSocket->disconnectFromHost();
-            return;
-        }
+    // Regular file transfer - parse metadata
+    // A name that is not a plain file name is refused before anyone is asked about it
+    Protocol::TransferHeader header;
+    if (!Protocol::TransferHeader::decode(line, &header) || !isSafeFileName(header.fileName))
+    {
+        clientSocket->disconnectFromHost();
+        return;
+    }
 
-        fileInfo.totalReceived += data.size();
-        float percentage = ((float)fileInfo.totalReceived / (float)fileInfo.size) * 100;
-        file->flush();
+    // Sender offers to carry several files on this connection
+    int sessionCount = header.options.value("session", "1").toInt();
+    if (sessionCount > 1)
+    {
+        SessionConnection &session = sessionConnections[clientSocket];
+        session.expected = sessionCount;
+        session.announced = 1;
+        session.manifest = header.options.contains("manifest");
+        session.queue.append(definitionFromHeader(header, clientSocket));
 
-        emit transferProgressUpdated(fileInfo.name, static_cast<int>(percentage));
+        clientSocket->write(Protocol::encodeSessionAck(version, sessionCount));
+        clientSocket->flush();
 
-        // Check if transfer complete
-        if (fileInfo.totalReceived >= fileInfo.size)
-        {
-            clientSocket->disconnectFromHost();
-        }
+        if (!session.manifest)
+            emit fileTransferRequested(header.fileName, QString::number(header.fileSize), clientSocket,
+                                       session.queue.last().transferId);
+        receiveSessionInput(clientSocket);
+        return;
     }
+
+    FileDefinition &fileInfo = pendingFiles[clientSocket];
+    fileInfo = definitionFromHeader(header, clientSocket);
+    emit fileTransferRequested(header.fileName, QString::number(header.fileSize), clientSocket, fileInfo.transferId);
 }
 
 /**
- * @brief Handles client disconnection and transfer cleanup.
+ * @brief Builds the receive state of a file from its transfer header.
  *
- * Called when a client disconnects, either normally after transfer completion
- * or abnormally due to network issues.
+ * @param header Header announcing the file
+ * @param socket Connection it arrived on, its peer scopes the sender's transfer ID
  */
-void Receiver::onDisconnected()
+FileDefinition Receiver::definitionFromHeader(const Protocol::TransferHeader &header, QTcpSocket *socket)
 {
-    QTcpSocket *clientSocket = qobject_cast<QTcpSocket *>(sender());
-    if (!clientSocket) return;
+    FileDefinition fileInfo;
+    fileInfo.name = header.fileName;
+    if (TransferTrace::enabled())
+    {
+        TransferTrace::instant("header", "receive");
+        fileInfo.headerAt = TransferTrace::now();
+    }
+    if (header.transferId.isEmpty())
+        fileInfo.transferId = QUuid::createUuid().toRfc4122().toHex();
+    else
+        fileInfo.transferId = socket->peerAddress().toString().toUtf8() + '/' + header.transferId;
+    fileInfo.size = header.fileSize;
+    fileInfo.counter = ProgressCounters::open(fileInfo.transferId, fileInfo.size);
+    fileInfo.offeredStripes = qMax(1, header.options.value("stripes", "1").toInt());
+    if (header.options.contains("weights"))
+        Protocol::decodeWeights(header.options.value("weights"), &fileInfo.stripeWeights);
+    fileInfo.rangeEnd = header.fileSize;
+    fileInfo.sourceTag = header.options.value("mtime");
+    fileInfo.offersDelta = (header.options.value("delta") == "1");
+    fileInfo.offeredCodec = header.options.value("compress");
+    fileInfo.offeredLevel = header.options.value("level", "1").toInt();
+    fileInfo.offersHash = (header.options.value("hash") == StreamHasher::ALGORITHM);
+    fileInfo.offersSparse = (header.options.value("sparse") == "1");
+    fileInfo.relayChain = header.options.value("relay");
+    fileInfo.offeredMulticast = header.options.value("mcast");
+    fileInfo.offersDatagram = (header.options.value("udp") == "1");
+    fileInfo.archiveCount = qMax(0, header.options.value("archive", "0").toInt());
+    fileInfo.offeredContent = header.options.value("content");
+    if (header.options.contains("range"))
+        fileInfo.rangeStart = qBound<qint64>(0, header.options.value("range").toLongLong(), qMax<qint64>(0, header.fileSize));
+    return fileInfo;
+}
 
-    if (pendingFiles.contains(clientSocket))
+/**
+ * @brief Writes data of the connection's current file until it is complete.
+ *
+ * On a session connection several files can arrive in the same read; the
+ * loop moves on to the next accepted file as soon as one is complete.
+ *
+ * @param socket Primary connection of the transfer
+ */
+void Receiver::receiveFileData(QTcpSocket *socket)
+{
+    while (pendingFiles.contains(socket))
     {
-        FileDefinition &fileInfo = pendingFiles[clientSocket];
+        FileDefinition &fileInfo = pendingFiles[socket];
         QFile *file = fileInfo.file;
-        QString fileName = fileInfo.name;
 
-        if (file)
+        // Data sent ahead of the answer stays in the socket buffer, which is
+        // bounded by Config::getPendingReceiveBuffer(), and is drained once
+        // the user accepted
+        if (fileInfo.phase == ReceivePhase::AwaitAccept)
+            return;
+
+        // Archives are unpacked into several files
+        if (fileInfo.unpacker)
         {
-            if (file->isOpen()) file->close();
-            delete file;
+            receiveArchiveData(socket);
+            return;
         }
 
-        if (fileInfo.totalReceived < fileInfo.size)
+        if (!file || !file->isOpen())
+        {
+            return;
+        }
+
+        // The data of a multicast transfer arrives on the group
+        if (fileInfo.multicast)
         {
-            emit transferStatusUpdated(fileName, TransferStatus::CANCELLED);
+            receiveRepairMessages(socket);
+            return;
         }
-        else
+
+        if (throttled(socket, socket))
+            return;
+
+        if (fileInfo.phase == ReceivePhase::Repair)
         {
-            emit fileReceivedSuccessfully(QFileInfo(fileName).fileName());
-            emit transferStatusUpdated(fileName, TransferStatus::FINISHED);
+            receiveRepairData(socket);
+            return;
         }
 
-        pendingFiles.remove(clientSocket);
-    }
+        if (fileInfo.delta)
+        {
+            receiveDeltaData(socket);
+            return;
+        }
 
-    clientSocket->deleteLater();
+        if (fileInfo.compressed)
+        {
+            receiveCompressedData(socket);
+            return;
+        }
+
+        if (fileInfo.sparse)
+        {
+            receiveSparseData(socket);
+            return;
+        }
+
+        qint64 remaining = fileInfo.rangeEnd - fileInfo.position;
+        if (remaining > 0 && socket->bytesAvailable() <= 0)
+            return;
+
+        while (remaining > 0)
+        {
+            QByteArray data = readPooled(socket, remaining);
+            if (data.isEmpty())
+                break;
+
+            if (!writeAt(fileInfo, fileInfo.position, data))
+            {
+                emit transferStatusUpdated(fileInfo.name, TransferStatus::CANCELLED, fileInfo.transferId);
+                socket->disconnectFromHost();
+                return;
+            }
+
+            if (fileInfo.hasher)
+                fileInfo.hasher->addData(data);
+            fileInfo.position += data.size();
+            fileInfo.totalReceived += data.size();
+            remaining -= data.size();
+            BandwidthShaper::consume(socket->peerAddress().toString(), &sessionBuckets[socket], data.size());
+            BufferPool::release(data);
+        }
+
+        if (!reportProgress(socket))
+            return;
+    }
 }
 
 /**
- * @brief Associates a file handle with a client socket for file reception.
- *
- * Called by the UI layer after user accepts a file transfer. Sets up the
- * file handle for writing incoming data and cleans up any existing file
- * associated with the socket.
+ * @brief Reads the next block of a connection into a pooled buffer.
  *
- * @param socket The client socket requesting file transfer
- * @param file The file handle to write received data to
+ * @param socket Connection to read from
+ * @param maxSize Bytes wanted at most
+ * @return The bytes read, empty if none were available; given back with
+ *         BufferPool::release() once written
  */
-void Receiver::setFile(QTcpSocket *socket, QFile *file)
+QByteArray Receiver::readPooled(QTcpSocket *socket, qint64 maxSize)
 {
-    if (!socket || !file || !pendingFiles.contains(socket))
+    QByteArray data = BufferPool::acquire(RECEIVE_BLOCK);
+    qint64 bytesRead = socket->read(data.data(), qMin(maxSize, RECEIVE_BLOCK));
+    if (bytesRead <= 0)
     {
-        delete file; // Clean up passed file if invalid parameters
-        return;
+        BufferPool::release(data);
+        return QByteArray();
     }
+    data.resize(int(bytesRead));
+    return data;
+}
 
-    // Clean up existing file if any
-    FileDefinition &fileInfo = pendingFiles[socket];
+/**
+ * @brief Writes a block of received data at its absolute file offset.
+ *
+ * Goes through the write-behind stage when the file has one.
+ *
+ * @return false if the data could not be written completely
+ */
+bool Receiver::writeAt(FileDefinition &fileInfo, qint64 offset, const QByteArray &data)
+{
+    // Time spent here is the disk holding the connection back
+    QElapsedTimer clock;
+    clock.start();
+    TransferTrace::Span span("disk write", "receive", fileInfo.metricsId, data.size());
+
+    bool written = false;
+    if (fileInfo.writer)
+    {
+        written = fileInfo.writer->write(offset, data);
+    }
+    else
+    {
+        QFile *file = fileInfo.file;
+        written = (file->pos() == offset || file->seek(offset)) && file->write(data) == data.size();
+    }
+
+    TransferMetrics::addWait(fileInfo.metricsId, TransferMetrics::Wait::Disk, clock.nsecsElapsed() / 1000);
+    return written;
+}
+
+/**
+ * @brief Opens the TransferMetrics session of an accepted transfer.
+ *
+ * Bytes a resumed or ranged transfer already has are not counted.
+ *
+ * @param fileInfo Accepted transfer
+ * @param socket Its primary connection, naming the sender
+ */
+void Receiver::beginMetrics(FileDefinition &fileInfo, QTcpSocket *socket)
+{
+    fileInfo.metricsId = TransferMetrics::begin(TransferMetrics::Direction::Receive, fileInfo.name,
+                                                socket->peerAddress().toString(), fileInfo.size);
+    TransferMetrics::accepted(fileInfo.metricsId);
+    fileInfo.metricsReported = fileInfo.totalReceived;
+    TransferTrace::complete("accept wait", "receive", fileInfo.headerAt, fileInfo.metricsId);
+}
+
+/**
+ * @brief Counts the bytes received since the last call in TransferMetrics.
+ *
+ * TransferMetrics takes a lock shared by every transfer, so while data
+ * flows the bytes are counted once @p batch of them accumulated; the
+ * first ones are counted at once for the time to first byte.
+ *
+ * @param batch Bytes left uncounted until the next call, 0 to count everything now
+ */
+void Receiver::countReceived(FileDefinition &fileInfo, qint64 batch)
+{
+    qint64 uncounted = fileInfo.totalReceived - fileInfo.metricsReported;
+    if (fileInfo.metricsCounted && uncounted < batch)
+        return;
+
+    TransferMetrics::addBytes(fileInfo.metricsId, uncounted);
+    fileInfo.metricsReported = fileInfo.totalReceived;
+    fileInfo.metricsCounted = fileInfo.metricsCounted || uncounted > 0;
+}
+
+/**
+ * @brief Emits progress for a transfer and closes it once every byte arrived.
+ *
+ * A verified file is only closed once its trailer arrived and matched.
+ *
+ * @param primary Primary connection of the transfer
+ * @return true if a session connection moved on to its next file
+ */
+bool Receiver::reportProgress(QTcpSocket *primary)
+{
+    FileDefinition &fileInfo = pendingFiles[primary];
+    countReceived(fileInfo, METRICS_BATCH);
+    if (fileInfo.counter)
+        fileInfo.counter->bytes.storeRelaxed(fileInfo.totalReceived);
+    float percentage = fileInfo.size > 0 ? ((float)fileInfo.totalReceived / (float)fileInfo.size) * 100 : 100;
+    if (fileInfo.file && !fileInfo.writer)
+        fileInfo.file->flush();
+    if (fileInfo.relay)
+        fileInfo.relay->setAvailable(fileInfo.position);
+
+    // Only whole-percent changes are posted to the GUI thread
+    if (static_cast<int>(percentage) != fileInfo.lastProgress)
+    {
+        fileInfo.lastProgress = static_cast<int>(percentage);
+        if (fileInfo.totalReceived < fileInfo.size)
+            saveResumeState(fileInfo);
+
+        // A watched counter already tells the GUI thread, without a queued signal per percent
+        if (!fileInfo.counter || !fileInfo.counter->watched.loadRelaxed() || fileInfo.lastProgress == 100)
+            emit transferProgressUpdated(fileInfo.name, fileInfo.lastProgress, fileInfo.transferId);
+    }
+
+    // Corrupted blocks are being received again
+    if (fileInfo.phase == ReceivePhase::Repair)
+        return false;
+
+    // An archive is complete once its last file was written
+    if (fileInfo.unpacker && !fileInfo.unpacker->isComplete())
+        return false;
+
+    // A multicast transfer is complete once the last repair round confirmed it
+    if (fileInfo.multicast && !fileInfo.multicastDone)
+        return false;
+
+    // A delta is complete once its end operation arrived
+    if (fileInfo.delta ? !fileInfo.delta->isFinished() : fileInfo.totalReceived < fileInfo.size)
+        return false;
+
+    if (fileInfo.hasher && !verifyTrailer(primary))
+        return false;
+
+    if (sessionConnections.contains(primary))
+        return completeSessionFile(primary);
+
+    // Transfer complete
+    for (auto it = stripeSockets.begin(); it != stripeSockets.end();)
+    {
+        if (it.value().primary == primary)
+        {
+            QTcpSocket *stripeSocket = it.key();
+            it = stripeSockets.erase(it);
+            stripeSocket->disconnectFromHost();
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    primary->disconnectFromHost();
+    return false;
+}
+
+/**
+ * @brief Registers a secondary connection of a striped transfer.
+ *
+ * The token must match a transfer this receiver accepted with stripes, and
+ * the index selects which byte range the connection carries.
+ *
+ * @param socket The new connection
+ * @param token Token of the transfer it announced
+ * @param index Stripe index it announced
+ */
+void Receiver::handleStripeConnection(QTcpSocket *socket, const QByteArray &token, int index)
+{
+    for (auto it = pendingFiles.begin(); it != pendingFiles.end(); ++it)
+    {
+        const FileDefinition &fileInfo = it.value();
+        if (fileInfo.stripeCount < 2 || fileInfo.stripeToken != token || !fileInfo.file)
+            continue;
+        if (index < 1 || index >= fileInfo.stripeCount)
+            break;
+
+        StripeConnection stripe;
+        stripe.primary = it.key();
+        Protocol::stripeRange(fileInfo.size, fileInfo.stripeCount, index, &stripe.position, &stripe.end,
+                              fileInfo.stripeWeights);
+        stripeSockets.insert(socket, stripe);
+
+        // Range data usually follows the announcement in the same segment
+        if (socket->bytesAvailable() > 0)
+            receiveStripeData(socket);
+        return;
+    }
+
+    Receiver *owner = nullptr;
+    if (registry)
+    {
+        ReceiverRegistry::Shard &shard = registry->shardOf(token);
+        QMutexLocker lock(&shard.mutex);
+        owner = shard.stripeTokens.value(token);
+    }
+    if (owner && owner != this)
+    {
+        // The stripe reached another worker than its transfer, which takes the socket over
+        int version = socketVersions.take(socket);
+        disconnect(socket, nullptr, this, nullptr);
+        untrack(socket);
+        releaseBuffer(socket);
+        socket->setParent(nullptr);
+        socket->moveToThread(owner->thread());
+        QMetaObject::invokeMethod(owner, [owner, socket, token, index, version]()
+                                  { owner->adoptStripe(socket, token, index, version); }, Qt::QueuedConnection);
+        return;
+    }
+
+    socket->disconnectFromHost();
+}
+
+/**
+ * @brief Takes over a stripe connection another worker accepted.
+ *
+ * @param socket Stripe connection, its join message already read
+ * @param token Token the stripe presented
+ * @param index Stripe index it presented
+ * @param version Protocol version of the connection
+ */
+void Receiver::adoptStripe(QTcpSocket *socket, const QByteArray &token, int index, int version)
+{
+    socket->setParent(this);
+    socketVersions[socket] = version;
+    setupConnection(socket);
+    handleStripeConnection(socket, token, index);
+}
+
+/**
+ * @brief Writes data arriving on a stripe connection at its range offset.
+ *
+ * @param socket A registered stripe connection
+ */
+void Receiver::receiveStripeData(QTcpSocket *socket)
+{
+    StripeConnection &stripe = stripeSockets[socket];
+    if (!pendingFiles.contains(stripe.primary))
+    {
+        stripeSockets.remove(socket);
+        socket->disconnectFromHost();
+        return;
+    }
+
+    FileDefinition &fileInfo = pendingFiles[stripe.primary];
+    qint64 remaining = stripe.end - stripe.position;
+    if (remaining <= 0 || !fileInfo.file || !fileInfo.file->isOpen()) return;
+    if (throttled(socket, stripe.primary)) return;
+    if (socket->bytesAvailable() <= 0) return;
+
+    while (remaining > 0)
+    {
+        QByteArray data = readPooled(socket, remaining);
+        if (data.isEmpty())
+            break;
+
+        if (!writeAt(fileInfo, stripe.position, data))
+        {
+            emit transferStatusUpdated(fileInfo.name, TransferStatus::CANCELLED, fileInfo.transferId);
+            stripe.primary->disconnectFromHost();
+            return;
+        }
+
+        stripe.position += data.size();
+        fileInfo.totalReceived += data.size();
+        remaining -= data.size();
+        BandwidthShaper::consume(socket->peerAddress().toString(), &sessionBuckets[stripe.primary], data.size());
+        BufferPool::release(data);
+    }
+
+    reportProgress(stripe.primary);
+}
+
+/**
+ * @brief Handles client disconnection and transfer cleanup.
+ *
+ * Called when a client disconnects, either normally after transfer completion
+ * or abnormally due to network issues.
+ */
+void Receiver::onDisconnected()
+{
+    QTcpSocket *clientSocket = qobject_cast<QTcpSocket *>(sender());
+    if (!clientSocket) return;
+
+    throttledSockets.remove(clientSocket);
+    sessionBuckets.remove(clientSocket);
+    socketVersions.remove(clientSocket);
+    partialHeaders.remove(clientSocket);
+    untrack(clientSocket);
+    releaseBuffer(clientSocket);
+
+    if (stripeSockets.contains(clientSocket))
+    {
+        // A stripe dropping out before its range is complete aborts the file
+        StripeConnection stripe = stripeSockets.take(clientSocket);
+        if (pendingFiles.contains(stripe.primary) && stripe.position < stripe.end)
+            stripe.primary->disconnectFromHost();
+        clientSocket->deleteLater();
+        return;
+    }
+
+    if (pendingFiles.contains(clientSocket))
+    {
+        FileDefinition &fileInfo = pendingFiles[clientSocket];
+        QFile *file = fileInfo.file;
+        QString fileName = fileInfo.name;
+        QString filePath = file ? file->fileName() : QString();
+        bool complete = fileInfo.totalReceived >= fileInfo.size && (!fileInfo.delta || fileInfo.delta->isFinished()) &&
+                        (!fileInfo.multicast || fileInfo.multicastDone) && !fileInfo.hasher && !fileInfo.hashMismatch &&
+                        (!fileInfo.unpacker || fileInfo.unpacker->isComplete()) &&
+                        fileInfo.phase != ReceivePhase::Repair && fileInfo.phase != ReceivePhase::Recheck;
+
+        // Data still buffered is written before the file is closed or resumed
+        if (!closeWriter(fileInfo))
+            complete = false;
+
+        // A failed archive does not leave some of its files behind
+        if (fileInfo.unpacker)
+        {
+            if (!complete)
+                fileInfo.unpacker->discard();
+            delete fileInfo.unpacker;
+            fileInfo.unpacker = nullptr;
+        }
+
+        if (fileInfo.multicast)
+        {
+            fileInfo.multicast->deleteLater();
+            fileInfo.multicast = nullptr;
+        }
+
+        if (file)
+        {
+            if (file->isOpen()) file->close();
+            delete file;
+            fileInfo.file = nullptr;
+        }
+
+        delete fileInfo.hasher;
+        fileInfo.hasher = nullptr;
+
+        // The relay sends the end of the file only once the local copy is complete
+        if (fileInfo.relay)
+        {
+            if (complete)
+                fileInfo.relay->finishInput();
+            else
+                fileInfo.relay->abort();
+            fileInfo.relay = nullptr;
+        }
+
+        if (fileInfo.delta)
+        {
+            // The rebuilt copy replaces the old one, nothing is left to resume
+            complete = finishDelta(fileInfo, complete);
+            filePath.clear();
+        }
+
+        countReceived(fileInfo);
+        TransferTrace::instant("finish", "receive", fileInfo.metricsId);
+        TransferMetrics::end(fileInfo.metricsId, complete && !fileInfo.hashMismatch ? TransferMetrics::Outcome::Finished
+                                                                                    : TransferMetrics::Outcome::Failed);
+
+        if (fileInfo.hashMismatch)
+        {
+            // Corrupted data is not kept, not even for resuming
+            if (!filePath.isEmpty())
+            {
+                QFile::remove(filePath);
+                ResumeState::remove(filePath);
+            }
+        }
+        else if (!complete)
+        {
+            // The partial data stays on disk for the next attempt, up to the first corrupted block
+            bool repairing = (fileInfo.phase == ReceivePhase::Repair || fileInfo.phase == ReceivePhase::Recheck);
+            if (!filePath.isEmpty() && Config::getResumeEnabled())
+                ResumeState::save(filePath, fileInfo.size, fileInfo.sourceTag, repairing ? fileInfo.repairFrom : fileInfo.position);
+            else if (GroupCommit::isPart(filePath))
+                QFile::remove(filePath);
+            emit transferStatusUpdated(fileName, TransferStatus::CANCELLED, fileInfo.transferId);
+        }
+        else
+        {
+            commitFile(filePath, fileName, fileInfo.transferId, fileInfo.verifiedHash);
+        }
+
+        if (registry && !fileInfo.stripeToken.isEmpty())
+        {
+            ReceiverRegistry::Shard &shard = registry->shardOf(fileInfo.stripeToken);
+            QMutexLocker lock(&shard.mutex);
+            shard.stripeTokens.remove(fileInfo.stripeToken);
+        }
+        pendingFiles.remove(clientSocket);
+
+        for (auto it = stripeSockets.begin(); it != stripeSockets.end();)
+        {
+            if (it.value().primary == clientSocket)
+            {
+                QTcpSocket *stripeSocket = it.key();
+                it = stripeSockets.erase(it);
+                stripeSocket->disconnectFromHost();
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    if (sessionConnections.contains(clientSocket))
+    {
+        // Files of the batch that never started are cancelled as well
+        for (FileDefinition &fileInfo : sessionConnections[clientSocket].queue)
+        {
+            closeWriter(fileInfo);
+            if (fileInfo.file)
+            {
+                if (fileInfo.file->isOpen()) fileInfo.file->close();
+                delete fileInfo.file;
+            }
+            delete fileInfo.hasher;
+            TransferMetrics::end(fileInfo.metricsId, TransferMetrics::Outcome::Failed);
+            emit transferStatusUpdated(fileInfo.name, TransferStatus::CANCELLED, fileInfo.transferId);
+        }
+        sessionConnections.remove(clientSocket);
+    }
+
+    clientSocket->deleteLater();
+}
+
+/**
+ * @brief Associates a file handle with a client socket for file reception.
+ *
+ * Called by the UI layer after user accepts a file transfer. Sets up the
+ * file handle for writing incoming data and cleans up any existing file
+ * associated with the socket.
+ *
+ * @param socket The client socket requesting file transfer
+ * @param file The file handle to write received data to
+ */
+void Receiver::setFile(QTcpSocket *socket, QFile *file)
+{
+    if (!workers.isEmpty())
+    {
+        Receiver *owner = ownerOf(socket);
+        if (!owner)
+        {
+            delete file;
+            return;
+        }
+        if (file)
+            file->moveToThread(owner->thread());
+        QMetaObject::invokeMethod(owner, [owner, socket, file]()
+                                  { owner->setFile(socket, file); }, Qt::BlockingQueuedConnection);
+        return;
+    }
+
+    if (!socket || !file || !pendingFiles.contains(socket))
+    {
+        delete file; // Clean up passed file if invalid parameters
+        return;
+    }
+
+    // Clean up existing file if any
+    FileDefinition &fileInfo = pendingFiles[socket];
+    closeWriter(fileInfo);
+    if (fileInfo.file)
+    {
+        if (fileInfo.file->isOpen()) fileInfo.file->close();
+        delete fileInfo.file;
+    }
+
+    fileInfo.file = file;
+}
+
+/**
+ * @brief Accepts a pending transfer and answers the sender.
+ *
+ * Opens the destination file in the received files folder, then replies
+ * "OK". When a verified partial copy of the file is already there, the reply
+ * is "OK|offset=N" and the sender continues from byte N. When the sender
+ * offered a delta and a complete older copy exists, the reply carries the
+ * block size and is followed by the block signature of that copy. When both
+ * sides allow compression, the reply confirms the codec and the lower of the
+ * two levels, and the data arrives as compression frames. When both sides
+ * verify files, the reply confirms the hash and the receiver compares the
+ * trailer after the data with its own digest. When the sender
+ * offered striping and this side allows it, the reply
+ * carries the agreed stripe count and a token the secondary connections use
+ * to join the transfer. On a session connection the reply is held back until
+ * every earlier file of the batch has been answered. When the header names
+ * more nodes to relay to, the file is forwarded to them while it is written.
+ * When the sender offered a multicast channel and the group can be joined,
+ * the reply confirms it with "mcast=1" and the data arrives on the group.
+ * An archive of several files is confirmed with "archive=1" instead (see
+ * acceptArchive()). When the sender named the contents and a local file
+ * already holds them, the copy is made locally and the reply is "have=1"
+ * (see acceptDuplicate()).
+ *
+ * @param socket Connection of the transfer request
+ * @param fileName Name of the accepted file, used on session connections
+ * @return false if the destination file could not be opened (the transfer is refused)
+ */
+bool Receiver::acceptTransfer(QTcpSocket *socket, const QString &fileName)
+{
+    if (!workers.isEmpty())
+    {
+        // Answered by the worker serving the connection
+        Receiver *owner = ownerOf(socket);
+        bool accepted = false;
+        if (owner)
+            QMetaObject::invokeMethod(owner, [owner, socket, fileName, &accepted]()
+                                      { accepted = owner->acceptTransfer(socket, fileName); }, Qt::BlockingQueuedConnection);
+        return accepted;
+    }
+
+    // Answered, the connection no longer holds a place among the waiting ones
+    leavePending(socket);
+
+    if (socket && sessionConnections.contains(socket))
+    {
+        FileDefinition *fileInfo = findUndecided(socket, fileName);
+        if (!fileInfo)
+            return false;
+
+        fileInfo->decided = true;
+        fileInfo->file = openDestination(*fileInfo);
+        fileInfo->accepted = (fileInfo->file != nullptr);
+        if (fileInfo->accepted)
+        {
+            beginMetrics(*fileInfo, socket);
+            fileInfo->phase = ReceivePhase::Data;
+            startHashing(*fileInfo);
+            startWriter(*fileInfo, socket);
+        }
+
+        bool accepted = fileInfo->accepted;
+        flushSessionReplies(socket);
+        return accepted;
+    }
+
+    if (!socket || !pendingFiles.contains(socket))
+        return false;
+
+    if (pendingFiles[socket].archiveCount > 0)
+    {
+        if (!acceptArchive(socket))
+            return false;
+        beginMetrics(pendingFiles[socket], socket);
+        return true;
+    }
+
+    if (acceptDuplicate(socket))
+        return true;
+
+    DeltaSync::Signature signature;
+    QFile *file = openDeltaDestination(pendingFiles[socket], &signature);
+    if (!file)
+        file = openDestination(pendingFiles[socket]);
+    if (!file)
+    {
+        rejectTransfer(socket);
+        return false;
+    }
+    setFile(socket, file);
+
+    FileDefinition &fileInfo = pendingFiles[socket];
+    Protocol::TransferReply reply;
+    reply.accepted = true;
+
+    // The sender's profile bounds what is accepted, as it is when the file is accepted
+    TransferProfiles::Settings profile = TransferProfiles::settings(socket->peerAddress().toString());
+    fileInfo.stripeCount = qMin(fileInfo.offeredStripes, profile.stripeCount);
+
+    // Holes are skipped in plain data written in place, arriving on one connection
+    fileInfo.sparse = fileInfo.offersSparse && Config::getSparseFilesEnabled() && !fileInfo.delta &&
+                      fileInfo.rangeStart < 0 && fileInfo.relayChain.isEmpty();
+
+    // Deltas and resumed files continue on the primary connection only
+    if (fileInfo.delta)
+    {
+        fileInfo.stripeCount = 1;
+        reply.options.insert("delta", QByteArray::number(signature.blockSize));
+        reply.options.insert("base", QByteArray::number(signature.basisSize));
+        reply.options.insert("sig", QByteArray::number(signature.weak.size() * DeltaSync::SIGNATURE_RECORD));
+    }
+    else if (fileInfo.resumeOffset > 0)
+    {
+        fileInfo.stripeCount = 1;
+        reply.options.insert("offset", QByteArray::number(fileInfo.resumeOffset));
+    }
+    else if (fileInfo.stripeCount > 1 && fileInfo.size > 0 && !fileInfo.sparse)
+    {
+        fileInfo.stripeToken = QUuid::createUuid().toRfc4122().toHex();
+        reply.options.insert("stripes", QByteArray::number(fileInfo.stripeCount));
+        reply.options.insert("token", fileInfo.stripeToken);
+        if (registry)
+        {
+            ReceiverRegistry::Shard &shard = registry->shardOf(fileInfo.stripeToken);
+            QMutexLocker lock(&shard.mutex);
+            shard.stripeTokens.insert(fileInfo.stripeToken, this);
+        }
+    }
+    else
+    {
+        fileInfo.stripeCount = 1;
+    }
+
+    QByteArray datagramOption;
+    if (!fileInfo.sparse && joinMulticast(socket, fileInfo))
+        reply.options.insert("mcast", "1");
+    else if (!fileInfo.sparse && openDatagramFlow(socket, fileInfo, &datagramOption))
+        reply.options.insert("udp", datagramOption);
+
+    // Compression frames are only used on a single connection carrying file data
+    int level = qBound(1, qMin(fileInfo.offeredLevel, profile.compressionLevel), 9);
+    if (profile.compression && fileInfo.offeredCodec == Compression::CODEC_ZLIB &&
+        fileInfo.stripeCount == 1 && !fileInfo.delta && !fileInfo.multicast && !fileInfo.sparse)
+    {
+        fileInfo.compressed = true;
+        reply.options.insert("compress", Compression::CODEC_ZLIB);
+        reply.options.insert("level", QByteArray::number(level));
+    }
+
+    // Block checksums let corrupted blocks be received again; data that is
+    // not written as sent (compressed, a delta) or is forwarded is not repaired
+    if (fileInfo.offersHash && fileInfo.size > 0 && fileInfo.rangeStart < 0 && !fileInfo.compressed && !fileInfo.delta &&
+        !fileInfo.multicast && fileInfo.relayChain.isEmpty())
+        fileInfo.blockSize = BlockMap::blockSizeFor(fileInfo.size);
+
+    startHashing(fileInfo);
+    if (fileInfo.hasher)
+        reply.options.insert("hash", StreamHasher::ALGORITHM);
+    if (fileInfo.hasher && fileInfo.blockSize > 0)
+        reply.options.insert("blocks", QByteArray::number(fileInfo.blockSize));
+    else
+        fileInfo.blockSize = 0;
+    if (fileInfo.sparse)
+        reply.options.insert("sparse", "1");
+
+    qint64 primaryStart = 0;
+    Protocol::stripeRange(fileInfo.size, fileInfo.stripeCount, 0, &primaryStart, &fileInfo.rangeEnd, fileInfo.stripeWeights);
+
+    beginMetrics(fileInfo, socket);
+    socket->write(reply.encode(socketVersions.value(socket, Protocol::VERSION_1)));
+    if (fileInfo.delta)
+        socket->write(signature.encode());
+    socket->flush();
+
+    if (fileInfo.stripeCount > 1)
+        emit transferStripeCountNegotiated(fileInfo.name, fileInfo.stripeCount, fileInfo.transferId);
+    if (fileInfo.compressed)
+        emit transferCompressionNegotiated(fileInfo.name, QString::fromUtf8(Compression::CODEC_ZLIB), level, fileInfo.transferId);
+    startRelay(fileInfo);
+    startWriter(fileInfo, socket);
+    fileInfo.phase = ReceivePhase::Data;
+    drainBuffered(socket);
+    return true;
+}
+
+/**
+ * @brief Processes data that arrived before the transfer was accepted.
+ *
+ * No readyRead() follows for bytes already buffered, so they are handled
+ * from the event loop once the answer was sent.
+ *
+ * @param socket Primary connection of the accepted transfer
+ */
+void Receiver::drainBuffered(QTcpSocket *socket)
+{
+    if (socket->bytesAvailable() <= 0)
+        return;
+
+    QPointer<QTcpSocket> guard(socket);
+    QMetaObject::invokeMethod(this, [this, guard]()
+                              {
+        if (guard && pendingFiles.contains(guard))
+            receiveFileData(guard); }, Qt::QueuedConnection);
+}
+
+/**
+ * @brief Completes a transfer from a local file with the contents the sender named.
+ *
+ * The file is cloned into the received files folder, or left alone if it
+ * is the destination itself, and the sender is told "have=1" so it sends
+ * no data. Only files whose hash was verified or computed locally are
+ * found, a sender naming other contents gets those contents.
+ *
+ * @param socket Connection of the transfer request
+ * @return false to receive the file normally
+ */
+bool Receiver::acceptDuplicate(QTcpSocket *socket)
+{
+    FileDefinition &fileInfo = pendingFiles[socket];
+    if (fileInfo.offeredContent.isEmpty() || !Config::getDedupEnabled())
+        return false;
+
+    QString source = ContentIndex::find(fileInfo.offeredContent, fileInfo.size);
+    if (source.isEmpty())
+        return false;
+
+    QDir dir(Config::getReceivedFilesPath());
+    dir.mkpath(".");
+    QString filePath = receivedFilePath(fileInfo.name);
+    if (filePath.isEmpty())
+        return false;
+    filePath = QFileInfo(filePath).absoluteFilePath();
+    if (source != filePath && !ContentIndex::cloneFile(source, filePath))
+        return false;
+    ResumeState::remove(filePath);
+    ContentIndex::record(filePath, fileInfo.offeredContent);
+
+    fileInfo.stripeCount = 1;
+    fileInfo.rangeEnd = fileInfo.size;
+    fileInfo.position = fileInfo.size;
+    fileInfo.totalReceived = fileInfo.size;
+    fileInfo.phase = ReceivePhase::Data;
+
+    Protocol::TransferReply reply;
+    reply.accepted = true;
+    reply.options.insert("have", "1");
+    socket->write(reply.encode(socketVersions.value(socket, Protocol::VERSION_1)));
+    socket->flush();
+
+    // Reported as received once the connection closes
+    emit transferProgressUpdated(fileInfo.name, 100, fileInfo.transferId);
+    socket->disconnectFromHost();
+    return true;
+}
+
+/**
+ * @brief Accepts an archive stream, unpacked into the received files folder as it arrives.
+ *
+ * Archives are sent whole on one connection: only the hash trailer is
+ * negotiated, they are not striped, resumed, delta-encoded or compressed.
+ *
+ * @param socket Connection of the transfer request
+ * @return true once the reply was sent
+ */
+bool Receiver::acceptArchive(QTcpSocket *socket)
+{
+    FileDefinition &fileInfo = pendingFiles[socket];
+    QDir dir(Config::getReceivedFilesPath());
+    dir.mkpath(".");
+    fileInfo.unpacker = new ArchiveUnpacker(dir.path(), fileInfo.archiveCount);
+    fileInfo.stripeCount = 1;
+    fileInfo.rangeEnd = fileInfo.size;
+
+    Protocol::TransferReply reply;
+    reply.accepted = true;
+    reply.options.insert("archive", "1");
+    startHashing(fileInfo);
+    if (fileInfo.hasher)
+        reply.options.insert("hash", StreamHasher::ALGORITHM);
+
+    socket->write(reply.encode(socketVersions.value(socket, Protocol::VERSION_1)));
+    socket->flush();
+    fileInfo.phase = ReceivePhase::Data;
+    drainBuffered(socket);
+    return true;
+}
+
+/**
+ * @brief Unpacks the archive data of a connection until the stream is complete.
+ *
+ * @param socket Primary connection of the archive
+ */
+void Receiver::receiveArchiveData(QTcpSocket *socket)
+{
+    FileDefinition &fileInfo = pendingFiles[socket];
+    if (throttled(socket, socket))
+        return;
+
+    qint64 remaining = fileInfo.size - fileInfo.position;
+    if (remaining > 0 && socket->bytesAvailable() <= 0)
+        return;
+
+    while (remaining > 0)
+    {
+        QByteArray data = readPooled(socket, remaining);
+        if (data.isEmpty())
+            break;
+
+        if (!fileInfo.unpacker->write(data))
+        {
+            // qDebug() << "Receiver: Malformed archive" << fileInfo.name;
+            emit transferStatusUpdated(fileInfo.name, TransferStatus::CANCELLED, fileInfo.transferId);
+            socket->disconnectFromHost();
+            return;
+        }
+
+        if (fileInfo.hasher)
+            fileInfo.hasher->addData(data);
+        fileInfo.position += data.size();
+        fileInfo.totalReceived += data.size();
+        remaining -= data.size();
+        BandwidthShaper::consume(socket->peerAddress().toString(), &sessionBuckets[socket], data.size());
+        BufferPool::release(data);
+    }
+
+    reportProgress(socket);
+}
+
+/**
+ * @brief Joins the multicast channel the sender offered for an accepted file.
+ *
+ * Blocks are written at their offset as they arrive; losses are repaired
+ * over the connection (see receiveRepairMessages()).
+ *
+ * @param socket Connection of the transfer
+ * @param fileInfo Receive state of the accepted file, its destination already open
+ * @return false to receive the file over the connection instead
+ */
+bool Receiver::joinMulticast(QTcpSocket *socket, FileDefinition &fileInfo)
+{
+    // Datagrams are not encrypted
+    Multicast::Channel channel;
+    if (SecureTransport::required() || fileInfo.offeredMulticast.isEmpty() || fileInfo.delta || fileInfo.stripeCount > 1 || fileInfo.resumeOffset > 0 ||
+        !Multicast::Channel::decode(fileInfo.offeredMulticast, &channel))
+        return false;
+
+    MulticastReceiver *multicast = new MulticastReceiver(fileInfo.file, fileInfo.size, channel, this);
+    if (!multicast->open())
+    {
+        delete multicast;
+        return false;
+    }
+
+    watchMulticast(socket, multicast);
+    fileInfo.multicast = multicast;
+    return true;
+}
+
+/**
+ * @brief Opens a UDP port for the data of an accepted file when the sender offered it.
+ *
+ * The blocks arrive as on a multicast channel and are repaired the same way
+ * (see receiveRepairMessages()); only plain data of a whole file, new on
+ * this side, is taken over UDP.
+ *
+ * @param socket Connection of the transfer
+ * @param fileInfo Receive state of the accepted file, its destination already open
+ * @param option Set to the "udp" reply option naming the port
+ * @return false to receive the file over the connection instead
+ */
+bool Receiver::openDatagramFlow(QTcpSocket *socket, FileDefinition &fileInfo, QByteArray *option)
+{
+    if (SecureTransport::required() || !fileInfo.offersDatagram || fileInfo.delta || fileInfo.stripeCount > 1 || fileInfo.resumeOffset > 0 ||
+        fileInfo.rangeStart >= 0 || fileInfo.archiveCount > 0 || !fileInfo.relayChain.isEmpty() || fileInfo.size <= 0)
+        return false;
+
+    Multicast::Channel channel;
+    channel.token = QRandomGenerator::global()->generate();
+    MulticastReceiver *flow = new MulticastReceiver(fileInfo.file, fileInfo.size, channel, this);
+    if (!flow->open())
+    {
+        delete flow;
+        return false;
+    }
+
+    watchMulticast(socket, flow);
+    channel.port = flow->port();
+    *option = DatagramTransport::encodeChannel(channel);
+    fileInfo.multicast = flow;
+    return true;
+}
+
+/**
+ * @brief Follows the blocks a MulticastReceiver writes for the transfer on @p socket.
+ */
+void Receiver::watchMulticast(QTcpSocket *socket, MulticastReceiver *multicast)
+{
+    connect(multicast, &MulticastReceiver::dataWritten, this, [this, socket, multicast]()
+            {
+        if (!pendingFiles.contains(socket) || pendingFiles[socket].multicast != multicast)
+            return;
+        pendingFiles[socket].totalReceived = multicast->received();
+        reportProgress(socket); });
+    connect(multicast, &MulticastReceiver::writeFailed, this, [this, socket, multicast]()
+            {
+        if (!pendingFiles.contains(socket) || pendingFiles[socket].multicast != multicast)
+            return;
+        emit transferStatusUpdated(pendingFiles[socket].name, TransferStatus::CANCELLED, pendingFiles[socket].transferId);
+        socket->disconnectFromHost(); });
+}
+
+/**
+ * @brief Answers the sender's repair rounds of a multicast transfer.
+ *
+ * Each round end is answered with the blocks still missing, or once the
+ * file is complete (and matches the digest when verified) with Done.
+ *
+ * @param socket Connection of a joined multicast transfer
+ */
+void Receiver::receiveRepairMessages(QTcpSocket *socket)
+{
+    int version = socketVersions.value(socket, Protocol::VERSION_1);
+    while (pendingFiles.contains(socket) && !pendingFiles[socket].multicastDone)
+    {
+        FileDefinition &fileInfo = pendingFiles[socket];
+        if (fileInfo.phase != ReceivePhase::Verify)
+        {
+            QByteArray message;
+            Protocol::ReadStatus status = Protocol::readMessage(socket, version, &message);
+            if (status == Protocol::ReadStatus::Incomplete)
+                return;
+
+            Protocol::RepairMessage repair;
+            if (status == Protocol::ReadStatus::Malformed || !Protocol::RepairMessage::decode(message, &repair) ||
+                repair.kind != Protocol::RepairMessage::RoundEnd)
+            {
+                emit transferStatusUpdated(fileInfo.name, TransferStatus::CANCELLED, fileInfo.transferId);
+                socket->disconnectFromHost();
+                return;
+            }
+
+            if (!fileInfo.multicast->isComplete())
+            {
+                Protocol::RepairMessage answer;
+                answer.round = repair.round;
+                answer.kind = Protocol::RepairMessage::Missing;
+                answer.ranges = fileInfo.multicast->missingRanges(Multicast::MAX_RANGES);
+                socket->write(answer.encode(version));
+                socket->flush();
+                continue;
+            }
+
+            fileInfo.file->flush();
+            fileInfo.multicastRound = repair.round;
+            if (fileInfo.hasher)
+            {
+                // Blocks arrived out of order, so the file is hashed once complete
+                fileInfo.hasher->addFileRange(fileInfo.file->fileName(), 0, fileInfo.size);
+                fileInfo.trailerDigest = repair.digest;
+                fileInfo.phase = ReceivePhase::Verify;
+            }
+        }
+
+        if (fileInfo.hasher)
+        {
+            if (!hashReady(socket))
+                return;
+
+            QByteArray expected = fileInfo.hasher->result();
+            delete fileInfo.hasher;
+            fileInfo.hasher = nullptr;
+            fileInfo.phase = ReceivePhase::Data;
+            if (expected.isEmpty() || expected != fileInfo.trailerDigest)
+            {
+                // qDebug() << "Receiver: Hash mismatch for" << fileInfo.name;
+                fileInfo.hashMismatch = true;
+                emit transferStatusUpdated(fileInfo.name, TransferStatus::ERROR, fileInfo.transferId);
+                socket->disconnectFromHost();
+                return;
+            }
+        }
+
+        Protocol::RepairMessage answer;
+        answer.round = fileInfo.multicastRound;
+        answer.kind = Protocol::RepairMessage::Done;
+        socket->write(answer.encode(version));
+        socket->flush();
+        fileInfo.multicastDone = true;
+        fileInfo.totalReceived = fileInfo.size;
+        reportProgress(socket);
+    }
+}
+
+/**
+ * @brief Starts forwarding an accepted file when the sender relays it through this receiver.
+ *
+ * Only plain data arriving in file order can be forwarded as it is written.
+ *
+ * @param fileInfo Receive state of the accepted file, its destination already open
+ */
+void Receiver::startRelay(FileDefinition &fileInfo)
+{
+    QList<FanoutTarget> chain = ChainRelay::decodeChain(fileInfo.relayChain);
+    if (chain.isEmpty() || fileInfo.delta || fileInfo.stripeCount > 1)
+        return;
+
+    fileInfo.relay = new ChainRelay(this);
+    connect(fileInfo.relay, &ChainRelay::relayFinished, fileInfo.relay, &QObject::deleteLater);
+    fileInfo.relay->start(fileInfo.file->fileName(), fileInfo.name, fileInfo.size, chain, fileInfo.position);
+}
+
+/**
+ * @brief Puts a write-behind stage in front of an accepted file (see FileWriter).
+ *
+ * Only data written through writeAt() can be buffered: rebuilt deltas,
+ * multicast blocks and archives write on their own, and a relay reads the
+ * file back as soon as the receiver reports the bytes.
+ *
+ * The file is synced as the sender's profile asks (see TransferProfiles).
+ *
+ * @param fileInfo Receive state of the accepted file, its destination already open
+ * @param socket Connection of the file
+ */
+void Receiver::startWriter(FileDefinition &fileInfo, QTcpSocket *socket)
+{
+    if (!Config::getWriteBehindEnabled() || !fileInfo.file || fileInfo.delta || fileInfo.multicast ||
+        fileInfo.unpacker || fileInfo.relay)
+        return;
+
+    // Preallocating a sparse file would allocate its holes
+    fileInfo.writer = new FileWriter(fileInfo.file->fileName(), fileInfo.sparse ? 0 : fileInfo.size,
+                                     TransferProfiles::settings(socket->peerAddress().toString()).durability);
+    if (fileInfo.writer->hasFailed())
+    {
+        delete fileInfo.writer;
+        fileInfo.writer = nullptr;
+    }
+}
+
+/**
+ * @brief Reports a completely received file once it is synced and under its final name.
+ *
+ * @param filePath Closed file the data was written to, empty when it is in place already
+ * @param fileName Name of the file as announced
+ * @param transferId Transfer the file belongs to
+ * @param verifiedHash Digest the trailer confirmed, empty if not verified
+ */
+void Receiver::commitFile(const QString &filePath, const QString &fileName, const QByteArray &transferId,
+                          const QByteArray &verifiedHash)
+{
+    if (filePath.isEmpty())
+    {
+        emit fileReceivedSuccessfully(QFileInfo(fileName).fileName(), transferId);
+        emit transferStatusUpdated(fileName, TransferStatus::FINISHED, transferId);
+        return;
+    }
+
+    ResumeState::remove(filePath);
+    GroupCommit::submit(filePath, this, [this, filePath, fileName, transferId, verifiedHash](bool committed)
+                        {
+        if (!committed)
+        {
+            // qDebug() << "Receiver: Could not commit" << filePath;
+            emit transferStatusUpdated(fileName, TransferStatus::ERROR, transferId);
+            return;
+        }
+        ContentIndex::record(GroupCommit::finalPath(filePath), verifiedHash);
+        emit fileReceivedSuccessfully(QFileInfo(fileName).fileName(), transferId);
+        emit transferStatusUpdated(fileName, TransferStatus::FINISHED, transferId); });
+}
+
+/**
+ * @brief Path an accepted file is written to until it is complete.
+ *
+ * Files are received under a temporary name (see GroupCommit); a relayed
+ * file keeps its name, the relay reads it as it grows.
+ */
+QString Receiver::receivePath(const FileDefinition &fileInfo) const
+{
+    QString filePath = receivedFilePath(fileInfo.name);
+    if (filePath.isEmpty())
+        return QString();
+    return fileInfo.relayChain.isEmpty() ? GroupCommit::partPath(filePath) : filePath;
+}
+
+/**
+ * @brief Whether a name announced by a sender is a plain file name.
+ *
+ * Names are written into the received files folder without asking when
+ * auto-accept is on, so separators of either kind, drive letters, absolute
+ * paths and "." or ".." are refused.
+ */
+bool Receiver::isSafeFileName(const QString &name)
+{
+    return Archive::isSafeName(name) && !name.contains('/');
+}
+
+/**
+ * @brief Path of a received file in the received files folder.
+ *
+ * @param name Name of the file as the sender announced it
+ * @return The path, or an empty string if it would not be directly in the folder
+ */
+QString Receiver::receivedFilePath(const QString &name)
+{
+    if (!isSafeFileName(name))
+        return QString();
+
+    QDir dir(Config::getReceivedFilesPath());
+    QString filePath = dir.filePath(name);
+
+    // Checked once the folder exists, a link in its place must not lead elsewhere
+    QString folder = QFileInfo(dir.absolutePath()).canonicalFilePath();
+    if (!folder.isEmpty() && QFileInfo(QFileInfo(filePath).absolutePath()).canonicalFilePath() != folder)
+        return QString();
+    return filePath;
+}
+
+/**
+ * @brief Writes what the write-behind stage still holds and removes it.
+ *
+ * A file the stage could not write completely only resumes from the data
+ * that reached the disk.
+ *
+ * @param fileInfo Receive state of the file
+ * @return false if some data could not be written
+ */
+bool Receiver::closeWriter(FileDefinition &fileInfo)
+{
+    if (!fileInfo.writer)
+        return true;
+
+    bool ok = fileInfo.writer->finish();
+    if (!ok)
+        fileInfo.position = qMin(fileInfo.position, fileInfo.writer->writtenUpTo(fileInfo.resumeOffset));
+    delete fileInfo.writer;
+    fileInfo.writer = nullptr;
+    return ok;
+}
+
+/**
+ * @brief Puts the data read from a connection in a lane of the bandwidth shaper.
+ *
+ * Stripes of the connection are charged to it and share the lane.
+ *
+ * @param socket Connection of the transfer
+ * @param priority Lane, see TransferPriority
+ */
+void Receiver::setTransferPriority(QTcpSocket *socket, TransferPriority priority)
+{
+    if (!socket)
+        return;
+
+    if (!workers.isEmpty())
+    {
+        Receiver *owner = ownerOf(socket);
+        if (owner)
+            QMetaObject::invokeMethod(owner, [owner, socket, priority]()
+                                      { owner->setTransferPriority(socket, priority); }, Qt::BlockingQueuedConnection);
+        return;
+    }
+
+    sessionBuckets[socket].setPriority(priority);
+}
+
+/**
+ * @brief Refuses a pending transfer and closes its connection.
+ *
+ * On a session connection only the named file is refused and the
+ * connection stays open for the rest of the batch.
+ *
+ * @param socket Connection of the transfer request
+ * @param fileName Name of the refused file, used on session connections
+ */
+void Receiver::rejectTransfer(QTcpSocket *socket, const QString &fileName)
+{
+    if (!socket)
+        return;
+
+    if (!workers.isEmpty())
+    {
+        Receiver *owner = ownerOf(socket);
+        if (owner)
+            QMetaObject::invokeMethod(owner, [owner, socket, fileName]()
+                                      { owner->rejectTransfer(socket, fileName); }, Qt::QueuedConnection);
+        return;
+    }
+
+    leavePending(socket);
+
+    if (sessionConnections.contains(socket))
+    {
+        FileDefinition *fileInfo = findUndecided(socket, fileName);
+        if (fileInfo)
+        {
+            fileInfo->decided = true;
+            fileInfo->accepted = false;
+            flushSessionReplies(socket);
+        }
+        return;
+    }
+
+    Protocol::TransferReply reply;
+    reply.accepted = false;
+    socket->write(reply.encode(socketVersions.value(socket, Protocol::VERSION_1)));
+    socket->flush();
+    socket->disconnectFromHost();
+}
+
+/**
+ * @brief Creates and opens the destination of an accepted file.
+ *
+ * The file is written under its temporary name (see receivePath()). A
+ * partial copy left by an interrupted transfer of the same file is kept
+ * when its sidecar still matches; the file's receive state then starts at
+ * the verified offset. Otherwise the destination is truncated. A ranged
+ * download is written into the existing copy at its offset instead,
+ * which lets a growing file be followed by asking for what was appended.
+ *
+ * @param fileInfo Receive state of the accepted file
+ * @return The open file, or nullptr if it could not be opened
+ */
+QFile *Receiver::openDestination(FileDefinition &fileInfo)
+{
+    QDir dir(Config::getReceivedFilesPath());
+    dir.mkpath(".");
+
+    if (fileInfo.rangeStart >= 0)
+    {
+        // A range lands in place, the rest of the local copy is kept
+        QString filePath = receivedFilePath(fileInfo.name);
+        if (filePath.isEmpty())
+            return nullptr;
+        QFile *file = new QFile(filePath);
+        if (!file->open(QIODevice::ReadWrite) || (file->size() < fileInfo.rangeStart && !file->resize(fileInfo.rangeStart)))
+        {
+            delete file;
+            return nullptr;
+        }
+        fileInfo.resumeOffset = fileInfo.rangeStart;
+        fileInfo.position = fileInfo.rangeStart;
+        fileInfo.totalReceived = fileInfo.rangeStart;
+        return file;
+    }
+
+    QString filePath = receivePath(fileInfo);
+    if (filePath.isEmpty())
+        return nullptr;
+    qint64 offset = 0;
+    if (Config::getResumeEnabled())
+        offset = ResumeState::resumableOffset(filePath, fileInfo.size, fileInfo.sourceTag);
+    if (offset == 0)
+        ResumeState::remove(filePath);
+
+    QFile *file = new QFile(filePath);
+    QIODevice::OpenMode mode = offset > 0 ? QIODevice::ReadWrite : QIODevice::WriteOnly;
+    if (!file->open(mode) || (offset > 0 && !file->resize(offset)))
+    {
+        delete file;
+        return nullptr;
+    }
+
+    fileInfo.resumeOffset = offset;
+    fileInfo.position = offset;
+    fileInfo.totalReceived = offset;
+    return file;
+}
+
+/**
+ * @brief Prepares a delta transfer against the copy already in the received files folder.
+ *
+ * The rebuilt file is written next to the old copy, which stays readable
+ * for block references until the transfer completes. Partial copies that
+ * can be resumed are left to openDestination().
+ *
+ * @param fileInfo Receive state of the accepted file
+ * @param signature Receives the block signature of the old copy
+ * @return The open rebuild file, or nullptr to receive the whole file instead
+ */
+QFile *Receiver::openDeltaDestination(FileDefinition &fileInfo, DeltaSync::Signature *signature)
+{
+    if (!fileInfo.offersDelta || !Config::getDeltaSyncEnabled())
+        return nullptr;
+
+    QString filePath = receivedFilePath(fileInfo.name);
+    QFile basis(filePath);
+    if (filePath.isEmpty() || basis.size() <= 0 ||
+        (Config::getResumeEnabled() && ResumeState::resumableOffset(receivePath(fileInfo), fileInfo.size, fileInfo.sourceTag) > 0))
+        return nullptr;
+
+    if (!basis.open(QIODevice::ReadOnly) ||
+        !DeltaSync::Signature::compute(&basis, DeltaSync::blockSizeFor(basis.size()), signature))
+        return nullptr;
+    basis.close();
+
+    QFile *file = new QFile(DeltaSync::rebuildPath(filePath));
+    if (!file->open(QIODevice::WriteOnly))
+    {
+        delete file;
+        return nullptr;
+    }
+
+    DeltaDecoder *decoder = new DeltaDecoder(filePath, file, signature->blockSize, fileInfo.size);
+    if (!decoder->open())
+    {
+        delete decoder;
+        file->remove();
+        delete file;
+        return nullptr;
+    }
+
+    fileInfo.delta = decoder;
+    return file;
+}
+
+/**
+ * @brief Applies delta operations arriving on the connection.
+ *
+ * @param socket Primary connection of a delta transfer
+ */
+void Receiver::receiveDeltaData(QTcpSocket *socket)
+{
+    FileDefinition &fileInfo = pendingFiles[socket];
+    DeltaDecoder *decoder = fileInfo.delta;
+    qint64 available = socket->bytesAvailable();
+    bool ok = decoder->readFrom(socket);
+    BandwidthShaper::consume(socket->peerAddress().toString(), &sessionBuckets[socket], available - socket->bytesAvailable());
+    if (!ok || (decoder->isFinished() && decoder->written() != fileInfo.size))
+    {
+        emit transferStatusUpdated(fileInfo.name, TransferStatus::CANCELLED, fileInfo.transferId);
+        socket->disconnectFromHost();
+        return;
+    }
+
+    fileInfo.totalReceived = decoder->written();
+    reportProgress(socket);
+}
+
+/**
+ * @brief Decodes compression frames and writes their data at the file position.
+ *
+ * @param socket Primary connection of a compressed transfer
+ */
+void Receiver::receiveCompressedData(QTcpSocket *socket)
+{
+    FileDefinition &fileInfo = pendingFiles[socket];
+    QByteArray decoded;
+    qint64 available = socket->bytesAvailable();
+    bool ok = Compression::readFrames(socket, fileInfo.rangeEnd - fileInfo.position, &decoded);
+    BandwidthShaper::consume(socket->peerAddress().toString(), &sessionBuckets[socket], available - socket->bytesAvailable());
+    if (!ok ||
+        decoded.size() > fileInfo.rangeEnd - fileInfo.position ||
+        (!decoded.isEmpty() && !writeAt(fileInfo, fileInfo.position, decoded)))
+    {
+        emit transferStatusUpdated(fileInfo.name, TransferStatus::CANCELLED, fileInfo.transferId);
+        socket->disconnectFromHost();
+        return;
+    }
+
+    if (fileInfo.hasher && !decoded.isEmpty())
+        fileInfo.hasher->addData(decoded);
+    fileInfo.position += decoded.size();
+    fileInfo.totalReceived += decoded.size();
+    reportProgress(socket);
+}
+
+/**
+ * @brief Reads the map of a sparse transfer, then writes each data range at its offset.
+ *
+ * Holes only advance the position; the file is extended to its size after
+ * the last range, so a trailing hole stays unallocated as well. The data is
+ * hashed from disk once complete (see verifyTrailer()).
+ *
+ * @param socket Primary connection of a sparse transfer
+ */
+void Receiver::receiveSparseData(QTcpSocket *socket)
+{
+    FileDefinition &fileInfo = pendingFiles[socket];
+    if (!fileInfo.sparseMapped)
+    {
+        QByteArray map;
+        Protocol::ReadStatus status = Protocol::readMessage(socket, socketVersions.value(socket, Protocol::VERSION_1), &map);
+        if (status == Protocol::ReadStatus::Incomplete)
+            return;
+
+        QList<QPair<qint64, qint64>> ranges;
+        bool valid = (status == Protocol::ReadStatus::Complete && Protocol::decodeSparseMap(map, &ranges) &&
+                      (ranges.isEmpty() || (ranges.first().first >= fileInfo.position &&
+                                            ranges.last().first + ranges.last().second <= fileInfo.rangeEnd)));
+        if (!valid || !SparseFile::markSparse(*fileInfo.file))
+        {
+            emit transferStatusUpdated(fileInfo.name, TransferStatus::ERROR, fileInfo.transferId);
+            socket->disconnectFromHost();
+            return;
+        }
+        fileInfo.dataRanges = ranges;
+        fileInfo.sparseMapped = true;
+    }
+
+    qint64 received = 0;
+    while (fileInfo.position < fileInfo.rangeEnd)
+    {
+        if (fileInfo.dataRange >= fileInfo.dataRanges.size())
+        {
+            // Trailing hole, the file only needs its length
+            fileInfo.totalReceived += fileInfo.rangeEnd - fileInfo.position;
+            fileInfo.position = fileInfo.rangeEnd;
+            if (fileInfo.writer)
+                fileInfo.writer->waitForWritten();
+            if (!fileInfo.file->resize(fileInfo.size))
+            {
+                emit transferStatusUpdated(fileInfo.name, TransferStatus::CANCELLED, fileInfo.transferId);
+                socket->disconnectFromHost();
+                return;
+            }
+            break;
+        }
+
+        const QPair<qint64, qint64> &range = fileInfo.dataRanges[fileInfo.dataRange];
+        if (fileInfo.position < range.first)
+        {
+            fileInfo.totalReceived += range.first - fileInfo.position;
+            fileInfo.position = range.first;
+        }
+
+        qint64 rangeEnd = range.first + range.second;
+        QByteArray data = readPooled(socket, rangeEnd - fileInfo.position);
+        if (data.isEmpty())
+            break;
+
+        if (!writeAt(fileInfo, fileInfo.position, data))
+        {
+            emit transferStatusUpdated(fileInfo.name, TransferStatus::CANCELLED, fileInfo.transferId);
+            socket->disconnectFromHost();
+            return;
+        }
+        fileInfo.position += data.size();
+        fileInfo.totalReceived += data.size();
+        received += data.size();
+        BufferPool::release(data);
+        if (fileInfo.position == rangeEnd)
+            fileInfo.dataRange++;
+    }
+
+    BandwidthShaper::consume(socket->peerAddress().toString(), &sessionBuckets[socket], received);
+    reportProgress(socket);
+}
+
+/**
+ * @brief Checks the bandwidth caps before more data is read from a connection.
+ *
+ * Unread data stays in the bounded read buffer, so the sender is slowed down
+ * by TCP flow control while the input is paused.
+ *
+ * @param socket Connection about to be read
+ * @param primary Primary connection of its transfer, whose session cap applies
+ * @return true if reading has to pause; resumeInput() is called once it may go on
+ */
+bool Receiver::throttled(QTcpSocket *socket, QTcpSocket *primary)
+{
+    // Reading also waits for its read buffer to fit the receive budget
+    int wait = growBuffer(socket, primary) ? BandwidthShaper::delay(primary->peerAddress().toString(), &sessionBuckets[primary])
+                                           : BUDGET_RETRY;
+    if (wait <= 0)
+        return false;
+
+    if (!throttledSockets.contains(socket))
+    {
+        throttledSockets.insert(socket);
+        QTimer::singleShot(wait, socket, [this, socket]()
+                           {
+            throttledSockets.remove(socket);
+            resumeInput(socket); });
+    }
+    return true;
+}
+
+/**
+ * @brief Processes the data that waited on a connection while it was paused.
+ */
+void Receiver::resumeInput(QTcpSocket *socket)
+{
+    if (stripeSockets.contains(socket))
+        receiveStripeData(socket);
+    else if (sessionConnections.contains(socket))
+        receiveSessionInput(socket);
+    else if (pendingFiles.contains(socket))
+        receiveFileData(socket);
+}
+
+/**
+ * @brief Starts hashing an accepted file when both sides verify transfers.
+ *
+ * A resumed prefix is read back from disk; the rest is hashed as it arrives.
+ *
+ * @param fileInfo Receive state of the accepted file, its destination already open
+ */
+void Receiver::startHashing(FileDefinition &fileInfo)
+{
+    if (!fileInfo.offersHash || !Config::getIntegrityCheckEnabled() || (!fileInfo.file && !fileInfo.unpacker))
+        return;
+
+    fileInfo.hasher = new StreamHasher();
+    if (fileInfo.blockSize > 0)
+        fileInfo.hasher->setBlockSize(fileInfo.blockSize);
+    if (fileInfo.resumeOffset > 0)
+        fileInfo.hasher->addFileRange(fileInfo.file->fileName(), 0, fileInfo.resumeOffset);
+}
+
+/**
+ * @brief Compares the sender's trailer with the digest of the received file.
+ *
+ * Data that did not pass through the primary connection in order (stripe
+ * ranges, a rebuilt delta) is read back from disk once every byte arrived,
+ * on the pool thread; the comparison waits for it in ReceivePhase::Verify.
+ * When the trailer lists block checksums, the blocks that do not match are
+ * asked for again (see requestRepair()) and the repaired file is compared
+ * with the same trailer. A mismatching file is reported as an error and
+ * removed on disconnect.
+ *
+ * @param primary Primary connection of the transfer, all data received
+ * @return true once the trailer arrived and matched
+ */
+bool Receiver::verifyTrailer(QTcpSocket *primary)
+{
+    FileDefinition &fileInfo = pendingFiles[primary];
+    if (fileInfo.phase != ReceivePhase::Recheck && fileInfo.phase != ReceivePhase::Verify)
+    {
+        if (fileInfo.phase != ReceivePhase::Trailer)
+        {
+            // Holes never passed through the connection either
+            qint64 hashed = fileInfo.delta ? 0 : (fileInfo.sparse ? fileInfo.resumeOffset : fileInfo.rangeEnd);
+            if (hashed < fileInfo.size && fileInfo.writer)
+                fileInfo.writer->waitForWritten();
+            if (hashed < fileInfo.size)
+                fileInfo.hasher->addFileRange(fileInfo.file->fileName(), hashed, fileInfo.size - hashed);
+            fileInfo.phase = ReceivePhase::Trailer;
+        }
+
+        QByteArray trailer;
+        Protocol::ReadStatus status = Protocol::readMessage(primary, socketVersions.value(primary, Protocol::VERSION_1), &trailer);
+        if (status == Protocol::ReadStatus::Incomplete)
+            return false;
+        fileInfo.trailerDecoded = (status == Protocol::ReadStatus::Complete &&
+                                   Protocol::decodeTrailer(trailer, &fileInfo.trailerDigest, &fileInfo.trailerBlocks));
+        fileInfo.phase = ReceivePhase::Verify;
+    }
+
+    if (!hashReady(primary))
+        return false;
+
+    QByteArray digest = fileInfo.trailerDigest;
+    QVector<quint32> blockSums = fileInfo.trailerBlocks;
+    bool decoded = (fileInfo.phase == ReceivePhase::Recheck || fileInfo.trailerDecoded);
+    QByteArray expected = fileInfo.hasher->result();
+    QVector<quint32> received = fileInfo.hasher->blockChecksums();
+    bool matches = (decoded && !expected.isEmpty() && digest == expected);
+    delete fileInfo.hasher;
+    fileInfo.hasher = nullptr;
+    fileInfo.phase = ReceivePhase::Data;
+    if (matches)
+    {
+        fileInfo.verifiedHash = expected.toHex();
+        return true;
+    }
+
+    if (decoded && !expected.isEmpty() && requestRepair(primary, digest, blockSums, received))
+        return false;
+
+    // qDebug() << "Receiver: Hash mismatch for" << fileInfo.name;
+    fileInfo.hashMismatch = true;
+    emit transferStatusUpdated(fileInfo.name, TransferStatus::ERROR, fileInfo.transferId);
+    primary->disconnectFromHost();
+    return false;
+}
+
+/**
+ * @brief Whether the hasher of a transfer is done, so its digest is read without waiting.
+ *
+ * Otherwise the transfer goes on once the pool thread hashed everything
+ * queued, from the step that asked.
+ *
+ * @param primary Primary connection of a verified transfer
+ */
+bool Receiver::hashReady(QTcpSocket *primary)
+{
+    // The metrics ID tells a later file of the connection apart from this one
+    StreamHasher *hasher = pendingFiles[primary].hasher;
+    quint64 transfer = pendingFiles[primary].metricsId;
+    return hasher->isFinished(this, [this, primary, hasher, transfer]()
+                              {
+        if (!pendingFiles.contains(primary) || pendingFiles[primary].hasher != hasher ||
+            pendingFiles[primary].metricsId != transfer)
+            return;
+        if (pendingFiles[primary].multicast)
+            receiveRepairMessages(primary);
+        else if (reportProgress(primary))
+            receiveFileData(primary); });
+}
+
+/**
+ * @brief Asks the sender for the blocks whose checksum differs from its trailer.
+ *
+ * @param primary Primary connection of the transfer
+ * @param digest Digest of the sender's trailer
+ * @param expected Block checksums of the sender's trailer
+ * @param received Block checksums of the file as received
+ * @return true if the blocks were asked for, false if the file cannot be repaired
+ */
+bool Receiver::requestRepair(QTcpSocket *primary, const QByteArray &digest, const QVector<quint32> &expected,
+                             const QVector<quint32> &received)
+{
+    FileDefinition &fileInfo = pendingFiles[primary];
+    if (fileInfo.blockSize <= 0 || fileInfo.repairRounds >= BlockMap::MAX_REPAIR_ROUNDS || expected.isEmpty() ||
+        expected.size() != received.size())
+        return false;
+
+    QList<int> corrupted;
+    for (int i = 0; i < expected.size(); ++i)
+    {
+        if (expected[i] != received[i])
+            corrupted.append(i);
+    }
+    if (corrupted.isEmpty())
+        return false;
+
+    Protocol::RepairMessage request;
+    request.kind = Protocol::RepairMessage::Missing;
+    request.round = ++fileInfo.repairRounds;
+    for (int index : corrupted)
+    {
+        if (!request.ranges.isEmpty() && request.ranges.last().second + 1 == quint32(index))
+            request.ranges.last().second = quint32(index);
+        else
+            request.ranges.append(qMakePair(quint32(index), quint32(index)));
+    }
+    primary->write(request.encode(socketVersions.value(primary, Protocol::VERSION_1)));
+    primary->flush();
+
+    // qDebug() << "Receiver: Repairing" << corrupted.size() << "blocks of" << fileInfo.name;
+    fileInfo.trailerDigest = digest;
+    fileInfo.trailerBlocks = expected;
+    fileInfo.repairBlocks = corrupted;
+    fileInfo.repairFilled = 0;
+    fileInfo.repairFrom = corrupted.first() * fileInfo.blockSize;
+    fileInfo.phase = ReceivePhase::Repair;
+    return true;
+}
+
+/**
+ * @brief Writes the blocks the sender sends again, then hashes the repaired file.
+ *
+ * @param socket Primary connection of the transfer
+ */
+void Receiver::receiveRepairData(QTcpSocket *socket)
+{
+    FileDefinition &fileInfo = pendingFiles[socket];
+    while (!fileInfo.repairBlocks.isEmpty())
+    {
+        qint64 offset = fileInfo.repairBlocks.first() * fileInfo.blockSize;
+        qint64 length = qMin(fileInfo.blockSize, fileInfo.size - offset);
+        QByteArray data = readPooled(socket, length - fileInfo.repairFilled);
+        if (data.isEmpty())
+            return;
+
+        if (!writeAt(fileInfo, offset + fileInfo.repairFilled, data))
+        {
+            BufferPool::release(data);
+            emit transferStatusUpdated(fileInfo.name, TransferStatus::CANCELLED, fileInfo.transferId);
+            socket->disconnectFromHost();
+            return;
+        }
+        fileInfo.repairFilled += data.size();
+        BandwidthShaper::consume(socket->peerAddress().toString(), &sessionBuckets[socket], data.size());
+        BufferPool::release(data);
+
+        if (fileInfo.repairFilled == length)
+        {
+            fileInfo.repairBlocks.removeFirst();
+            fileInfo.repairFilled = 0;
+        }
+    }
+
+    if (fileInfo.writer)
+        fileInfo.writer->waitForWritten();
+    else
+        fileInfo.file->flush();
+
+    fileInfo.hasher = new StreamHasher();
+    fileInfo.hasher->setBlockSize(fileInfo.blockSize);
+    fileInfo.hasher->addFileRange(fileInfo.file->fileName(), 0, fileInfo.size);
+    fileInfo.phase = ReceivePhase::Recheck;
+    reportProgress(socket);
+}
+
+/**
+ * @brief Ends a delta transfer, replacing the old copy with the rebuilt file.
+ *
+ * @param fileInfo Receive state of the file, its rebuild file already closed
+ * @param complete Whether the whole delta arrived
+ * @return true if the rebuilt file is now in place
+ */
+bool Receiver::finishDelta(FileDefinition &fileInfo, bool complete)
+{
+    QString filePath = receivedFilePath(fileInfo.name);
+    if (filePath.isEmpty())
+        return false;
+    QString rebuilt = DeltaSync::rebuildPath(filePath);
+
+    // Releases the old copy before it is replaced
+    delete fileInfo.delta;
+    fileInfo.delta = nullptr;
+
+    if (!complete)
+    {
+        QFile::remove(rebuilt);
+        return false;
+    }
+
+    ResumeState::remove(filePath);
+    return QFile::remove(filePath) && QFile::rename(rebuilt, filePath);
+}
+
+/**
+ * @brief Records how much of a file arrived, so a later attempt can resume.
+ *
+ * Only the contiguous prefix carried by the primary connection counts;
+ * stripe ranges beyond it are received again.
+ *
+ * @param fileInfo Receive state of the file, its data already flushed
+ */
+void Receiver::saveResumeState(const FileDefinition &fileInfo)
+{
+    if (!fileInfo.file || fileInfo.delta || fileInfo.multicast || !Config::getResumeEnabled())
+        return;
+
+    // Buffered data is not on disk yet
+    qint64 position = fileInfo.writer ? fileInfo.writer->writtenUpTo(fileInfo.resumeOffset) : fileInfo.position;
+    ResumeState::save(fileInfo.file->fileName(), fileInfo.size, fileInfo.sourceTag, position);
+}
+
+/**
+ * @brief Reads the headers announced on a session connection, then file data.
+ *
+ * The files of a manifest session are only requested once the last header
+ * arrived, all together, followed by batchAnnounced().
+ *
+ * @param socket Session connection
+ */
+void Receiver::receiveSessionInput(QTcpSocket *socket)
+{
+    SessionConnection &session = sessionConnections[socket];
+    bool announcing = (session.announced < session.expected);
+
+    int version = socketVersions.value(socket, Protocol::VERSION_1);
+    QByteArray line;
+    while (session.announced < session.expected)
+    {
+        Protocol::ReadStatus status = Protocol::readMessage(socket, version, &line);
+        if (status == Protocol::ReadStatus::Incomplete)
+        {
+            makeRoomForMessage(socket);
+            break;
+        }
+
+        Protocol::TransferHeader header;
+        if (status == Protocol::ReadStatus::Malformed || !Protocol::TransferHeader::decode(line, &header) ||
+            !isSafeFileName(header.fileName))
+        {
+            socket->disconnectFromHost();
+            return;
+        }
+
+        session.queue.append(definitionFromHeader(header, socket));
+        ++session.announced;
+        if (!session.manifest)
+            emit fileTransferRequested(header.fileName, QString::number(header.fileSize), socket,
+                                       session.queue.last().transferId);
+    }
+
+    if (session.announced < session.expected)
+        return;
+
+    if (session.manifest && announcing)
+    {
+        // Decisions made from the signals change the queue
+        QList<FileDefinition> batch = session.queue;
+        for (const FileDefinition &fileInfo : batch)
+            emit fileTransferRequested(fileInfo.name, QString::number(fileInfo.size), socket, fileInfo.transferId);
+        emit batchAnnounced(socket);
+        return;
+    }
+
+    receiveFileData(socket);
+}
+
+/**
+ * @brief Finds the first file of a session still waiting for the user's decision.
+ *
+ * @param socket Session connection
+ * @param fileName Name of the file, or empty for the first undecided one
+ */
+FileDefinition *Receiver::findUndecided(QTcpSocket *socket, const QString &fileName)
+{
+    SessionConnection &session = sessionConnections[socket];
+    for (FileDefinition &fileInfo : session.queue)
+    {
+        if (!fileInfo.decided && (fileName.isEmpty() || fileInfo.name == fileName))
+            return &fileInfo;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Sends the replies of a session in header order, as far as decided.
+ *
+ * The sender matches replies to its headers by position, so a decision on
+ * a later file is held back until every earlier file has been answered.
+ * A manifest session is answered once every file is decided, with one
+ * Protocol::BatchReply.
+ *
+ * @param socket Session connection
+ */
+void Receiver::flushSessionReplies(QTcpSocket *socket)
+{
+    SessionConnection &session = sessionConnections[socket];
+    int version = socketVersions.value(socket, Protocol::VERSION_1);
+
+    if (session.manifest && !session.queue.isEmpty() && !session.queue.first().replied)
+    {
+        if (session.announced < session.expected)
+            return;
+        for (const FileDefinition &fileInfo : session.queue)
+        {
+            if (!fileInfo.decided)
+                return;
+        }
+
+        Protocol::BatchReply batch;
+        for (FileDefinition &fileInfo : session.queue)
+        {
+            batch.replies.append(sessionReply(fileInfo));
+            fileInfo.replied = true;
+        }
+        socket->write(batch.encode(version));
+    }
+
+    for (auto it = session.queue.begin(); it != session.queue.end();)
+    {
+        if (!it->decided)
+            break;
+
+        if (!it->replied)
+        {
+            socket->write(sessionReply(*it).encode(version));
+            it->replied = true;
+        }
+
+        if (!it->accepted)
+        {
+            emit transferStatusUpdated(it->name, TransferStatus::CANCELLED, it->transferId);
+            ++session.resolved;
+            it = session.queue.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    socket->flush();
+
+    if (!pendingFiles.contains(socket))
+    {
+        activateSessionFile(socket);
+        if (pendingFiles.contains(socket))
+            receiveFileData(socket);
+        else if (session.resolved >= session.expected)
+            socket->disconnectFromHost();
+    }
+}
+
+/**
+ * @brief Reply to one decided file of a session.
+ */
+Protocol::TransferReply Receiver::sessionReply(const FileDefinition &fileInfo)
+{
+    Protocol::TransferReply reply;
+    reply.accepted = fileInfo.accepted;
+    if (fileInfo.accepted && fileInfo.resumeOffset > 0)
+        reply.options.insert("offset", QByteArray::number(fileInfo.resumeOffset));
+    if (fileInfo.accepted && fileInfo.hasher)
+        reply.options.insert("hash", StreamHasher::ALGORITHM);
+    return reply;
+}
+
+/**
+ * @brief Makes the next answered and accepted file the one receiving data.
+ *
+ * @param socket Session connection
+ */
+void Receiver::activateSessionFile(QTcpSocket *socket)
+{
+    SessionConnection &session = sessionConnections[socket];
+    if (pendingFiles.contains(socket) || session.queue.isEmpty())
+        return;
+
+    const FileDefinition &next = session.queue.first();
+    if (next.replied && next.accepted)
+        pendingFiles[socket] = session.queue.takeFirst();
+}
+
+/**
+ * @brief Closes a completely received file of a session and moves on.
+ *
+ * @param socket Session connection
+ * @return true if another file of the session is now receiving data
+ */
+bool Receiver::completeSessionFile(QTcpSocket *socket)
+{
+    FileDefinition fileInfo = pendingFiles.take(socket);
+    bool written = closeWriter(fileInfo);
+    countReceived(fileInfo);
+    TransferTrace::instant("finish", "receive", fileInfo.metricsId);
+    TransferMetrics::end(fileInfo.metricsId, written ? TransferMetrics::Outcome::Finished : TransferMetrics::Outcome::Failed);
+    QString filePath;
     if (fileInfo.file)
     {
         if (fileInfo.file->isOpen()) fileInfo.file->close();
+        filePath = fileInfo.file->fileName();
+        ResumeState::remove(filePath);
         delete fileInfo.file;
     }
+    delete fileInfo.hasher;
 
-    fileInfo.file = file;
+    if (written)
+        commitFile(filePath, fileInfo.name, fileInfo.transferId, fileInfo.verifiedHash);
+    else
+        emit transferStatusUpdated(fileInfo.name, TransferStatus::ERROR, fileInfo.transferId);
+
+    SessionConnection &session = sessionConnections[socket];
+    ++session.resolved;
+    activateSessionFile(socket);
+
+    if (pendingFiles.contains(socket))
+        return true;
+
+    if (session.resolved >= session.expected)
+        socket->disconnectFromHost();
+    return false;
 }
 
 /**
@@ -262,38 +2660,308 @@ void Receiver::setFile(QTcpSocket *socket, QFile *file)
  *
  * When a client requests a shared file, this method validates the file exists
  * in the shared folder and initiates a reverse file transfer using a Sender
- * instance.
+ * instance, once UploadSlots has a slot for the client.
  *
  * @param clientIP IP address of the requesting client
  * @param relativePath Relative path of the requested file within shared folder
  * @param fileName Name of the requested file
  * @param clientPort Port number where the client expects to receive the file
+ * @param version Protocol version the client used for the request
+ * @param offset First byte wanted
+ * @param length Bytes wanted, -1 up to the end of the file
  */
-void Receiver::handleDownloadRequest(const QString &clientIP, const QString &relativePath, const QString &fileName, quint16 clientPort)
+void Receiver::handleDownloadRequest(const QString &clientIP, const QString &relativePath, const QString &fileName, quint16 clientPort, int version,
+                                     qint64 offset, qint64 length)
 {
     // qDebug() << "Receiver: Handling download request for" << fileName << "to" << clientIP << ":" << clientPort;
 
-    // Build full path to the shared file
-    QString sharedDir = Config::getSharedFolderPath();
-    QString fullPath = QDir(sharedDir).absoluteFilePath(relativePath);
-
-    // Check if file exists
-    QFileInfo fileInfo(fullPath);
-    if (!fileInfo.exists() || !fileInfo.isFile())
+    QString fullPath = sharedFilePath(relativePath);
+    if (fullPath.isEmpty())
     {
-        // qDebug() << "Receiver: Requested file does not exist:" << fullPath;
+        // qDebug() << "Receiver: Requested file does not exist:" << relativePath;
         return;
     }
 
     // qDebug() << "Receiver: File found, sending to" << clientIP << ":" << clientPort;
 
-    // Use the same logic as normal file transfers - create a Sender
-    Sender *downloadSender = new Sender(this);
+    bool admitted = UploadSlots::request(clientIP, this, [this, clientIP, fullPath, clientPort, version, offset, length]()
+                                         { startUpload(clientIP, fullPath, version, offset, length, nullptr, clientPort); });
+    if (!admitted)
+    {
+        // qDebug() << "Receiver: Upload queue full, dropping request for" << relativePath;
+    }
+}
+
+/**
+ * @brief Sends a shared file back on the connection that asked for it.
+ *
+ * The request connection is handed to a Sender, which sends the usual
+ * header and data on it, so the requester goes through its normal accept
+ * flow without a second connection. The connection waits for an upload
+ * slot first, and is closed if the queue of UploadSlots is full.
+ *
+ * @param socket Request connection
+ * @param relativePath Relative path of the requested file within shared folder
+ * @param version Protocol version the client used for the request
+ * @param offset First byte wanted
+ * @param length Bytes wanted, -1 up to the end of the file
+ */
+void Receiver::serveDownload(QTcpSocket *socket, const QString &relativePath, int version, qint64 offset, qint64 length)
+{
+    QString fullPath = sharedFilePath(relativePath);
+    if (fullPath.isEmpty())
+    {
+        socket->disconnectFromHost();
+        return;
+    }
+
+    // The connection belongs to the upload from now on
+    disconnect(socket, nullptr, this, nullptr);
+    socketVersions.remove(socket);
+    untrack(socket);
+    releaseBuffer(socket);
+
+    // Closed by the requester while it waits for a slot, it is not served
+    connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+
+    QString peer = socket->peerAddress().toString();
+    QPointer<QTcpSocket> connection(socket);
+    bool admitted = UploadSlots::request(peer, this, [this, connection, peer, fullPath, version, offset, length]()
+                                         {
+        if (!connection || connection->state() != QAbstractSocket::ConnectedState)
+        {
+            UploadSlots::release(peer);
+            return;
+        }
+        disconnect(connection.data(), &QTcpSocket::disconnected, connection.data(), &QObject::deleteLater);
+        startUpload(peer, fullPath, version, offset, length, connection, 0); });
+    if (!admitted)
+        socket->disconnectFromHost();
+}
+
+/**
+ * @brief Starts the Sender of a shared file once its upload slot is granted.
+ *
+ * The slot is released when the Sender is gone, however the upload ended.
+ *
+ * @param peer Address of the requester, holding the slot
+ * @param fullPath Path of the shared file
+ * @param version Protocol version the requester used
+ * @param offset First byte wanted
+ * @param length Bytes wanted, -1 up to the end of the file
+ * @param connection Request connection to send on, null to connect to @p clientPort
+ * @param clientPort Port the requester receives on when not sent in band
+ */
+void Receiver::startUpload(const QString &peer, const QString &fullPath, int version, qint64 offset, qint64 length,
+                           QTcpSocket *connection, quint16 clientPort)
+{
+    Sender *uploadSender = new Sender(this);
 
     // Connect Sender signals for proper cleanup (but don't connect to FileTransferManager)
-    connect(downloadSender, &Sender::transferFinished, downloadSender, &Sender::deleteLater);
-    connect(downloadSender, &Sender::transferError, downloadSender, &Sender::deleteLater);
+    connect(uploadSender, &Sender::transferFinished, uploadSender, &Sender::deleteLater);
+    connect(uploadSender, &Sender::transferError, uploadSender, &Sender::deleteLater);
+    connect(uploadSender, &Sender::transferRefused, uploadSender, &Sender::deleteLater);
+    connect(uploadSender, &QObject::destroyed, [peer]()
+            { UploadSlots::release(peer); });
+    if (offset > 0 || length >= 0)
+        uploadSender->setRange(offset, length);
+    uploadSender->setCached(true);
+
+    // Use the same logic as normal file transfers
+    if (connection)
+        uploadSender->sendFileOn(connection, fullPath, version);
+    else
+        uploadSender->sendFile(fullPath, peer, clientPort, version);
+}
+
+/**
+ * @brief Sends one byte range of a shared file on the connection that asked for it, once it has an upload slot.
+ *
+ * Ranges take an upload slot like whole downloads (see UploadSlots), held
+ * only while the range is read and written. A request beyond the queue of
+ * UploadSlots is refused.
+ *
+ * @param socket Request connection
+ * @param relativePath Relative path of the file within shared folder
+ * @param content Hex hash the requester expects, empty to serve the file as it is
+ * @param offset First byte of the range
+ * @param length Bytes wanted
+ * @param version Protocol version of the connection
+ */
+void Receiver::serveRange(QTcpSocket *socket, const QString &relativePath, const QByteArray &content, qint64 offset,
+                          qint64 length, int version)
+{
+    QString peer = socket->peerAddress().toString();
+    QPointer<QTcpSocket> connection(socket);
+    bool admitted = UploadSlots::request(peer, this, [this, connection, peer, relativePath, content, offset, length, version]()
+                                         {
+        if (connection && connection->state() == QAbstractSocket::ConnectedState)
+            writeRange(connection, relativePath, content, offset, length, version);
+        UploadSlots::release(peer); });
+    if (!admitted)
+        socket->write(Protocol::TransferReply().encode(version));
+}
+
+/**
+ * @brief Writes one byte range of a shared file and its reply.
+ *
+ * The range is refused if the file is not shared, or if its contents are
+ * not the ones the requester expects: a peer asking for ranges of a hash
+ * must not get parts of another version of the file. Ranges are capped at
+ * MAX_SERVED_RANGE, the reply tells how many bytes follow.
+ *
+ * Ranges are read through ServeCache, so the blocks of a swarm download
+ * come from the windows the previous blocks were read from.
+ *
+ * @param socket Request connection
+ * @param relativePath Relative path of the file within shared folder
+ * @param content Hex hash the requester expects, empty to serve the file as it is
+ * @param offset First byte of the range
+ * @param length Bytes wanted
+ * @param version Protocol version of the connection
+ */
+void Receiver::writeRange(QTcpSocket *socket, const QString &relativePath, const QByteArray &content, qint64 offset,
+                          qint64 length, int version)
+{
+    Protocol::TransferReply reply;
+    QString fullPath = sharedFilePath(relativePath);
+    TransferSource *source = fullPath.isEmpty() ? nullptr : TransferSource::create(fullPath, true);
+    if (!source || (!content.isEmpty() && ContentIndex::hashOf(fullPath) != content.toLower()) || offset < 0 ||
+        !source->open() || offset > source->size())
+    {
+        delete source;
+        socket->write(reply.encode(version));
+        return;
+    }
+
+    // A range may span two windows of a mapped file
+    QByteArray data;
+    qint64 end = offset + qMin(length, MAX_SERVED_RANGE);
+    data.reserve(int(qMax<qint64>(0, qMin(end, source->size()) - offset)));
+    for (qint64 position = offset; position < end;)
+    {
+        const char *chunk = nullptr;
+        qint64 bytesRead = source->readChunk(position, end - position, &chunk);
+        if (bytesRead <= 0)
+            break;
+        data.append(chunk, int(bytesRead));
+        position += bytesRead;
+    }
+    source->close();
+    delete source;
+
+    // The requester checks the range against it before writing it
+    reply.accepted = true;
+    reply.options.insert("length", QByteArray::number(data.size()));
+    reply.options.insert("crc", QByteArray::number(BlockMap::checksum(data), 16).rightJustified(8, '0'));
+    socket->write(reply.encode(version));
+    socket->write(data);
+}
+
+/**
+ * @brief Resolves a file of the shared folder.
+ *
+ * Links and ".." are followed before the check, so a peer only ever gets
+ * a file that really is inside the shared folder.
+ *
+ * @return Absolute path of the file, empty if it is not an existing file of the shared folder
+ */
+QString Receiver::sharedFilePath(const QString &relativePath)
+{
+    QString folder = QFileInfo(Config::getSharedFolderPath()).canonicalFilePath();
+    if (folder.isEmpty() || relativePath.isEmpty() || QDir::isAbsolutePath(relativePath))
+        return QString();
+
+    QString fullPath = QDir(Config::getSharedFolderPath()).absoluteFilePath(relativePath);
+    QFileInfo fileInfo(fullPath);
+    QString resolved = fileInfo.canonicalFilePath();
+    if (!folder.endsWith('/'))
+        folder += '/';
+    if (resolved.isEmpty() || !fileInfo.isFile() || !resolved.startsWith(folder))
+        return QString();
+    return fullPath;
+}
+
+/**
+ * @brief Asks a peer for one of its shared files.
+ *
+ * The file is asked for on the request connection itself and arrives on it
+ * like an incoming transfer. Older peers ignore that and send the file to
+ * this receiver's port instead, then close the request connection.
+ *
+ * @param ownerIP Address of the sharing peer
+ * @param ownerPort Transfer port of the sharing peer
+ * @param relativePath Relative path of the file within the peer's shared folder
+ * @param fileName Name of the file
+ * @param connection Connected, unused socket to the peer taken from a
+ *        ConnectionPool, null to connect now; the receiver takes it over
+ * @param offset First byte wanted, the range is written into the local copy in place
+ * @param length Bytes wanted, -1 up to the end of the file; older peers send the whole file
+ */
+void Receiver::requestDownload(const QString &ownerIP, quint16 ownerPort, const QString &relativePath, const QString &fileName,
+                               QTcpSocket *connection, qint64 offset, qint64 length)
+{
+    quint16 ourPort = server->serverPort();
+    if (workers.isEmpty())
+    {
+        startDownload(ownerIP, ownerPort, relativePath, fileName, connection, ourPort, offset, length);
+        return;
+    }
+
+    Receiver *worker = workers[nextWorker];
+    nextWorker = (nextWorker + 1) % workers.size();
+    Config::publish();
+    if (connection)
+    {
+        connection->setParent(nullptr);
+        connection->moveToThread(worker->thread());
+    }
+    QMetaObject::invokeMethod(worker, [worker, ownerIP, ownerPort, relativePath, fileName, connection, ourPort, offset, length]()
+                              { worker->startDownload(ownerIP, ownerPort, relativePath, fileName, connection, ourPort, offset, length); },
+                              Qt::QueuedConnection);
+}
+
+/**
+ * @brief Sends a download request on a connection of this receiver and reads the answer.
+ *
+ * @param ourPort Transfer port of this side, announced for senders answering on a new connection
+ */
+void Receiver::startDownload(const QString &ownerIP, quint16 ownerPort, const QString &relativePath, const QString &fileName,
+                             QTcpSocket *connection, quint16 ourPort, qint64 offset, qint64 length)
+{
+    QTcpSocket *socket = connection ? connection : new QTcpSocket(this);
+    socket->setParent(this);
+    setBuffer(socket, Config::getPendingReceiveBuffer());
+    track(socket);
+
+    auto sendRequest = [this, socket, relativePath, fileName, ourPort, offset, length]()
+    {
+        // Only the address of the sharing user is known here, so the request stays v1
+        socket->write(Protocol::encodeDownloadRequest(Protocol::VERSION_1, relativePath, fileName, ourPort, true, offset, length));
+        socket->flush();
+
+        // The answer is read like any incoming connection
+        connect(socket, &QTcpSocket::readyRead, this, &Receiver::onReadyRead);
+        connect(socket, &QTcpSocket::disconnected, this, &Receiver::onDisconnected);
+    };
+    if (connection)
+    {
+        sendRequest();
+        return;
+    }
+
+    connect(socket, &QTcpSocket::connected, this, sendRequest);
+
+    connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::errorOccurred),
+            this, [this, socket](QAbstractSocket::SocketError)
+            {
+        // Errors of a connected socket end in onDisconnected()
+        if (socket->state() != QAbstractSocket::ConnectedState)
+        {
+            untrack(socket);
+            releaseBuffer(socket);
+            socket->deleteLater();
+        } });
 
-    // Use normal Sender::sendFile - this will follow the exact same protocol as regular transfers
-    downloadSender->sendFile(fullPath, clientIP, clientPort);
+    socket->connectToHost(ownerIP, ownerPort);
 }
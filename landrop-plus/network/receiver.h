@@ -12,8 +12,45 @@
 #include <QFile>
 #include <QDir>
 #include <QMap>
+#include <QList>
+#include <QSet>
+#include <QHash>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QThread>
+#include <QTimer>
 #include "../core/transferstatus.h"
 #include "../config/config.h"
+#include "transfermetrics.h"
+#include "transfertrace.h"
+#include "protocol.h"
+#include "deltasync.h"
+#include "compression.h"
+#include "streamhasher.h"
+#include "bandwidthshaper.h"
+#include "chainrelay.h"
+#include "multicast.h"
+#include "archive.h"
+#include "filewriter.h"
+#include "bufferpool.h"
+#include "receiverserver.h"
+#include "progresscounter.h"
+
+/**
+ * @brief Stage of an announced transfer in the receive state machine.
+ *
+ * A connection whose header is still incomplete has no FileDefinition yet;
+ * its bytes wait in the socket buffer until the whole header arrived.
+ */
+enum class ReceivePhase
+{
+    AwaitAccept, ///< Header read, the user has not decided; early data stays buffered
+    Data,        ///< Accepted, data is written as it arrives
+    Trailer,     ///< Every byte arrived, the sender's hash trailer is read next
+    Verify,      ///< The trailer arrived, the pool thread is still hashing the file
+    Repair,      ///< The trailer did not match, the corrupted blocks are received again
+    Recheck      ///< The repaired file is hashed again and compared with the trailer
+};
 
 /**
  * @brief Structure containing file transfer metadata and state.
@@ -28,14 +65,242 @@ typedef struct FileDefinition
     
     /** @brief Original name of the file being transferred. */
     QString name;
+
+    /**
+     * @brief Identifies the transfer in signals, unique where names are not.
+     *
+     * The sender's "id" prefixed with its address, or generated here for
+     * senders that do not send one.
+     */
+    QByteArray transferId;
     
     /** @brief Total size of the file in bytes. */
     qint64 size = 0;
     
     /** @brief Number of bytes received so far. */
     qint64 totalReceived = 0;
+
+    /** @brief Session of the transfer in TransferMetrics, 0 until accepted. */
+    quint64 metricsId = 0;
+
+    /** @brief Part of totalReceived already counted in TransferMetrics. */
+    qint64 metricsReported = 0;
+
+    /** @brief Whether the first bytes were counted, later ones are counted in batches. */
+    bool metricsCounted = false;
+
+    /** @brief Bytes present, read by ProgressAggregator without a lock. */
+    QSharedPointer<ProgressCounter> counter;
+
+    /** @brief TransferTrace::now() the header arrived at, -1 when not recording. */
+    qint64 headerAt = -1;
+
+    /** @brief Stripe count offered by the sender in its header. */
+    int offeredStripes = 1;
+
+    /** @brief Share of the file each stripe carries, as the sender offered it; empty for equal stripes. */
+    QList<int> stripeWeights;
+
+    /** @brief Stripe count agreed on in the reply (1 for a single connection). */
+    int stripeCount = 1;
+
+    /** @brief Token secondary stripe connections present to join this transfer. */
+    QByteArray stripeToken;
+
+    /** @brief Next file offset written from the primary connection. */
+    qint64 position = 0;
+
+    /** @brief End of the byte range carried by the primary connection. */
+    qint64 rangeEnd = 0;
+
+    /** @brief Whether the user has answered this request (session connections). */
+    bool decided = false;
+
+    /** @brief Whether the user accepted this request (session connections). */
+    bool accepted = false;
+
+    /** @brief Whether the answer was written to the sender (session connections). */
+    bool replied = false;
+
+    /** @brief Last percentage reported, progress is only emitted when it changes. */
+    int lastProgress = -1;
+
+    /** @brief Modification time announced by the sender, empty if it cannot resume. */
+    QByteArray sourceTag;
+
+    /** @brief Offset the transfer continues from, 0 when received from the start. */
+    qint64 resumeOffset = 0;
+
+    /** @brief First byte of a ranged download, written into the local copy in place; -1 for a whole file. */
+    qint64 rangeStart = -1;
+
+    /** @brief Whether the sender offered to send a delta against an existing copy. */
+    bool offersDelta = false;
+
+    /** @brief Rebuilds the file from the existing copy, null for a full transfer. */
+    DeltaDecoder *delta = nullptr;
+
+    /** @brief Codec and level the sender offered, empty if it sends plain data only. */
+    QByteArray offeredCodec;
+    int offeredLevel = 1;
+
+    /** @brief Whether the data arrives as compression frames. */
+    bool compressed = false;
+
+    /** @brief Whether the sender offered to send only the data ranges of a sparse file. */
+    bool offersSparse = false;
+
+    /** @brief Whether only the data ranges arrive, after a map of them; holes are left unallocated. */
+    bool sparse = false;
+
+    /** @brief Data ranges of a sparse transfer once its map arrived, and the one being received. */
+    QList<QPair<qint64, qint64>> dataRanges;
+    int dataRange = 0;
+    bool sparseMapped = false;
+
+    /** @brief Whether the sender offered a digest trailer after the data. */
+    bool offersHash = false;
+
+    /** @brief Hashes the received file, null when it is not verified or already was. */
+    StreamHasher *hasher = nullptr;
+
+    /** @brief Size of the blocks the sender lists checksums of in its trailer, 0 if it does not. */
+    qint64 blockSize = 0;
+
+    /** @brief Digest and block checksums of the trailer, kept while corrupted blocks are repaired. */
+    QByteArray trailerDigest;
+    QVector<quint32> trailerBlocks;
+
+    /** @brief Whether the trailer was well formed, kept while the file is hashed. */
+    bool trailerDecoded = false;
+
+    /** @brief Blocks still to receive again, in the order the sender sends them. */
+    QList<int> repairBlocks;
+
+    /** @brief Bytes of the first block in repairBlocks received so far. */
+    qint64 repairFilled = 0;
+
+    /** @brief Repair rounds asked for, at most BlockMap::MAX_REPAIR_ROUNDS. */
+    int repairRounds = 0;
+
+    /** @brief Offset of the first corrupted block, where the transfer resumes if it stops while repairing. */
+    qint64 repairFrom = 0;
+
+    /** @brief Stage of the transfer, see ReceivePhase. */
+    ReceivePhase phase = ReceivePhase::AwaitAccept;
+
+    /** @brief Whether the trailer did not match the received data. */
+    bool hashMismatch = false;
+
+    /** @brief Hex digest of the received data once the trailer matched it. */
+    QByteArray verifiedHash;
+
+    /** @brief Hex digest of the contents the sender named, empty if it did not. */
+    QByteArray offeredContent;
+
+    /** @brief Nodes the sender asked this receiver to forward the file to, encoded. */
+    QByteArray relayChain;
+
+    /** @brief Forwards the file to the next node while it is written, null if not relayed. */
+    ChainRelay *relay = nullptr;
+
+    /** @brief Multicast channel the sender offered, encoded, empty for TCP only. */
+    QByteArray offeredMulticast;
+
+    /** @brief Whether the sender offered to carry the data over UDP (see DatagramTransport). */
+    bool offersDatagram = false;
+
+    /** @brief Writes the blocks of a joined multicast transfer or a UDP flow, null otherwise. */
+    MulticastReceiver *multicast = nullptr;
+
+    /** @brief Whether every multicast block arrived and the sender was told. */
+    bool multicastDone = false;
+
+    /** @brief Repair round answered once the complete multicast file is hashed. */
+    int multicastRound = 0;
+
+    /** @brief Number of files the sender packed into an archive stream, 0 for a single file. */
+    int archiveCount = 0;
+
+    /** @brief Unpacks an accepted archive stream into the received files folder, null otherwise. */
+    ArchiveUnpacker *unpacker = nullptr;
+
+    /** @brief Writes the received data behind the connection, null when it is written directly. */
+    FileWriter *writer = nullptr;
 } FileDefinition;
 
+/**
+ * @brief State of a secondary connection carrying one range of a striped file.
+ */
+struct StripeConnection
+{
+    /** @brief Primary connection of the transfer this stripe belongs to. */
+    QTcpSocket *primary = nullptr;
+
+    /** @brief Next file offset written from this connection. */
+    qint64 position = 0;
+
+    /** @brief End of the byte range carried by this connection. */
+    qint64 end = 0;
+};
+
+/**
+ * @brief State of a connection carrying several files back to back.
+ */
+struct SessionConnection
+{
+    /** @brief Number of files the sender announced for the session. */
+    int expected = 0;
+
+    /** @brief Number of headers received so far. */
+    int announced = 0;
+
+    /** @brief Number of files received or refused. */
+    int resolved = 0;
+
+    /**
+     * @brief Whether the sender offered a manifest: the files are requested
+     * once every header arrived and answered with one Protocol::BatchReply.
+     */
+    bool manifest = false;
+
+    /** @brief Announced files not receiving data yet, in header order. */
+    QList<FileDefinition> queue;
+};
+
+class Receiver;
+
+/**
+ * @brief Which worker of a receiver owns each connection and striped transfer.
+ *
+ * Shared by the receiver and its workers, so calls naming a socket reach
+ * the thread serving it and stripes find the worker of their transfer.
+ * The tables are split into SHARDS parts by key, each locked on its own
+ * and on a cache line of its own, so workers registering connections at
+ * the same time rarely meet on a lock. Only connection setup and teardown
+ * use them; received data never does.
+ */
+struct ReceiverRegistry
+{
+    static const int SHARDS = 16;
+
+    struct alignas(64) Shard
+    {
+        QMutex mutex;
+
+        /** @brief Worker serving each connection. */
+        QHash<QTcpSocket*, Receiver*> owners;
+
+        /** @brief Worker receiving each striped transfer, by stripe token. */
+        QHash<QByteArray, Receiver*> stripeTokens;
+    };
+
+    Shard shards[SHARDS];
+
+    Shard &shardOf(QTcpSocket *socket) { return shards[qHash(quintptr(socket)) % SHARDS]; }
+    Shard &shardOf(const QByteArray &token) { return shards[qHash(token) % SHARDS]; }
+};
+
 /**
  * @class Receiver
  * @brief TCP server class responsible for receiving files from remote senders.
@@ -44,6 +309,11 @@ typedef struct FileDefinition
  * It listens for incoming TCP connections, processes file transfer requests,
  * manages user confirmation dialogs, and handles concurrent file downloads
  * from multiple senders.
+ *
+ * With setWorkerCount(), accepted connections are spread over worker
+ * receivers running on threads of their own, each owning its sockets and
+ * files. This receiver then only listens and passes calls on to the worker
+ * owning the named socket; the workers' signals are emitted as its own.
  */
 class Receiver : public QObject
 {
@@ -54,11 +324,23 @@ public:
     ~Receiver();
 
     bool startServer(quint16 port = 0);
+    bool rebind(quint16 port);
+    void setWorkerCount(int count);
+
+    /** @brief Number of worker threads serving connections, 0 when served on this thread. */
+    int workerCount() const { return workers.size(); }
     void setFile(QTcpSocket *s, QFile *f);
+    bool acceptTransfer(QTcpSocket *socket, const QString &fileName = QString());
+    void rejectTransfer(QTcpSocket *socket, const QString &fileName = QString());
+    void setTransferPriority(QTcpSocket *socket, TransferPriority priority);
     quint16 getServerPort() const;
+    void requestDownload(const QString &ownerIP, quint16 ownerPort, const QString &relativePath, const QString &fileName,
+                         QTcpSocket *connection = nullptr, qint64 offset = 0, qint64 length = -1);
+
+    static bool isSafeFileName(const QString &name);
 
 private slots:
-    void onNewConnection();
+    void onConnectionAccepted(qintptr socketDescriptor);
     void onReadyRead();
     void onDisconnected();
 
@@ -68,40 +350,212 @@ signals:
      * @param fileName Name of the file being offered for transfer.
      * @param fileSize Size of the file in human-readable format.
      * @param socket TCP socket connection for this transfer.
+     * @param transferId Identifier of the transfer, see FileDefinition::transferId.
      */
-    void fileTransferRequested(const QString &fileName, const QString &fileSize, QTcpSocket *socket);
+    void fileTransferRequested(const QString &fileName, const QString &fileSize, QTcpSocket *socket,
+                               const QByteArray &transferId);
+
+    /**
+     * @brief Signal emitted once every file of a manifest session was requested.
+     *
+     * Follows the fileTransferRequested() of the last file; the requests
+     * made on @p socket are the whole batch the sender chose.
+     * @param socket Session connection of the batch.
+     */
+    void batchAnnounced(QTcpSocket *socket);
     
     /**
      * @brief Signal emitted when a file has been successfully received.
      * @param fileName Name of the completed file.
+     * @param transferId Identifier of the transfer.
      */
-    void fileReceivedSuccessfully(const QString &fileName);
+    void fileReceivedSuccessfully(const QString &fileName, const QByteArray &transferId);
     
     /**
      * @brief Signal emitted when file transfer progress is updated.
      * @param fileName Name of the file being transferred.
      * @param percent Completion percentage (0-100).
+     * @param transferId Identifier of the transfer.
      */
-    void transferProgressUpdated(const QString &fileName, int percent);
+    void transferProgressUpdated(const QString &fileName, int percent, const QByteArray &transferId);
     
     /**
      * @brief Signal emitted when transfer status changes.
      * @param fileName Name of the file being transferred.
      * @param status New transfer status.
+     * @param transferId Identifier of the transfer.
      */
-    void transferStatusUpdated(const QString &fileName, TransferStatus status);
+    void transferStatusUpdated(const QString &fileName, TransferStatus status, const QByteArray &transferId);
+
+    /**
+     * @brief Signal emitted when an accepted transfer is striped over several connections.
+     * @param fileName Name of the file being transferred.
+     * @param stripeCount Number of parallel connections agreed with the sender.
+     * @param transferId Identifier of the transfer.
+     */
+    void transferStripeCountNegotiated(const QString &fileName, int stripeCount, const QByteArray &transferId);
+
+    /**
+     * @brief Signal emitted when an accepted transfer arrives compressed.
+     * @param fileName Name of the file being transferred.
+     * @param codec Codec agreed with the sender.
+     * @param level Compression level agreed with the sender.
+     * @param transferId Identifier of the transfer.
+     */
+    void transferCompressionNegotiated(const QString &fileName, const QString &codec, int level,
+                                       const QByteArray &transferId);
 
 private:
-    void handleDownloadRequest(const QString &clientIP, const QString &relativePath, const QString &fileName, quint16 clientPort);
+    void openConnection(qintptr socketDescriptor);
+    void setupConnection(QTcpSocket *socket);
+    void resumeAccepting();
+    void leavePending(QTcpSocket *socket);
+    void setBuffer(QTcpSocket *socket, qint64 size);
+    bool growBuffer(QTcpSocket *socket, QTcpSocket *primary);
+    void makeRoomForMessage(QTcpSocket *socket);
+    void releaseBuffer(QTcpSocket *socket);
+    void handleHeader(QTcpSocket *clientSocket, const QByteArray &line, int version);
+    void receiveLegacyHeader(QTcpSocket *socket);
+    void drainBuffered(QTcpSocket *socket);
+    void startDownload(const QString &ownerIP, quint16 ownerPort, const QString &relativePath, const QString &fileName,
+                       QTcpSocket *connection, quint16 ourPort, qint64 offset, qint64 length);
+    void adoptStripe(QTcpSocket *socket, const QByteArray &token, int index, int version);
+    Receiver *ownerOf(QTcpSocket *socket) const;
+    void track(QTcpSocket *socket);
+    void untrack(QTcpSocket *socket);
+    void handleDownloadRequest(const QString &clientIP, const QString &relativePath, const QString &fileName, quint16 clientPort, int version,
+                               qint64 offset = 0, qint64 length = -1);
+    void serveDownload(QTcpSocket *socket, const QString &relativePath, int version, qint64 offset = 0, qint64 length = -1);
+    void startUpload(const QString &peer, const QString &fullPath, int version, qint64 offset, qint64 length,
+                     QTcpSocket *connection, quint16 clientPort);
+    void serveRange(QTcpSocket *socket, const QString &relativePath, const QByteArray &content, qint64 offset,
+                    qint64 length, int version);
+    void writeRange(QTcpSocket *socket, const QString &relativePath, const QByteArray &content, qint64 offset,
+                    qint64 length, int version);
+    static QString sharedFilePath(const QString &relativePath);
+    void handleStripeConnection(QTcpSocket *socket, const QByteArray &token, int index);
+    void receiveStripeData(QTcpSocket *socket);
+    QByteArray readPooled(QTcpSocket *socket, qint64 maxSize);
+    bool writeAt(FileDefinition &fileInfo, qint64 offset, const QByteArray &data);
+    static void beginMetrics(FileDefinition &fileInfo, QTcpSocket *socket);
+    static void countReceived(FileDefinition &fileInfo, qint64 batch = 0);
+    bool reportProgress(QTcpSocket *primary);
+    void receiveFileData(QTcpSocket *socket);
+    QFile *openDestination(FileDefinition &fileInfo);
+    QFile *openDeltaDestination(FileDefinition &fileInfo, DeltaSync::Signature *signature);
+    void receiveDeltaData(QTcpSocket *socket);
+    void receiveCompressedData(QTcpSocket *socket);
+    void receiveSparseData(QTcpSocket *socket);
+    bool throttled(QTcpSocket *socket, QTcpSocket *primary);
+    void resumeInput(QTcpSocket *socket);
+    void startHashing(FileDefinition &fileInfo);
+    void startRelay(FileDefinition &fileInfo);
+    void startWriter(FileDefinition &fileInfo, QTcpSocket *socket);
+    bool closeWriter(FileDefinition &fileInfo);
+    void commitFile(const QString &filePath, const QString &fileName, const QByteArray &transferId,
+                    const QByteArray &verifiedHash);
+    QString receivePath(const FileDefinition &fileInfo) const;
+    static QString receivedFilePath(const QString &name);
+    bool joinMulticast(QTcpSocket *socket, FileDefinition &fileInfo);
+    bool openDatagramFlow(QTcpSocket *socket, FileDefinition &fileInfo, QByteArray *option);
+    void watchMulticast(QTcpSocket *socket, MulticastReceiver *multicast);
+    void receiveRepairMessages(QTcpSocket *socket);
+    bool acceptArchive(QTcpSocket *socket);
+    bool acceptDuplicate(QTcpSocket *socket);
+    void receiveArchiveData(QTcpSocket *socket);
+    bool verifyTrailer(QTcpSocket *primary);
+    bool hashReady(QTcpSocket *primary);
+    bool requestRepair(QTcpSocket *primary, const QByteArray &digest, const QVector<quint32> &expected,
+                       const QVector<quint32> &received);
+    void receiveRepairData(QTcpSocket *socket);
+    bool finishDelta(FileDefinition &fileInfo, bool complete);
+    void saveResumeState(const FileDefinition &fileInfo);
+    void receiveSessionInput(QTcpSocket *socket);
+    FileDefinition *findUndecided(QTcpSocket *socket, const QString &fileName);
+    void flushSessionReplies(QTcpSocket *socket);
+    void activateSessionFile(QTcpSocket *socket);
+    static Protocol::TransferReply sessionReply(const FileDefinition &fileInfo);
+    bool completeSessionFile(QTcpSocket *socket);
+    static FileDefinition definitionFromHeader(const Protocol::TransferHeader &header, QTcpSocket *socket);
 
     /** TCP server for listening to incoming connections. */
-    QTcpServer *server;
+    ReceiverServer *server;
+
+    /** Receivers serving the connections, empty when this one serves them. */
+    QList<Receiver*> workers;
+
+    /** Threads of the workers, one each. */
+    QList<QThread*> workerThreads;
+
+    /** Worker receiving the next connection. */
+    int nextWorker = 0;
+
+    /** Polls for room while accepting is paused by Config::getMaxPendingConnections(), null until needed. */
+    QTimer *admissionTimer = nullptr;
+
+    /** Owners of connections, shared with the workers, null without workers. */
+    QSharedPointer<ReceiverRegistry> registry;
     
     /** Directory object for received files path. */
     QDir *directory;
      
     /** Map of active file transfers indexed by socket. */
     QMap<QTcpSocket*, FileDefinition> pendingFiles;
+
+    /** Secondary connections of striped transfers indexed by socket. */
+    QMap<QTcpSocket*, StripeConnection> stripeSockets;
+
+    /** Connections carrying a batch of files indexed by socket. */
+    QMap<QTcpSocket*, SessionConnection> sessionConnections;
+
+    /** Rate limits of incoming transfers indexed by primary connection. */
+    QMap<QTcpSocket*, TokenBucket> sessionBuckets;
+
+    /** Connections paused by a bandwidth cap, each with a resume timer pending. */
+    QSet<QTcpSocket*> throttledSockets;
+
+    /** Read buffer reserved in ReceiveBudget by each connection. */
+    QHash<QTcpSocket*, qint64> bufferReservations;
+
+    /** Incoming connections counted by ReceiveBudget as waiting for an answer. */
+    QSet<QTcpSocket*> undecidedSockets;
+
+    /** Protocol version of each connection, known once its first bytes arrived. */
+    QMap<QTcpSocket*, int> socketVersions;
+
+    /** Connections with part of a v1 header buffered and no newline yet. */
+    QSet<QTcpSocket*> partialHeaders;
+
+    /**
+     * Milliseconds a v1 header without newline is waited for before the
+     * buffered bytes are taken as the whole line; older senders do not end
+     * download requests with a newline.
+     */
+    static const int LEGACY_HEADER_WAIT = 500;
+
+    /**
+     * Read buffer of a connection receiving compressed data, large enough
+     * for the biggest compression frame. Other connections get
+     * Config::getReceiveBufferSize(); every buffer is bounded so that an
+     * input paused by a bandwidth cap or by ReceiveBudget stops the sender
+     * through TCP flow control.
+     */
+    static constexpr qint64 RECEIVE_BUFFER = 2 * Compression::MAX_FRAME;
+
+    /** Milliseconds between checks for room while accepting is paused. */
+    static const int ADMISSION_POLL = 100;
+
+    /** Milliseconds a connection waiting for buffer memory retries after. */
+    static const int BUDGET_RETRY = 50;
+
+    /** Bytes read from a connection at once, in a buffer from BufferPool. */
+    static constexpr qint64 RECEIVE_BLOCK = 256 * 1024;
+
+    /** Largest byte range sent for one range request. */
+    static constexpr qint64 MAX_SERVED_RANGE = 8 * 1024 * 1024;
+
+    /** Bytes received between two counts in TransferMetrics, see countReceived(). */
+    static const qint64 METRICS_BATCH = 1024 * 1024;
 };
 
 #endif // RECEIVER_H
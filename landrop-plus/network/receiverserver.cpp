@@ -0,0 +1,15 @@
+/**
+ * @file receiverserver.cpp
+ */
+
+#include "receiverserver.h"
+
+ReceiverServer::ReceiverServer(QObject *parent)
+    : QTcpServer(parent)
+{
+}
+
+void ReceiverServer::incomingConnection(qintptr socketDescriptor)
+{
+    emit connectionAccepted(socketDescriptor);
+}
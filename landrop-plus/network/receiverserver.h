@@ -0,0 +1,38 @@
+/**
+ * @file receiverserver.h
+ * @brief Listening socket of the receiver handing out accepted descriptors
+ */
+
+#ifndef RECEIVERSERVER_H
+#define RECEIVERSERVER_H
+
+#include <QTcpServer>
+
+/**
+ * @class ReceiverServer
+ * @brief QTcpServer that leaves creating the socket of a connection to its user.
+ *
+ * A QTcpSocket belongs to the thread that creates it, so the default
+ * server, creating every socket itself, would tie all incoming connections
+ * to the listening thread. This one emits the native descriptor instead and
+ * Receiver opens the socket in the worker thread serving the connection.
+ */
+class ReceiverServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    explicit ReceiverServer(QObject *parent = nullptr);
+
+signals:
+    /**
+     * @brief Signal emitted for each accepted connection.
+     * @param socketDescriptor Native descriptor of the connected socket, owned by the receiver of the signal
+     */
+    void connectionAccepted(qintptr socketDescriptor);
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+};
+
+#endif // RECEIVERSERVER_H
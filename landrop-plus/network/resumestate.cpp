@@ -0,0 +1,152 @@
+/**
+ * @file resumestate.cpp
+ */
+
+#include "resumestate.h"
+#include <QCryptographicHash>
+#include <QFile>
+#include <QMap>
+
+namespace
+{
+    /** Size of the block at the end of the prefix covered by the check hash. */
+    const qint64 CHECK_BLOCK = 64 * 1024;
+
+    /**
+     * @brief Hashes the last block before @p length of a file.
+     * @return Hex SHA-1, empty if the file is shorter than @p length
+     */
+    QByteArray tailHash(const QString &filePath, qint64 length)
+    {
+        QFile file(filePath);
+        if (!file.open(QIODevice::ReadOnly) || file.size() < length)
+            return QByteArray();
+
+        qint64 start = qMax<qint64>(0, length - CHECK_BLOCK);
+        if (!file.seek(start))
+            return QByteArray();
+
+        QByteArray block = file.read(length - start);
+        if (block.size() != length - start)
+            return QByteArray();
+        return QCryptographicHash::hash(block, QCryptographicHash::Sha1).toHex();
+    }
+
+    /**
+     * @brief Reads the "key=value" lines of a file's sidecar.
+     * @return Values by key, empty if there is no sidecar
+     */
+    QMap<QByteArray, QByteArray> readSidecar(const QString &filePath)
+    {
+        QMap<QByteArray, QByteArray> values;
+        QFile sidecar(ResumeState::sidecarPath(filePath));
+        if (!sidecar.open(QIODevice::ReadOnly))
+            return values;
+
+        while (!sidecar.atEnd())
+        {
+            QByteArray line = sidecar.readLine().trimmed();
+            int separator = line.indexOf('=');
+            if (separator > 0)
+                values.insert(line.left(separator), line.mid(separator + 1));
+        }
+        return values;
+    }
+}
+
+QString ResumeState::sidecarPath(const QString &filePath)
+{
+    return filePath + ".landrop-resume";
+}
+
+qint64 ResumeState::resumableOffset(const QString &filePath, qint64 fileSize, const QByteArray &sourceTag)
+{
+    QMap<QByteArray, QByteArray> values = readSidecar(filePath);
+    if (sourceTag.isEmpty() || values.isEmpty())
+        return 0;
+
+    // A different version of the file was offered, its partial data is useless
+    if (values.value("size").toLongLong() != fileSize || values.value("mtime") != sourceTag)
+        return 0;
+
+    qint64 length = values.value("length").toLongLong();
+    if (length <= 0 || length >= fileSize)
+        return 0;
+
+    QByteArray check = values.value("check");
+    if (check.isEmpty() || tailHash(filePath, length) != check)
+        return 0;
+    return length;
+}
+
+void ResumeState::save(const QString &filePath, qint64 fileSize, const QByteArray &sourceTag, qint64 length)
+{
+    if (sourceTag.isEmpty() || length <= 0)
+        return;
+
+    QByteArray check = tailHash(filePath, length);
+    if (check.isEmpty())
+        return;
+
+    QFile sidecar(sidecarPath(filePath));
+    if (!sidecar.open(QIODevice::WriteOnly | QFile::Truncate))
+        return;
+
+    sidecar.write("size=" + QByteArray::number(fileSize) + '\n');
+    sidecar.write("mtime=" + sourceTag + '\n');
+    sidecar.write("length=" + QByteArray::number(length) + '\n');
+    sidecar.write("check=" + check + '\n');
+    sidecar.close();
+}
+
+void ResumeState::saveBlocks(const QString &filePath, qint64 fileSize, const QByteArray &sourceTag, const BlockMap &map)
+{
+    if (sourceTag.isEmpty() || map.heldCount() == 0)
+        return;
+
+    QFile sidecar(sidecarPath(filePath));
+    if (!sidecar.open(QIODevice::WriteOnly | QFile::Truncate))
+        return;
+
+    sidecar.write("size=" + QByteArray::number(fileSize) + '\n');
+    sidecar.write("mtime=" + sourceTag + '\n');
+    sidecar.write("block=" + QByteArray::number(map.blockSize()) + '\n');
+    sidecar.write("blocks=" + map.bitmap().toBase64() + '\n');
+    sidecar.write("sums=" + BlockMap::encodeChecksums(map.heldChecksums()).toBase64() + '\n');
+    sidecar.close();
+}
+
+BlockMap ResumeState::loadBlocks(const QString &filePath, qint64 fileSize, const QByteArray &sourceTag, qint64 blockSize)
+{
+    BlockMap map(fileSize, blockSize);
+    QMap<QByteArray, QByteArray> values = readSidecar(filePath);
+    if (sourceTag.isEmpty() || values.value("size").toLongLong() != fileSize || values.value("mtime") != sourceTag ||
+        values.value("block").toLongLong() != blockSize)
+        return map;
+
+    BlockMap listed(fileSize, blockSize);
+    QVector<quint32> sums;
+    if (!BlockMap::decodeChecksums(QByteArray::fromBase64(values.value("sums")), &sums) ||
+        !listed.restore(QByteArray::fromBase64(values.value("blocks")), sums))
+        return map;
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly) || file.size() < fileSize)
+        return map;
+
+    // Blocks written after the last save, or damaged since, are fetched again
+    for (int i = 0; i < listed.count(); ++i)
+    {
+        if (!listed.isHeld(i) || !file.seek(listed.blockOffset(i)))
+            continue;
+        QByteArray block = file.read(listed.blockLength(i));
+        if (block.size() == listed.blockLength(i) && BlockMap::checksum(block) == listed.checksumOf(i))
+            map.setHeld(i, listed.checksumOf(i));
+    }
+    return map;
+}
+
+void ResumeState::remove(const QString &filePath)
+{
+    QFile::remove(sidecarPath(filePath));
+}
@@ -0,0 +1,88 @@
+/**
+ * @file resumestate.h
+ * @brief Sidecar files recording how much of a partial download is valid
+ */
+
+#ifndef RESUMESTATE_H
+#define RESUMESTATE_H
+
+#include <QByteArray>
+#include <QString>
+#include "blockmap.h"
+
+/**
+ * @namespace ResumeState
+ * @brief Bookkeeping that lets an interrupted transfer continue where it stopped.
+ *
+ * While a file is being received, a small "<file>.landrop-resume" sidecar
+ * next to it records the size and modification time the sender announced,
+ * the length of the contiguous prefix already written and a SHA-1 of the
+ * last block of that prefix. When the same file is offered again, the
+ * receiver checks the partial file against the sidecar and answers the
+ * header with the offset the sender should continue from.
+ *
+ * A file received in blocks out of order (SwarmDownload) records a bitmap
+ * of the blocks it holds and their CRC-32C instead, see saveBlocks().
+ */
+namespace ResumeState
+{
+    /**
+     * @brief Path of the sidecar belonging to a destination file.
+     */
+    QString sidecarPath(const QString &filePath);
+
+    /**
+     * @brief Returns the offset a new transfer of the file can continue from.
+     *
+     * @param filePath Destination file in the received files folder
+     * @param fileSize Size announced by the sender
+     * @param sourceTag Modification time announced by the sender
+     * @return Verified length of the partial file, 0 when it must be received again
+     */
+    qint64 resumableOffset(const QString &filePath, qint64 fileSize, const QByteArray &sourceTag);
+
+    /**
+     * @brief Records the verified prefix of a partial file.
+     *
+     * The data must already be flushed to the file.
+     *
+     * @param filePath Destination file in the received files folder
+     * @param fileSize Size announced by the sender
+     * @param sourceTag Modification time announced by the sender
+     * @param length Length of the contiguous prefix received so far
+     */
+    void save(const QString &filePath, qint64 fileSize, const QByteArray &sourceTag, qint64 length);
+
+    /**
+     * @brief Records the blocks held of a file received out of order.
+     *
+     * The blocks must already be flushed to the file.
+     *
+     * @param filePath Destination file in the received files folder
+     * @param fileSize Size of the file
+     * @param sourceTag Identifies the contents, e.g. their hash
+     * @param map Blocks held and their checksums
+     */
+    void saveBlocks(const QString &filePath, qint64 fileSize, const QByteArray &sourceTag, const BlockMap &map);
+
+    /**
+     * @brief Returns the blocks of a partial file that can be kept.
+     *
+     * Every block the sidecar lists is read back and kept only if it still
+     * matches its checksum.
+     *
+     * @param filePath Destination file in the received files folder
+     * @param fileSize Size of the file
+     * @param sourceTag Identifies the contents, as given to saveBlocks()
+     * @param blockSize Block size of the download
+     * @return Map of the blocks held, none when the file must be received again
+     */
+    BlockMap loadBlocks(const QString &filePath, qint64 fileSize, const QByteArray &sourceTag, qint64 blockSize);
+
+    /**
+     * @brief Deletes the sidecar of a file, once complete or no longer resumable.
+     */
+    void remove(const QString &filePath);
+}
+
+#endif // RESUMESTATE_H
@@ -0,0 +1,357 @@
+/**
+ * @file securetransport.cpp
+ */
+
+#include "securetransport.h"
+#include "../config/config.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QHostAddress>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QProcess>
+#include <QSslCertificate>
+#include <QSslCipher>
+#include <QSslConfiguration>
+#include <QSslError>
+#include <QSslKey>
+#include <QSslSocket>
+
+namespace
+{
+    /** Content type of a TLS handshake record, the first byte of a ClientHello */
+    const char HANDSHAKE_RECORD = 0x16;
+
+    QMutex transportMutex;
+
+    /** Last session ticket of each peer ("ip:port") */
+    QHash<QString, QByteArray> sessionTickets;
+
+    /** SHA-256 digest of the certificate each peer presented first, kept at Config::getTrustedPeersPath() */
+    QHash<QString, QByteArray> trustedCertificates;
+    bool trustedLoaded = false;
+
+    /** Longest time the openssl command may take to create the server certificate */
+    const int GENERATE_TIMEOUT_MS = 30000;
+
+    bool serverLoaded = false;
+    bool serverUsable = false;
+    QSslConfiguration serverConfig;
+
+    /**
+     * @brief Same key for an IPv4 peer whether it is seen as IPv4 or IPv4-mapped IPv6.
+     */
+    QString peerKey(const QString &peer)
+    {
+        QHostAddress address(peer);
+        bool isIPv4 = false;
+        quint32 ipv4 = address.toIPv4Address(&isIPv4);
+        return isIPv4 ? QHostAddress(ipv4).toString() : peer;
+    }
+
+    /**
+     * @brief TLS 1.3 with the AEAD ciphers the TLS library supports, fastest first.
+     */
+    QSslConfiguration baseConfiguration()
+    {
+        static const char *const preferred[] = {
+            "TLS_AES_128_GCM_SHA256",
+            "TLS_CHACHA20_POLY1305_SHA256",
+            "TLS_AES_256_GCM_SHA384",
+        };
+
+        QSslConfiguration config = QSslConfiguration::defaultConfiguration();
+        config.setProtocol(QSsl::TlsV1_3OrLater);
+
+        QList<QSslCipher> ciphers;
+        for (const char *name : preferred)
+        {
+            QSslCipher cipher(QString::fromLatin1(name));
+            if (!cipher.isNull())
+                ciphers.append(cipher);
+        }
+        if (!ciphers.isEmpty())
+            config.setCiphers(ciphers);
+        return config;
+    }
+
+    /**
+     * @brief Reads the server certificate and key once. Called with the mutex held.
+     */
+    bool loadServerConfiguration()
+    {
+        if (serverLoaded)
+            return serverUsable;
+        serverLoaded = true;
+
+        QList<QSslCertificate> certificates = QSslCertificate::fromPath(Config::getTlsCertificatePath());
+        QFile keyFile(Config::getTlsKeyPath());
+        if (certificates.isEmpty() || !keyFile.open(QIODevice::ReadOnly))
+            return false;
+
+        QByteArray pem = keyFile.readAll();
+        QSslKey key(pem, QSsl::Ec);
+        if (key.isNull())
+            key = QSslKey(pem, QSsl::Rsa);
+        if (key.isNull())
+            return false;
+
+        serverConfig = baseConfiguration();
+        serverConfig.setLocalCertificate(certificates.first());
+        serverConfig.setPrivateKey(key);
+        serverConfig.setPeerVerifyMode(QSslSocket::VerifyNone);
+        serverUsable = true;
+        return true;
+    }
+
+    /**
+     * @brief Reads the pinned certificate digests once. Called with the mutex held.
+     *
+     * Lines that cannot be read are skipped, a later pin of the same peer
+     * replaces an earlier one.
+     */
+    void loadTrustedCertificates()
+    {
+        if (trustedLoaded)
+            return;
+        trustedLoaded = true;
+
+        QFile file(Config::getTrustedPeersPath());
+        if (!file.open(QIODevice::ReadOnly))
+            return;
+        while (!file.atEnd())
+        {
+            QList<QByteArray> fields = file.readLine().trimmed().split(' ');
+            QByteArray digest = fields.size() == 2 ? QByteArray::fromHex(fields[1]) : QByteArray();
+            if (digest.size() == 32)
+                trustedCertificates.insert(QString::fromUtf8(fields[0]), digest);
+        }
+    }
+
+    /**
+     * @brief Appends the pin of a peer seen for the first time. Called with the mutex held.
+     */
+    bool saveTrustedCertificate(const QString &peer, const QByteArray &digest)
+    {
+        QFile file(Config::getTrustedPeersPath());
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+            return false;
+        QByteArray line = peer.toUtf8() + ' ' + digest.toHex() + '\n';
+        return file.write(line) == line.size() && file.flush();
+    }
+
+    /**
+     * @brief Creates a self-signed certificate and its key with the openssl command.
+     *
+     * @return false if openssl is missing or failed
+     */
+    bool generateServerCertificate(const QString &certificatePath, const QString &keyPath)
+    {
+        QDir().mkpath(QFileInfo(certificatePath).absolutePath());
+        QDir().mkpath(QFileInfo(keyPath).absolutePath());
+
+        QProcess openssl;
+        openssl.start("openssl", {"req", "-x509", "-newkey", "ec", "-pkeyopt", "ec_paramgen_curve:prime256v1",
+                                  "-nodes", "-days", "3650", "-subj", "/CN=landrop", "-keyout", keyPath, "-out",
+                                  certificatePath});
+        if (!openssl.waitForFinished(GENERATE_TIMEOUT_MS) || openssl.exitStatus() != QProcess::NormalExit ||
+            openssl.exitCode() != 0)
+        {
+            openssl.kill();
+            QFile::remove(certificatePath);
+            QFile::remove(keyPath);
+            return false;
+        }
+        QFile::setPermissions(keyPath, QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+        return true;
+    }
+
+    /**
+     * @brief Whether the handshake errors only say the peer's certificate is
+     * not signed by a known authority, and it is the one pinned for the peer.
+     *
+     * The first certificate of a peer is pinned and kept across restarts,
+     * a different one is refused until its line is removed from
+     * Config::getTrustedPeersPath().
+     */
+    bool trustPeer(QSslSocket *socket, const QString &ip, const QList<QSslError> &errors)
+    {
+        for (const QSslError &error : errors)
+        {
+            switch (error.error())
+            {
+            case QSslError::SelfSignedCertificate:
+            case QSslError::SelfSignedCertificateInChain:
+            case QSslError::UnableToGetLocalIssuerCertificate:
+            case QSslError::UnableToVerifyFirstCertificate:
+            case QSslError::CertificateUntrusted:
+            case QSslError::HostNameMismatch:
+                break;
+            default:
+                return false;
+            }
+        }
+
+        QByteArray digest = socket->peerCertificate().digest(QCryptographicHash::Sha256);
+        if (digest.isEmpty())
+            return false;
+
+        QMutexLocker lock(&transportMutex);
+        loadTrustedCertificates();
+        QString peer = peerKey(ip);
+        auto trusted = trustedCertificates.constFind(peer);
+        if (trusted != trustedCertificates.constEnd())
+            return trusted.value() == digest;
+
+        // A pin that cannot be kept would be trusted again after a restart
+        if (!saveTrustedCertificate(peer, digest))
+            return false;
+        trustedCertificates.insert(peer, digest);
+        return true;
+    }
+}
+
+bool SecureTransport::enabled()
+{
+    return (Config::getEncryptionEnabled() || Config::getEncryptionRequired()) && QSslSocket::supportsSsl();
+}
+
+bool SecureTransport::required()
+{
+    return Config::getEncryptionRequired();
+}
+
+bool SecureTransport::prepareServer(QString *error)
+{
+    QString certificatePath = Config::getTlsCertificatePath();
+    QString keyPath = Config::getTlsKeyPath();
+    QMutexLocker lock(&transportMutex);
+    if (!QSslSocket::supportsSsl())
+    {
+        if (error)
+            *error = QString("Encryption needs a TLS library, none is available");
+        return false;
+    }
+
+    // First run: neither file exists yet
+    if (!QFile::exists(certificatePath) && !QFile::exists(keyPath))
+    {
+        generateServerCertificate(certificatePath, keyPath);
+        serverLoaded = false;
+    }
+    if (loadServerConfiguration())
+        return true;
+
+    if (error)
+        *error = QString("No usable TLS certificate %1 with its private key %2. Create them with: openssl req -x509 "
+                         "-newkey ec -pkeyopt ec_paramgen_curve:prime256v1 -nodes -days 3650 -subj /CN=landrop "
+                         "-keyout %2 -out %1")
+                     .arg(certificatePath, keyPath);
+    return false;
+}
+
+QTcpSocket *SecureTransport::createSocket(QObject *parent)
+{
+    if (enabled())
+        return new QSslSocket(parent);
+    return new QTcpSocket(parent);
+}
+
+void SecureTransport::connectToPeer(QTcpSocket *socket, const QString &ip, quint16 port)
+{
+    QSslSocket *secure = qobject_cast<QSslSocket *>(socket);
+    if (!secure)
+    {
+        socket->connectToHost(QHostAddress(ip), port);
+        return;
+    }
+
+    QString key = peerKey(ip) + ':' + QString::number(port);
+    QSslConfiguration config = baseConfiguration();
+    config.setPeerVerifyMode(QSslSocket::VerifyPeer);
+    config.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+    {
+        QMutexLocker lock(&transportMutex);
+        QByteArray ticket = sessionTickets.value(key);
+        if (!ticket.isEmpty())
+            config.setSessionTicket(ticket);
+    }
+    secure->setSslConfiguration(config);
+
+    QObject::connect(secure, &QSslSocket::sslErrors, secure, [secure, ip](const QList<QSslError> &errors)
+                     {
+        if (trustPeer(secure, ip, errors))
+            secure->ignoreSslErrors(); });
+
+    // TLS 1.3 tickets arrive after the handshake
+    auto keepTicket = [secure, key]()
+    {
+        QByteArray ticket = secure->sslConfiguration().sessionTicket();
+        if (ticket.isEmpty())
+            return;
+        QMutexLocker lock(&transportMutex);
+        sessionTickets.insert(key, ticket);
+    };
+    QObject::connect(secure, &QSslSocket::encrypted, secure, keepTicket);
+    QObject::connect(secure, &QSslSocket::newSessionTicketReceived, secure, keepTicket);
+
+    secure->connectToHostEncrypted(ip, port);
+}
+
+QMetaObject::Connection SecureTransport::onReady(QTcpSocket *socket, QObject *context, std::function<void()> ready)
+{
+    if (QSslSocket *secure = qobject_cast<QSslSocket *>(socket))
+        return QObject::connect(secure, &QSslSocket::encrypted, context, ready);
+    return QObject::connect(socket, &QTcpSocket::connected, context, ready);
+}
+
+bool SecureTransport::isReady(QTcpSocket *socket)
+{
+    if (socket->state() != QAbstractSocket::ConnectedState)
+        return false;
+    QSslSocket *secure = qobject_cast<QSslSocket *>(socket);
+    return !secure || secure->isEncrypted();
+}
+
+bool SecureTransport::isEncrypted(QTcpSocket *socket)
+{
+    QSslSocket *secure = qobject_cast<QSslSocket *>(socket);
+    return secure && secure->isEncrypted();
+}
+
+bool SecureTransport::acceptHandshake(QTcpSocket *socket)
+{
+    QSslSocket *secure = qobject_cast<QSslSocket *>(socket);
+    if (!secure || secure->mode() != QSslSocket::UnencryptedMode)
+        return false;
+
+    // Peeking a plain QSslSocket leaves the bytes for the handshake
+    QByteArray start = secure->peek(1);
+    if (start.isEmpty() || start.at(0) != HANDSHAKE_RECORD)
+        return false;
+
+    QSslConfiguration config;
+    {
+        QMutexLocker lock(&transportMutex);
+        if (!loadServerConfiguration())
+            return false;
+        config = serverConfig;
+    }
+    secure->setSslConfiguration(config);
+    secure->startServerEncryption();
+    return true;
+}
+
+void SecureTransport::reset()
+{
+    QMutexLocker lock(&transportMutex);
+    sessionTickets.clear();
+    trustedCertificates.clear();
+    trustedLoaded = false;
+    serverLoaded = false;
+    serverUsable = false;
+    serverConfig = QSslConfiguration();
+}
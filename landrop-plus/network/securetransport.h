@@ -0,0 +1,121 @@
+/**
+ * @file securetransport.h
+ * @brief TLS 1.3 encryption of transfer connections
+ */
+
+#ifndef SECURETRANSPORT_H
+#define SECURETRANSPORT_H
+
+#include <QMetaObject>
+#include <QString>
+#include <QTcpSocket>
+#include <functional>
+
+/**
+ * @namespace SecureTransport
+ * @brief Opens and accepts transfer connections encrypted with TLS 1.3.
+ *
+ * With Config::getEncryptionEnabled() set (and a TLS library available),
+ * the connections of Sender, PeerSession and ConnectionPool are QSslSocket
+ * instances negotiating TLS 1.3 with AEAD ciphers only: AES-128-GCM first,
+ * which the TLS library runs on the CPU's AES instructions, ChaCha20-Poly1305
+ * for CPUs without them, then AES-256-GCM. Once the handshake is done the
+ * connection carries the same protocol as a plain one.
+ *
+ * Handshakes are amortized: pooled connections are taken only once they are
+ * encrypted, a session sends all its files over one connection, and the
+ * session ticket of each peer is kept so later connections resume the TLS
+ * session instead of doing a full handshake.
+ *
+ * The Receiver accepts encrypted and plain connections on the same port: a
+ * connection opening with a TLS handshake record is answered with the
+ * certificate at Config::getTlsCertificatePath(), created on first run by
+ * prepareServer(). With Config::getEncryptionRequired() set plain
+ * connections are refused, so a peer cannot be talked into sending in the
+ * clear. Peers present self-signed certificates, so a sender pins the
+ * first certificate a peer presents in Config::getTrustedPeersPath() and
+ * refuses a different one from that peer, also after a restart.
+ *
+ * Can be used from any thread.
+ */
+namespace SecureTransport
+{
+    /**
+     * @brief Whether new connections are encrypted.
+     */
+    bool enabled();
+
+    /**
+     * @brief Whether unencrypted connections are refused.
+     */
+    bool required();
+
+    /**
+     * @brief Loads the server certificate, creating a self-signed one if neither it nor its key exists.
+     *
+     * The certificate is created with the openssl command. Called once on
+     * start when encryption is enabled, so a missing certificate is
+     * reported instead of leaving only plain connections working.
+     *
+     * @param error Receives what is missing and how to create it
+     * @return false if encrypted connections cannot be accepted
+     */
+    bool prepareServer(QString *error = nullptr);
+
+    /**
+     * @brief Creates a transfer socket, a QSslSocket when encryption is enabled.
+     */
+    QTcpSocket *createSocket(QObject *parent);
+
+    /**
+     * @brief Connects a socket made by createSocket() to a peer.
+     *
+     * Starts the TLS handshake on a QSslSocket, resuming the previous session
+     * with the peer when its ticket is known, and plainly connects any other
+     * socket.
+     */
+    void connectToPeer(QTcpSocket *socket, const QString &ip, quint16 port);
+
+    /**
+     * @brief Calls a function once a socket can carry transfer data.
+     *
+     * That is once the handshake is done for an encrypted socket, once it is
+     * connected otherwise.
+     *
+     * @param socket Socket being connected with connectToPeer()
+     * @param context Object the call is bound to
+     * @param ready Function to call
+     */
+    QMetaObject::Connection onReady(QTcpSocket *socket, QObject *context, std::function<void()> ready);
+
+    /**
+     * @brief Whether a socket is connected and, if it is a QSslSocket, encrypted.
+     */
+    bool isReady(QTcpSocket *socket);
+
+    /**
+     * @brief Whether a socket carries data encrypted.
+     *
+     * Its data then has to pass through the TLS library, zero-copy sends
+     * cannot be used on it.
+     */
+    bool isEncrypted(QTcpSocket *socket);
+
+    /**
+     * @brief Starts the server side of a handshake when a connection opens with one.
+     *
+     * Called with the first bytes of an accepted connection, before anything
+     * is read from it. Plain connections are left untouched.
+     *
+     * @return true if the connection is being encrypted, its data then
+     *         arrives with the next readyRead()
+     */
+    bool acceptHandshake(QTcpSocket *socket);
+
+    /**
+     * @brief Forgets session tickets and the loaded server certificate, pins are read again from their file.
+     */
+    void reset();
+}
+
+#endif // SECURETRANSPORT_H
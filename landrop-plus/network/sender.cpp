@@ -3,7 +3,14 @@
  */
 
 #include "sender.h"
+#include "blockmap.h"
+#include "protocol.h"
+#include "zerocopy.h"
+#include "securetransport.h"
+#include "sparsefile.h"
+#include "contentindex.h"
 #include <QFileInfo>
+#include <QDateTime>
 #include <QDebug>
 
 /**
@@ -16,10 +23,13 @@
  */
 Sender::Sender(QObject *parent)
     : QObject(parent), socket(nullptr), file(nullptr), bytesSent(0), port(Config::getPort()),
-      connectionTimer(new QTimer(this)), responseTimer(new QTimer(this))
+      connectionTimer(new QTimer(this)), responseTimer(new QTimer(this)), throttleTimer(new QTimer(this)),
+      race(new ConnectionRace(this))
 {
     connectionTimer->setSingleShot(true);
     responseTimer->setSingleShot(true);
+    throttleTimer->setSingleShot(true);
+    connect(throttleTimer, &QTimer::timeout, this, &Sender::resumeThrottled);
 
     connect(connectionTimer, &QTimer::timeout, this, [this]()
             {
@@ -27,6 +37,16 @@ Sender::Sender(QObject *parent)
         emit transferError();
         reset(); });
 
+    connect(race, &ConnectionRace::established, this, [this](QTcpSocket *connection, const QString &address)
+            {
+        connectedAddress = address;
+        adoptConnection(connection); });
+    connect(race, &ConnectionRace::failed, this, [this]()
+            {
+        // qDebug() << "Sender: No address of the receiver answered";
+        emit transferError();
+        reset(); });
+
     connect(responseTimer, &QTimer::timeout, this, [this]()
             {
         qDebug() << "Sender: Response timeout - no OK/NO received";
@@ -53,8 +73,39 @@ Sender::~Sender()
  */
 void Sender::reset()
 {
+    // A file still open here did not make it
+    TransferMetrics::end(metricsId, TransferMetrics::Outcome::Failed);
+    metricsId = 0;
+    connectClock.invalidate();
+    windowFull.invalidate();
+    acceptWaitStart = -1;
+
     connectionTimer->stop();
     responseTimer->stop();
+    throttleTimer->stop();
+    race->abort();
+    sessionBucket = TokenBucket();
+    sessionBucket.setPriority(lane);
+
+    if (zeroCopyNotifier)
+    {
+        zeroCopyNotifier->setEnabled(false);
+        zeroCopyNotifier->deleteLater();
+        zeroCopyNotifier = nullptr;
+    }
+
+    for (Stripe &stripe : stripes)
+    {
+        if (stripe.socket)
+        {
+            stripe.socket->blockSignals(true);
+            if (stripe.socket->state() != QAbstractSocket::UnconnectedState)
+                stripe.socket->disconnectFromHost();
+            stripe.socket->deleteLater();
+        }
+        delete stripe.source;
+    }
+    stripes.clear();
 
     if (socket)
     {
@@ -71,6 +122,12 @@ void Sender::reset()
         socket->deleteLater();
         socket = nullptr;
     }
+    if (source)
+    {
+        source->close();
+        delete source;
+        source = nullptr;
+    }
     if (file)
     {
         if (file->isOpen())
@@ -79,6 +136,40 @@ void Sender::reset()
         file = nullptr;
     }
     bytesSent = 0;
+    stripeBytesSent = 0;
+    stripeCount = 1;
+    sendEnd = 0;
+    resumeOffset = 0;
+    fileEnd = 0;
+    delete deltaEncoder;
+    deltaEncoder = nullptr;
+    delete compressor;
+    compressor = nullptr;
+    delete hasher;
+    hasher = nullptr;
+    if (datagramSender)
+    {
+        datagramSender->deleteLater();
+        datagramSender = nullptr;
+    }
+    datagramDigest.clear();
+    repairBlockSize = 0;
+    repairRounds = 0;
+    deltaBlockSize = 0;
+    deltaBasisSize = 0;
+    signatureSize = -1;
+    signatureData.clear();
+    sparse = false;
+    dataRanges.clear();
+    stripePaths.clear();
+    stripeWeights.clear();
+    stripeToken.clear();
+    dataRange = 0;
+    primaryDone = false;
+    finished = false;
+    inBand = false;
+    lastProgress = -1;
+    sendWindow.reset();
 }
 
 
@@ -95,32 +186,120 @@ void Sender::reset()
  * @param filePath Absolute path to the file to be sent.
  * @param receiverIP IP address of the receiver.
  * @param customPort TCP port number to connect to on the receiver.
+ * @param version Protocol version the receiver advertised (Protocol::VERSION_1 or VERSION_2).
+ * @param connection Connected, unused socket to the receiver taken from a
+ *        ConnectionPool, null to connect now; the sender takes it over
  *
  * @note Returns silently if file doesn't exist; emits transferError() for connection/protocol failures.
- * @note Uses a 10-second connection timeout.
+ * @note Uses a 10-second connection timeout, covering the TLS handshake of an
+ *       encrypted connection (see SecureTransport) and the attempts to every
+ *       address the receiver announced (see ConnectionRace).
  */
-void Sender::sendFile(const QString &filePath, const QString &receiverIP, quint16 customPort)
+void Sender::sendFile(const QString &filePath, const QString &receiverIP, quint16 customPort, int version, QTcpSocket *connection)
 {
     reset();
 
     port = customPort; // Use the specified port
+    receiverAddress = receiverIP;
+    connectedAddress = receiverIP;
+    protocolVersion = version;
 
     file = new QFile(filePath);
+    if (connection)
+    {
+        adoptConnection(connection);
+        return;
+    }
     if (!file->exists())
     {
         return;
     }
 
-    socket = new QTcpSocket(this);
-    connect(socket, &QTcpSocket::connected, this, &Sender::onConnected);
+    // Every address the receiver announced is tried, see ConnectionRace
+    connectClock.start();
+    race->start(receiverIP, port);
+    connectionTimer->start(10000); // 10 second connection timeout
+}
+
+/**
+ * @brief Sends a file on a connection the receiver opened to ask for it.
+ *
+ * Serves in-band downloads: the requester reads the header and data on its
+ * request connection, so no connection back to it is needed. The file is
+ * not offered striped, since stripes would have to connect back.
+ *
+ * @param connection Connected request socket, the sender takes it over
+ * @param filePath Absolute path to the file to be sent.
+ * @param version Protocol version of the request
+ */
+void Sender::sendFileOn(QTcpSocket *connection, const QString &filePath, int version)
+{
+    reset();
+
+    receiverAddress = connection->peerAddress().toString();
+    connectedAddress = receiverAddress;
+    port = connection->peerPort();
+    protocolVersion = version;
+    inBand = true;
+
+    file = new QFile(filePath);
+    adoptConnection(connection);
+}
+
+/**
+ * @brief Limits the files sent next to one byte range.
+ *
+ * The header then announces the end of the range as the file size and
+ * "range=<offset>", and only the bytes from the offset on are sent, like
+ * a resumed transfer. Ranged files are neither striped, diffed, hashed nor
+ * offered for dedup, those cover whole files. The range stays set for
+ * every file sent afterwards.
+ *
+ * @param offset First byte to send, past the end of the file nothing is sent
+ * @param length Bytes to send, -1 up to the end of the file as it is when the header is sent
+ */
+void Sender::setRange(qint64 offset, qint64 length)
+{
+    rangeOffset = qMax<qint64>(0, offset);
+    rangeLength = length;
+}
+
+/**
+ * @brief Sends the header of the current file on an already connected socket.
+ */
+void Sender::adoptConnection(QTcpSocket *connection)
+{
+    connection->setParent(this);
+    socket = connection;
+    if (!file->exists())
+    {
+        reset();
+        return;
+    }
+
+    connectSocket();
+    onConnected();
+}
+
+/**
+ * @brief Connects the primary socket's data, disconnection and error signals.
+ */
+void Sender::connectSocket()
+{
     connect(socket, &QTcpSocket::readyRead, this, &Sender::onReadyRead);
-    connect(socket, &QTcpSocket::disconnected, this, &Sender::reset);
+    connect(socket, &QTcpSocket::disconnected, this, [this]()
+            {
+        // The receiver closes every stripe once it has the whole file
+        if (!finished && primaryDone && stripeBytesSent + bytesSent >= fileEnd)
+            finishSend();
+        reset(); });
     connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::errorOccurred),
             this, [this](QAbstractSocket::SocketError socketError)
-            { emit transferError(); });
-
-    socket->connectToHost(QHostAddress(receiverIP), port);
-    connectionTimer->start(10000); // 10 second connection timeout
+            {
+        // A receiver that may ask for blocks again closes the connection once verified
+        bool verified = (repairBlockSize > 0 && primaryDone && socketError == QAbstractSocket::RemoteHostClosedError);
+        if (!finished && !verified)
+            emit transferError(); });
 }
 
 /**
@@ -131,16 +310,127 @@ void Sender::sendFile(const QString &filePath, const QString &receiverIP, quint1
  * and starts a timer waiting for the receiver's acceptance response.
  *
  * @note Uses a 30-second timeout for receiver response.
- * @note File metadata is sent in format: "filename|filesize\n"
+ * @note File metadata is sent in format: "filename|filesize[|udp=1;stripes=N;weights=W;mtime=T;delta=1;compress=zlib;level=L;hash=blake2b;content=H]\n",
+ *       or after Protocol::PREAMBLE_V2 as a header frame to a v2 receiver. A
+ *       range carries "range=<offset>" and compression only.
  */
 void Sender::onConnected()
 {
     connectionTimer->stop(); // Connection successful
 
-    QByteArray filename = QFileInfo(file->fileName()).fileName().toLocal8Bit();
-    QByteArray filesize = QByteArray::number(file->size());
-    socket->write(filename + "|" + filesize + "\n");
+    // The receiver's profile as it is now holds for the whole file
+    profile = TransferProfiles::settings(receiverAddress);
+    sendWindow.reset(receiverAddress);
+
+    // The size is taken once, a file growing meanwhile is sent as it was
+    bool ranged = rangeOffset > 0 || rangeLength >= 0;
+    fileEnd = file->size();
+    if (ranged)
+    {
+        rangeOffset = qMin(rangeOffset, fileEnd);
+        if (rangeLength >= 0)
+            fileEnd = qMin(fileEnd, rangeOffset + rangeLength);
+    }
+
+    Protocol::TransferHeader header;
+    header.fileName = QFileInfo(file->fileName()).fileName();
+    header.fileSize = fileEnd;
+    header.transferId = Protocol::newTransferId();
+
+    metricsId = TransferMetrics::begin(TransferMetrics::Direction::Send, header.fileName, receiverAddress,
+                                       fileEnd - rangeOffset);
+    if (connectClock.isValid())
+    {
+        TransferMetrics::setHandshake(metricsId, connectClock.elapsed());
+        if (TransferTrace::enabled())
+            TransferTrace::complete("connect", "send", TransferTrace::now() - connectClock.nsecsElapsed() / 1000, metricsId);
+    }
+    connectClock.invalidate();
+
+    if (ranged)
+    {
+        header.options.insert("range", QByteArray::number(rangeOffset));
+        if (profile.compression)
+        {
+            header.options.insert("compress", Compression::CODEC_ZLIB);
+            header.options.insert("level", QByteArray::number(profile.compressionLevel));
+        }
+        if (protocolVersion >= Protocol::VERSION_2)
+            socket->write(Protocol::PREAMBLE_V2);
+        socket->write(header.encode(protocolVersion));
+        socket->flush();
+        TransferTrace::instant("header", "send", metricsId);
+        acceptWaitStart = TransferTrace::enabled() ? TransferTrace::now() : -1;
+        responseTimer->start(30000);
+        return;
+    }
+
+    // Offer to carry the data over UDP to peers chosen for it, instead of striping
+    if (!inBand && DatagramTransport::selectedFor(receiverAddress))
+        header.options.insert("udp", "1");
+
+    // Offer striping for large files, the receiver may lower or ignore it
+    else if (!inBand && profile.stripeCount > 1 && header.fileSize >= Config::getStripeThreshold())
+    {
+        header.options.insert("stripes", QByteArray::number(profile.stripeCount));
+
+        // Weighted stripes over every interface, when the hosts have more than one path
+        if (Config::getBondingEnabled())
+        {
+            stripePaths = PathBonding::paths(socket->localAddress(), receiverAddress, profile.stripeCount);
+            for (PathBonding::Path &path : stripePaths)
+            {
+                if (path.remote == receiverAddress)
+                    path.remote = connectedAddress;
+            }
+            if (stripePaths.count(stripePaths.first()) < stripePaths.size())
+            {
+                stripeWeights = PathBonding::weights(stripePaths);
+                header.options.insert("weights", Protocol::encodeWeights(stripeWeights));
+            }
+            else
+            {
+                stripePaths.clear();
+            }
+        }
+    }
+
+    // Identifies this version of the file, so the receiver can resume a partial copy
+    if (Config::getResumeEnabled())
+        header.options.insert("mtime", QByteArray::number(QFileInfo(*file).lastModified().toMSecsSinceEpoch()));
+
+    // Offer to send only the blocks that differ from a copy the receiver has
+    if (Config::getDeltaSyncEnabled() && header.fileSize >= Config::getDeltaThreshold())
+        header.options.insert("delta", "1");
+
+    // Offer to send only the data of a sparse file and a map of its holes
+    if (Config::getSparseFilesEnabled() && SparseFile::isSparse(file->fileName()))
+        header.options.insert("sparse", "1");
+
+    if (profile.compression)
+    {
+        header.options.insert("compress", Compression::CODEC_ZLIB);
+        header.options.insert("level", QByteArray::number(profile.compressionLevel));
+    }
+
+    // Offer a digest of the whole file after its data
+    if (Config::getIntegrityCheckEnabled())
+        header.options.insert("hash", StreamHasher::ALGORITHM);
+
+    // Name the contents when they were hashed before, the receiver may have them
+    if (Config::getDedupEnabled())
+    {
+        QByteArray content = ContentIndex::hashOf(file->fileName());
+        if (!content.isEmpty())
+            header.options.insert("content", content);
+    }
+
+    if (protocolVersion >= Protocol::VERSION_2)
+        socket->write(Protocol::PREAMBLE_V2);
+    socket->write(header.encode(protocolVersion));
     socket->flush();
+    TransferTrace::instant("header", "send", metricsId);
+    acceptWaitStart = TransferTrace::enabled() ? TransferTrace::now() : -1;
 
     responseTimer->start(30000); // 30 second response timeout
 }
@@ -150,10 +440,24 @@ void Sender::onConnected()
  *
  * This method handles the LANDrop protocol responses:
  * - "OK": Receiver accepts the transfer, begin sending file data
+ * - "OK|stripes=N;token=T": Accepted as a striped transfer over N connections
+ * - "OK|offset=N": Accepted, the receiver already has the first N bytes
+ * - "OK|delta=B;base=N;sig=S": Accepted as a delta against the receiver's
+ *   copy, whose S-byte block signature follows the reply line
+ * - "OK|compress=zlib;level=L": Accepted, data is sent as compression frames
+ * - "OK|hash=blake2b": Accepted, the data is followed by "HASH|<hex digest>\n"
+ * - "OK|sparse=1": Accepted, the data ranges are listed in a map that precedes them
+ * - "OK|udp=P/T/B": Accepted, the data goes to UDP port P as blocks of B
+ *   bytes tagged with token T, repaired in rounds on the connection (see DatagramTransport)
+ * - "OK|have=1": The receiver copied the contents from a file it already had,
+ *   no data is sent
  * - "NO": Receiver refuses the transfer
  * - Other: Errors
  *
- * For accepted transfers, this method sets up chunked file transmission
+ * A v2 receiver sends the same reply as a reply frame.
+ *
+ * For accepted transfers, this method hands the file to the kernel send path
+ * when enabled and available, otherwise it sets up chunked file transmission
  * using the configured buffer size.
  *
  * @note Emits transferAccepted(), transferRefused(), or transferError() based on response.
@@ -166,12 +470,46 @@ void Sender::onReadyRead()
     if (!socket)
         return; // Safety check
 
-    QByteArray response = socket->readLine().trimmed();
+    if (signatureSize >= 0)
+    {
+        receiveSignature();
+        return;
+    }
+
+    if (primaryDone)
+    {
+        resendBlocks();
+        return;
+    }
 
-    if (response == "OK")
+    if (datagramSender)
+    {
+        receiveDatagramRepairs();
+        return;
+    }
+
+    QByteArray response;
+    Protocol::ReadStatus status = Protocol::readMessage(socket, protocolVersion, &response);
+    if (status == Protocol::ReadStatus::Incomplete)
+        return;
+
+    Protocol::TransferReply reply;
+    bool valid = (status == Protocol::ReadStatus::Complete && Protocol::TransferReply::decode(response, &reply));
+
+    if (valid && reply.accepted)
     {
         responseTimer->stop(); // Got response
-        emit transferAccepted();
+        TransferMetrics::accepted(metricsId);
+        TransferTrace::complete("accept wait", "send", acceptWaitStart, metricsId);
+        acceptWaitStart = -1;
+
+        if (reply.options.value("have") == "1")
+        {
+            emit transferAccepted();
+            emit progressUpdated(100);
+            finishSend();
+            return;
+        }
 
         // Regular file upload logic
         if (!file->open(QIODevice::ReadOnly))
@@ -180,36 +518,152 @@ void Sender::onReadyRead()
             return;
         }
 
-        bytesSent = 0;
+        int offered = profile.stripeCount;
+        QByteArray token = reply.options.value("token");
+        stripeCount = qBound(1, reply.options.value("stripes", "1").toInt(), qMax(1, offered));
+        if (token.isEmpty())
+            stripeCount = 1;
+
+        // A range continues from its offset, the receiver confirms it
+        bool ranged = rangeOffset > 0 || rangeLength >= 0;
+        resumeOffset = reply.options.value("offset", "0").toLongLong();
+        if (resumeOffset < 0 || (ranged && resumeOffset != rangeOffset) ||
+            (!ranged && resumeOffset > 0 && (resumeOffset >= fileEnd || stripeCount > 1)))
+        {
+            // The receiver would expect data this side cannot send
+            emit transferError();
+            reset();
+            return;
+        }
+
+        deltaBlockSize = reply.options.value("delta", "0").toLongLong();
+        if (deltaBlockSize > 0)
+        {
+            deltaBasisSize = reply.options.value("base", "-1").toLongLong();
+            signatureSize = reply.options.value("sig", "-1").toLongLong();
+            if (stripeCount > 1 || resumeOffset > 0 || deltaBasisSize < 0 || signatureSize < 0)
+            {
+                emit transferError();
+                reset();
+                return;
+            }
+        }
 
-        connect(socket, &QTcpSocket::bytesWritten, this, [this](qint64)
-                {
-            if (!file || !file->isOpen() || !socket) return;
+        QByteArray codec = reply.options.value("compress");
+        if (!codec.isEmpty())
+        {
+            // Only plain single-connection data is framed
+            if (codec != Compression::CODEC_ZLIB || stripeCount > 1 || deltaBlockSize > 0)
+            {
+                emit transferError();
+                reset();
+                return;
+            }
+            compressor = new BlockCompressor(reply.options.value("level", "1").toInt());
+        }
 
-            if (!file->atEnd()) {
-                QByteArray chunk = file->read(Config::getBufferSize());
-                bytesSent += chunk.size();
-                emit progressUpdated(static_cast<int>(bytesSent * 100 / file->size()));
-                socket->write(chunk);
-            } else {
-                emit transferFinished();
-                file->close();
-                if (socket && socket->state() != QAbstractSocket::UnconnectedState) {
-                    socket->disconnectFromHost();
-                }
-            } });
+        if (reply.options.value("sparse") == "1")
+        {
+            // Holes are only skipped in plain data on a single connection
+            if (ranged || stripeCount > 1 || deltaBlockSize > 0 || compressor)
+            {
+                emit transferError();
+                reset();
+                return;
+            }
+            sparse = true;
+        }
 
-        QByteArray chunk = file->read(Config::getBufferSize());
-        bytesSent += chunk.size();
-        if (socket->write(chunk) < 1)
+        Multicast::Channel datagramChannel;
+        QByteArray datagramOption = reply.options.value("udp");
+        if (!datagramOption.isEmpty())
         {
-            emit transferError();
+            // Datagrams carry the blocks of a whole file as it is on disk
+            if (ranged || stripeCount > 1 || resumeOffset > 0 || deltaBlockSize > 0 || compressor || sparse ||
+                !DatagramTransport::decodeChannel(datagramOption, &datagramChannel))
+            {
+                emit transferError();
+                reset();
+                return;
+            }
+        }
+
+        QByteArray hash = reply.options.value("hash");
+        if (!hash.isEmpty())
+        {
+            if (hash != StreamHasher::ALGORITHM)
+            {
+                emit transferError();
+                reset();
+                return;
+            }
+
+            // Read back on a pool thread while the data is on its way
+            hasher = new StreamHasher();
+
+            // Checksummed blocks can be sent again when the data is sent as it is on disk
+            qint64 blockSize = reply.options.value("blocks", "0").toLongLong();
+            if (blockSize >= BlockMap::MIN_BLOCK_SIZE && !ranged && !compressor && deltaBlockSize <= 0 &&
+                (fileEnd + blockSize - 1) / blockSize <= BlockMap::MAX_BLOCKS)
+            {
+                repairBlockSize = blockSize;
+                hasher->setBlockSize(blockSize);
+            }
+            hasher->addFileRange(file->fileName(), 0, fileEnd);
+        }
+
+        if (stripeCount > 1)
+            emit stripeCountNegotiated(stripeCount);
+        if (compressor)
+            emit compressionNegotiated(QString::fromUtf8(codec), compressor->level());
+        emit transferAccepted();
+
+        qint64 primaryStart = 0;
+        Protocol::stripeRange(fileEnd, stripeCount, 0, &primaryStart, &sendEnd, stripeWeights);
+        bytesSent = resumeOffset;
+        sendClock.start();
+
+        if (!datagramOption.isEmpty())
+        {
+            startDatagramSend(datagramChannel);
             return;
         }
+
+        if (sparse)
+        {
+            // The map goes before the data, the receiver reads the ranges it lists
+            dataRanges = SparseFile::dataRanges(file->fileName(), resumeOffset, sendEnd);
+            QByteArray map = Protocol::encodeSparseMap(protocolVersion, dataRanges);
+            if (socket->write(map) != map.size())
+            {
+                emit transferError();
+                reset();
+                return;
+            }
+            skipHole();
+        }
+
+        if (deltaBlockSize > 0)
+        {
+            // The signature usually arrives in the same segment as the reply
+            receiveSignature();
+            return;
+        }
+
+        if (stripeCount > 1)
+            openStripes(token);
+
+        // The kernel send path cannot skip holes
+        if (sparse || !startZeroCopySend())
+            startBufferedSend();
     }
-    else if (response == "NO")
+    else if (valid)
     {
         responseTimer->stop(); // Got response
+        TransferTrace::complete("accept wait", "send", acceptWaitStart, metricsId);
+        acceptWaitStart = -1;
+        TransferMetrics::end(metricsId, TransferMetrics::Outcome::Refused);
+        metricsId = 0;
         if (socket && socket->state() != QAbstractSocket::UnconnectedState) {
             socket->disconnectFromHost();
         }
@@ -224,3 +678,756 @@ void Sender::onReadyRead()
         emit transferError();
     }
 }
+
+/**
+ * @brief Starts the regular chunked upload driven by bytesWritten().
+ *
+ * File data comes from a TransferSource chosen per file: small files are
+ * read into one reused buffer, large ones are written straight out of
+ * memory-mapped windows. The socket is refilled up to the adaptive window
+ * whenever its queue drops below the low water mark, so several chunks are
+ * always waiting for the kernel.
+ */
+void Sender::startBufferedSend()
+{
+    source = TransferSource::create(file->fileName(), cached);
+    if (!source->open())
+    {
+        emit transferError();
+        reset();
+        return;
+    }
+
+    connect(socket, &QTcpSocket::bytesWritten, this, [this](qint64 bytes)
+            {
+        if (!file || !file->isOpen() || !socket || !source || primaryDone) return;
+        TransferTrace::Span span("bytesWritten", "send", metricsId, bytes);
+
+        sendWindow.recordWritten(bytes, socket->bytesToWrite());
+        if (bytesSent < sendEnd) {
+            if (socket->bytesToWrite() <= sendWindow.lowWater() && !fillPrimary())
+                emit transferError();
+        } else if (socket->bytesToWrite() == 0) {
+            onPrimaryRangeSent();
+        } });
+
+    if (bytesSent >= sendEnd)
+    {
+        onPrimaryRangeSent();
+        return;
+    }
+
+    if (!fillPrimary())
+    {
+        emit transferError();
+        return;
+    }
+}
+
+/**
+ * @brief Collects the block signature following a delta reply, then starts the delta.
+ */
+void Sender::receiveSignature()
+{
+    signatureData += socket->read(signatureSize - signatureData.size());
+    if (signatureData.size() < signatureSize)
+        return;
+
+    DeltaSync::Signature signature;
+    if (!DeltaSync::Signature::decode(signatureData, deltaBlockSize, deltaBasisSize, &signature))
+    {
+        emit transferError();
+        reset();
+        return;
+    }
+    signatureSize = -1;
+    signatureData.clear();
+
+    deltaEncoder = new DeltaEncoder(file, fileEnd, signature);
+    connect(socket, &QTcpSocket::bytesWritten, this, [this](qint64 bytes)
+            {
+        if (!socket || !deltaEncoder || primaryDone) return;
+        sendWindow.recordWritten(bytes, socket->bytesToWrite());
+        if (socket->bytesToWrite() <= sendWindow.lowWater())
+            fillDelta(); });
+
+    fillDelta();
+}
+
+/**
+ * @brief Queues delta operations up to the window's high water mark.
+ *
+ * Progress follows the scanned part of the file, so blocks the receiver
+ * already has advance it without using the link.
+ */
+void Sender::fillDelta()
+{
+    while (!deltaEncoder->atEnd() && socket->bytesToWrite() < sendWindow.highWater())
+    {
+        if (throttled())
+            return;
+
+        QByteArray out = deltaEncoder->next(BandwidthShaper::step(sendWindow.chunkSize()));
+        if (deltaEncoder->hasError() || (!out.isEmpty() && socket->write(out) != out.size()))
+        {
+            emit transferError();
+            reset();
+            return;
+        }
+
+        BandwidthShaper::consume(receiverAddress, &sessionBucket, out.size());
+        TransferMetrics::addBytes(metricsId, out.size());
+        bytesSent = deltaEncoder->position();
+        emitProgress();
+    }
+
+    if (deltaEncoder->atEnd() && socket->bytesToWrite() == 0)
+    {
+        // qDebug() << "Sender: Delta reused" << deltaEncoder->matchedBytes() << "bytes";
+        onPrimaryRangeSent();
+    }
+}
+
+/**
+ * @brief Queues chunks until the window's high water mark or the range end.
+ *
+ * @return false if nothing could be read or written.
+ */
+bool Sender::fillPrimary()
+{
+    if (windowFull.isValid())
+    {
+        TransferMetrics::addWait(metricsId, TransferMetrics::Wait::Network, windowFull.nsecsElapsed() / 1000);
+        if (TransferTrace::enabled())
+            TransferTrace::complete("window full", "send", TransferTrace::now() - windowFull.nsecsElapsed() / 1000, metricsId);
+        windowFull.invalidate();
+    }
+    if (diskWait.isValid())
+    {
+        TransferMetrics::addWait(metricsId, TransferMetrics::Wait::Disk, diskWait.nsecsElapsed() / 1000);
+        if (TransferTrace::enabled())
+            TransferTrace::complete("read ahead", "send", TransferTrace::now() - diskWait.nsecsElapsed() / 1000, metricsId);
+        diskWait.invalidate();
+    }
+
+    while (bytesSent < sendEnd && socket->bytesToWrite() < sendWindow.highWater())
+    {
+        if (throttled())
+            return true;
+
+        // The socket drains what it holds while the disk catches up
+        if (!source->readyAt(bytesSent, this, [this]() { resumeThrottled(); }))
+        {
+            diskWait.start();
+            return true;
+        }
+        if (!sendNextChunk())
+            return false;
+    }
+
+    // Waiting on the socket from here, until bytesWritten() drains the window
+    if (bytesSent < sendEnd)
+        windowFull.start();
+    return true;
+}
+
+/**
+ * @brief Queues the next chunk from the source on the socket.
+ *
+ * @return false if nothing could be read or written.
+ */
+bool Sender::sendNextChunk()
+{
+    const char *data = nullptr;
+    QElapsedTimer clock;
+    clock.start();
+    qint64 length;
+    {
+        TransferTrace::Span span("read", "send", metricsId);
+        qint64 end = sparse ? dataRanges[dataRange].first + dataRanges[dataRange].second : sendEnd;
+        length = source->readChunk(bytesSent, BandwidthShaper::step(qMin<qint64>(sendWindow.chunkSize(), end - bytesSent)), &data);
+        span.setBytes(length);
+    }
+    TransferMetrics::addWait(metricsId, TransferMetrics::Wait::Disk, clock.nsecsElapsed() / 1000);
+    if (length <= 0)
+        return false;
+
+    bytesSent += length;
+    if (sparse)
+        skipHole();
+    BandwidthShaper::consume(receiverAddress, &sessionBucket, length);
+    TransferMetrics::addBytes(metricsId, length);
+    emitProgress();
+
+    if (compressor)
+    {
+        QByteArray frame = compressor->encode(data, length);
+        TransferTrace::Span span("socket write", "send", metricsId, frame.size());
+        return socket->write(frame) == frame.size();
+    }
+    TransferTrace::Span span("socket write", "send", metricsId, length);
+    return socket->write(data, length) > 0;
+}
+
+/**
+ * @brief Moves past the hole the next byte to send falls in, if any.
+ *
+ * Holes count as sent, so progress advances over them without using the
+ * link. After the last range the primary range is done.
+ */
+void Sender::skipHole()
+{
+    while (dataRange < dataRanges.size() && bytesSent >= dataRanges[dataRange].first + dataRanges[dataRange].second)
+        dataRange++;
+    if (dataRange < dataRanges.size())
+        bytesSent = qMax(bytesSent, dataRanges[dataRange].first);
+    else
+        bytesSent = sendEnd;
+}
+
+/**
+ * @brief Opens the secondary connections of a striped transfer.
+ *
+ * Each connection announces itself with "STRIPE|token|index\n" and then
+ * streams its byte range without waiting for a reply.
+ *
+ * @param token Transfer token handed out by the receiver in its reply
+ */
+void Sender::openStripes(const QByteArray &token)
+{
+    stripeToken = token;
+    for (int index = 1; index < stripeCount; ++index)
+    {
+        Stripe stripe;
+        stripe.index = index;
+        Protocol::stripeRange(fileEnd, stripeCount, index, &stripe.position, &stripe.end, stripeWeights);
+        stripe.start = stripe.position;
+        stripe.source = TransferSource::create(file->fileName(), cached);
+        stripe.window.reset(receiverAddress);
+        stripe.path.remote = connectedAddress;
+        if (index < stripePaths.size())
+            stripe.path = stripePaths[index];
+        stripes.append(stripe);
+        connectStripe(stripes.size() - 1);
+    }
+}
+
+/**
+ * @brief Opens the connection of a secondary stripe over its path.
+ *
+ * A bonded path that fails before the stripe joined, e.g. an interface
+ * that cannot reach the peer's address, is given up for the primary
+ * connection's path.
+ *
+ * @param slot Position of the stripe in the stripes list
+ */
+void Sender::connectStripe(int slot)
+{
+    Stripe &stripe = stripes[slot];
+    stripe.socket = SecureTransport::createSocket(this);
+    QTcpSocket *stripeSocket = stripe.socket;
+
+    SecureTransport::onReady(stripeSocket, this, [this, slot]()
+                             {
+        Stripe &current = stripes[slot];
+        if (!current.source->open()) {
+            emit transferError();
+            reset();
+            return;
+        }
+        if (protocolVersion >= Protocol::VERSION_2)
+            current.socket->write(Protocol::PREAMBLE_V2);
+        current.socket->write(Protocol::encodeStripeJoin(protocolVersion, stripeToken, current.index));
+        current.joined = true;
+        current.clock.start();
+        sendStripeChunk(slot); });
+
+    connect(stripeSocket, &QTcpSocket::bytesWritten, this, [this, slot](qint64 bytes)
+            {
+        if (slot >= stripes.size() || !stripes[slot].socket) return;
+        TransferTrace::Span span("bytesWritten", "send", metricsId, bytes);
+        Stripe &current = stripes[slot];
+        current.window.recordWritten(bytes, current.socket->bytesToWrite());
+        if (current.position >= current.end || current.socket->bytesToWrite() <= current.window.lowWater())
+            sendStripeChunk(slot); });
+
+    connect(stripeSocket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::errorOccurred),
+            this, [this, slot](QAbstractSocket::SocketError)
+            {
+        if (finished || slot >= stripes.size() || stripes[slot].done) return;
+        Stripe &current = stripes[slot];
+        if (!current.joined && !stripePaths.isEmpty() && !(current.path == stripePaths.first()))
+        {
+            // qDebug() << "Sender: Path" << current.path.remote << "failed, using the primary path";
+            current.socket->blockSignals(true);
+            current.socket->deleteLater();
+            current.path = stripePaths.first();
+            connectStripe(slot);
+            return;
+        }
+        emit transferError();
+        reset(); });
+
+    if (!stripe.path.local.isNull())
+        stripeSocket->bind(stripe.path.local);
+    SecureTransport::connectToPeer(stripeSocket, stripe.path.remote, port);
+}
+
+/**
+ * @brief Queues chunks of a secondary stripe up to its window, or marks it complete.
+ *
+ * @param slot Position of the stripe in the stripes list
+ */
+void Sender::sendStripeChunk(int slot)
+{
+    if (slot >= stripes.size())
+        return;
+
+    Stripe &stripe = stripes[slot];
+    if (stripe.done || !stripe.socket)
+        return;
+
+    while (stripe.position < stripe.end && stripe.socket->bytesToWrite() < stripe.window.highWater())
+    {
+        if (throttled())
+            return;
+        if (!stripe.source->readyAt(stripe.position, this, [this]() { resumeThrottled(); }))
+            return;
+
+        const char *data = nullptr;
+        QElapsedTimer clock;
+        clock.start();
+        qint64 length;
+        {
+            TransferTrace::Span span("read", "send", metricsId);
+            length = stripe.source->readChunk(stripe.position,
+                                              BandwidthShaper::step(qMin<qint64>(stripe.window.chunkSize(), stripe.end - stripe.position)), &data);
+            span.setBytes(length);
+        }
+        TransferMetrics::addWait(metricsId, TransferMetrics::Wait::Disk, clock.nsecsElapsed() / 1000);
+        bool written = false;
+        if (length > 0)
+        {
+            TransferTrace::Span span("socket write", "send", metricsId, length);
+            written = stripe.socket->write(data, length) > 0;
+        }
+        if (!written)
+        {
+            emit transferError();
+            reset();
+            return;
+        }
+
+        stripe.position += length;
+        stripeBytesSent += length;
+        BandwidthShaper::consume(receiverAddress, &sessionBucket, length);
+        TransferMetrics::addBytes(metricsId, length);
+    }
+    emitProgress();
+
+    if (stripe.position >= stripe.end && stripe.socket->bytesToWrite() == 0)
+    {
+        // The whole range has left Qt's write buffer
+        stripe.done = true;
+        if (!stripePaths.isEmpty())
+            PathBonding::recordThroughput(stripe.path, stripe.end - stripe.start, stripe.clock.elapsed());
+        finishIfComplete();
+    }
+}
+
+/**
+ * @brief Reports overall progress across the primary and stripe connections.
+ *
+ * Only whole-percent changes are emitted, so a transfer running on a worker
+ * thread posts at most about a hundred progress events to the GUI thread.
+ */
+void Sender::emitProgress()
+{
+    if (!file || fileEnd <= 0)
+        return;
+
+    int percent = static_cast<int>((bytesSent + stripeBytesSent) * 100 / fileEnd);
+    if (percent == lastProgress)
+        return;
+
+    lastProgress = percent;
+    emit sendStatsUpdated(sendWindow.chunkSize(), sendWindow.highWater(), sendWindow.throughput());
+    emit progressUpdated(percent);
+}
+
+/**
+ * @brief Checks the bandwidth caps before the next block is queued.
+ *
+ * @return true if the transfer has to pause; throttleTimer then resumes it
+ */
+bool Sender::throttled()
+{
+    int wait = BandwidthShaper::delay(receiverAddress, &sessionBucket);
+    if (wait <= 0)
+        return false;
+
+    if (!throttleTimer->isActive())
+        throttleTimer->start(wait);
+    return true;
+}
+
+/**
+ * @brief Continues every connection of the transfer paused by a bandwidth cap or a late read.
+ */
+void Sender::resumeThrottled()
+{
+    if (!socket || !file || !file->isOpen() || finished)
+        return;
+
+    if (zeroCopyNotifier)
+        zeroCopyNotifier->setEnabled(true);
+    else if (deltaEncoder && !primaryDone)
+        fillDelta();
+    else if (source && !primaryDone && bytesSent < sendEnd && !fillPrimary())
+        emit transferError();
+
+    for (int slot = 0; slot < stripes.size(); ++slot)
+        sendStripeChunk(slot);
+}
+
+/**
+ * @brief Tries to switch the accepted transfer to the zero-copy kernel path.
+ *
+ * The file descriptor is passed to the kernel (sendfile/TransmitFile) each
+ * time the socket becomes writable, so file data never passes through a
+ * user-space buffer or Qt's write buffer.
+ *
+ * @return false if zero-copy is disabled, unsupported, or the socket still has
+ *         buffered data; the caller then falls back to startBufferedSend().
+ */
+bool Sender::startZeroCopySend()
+{
+    // Compressed frames and encrypted connections have to pass through user space
+    if (!Config::getZeroCopyEnabled() || !ZeroCopy::isSupported() || compressor || SecureTransport::isEncrypted(socket))
+        return false;
+
+    // Qt's own write buffer must be drained, otherwise data would be reordered
+    if (socket->bytesToWrite() > 0 || socket->socketDescriptor() < 0 || file->handle() < 0)
+        return false;
+
+    if (bytesSent >= sendEnd)
+    {
+        onPrimaryRangeSent();
+        return true;
+    }
+
+    zeroCopyNotifier = new QSocketNotifier(socket->socketDescriptor(), QSocketNotifier::Write, this);
+    connect(zeroCopyNotifier, &QSocketNotifier::activated, this, &Sender::onZeroCopyWritable);
+    return true;
+}
+
+/**
+ * @brief Pushes the next part of the file to the kernel when the socket is writable.
+ *
+ * Falls back to the buffered path if the very first kernel send fails (e.g. the
+ * file lives on a filesystem that does not support sendfile).
+ *
+ * @note Emits progressUpdated() after each accepted chunk and transferFinished() at the end.
+ */
+void Sender::onZeroCopyWritable()
+{
+    if (!file || !file->isOpen() || !socket || !zeroCopyNotifier)
+        return;
+
+    if (throttled())
+    {
+        // Writability would fire continuously, resumeThrottled() enables it again
+        zeroCopyNotifier->setEnabled(false);
+        return;
+    }
+
+    // Bound each call so the event loop stays responsive on fast links
+    const qint64 maxChunk = qMax<qint64>(profile.bufferSize, 4 * 1024 * 1024);
+    qint64 sent;
+    {
+        TransferTrace::Span span("sendfile", "send", metricsId);
+        sent = ZeroCopy::sendFileChunk(socket->socketDescriptor(), file->handle(), bytesSent,
+                                       BandwidthShaper::step(qMin(maxChunk, sendEnd - bytesSent)));
+        span.setBytes(sent);
+    }
+
+    if (sent < 0)
+    {
+        zeroCopyNotifier->setEnabled(false);
+        zeroCopyNotifier->deleteLater();
+        zeroCopyNotifier = nullptr;
+
+        if (bytesSent == resumeOffset)
+        {
+            // qDebug() << "Sender: Kernel send unavailable, using buffered send";
+            startBufferedSend();
+            return;
+        }
+        emit transferError();
+        reset();
+        return;
+    }
+
+    if (sent == 0)
+        return; // Socket buffer full, wait for the next notification
+
+    bytesSent += sent;
+    BandwidthShaper::consume(receiverAddress, &sessionBucket, sent);
+    TransferMetrics::addBytes(metricsId, sent);
+    emitProgress();
+
+    if (bytesSent >= sendEnd)
+    {
+        zeroCopyNotifier->setEnabled(false);
+        zeroCopyNotifier->deleteLater();
+        zeroCopyNotifier = nullptr;
+        onPrimaryRangeSent();
+    }
+}
+
+/**
+ * @brief Marks the primary connection's range as fully queued.
+ *
+ * When the receiver verifies the file, the trailer is queued after the range.
+ */
+void Sender::onPrimaryRangeSent()
+{
+    if (!stripePaths.isEmpty() && stripeCount > 1 && !primaryDone)
+        PathBonding::recordThroughput(stripePaths.first(), sendEnd - resumeOffset, sendClock.elapsed());
+
+    if (hasher)
+    {
+        sendTrailer();
+        return;
+    }
+
+    primaryDone = true;
+    finishIfComplete();
+}
+
+/**
+ * @brief Queues the trailer once the hasher is done, then marks the primary range as sent.
+ *
+ * Ranges read back from disk (stripes, zero-copy sends) may still be
+ * hashed on the pool thread; the event loop keeps running meanwhile.
+ */
+void Sender::sendTrailer()
+{
+    // The metrics ID tells a later transfer apart from this one
+    StreamHasher *pending = hasher;
+    quint64 transfer = metricsId;
+    if (!hasher->isFinished(this, [this, pending, transfer]()
+                            {
+        if (hasher == pending && metricsId == transfer)
+            sendTrailer(); }))
+        return;
+
+    if (!writeTrailer())
+    {
+        emit transferError();
+        reset();
+        return;
+    }
+
+    primaryDone = true;
+    finishIfComplete();
+}
+
+/**
+ * @brief Queues the digest of the whole file on the primary connection.
+ *
+ * Called once the hasher is finished, see sendTrailer().
+ *
+ * @return false if the file could not be hashed or the trailer not written
+ */
+bool Sender::writeTrailer()
+{
+    QByteArray digest = hasher->result();
+    QVector<quint32> blockSums = repairBlockSize > 0 ? hasher->blockChecksums() : QVector<quint32>();
+    delete hasher;
+    hasher = nullptr;
+    if (digest.isEmpty())
+        return false;
+
+    // Known for the next transfer of the same file
+    ContentIndex::record(file->fileName(), digest.toHex());
+
+    QByteArray trailer = Protocol::encodeTrailer(protocolVersion, digest, blockSums);
+    return socket->write(trailer) == trailer.size();
+}
+
+/**
+ * @brief Hands the file data to a DatagramSender once the receiver opened its UDP port.
+ *
+ * @param channel Port, token and block size of the receiver's reply
+ */
+void Sender::startDatagramSend(const Multicast::Channel &channel)
+{
+    datagramSender = new DatagramSender(file->fileName(), fileEnd, receiverAddress, channel, this);
+    connect(datagramSender, &DatagramSender::acknowledgedChanged, this, [this](qint64 bytes)
+            {
+        bytesSent = bytes;
+        emitProgress(); });
+    connect(datagramSender, &DatagramSender::roundSent, this, &Sender::endDatagramRound);
+    connect(datagramSender, &DatagramSender::failed, this, [this]()
+            {
+        emit transferError();
+        reset(); });
+
+    if (!datagramSender->start())
+    {
+        emit transferError();
+        reset();
+    }
+}
+
+/**
+ * @brief Asks the receiver which blocks of the round did not arrive.
+ */
+void Sender::endDatagramRound()
+{
+    // Hashed on a pool thread while the first round was sent
+    if (hasher)
+    {
+        StreamHasher *pending = hasher;
+        quint64 transfer = metricsId;
+        if (!hasher->isFinished(this, [this, pending, transfer]()
+                                {
+            if (hasher == pending && metricsId == transfer)
+                endDatagramRound(); }))
+            return;
+        datagramDigest = hasher->result();
+        delete hasher;
+        hasher = nullptr;
+    }
+
+    Protocol::RepairMessage repair;
+    repair.kind = Protocol::RepairMessage::RoundEnd;
+    repair.round = repairRounds;
+    repair.digest = datagramDigest;
+    socket->write(repair.encode(protocolVersion));
+    socket->flush();
+}
+
+/**
+ * @brief Answers the receiver's report of a round: sends the missing blocks again or finishes.
+ */
+void Sender::receiveDatagramRepairs()
+{
+    while (datagramSender)
+    {
+        QByteArray message;
+        Protocol::ReadStatus status = Protocol::readMessage(socket, protocolVersion, &message);
+        if (status == Protocol::ReadStatus::Incomplete)
+            return;
+
+        Protocol::RepairMessage repair;
+        bool valid = (status == Protocol::ReadStatus::Complete && Protocol::RepairMessage::decode(message, &repair) &&
+                      repair.round == repairRounds && repair.kind != Protocol::RepairMessage::RoundEnd);
+        if (valid && repair.kind == Protocol::RepairMessage::Done)
+        {
+            bytesSent = fileEnd;
+            emitProgress();
+            finishSend();
+            return;
+        }
+
+        if (!valid || ++repairRounds > DatagramTransport::MAX_ROUNDS)
+        {
+            emit transferError();
+            reset();
+            return;
+        }
+        datagramSender->resend(repair.ranges);
+    }
+}
+
+/**
+ * @brief Sends again the blocks the receiver found corrupted.
+ *
+ * The receiver lists them in a repair message after the trailer, each block
+ * is read from the file and sent back to back in the order listed.
+ */
+void Sender::resendBlocks()
+{
+    for (;;)
+    {
+        QByteArray message;
+        Protocol::ReadStatus status = Protocol::readMessage(socket, protocolVersion, &message);
+        if (status == Protocol::ReadStatus::Incomplete)
+            return;
+
+        Protocol::RepairMessage request;
+        bool valid = (repairBlockSize > 0 && status == Protocol::ReadStatus::Complete &&
+                      Protocol::RepairMessage::decode(message, &request) &&
+                      request.kind == Protocol::RepairMessage::Missing && ++repairRounds <= BlockMap::MAX_REPAIR_ROUNDS);
+
+        qint64 blockCount = (fileEnd + repairBlockSize - 1) / qMax<qint64>(1, repairBlockSize);
+        for (int i = 0; valid && i < request.ranges.size(); ++i)
+        {
+            const QPair<quint32, quint32> &range = request.ranges[i];
+            for (qint64 index = range.first; valid && index <= range.second; ++index)
+            {
+                qint64 offset = index * repairBlockSize;
+                qint64 length = qMin(repairBlockSize, fileEnd - offset);
+                QByteArray block;
+                valid = index < blockCount && file->seek(offset);
+                if (valid)
+                    block = file->read(length);
+                valid = valid && block.size() == length && socket->write(block) == length;
+            }
+        }
+
+        if (!valid)
+        {
+            emit transferError();
+            reset();
+            return;
+        }
+        // qDebug() << "Sender: Sent blocks again for repair round" << request.round;
+    }
+}
+
+/**
+ * @brief Finishes the transfer once the primary and every stripe are done.
+ */
+void Sender::finishIfComplete()
+{
+    if (!primaryDone || finished)
+        return;
+
+    for (const Stripe &stripe : stripes)
+    {
+        if (!stripe.done)
+            return;
+    }
+
+    // Finished once the receiver verified the file and closed the connection
+    if (repairBlockSize > 0)
+        return;
+    finishSend();
+}
+
+/**
+ * @brief Completes a transfer once all file data has been handed to the sockets.
+ */
+void Sender::finishSend()
+{
+    finished = true;
+    TransferTrace::instant("finish", "send", metricsId);
+    TransferMetrics::end(metricsId, TransferMetrics::Outcome::Finished);
+    metricsId = 0;
+    emit transferFinished();
+    if (source)
+        source->close();
+    if (file)
+        file->close();
+    for (Stripe &stripe : stripes)
+    {
+        if (stripe.socket && stripe.socket->state() != QAbstractSocket::UnconnectedState)
+            stripe.socket->disconnectFromHost();
+    }
+    if (socket && socket->state() != QAbstractSocket::UnconnectedState) {
+        socket->disconnectFromHost();
+    }
+}
@@ -11,8 +11,24 @@
 #include <QFile>
 #include <QHostAddress>
 #include <QTimer>
+#include <QSocketNotifier>
+#include <QList>
+#include <QElapsedTimer>
 
 #include "../config/config.h"
+#include "protocol.h"
+#include "transfersource.h"
+#include "transfermetrics.h"
+#include "transfertrace.h"
+#include "sendwindow.h"
+#include "deltasync.h"
+#include "compression.h"
+#include "streamhasher.h"
+#include "bandwidthshaper.h"
+#include "pathbonding.h"
+#include "datagramtransport.h"
+#include "connectionrace.h"
+#include "transferprofiles.h"
 
 /**
  * @class Sender
@@ -22,23 +38,56 @@
  * It establishes TCP connections to receivers, sends file metadata, waits for
  * acceptance confirmation, and then transfers the file data in chunks while
  * providing progress updates.
+ *
+ * Large files may be striped: when the receiver agrees, the file is split
+ * into byte ranges and each range beyond the first travels on its own
+ * secondary connection.
+ *
+ * A shared file may also be sent in part, from an offset and up to a
+ * length the requester asked for (see setRange()).
  */
 class Sender : public QObject
 {
     Q_OBJECT
 
-    /** Number of bytes sent during current transfer.*/
+    /** File offset reached by the primary connection in the current transfer.*/
     qint64 bytesSent = 0;
 
 public:
     explicit Sender(QObject *parent = nullptr);
     ~Sender();
 
-    void sendFile(const QString &filePath, const QString &receiverIP, quint16 port);
+    void sendFile(const QString &filePath, const QString &receiverIP, quint16 port, int version = Protocol::VERSION_1,
+                  QTcpSocket *connection = nullptr);
+    void sendFileOn(QTcpSocket *connection, const QString &filePath, int version = Protocol::VERSION_1);
+    void setRange(qint64 offset, qint64 length);
+
+    /** @brief Reads the files sent next through ServeCache, for shared files served on request. */
+    void setCached(bool enabled) { cached = enabled; }
+
+    /** @brief Lane of the bandwidth shaper the files sent next move in. */
+    void setPriority(TransferPriority priority)
+    {
+        lane = priority;
+        sessionBucket.setPriority(priority);
+    }
+
+    /** @brief Number of connections the current file is striped over (1 when not striped). */
+    int getStripeCount() const { return stripeCount; }
+
+    /** @brief Current chunk size of the primary connection in bytes. */
+    qint64 getChunkSize() const { return sendWindow.chunkSize(); }
+
+    /** @brief Current limit of queued bytes on the primary connection. */
+    qint64 getSendWindow() const { return sendWindow.highWater(); }
+
+    /** @brief Measured throughput of the primary connection in bytes per second. */
+    qint64 getThroughput() const { return sendWindow.throughput(); }
 
 private slots:
     void onReadyRead();
     void onConnected();
+    void onZeroCopyWritable();
 
 signals:
     /**
@@ -59,13 +108,64 @@ signals:
     /** @brief Signal emitted when an error occurs during transfer. */
     void transferError();
 
+    /**
+     * @brief Signal emitted before transferAccepted() when the file is striped.
+     * @param stripeCount Number of connections agreed with the receiver.
+     */
+    void stripeCountNegotiated(int stripeCount);
+
+    /**
+     * @brief Signal emitted along with progressUpdated() with the send window state.
+     * @param chunkSize Current chunk size in bytes.
+     * @param sendWindow Current limit of queued bytes.
+     * @param throughput Measured throughput in bytes per second.
+     */
+    void sendStatsUpdated(qint64 chunkSize, qint64 sendWindow, qint64 throughput);
+
+    /**
+     * @brief Signal emitted before transferAccepted() when the data is compressed.
+     * @param codec Codec agreed with the receiver.
+     * @param level Compression level agreed with the receiver.
+     */
+    void compressionNegotiated(const QString &codec, int level);
+
 private:
+    /**
+     * @brief One secondary connection carrying a byte range of a striped file.
+     */
+    struct Stripe
+    {
+        QTcpSocket *socket = nullptr;
+        TransferSource *source = nullptr;
+        int index = 0;
+        qint64 start = 0;
+        qint64 position = 0;
+        qint64 end = 0;
+        bool done = false;
+        AdaptiveSendWindow window;
+
+        /** Interface and peer address the connection uses, see PathBonding. */
+        PathBonding::Path path;
+
+        /** Whether the connection sent its join message, it is no longer moved to another path. */
+        bool joined = false;
+
+        /** Started once connected, measures the throughput of the path. */
+        QElapsedTimer clock;
+    };
+
     /** TCP socket for connection to receiver. */
     QTcpSocket *socket;
 
     /** File object for reading data to send. */
     QFile *file;
 
+    /** Read strategy feeding the buffered send path, null until it starts. */
+    TransferSource *source = nullptr;
+
+    /** Chunk size and queue limits of the buffered send path. */
+    AdaptiveSendWindow sendWindow;
+
     /** Port number for connection to receiver. */
     int port;
 
@@ -75,7 +175,164 @@ private:
     /** Timer for response timeout handling. */
     QTimer *responseTimer;
 
+    /** Timer resuming the transfer after a bandwidth cap paused it. */
+    QTimer *throttleTimer;
+
+    /** Rate limit of this transfer, shared by its primary and stripe connections. */
+    TokenBucket sessionBucket;
+
+    /** Lane of the transfer, kept over resets. */
+    TransferPriority lane = TransferPriority::NORMAL;
+
+    /** Write-readiness notifier driving the kernel send path, null when unused. */
+    QSocketNotifier *zeroCopyNotifier = nullptr;
+
+    /** Receiver address, reused for secondary stripe connections. */
+    QString receiverAddress;
+
+    /** Address of the receiver the primary connection went to, one of those it announced. */
+    QString connectedAddress;
+
+    /** Connects to whichever address of the receiver answers first. */
+    ConnectionRace *race;
+
+    /** Settings of the current file, from the receiver's profile when it sent its header. */
+    TransferProfiles::Settings profile;
+
+    /** Wire protocol version used with the receiver. */
+    int protocolVersion = Protocol::VERSION_1;
+
+    /** End offset of the range carried by the primary connection. */
+    qint64 sendEnd = 0;
+
+    /** Offset the receiver asked to continue from, 0 for a full transfer. */
+    qint64 resumeOffset = 0;
+
+    /** File size announced in the header, data past it is not sent even if the file grew. */
+    qint64 fileEnd = 0;
+
+    /** Part of the file to send, set by setRange(); length -1 up to the end. */
+    qint64 rangeOffset = 0;
+    qint64 rangeLength = -1;
+
+    /** Whether file data is read through ServeCache, set by setCached(). */
+    bool cached = false;
+
+    /** Session of the current file in TransferMetrics, 0 when none is open. */
+    quint64 metricsId = 0;
+
+    /** Runs while connecting, for the TCP connect time. */
+    QElapsedTimer connectClock;
+
+    /** Runs from the send window filling up until bytesWritten() lets it refill. */
+    QElapsedTimer windowFull;
+
+    /** Runs from a block read ahead being late until it arrived. */
+    QElapsedTimer diskWait;
+
+    /** TransferTrace::now() the header was sent at, -1 once the reply came. */
+    qint64 acceptWaitStart = -1;
+
+    /** Delta reply parameters, the signature is read after the reply line. */
+    qint64 deltaBlockSize = 0;
+    qint64 deltaBasisSize = 0;
+    qint64 signatureSize = -1;
+    QByteArray signatureData;
+
+    /** Produces the delta stream once the signature arrived, null otherwise. */
+    DeltaEncoder *deltaEncoder = nullptr;
+
+    /** Frames the primary connection's chunks when compression was agreed, null otherwise. */
+    BlockCompressor *compressor = nullptr;
+
+    /** Hashes the file for the trailer when the receiver verifies it, null otherwise. */
+    StreamHasher *hasher = nullptr;
+
+    /**
+     * Size of the blocks listed in the trailer, 0 if the receiver did not ask
+     * for them. The connection then stays open after the trailer until the
+     * receiver closes it, sending again the blocks it reports corrupted.
+     */
+    qint64 repairBlockSize = 0;
+
+    /** Repair requests answered for the current file. */
+    int repairRounds = 0;
+
+    /**
+     * Whether only the data ranges of the file are sent, after a map of them.
+     * dataRange indexes the range bytesSent is in.
+     */
+    bool sparse = false;
+    QList<QPair<qint64, qint64>> dataRanges;
+    int dataRange = 0;
+
+    /**
+     * Sends the file data over UDP when the receiver agreed to it, null
+     * otherwise; the connection then only carries the repair rounds.
+     * The digest is taken once for every round end.
+     */
+    DatagramSender *datagramSender = nullptr;
+    QByteArray datagramDigest;
+
+    /** Negotiated stripe count for the current file. */
+    int stripeCount = 1;
+
+    /**
+     * Path of each stripe and the weights offered for them when bonding,
+     * empty otherwise. The first path is the primary connection's.
+     */
+    QList<PathBonding::Path> stripePaths;
+    QList<int> stripeWeights;
+
+    /** Transfer token the stripe connections present. */
+    QByteArray stripeToken;
+
+    /** Started when the receiver accepted, measures the primary connection's path. */
+    QElapsedTimer sendClock;
+
+    /** Secondary stripe connections (stripe indices 1..stripeCount-1). */
+    QList<Stripe> stripes;
+
+    /** Bytes sent on secondary stripe connections. */
+    qint64 stripeBytesSent = 0;
+
+    /** Whether the primary connection has queued its whole range. */
+    bool primaryDone = false;
+
+    /** Whether transferFinished() was already emitted for the current file. */
+    bool finished = false;
+
+    /** Whether the file goes back on a connection the receiver opened, which cannot be striped. */
+    bool inBand = false;
+
+    /** Last percentage reported, progress is only emitted when it changes. */
+    int lastProgress = -1;
+
     void reset();
+    void connectSocket();
+    void adoptConnection(QTcpSocket *connection);
+    bool startZeroCopySend();
+    void startBufferedSend();
+    void receiveSignature();
+    void fillDelta();
+    bool sendNextChunk();
+    void skipHole();
+    bool fillPrimary();
+    void openStripes(const QByteArray &token);
+    void connectStripe(int slot);
+    void sendStripeChunk(int index);
+    void emitProgress();
+    bool throttled();
+    void resumeThrottled();
+    void onPrimaryRangeSent();
+    void sendTrailer();
+    bool writeTrailer();
+    void resendBlocks();
+    void startDatagramSend(const Multicast::Channel &channel);
+    void endDatagramRound();
+    void receiveDatagramRepairs();
+    void finishIfComplete();
+    void finishSend();
 };
 
 #endif // SENDER_H
@@ -0,0 +1,81 @@
+/**
+ * @file sendwindow.cpp
+ */
+
+#include "sendwindow.h"
+#include "transferprofiles.h"
+
+/**
+ * @brief Constructs a window starting from the configured buffer size.
+ */
+AdaptiveSendWindow::AdaptiveSendWindow()
+{
+    reset();
+}
+
+/**
+ * @brief Restarts the measurements for a new transfer.
+ *
+ * The first chunk is Config::getBufferSize() and four of them may be queued.
+ *
+ * @param peer Address of the receiver whose profile applies, empty for Config alone
+ */
+void AdaptiveSendWindow::reset(const QString &peer)
+{
+    TransferProfiles::Settings settings = TransferProfiles::settings(peer);
+    this->peer = peer;
+    sampleBytes = 0;
+    rate = 0;
+    delayMs = 0;
+    chunk = qBound(MIN_CHUNK, qint64(settings.bufferSize), MAX_CHUNK);
+    window = qBound(MIN_WINDOW, 4 * chunk, qMax(MIN_WINDOW, settings.maxSendWindow));
+    clock.start();
+}
+
+/**
+ * @brief Accounts for bytes handed to the operating system.
+ *
+ * @param bytes Bytes reported by QTcpSocket::bytesWritten()
+ * @param bytesToWrite Bytes still queued in the socket afterwards
+ */
+void AdaptiveSendWindow::recordWritten(qint64 bytes, qint64 bytesToWrite)
+{
+    sampleBytes += bytes;
+
+    qint64 elapsed = clock.elapsed();
+    if (elapsed < SAMPLE_INTERVAL)
+        return;
+
+    double instant = double(sampleBytes) * 1000.0 / double(elapsed);
+    rate = (rate <= 0) ? instant : 0.7 * rate + 0.3 * instant;
+    sampleBytes = 0;
+    clock.restart();
+
+    adapt(bytesToWrite);
+}
+
+/**
+ * @brief Grows or shrinks the window and chunk size from the last sample.
+ *
+ * The window follows the amount of data the link moves during the target
+ * delay, growing by a quarter while the queue drains fast and halving when
+ * the queue backs up.
+ */
+void AdaptiveSendWindow::adapt(qint64 bytesToWrite)
+{
+    if (rate <= 0)
+        return;
+
+    delayMs = qint64(double(bytesToWrite) * 1000.0 / rate);
+    qint64 maxWindow = qMax(MIN_WINDOW, TransferProfiles::settings(peer).maxSendWindow);
+
+    if (delayMs > 2 * TARGET_DELAY)
+        window = window / 2;
+    else if (delayMs < TARGET_DELAY)
+        window = window + window / 4;
+
+    // Never keep much more than the target delay worth of data queued
+    qint64 target = qint64(rate * double(TARGET_DELAY) / 1000.0) * 2;
+    window = qBound(MIN_WINDOW, qMin(window, qMax(MIN_WINDOW, target)), maxWindow);
+    chunk = qBound(MIN_CHUNK, window / 4, MAX_CHUNK);
+}
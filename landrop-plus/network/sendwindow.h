@@ -0,0 +1,79 @@
+/**
+ * @file sendwindow.h
+ * @brief Adaptive chunk size and queue limits for outgoing transfers
+ */
+
+#ifndef SENDWINDOW_H
+#define SENDWINDOW_H
+
+#include <QtGlobal>
+#include <QElapsedTimer>
+#include <QString>
+
+/**
+ * @class AdaptiveSendWindow
+ * @brief Decides how much file data a connection keeps queued in its socket.
+ *
+ * Senders refill the socket once bytesToWrite() drops below lowWater() and
+ * stop at highWater(), so the link never idles while waiting for the event
+ * loop. Throughput is sampled from bytesWritten(); the time the queued bytes
+ * take to drain approximates the round trip through the socket buffers.
+ *
+ * When the queue drains quickly the window grows towards
+ * Config::getMaxSendWindow(). When the peer is slow and the queue delay
+ * grows, the window shrinks, which bounds the memory held for that peer.
+ * A window reset for a peer takes the buffer size and window bound of the
+ * peer's profile instead (see TransferProfiles), the bound again at every
+ * sample so a reloaded profile applies to the running transfer.
+ */
+class AdaptiveSendWindow
+{
+public:
+    AdaptiveSendWindow();
+
+    void reset(const QString &peer = QString());
+    void recordWritten(qint64 bytes, qint64 bytesToWrite);
+
+    /** @brief Size of the next chunk to queue. */
+    qint64 chunkSize() const { return chunk; }
+
+    /** @brief Queued bytes at which the sender stops adding chunks. */
+    qint64 highWater() const { return window; }
+
+    /** @brief Queued bytes below which the sender starts adding chunks again. */
+    qint64 lowWater() const { return window / 2; }
+
+    /** @brief Smoothed throughput in bytes per second (0 before the first sample). */
+    qint64 throughput() const { return qint64(rate); }
+
+    /** @brief Estimated time in milliseconds the queued bytes need to drain. */
+    qint64 queueDelay() const { return delayMs; }
+
+private:
+    /** Bounds of the chunk size. */
+    static constexpr qint64 MIN_CHUNK = 16 * 1024;
+    static constexpr qint64 MAX_CHUNK = 1024 * 1024;
+
+    /** Smallest window, enough to keep a few chunks in flight. */
+    static constexpr qint64 MIN_WINDOW = 64 * 1024;
+
+    /** Interval between throughput samples in milliseconds. */
+    static const qint64 SAMPLE_INTERVAL = 50;
+
+    /** Queue delay the window aims for in milliseconds. */
+    static const qint64 TARGET_DELAY = 20;
+
+    /** Peer whose profile bounds the window, empty for Config */
+    QString peer;
+
+    QElapsedTimer clock;
+    qint64 sampleBytes = 0;
+    double rate = 0;
+    qint64 delayMs = 0;
+    qint64 chunk = 0;
+    qint64 window = 0;
+
+    void adapt(qint64 bytesToWrite);
+};
+
+#endif // SENDWINDOW_H
@@ -0,0 +1,87 @@
+/**
+ * @file servecache.cpp
+ */
+
+#include "servecache.h"
+#include "../config/config.h"
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+
+namespace
+{
+    QMutex cacheMutex;
+
+    /** Cached windows, most recently used first */
+    QList<QSharedPointer<MappedFile::Window>> windows;
+
+    qint64 bytes = 0;
+}
+
+QSharedPointer<MappedFile::Window> ServeCache::window(const QSharedPointer<MappedFile> &mapped, qint64 offset)
+{
+    if (!mapped)
+        return {};
+
+    // Mapped outside the cache lock, a window's destructor takes its file's lock
+    QSharedPointer<MappedFile::Window> found = MappedFile::window(mapped, offset);
+    qint64 limit = Config::getServeCacheSize();
+    if (!found || found->length > limit)
+        return found;
+
+    QList<QSharedPointer<MappedFile::Window>> dropped;
+    {
+        QMutexLocker lock(&cacheMutex);
+        int index = windows.indexOf(found);
+        if (index >= 0)
+        {
+            windows.move(index, 0);
+            return found;
+        }
+
+        // Windows of an older handle of the same file are not asked for anymore
+        for (int i = windows.size() - 1; i >= 0; --i)
+        {
+            const QSharedPointer<MappedFile> &owner = windows[i]->owner;
+            if (owner != mapped && owner->path() == mapped->path())
+            {
+                bytes -= windows[i]->length;
+                dropped.append(windows.takeAt(i));
+            }
+        }
+
+        windows.prepend(found);
+        bytes += found->length;
+        while (bytes > limit)
+        {
+            bytes -= windows.last()->length;
+            dropped.append(windows.takeLast());
+        }
+    }
+
+    // Unmapped here unless a transfer still reads from them
+    dropped.clear();
+    return found;
+}
+
+QSharedPointer<MappedFile::Window> ServeCache::window(const QString &filePath, qint64 offset)
+{
+    return window(MappedFile::acquire(filePath), offset);
+}
+
+qint64 ServeCache::cachedBytes()
+{
+    QMutexLocker lock(&cacheMutex);
+    return bytes;
+}
+
+void ServeCache::clear()
+{
+    QList<QSharedPointer<MappedFile::Window>> dropped;
+    {
+        QMutexLocker lock(&cacheMutex);
+        dropped = windows;
+        windows.clear();
+        bytes = 0;
+    }
+}
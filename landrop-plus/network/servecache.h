@@ -0,0 +1,52 @@
+/**
+ * @file servecache.h
+ * @brief Mappings of the shared files peers download, kept between requests
+ */
+
+#ifndef SERVECACHE_H
+#define SERVECACHE_H
+
+#include "transfersource.h"
+#include <QSharedPointer>
+#include <QString>
+
+/**
+ * @namespace ServeCache
+ * @brief Least recently used windows of the files served to peers.
+ *
+ * MappedFile already lets concurrent readers of a file share its handle and
+ * windows, but drops them with their last reader. Files served on request
+ * are asked for again and again, by many peers and, during a swarm
+ * download, one block at a time, so the windows they were read from are
+ * kept mapped here, and with them the open file, up to
+ * Config::getServeCacheSize() bytes. The least recently used ones are
+ * unmapped beyond that.
+ *
+ * MappedFile::acquire() opens a changed file anew, the windows of its old
+ * handle are dropped as soon as a window of the new one is cached.
+ * Thread-safe.
+ */
+namespace ServeCache
+{
+    /**
+     * @brief Window of @p mapped covering @p offset, kept mapped for later requests.
+     *
+     * @return The window, null if mapping failed
+     */
+    QSharedPointer<MappedFile::Window> window(const QSharedPointer<MappedFile> &mapped, qint64 offset);
+
+    /**
+     * @brief Window of a file covering @p offset, opening the file if it is not cached.
+     *
+     * @return The window, null if the file cannot be opened or mapped
+     */
+    QSharedPointer<MappedFile::Window> window(const QString &filePath, qint64 offset);
+
+    /** @brief Bytes of the windows kept mapped now. */
+    qint64 cachedBytes();
+
+    /** @brief Unmaps every window nobody else is reading from. */
+    void clear();
+}
+
+#endif // SERVECACHE_H
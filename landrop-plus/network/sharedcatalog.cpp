@@ -0,0 +1,222 @@
+/**
+ * @file sharedcatalog.cpp
+ */
+
+#include "sharedcatalog.h"
+#include <QCryptographicHash>
+#include <QJsonDocument>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QtEndian>
+
+namespace
+{
+    /** Entry added, modified or removed by one generation. */
+    struct Change
+    {
+        quint64 generation = 0;
+        QString path;
+
+        /** New entry, a removal marker for removed entries. */
+        QJsonObject entry;
+    };
+
+    /** Version of the catalog at the end of a generation still in the log. */
+    struct Generation
+    {
+        quint64 generation = 0;
+        quint64 version = 0;
+    };
+
+    QMutex catalogMutex;
+    QJsonArray catalogFiles;
+    quint64 catalogVersion = 0;
+    quint64 catalogGeneration = 0;
+
+    /** Digest of each published entry, by path. */
+    QHash<QString, quint64> entryDigests;
+
+    /** Changes in generation order, and the generations they can be applied from. */
+    QList<Change> changeLog;
+    QList<Generation> generations;
+
+    quint64 digestOf(const QJsonObject &entry)
+    {
+        QByteArray digest = QCryptographicHash::hash(QJsonDocument(entry).toJson(QJsonDocument::Compact),
+                                                     QCryptographicHash::Sha1);
+        return qFromBigEndian<quint64>(digest.constData());
+    }
+
+    QJsonObject removalOf(const QString &path)
+    {
+        QJsonObject marker;
+        marker["path"] = path;
+        marker["removed"] = true;
+        return marker;
+    }
+
+    /**
+     * @brief Drops the oldest generations until the log fits LOG_LIMIT.
+     */
+    void trimLog()
+    {
+        while (changeLog.size() > SharedCatalog::LOG_LIMIT && generations.size() > 1)
+        {
+            generations.removeFirst();
+            quint64 oldest = generations.first().generation;
+            while (!changeLog.isEmpty() && changeLog.first().generation <= oldest)
+                changeLog.removeFirst();
+        }
+    }
+
+    /**
+     * @brief Changes since a generation, one per path, the latest winning.
+     */
+    QJsonArray changesSince(quint64 since)
+    {
+        QHash<QString, int> positions;
+        QJsonArray changes;
+        for (const Change &change : changeLog)
+        {
+            if (change.generation <= since)
+                continue;
+            auto it = positions.constFind(change.path);
+            if (it != positions.constEnd())
+            {
+                changes.replace(it.value(), change.entry);
+                continue;
+            }
+            positions.insert(change.path, int(changes.size()));
+            changes.append(change.entry);
+        }
+        return changes;
+    }
+}
+
+void SharedCatalog::publish(const QJsonArray &files)
+{
+    QHash<QString, quint64> digests;
+    quint64 version = 0;
+    for (const QJsonValue &value : files)
+    {
+        QJsonObject entry = value.toObject();
+        quint64 digest = digestOf(entry);
+        digests.insert(entry["path"].toString(), digest);
+        version += digest;
+    }
+    if (!files.isEmpty() && version == 0)
+        version = 1;
+
+    QMutexLocker lock(&catalogMutex);
+    QList<Change> changes;
+    if (catalogGeneration > 0)
+    {
+        for (const QJsonValue &value : files)
+        {
+            QJsonObject entry = value.toObject();
+            QString path = entry["path"].toString();
+            auto known = entryDigests.constFind(path);
+            if (known == entryDigests.constEnd() || known.value() != digests.value(path))
+                changes.append(Change{catalogGeneration + 1, path, entry});
+        }
+        for (auto it = entryDigests.constBegin(); it != entryDigests.constEnd(); ++it)
+        {
+            if (!digests.contains(it.key()))
+                changes.append(Change{catalogGeneration + 1, it.key(), removalOf(it.key())});
+        }
+        if (changes.isEmpty())
+            return;
+    }
+
+    ++catalogGeneration;
+    catalogFiles = files;
+    catalogVersion = version;
+    entryDigests = digests;
+    changeLog.append(changes);
+    generations.append(Generation{catalogGeneration, version});
+    trimLog();
+}
+
+quint64 SharedCatalog::version()
+{
+    QMutexLocker lock(&catalogMutex);
+    return catalogVersion;
+}
+
+quint64 SharedCatalog::generation()
+{
+    QMutexLocker lock(&catalogMutex);
+    return catalogGeneration;
+}
+
+Protocol::CatalogPage SharedCatalog::page(int offset, quint64 sinceGeneration, quint64 baseVersion)
+{
+    QJsonArray entries;
+    Protocol::CatalogPage page;
+    {
+        QMutexLocker lock(&catalogMutex);
+        page.catalogVersion = catalogVersion;
+        page.generation = catalogGeneration;
+
+        // The peer's copy must be the one this log continues
+        for (const Generation &known : generations)
+        {
+            if (sinceGeneration > 0 && known.generation == sinceGeneration && known.version == baseVersion)
+            {
+                page.delta = true;
+                break;
+            }
+        }
+        entries = page.delta ? changesSince(sinceGeneration) : catalogFiles;
+    }
+
+    page.total = int(entries.size());
+    page.offset = qBound(0, offset, page.total);
+
+    QJsonArray slice;
+    for (int i = page.offset; i < page.total && i < page.offset + PAGE_SIZE; ++i)
+        slice.append(entries.at(i));
+    page.data = qCompress(QJsonDocument(slice).toJson(QJsonDocument::Compact));
+    return page;
+}
+
+QJsonArray SharedCatalog::applyDelta(const QJsonArray &files, const QJsonArray &changes)
+{
+    QHash<QString, QJsonObject> changed;
+    for (const QJsonValue &value : changes)
+    {
+        QJsonObject entry = value.toObject();
+        changed.insert(entry["path"].toString(), entry);
+    }
+
+    QJsonArray result;
+    for (const QJsonValue &value : files)
+    {
+        QString path = value.toObject()["path"].toString();
+        auto it = changed.find(path);
+        if (it == changed.end())
+        {
+            result.append(value);
+            continue;
+        }
+        if (!it.value()["removed"].toBool())
+            result.append(it.value());
+        changed.erase(it);
+    }
+    for (const QJsonValue &value : changes)
+    {
+        QJsonObject entry = value.toObject();
+        if (changed.contains(entry["path"].toString()) && !entry["removed"].toBool())
+            result.append(entry);
+    }
+    return result;
+}
+
+quint64 SharedCatalog::versionOf(const QJsonArray &files)
+{
+    quint64 version = 0;
+    for (const QJsonValue &value : files)
+        version += digestOf(value.toObject());
+    return (!files.isEmpty() && version == 0) ? 1 : version;
+}
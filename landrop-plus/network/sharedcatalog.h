@@ -0,0 +1,83 @@
+/**
+ * @file sharedcatalog.h
+ * @brief Catalog of this instance's shared files, served to peers on request
+ */
+
+#ifndef SHAREDCATALOG_H
+#define SHAREDCATALOG_H
+
+#include <QByteArray>
+#include <QJsonArray>
+#include <QJsonObject>
+#include "protocol.h"
+
+/**
+ * @namespace SharedCatalog
+ * @brief Shared files listing advertised by version and fetched in pages.
+ *
+ * Discovery datagrams only carry the version of the catalog; peers that do
+ * not hold that version yet ask for it on the transfer port, one
+ * Protocol::CatalogPage of PAGE_SIZE entries at a time. The catalog is
+ * published by the discovery service after each scan and read by the
+ * receiver threads, so access is synchronized.
+ *
+ * Each publish that changes the listing starts a new generation and logs
+ * the entries added, modified and removed. A peer holding an older
+ * generation gets only the changes since then, as entries and removal
+ * markers ({"path": ..., "removed": true}); when that generation left the
+ * log or the peer's copy differs from it, the whole catalog is sent.
+ *
+ * The version is the sum of per-entry digests, so it does not depend on
+ * the order of the entries and a peer can check the catalog it rebuilt
+ * from changes.
+ */
+namespace SharedCatalog
+{
+    /** Entries sent per page. */
+    const int PAGE_SIZE = 256;
+
+    /** Most entries accepted from a peer. */
+    const int MAX_ENTRIES = 100000;
+
+    /** Most changes kept in the log, older generations are sent in full. */
+    const int LOG_LIMIT = 20000;
+
+    /**
+     * @brief Replaces the catalog served to peers.
+     *
+     * Entries are told apart by their "path".
+     *
+     * @param files Shared files as listed by discovery
+     */
+    void publish(const QJsonArray &files);
+
+    /** @brief Version of the published catalog, 0 when nothing is shared. */
+    quint64 version();
+
+    /** @brief Generation of the published catalog, 0 before the first publish. */
+    quint64 generation();
+
+    /**
+     * @brief Page of the published catalog, or of its changes, starting at @p offset.
+     *
+     * An offset past the end gives an empty page carrying the total.
+     *
+     * @param sinceGeneration Generation the peer holds, 0 for the whole catalog
+     * @param baseVersion Version of the peer's copy of that generation
+     */
+    Protocol::CatalogPage page(int offset, quint64 sinceGeneration = 0, quint64 baseVersion = 0);
+
+    /**
+     * @brief Applies changes received in a delta to a copy of the catalog.
+     *
+     * Modified entries keep their place, added ones are appended.
+     */
+    QJsonArray applyDelta(const QJsonArray &files, const QJsonArray &changes);
+
+    /**
+     * @brief Version identifying a catalog, the same on every peer for the same entries.
+     */
+    quint64 versionOf(const QJsonArray &files);
+}
+
+#endif // SHAREDCATALOG_H
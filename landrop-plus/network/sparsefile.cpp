@@ -0,0 +1,159 @@
+/**
+ * @file sparsefile.cpp
+ */
+
+#include "sparsefile.h"
+#include <QDir>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <winioctl.h>
+#include <io.h>
+#elif defined(Q_OS_UNIX)
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace
+{
+    /**
+     * @brief Merges ranges separated by holes shorter than @p minHole.
+     */
+    QList<SparseFile::Range> coalesce(const QList<SparseFile::Range> &ranges, qint64 minHole)
+    {
+        QList<SparseFile::Range> merged;
+        for (const SparseFile::Range &range : ranges)
+        {
+            if (!merged.isEmpty() && range.first - (merged.last().first + merged.last().second) < minHole)
+                merged.last().second = range.first + range.second - merged.last().first;
+            else
+                merged.append(range);
+        }
+        return merged;
+    }
+
+    /**
+     * @brief Asks the filesystem for the data regions of an open file.
+     *
+     * @return false if it cannot tell
+     */
+    bool queryRanges(QFile &file, qint64 from, qint64 end, QList<SparseFile::Range> *ranges)
+    {
+#if defined(Q_OS_WIN)
+        HANDLE fileHandle = reinterpret_cast<HANDLE>(_get_osfhandle(file.handle()));
+        if (fileHandle == INVALID_HANDLE_VALUE)
+            return false;
+
+        FILE_ALLOCATED_RANGE_BUFFER query;
+        query.FileOffset.QuadPart = from;
+        query.Length.QuadPart = end - from;
+        FILE_ALLOCATED_RANGE_BUFFER found[64];
+        for (;;)
+        {
+            DWORD bytes = 0;
+            BOOL done = DeviceIoControl(fileHandle, FSCTL_QUERY_ALLOCATED_RANGES, &query, sizeof(query), found,
+                                        sizeof(found), &bytes, nullptr);
+            if (!done && GetLastError() != ERROR_MORE_DATA)
+                return false;
+
+            int count = int(bytes / sizeof(found[0]));
+            for (int i = 0; i < count; ++i)
+            {
+                qint64 start = qMax<qint64>(from, found[i].FileOffset.QuadPart);
+                qint64 stop = qMin<qint64>(end, found[i].FileOffset.QuadPart + found[i].Length.QuadPart);
+                if (stop > start)
+                    ranges->append(qMakePair(start, stop - start));
+            }
+            if (done || count == 0)
+                return true;
+
+            qint64 next = found[count - 1].FileOffset.QuadPart + found[count - 1].Length.QuadPart;
+            query.FileOffset.QuadPart = next;
+            query.Length.QuadPart = end - next;
+            if (next >= end)
+                return true;
+        }
+#elif defined(Q_OS_UNIX) && defined(SEEK_DATA) && defined(SEEK_HOLE)
+        int descriptor = file.handle();
+        qint64 position = from;
+        while (position < end)
+        {
+            off_t data = ::lseek(descriptor, static_cast<off_t>(position), SEEK_DATA);
+            if (data < 0)
+                return errno == ENXIO; // No data after position
+            if (data >= end)
+                break;
+
+            off_t hole = ::lseek(descriptor, data, SEEK_HOLE);
+            if (hole < 0)
+                return false;
+            qint64 stop = qMin<qint64>(end, hole);
+            ranges->append(qMakePair(qint64(data), stop - qint64(data)));
+            position = stop;
+        }
+        return true;
+#else
+        Q_UNUSED(file);
+        Q_UNUSED(from);
+        Q_UNUSED(end);
+        Q_UNUSED(ranges);
+        return false;
+#endif
+    }
+}
+
+bool SparseFile::isSparse(const QString &filePath)
+{
+#if defined(Q_OS_WIN)
+    DWORD attributes = GetFileAttributesW(reinterpret_cast<LPCWSTR>(QDir::toNativeSeparators(filePath).utf16()));
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_SPARSE_FILE);
+#elif defined(Q_OS_UNIX)
+    struct stat status;
+    if (::stat(QFile::encodeName(filePath).constData(), &status) != 0)
+        return false;
+    // st_blocks counts 512-byte units whatever the filesystem block size
+    return qint64(status.st_blocks) * 512 + MIN_HOLE <= qint64(status.st_size);
+#else
+    Q_UNUSED(filePath);
+    return false;
+#endif
+}
+
+QList<SparseFile::Range> SparseFile::dataRanges(const QString &filePath, qint64 from, qint64 end)
+{
+    QList<Range> whole;
+    if (end > from)
+        whole.append(qMakePair(from, end - from));
+
+    QFile file(filePath);
+    QList<Range> ranges;
+    if (end <= from || !file.open(QIODevice::ReadOnly) || !queryRanges(file, from, end, &ranges))
+        return whole;
+
+    // Nothing but holes, no data to send
+    if (ranges.isEmpty())
+        return ranges;
+
+    qint64 minHole = MIN_HOLE;
+    ranges = coalesce(ranges, minHole);
+    while (ranges.size() > MAX_RANGES)
+    {
+        minHole *= 2;
+        ranges = coalesce(ranges, minHole);
+    }
+    return ranges;
+}
+
+bool SparseFile::markSparse(QFile &file)
+{
+#if defined(Q_OS_WIN)
+    HANDLE fileHandle = reinterpret_cast<HANDLE>(_get_osfhandle(file.handle()));
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return false;
+    DWORD bytes = 0;
+    return DeviceIoControl(fileHandle, FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &bytes, nullptr) != 0;
+#else
+    return file.handle() >= 0;
+#endif
+}
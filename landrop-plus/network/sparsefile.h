@@ -0,0 +1,67 @@
+/**
+ * @file sparsefile.h
+ * @brief Holes of sparse files, found on the sending side and recreated on the receiving side
+ */
+
+#ifndef SPARSEFILE_H
+#define SPARSEFILE_H
+
+#include <QFile>
+#include <QList>
+#include <QPair>
+#include <QString>
+
+/**
+ * @namespace SparseFile
+ * @brief Finds the regions of a file holding data, so its holes need not be sent.
+ *
+ * VM disk images and database files are often mostly holes: regions the
+ * filesystem has no blocks for that read as zeros. The sender asks the
+ * filesystem where data is (SEEK_DATA/SEEK_HOLE, FSCTL_QUERY_ALLOCATED_RANGES
+ * on Windows), sends that map after the receiver's reply and then only the
+ * bytes of the listed ranges. The receiver writes each range at its offset
+ * and extends the file to its size, leaving the holes unallocated.
+ */
+namespace SparseFile
+{
+    /** Offset and length of a region holding data. */
+    typedef QPair<qint64, qint64> Range;
+
+    /** Holes shorter than this are sent as zeros, merging the ranges around them */
+    const qint64 MIN_HOLE = 64 * 1024;
+
+    /** Most ranges in a map, holes are merged from the shortest up to stay below */
+    const int MAX_RANGES = 16384;
+
+    /**
+     * @brief Whether a file has fewer blocks allocated than its size needs.
+     *
+     * Cheap enough to be asked for every file sent.
+     */
+    bool isSparse(const QString &filePath);
+
+    /**
+     * @brief Regions of a file holding data, within a part of it.
+     *
+     * Ranges are in file order, do not overlap and are separated by holes
+     * of at least MIN_HOLE. Where the filesystem cannot tell, the whole part
+     * is returned as one range.
+     *
+     * @param filePath File to look at
+     * @param from Start of the part
+     * @param end End of the part
+     */
+    QList<Range> dataRanges(const QString &filePath, qint64 from, qint64 end);
+
+    /**
+     * @brief Makes regions of an open file that are never written stay unallocated.
+     *
+     * Needed on Windows, where extending a file that is not marked sparse
+     * allocates and zeroes the new region; files are sparse by default elsewhere.
+     *
+     * @return false if the file could not be marked
+     */
+    bool markSparse(QFile &file);
+}
+
+#endif // SPARSEFILE_H
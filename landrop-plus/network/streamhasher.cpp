@@ -0,0 +1,224 @@
+/**
+ * @file streamhasher.cpp
+ */
+
+#include "streamhasher.h"
+#include "blockmap.h"
+#include "bufferpool.h"
+#include <QFile>
+#include <QMutexLocker>
+#include <QThreadPool>
+
+const QByteArray StreamHasher::ALGORITHM = "blake2b";
+
+StreamHasher::StreamHasher()
+    : hash(QCryptographicHash::Blake2b_256)
+{
+}
+
+/**
+ * @brief Waits for the pool thread to finish with this hasher.
+ *
+ * File ranges not read yet are dropped, so a transfer closed while its
+ * file is hashed does not wait for the whole file.
+ */
+StreamHasher::~StreamHasher()
+{
+    abandoned.storeRelaxed(1);
+    QMutexLocker lock(&mutex);
+    waiter = nullptr;
+    resume = nullptr;
+    while (running)
+        changed.wait(&mutex);
+}
+
+/**
+ * @brief Queues the next block of the stream.
+ *
+ * @param data Block to hash, must not be raw data that is reused afterwards
+ */
+void StreamHasher::addData(const QByteArray &data)
+{
+    Item item;
+    item.data = data;
+    enqueue(item);
+}
+
+/**
+ * @brief Queues a range of a file, read back from disk by the pool thread.
+ *
+ * Used for data that is already on disk or never passed through the
+ * caller, e.g. a resumed prefix, stripe ranges or zero-copy sends.
+ */
+void StreamHasher::addFileRange(const QString &filePath, qint64 offset, qint64 length)
+{
+    if (length <= 0)
+        return;
+
+    Item item;
+    item.filePath = filePath;
+    item.offset = offset;
+    item.length = length;
+    enqueue(item);
+}
+
+/**
+ * @brief Waits until everything queued is hashed.
+ *
+ * @return Raw digest, empty if a file range could not be read
+ */
+QByteArray StreamHasher::result()
+{
+    QMutexLocker lock(&mutex);
+    while (running)
+        changed.wait(&mutex);
+    return failed ? QByteArray() : hash.result();
+}
+
+bool StreamHasher::isFinished(QObject *context, const std::function<void()> &resume)
+{
+    QMutexLocker lock(&mutex);
+    if (!running)
+        return true;
+
+    waiter = context;
+    this->resume = resume;
+    return false;
+}
+
+void StreamHasher::setBlockSize(qint64 size)
+{
+    QMutexLocker lock(&mutex);
+    blockSize = size;
+}
+
+QVector<quint32> StreamHasher::blockChecksums()
+{
+    QMutexLocker lock(&mutex);
+    while (running)
+        changed.wait(&mutex);
+    if (failed)
+        return QVector<quint32>();
+
+    // The last block ends with the stream
+    if (blockFill > 0)
+    {
+        checksums.append(blockSum);
+        blockFill = 0;
+        blockSum = 0;
+    }
+    return checksums;
+}
+
+void StreamHasher::enqueue(const Item &item)
+{
+    QMutexLocker lock(&mutex);
+    while (queuedBytes > MAX_QUEUED)
+        changed.wait(&mutex);
+
+    queue.append(item);
+    queuedBytes += item.data.size();
+    if (!running)
+    {
+        running = true;
+        QThreadPool::globalInstance()->start([this]()
+                                             { run(); });
+    }
+}
+
+/**
+ * @brief Hashes queued items until the queue is empty.
+ */
+void StreamHasher::run()
+{
+    for (;;)
+    {
+        Item item;
+        {
+            QMutexLocker lock(&mutex);
+            if (abandoned.loadRelaxed())
+            {
+                for (const Item &dropped : std::as_const(queue))
+                    queuedBytes -= dropped.data.size();
+                queue.clear();
+            }
+            if (queue.isEmpty())
+            {
+                // Posted with the mutex held: the destructor clears the waiter before it goes away
+                if (waiter)
+                {
+                    QMetaObject::invokeMethod(waiter, resume, Qt::QueuedConnection);
+                    waiter = nullptr;
+                    resume = nullptr;
+                }
+                running = false;
+                changed.wakeAll();
+                return;
+            }
+            item = queue.takeFirst();
+        }
+
+        bool ok = true;
+        if (item.filePath.isEmpty())
+        {
+            consume(item.data);
+        }
+        else
+        {
+            QFile file(item.filePath);
+            ok = file.open(QIODevice::ReadOnly) && file.seek(item.offset);
+            qint64 remaining = item.length;
+            QByteArray block = BufferPool::acquire(READ_BLOCK);
+            while (ok && remaining > 0 && !abandoned.loadRelaxed())
+            {
+                block.resize(int(qMin(remaining, READ_BLOCK)));
+                qint64 bytesRead = file.read(block.data(), block.size());
+                ok = bytesRead > 0;
+                if (ok)
+                {
+                    block.resize(int(bytesRead));
+                    consume(block);
+                }
+                remaining -= bytesRead;
+            }
+            BufferPool::release(block);
+        }
+
+        QMutexLocker lock(&mutex);
+        if (!ok)
+            failed = true;
+        queuedBytes -= item.data.size();
+        changed.wakeAll();
+        lock.unlock();
+
+        // The last holder of a pooled receive buffer gives it back
+        BufferPool::release(item.data);
+    }
+}
+
+/**
+ * @brief Adds data to the digest and to the checksums of the blocks it spans.
+ */
+void StreamHasher::consume(const QByteArray &data)
+{
+    hash.addData(data);
+    if (blockSize <= 0)
+        return;
+
+    const char *bytes = data.constData();
+    qint64 remaining = data.size();
+    while (remaining > 0)
+    {
+        qint64 part = qMin(remaining, blockSize - blockFill);
+        blockSum = BlockMap::checksum(bytes, part, blockSum);
+        blockFill += part;
+        bytes += part;
+        remaining -= part;
+        if (blockFill == blockSize)
+        {
+            checksums.append(blockSum);
+            blockFill = 0;
+            blockSum = 0;
+        }
+    }
+}
@@ -0,0 +1,118 @@
+/**
+ * @file streamhasher.h
+ * @brief End-to-end file hashing running beside the transfer
+ */
+
+#ifndef STREAMHASHER_H
+#define STREAMHASHER_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QWaitCondition>
+#include <functional>
+
+/**
+ * @class StreamHasher
+ * @brief Hashes a stream of data on a pool thread, in the order it was added.
+ *
+ * The connection's thread only queues blocks (implicitly shared, so no
+ * copy is made) or file ranges to read back from disk; hashing itself runs
+ * on QThreadPool::globalInstance(). Queued data is bounded, so a slow
+ * hasher throttles the transfer instead of growing without limit.
+ *
+ * When both peers agree on "hash=blake2b", the sender writes a trailer
+ * (Protocol::encodeTrailer()) after the file data and the receiver compares
+ * it with its own digest before reporting the file as received.
+ *
+ * result() waits for the pool thread. Connections ask isFinished() first,
+ * so a file range read back from disk never stalls their event loop.
+ *
+ * With setBlockSize(), the CRC-32C of every block of the stream is computed
+ * along with the digest, so the blocks that differ can be found when the
+ * digests do not match (see BlockMap).
+ */
+class StreamHasher
+{
+public:
+    StreamHasher();
+    ~StreamHasher();
+
+    void addData(const QByteArray &data);
+    void addFileRange(const QString &filePath, qint64 offset, qint64 length);
+    QByteArray result();
+
+    /**
+     * @brief Whether everything queued is hashed, so result() returns without waiting.
+     *
+     * When it is not, @p resume is called once on the thread of @p context
+     * as soon as the queue ran empty, unless another isFinished() came
+     * first. The hasher has to be deleted before @p context is.
+     */
+    bool isFinished(QObject *context, const std::function<void()> &resume);
+
+    /**
+     * @brief Also checksums the stream in blocks of this size.
+     *
+     * Called before anything is added.
+     */
+    void setBlockSize(qint64 size);
+
+    /**
+     * @brief Waits like result().
+     *
+     * @return CRC-32C of each block of the stream, the last one possibly
+     *         shorter, empty without setBlockSize()
+     */
+    QVector<quint32> blockChecksums();
+
+    /** Name of the hash in headers and replies. */
+    static const QByteArray ALGORITHM;
+
+private:
+    /** Either a block of data or a range of a file to read. */
+    struct Item
+    {
+        QByteArray data;
+        QString filePath;
+        qint64 offset = 0;
+        qint64 length = 0;
+    };
+
+    /** Bytes queued before addData() waits for the hasher. */
+    static const qint64 MAX_QUEUED = 32 * 1024 * 1024;
+
+    /** Bytes read back from disk at once for file ranges. */
+    static constexpr qint64 READ_BLOCK = 1024 * 1024;
+
+    void enqueue(const Item &item);
+    void run();
+    void consume(const QByteArray &data);
+
+    QMutex mutex;
+    QWaitCondition changed;
+    QList<Item> queue;
+    qint64 queuedBytes = 0;
+    bool running = false;
+    bool failed = false;
+    QCryptographicHash hash;
+
+    /** Called back once the queue ran empty, see isFinished() */
+    QObject *waiter = nullptr;
+    std::function<void()> resume;
+
+    /** Set by the destructor, the pool thread then stops reading file ranges */
+    QAtomicInt abandoned;
+
+    qint64 blockSize = 0;
+    qint64 blockFill = 0;
+    quint32 blockSum = 0;
+    QVector<quint32> checksums;
+};
+
+#endif // STREAMHASHER_H
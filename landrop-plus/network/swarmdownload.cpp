@@ -0,0 +1,567 @@
+/**
+ * @file swarmdownload.cpp
+ */
+
+#include "swarmdownload.h"
+#include "protocol.h"
+#include "streamhasher.h"
+#include "contentindex.h"
+#include "resumestate.h"
+#include "../config/config.h"
+#include <QDir>
+#include <QFileInfo>
+
+/**
+ * @brief Constructs an idle download, start() begins it.
+ *
+ * @param parent Parent QObject
+ */
+SwarmDownload::SwarmDownload(QObject *parent)
+    : QObject(parent),
+      stallTimer(new QTimer(this))
+{
+    connect(stallTimer, &QTimer::timeout, this, &SwarmDownload::checkStalls);
+}
+
+SwarmDownload::~SwarmDownload()
+{
+    if (file.isOpen())
+        file.close();
+}
+
+/**
+ * @brief Connects to every source and starts fetching blocks.
+ *
+ * A local file that already holds the contents is cloned instead when
+ * dedup is enabled, and nothing is fetched (see ContentIndex). The blocks
+ * a previous attempt left that still match their checksums are kept.
+ *
+ * @param sources Peers sharing the file
+ * @param fileName Path the file is saved at, relative to the received files folder
+ * @param size Size of the file
+ * @param hash Hex BLAKE2b-256 of the contents the peers advertised
+ */
+void SwarmDownload::start(const QList<Source> &sources, const QString &fileName, qint64 size, const QByteArray &hash)
+{
+    QDir dir(Config::getReceivedFilesPath());
+    QString filePath = QFileInfo(dir.filePath(fileName)).absoluteFilePath();
+    dir.mkpath(QFileInfo(filePath).absolutePath());
+    contentHash = hash.toLower();
+    fileSize = size;
+
+    QString local = Config::getDedupEnabled() ? ContentIndex::find(contentHash, size) : QString();
+    if (!local.isEmpty() && (local == filePath || ContentIndex::cloneFile(local, filePath)))
+    {
+        ended = true;
+        ContentIndex::record(filePath, contentHash);
+        emit progressUpdated(100);
+        emit transferFinished();
+        return;
+    }
+
+    written = Config::getResumeEnabled() ? ResumeState::loadBlocks(filePath, size, contentHash, BLOCK_SIZE)
+                                         : BlockMap(size, BLOCK_SIZE);
+    QIODevice::OpenMode mode = QIODevice::ReadWrite;
+    if (written.heldCount() == 0)
+        mode = QIODevice::ReadWrite | QIODevice::Truncate;
+
+    file.setFileName(filePath);
+    if (sources.isEmpty() || !file.open(mode) || !file.resize(size))
+    {
+        fail();
+        return;
+    }
+
+    int blockCount = written.count();
+    blocks.fill(Missing, blockCount);
+    copies.fill(0, blockCount);
+    for (int block = 0; block < blockCount; ++block)
+    {
+        if (written.isHeld(block))
+            blocks[block] = Done;
+    }
+    blocksDone = written.heldCount();
+    if (blocksDone == blockCount)
+    {
+        finish();
+        return;
+    }
+    if (blocksDone > 0)
+    {
+        lastProgress = int(qint64(blocksDone) * 100 / blockCount);
+        emit progressUpdated(lastProgress);
+    }
+
+    for (const Source &source : sources)
+    {
+        Peer peer;
+        peer.source = source;
+        peer.socket = new QTcpSocket(this);
+        peer.lastActivity.start();
+        peer.bucket.setPriority(lane);
+
+        // Data held back by the shaper stays with the kernel, which slows the peer down
+        peer.socket->setReadBufferSize(2 * BLOCK_SIZE);
+        peers.append(peer);
+    }
+
+    // Connected once the list no longer grows, so the peers stay where they are
+    for (Peer &peer : peers)
+    {
+        QTcpSocket *socket = peer.socket;
+        connect(socket, &QTcpSocket::connected, this, &SwarmDownload::onConnected);
+        connect(socket, &QTcpSocket::readyRead, this, &SwarmDownload::onReadyRead);
+        connect(socket, &QTcpSocket::disconnected, this, &SwarmDownload::onDisconnected);
+        connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::errorOccurred),
+                this, [this, socket](QAbstractSocket::SocketError)
+                {
+            // Errors of a connected socket end in onDisconnected()
+            Peer *peer = peerOf(socket);
+            if (peer && socket->state() != QAbstractSocket::ConnectedState)
+                dropPeer(*peer); });
+        socket->connectToHost(peer.source.ip, peer.source.port);
+    }
+
+    emit sourceCountChanged(peers.size());
+    stallTimer->start(1000);
+}
+
+/**
+ * @brief Finds the peer a socket belongs to.
+ *
+ * @return The peer, null once it was dropped
+ */
+SwarmDownload::Peer *SwarmDownload::peerOf(QObject *socket)
+{
+    for (Peer &peer : peers)
+    {
+        if (peer.socket && peer.socket == socket)
+            return &peer;
+    }
+    return nullptr;
+}
+
+void SwarmDownload::onConnected()
+{
+    Peer *peer = peerOf(sender());
+    if (!peer)
+        return;
+
+    peer->clock.start();
+    peer->lastActivity.restart();
+    requestBlocks(*peer);
+}
+
+/**
+ * @brief Reads the replies and block data a peer sent.
+ *
+ * Each block comes as a reply telling its length and checksum, then the
+ * data, which is written once the whole block arrived and matched. Data of
+ * a block another peer completed first is read and thrown away.
+ */
+void SwarmDownload::onReadyRead()
+{
+    Peer *peer = peerOf(sender());
+    if (!peer)
+        return;
+    peer->lastActivity.restart();
+    readPeer(peer);
+}
+
+/**
+ * @brief Reads what a peer sent as far as the BandwidthShaper allows.
+ */
+void SwarmDownload::readPeer(Peer *peer)
+{
+    while (!ended && peer->socket && peer->socket->bytesAvailable() > 0)
+    {
+        if (peer->requested.isEmpty())
+        {
+            // Nothing was asked for
+            dropPeer(*peer);
+            return;
+        }
+        int block = peer->requested.first();
+
+        if (peer->remaining < 0)
+        {
+            QByteArray message;
+            Protocol::ReadStatus status = Protocol::readMessage(peer->socket, Protocol::VERSION_1, &message);
+            if (status == Protocol::ReadStatus::Incomplete)
+                return;
+
+            Protocol::TransferReply reply;
+            if (status == Protocol::ReadStatus::Malformed || !Protocol::TransferReply::decode(message.trimmed(), &reply) ||
+                !reply.accepted || reply.options.value("length").toLongLong() != blockLength(block))
+            {
+                dropPeer(*peer);
+                return;
+            }
+            peer->remaining = blockLength(block);
+            peer->expectedSum = reply.options.value("crc").toUInt(&peer->hasSum, 16);
+            peer->pending.clear();
+            peer->pending.reserve(int(peer->remaining));
+        }
+
+        int wait = BandwidthShaper::delay(peer->source.ip, &peer->bucket);
+        if (wait > 0)
+        {
+            resumeLater(peer, wait);
+            return;
+        }
+
+        QByteArray data = peer->socket->read(BandwidthShaper::step(qMin<qint64>(peer->remaining, 256 * 1024)));
+        if (data.isEmpty())
+            return;
+        BandwidthShaper::consume(peer->source.ip, &peer->bucket, data.size());
+        peer->pending.append(data);
+        peer->remaining -= data.size();
+        peer->received += data.size();
+
+        if (peer->remaining == 0)
+        {
+            QByteArray content = peer->pending;
+            peer->pending.clear();
+            peer->requested.removeFirst();
+            peer->remaining = -1;
+            copies[block]--;
+
+            quint32 checksum = BlockMap::checksum(content);
+            if (peer->hasSum && checksum != peer->expectedSum)
+            {
+                rejectBlock(*peer, block);
+                if (ended)
+                    return;
+                continue;
+            }
+
+            served = true;
+            if (blocks[block] != Done && !writeBlock(block, content, checksum))
+            {
+                fail();
+                return;
+            }
+            completeBlock(block);
+            if (ended)
+                return;
+            requestBlocks(*peer);
+        }
+    }
+}
+
+/**
+ * @brief Reads a peer again once the shaper lets it, data arriving meanwhile waits in its socket.
+ */
+void SwarmDownload::resumeLater(Peer *peer, int wait)
+{
+    if (peer->paused)
+        return;
+
+    peer->paused = true;
+    QTcpSocket *socket = peer->socket;
+    QTimer::singleShot(wait, this, [this, socket]()
+                       {
+        Peer *peer = peerOf(socket);
+        if (!peer || ended)
+            return;
+        peer->paused = false;
+        peer->lastActivity.restart();
+        readPeer(peer); });
+}
+
+void SwarmDownload::onDisconnected()
+{
+    Peer *peer = peerOf(sender());
+    if (peer)
+        dropPeer(*peer);
+}
+
+/**
+ * @brief Drops the peers that sent nothing for STALL_TIMEOUT_MS while blocks were expected.
+ */
+void SwarmDownload::checkStalls()
+{
+    for (Peer &peer : peers)
+    {
+        bool waiting = !peer.requested.isEmpty() || (peer.socket && peer.socket->state() != QAbstractSocket::ConnectedState);
+        if (peer.socket && waiting && peer.lastActivity.elapsed() > STALL_TIMEOUT_MS)
+            dropPeer(peer);
+        if (ended)
+            return;
+    }
+}
+
+/**
+ * @brief Queues block requests on a peer until its pipeline is full.
+ *
+ * Missing blocks are handed out first, in file order. Once none is left,
+ * the peer duplicates blocks still in flight on other peers.
+ */
+void SwarmDownload::requestBlocks(Peer &peer)
+{
+    if (ended || !peer.socket || peer.socket->state() != QAbstractSocket::ConnectedState)
+        return;
+
+    bool wasIdle = peer.requested.isEmpty();
+    int depth = pipelineDepth(peer);
+    while (peer.requested.size() < depth)
+    {
+        int block = nextBlock(peer, false);
+        if (block < 0)
+            block = nextBlock(peer, true);
+        if (block < 0)
+            break;
+
+        peer.socket->write(Protocol::encodeRangeRequest(Protocol::VERSION_1, peer.source.relativePath, contentHash,
+                                                        block * BLOCK_SIZE, blockLength(block)));
+        blocks[block] = Requested;
+        copies[block]++;
+        peer.requested.append(block);
+    }
+
+    // The stall timeout counts from the first request of an idle peer
+    if (wasIdle && !peer.requested.isEmpty())
+        peer.lastActivity.restart();
+}
+
+/**
+ * @brief Picks the next block for a peer.
+ *
+ * A block the peer sent corrupted is left to the other peers, it only gets
+ * it again when no other peer is left.
+ *
+ * @param endgame Whether to pick among the blocks requested from other
+ *        peers, the one fetched by the fewest, instead of a missing one
+ * @return Block index, -1 if there is none
+ */
+int SwarmDownload::nextBlock(const Peer &peer, bool endgame) const
+{
+    if (!endgame)
+    {
+        int retry = -1;
+        for (int block = 0; block < blocks.size(); ++block)
+        {
+            if (blocks[block] != Missing)
+                continue;
+            if (!peer.failed.contains(block))
+                return block;
+            if (retry < 0)
+                retry = block;
+        }
+
+        for (const Peer &other : peers)
+        {
+            if (other.socket && &other != &peer)
+                return -1;
+        }
+        return retry;
+    }
+
+    int best = -1;
+    for (int block = 0; block < blocks.size(); ++block)
+    {
+        if (blocks[block] != Requested || copies[block] >= ENDGAME_COPIES || peer.requested.contains(block) ||
+            peer.failed.contains(block))
+            continue;
+        if (best < 0 || copies[block] < copies[best])
+            best = block;
+    }
+    return best;
+}
+
+/**
+ * @brief Requests a peer keeps queued, from the rate it delivered at so far.
+ */
+int SwarmDownload::pipelineDepth(const Peer &peer) const
+{
+    qint64 elapsed = peer.clock.isValid() ? peer.clock.elapsed() : 0;
+    if (peer.received == 0 || elapsed <= 0)
+        return 2;
+
+    qint64 rate = peer.received * 1000 / elapsed;
+    qint64 depth = 1 + rate * PIPELINE_TARGET_MS / 1000 / BLOCK_SIZE;
+    return int(qBound<qint64>(1, depth, MAX_PIPELINE));
+}
+
+/**
+ * @brief Writes a verified block, saving the resume state every SAVE_INTERVAL blocks.
+ *
+ * @return false if the block could not be written
+ */
+bool SwarmDownload::writeBlock(int block, const QByteArray &data, quint32 checksum)
+{
+    if (!file.seek(written.blockOffset(block)) || file.write(data) != data.size())
+        return false;
+
+    written.setHeld(block, checksum);
+    if (++unsaved >= SAVE_INTERVAL && Config::getResumeEnabled())
+    {
+        unsaved = 0;
+        file.flush();
+        ResumeState::saveBlocks(file.fileName(), fileSize, contentHash, written);
+    }
+    return true;
+}
+
+/**
+ * @brief Throws away a block that did not match its checksum.
+ *
+ * The block goes back to the other peers; the peer is dropped once it
+ * sent MAX_CORRUPT_BLOCKS corrupted blocks.
+ */
+void SwarmDownload::rejectBlock(Peer &peer, int block)
+{
+    peer.corrupt++;
+    if (!peer.failed.contains(block))
+        peer.failed.append(block);
+    if (blocks[block] == Requested && copies[block] == 0)
+        blocks[block] = Missing;
+
+    if (peer.corrupt >= MAX_CORRUPT_BLOCKS)
+    {
+        dropPeer(peer);
+        return;
+    }
+
+    for (Peer &other : peers)
+        requestBlocks(other);
+}
+
+/**
+ * @brief Marks a block received, finishing the file with the last one.
+ */
+void SwarmDownload::completeBlock(int block)
+{
+    if (blocks[block] == Done)
+        return;
+
+    blocks[block] = Done;
+    blocksDone++;
+    int progress = int(qint64(blocksDone) * 100 / blocks.size());
+    if (progress != lastProgress)
+    {
+        lastProgress = progress;
+        emit progressUpdated(progress);
+    }
+
+    if (blocksDone == blocks.size())
+        finish();
+}
+
+/**
+ * @brief Closes a peer's connection and hands its blocks back to the others.
+ *
+ * The download fails once no peer is left.
+ */
+void SwarmDownload::dropPeer(Peer &peer)
+{
+    if (!peer.socket)
+        return;
+
+    for (int block : peer.requested)
+    {
+        copies[block]--;
+        if (blocks[block] == Requested && copies[block] == 0)
+            blocks[block] = Missing;
+    }
+    peer.requested.clear();
+    peer.remaining = -1;
+    peer.pending.clear();
+
+    QTcpSocket *socket = peer.socket;
+    peer.socket = nullptr;
+    socket->disconnect(this);
+    socket->abort();
+    socket->deleteLater();
+
+    if (ended)
+        return;
+
+    int active = 0;
+    for (const Peer &other : peers)
+        active += other.socket ? 1 : 0;
+    emit sourceCountChanged(active);
+    if (active == 0)
+    {
+        fail();
+        return;
+    }
+
+    for (Peer &other : peers)
+        requestBlocks(other);
+}
+
+/**
+ * @brief Closes the connections and checks the complete file against its hash.
+ */
+void SwarmDownload::finish()
+{
+    ended = true;
+    stallTimer->stop();
+    for (Peer &peer : peers)
+        dropPeer(peer);
+
+    QString filePath = file.fileName();
+    file.close();
+    ResumeState::remove(filePath);
+
+    if (!contentHash.isEmpty())
+    {
+        StreamHasher hasher;
+        hasher.addFileRange(filePath, 0, fileSize);
+        if (hasher.result().toHex() != contentHash)
+        {
+            // The peers did not send the contents they advertised
+            QFile::remove(filePath);
+            emit transferError();
+            return;
+        }
+        ContentIndex::record(filePath, contentHash);
+    }
+
+    emit progressUpdated(100);
+    emit transferFinished();
+}
+
+/**
+ * @brief Gives up, keeping the blocks written for resuming, otherwise removing the partial file.
+ *
+ * Reported as refused if no peer served anything, so the file can still
+ * be downloaded from one of them the usual way.
+ */
+void SwarmDownload::fail()
+{
+    ended = true;
+    stallTimer->stop();
+    for (Peer &peer : peers)
+        dropPeer(peer);
+
+    if (file.isOpen())
+    {
+        if (Config::getResumeEnabled() && !contentHash.isEmpty() && written.heldCount() > 0)
+        {
+            file.flush();
+            ResumeState::saveBlocks(file.fileName(), fileSize, contentHash, written);
+            file.close();
+        }
+        else
+        {
+            file.close();
+            file.remove();
+            ResumeState::remove(file.fileName());
+        }
+    }
+
+    if (served)
+        emit transferError();
+    else
+        emit transferRefused();
+}
+
+/**
+ * @brief Bytes of a block, shorter than BLOCK_SIZE for the last one.
+ */
+qint64 SwarmDownload::blockLength(int block) const
+{
+    return qMin(BLOCK_SIZE, fileSize - block * BLOCK_SIZE);
+}
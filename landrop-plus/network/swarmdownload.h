@@ -0,0 +1,204 @@
+/**
+ * @file swarmdownload.h
+ * @brief Download of one shared file from several peers at once
+ */
+
+#ifndef SWARMDOWNLOAD_H
+#define SWARMDOWNLOAD_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QFile>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QList>
+#include <QVector>
+#include "blockmap.h"
+#include "bandwidthshaper.h"
+
+/**
+ * @class SwarmDownload
+ * @brief Fetches the blocks of a file from every peer sharing the same contents.
+ *
+ * Peers whose catalogs list a file with the same hash and size hold the
+ * same bytes, so each of them is asked for different BLOCK_SIZE ranges
+ * with range requests (see Protocol::encodeRangeRequest()) on a connection
+ * of its own. A peer is given a new block whenever one of its blocks
+ * arrived, and keeps as many requests queued as it delivers in
+ * PIPELINE_TARGET_MS: faster peers end up carrying most of the file, a
+ * slow one never holds more than a block or two.
+ *
+ * Once every block is either received or requested, idle peers request
+ * the blocks still in flight elsewhere as well (endgame), the first copy
+ * to arrive completes the block. A peer that refuses, stalls or
+ * disconnects is dropped and its blocks go back to the others.
+ *
+ * Every block is checked against the CRC-32C its peer sent with it before
+ * it is written; a corrupted block is fetched again, from another peer if
+ * there is one, and a peer sending MAX_CORRUPT_BLOCKS of them is dropped.
+ * The blocks held are saved with ResumeState::saveBlocks(), so a download
+ * that stopped keeps them for the next attempt.
+ *
+ * Blocks are read through the BandwidthShaper in the lane of setPriority(),
+ * so a background download leaves the link to other transfers.
+ *
+ * The file is written in place in the received files folder and checked
+ * against the hash once complete. Lives on a TransferEngine worker thread.
+ */
+class SwarmDownload : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief A peer sharing the file.
+     */
+    struct Source
+    {
+        QString ip;
+        quint16 port = 0;
+
+        /** Path of the file within the peer's shared folder */
+        QString relativePath;
+    };
+
+    explicit SwarmDownload(QObject *parent = nullptr);
+    ~SwarmDownload();
+
+    void start(const QList<Source> &sources, const QString &fileName, qint64 size, const QByteArray &hash);
+
+    /** @brief Sets the lane of the download, before start(); NORMAL unless set. */
+    void setPriority(TransferPriority priority) { lane = priority; }
+
+    /** Length of the ranges requested, the last block of a file may be shorter */
+    static constexpr qint64 BLOCK_SIZE = 1024 * 1024;
+
+    /** Milliseconds of data each peer is kept busy with */
+    static const int PIPELINE_TARGET_MS = 500;
+
+    /** Most requests queued on one peer */
+    static const int MAX_PIPELINE = 8;
+
+    /** Most peers fetching the same block during the endgame */
+    static const int ENDGAME_COPIES = 2;
+
+    /** Milliseconds a peer with requests queued may send nothing before it is dropped */
+    static const int STALL_TIMEOUT_MS = 10000;
+
+    /** Corrupted blocks a peer may send before it is dropped */
+    static const int MAX_CORRUPT_BLOCKS = 3;
+
+    /** Blocks written between two saves of the resume state */
+    static const int SAVE_INTERVAL = 16;
+
+signals:
+    /** Signal emitted as blocks arrive, with the percentage of the file received. */
+    void progressUpdated(int progress);
+
+    /** Signal emitted when the number of peers fetching blocks changes. */
+    void sourceCountChanged(int count);
+
+    /** Signal emitted once the file is complete and matches its hash. */
+    void transferFinished();
+
+    /** Signal emitted when the file could not be completed. */
+    void transferError();
+
+    /** Signal emitted when no peer served any block, they may not support range requests. */
+    void transferRefused();
+
+private slots:
+    void onConnected();
+    void onReadyRead();
+    void onDisconnected();
+    void checkStalls();
+
+private:
+    enum BlockState : quint8
+    {
+        Missing,
+        Requested,
+        Done
+    };
+
+    /**
+     * @brief State of the connection to one source.
+     */
+    struct Peer
+    {
+        Source source;
+        QTcpSocket *socket = nullptr;
+
+        /** Blocks requested and not received yet, in request order */
+        QList<int> requested;
+
+        /** Bytes of the first requested block still to read, -1 until its reply is read */
+        qint64 remaining = -1;
+
+        /** Data of the block being read, written once it is complete and verified */
+        QByteArray pending;
+
+        /** CRC-32C the peer sent for the block being read, if it sent one */
+        quint32 expectedSum = 0;
+        bool hasSum = false;
+
+        /** Corrupted blocks this peer sent, and which ones */
+        int corrupt = 0;
+        QList<int> failed;
+
+        /** Bytes received from this peer, and when its first block was asked for */
+        qint64 received = 0;
+        QElapsedTimer clock;
+
+        /** When this peer last sent anything */
+        QElapsedTimer lastActivity;
+
+        /** Shaping of the connection, and whether reading waits for it */
+        TokenBucket bucket;
+        bool paused = false;
+    };
+
+    Peer *peerOf(QObject *socket);
+    void readPeer(Peer *peer);
+    void resumeLater(Peer *peer, int wait);
+    void requestBlocks(Peer &peer);
+    int nextBlock(const Peer &peer, bool endgame) const;
+    int pipelineDepth(const Peer &peer) const;
+    bool writeBlock(int block, const QByteArray &data, quint32 checksum);
+    void rejectBlock(Peer &peer, int block);
+    void completeBlock(int block);
+    void dropPeer(Peer &peer);
+    void finish();
+    void fail();
+    qint64 blockLength(int block) const;
+
+    QList<Peer> peers;
+    QFile file;
+    QByteArray contentHash;
+    qint64 fileSize = 0;
+
+    QVector<BlockState> blocks;
+
+    /** Peers fetching each block */
+    QVector<quint8> copies;
+
+    /** Blocks written and their checksums, saved for resuming */
+    BlockMap written;
+
+    /** Blocks written since the resume state was last saved */
+    int unsaved = 0;
+
+    int blocksDone = 0;
+    int lastProgress = -1;
+
+    /** Whether any peer served a block */
+    bool served = false;
+    bool ended = false;
+
+    /** Timer dropping peers that stopped sending */
+    QTimer *stallTimer;
+
+    TransferPriority lane = TransferPriority::NORMAL;
+};
+
+#endif // SWARMDOWNLOAD_H
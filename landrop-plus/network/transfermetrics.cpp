@@ -0,0 +1,371 @@
+/**
+ * @file transfermetrics.cpp
+ */
+
+#include "transfermetrics.h"
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <algorithm>
+
+namespace
+{
+    /**
+     * @brief Count per second over the last completed window.
+     */
+    struct RateMeter
+    {
+        qint64 windowStart = 0;
+        qint64 windowCount = 0;
+        qint64 rate = 0;
+
+        void add(qint64 count, qint64 now)
+        {
+            roll(now);
+            windowCount += count;
+        }
+
+        qint64 current(qint64 now)
+        {
+            roll(now);
+            return rate;
+        }
+
+        void roll(qint64 now)
+        {
+            qint64 elapsed = now - windowStart;
+            if (elapsed < TransferMetrics::RATE_WINDOW_MS)
+                return;
+            rate = windowCount * 1000 / elapsed;
+            windowStart = now;
+            windowCount = 0;
+        }
+    };
+
+    struct Session
+    {
+        TransferMetrics::SessionStats stats;
+
+        /** Clock readings in milliseconds, -1 until reached */
+        qint64 begun = 0;
+        qint64 accepted = -1;
+        qint64 firstByte = -1;
+        qint64 ended = -1;
+
+        RateMeter meter;
+    };
+
+    QMutex metricsMutex;
+    QHash<quint64, Session> running;
+
+    /** Ended sessions, newest last */
+    QList<Session> recent;
+
+    quint64 nextId = 1;
+    TransferMetrics::Totals counters;
+    RateMeter sendMeter;
+    RateMeter receiveMeter;
+    RateMeter discoverySendMeter;
+    RateMeter discoveryReceiveMeter;
+
+    /**
+     * @brief Milliseconds of a monotonic clock started with the first call.
+     */
+    qint64 now()
+    {
+        static QElapsedTimer clock;
+        if (!clock.isValid())
+            clock.start();
+        return clock.elapsed();
+    }
+
+    /**
+     * @brief Fills in the figures derived from the clock readings. Called with the mutex held.
+     */
+    TransferMetrics::SessionStats statsOf(Session &session, qint64 at)
+    {
+        TransferMetrics::SessionStats stats = session.stats;
+        qint64 end = session.ended >= 0 ? session.ended : at;
+        stats.durationMs = end - session.begun;
+        if (session.firstByte >= 0)
+        {
+            qint64 moving = end - session.firstByte;
+            stats.averageRate = moving > 0 ? stats.bytes * 1000 / moving : 0;
+        }
+        stats.rate = session.ended >= 0 ? 0 : session.meter.current(at);
+        return stats;
+    }
+
+    QString directionName(TransferMetrics::Direction direction)
+    {
+        return direction == TransferMetrics::Direction::Send ? "send" : "receive";
+    }
+
+    QString outcomeName(TransferMetrics::Outcome outcome)
+    {
+        switch (outcome)
+        {
+        case TransferMetrics::Outcome::Finished:
+            return "finished";
+        case TransferMetrics::Outcome::Failed:
+            return "failed";
+        case TransferMetrics::Outcome::Refused:
+            return "refused";
+        default:
+            return "running";
+        }
+    }
+}
+
+quint64 TransferMetrics::begin(Direction direction, const QString &fileName, const QString &peer, qint64 size)
+{
+    QMutexLocker lock(&metricsMutex);
+    Session session;
+    session.stats.id = nextId++;
+    session.stats.direction = direction;
+    session.stats.fileName = fileName;
+    session.stats.peer = peer;
+    session.stats.size = size;
+    session.stats.started = QDateTime::currentMSecsSinceEpoch();
+    session.begun = now();
+    session.meter.windowStart = session.begun;
+    running.insert(session.stats.id, session);
+    counters.sessionsStarted++;
+    return session.stats.id;
+}
+
+void TransferMetrics::setHandshake(quint64 id, qint64 milliseconds)
+{
+    QMutexLocker lock(&metricsMutex);
+    auto it = running.find(id);
+    if (it != running.end())
+        it->stats.handshakeMs = milliseconds;
+}
+
+void TransferMetrics::accepted(quint64 id)
+{
+    QMutexLocker lock(&metricsMutex);
+    auto it = running.find(id);
+    if (it != running.end() && it->accepted < 0)
+        it->accepted = now();
+}
+
+void TransferMetrics::addBytes(quint64 id, qint64 bytes)
+{
+    if (bytes <= 0)
+        return;
+
+    QMutexLocker lock(&metricsMutex);
+    auto it = running.find(id);
+    if (it == running.end())
+        return;
+
+    qint64 at = now();
+    if (it->firstByte < 0)
+    {
+        it->firstByte = at;
+        it->stats.firstByteMs = at - (it->accepted >= 0 ? it->accepted : it->begun);
+    }
+    it->stats.bytes += bytes;
+    it->meter.add(bytes, at);
+
+    if (it->stats.direction == Direction::Send)
+    {
+        counters.bytesSent += bytes;
+        sendMeter.add(bytes, at);
+    }
+    else
+    {
+        counters.bytesReceived += bytes;
+        receiveMeter.add(bytes, at);
+    }
+}
+
+void TransferMetrics::addWait(quint64 id, Wait wait, qint64 microseconds)
+{
+    if (microseconds <= 0)
+        return;
+
+    QMutexLocker lock(&metricsMutex);
+    auto it = running.find(id);
+    if (it == running.end())
+        return;
+    if (wait == Wait::Network)
+        it->stats.networkWaitUs += microseconds;
+    else
+        it->stats.diskWaitUs += microseconds;
+}
+
+void TransferMetrics::end(quint64 id, Outcome outcome)
+{
+    QMutexLocker lock(&metricsMutex);
+    auto it = running.find(id);
+    if (it == running.end())
+        return;
+
+    Session session = *it;
+    running.erase(it);
+    session.ended = now();
+    session.stats.outcome = outcome;
+    if (outcome == Outcome::Finished)
+        counters.sessionsFinished++;
+    else if (outcome == Outcome::Refused)
+        counters.sessionsRefused++;
+    else
+        counters.sessionsFailed++;
+
+    recent.append(session);
+    while (recent.size() > RECENT_SESSIONS)
+        recent.removeFirst();
+}
+
+void TransferMetrics::countDiscovery(bool incoming)
+{
+    QMutexLocker lock(&metricsMutex);
+    if (incoming)
+    {
+        counters.discoveryReceived++;
+        discoveryReceiveMeter.add(1, now());
+    }
+    else
+    {
+        counters.discoverySent++;
+        discoverySendMeter.add(1, now());
+    }
+}
+
+void TransferMetrics::setQueueDepth(const QString &name, qint64 depth)
+{
+    QMutexLocker lock(&metricsMutex);
+    counters.queueDepths.insert(name, depth);
+}
+
+void TransferMetrics::setStartupPhase(const QString &phase, qint64 milliseconds)
+{
+    QMutexLocker lock(&metricsMutex);
+    for (QPair<QString, qint64> &entry : counters.startupPhases)
+    {
+        if (entry.first == phase)
+        {
+            entry.second = milliseconds;
+            return;
+        }
+    }
+    counters.startupPhases.append(qMakePair(phase, milliseconds));
+}
+
+QList<TransferMetrics::SessionStats> TransferMetrics::sessions()
+{
+    QMutexLocker lock(&metricsMutex);
+    qint64 at = now();
+    QList<SessionStats> list;
+    for (Session &session : running)
+        list.append(statsOf(session, at));
+    std::sort(list.begin(), list.end(), [](const SessionStats &a, const SessionStats &b)
+              { return a.id > b.id; });
+    for (int i = recent.size() - 1; i >= 0; --i)
+        list.append(statsOf(recent[i], at));
+    return list;
+}
+
+TransferMetrics::Totals TransferMetrics::totals()
+{
+    QMutexLocker lock(&metricsMutex);
+    qint64 at = now();
+    Totals result = counters;
+    result.sendRate = sendMeter.current(at);
+    result.receiveRate = receiveMeter.current(at);
+    result.discoverySendRate = discoverySendMeter.current(at);
+    result.discoveryReceiveRate = discoveryReceiveMeter.current(at);
+    return result;
+}
+
+QJsonObject TransferMetrics::snapshotJson()
+{
+    Totals all = totals();
+    QJsonObject global;
+    global["bytesSent"] = all.bytesSent;
+    global["bytesReceived"] = all.bytesReceived;
+    global["sendRate"] = all.sendRate;
+    global["receiveRate"] = all.receiveRate;
+    global["sessionsStarted"] = all.sessionsStarted;
+    global["sessionsFinished"] = all.sessionsFinished;
+    global["sessionsFailed"] = all.sessionsFailed;
+    global["sessionsRefused"] = all.sessionsRefused;
+
+    QJsonObject discovery;
+    discovery["sent"] = all.discoverySent;
+    discovery["received"] = all.discoveryReceived;
+    discovery["sendRate"] = all.discoverySendRate;
+    discovery["receiveRate"] = all.discoveryReceiveRate;
+
+    QJsonObject queues;
+    for (auto it = all.queueDepths.constBegin(); it != all.queueDepths.constEnd(); ++it)
+        queues[it.key()] = it.value();
+
+    QJsonArray startup;
+    for (const QPair<QString, qint64> &entry : all.startupPhases)
+    {
+        QJsonObject phase;
+        phase["phase"] = entry.first;
+        phase["ms"] = entry.second;
+        startup.append(phase);
+    }
+
+    QJsonArray list;
+    for (const SessionStats &stats : sessions())
+    {
+        QJsonObject session;
+        session["id"] = qint64(stats.id);
+        session["direction"] = directionName(stats.direction);
+        session["file"] = stats.fileName;
+        session["peer"] = stats.peer;
+        session["size"] = stats.size;
+        session["bytes"] = stats.bytes;
+        session["started"] = stats.started;
+        session["durationMs"] = stats.durationMs;
+        session["handshakeMs"] = stats.handshakeMs;
+        session["firstByteMs"] = stats.firstByteMs;
+        session["networkWaitMs"] = stats.networkWaitUs / 1000.0;
+        session["diskWaitMs"] = stats.diskWaitUs / 1000.0;
+        session["rate"] = stats.rate;
+        session["averageRate"] = stats.averageRate;
+        session["state"] = outcomeName(stats.outcome);
+        list.append(session);
+    }
+
+    QJsonObject snapshot;
+    snapshot["time"] = QDateTime::currentMSecsSinceEpoch();
+    snapshot["totals"] = global;
+    snapshot["discovery"] = discovery;
+    snapshot["queues"] = queues;
+    snapshot["startup"] = startup;
+    snapshot["sessions"] = list;
+    return snapshot;
+}
+
+bool TransferMetrics::writeJson(const QString &filePath)
+{
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    file.write(QJsonDocument(snapshotJson()).toJson(QJsonDocument::Indented));
+    return file.commit();
+}
+
+void TransferMetrics::reset()
+{
+    QMutexLocker lock(&metricsMutex);
+    running.clear();
+    recent.clear();
+    counters = Totals();
+    sendMeter = RateMeter();
+    receiveMeter = RateMeter();
+    discoverySendMeter = RateMeter();
+    discoveryReceiveMeter = RateMeter();
+}
@@ -0,0 +1,186 @@
+/**
+ * @file transfermetrics.h
+ * @brief Counters and timings of transfers, for the stats panel and monitoring
+ */
+
+#ifndef TRANSFERMETRICS_H
+#define TRANSFERMETRICS_H
+
+#include <QJsonObject>
+#include <QList>
+#include <QMap>
+#include <QPair>
+#include <QString>
+
+/**
+ * @namespace TransferMetrics
+ * @brief What the transfers of this process did, and where they waited.
+ *
+ * Every file sent or received is a session, opened with begin() by the
+ * Sender or Receiver moving its data and closed with end(). Sessions count
+ * their bytes, the TCP connect time (sender side), the time from acceptance
+ * to the first data byte, and the time the data path spent waiting, on the
+ * socket's bytesWritten() for a full send window or on the disk for a read
+ * or write. Throughput is measured over the last RATE_WINDOW_MS and on
+ * average since the first byte.
+ *
+ * Global totals add up every session, the discovery datagrams sent and
+ * received, the queue depths the services publish with setQueueDepth(),
+ * and how long each phase of the application startup took, recorded with
+ * setStartupPhase(). snapshotJson() returns all of it as one object,
+ * writeJson() saves it for monitoring tools.
+ *
+ * Session 0 stands for "not tracked", every call ignores it. Thread-safe,
+ * called from the transfer worker threads.
+ */
+namespace TransferMetrics
+{
+    enum class Direction
+    {
+        Send,
+        Receive
+    };
+
+    /** What the data path waited on. */
+    enum class Wait
+    {
+        Network,
+        Disk
+    };
+
+    enum class Outcome
+    {
+        Running,
+        Finished,
+        Failed,
+        Refused
+    };
+
+    /** Throughput is measured over windows of this many milliseconds. */
+    const qint64 RATE_WINDOW_MS = 1000;
+
+    /** Ended sessions kept for display, the oldest are forgotten. */
+    const int RECENT_SESSIONS = 32;
+
+    /** What is known about one session. */
+    struct SessionStats
+    {
+        quint64 id = 0;
+        Direction direction = Direction::Send;
+        QString fileName;
+
+        /** Address of the other side */
+        QString peer;
+
+        /** Bytes the session is expected to carry, 0 when unknown */
+        qint64 size = 0;
+
+        /** Data bytes moved so far */
+        qint64 bytes = 0;
+
+        /** Milliseconds since the epoch the session began at */
+        qint64 started = 0;
+
+        /** Milliseconds the session ran, until now while running */
+        qint64 durationMs = 0;
+
+        /** Milliseconds the TCP connection took to open, -1 when not measured */
+        qint64 handshakeMs = -1;
+
+        /** Milliseconds from acceptance to the first data byte, -1 before it */
+        qint64 firstByteMs = -1;
+
+        /** Microseconds spent waiting on the socket and on the disk */
+        qint64 networkWaitUs = 0;
+        qint64 diskWaitUs = 0;
+
+        /** Bytes per second over the last window, and since the first byte */
+        qint64 rate = 0;
+        qint64 averageRate = 0;
+
+        Outcome outcome = Outcome::Running;
+    };
+
+    /** Counters of every session and of discovery. */
+    struct Totals
+    {
+        qint64 bytesSent = 0;
+        qint64 bytesReceived = 0;
+
+        /** Bytes per second over the last window */
+        qint64 sendRate = 0;
+        qint64 receiveRate = 0;
+
+        int sessionsStarted = 0;
+        int sessionsFinished = 0;
+        int sessionsFailed = 0;
+        int sessionsRefused = 0;
+
+        /** Discovery datagrams, and datagrams per second over the last window */
+        qint64 discoverySent = 0;
+        qint64 discoveryReceived = 0;
+        qint64 discoverySendRate = 0;
+        qint64 discoveryReceiveRate = 0;
+
+        /** Latest depth of each published queue, by name */
+        QMap<QString, qint64> queueDepths;
+
+        /** Milliseconds each startup phase took, in the order they completed */
+        QList<QPair<QString, qint64>> startupPhases;
+    };
+
+    /**
+     * @brief Opens a session.
+     *
+     * @param direction Whether this side sends or receives the data
+     * @param fileName Name of the file carried
+     * @param peer Address of the other side
+     * @param size Bytes expected, 0 when unknown
+     * @return Identifier of the session, never 0
+     */
+    quint64 begin(Direction direction, const QString &fileName, const QString &peer, qint64 size);
+
+    /** @brief Records how long the connection of a session took to open. */
+    void setHandshake(quint64 id, qint64 milliseconds);
+
+    /** @brief Marks the transfer accepted, the time to first byte counts from here. */
+    void accepted(quint64 id);
+
+    /** @brief Counts data bytes a session moved. */
+    void addBytes(quint64 id, qint64 bytes);
+
+    /** @brief Adds time a session's data path waited. */
+    void addWait(quint64 id, Wait wait, qint64 microseconds);
+
+    /** @brief Closes a session; calls after the first one are ignored. */
+    void end(quint64 id, Outcome outcome);
+
+    /** @brief Counts one discovery datagram. */
+    void countDiscovery(bool incoming);
+
+    /** @brief Publishes the current depth of a queue. */
+    void setQueueDepth(const QString &name, qint64 depth);
+
+    /** @brief Records how long a startup phase took, replacing an earlier record of it. */
+    void setStartupPhase(const QString &phase, qint64 milliseconds);
+
+    /** @brief Running sessions, then the RECENT_SESSIONS last ended ones, newest first. */
+    QList<SessionStats> sessions();
+
+    Totals totals();
+
+    /** @brief Totals and sessions as one JSON object. */
+    QJsonObject snapshotJson();
+
+    /**
+     * @brief Replaces the file at @p filePath with snapshotJson().
+     *
+     * @return false if the file could not be written
+     */
+    bool writeJson(const QString &filePath);
+
+    /** @brief Forgets every session and counter. */
+    void reset();
+}
+
+#endif // TRANSFERMETRICS_H
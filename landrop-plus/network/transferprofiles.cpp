@@ -0,0 +1,243 @@
+/**
+ * @file transferprofiles.cpp
+ */
+
+#include "transferprofiles.h"
+#include "../config/config.h"
+#include <QAtomicInteger>
+#include <QFile>
+#include <QHash>
+#include <QHostAddress>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPair>
+
+namespace
+{
+    /** Subnet of the peers an assignment covers, an address is a full-length subnet. */
+    struct Assignment
+    {
+        QHostAddress subnet;
+        int prefixLength = 0;
+        int profile = -1;
+    };
+
+    QMutex profilesMutex;
+    QList<TransferProfiles::Profile> profiles;
+    QList<Assignment> assignments;
+    int defaultProfile = -1;
+
+    /** Whether a profile caps a rate, read without the mutex by every block */
+    QAtomicInteger<int> rateCaps;
+
+    /** Profile number of each peer seen since the last load, -1 for none */
+    QHash<QString, int> profileOfPeer;
+
+    /**
+     * @brief IPv4 peers seen as IPv4-mapped IPv6 match their IPv4 subnets.
+     */
+    QHostAddress addressOf(const QString &peer)
+    {
+        QHostAddress address(peer);
+        bool isIPv4 = false;
+        quint32 ipv4 = address.toIPv4Address(&isIPv4);
+        return isIPv4 ? QHostAddress(ipv4) : address;
+    }
+
+    bool parseAssignment(const QString &peer, Assignment *assignment)
+    {
+        if (peer.contains('/'))
+        {
+            QPair<QHostAddress, int> subnet = QHostAddress::parseSubnet(peer);
+            assignment->subnet = subnet.first;
+            assignment->prefixLength = subnet.second;
+        }
+        else
+        {
+            assignment->subnet = addressOf(peer);
+            assignment->prefixLength = assignment->subnet.protocol() == QAbstractSocket::IPv6Protocol ? 128 : 32;
+        }
+        return !assignment->subnet.isNull();
+    }
+
+    qint64 sizeOf(const QJsonObject &object, const char *key)
+    {
+        // Doubles hold every size below 2^53 exactly
+        return object.contains(key) ? qint64(object.value(key).toDouble(-1)) : -1;
+    }
+
+    TransferProfiles::Profile parseProfile(const QString &name, const QJsonObject &object)
+    {
+        TransferProfiles::Profile profile;
+        profile.name = name;
+
+        qint64 bufferSize = sizeOf(object, "bufferSize");
+        if (bufferSize > 0)
+            profile.bufferSize = int(qMin<qint64>(bufferSize, 64 * 1024 * 1024));
+        qint64 window = sizeOf(object, "maxSendWindow");
+        if (window >= 0)
+            profile.maxSendWindow = qMax<qint64>(64 * 1024, window);
+        qint64 stripes = sizeOf(object, "stripes");
+        if (stripes >= 0)
+            profile.stripeCount = int(qBound<qint64>(1, stripes, 16));
+        if (object.value("compression").isBool())
+            profile.compression = object.value("compression").toBool() ? 1 : 0;
+        qint64 level = sizeOf(object, "compressionLevel");
+        if (level >= 0)
+            profile.compressionLevel = int(qBound<qint64>(1, level, 9));
+        profile.peerRateLimit = sizeOf(object, "peerRateLimit");
+        profile.sessionRateLimit = sizeOf(object, "sessionRateLimit");
+        qint64 durability = sizeOf(object, "durability");
+        if (durability >= 0)
+            profile.durability = int(qBound<qint64>(0, durability, 2));
+        return profile;
+    }
+
+    /**
+     * @brief Number of the profile a peer takes, -1 for none. Called with profilesMutex held.
+     */
+    int profileFor(const QString &peer)
+    {
+        auto cached = profileOfPeer.constFind(peer);
+        if (cached != profileOfPeer.constEnd())
+            return *cached;
+
+        int number = defaultProfile;
+        QHostAddress address = addressOf(peer);
+        for (const Assignment &assignment : assignments)
+        {
+            if (!address.isNull() && address.isInSubnet(assignment.subnet, assignment.prefixLength))
+            {
+                number = assignment.profile;
+                break;
+            }
+        }
+        profileOfPeer.insert(peer, number);
+        return number;
+    }
+}
+
+bool TransferProfiles::load(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.exists())
+    {
+        clear();
+        return true;
+    }
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QJsonParseError error;
+    QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &error);
+    if (error.error != QJsonParseError::NoError || !document.isObject())
+        return false;
+    QJsonObject root = document.object();
+
+    QList<Profile> loadedProfiles;
+    QHash<QString, int> numbers;
+    bool caps = false;
+    const QJsonObject profileObjects = root.value("profiles").toObject();
+    for (auto it = profileObjects.constBegin(); it != profileObjects.constEnd(); ++it)
+    {
+        if (!it.value().isObject())
+            return false;
+        Profile profile = parseProfile(it.key(), it.value().toObject());
+        caps = caps || profile.peerRateLimit > 0 || profile.sessionRateLimit > 0;
+        numbers.insert(profile.name, loadedProfiles.size());
+        loadedProfiles.append(profile);
+    }
+
+    QList<Assignment> loadedAssignments;
+    for (const QJsonValue &value : root.value("assignments").toArray())
+    {
+        QJsonObject object = value.toObject();
+        Assignment assignment;
+        assignment.profile = numbers.value(object.value("profile").toString(), -1);
+        if (assignment.profile < 0 || !parseAssignment(object.value("peer").toString().trimmed(), &assignment))
+            return false;
+        loadedAssignments.append(assignment);
+    }
+
+    QString defaultName = root.value("default").toString();
+    int loadedDefault = numbers.value(defaultName, -1);
+    if (!defaultName.isEmpty() && loadedDefault < 0)
+        return false;
+
+    QMutexLocker lock(&profilesMutex);
+    profiles = loadedProfiles;
+    assignments = loadedAssignments;
+    defaultProfile = loadedDefault;
+    rateCaps.storeRelaxed(caps ? 1 : 0);
+    profileOfPeer.clear();
+    return true;
+}
+
+void TransferProfiles::clear()
+{
+    QMutexLocker lock(&profilesMutex);
+    profiles.clear();
+    assignments.clear();
+    defaultProfile = -1;
+    rateCaps.storeRelaxed(0);
+    profileOfPeer.clear();
+}
+
+TransferProfiles::Settings TransferProfiles::settings(const QString &peer)
+{
+    Settings settings;
+    settings.bufferSize = Config::getBufferSize();
+    settings.maxSendWindow = Config::getMaxSendWindow();
+    settings.stripeCount = Config::getStripeCount();
+    settings.compression = Config::getCompressionEnabled();
+    settings.compressionLevel = Config::getCompressionLevel();
+    settings.peerRateLimit = Config::getPeerRateLimit();
+    settings.sessionRateLimit = Config::getSessionRateLimit();
+    settings.durability = Config::getWriteDurability();
+    if (peer.isEmpty())
+        return settings;
+
+    QMutexLocker lock(&profilesMutex);
+    if (profiles.isEmpty())
+        return settings;
+    int number = profileFor(peer);
+    if (number < 0)
+        return settings;
+
+    const Profile &profile = profiles[number];
+    settings.profile = profile.name;
+    if (profile.bufferSize > 0)
+        settings.bufferSize = profile.bufferSize;
+    if (profile.maxSendWindow >= 0)
+        settings.maxSendWindow = profile.maxSendWindow;
+    if (profile.stripeCount >= 0)
+        settings.stripeCount = profile.stripeCount;
+    if (profile.compression >= 0)
+        settings.compression = profile.compression == 1;
+    if (profile.compressionLevel >= 0)
+        settings.compressionLevel = profile.compressionLevel;
+    if (profile.peerRateLimit >= 0)
+        settings.peerRateLimit = profile.peerRateLimit;
+    if (profile.sessionRateLimit >= 0)
+        settings.sessionRateLimit = profile.sessionRateLimit;
+    if (profile.durability >= 0)
+        settings.durability = profile.durability;
+    return settings;
+}
+
+QList<QString> TransferProfiles::names()
+{
+    QMutexLocker lock(&profilesMutex);
+    QList<QString> list;
+    for (const Profile &profile : profiles)
+        list.append(profile.name);
+    return list;
+}
+
+bool TransferProfiles::limitsRates()
+{
+    return rateCaps.loadRelaxed() != 0;
+}
@@ -0,0 +1,117 @@
+/**
+ * @file transferprofiles.h
+ * @brief Named transfer settings assigned to peers and subnets
+ */
+
+#ifndef TRANSFERPROFILES_H
+#define TRANSFERPROFILES_H
+
+#include <QList>
+#include <QString>
+#include <QtGlobal>
+
+/**
+ * @namespace TransferProfiles
+ * @brief Lets a peer or subnet use other transfer settings than the Config ones.
+ *
+ * Profiles are read from the JSON file at Config::getTransferProfilesPath():
+ *
+ *     {
+ *       "profiles": {
+ *         "wan":  { "bufferSize": 262144, "maxSendWindow": 33554432, "stripes": 1,
+ *                   "compression": true, "compressionLevel": 6,
+ *                   "peerRateLimit": 0, "sessionRateLimit": 10485760, "durability": 2 },
+ *         "lan":  { "stripes": 8, "compression": false }
+ *       },
+ *       "assignments": [
+ *         { "peer": "10.8.0.0/16", "profile": "wan" },
+ *         { "peer": "192.168.1.20", "profile": "lan" }
+ *       ],
+ *       "default": ""
+ *     }
+ *
+ * A peer takes the profile of the first assignment matching its address
+ * (an address or a subnet), else the "default" one, else none. Fields a
+ * profile leaves out keep their Config value, so settings() of a peer
+ * without a profile is Config as it is.
+ *
+ * load() replaces the profiles at once; the transfers running pick them up
+ * without a restart. Rate caps apply from the next block, the send window
+ * from its next sample, chunk size, stripes, compression and durability
+ * from the next file. FileTransferManager reloads the file whenever it
+ * changes. Thread-safe.
+ */
+namespace TransferProfiles
+{
+    /**
+     * @brief Settings of one profile, -1 where it keeps the Config value.
+     */
+    struct Profile
+    {
+        QString name;
+
+        /** First chunk size, see Config::getBufferSize() */
+        int bufferSize = -1;
+
+        /** See Config::getMaxSendWindow() */
+        qint64 maxSendWindow = -1;
+
+        /** See Config::getStripeCount() */
+        int stripeCount = -1;
+
+        /** 1 to offer or accept compression, 0 not to, see Config::getCompressionEnabled() */
+        int compression = -1;
+
+        /** See Config::getCompressionLevel() */
+        int compressionLevel = -1;
+
+        /** See Config::getPeerRateLimit(), 0 for unlimited */
+        qint64 peerRateLimit = -1;
+
+        /** See Config::getSessionRateLimit(), 0 for unlimited */
+        qint64 sessionRateLimit = -1;
+
+        /** See Config::getWriteDurability() */
+        int durability = -1;
+    };
+
+    /**
+     * @brief Settings a transfer with a peer runs with.
+     */
+    struct Settings
+    {
+        /** Profile they come from, empty for Config alone */
+        QString profile;
+
+        int bufferSize = 0;
+        qint64 maxSendWindow = 0;
+        int stripeCount = 1;
+        bool compression = false;
+        int compressionLevel = 1;
+        qint64 peerRateLimit = 0;
+        qint64 sessionRateLimit = 0;
+        int durability = 0;
+    };
+
+    /**
+     * @brief Replaces the profiles and assignments with those of a JSON file.
+     *
+     * @param filePath Profiles file, missing meaning no profiles
+     * @return false if the file exists but is not valid; the profiles loaded before are kept then
+     */
+    bool load(const QString &filePath);
+
+    /** @brief Drops every profile, all peers use Config. */
+    void clear();
+
+    /** @brief Settings for transfers with @p peer, Config for an empty or unassigned one. */
+    Settings settings(const QString &peer);
+
+    /** @brief Names of the profiles loaded. */
+    QList<QString> names();
+
+    /** @brief Whether a profile loaded caps a rate, so the shaper has to run. */
+    bool limitsRates();
+}
+
+#endif // TRANSFERPROFILES_H
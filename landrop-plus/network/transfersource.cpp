@@ -0,0 +1,393 @@
+/**
+ * @file transfersource.cpp
+ */
+
+#include "transfersource.h"
+#include "diskio.h"
+#include "bufferpool.h"
+#include "servecache.h"
+#include "../config/config.h"
+#include <QDateTime>
+#include <QFileInfo>
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QStorageInfo>
+#include <QThreadPool>
+
+QMutex MappedFile::registryMutex;
+QHash<QString, QWeakPointer<MappedFile>> MappedFile::registry;
+
+/**
+ * @brief Picks the read strategy for a file based on its size.
+ *
+ * @param filePath Path of the file to send
+ * @param cached Whether the file is served on request and read through ServeCache
+ * @return A new, unopened source owned by the caller
+ */
+TransferSource *TransferSource::create(const QString &filePath, bool cached)
+{
+    qint64 size = QFileInfo(filePath).size();
+    qint64 threshold = Config::getMappedSourceThreshold();
+    bool remote = onNetworkShare(filePath);
+
+    if (cached && size > 0 && Config::getServeCacheSize() > 0 && !remote)
+        return new MappedFileSource(filePath, true);
+    if (threshold > 0 && size >= threshold && !remote)
+        return new MappedFileSource(filePath);
+    if (size > ReadAheadSource::BLOCK_SIZE)
+        return new ReadAheadSource(filePath);
+    return new FileReadSource(filePath);
+}
+
+bool TransferSource::onNetworkShare(const QString &filePath)
+{
+    QByteArray type = QStorageInfo(filePath).fileSystemType().toLower();
+    return type.startsWith("nfs") || type.startsWith("cifs") || type.startsWith("smb") || type == "9p" ||
+           type.startsWith("fuse.sshfs");
+}
+
+FileReadSource::FileReadSource(const QString &filePath)
+    : file(filePath)
+{
+}
+
+bool FileReadSource::open()
+{
+    return file.isOpen() || file.open(QIODevice::ReadOnly);
+}
+
+void FileReadSource::close()
+{
+    file.close();
+    buffer.clear();
+}
+
+qint64 FileReadSource::size() const
+{
+    return file.size();
+}
+
+qint64 FileReadSource::readChunk(qint64 offset, qint64 maxSize, const char **data)
+{
+    if (!file.isOpen() || offset < 0 || maxSize <= 0)
+        return -1;
+    if (offset >= file.size())
+        return 0;
+    if (file.pos() != offset && !file.seek(offset))
+        return -1;
+
+    if (buffer.size() < maxSize)
+        buffer.resize(maxSize);
+
+    qint64 bytesRead = file.read(buffer.data(), maxSize);
+    *data = buffer.constData();
+    return bytesRead;
+}
+
+ReadAheadSource::ReadAheadSource(const QString &filePath)
+    : path(filePath)
+{
+}
+
+ReadAheadSource::~ReadAheadSource()
+{
+    close();
+}
+
+bool ReadAheadSource::open()
+{
+    if (reads)
+        return true;
+
+    reads = QSharedPointer<Reads>::create();
+    reads->file.setFileName(path);
+    if (!reads->file.open(QIODevice::ReadOnly | QIODevice::Unbuffered))
+    {
+        reads.reset();
+        return false;
+    }
+    fileSize = reads->file.size();
+    depth = qMax(1, Config::getDiskQueueDepth());
+    return true;
+}
+
+/**
+ * @brief Drops the blocks read ahead; running reads finish on their own.
+ */
+void ReadAheadSource::close()
+{
+    current.clear();
+    if (reads)
+    {
+        QMutexLocker lock(&reads->mutex);
+        for (Block &block : reads->blocks)
+            BufferPool::release(block.data);
+        reads->blocks.clear();
+        reads->waiter = nullptr;
+        reads->resume = nullptr;
+    }
+    reads.reset();
+}
+
+qint64 ReadAheadSource::size() const
+{
+    return reads ? fileSize : QFileInfo(path).size();
+}
+
+qint64 ReadAheadSource::readChunk(qint64 offset, qint64 maxSize, const char **data)
+{
+    if (!reads || offset < 0 || maxSize <= 0)
+        return -1;
+    if (offset >= fileSize)
+        return 0;
+
+    current.clear(); // Lets the previous block go back to the pool
+    QMutexLocker lock(&reads->mutex);
+    qint64 start = prepare(offset);
+    while (!reads->blocks[start].done)
+        reads->changed.wait(&reads->mutex);
+
+    const Block &block = reads->blocks[start];
+    if (block.failed)
+        return -1;
+
+    current = block.data;
+    qint64 available = current.size() - (offset - start);
+    if (available <= 0)
+        return 0;
+    *data = current.constData() + (offset - start);
+    return qMin(maxSize, available);
+}
+
+bool ReadAheadSource::readyAt(qint64 offset, QObject *context, const std::function<void()> &resume)
+{
+    if (!reads || offset < 0 || offset >= fileSize)
+        return true;
+
+    QMutexLocker lock(&reads->mutex);
+    qint64 start = prepare(offset);
+    if (reads->blocks[start].done)
+        return true;
+
+    reads->waiter = context;
+    reads->resume = resume;
+    reads->waitedBlock = start;
+    return false;
+}
+
+/**
+ * @brief Drops the blocks no longer needed and queues the ones ahead of @p offset.
+ *
+ * Called with the mutex held.
+ *
+ * @return Start of the block holding @p offset
+ */
+qint64 ReadAheadSource::prepare(qint64 offset)
+{
+    qint64 start = offset - offset % BLOCK_SIZE;
+    qint64 last = start + depth * BLOCK_SIZE;
+
+    // Blocks behind the sender, or out of reach after a jump, are not needed anymore
+    for (auto it = reads->blocks.begin(); it != reads->blocks.end();)
+    {
+        if (it.key() < start || it.key() > last)
+        {
+            BufferPool::release(it->data);
+            it = reads->blocks.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    for (qint64 blockStart = start; blockStart <= last && blockStart < fileSize; blockStart += BLOCK_SIZE)
+    {
+        if (!reads->blocks.contains(blockStart))
+            schedule(blockStart);
+    }
+    return start;
+}
+
+/**
+ * @brief Queues the read of the block at @p start, called with the mutex held.
+ */
+void ReadAheadSource::schedule(qint64 start)
+{
+    reads->blocks.insert(start, Block());
+    QSharedPointer<Reads> shared = reads;
+    qint64 length = qMin(BLOCK_SIZE, fileSize - start);
+    DiskIo::pool()->start([shared, start, length]()
+                          {
+        QByteArray data = BufferPool::acquire(BLOCK_SIZE);
+        qint64 bytesRead = DiskIo::readAt(shared->file.handle(), start, data.data(), length);
+
+        QMutexLocker lock(&shared->mutex);
+        auto it = shared->blocks.find(start);
+        if (it == shared->blocks.end())
+        {
+            // Dropped while it was read
+            BufferPool::release(data);
+            return;
+        }
+        it->done = true;
+        it->failed = bytesRead < 0;
+        if (bytesRead > 0)
+        {
+            data.resize(int(bytesRead));
+            it->data = data;
+        }
+        else
+        {
+            BufferPool::release(data);
+        }
+        shared->changed.wakeAll();
+
+        // Posted with the mutex held: close() clears the waiter before it goes away
+        if (shared->waiter && shared->waitedBlock == start)
+        {
+            QMetaObject::invokeMethod(shared->waiter, shared->resume, Qt::QueuedConnection);
+            shared->waiter = nullptr;
+            shared->resume = nullptr;
+        }
+    });
+}
+
+MappedFile::MappedFile(const QString &filePath)
+    : file(filePath)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    file.close();
+}
+
+MappedFile::Window::~Window()
+{
+    if (owner && address)
+    {
+        QMutexLocker locker(&owner->mutex);
+        owner->file.unmap(address);
+    }
+}
+
+/**
+ * @brief Returns the shared handle for a file, opening it on first use.
+ *
+ * A handle opened before the file changed is not handed out anymore, its
+ * holders keep reading what they started with.
+ *
+ * @param filePath Path of the file to map
+ * @return Shared handle, or null if the file cannot be opened
+ */
+QSharedPointer<MappedFile> MappedFile::acquire(const QString &filePath)
+{
+    QString key = QFileInfo(filePath).canonicalFilePath();
+    if (key.isEmpty())
+        return {};
+
+    QMutexLocker locker(&registryMutex);
+    QSharedPointer<MappedFile> mapped = registry.value(key).toStrongRef();
+    if (mapped && mapped->isCurrent())
+        return mapped;
+
+    // Forget files whose last reader is gone
+    registry.removeIf([](const auto &entry) { return entry.value().isNull(); });
+
+    mapped = QSharedPointer<MappedFile>(new MappedFile(key));
+    if (!mapped->file.open(QIODevice::ReadOnly))
+        return {};
+    mapped->modified = QFileInfo(key).lastModified().toMSecsSinceEpoch();
+
+    registry.insert(key, mapped);
+    return mapped;
+}
+
+/**
+ * @brief Returns the window covering @p offset, mapping it if no one holds it yet.
+ *
+ * @param mapped Shared file handle
+ * @param offset Absolute position inside the file
+ * @return The window, or null if mapping failed
+ */
+QSharedPointer<MappedFile::Window> MappedFile::window(const QSharedPointer<MappedFile> &mapped, qint64 offset)
+{
+    qint64 start = (offset / WINDOW_SIZE) * WINDOW_SIZE;
+
+    QMutexLocker locker(&mapped->mutex);
+    QSharedPointer<Window> existing = mapped->windows.value(start).toStrongRef();
+    if (existing)
+        return existing;
+
+    qint64 length = qMin(WINDOW_SIZE, mapped->file.size() - start);
+    uchar *address = length > 0 ? mapped->file.map(start, length) : nullptr;
+    if (!address)
+        return {};
+
+    QSharedPointer<Window> created(new Window);
+    created->owner = mapped;
+    created->address = address;
+    created->offset = start;
+    created->length = length;
+    mapped->windows.insert(start, created);
+    return created;
+}
+
+qint64 MappedFile::size() const
+{
+    return file.size();
+}
+
+/**
+ * @brief Whether the file on disk still has the size and modification time it was opened with.
+ */
+bool MappedFile::isCurrent() const
+{
+    QFileInfo fileInfo(file.fileName());
+    return fileInfo.size() == file.size() && fileInfo.lastModified().toMSecsSinceEpoch() == modified;
+}
+
+MappedFileSource::MappedFileSource(const QString &filePath, bool cached)
+    : path(filePath),
+      cached(cached)
+{
+}
+
+bool MappedFileSource::open()
+{
+    if (!mapped)
+        mapped = MappedFile::acquire(path);
+    return !mapped.isNull();
+}
+
+void MappedFileSource::close()
+{
+    current.reset();
+    mapped.reset();
+}
+
+qint64 MappedFileSource::size() const
+{
+    return mapped ? mapped->size() : QFileInfo(path).size();
+}
+
+qint64 MappedFileSource::readChunk(qint64 offset, qint64 maxSize, const char **data)
+{
+    if (!mapped || offset < 0 || maxSize <= 0)
+        return -1;
+    if (offset >= mapped->size())
+        return 0;
+
+    if (!current || offset < current->offset || offset >= current->offset + current->length)
+    {
+        current.reset(); // Release before mapping the next window
+        current = cached ? ServeCache::window(mapped, offset) : MappedFile::window(mapped, offset);
+        if (!current)
+            return -1;
+    }
+
+    qint64 available = current->offset + current->length - offset;
+    *data = reinterpret_cast<const char *>(current->address + (offset - current->offset));
+    return qMin(maxSize, available);
+}
@@ -0,0 +1,246 @@
+/**
+ * @file transfersource.h
+ * @brief Read strategies used by Sender to feed outgoing file data
+ */
+
+#ifndef TRANSFERSOURCE_H
+#define TRANSFERSOURCE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QObject>
+#include <QSharedPointer>
+#include <QWaitCondition>
+#include <QWeakPointer>
+#include <QString>
+#include <functional>
+
+/**
+ * @class TransferSource
+ * @brief Abstract provider of file data for an outgoing transfer.
+ *
+ * A source hands out pointers to contiguous file bytes at a given offset.
+ * The returned pointer stays valid until the next readChunk() or close()
+ * call, so callers copy it into the socket immediately.
+ *
+ * readChunk() may wait for the disk. Callers driven by socket events ask
+ * readyAt() first and go back to the event loop while the bytes are read.
+ */
+class TransferSource
+{
+public:
+    virtual ~TransferSource() = default;
+
+    virtual bool open() = 0;
+    virtual void close() = 0;
+    virtual qint64 size() const = 0;
+
+    /**
+     * @brief Returns up to @p maxSize bytes starting at @p offset.
+     * @param offset Absolute position in the file
+     * @param maxSize Upper bound on the returned length
+     * @param data Receives a pointer to the bytes
+     * @return Number of bytes available at @p data, 0 at end of file, -1 on error
+     */
+    virtual qint64 readChunk(qint64 offset, qint64 maxSize, const char **data) = 0;
+
+    /**
+     * @brief Whether readChunk() at @p offset returns without waiting for the disk.
+     *
+     * When it does not, @p resume is called once on the thread of
+     * @p context as soon as the bytes arrived, unless close() or another
+     * readyAt() came first. The source has to be closed before @p context
+     * is deleted. Sources reading synchronously are always ready.
+     */
+    virtual bool readyAt(qint64 offset, QObject *context, const std::function<void()> &resume)
+    {
+        Q_UNUSED(offset);
+        Q_UNUSED(context);
+        Q_UNUSED(resume);
+        return true;
+    }
+
+    /**
+     * @brief Creates the preferred source for a file.
+     *
+     * Local files at or above Config::getMappedSourceThreshold() are served
+     * from memory-mapped windows. Other files larger than one read-ahead
+     * block are read ahead on the disk threads, the rest through plain
+     * buffered reads.
+     *
+     * With @p cached, files of any size are read from the windows
+     * ServeCache keeps, unless the cache is disabled or the file lives on a
+     * network share.
+     */
+    static TransferSource *create(const QString &filePath, bool cached = false);
+
+    /** @brief Whether a file lives on a network share, where page faults wait for a round trip. */
+    static bool onNetworkShare(const QString &filePath);
+};
+
+/**
+ * @class FileReadSource
+ * @brief Default source reading through QFile into one reusable buffer.
+ */
+class FileReadSource : public TransferSource
+{
+public:
+    explicit FileReadSource(const QString &filePath);
+
+    bool open() override;
+    void close() override;
+    qint64 size() const override;
+    qint64 readChunk(qint64 offset, qint64 maxSize, const char **data) override;
+
+private:
+    QFile file;
+
+    /** Buffer reused for every chunk, grown once to the largest request. */
+    QByteArray buffer;
+};
+
+/**
+ * @class ReadAheadSource
+ * @brief Source keeping several block reads in flight ahead of the sender.
+ *
+ * Blocks of BLOCK_SIZE bytes are read with DiskIo::readAt() on the disk
+ * threads, Config::getDiskQueueDepth() of them ahead of the block being
+ * sent, so the disk is already fetching the next blocks while the socket
+ * drains the current one. At most that many blocks plus the current one
+ * are held per file. Sequential offsets are expected; a jump drops the
+ * blocks read ahead.
+ *
+ * readyAt() tells whether the block of an offset arrived, so a sender
+ * waiting for a cold read keeps serving its other connections and the
+ * waits of the disk and the network overlap instead of adding up.
+ *
+ * Slow storage (spinning disks, network shares) is served best this way;
+ * mapped windows fault in one page range at a time.
+ */
+class ReadAheadSource : public TransferSource
+{
+public:
+    explicit ReadAheadSource(const QString &filePath);
+    ~ReadAheadSource() override;
+
+    bool open() override;
+    void close() override;
+    qint64 size() const override;
+    qint64 readChunk(qint64 offset, qint64 maxSize, const char **data) override;
+    bool readyAt(qint64 offset, QObject *context, const std::function<void()> &resume) override;
+
+    /** Bytes of one read request. */
+    static constexpr qint64 BLOCK_SIZE = 1024 * 1024;
+
+private:
+    /** One block read request. */
+    struct Block
+    {
+        QByteArray data;
+        bool done = false;
+        bool failed = false;
+    };
+
+    /** State shared with the reads still running after close(). */
+    struct Reads
+    {
+        QFile file;
+        QMutex mutex;
+        QWaitCondition changed;
+        QMap<qint64, Block> blocks;
+
+        /** Object waiting for the block at waitedBlock, null if none */
+        QObject *waiter = nullptr;
+        std::function<void()> resume;
+        qint64 waitedBlock = -1;
+    };
+
+    qint64 prepare(qint64 offset);
+    void schedule(qint64 start);
+
+    QString path;
+    int depth = 1;
+    qint64 fileSize = 0;
+    QSharedPointer<Reads> reads;
+
+    /** Block handed out last, kept so its data stays valid. */
+    QByteArray current;
+};
+
+/**
+ * @class MappedFile
+ * @brief One open file shared by every MappedFileSource reading it.
+ *
+ * Windows of the file are mapped on demand and kept alive for as long as at
+ * least one source references them, so concurrent uploads of the same
+ * shared file to several peers reuse a single mapping.
+ */
+class MappedFile
+{
+public:
+    /** A mapped region of the file, unmapped when the last holder drops it. */
+    struct Window
+    {
+        QSharedPointer<MappedFile> owner;
+        uchar *address = nullptr;
+        qint64 offset = 0;
+        qint64 length = 0;
+        ~Window();
+    };
+
+    /** Mapping granularity; window offsets are multiples of this value. */
+    static constexpr qint64 WINDOW_SIZE = 64 * 1024 * 1024;
+
+    static QSharedPointer<MappedFile> acquire(const QString &filePath);
+    static QSharedPointer<Window> window(const QSharedPointer<MappedFile> &mapped, qint64 offset);
+
+    qint64 size() const;
+
+    /** @brief Canonical path of the file. */
+    QString path() const { return file.fileName(); }
+
+    bool isCurrent() const;
+    ~MappedFile();
+
+private:
+    explicit MappedFile(const QString &filePath);
+
+    QFile file;
+
+    /** Modification time in milliseconds since the epoch the file had when opened */
+    qint64 modified = 0;
+    QMutex mutex;
+    QHash<qint64, QWeakPointer<Window>> windows;
+
+    static QMutex registryMutex;
+    static QHash<QString, QWeakPointer<MappedFile>> registry;
+};
+
+/**
+ * @class MappedFileSource
+ * @brief Source writing straight out of memory-mapped file windows.
+ *
+ * A cached source takes its windows from ServeCache, which keeps them
+ * mapped after the transfer, for the next peer asking for the same file.
+ */
+class MappedFileSource : public TransferSource
+{
+public:
+    explicit MappedFileSource(const QString &filePath, bool cached = false);
+
+    bool open() override;
+    void close() override;
+    qint64 size() const override;
+    qint64 readChunk(qint64 offset, qint64 maxSize, const char **data) override;
+
+private:
+    QString path;
+    bool cached = false;
+    QSharedPointer<MappedFile> mapped;
+    QSharedPointer<MappedFile::Window> current;
+};
+
+#endif // TRANSFERSOURCE_H
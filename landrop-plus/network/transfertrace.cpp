@@ -0,0 +1,191 @@
+/**
+ * @file transfertrace.cpp
+ */
+
+#include "transfertrace.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <atomic>
+
+namespace
+{
+    std::atomic<bool> recording{false};
+    std::atomic<int> nextThreadId{1};
+
+    QMutex traceMutex;
+    QFile traceFile;
+    QByteArray buffer;
+    QElapsedTimer traceClock;
+    qint64 processId = 0;
+
+    /** Generation of the recording, threads name themselves again in a new one */
+    int generation = 0;
+
+    /** Whether an event was written since start(), the next one needs a comma */
+    bool separated = false;
+
+    /** @brief Starts an event in the array. Called with the mutex held. */
+    void beginEvent()
+    {
+        if (separated)
+            buffer += ",\n";
+        separated = true;
+    }
+
+    struct ThreadState
+    {
+        int id = 0;
+        int named = -1;
+    };
+
+    thread_local ThreadState threadState;
+
+    /**
+     * @brief Identifier of the calling thread, naming it in the trace first. Called with the mutex held.
+     */
+    int threadId()
+    {
+        if (threadState.id == 0)
+            threadState.id = nextThreadId++;
+        if (threadState.named != generation)
+        {
+            threadState.named = generation;
+            QThread *thread = QThread::currentThread();
+            QString name = thread->objectName();
+            if (name.isEmpty())
+            {
+                bool main = QCoreApplication::instance() && thread == QCoreApplication::instance()->thread();
+                name = main ? QString("main") : QString("thread %1").arg(threadState.id);
+            }
+            name.replace('"', '\'').replace('\\', '/');
+            beginEvent();
+            buffer += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + QByteArray::number(processId) +
+                      ",\"tid\":" + QByteArray::number(threadState.id) + ",\"args\":{\"name\":\"" + name.toUtf8() +
+                      "\"}}";
+        }
+        return threadState.id;
+    }
+
+    /** @brief Writes the buffer out. Called with the mutex held. */
+    void writeBuffer()
+    {
+        if (traceFile.isOpen() && !buffer.isEmpty())
+            traceFile.write(buffer);
+        buffer.clear();
+    }
+
+    /** @brief Adds one event, written out once enough are buffered. Called with the mutex held. */
+    void append(const char *name, const char *category, char phase, qint64 startUs, qint64 durationUs, quint64 id,
+                qint64 bytes)
+    {
+        int tid = threadId();
+        beginEvent();
+        buffer += "{\"name\":\"";
+        buffer += name;
+        buffer += "\",\"cat\":\"";
+        buffer += category;
+        buffer += "\",\"ph\":\"";
+        buffer += phase;
+        buffer += "\",\"ts\":" + QByteArray::number(startUs);
+        if (phase == 'X')
+            buffer += ",\"dur\":" + QByteArray::number(durationUs);
+        else
+            buffer += ",\"s\":\"t\"";
+        buffer += ",\"pid\":" + QByteArray::number(processId) + ",\"tid\":" + QByteArray::number(tid);
+        if (id != 0 || bytes >= 0)
+        {
+            buffer += ",\"args\":{";
+            if (id != 0)
+                buffer += "\"id\":" + QByteArray::number(id);
+            if (bytes >= 0)
+                buffer += QByteArray(id != 0 ? "," : "") + "\"bytes\":" + QByteArray::number(bytes);
+            buffer += '}';
+        }
+        buffer += '}';
+
+        if (buffer.size() >= TransferTrace::FLUSH_BYTES)
+            writeBuffer();
+    }
+}
+
+bool TransferTrace::start(const QString &filePath)
+{
+    QMutexLocker lock(&traceMutex);
+    if (traceFile.isOpen())
+    {
+        writeBuffer();
+        traceFile.write("\n]\n");
+        traceFile.close();
+    }
+    recording = false;
+
+    traceFile.setFileName(filePath);
+    if (!traceFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    processId = QCoreApplication::applicationPid();
+    generation++;
+    separated = false;
+    buffer = "[\n";
+    traceClock.start();
+    recording = true;
+    return true;
+}
+
+void TransferTrace::stop()
+{
+    QMutexLocker lock(&traceMutex);
+    recording = false;
+    if (!traceFile.isOpen())
+        return;
+
+    buffer += "\n]\n";
+    writeBuffer();
+    traceFile.close();
+}
+
+bool TransferTrace::enabled()
+{
+    return recording.load(std::memory_order_relaxed);
+}
+
+qint64 TransferTrace::now()
+{
+    QMutexLocker lock(&traceMutex);
+    return traceClock.isValid() ? traceClock.nsecsElapsed() / 1000 : 0;
+}
+
+void TransferTrace::complete(const char *name, const char *category, qint64 startUs, quint64 id, qint64 bytes)
+{
+    if (!enabled() || startUs < 0)
+        return;
+
+    QMutexLocker lock(&traceMutex);
+    if (!recording)
+        return;
+    qint64 end = traceClock.nsecsElapsed() / 1000;
+    append(name, category, 'X', startUs, qMax<qint64>(0, end - startUs), id, bytes);
+}
+
+void TransferTrace::instant(const char *name, const char *category, quint64 id)
+{
+    if (!enabled())
+        return;
+
+    QMutexLocker lock(&traceMutex);
+    if (!recording)
+        return;
+    append(name, category, 'i', traceClock.nsecsElapsed() / 1000, 0, id, -1);
+}
+
+void TransferTrace::flush()
+{
+    QMutexLocker lock(&traceMutex);
+    writeBuffer();
+    if (traceFile.isOpen())
+        traceFile.flush();
+}
@@ -0,0 +1,98 @@
+/**
+ * @file transfertrace.h
+ * @brief Timeline of transfer events in the Chrome trace format
+ */
+
+#ifndef TRANSFERTRACE_H
+#define TRANSFERTRACE_H
+
+#include <QString>
+#include <QtGlobal>
+
+/**
+ * @namespace TransferTrace
+ * @brief Optional recording of where transfers spend their time.
+ *
+ * While started, the Sender, Receiver and FileTransferManager record
+ * timestamped spans (connect, header, accept wait, chunk reads, socket
+ * writes, bytesWritten() callbacks, disk writes, queueing) and instants
+ * (finish) to a file in the Chrome trace event format, which Perfetto and
+ * chrome://tracing open. Events carry the TransferMetrics session they
+ * belong to as "id" and the thread they ran on, so a slow transfer shows
+ * whether it waited on the disk, the event loop or the network.
+ *
+ * Events are appended to a JSON array as they come, without its closing
+ * bracket until stop(), which the format allows: a trace cut short by a
+ * crash still opens. flush() writes the buffered events out.
+ *
+ * Recording costs one check of enabled() while stopped. Thread-safe.
+ */
+namespace TransferTrace
+{
+    /** Buffered bytes written to the file at once. */
+    const int FLUSH_BYTES = 256 * 1024;
+
+    /**
+     * @brief Starts recording to @p filePath, replacing the file.
+     *
+     * @return false if the file could not be opened
+     */
+    bool start(const QString &filePath);
+
+    /** @brief Writes the remaining events and closes the file. */
+    void stop();
+
+    /** @brief Whether events are recorded. */
+    bool enabled();
+
+    /** @brief Microseconds on the trace clock. */
+    qint64 now();
+
+    /**
+     * @brief Records a span that began at @p startUs and ends now.
+     *
+     * @param name Static name of the span
+     * @param category Static category: "send", "receive" or "manager"
+     * @param startUs now() when the span began, the span is dropped if negative
+     * @param id Session or transfer the span belongs to, 0 for none
+     * @param bytes Bytes the span moved, -1 for none
+     */
+    void complete(const char *name, const char *category, qint64 startUs, quint64 id = 0, qint64 bytes = -1);
+
+    /** @brief Records an instant event. */
+    void instant(const char *name, const char *category, quint64 id = 0);
+
+    /** @brief Writes the buffered events to the file. */
+    void flush();
+
+    /**
+     * @class Span
+     * @brief Records the lifetime of a scope as a span, when recording.
+     */
+    class Span
+    {
+    public:
+        Span(const char *name, const char *category, quint64 id = 0, qint64 bytes = -1)
+            : name(name), category(category), id(id), bytes(bytes), startUs(enabled() ? now() : -1) {}
+        ~Span()
+        {
+            if (startUs >= 0)
+                complete(name, category, startUs, id, bytes);
+        }
+
+        /** @brief Bytes the span moved, known once it is done. */
+        void setBytes(qint64 count) { bytes = count; }
+
+        Span(const Span &) = delete;
+        Span &operator=(const Span &) = delete;
+
+    private:
+        const char *name;
+        const char *category;
+        quint64 id;
+        qint64 bytes;
+        qint64 startUs;
+    };
+}
+
+#endif // TRANSFERTRACE_H
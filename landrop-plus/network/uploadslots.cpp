@@ -0,0 +1,134 @@
+/**
+ * @file uploadslots.cpp
+ */
+
+#include "uploadslots.h"
+#include "../config/config.h"
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPointer>
+
+namespace
+{
+    struct Request
+    {
+        QString peer;
+        QPointer<QObject> context;
+        std::function<void()> start;
+    };
+
+    QMutex slotsMutex;
+    QList<Request> queue;
+
+    /** Slots held by each peer */
+    QHash<QString, int> active;
+    int activeTotal = 0;
+
+    /**
+     * @brief Whether one more upload to @p peer fits the limits. Called with the mutex held.
+     */
+    bool fits(const QString &peer)
+    {
+        int total = Config::getUploadSlots();
+        int perPeer = Config::getUploadSlotsPerPeer();
+        return (total <= 0 || activeTotal < total) && (perPeer <= 0 || active.value(peer) < perPeer);
+    }
+
+    /**
+     * @brief Takes a slot for @p peer. Called with the mutex held.
+     */
+    void take(const QString &peer)
+    {
+        active[peer]++;
+        activeTotal++;
+    }
+
+    /**
+     * @brief Runs a granted request on the thread of its context.
+     *
+     * Returns false, without running it, when the context is gone.
+     */
+    bool run(const Request &request)
+    {
+        if (!request.context)
+            return false;
+        return QMetaObject::invokeMethod(request.context, request.start, Qt::QueuedConnection);
+    }
+
+    /**
+     * @brief Hands the free slots to the waiting requests, in arrival order.
+     */
+    void grant()
+    {
+        while (true)
+        {
+            Request next;
+            {
+                QMutexLocker lock(&slotsMutex);
+                int index = -1;
+                for (int i = 0; i < queue.size() && index < 0; ++i)
+                {
+                    if (!queue[i].context)
+                        queue.removeAt(i--);
+                    else if (fits(queue[i].peer))
+                        index = i;
+                }
+                if (index < 0)
+                    return;
+                next = queue.takeAt(index);
+                take(next.peer);
+            }
+            if (!run(next))
+                UploadSlots::release(next.peer);
+        }
+    }
+}
+
+bool UploadSlots::request(const QString &peer, QObject *context, std::function<void()> start)
+{
+    Request entry{peer, context, std::move(start)};
+    {
+        // Waiting requests do not fit, or a release would have granted them
+        QMutexLocker lock(&slotsMutex);
+        if (!fits(peer))
+        {
+            if (queue.size() >= Config::getUploadQueueLength())
+                return false;
+            queue.append(entry);
+            return true;
+        }
+        take(peer);
+    }
+
+    if (!run(entry))
+        release(peer);
+    return true;
+}
+
+void UploadSlots::release(const QString &peer)
+{
+    {
+        QMutexLocker lock(&slotsMutex);
+        auto it = active.find(peer);
+        if (it == active.end())
+            return;
+        if (--it.value() == 0)
+            active.erase(it);
+        activeTotal--;
+    }
+    grant();
+}
+
+int UploadSlots::activeCount()
+{
+    QMutexLocker lock(&slotsMutex);
+    return activeTotal;
+}
+
+int UploadSlots::queuedCount()
+{
+    QMutexLocker lock(&slotsMutex);
+    return queue.size();
+}
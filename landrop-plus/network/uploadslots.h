@@ -0,0 +1,56 @@
+/**
+ * @file uploadslots.h
+ * @brief Admission of shared file uploads, globally and per peer
+ */
+
+#ifndef UPLOADSLOTS_H
+#define UPLOADSLOTS_H
+
+#include <QObject>
+#include <QString>
+#include <functional>
+
+/**
+ * @namespace UploadSlots
+ * @brief Bounds how many shared files are served at once.
+ *
+ * Every download a peer asks for takes a slot before its Sender starts.
+ * At most Config::getUploadSlots() run at once, and at most
+ * Config::getUploadSlotsPerPeer() for the same peer, so fifty requests for
+ * one file do not become fifty readers of the disk and one busy peer does
+ * not hold every slot. Requests beyond that wait in one queue in arrival
+ * order; a freed slot goes to the first request whose peer is under its
+ * own limit. Requests beyond Config::getUploadQueueLength() are refused.
+ *
+ * The slots are shared by the receiver and its workers. Thread-safe.
+ */
+namespace UploadSlots
+{
+    /**
+     * @brief Asks for a slot to serve @p peer.
+     *
+     * @p start is called on the thread of @p context once the slot is
+     * granted, right away or when another upload ended. It must end in a
+     * release() for the same peer, also when it has nothing to serve
+     * anymore. If @p context is destroyed first, the request is dropped.
+     *
+     * @param peer Address of the requesting peer
+     * @param context Object whose thread runs @p start
+     * @param start Starts the upload
+     * @return false if the queue is full and the request was refused
+     */
+    bool request(const QString &peer, QObject *context, std::function<void()> start);
+
+    /**
+     * @brief Frees the slot an upload to @p peer held, handing it to the next request.
+     */
+    void release(const QString &peer);
+
+    /** @brief Uploads holding a slot. */
+    int activeCount();
+
+    /** @brief Requests waiting for a slot. */
+    int queuedCount();
+}
+
+#endif // UPLOADSLOTS_H
@@ -0,0 +1,61 @@
+/**
+ * @file zerocopy.cpp
+ */
+
+#include "zerocopy.h"
+
+#if defined(Q_OS_LINUX)
+#include <sys/sendfile.h>
+#include <cerrno>
+#elif defined(Q_OS_WIN)
+#include <winsock2.h>
+#include <mswsock.h>
+#include <windows.h>
+#include <io.h>
+#endif
+
+bool ZeroCopy::isSupported()
+{
+#if defined(Q_OS_LINUX) || defined(Q_OS_WIN)
+    return true;
+#else
+    return false;
+#endif
+}
+
+qint64 ZeroCopy::sendFileChunk(qintptr socketDescriptor, int fileDescriptor, qint64 offset, qint64 length)
+{
+    if (socketDescriptor < 0 || fileDescriptor < 0 || length <= 0)
+        return -1;
+
+#if defined(Q_OS_LINUX)
+    off_t fileOffset = static_cast<off_t>(offset);
+    ssize_t sent;
+    do {
+        sent = ::sendfile(static_cast<int>(socketDescriptor), fileDescriptor, &fileOffset,
+                          static_cast<size_t>(length));
+    } while (sent < 0 && errno == EINTR);
+
+    if (sent < 0)
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    return sent;
+#elif defined(Q_OS_WIN)
+    HANDLE fileHandle = reinterpret_cast<HANDLE>(_get_osfhandle(fileDescriptor));
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return -1;
+
+    // TransmitFile reads from the current file pointer when no OVERLAPPED is given
+    LARGE_INTEGER position;
+    position.QuadPart = offset;
+    if (!SetFilePointerEx(fileHandle, position, nullptr, FILE_BEGIN))
+        return -1;
+
+    DWORD chunk = static_cast<DWORD>(qMin<qint64>(length, 0x7FFFFFFE));
+    if (!TransmitFile(static_cast<SOCKET>(socketDescriptor), fileHandle, chunk, 0, nullptr, nullptr, 0))
+        return WSAGetLastError() == WSAEWOULDBLOCK ? 0 : -1;
+    return chunk;
+#else
+    Q_UNUSED(offset);
+    return -1;
+#endif
+}
@@ -0,0 +1,39 @@
+/**
+ * @file zerocopy.h
+ * @brief Kernel-assisted file-to-socket transmission helpers
+ */
+
+#ifndef ZEROCOPY_H
+#define ZEROCOPY_H
+
+#include <QtGlobal>
+
+/**
+ * @namespace ZeroCopy
+ * @brief Thin wrappers over the platform zero-copy send primitives.
+ *
+ * On Linux this uses sendfile(2), on Windows TransmitFile. Both move file
+ * data from the page cache straight into the socket without staging it in a
+ * user-space buffer. Other platforms report isSupported() == false and the
+ * caller keeps using its regular read/write loop.
+ */
+namespace ZeroCopy
+{
+    /**
+     * @brief Whether a kernel send path is compiled in for this platform.
+     */
+    bool isSupported();
+
+    /**
+     * @brief Sends up to @p length bytes of a file starting at @p offset.
+     *
+     * @param socketDescriptor Native descriptor of a connected, non-blocking socket
+     * @param fileDescriptor   C runtime descriptor of the open file (QFile::handle())
+     * @param offset           Absolute file offset to start from
+     * @param length           Maximum number of bytes to send
+     * @return Bytes handed to the kernel, 0 if the socket buffer is full, -1 on error
+     */
+    qint64 sendFileChunk(qintptr socketDescriptor, int fileDescriptor, qint64 offset, qint64 length);
+}
+
+#endif // ZEROCOPY_H
@@ -0,0 +1,147 @@
+/**
+ * @file autoacceptpolicy.cpp
+ */
+
+#include "autoacceptpolicy.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QStorageInfo>
+
+bool AutoAcceptPolicy::load(const QString &filePath)
+{
+    ruleList.clear();
+
+    QFile file(filePath);
+    if (!file.exists())
+        return true;
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QJsonParseError error;
+    QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &error);
+    if (error.error != QJsonParseError::NoError || !document.isArray())
+        return false;
+
+    QList<Rule> loaded;
+    for (const QJsonValue &value : document.array())
+    {
+        if (!value.isObject())
+            return false;
+
+        QJsonObject object = value.toObject();
+        Rule rule;
+        rule.peer = object.value("peer").toString().trimmed();
+        for (const QJsonValue &pattern : object.value("patterns").toArray())
+        {
+            if (!pattern.toString().isEmpty())
+                rule.patterns.append(pattern.toString());
+        }
+        // Doubles hold every size below 2^53 exactly
+        rule.maxSize = qint64(object.value("maxSize").toDouble(-1));
+        rule.minFreeSpace = qMax<qint64>(0, qint64(object.value("minFreeSpace").toDouble(0)));
+        QString priority = object.value("priority").toString().trimmed().toLower();
+        if (priority == "background")
+            rule.priority = TransferPriority::BACKGROUND;
+        else if (priority == "interactive")
+            rule.priority = TransferPriority::INTERACTIVE;
+        loaded.append(rule);
+    }
+
+    ruleList = loaded;
+    return true;
+}
+
+bool AutoAcceptPolicy::accepts(const Request &request, qint64 freeSpace, TransferPriority *priority) const
+{
+    for (const Rule &rule : ruleList)
+    {
+        if (matches(rule, request, freeSpace))
+        {
+            if (priority)
+                *priority = rule.priority;
+            return true;
+        }
+    }
+    return false;
+}
+
+qint64 AutoAcceptPolicy::freeSpace(const QString &folderPath)
+{
+    // The received files folder is only created with the first file
+    QFileInfo folder(QDir::cleanPath(QDir(folderPath).absolutePath()));
+    while (!folder.exists() && folder.absoluteFilePath() != folder.absolutePath())
+        folder = QFileInfo(folder.absolutePath());
+
+    QStorageInfo storage(folder.absoluteFilePath());
+    if (!storage.isValid() || !storage.isReady())
+        return -1;
+    return storage.bytesAvailable();
+}
+
+bool AutoAcceptPolicy::matches(const Rule &rule, const Request &request, qint64 freeSpace)
+{
+    if (!rule.peer.isEmpty() && !peerMatches(rule.peer, request))
+        return false;
+
+    if (rule.maxSize >= 0 && request.size > rule.maxSize)
+        return false;
+
+    if (!rule.patterns.isEmpty())
+    {
+        QString baseName = QFileInfo(request.fileName).fileName();
+        bool nameMatches = false;
+        for (const QString &pattern : rule.patterns)
+        {
+            if (wildcardMatch(pattern, request.fileName) || wildcardMatch(pattern, baseName))
+            {
+                nameMatches = true;
+                break;
+            }
+        }
+        if (!nameMatches)
+            return false;
+    }
+
+    if (rule.minFreeSpace > 0 && (freeSpace < 0 || freeSpace - request.size < rule.minFreeSpace))
+        return false;
+    return true;
+}
+
+/**
+ * @brief Matches the sender against an address, a subnet ("192.168.1.0/24")
+ * or a wildcard of its hostname or address.
+ */
+bool AutoAcceptPolicy::peerMatches(const QString &peer, const Request &request)
+{
+    bool isIPv4 = false;
+    quint32 ipv4 = request.address.toIPv4Address(&isIPv4);
+    QHostAddress address = isIPv4 ? QHostAddress(ipv4) : request.address;
+
+    if (peer.contains('/'))
+    {
+        QPair<QHostAddress, int> subnet = QHostAddress::parseSubnet(peer);
+        return !subnet.first.isNull() && address.isInSubnet(subnet.first, subnet.second);
+    }
+
+    QHostAddress exact(peer);
+    if (!exact.isNull())
+        return exact.isEqual(address, QHostAddress::ConvertV4MappedToIPv4);
+    return wildcardMatch(peer, request.hostname) || wildcardMatch(peer, address.toString());
+}
+
+/**
+ * @brief Case-insensitive match of a wildcard ("*", "?", "[...]") against the whole text.
+ */
+bool AutoAcceptPolicy::wildcardMatch(const QString &pattern, const QString &text)
+{
+    if (text.isEmpty())
+        return false;
+    QRegularExpression expression(QRegularExpression::wildcardToRegularExpression(pattern),
+                                  QRegularExpression::CaseInsensitiveOption);
+    return expression.match(text).hasMatch();
+}
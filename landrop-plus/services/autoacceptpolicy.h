@@ -0,0 +1,112 @@
+/**
+ * @file autoacceptpolicy.h
+ * @brief Rules accepting incoming transfers from trusted peers without asking
+ */
+
+#ifndef AUTOACCEPTPOLICY_H
+#define AUTOACCEPTPOLICY_H
+
+#include <QHostAddress>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include "../core/transferpriority.h"
+
+/**
+ * @class AutoAcceptPolicy
+ * @brief Decides which incoming files are accepted without the batch dialog.
+ *
+ * The rules are read from the JSON file at Config::getAutoAcceptRulesPath(),
+ * an array of objects whose fields are all optional:
+ *
+ *     [
+ *       { "peer": "build-*", "patterns": ["*.log", "*.tar.gz"],
+ *         "maxSize": 1073741824, "minFreeSpace": 10737418240,
+ *         "priority": "background" }
+ *     ]
+ *
+ * A file is accepted when one rule matches it: "peer" is an address, a
+ * subnet such as "192.168.1.0/24", or a wildcard matched against the
+ * sender's discovered hostname or its IP address,
+ * "patterns" are wildcards matched against the file name (with or without
+ * its folders), "maxSize" bounds the file size, and "minFreeSpace" is the
+ * number of bytes that must remain free in the received files folder once
+ * the file is written. "priority" ("background", "normal" or
+ * "interactive") is the lane the accepted file is received in, see
+ * TransferPriority. A missing file means no rules.
+ *
+ * Evaluated by FileTransferManager before any UI is involved, on the GUI
+ * thread.
+ */
+class AutoAcceptPolicy
+{
+public:
+    /**
+     * @brief One rule, every condition set must hold.
+     */
+    struct Rule
+    {
+        /** Address, subnet or wildcard of the sender, empty for any sender */
+        QString peer;
+
+        /** Wildcards for the file name, empty for any file */
+        QStringList patterns;
+
+        /** Largest file accepted in bytes, -1 for no limit */
+        qint64 maxSize = -1;
+
+        /** Bytes that must stay free after the file, 0 for no check */
+        qint64 minFreeSpace = 0;
+
+        /** Lane the files the rule accepts are received in */
+        TransferPriority priority = TransferPriority::NORMAL;
+    };
+
+    /**
+     * @brief What is known about an incoming file.
+     */
+    struct Request
+    {
+        QString fileName;
+        qint64 size = 0;
+        QHostAddress address;
+
+        /** Hostname the sender announced in discovery, empty if unknown */
+        QString hostname;
+    };
+
+    /**
+     * @brief Replaces the rules with those of a JSON file.
+     *
+     * @param filePath Rules file, missing meaning no rules
+     * @return false if the file exists but is not a valid rules array (no rules are kept)
+     */
+    bool load(const QString &filePath);
+
+    void setRules(const QList<Rule> &list) { ruleList = list; }
+    QList<Rule> rules() const { return ruleList; }
+
+    /**
+     * @brief Whether one of the rules accepts a file.
+     *
+     * @param request Incoming file
+     * @param freeSpace Bytes available for received files, -1 if unknown
+     *        (rules with a free space condition then never match)
+     * @param priority Set to the lane of the matching rule if not null
+     */
+    bool accepts(const Request &request, qint64 freeSpace, TransferPriority *priority = nullptr) const;
+
+    /**
+     * @brief Bytes available on the volume of a folder, -1 if unknown.
+     */
+    static qint64 freeSpace(const QString &folderPath);
+
+private:
+    static bool matches(const Rule &rule, const Request &request, qint64 freeSpace);
+    static bool peerMatches(const QString &peer, const Request &request);
+    static bool wildcardMatch(const QString &pattern, const QString &text);
+
+    QList<Rule> ruleList;
+};
+
+#endif // AUTOACCEPTPOLICY_H
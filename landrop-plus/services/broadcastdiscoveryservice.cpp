@@ -6,38 +6,60 @@
 #include "broadcastdiscoveryservice.h"
 #include "sharedfilemanager.h"
 #include "../config/config.h"
-#include <QDateTime>
+#include "../network/protocol.h"
+#include "../network/sharedcatalog.h"
+#include "../network/catalogfetcher.h"
+#include "../network/discoverymessage.h"
+#include "../network/transfermetrics.h"
+#include "../network/pathbonding.h"
+#include "discoverybackend.h"
+#include "mdnsdiscoverybackend.h"
+#include "registrydiscoverybackend.h"
+#include "interfacesnapshot.h"
 #include <QDebug>
 #include <QJsonDocument>
+#include <QHash>
+#include <QRandomGenerator>
 #include <QCoreApplication>
 #include <QOperatingSystemVersion>
 
 const QString BroadcastDiscoveryService::PROTOCOL_VERSION = "V1";
+const QString BroadcastDiscoveryService::TRANSFER_PROTOCOL_PREFIX = "P";
+const QString BroadcastDiscoveryService::CATALOG_PREFIX = "C";
+const QByteArray BroadcastDiscoveryService::TEXT_REQUEST_PREFIX = "LANDROP_DISCOVERY_" + PROTOCOL_VERSION.toUtf8() + "|";
+const QByteArray BroadcastDiscoveryService::TEXT_RESPONSE_PREFIX = "LANDROP_RESPONSE_" + PROTOCOL_VERSION.toUtf8() + "|";
+const QByteArray BroadcastDiscoveryService::ADDRESSES_OPTION = "addrs";
 
 /**
  * @brief Constructs a new BroadcastDiscoveryService instance.
  *
  * Initializes the discovery service with UDP socket, timers for broadcasting and cleanup,
- * and automatically starts the discovery process.
+ * and starts the discovery process unless asked not to. The local network
+ * interfaces are only enumerated once discovery starts.
  *
  * @param parent The parent QObject for memory management
+ * @param start Whether to start discovering now, otherwise startDiscovery() does
  */
-BroadcastDiscoveryService::BroadcastDiscoveryService(QObject *parent)
+BroadcastDiscoveryService::BroadcastDiscoveryService(QObject *parent, bool start)
     : QObject(parent),
       discoverySocket(nullptr),
       broadcastTimer(new QTimer(this)),
       cleanupTimer(new QTimer(this)),
+      heartbeatTimer(new QTimer(this)),
       discovering(false),
-      discoveryInterval(5000),
       myDiscoveryPort(0),
-      sharedFileManager(nullptr),
-      cachedSharedFilesJson("[]"),
-      fileScanTimer(new QTimer(this))
+      sharedFileManager(nullptr)
 {
+    broadcastTimer->setSingleShot(true);
     connect(broadcastTimer, &QTimer::timeout, this, &BroadcastDiscoveryService::performPeriodicBroadcast);
     connect(cleanupTimer, &QTimer::timeout, this, &BroadcastDiscoveryService::cleanupExpiredUsers);
-    connect(fileScanTimer, &QTimer::timeout, this, &BroadcastDiscoveryService::scanSharedFilesDirectly);
-    startDiscovery();
+    connect(heartbeatTimer, &QTimer::timeout, this, &BroadcastDiscoveryService::sendHeartbeats);
+    if (Config::getMdnsDiscoveryEnabled())
+        addBackend(new MdnsDiscoveryBackend(this));
+    if (RegistryDiscoveryBackend::isConfigured())
+        addBackend(new RegistryDiscoveryBackend(this));
+    if (start)
+        startDiscovery();
 }
 
 /**
@@ -52,7 +74,8 @@ BroadcastDiscoveryService::~BroadcastDiscoveryService()
  * @brief Starts the network discovery process.
  *
  * Initializes UDP socket binding on the fixed discovery port, clears any existing
- * user data, and starts the periodic broadcast and cleanup timers.
+ * user data, and starts the cleanup timer and a burst of broadcasts finding
+ * the peers quickly.
  */
 void BroadcastDiscoveryService::startDiscovery()
 {
@@ -65,13 +88,25 @@ void BroadcastDiscoveryService::startDiscovery()
         return;
     }
 
-    discovering = true;
-    discoveredUsers.clear();
-    lastSeenTimes.clear();
+    // Backends announce our address, which may change with the interfaces
+    connect(InterfaceSnapshot::shared(), &InterfaceSnapshot::changed, this, &BroadcastDiscoveryService::updateBackends,
+            Qt::UniqueConnection);
 
-    broadcastTimer->start(discoveryInterval);
-    cleanupTimer->start(10000);
-    performPeriodicBroadcast();
+    discovering = true;
+    clearPeers();
+    stats = ParseStats();
+
+    cleanupTimer->start(CLEANUP_INTERVAL_MS);
+    heartbeatSequence = QRandomGenerator::global()->generate();
+    heartbeatTimer->start(heartbeatInterval());
+    startBurst();
+    for (DiscoveryBackend *backend : backends)
+    {
+        if (!backend->start(localUser()))
+        {
+            // qDebug() << "BroadcastDiscoveryService: Discovery backend unavailable, using broadcasts only";
+        }
+    }
     QTimer::singleShot(200, this, &BroadcastDiscoveryService::requestUserListUpdate);
 
     emit discoveryStarted();
@@ -90,7 +125,11 @@ void BroadcastDiscoveryService::stopDiscovery()
 
     discovering = false;
     broadcastTimer->stop();
+    pacing.stopBurst();
     cleanupTimer->stop();
+    heartbeatTimer->stop();
+    for (DiscoveryBackend *backend : backends)
+        backend->stop();
 
     if (discoverySocket)
     {
@@ -100,8 +139,7 @@ void BroadcastDiscoveryService::stopDiscovery()
     }
 
     myDiscoveryPort = 0;
-    discoveredUsers.clear();
-    lastSeenTimes.clear();
+    clearPeers();
 
     emit discoveryStopped();
 }
@@ -130,46 +168,83 @@ bool BroadcastDiscoveryService::findAndBindAvailablePort()
 
 
 /**
- * @brief Scans the shared files directory and caches the file list as JSON.
+ * @brief Publishes the files indexed by the shared file manager.
  *
- * Directly scans the configured shared folder path for files and creates a JSON
- * representation of available files.
- * Updates the cached JSON representation for use in discovery protocol messages.
+ * The list becomes the SharedCatalog served to peers, whose version discovery
+ * messages advertise. The index is read, the file system is not.
  */
-void BroadcastDiscoveryService::scanSharedFilesDirectly()
+void BroadcastDiscoveryService::publishSharedFiles()
 {
-    QString sharedPath = Config::getSharedFolderPath();
-    if (sharedPath.isEmpty()) {
-        // Fallback if Config not set
-        QString exeDir = QCoreApplication::applicationDirPath();
-        sharedPath = QDir(exeDir).absoluteFilePath("Shared Files");
-    }
-    QDir sharedDir(sharedPath);
-    
-    if (!sharedDir.exists()) {
-        QDir().mkpath(sharedPath);
-    }
-    
-    QFileInfoList files = sharedDir.entryInfoList(QDir::Files | QDir::Readable | QDir::NoDotAndDotDot);
-    
-    if (files.isEmpty()) {
-        cachedSharedFilesJson = "[]";
+    SharedCatalog::publish(sharedFileManager ? sharedFileManager->sharedFilesJson() : QJsonArray());
+    updateBackends();
+    // qDebug() << "BroadcastDiscoveryService: Published catalog" << catalogField();
+}
+
+/**
+ * @brief Adds a discovery mechanism feeding the peer table.
+ *
+ * The service takes ownership, and starts the backend if discovery runs.
+ */
+void BroadcastDiscoveryService::addBackend(DiscoveryBackend *backend)
+{
+    backend->setParent(this);
+    backends.append(backend);
+    connect(backend, &DiscoveryBackend::peerFound, this, &BroadcastDiscoveryService::onBackendPeerFound);
+    connect(backend, &DiscoveryBackend::peerLost, this, &BroadcastDiscoveryService::onBackendPeerLost);
+    if (discovering)
+        backend->start(localUser());
+}
+
+/**
+ * @brief The local instance as announced by backends.
+ */
+LANDropUser BroadcastDiscoveryService::localUser() const
+{
+    LANDropUser user(getLocalIPAddress(), getLocalHostname(), getTransferPort(), QString::number(Protocol::VERSION_2));
+    user.catalogVersion = SharedCatalog::version();
+    return user;
+}
+
+/**
+ * @brief Passes the current catalog version and ports to the backends.
+ */
+void BroadcastDiscoveryService::updateBackends()
+{
+    if (!discovering)
         return;
-    }
-    
-    QJsonArray filesArray;
-    for (const QFileInfo &fileInfo : files) {
-        QJsonObject obj;
-        obj["name"] = fileInfo.fileName();
-        obj["path"] = fileInfo.fileName(); // files are in root of shared folder
-        obj["size"] = QString::number(fileInfo.size());
-        obj["type"] = "file";
-        filesArray.append(obj);
-    }
-    
-    QJsonDocument doc(filesArray);
-    cachedSharedFilesJson = QString::fromUtf8(doc.toJson(QJsonDocument::Compact));
-    // qDebug() << "BroadcastDiscoveryService: Found" << files.size() << "files:" << cachedSharedFilesJson;
+
+    LANDropUser user = localUser();
+    for (DiscoveryBackend *backend : backends)
+        backend->update(user);
+}
+
+/**
+ * @brief Adds or updates a peer a backend reported.
+ */
+void BroadcastDiscoveryService::onBackendPeerFound(const LANDropUser &user)
+{
+    if (!discovering || isSelfMessage(user.ipAddress, user.hostname))
+        return;
+
+    pacing.noteHeard(user.ipAddress);
+    backendPeers.insert(user.ipAddress);
+    if (!user.addresses.isEmpty())
+        PathBonding::setPeerAddresses(user.ipAddress, user.addresses);
+    updatePeerWithCatalog(user);
+}
+
+/**
+ * @brief Removes a peer a backend saw leave.
+ */
+void BroadcastDiscoveryService::onBackendPeerLost(const QString &ipAddress)
+{
+    if (!backendPeers.remove(ipAddress))
+        return;
+
+    bool known = peers.contains(ipAddress);
+    removePeer(ipAddress);
+    if (known)
+        emit userListUpdated(users());
 }
 
 
@@ -201,9 +276,9 @@ void BroadcastDiscoveryService::handleDiscoveryMessage()
         {
             continue;
         }
+        TransferMetrics::countDiscovery(true);
 
         datagram.resize(bytesRead);
-        QString message = QString::fromUtf8(datagram);
         QString senderIP = sender.toString();
 
         // Clean IPv6-mapped addresses immediately to prevent connection issues
@@ -212,144 +287,248 @@ void BroadcastDiscoveryService::handleDiscoveryMessage()
             senderIP = senderIP.mid(7);
         }
 
-        // qDebug() << "BroadcastDiscoveryService: Received from" << senderIP << ":" << message;
+        // qDebug() << "BroadcastDiscoveryService: Received from" << senderIP << ":" << datagram;
 
-        // Check if this is a response to our probe (indicates port is occupied)
-        if (message.startsWith(QString("LANDROP_DISCOVERY_%1|").arg(PROTOCOL_VERSION)))
+        // Heartbeats differ every time, they skip the payload cache
+        DiscoveryMessage::HeartbeatMessage heartbeat;
+        if (DiscoveryMessage::HeartbeatMessage::decode(datagram, &heartbeat))
         {
-            QString localHostname = getLocalHostname();
-            QString localIP = getLocalIPAddress();
-            handleDiscoveryRequest(message, sender, senderIP);
+            // Our own broadcast heartbeats come back on every interface
+            if (InterfaceSnapshot::shared()->isLocalAddress(sender))
+                continue;
+            handleHeartbeat(heartbeat, sender, senderPort, senderIP);
+            continue;
         }
-        else if (message.startsWith(QString("LANDROP_RESPONSE_%1|").arg(PROTOCOL_VERSION)))
+
+        if (handleRepeatedPayload(datagram, sender, senderIP))
         {
-            QString localIP = getLocalIPAddress();
-            handleDiscoveryResponse(message, senderIP);
+            ++stats.skipped;
+            continue;
+        }
+
+        PeerPayload payload;
+        if (parseDatagram(datagram, senderIP, &payload))
+        {
+            ++stats.parsed;
+            handleAnnouncement(payload, sender);
         }
     }
 }
 
 /**
- * @brief Handles incoming discovery request messages.
+ * @brief Handles a datagram identical to the previous one of a known peer.
  *
- * Parses the received message, extracts peer information (hostname, ports, shared files),
- * responds with our shared file list, and updates internal state to reflect the presence
- * of this peer.
+ * Peers repeat the same announcement until something changes, so it is
+ * compared with the last one instead of being split and parsed again. The
+ * peer is marked as heard and answered as before, and a catalog that could
+ * not be fetched yet is asked for again.
  *
- * @param message The raw discovery message string received via UDP
- * @param sender The QHostAddress of the sender
+ * @return false if the datagram has to be parsed
+ */
+bool BroadcastDiscoveryService::handleRepeatedPayload(const QByteArray &datagram, const QHostAddress &sender,
+                                                      const QString &senderIP)
+{
+    auto it = payloads.constFind(senderIP);
+    if (it == payloads.constEnd() || it->datagram != datagram)
+        return false;
+
+    // A peer that expired is added again from a full parse
+    auto known = peers.constFind(senderIP);
+    if (known == peers.constEnd())
+        return false;
+
+    const PeerPayload payload = it.value();
+    pacing.noteHeard(senderIP);
+    if (payload.request && shouldRespondTo(senderIP))
+        sendDiscoveryResponse(sender, payload.discoveryPort, payload.binary);
+    if (payload.advertised && known->catalogVersion != payload.user.catalogVersion)
+        updatePeerWithCatalog(payload.user);
+    return true;
+}
+
+/**
+ * @brief Answers a discovery request with our catalog version.
+ *
+ * @param receiver Address of the requesting peer
+ * @param port Discovery port the peer announced
+ * @param binary Whether the request was in the binary format, else it is answered in text
+ */
+void BroadcastDiscoveryService::sendDiscoveryResponse(const QHostAddress &receiver, quint16 port, bool binary)
+{
+    QByteArray message = binary ? binaryMessage(DiscoveryMessage::Response) : textMessage(TEXT_RESPONSE_PREFIX);
+    qint64 result = sendDatagram(message, receiver, port);
+
+    /*
+    if (result > 0)
+    {
+        qDebug() << "BroadcastDiscoveryService: Sent response to:" << receiver.toString() << "port:" << port;
+    }
+    else
+    {
+        qDebug() << "BroadcastDiscoveryService: Failed to send response to:" << receiver.toString() << "port:" << port;
+    }
+    */
+}
+
+/**
+ * @brief Reads a discovery datagram in either format.
+ *
+ * Binary datagrams are recognized by their magic number. Text ones carry
+ * ports, hostname and shared files as '|' separated fields, see
+ * readSharedFiles() and takeTransferProtocol().
+ *
+ * @param datagram The raw discovery message received via UDP
  * @param senderIP The IP address string of the sender (cleaned from IPv6-mapped format, the ::ffff:)
+ * @param payload Receives the peer as announced
+ * @return false if the datagram is not a discovery message
  */
-void BroadcastDiscoveryService::handleDiscoveryRequest(const QString &message, const QHostAddress &sender, const QString &senderIP)
+bool BroadcastDiscoveryService::parseDatagram(const QByteArray &datagram, const QString &senderIP, PeerPayload *payload) const
 {
-    QStringList parts = message.split('|');
-    if (parts.size() >= 4)
+    payload->datagram = datagram;
+
+    if (DiscoveryMessage::isBinary(datagram))
     {
-        quint16 senderDiscoveryPort = parts[1].toUShort();
-        quint16 transferPort = parts[2].toUShort();
-        QString hostname = parts[3];
+        DiscoveryMessage::Announcement announcement;
+        if (!DiscoveryMessage::Announcement::decode(datagram, &announcement))
+            return false;
+
+        payload->user = LANDropUser(senderIP, announcement.hostname, announcement.transferPort,
+                                    QString::number(announcement.transferVersion));
+        payload->user.catalogVersion = announcement.catalogVersion;
+        QByteArray addresses = announcement.options.value(ADDRESSES_OPTION);
+        if (!addresses.isEmpty())
+            payload->user.addresses = QString::fromUtf8(addresses).split(',');
+        payload->advertised = true;
+        payload->request = announcement.type == DiscoveryMessage::Request;
+        payload->discoveryPort = announcement.discoveryPort;
+        payload->binary = true;
+        return true;
+    }
 
-        QJsonArray sharedFiles;
-        if (parts.size() >= 5)
-        {
-            try
-            {
-                QString sharedFilesJson = parts[4];
-                QJsonParseError error;
-                QJsonDocument doc = QJsonDocument::fromJson(sharedFilesJson.toUtf8(), &error);
-                if (error.error == QJsonParseError::NoError && doc.isArray())
-                {
-                    sharedFiles = doc.array();
-                }
-            }
-            catch (...)
-            {
-            }
-        }
+    payload->request = datagram.startsWith(TEXT_REQUEST_PREFIX);
+    if (!payload->request && !datagram.startsWith(TEXT_RESPONSE_PREFIX))
+        return false;
 
-        // Check if this is a self-message
-        if (isSelfMessage(senderIP, hostname))
-        {
-            return;
-        }
+    QStringList parts = QString::fromUtf8(datagram).split('|');
+    if (parts.size() < 4)
+        return false;
 
-        // Send response with our shared files
-        QString ourSharedFilesJson = cachedSharedFilesJson;
+    payload->discoveryPort = parts[1].toUShort();
+    quint16 transferPort = parts[2].toUShort();
+    QString hostname = parts[3];
+    QString transferVersion = takeTransferProtocol(&parts);
 
-        QString responseMessage = QString("LANDROP_RESPONSE_%1|%2|%3|%4|%5")
-                                      .arg(PROTOCOL_VERSION)
-                                      .arg(myDiscoveryPort)
-                                      .arg(getTransferPort())
-                                      .arg(getLocalHostname())
-                                      .arg(ourSharedFilesJson);
+    payload->user = LANDropUser(senderIP, hostname, transferPort, transferVersion);
+    payload->advertised = readSharedFiles(parts, &payload->user);
+    return true;
+}
 
-        qint64 result = discoverySocket->writeDatagram(responseMessage.toUtf8(), sender, senderDiscoveryPort);
-        
-        /* 
-        if (result > 0)
-        {
-            qDebug() << "BroadcastDiscoveryService: Sent response to:" << senderIP << "port:" << senderDiscoveryPort;
-        }
-        else
-        {
-            qDebug() << "BroadcastDiscoveryService: Failed to send response to:" << senderIP << "port:" << senderDiscoveryPort;
-        } 
-        */
+/**
+ * @brief Handles a parsed discovery message from another LANDrop instance.
+ *
+ * Requests are answered with our catalog version, in the format they came
+ * in, and the peer table is updated to reflect the presence of this peer.
+ *
+ * @param payload The peer as announced
+ * @param sender The QHostAddress of the sender
+ */
+void BroadcastDiscoveryService::handleAnnouncement(const PeerPayload &payload, const QHostAddress &sender)
+{
+    const QString senderIP = payload.user.ipAddress;
 
-        // Add this user to our list
-        LANDropUser user(senderIP, hostname, transferPort, "1.0");
-        user.sharedFiles = sharedFiles;
-        updatePeerWithSharedFiles(user);
+    // Check if this is a self-message
+    if (isSelfMessage(senderIP, payload.user.hostname))
+    {
+        return;
     }
+    pacing.noteHeard(senderIP);
+    payloads.insert(senderIP, payload);
+    PathBonding::setPeerAddresses(senderIP, payload.user.addresses);
+
+    if (payload.binary)
+        textPeers.remove(senderIP);
+    else
+        textPeers.insert(senderIP);
+
+    // A peer answered recently hears our next broadcast anyway
+    if (payload.request && shouldRespondTo(senderIP))
+        sendDiscoveryResponse(sender, payload.discoveryPort, payload.binary);
+
+    // Add this user to our list
+    if (payload.advertised)
+        updatePeerWithCatalog(payload.user);
+    else
+        updatePeerWithSharedFiles(payload.user);
 }
 
 /**
- * @brief Handles a discovery response from another LANDrop instance.
+ * @brief Reads the shared files field of a discovery message.
  *
- * Parses and validates the incoming response, extracts peer info and shared file list,
- * and updates the internal discoveredUsers list accordingly.
+ * Current peers send "C<hex version>" of their catalog, older ones the
+ * JSON listing itself, which is versioned by its hash.
  *
- * @param message The received LANDROP_RESPONSE message string
- * @param senderIP The IP address of the sender as a string
+ * @param parts Fields of the message, without the protocol field
+ * @param user Receives the catalog version, and the files of older peers
+ * @return true if the message advertised a catalog version to fetch
  */
-void BroadcastDiscoveryService::handleDiscoveryResponse(const QString &message, const QString &senderIP)
+bool BroadcastDiscoveryService::readSharedFiles(const QStringList &parts, LANDropUser *user) const
 {
-    QStringList parts = message.split('|');
-    if (parts.size() >= 4)
-    {
-        quint16 discoveryPort = parts[1].toUShort();
-        quint16 transferPort = parts[2].toUShort();
-        QString hostname = parts[3];
+    if (parts.size() < 5)
+        return false;
 
-        QJsonArray sharedFiles;
-        if (parts.size() >= 5)
+    if (parts.size() == 5 && parts[4].startsWith(CATALOG_PREFIX))
+    {
+        bool isNumber = false;
+        quint64 version = parts[4].mid(CATALOG_PREFIX.size()).toULongLong(&isNumber, 16);
+        if (isNumber)
         {
-            try
-            {
-                QString sharedFilesJson = parts[4];
-                QJsonParseError error;
-                QJsonDocument doc = QJsonDocument::fromJson(sharedFilesJson.toUtf8(), &error);
-                if (error.error == QJsonParseError::NoError && doc.isArray())
-                {
-                    sharedFiles = doc.array();
-                }
-            }
-            catch (...)
-            {
-            }
+            user->catalogVersion = version;
+            return true;
         }
+    }
 
-        // Check if this is a self-message
-        if (isSelfMessage(senderIP, hostname))
-        {
-            return;
-        }
+    QString sharedFilesJson = parts.mid(4).join('|');
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(sharedFilesJson.toUtf8(), &error);
+    if (error.error == QJsonParseError::NoError && doc.isArray())
+    {
+        user->sharedFiles = doc.array();
+        user->catalogVersion = qHash(sharedFilesJson);
+    }
+    return false;
+}
 
+/**
+ * @brief Catalog version field of our discovery messages.
+ */
+QString BroadcastDiscoveryService::catalogField() const
+{
+    return CATALOG_PREFIX + QString::number(SharedCatalog::version(), 16);
+}
 
-        LANDropUser user(senderIP, hostname, transferPort, "1.0");
-        user.sharedFiles = sharedFiles;
-        updatePeerWithSharedFiles(user);
+/**
+ * @brief Removes the transfer protocol field from the end of a discovery message.
+ *
+ * Peers append "P<version>" after their shared files; older peers send no
+ * such field and only speak the line-based protocol.
+ *
+ * @param parts Fields of the message, without the protocol field afterwards
+ * @return Transfer protocol version of the peer, "1" if not announced
+ */
+QString BroadcastDiscoveryService::takeTransferProtocol(QStringList *parts)
+{
+    if (parts->size() >= 6)
+    {
+        const QString &last = parts->last();
+        bool isNumber = false;
+        int version = last.mid(TRANSFER_PROTOCOL_PREFIX.size()).toInt(&isNumber);
+        if (last.startsWith(TRANSFER_PROTOCOL_PREFIX) && isNumber && version > 0)
+        {
+            parts->removeLast();
+            return QString::number(version);
+        }
     }
+    return QString::number(Protocol::VERSION_1);
 }
 
 /**
@@ -361,66 +540,225 @@ void BroadcastDiscoveryService::performPeriodicBroadcast()
         return;
 
     sendDiscoveryBroadcast();
+    pacing.broadcastSent();
+    scheduleBroadcast();
+}
+
+/**
+ * @brief Arms the broadcast timer for the next broadcast, see DiscoveryPacing::nextBroadcastDelay().
+ */
+void BroadcastDiscoveryService::scheduleBroadcast()
+{
+    broadcastTimer->start(pacing.nextBroadcastDelay(int(peers.size()), isAllHeartbeating()));
+}
+
+/**
+ * @brief Broadcasts now and a few times more in quick succession, see DiscoveryPacing::startBurst().
+ */
+void BroadcastDiscoveryService::startBurst()
+{
+    if (pacing.startBurst())
+        performPeriodicBroadcast();
+}
+
+/**
+ * @brief Interval between regular broadcasts, see DiscoveryPacing::broadcastInterval().
+ */
+int BroadcastDiscoveryService::broadcastInterval() const
+{
+    return pacing.broadcastInterval(int(peers.size()), isAllHeartbeating());
+}
+
+/**
+ * @brief Whether every known peer sends heartbeats, so broadcasts only look for new ones.
+ */
+bool BroadcastDiscoveryService::isAllHeartbeating() const
+{
+    return !peers.isEmpty() && heartbeats.size() == peers.size();
+}
+
+/**
+ * @brief Whether a discovery request of a peer is answered, see DiscoveryPacing::shouldRespondTo().
+ */
+bool BroadcastDiscoveryService::shouldRespondTo(const QString &ipAddress)
+{
+    return pacing.shouldRespondTo(ipAddress, peers.contains(ipAddress), broadcastInterval());
+}
+
+/**
+ * @brief Interval between our heartbeats, growing with the number of peers.
+ */
+int BroadcastDiscoveryService::heartbeatInterval() const
+{
+    return qMin<qint64>(0xffff, qint64(HEARTBEAT_INTERVAL_MS) * (1 + peers.size() / DiscoveryPacing::PEERS_PER_INTERVAL));
+}
+
+/**
+ * @brief Sends a heartbeat to every known peer speaking the binary format,
+ * and removes peers whose heartbeats stopped.
+ *
+ * Peers on the subnets of our interfaces listening on DISCOVERY_PORT all
+ * hear a single broadcast, so the traffic of a network grows with the
+ * number of peers rather than its square. Only the others, found by a
+ * backend on other subnets or listening on another port, get a unicast.
+ *
+ * Peers that never sent a heartbeat are expired by cleanupExpiredUsers().
+ */
+void BroadcastDiscoveryService::sendHeartbeats()
+{
+    if (!discovering || !discoverySocket)
+        return;
+
+    DiscoveryMessage::HeartbeatMessage heartbeat;
+    heartbeat.sequence = heartbeatSequence++;
+    heartbeat.interval = quint16(heartbeatInterval());
+    heartbeat.catalogVersion = SharedCatalog::version();
+    QByteArray datagram = heartbeat.encode();
+
+    const InterfaceSnapshot *snapshot = InterfaceSnapshot::shared();
+    bool broadcast = false;
+    for (auto it = payloads.constBegin(); it != payloads.constEnd(); ++it)
+    {
+        if (!it->binary || !peers.contains(it.key()))
+            continue;
+
+        QHostAddress address(it.key());
+        if (it->discoveryPort == DISCOVERY_PORT && snapshot->isOnLocalSubnet(address))
+            broadcast = true;
+        else
+            sendDatagram(datagram, address, it->discoveryPort);
+    }
+    if (broadcast)
+        broadcastDatagram(datagram);
+
+    qint64 currentTime = pacing.now();
+    QStringList expired;
+    for (auto it = heartbeats.constBegin(); it != heartbeats.constEnd(); ++it)
+    {
+        if (currentTime > it->expires)
+            expired.append(it.key());
+    }
+    for (const QString &ip : expired)
+    {
+        // qDebug() << "BroadcastDiscoveryService: Heartbeats of" << ip << "stopped";
+        removePeer(ip);
+    }
+    if (!expired.isEmpty())
+        emit userListUpdated(users());
+
+    heartbeatTimer->setInterval(heartbeatInterval());
+}
+
+/**
+ * @brief Keeps a peer alive and follows its catalog version.
+ *
+ * A heartbeat of a peer not known, which knows us or broadcast it to its
+ * subnet, is answered with a request so the peer announces itself again.
+ */
+void BroadcastDiscoveryService::handleHeartbeat(const DiscoveryMessage::HeartbeatMessage &heartbeat,
+                                                const QHostAddress &sender, quint16 senderPort, const QString &senderIP)
+{
+    auto known = peers.constFind(senderIP);
+    if (known == peers.constEnd())
+    {
+        if (shouldRespondTo(senderIP))
+            sendDatagram(binaryMessage(DiscoveryMessage::Request), sender, senderPort);
+        return;
+    }
+
+    PeerHeartbeat &state = heartbeats[senderIP];
+    if (state.expires != 0 && state.sequence == heartbeat.sequence)
+        return;
+
+    state.sequence = heartbeat.sequence;
+    state.expires = pacing.now() + qint64(heartbeat.interval) * HEARTBEAT_TIMEOUT_TENTHS / 10;
+    pacing.noteAlive(senderIP);
+
+    if (heartbeat.catalogVersion != known->catalogVersion)
+    {
+        LANDropUser user = known.value();
+        user.catalogVersion = heartbeat.catalogVersion;
+        updatePeerWithCatalog(user);
+    }
 }
 
 /**
  * @brief Sends a broadcast message to discover peers on the local network.
  *
- * Constructs a discovery message containing hostname, ports, and shared files,
- * then broadcasts it using UDP. On Windows 11+, uses interface-specific
- * broadcast addresses for better compatibility, otherwise uses global broadcast.
+ * Broadcasts our hostname, ports and catalog version in the binary format,
+ * and again in text while peers only speaking text are known.
  */
 void BroadcastDiscoveryService::sendDiscoveryBroadcast()
 {
-    // Always rebuild message from current state to avoid stale data crashes
-    QString hostname = getLocalHostname();
-    quint16 transferPort = getTransferPort();
+    broadcastDatagram(binaryMessage(DiscoveryMessage::Request));
+
+    // Peers only reading text would not see the binary announcement
+    if (!textPeers.isEmpty())
+        broadcastDatagram(textMessage(TEXT_REQUEST_PREFIX));
+}
 
-    QString sharedFilesJson = cachedSharedFilesJson;
+/**
+ * @brief Builds our announcement in the binary format.
+ *
+ * Always rebuilt from current state to avoid stale data.
+ */
+QByteArray BroadcastDiscoveryService::binaryMessage(DiscoveryMessage::Type type) const
+{
+    DiscoveryMessage::Announcement announcement;
+    announcement.type = type;
+    announcement.discoveryPort = myDiscoveryPort;
+    announcement.transferPort = getTransferPort();
+    announcement.transferVersion = quint8(Protocol::VERSION_2);
+    announcement.catalogVersion = SharedCatalog::version();
+    announcement.hostname = getLocalHostname();
+    announcement.options.insert(ADDRESSES_OPTION, PathBonding::reachableAddresses().join(',').toUtf8());
+    return announcement.encode();
+}
 
-    QString message = QString("LANDROP_DISCOVERY_%1|%2|%3|%4|%5")
-                          .arg(PROTOCOL_VERSION)
+/**
+ * @brief Builds our announcement in the text format of older peers.
+ *
+ * @param prefix TEXT_REQUEST_PREFIX or TEXT_RESPONSE_PREFIX
+ */
+QByteArray BroadcastDiscoveryService::textMessage(const QByteArray &prefix) const
+{
+    QString message = QString("%1|%2|%3|%4|%5%6")
                           .arg(myDiscoveryPort)
-                          .arg(transferPort)
-                          .arg(hostname)
-                          .arg(sharedFilesJson);
+                          .arg(getTransferPort())
+                          .arg(getLocalHostname())
+                          .arg(catalogField())
+                          .arg(TRANSFER_PROTOCOL_PREFIX)
+                          .arg(Protocol::VERSION_2);
+    return prefix + message.toUtf8();
+}
 
+/**
+ * @brief Broadcasts a datagram on the discovery port.
+ *
+ * On Windows 11+, uses interface-specific broadcast addresses for better
+ * compatibility, otherwise uses global broadcast.
+ */
+void BroadcastDiscoveryService::broadcastDatagram(const QByteArray &message)
+{
 #ifdef Q_OS_WIN
     QOperatingSystemVersion version = QOperatingSystemVersion::current();
     if (version >= QOperatingSystemVersion::Windows11)
     {
 
         bool sentAny = false;
-        QList<QNetworkInterface> interfaces = QNetworkInterface::allInterfaces();
-        for (const QNetworkInterface &iface : interfaces)
+        const QList<QHostAddress> targets = InterfaceSnapshot::shared()->broadcastAddresses();
+        for (const QHostAddress &bcast : targets)
         {
-            if (!(iface.flags() & QNetworkInterface::IsUp) ||
-                !(iface.flags() & QNetworkInterface::IsRunning) ||
-                (iface.flags() & QNetworkInterface::IsLoopBack))
-            {
-                continue;
-            }
-
-            for (const QNetworkAddressEntry &entry : iface.addressEntries())
-            {
-                if (entry.ip().protocol() != QAbstractSocket::IPv4Protocol)
-                    continue;
-
-                QHostAddress bcast = entry.broadcast();
-                if (!bcast.isNull())
-                {
-                    qint64 result = discoverySocket->writeDatagram(message.toUtf8(), bcast, DISCOVERY_PORT);
-                    if (result > 0)
-                        sentAny = true;
-                }
-            }
+            qint64 result = sendDatagram(message, bcast, DISCOVERY_PORT);
+            if (result > 0)
+                sentAny = true;
         }
 
         // Fallback to global broadcast if no interface-specific broadcasts worked
         if (!sentAny)
         {
             QHostAddress broadcastAddress("255.255.255.255");
-            qint64 result = discoverySocket->writeDatagram(message.toUtf8(), broadcastAddress, DISCOVERY_PORT);
+            qint64 result = sendDatagram(message, broadcastAddress, DISCOVERY_PORT);
         }
     }
     else
@@ -428,81 +766,251 @@ void BroadcastDiscoveryService::sendDiscoveryBroadcast()
     {
         // behavior for Win10 and maybe other OSes
         QHostAddress broadcastAddress("255.255.255.255");
-        qint64 result = discoverySocket->writeDatagram(message.toUtf8(), broadcastAddress, DISCOVERY_PORT);
+        qint64 result = sendDatagram(message, broadcastAddress, DISCOVERY_PORT);
     }
 }
 
+/**
+ * @brief Writes one discovery datagram and counts it in TransferMetrics.
+ *
+ * @return Bytes sent, -1 on error
+ */
+qint64 BroadcastDiscoveryService::sendDatagram(const QByteArray &message, const QHostAddress &address, quint16 port)
+{
+    qint64 result = discoverySocket->writeDatagram(message, address, port);
+    if (result > 0)
+        TransferMetrics::countDiscovery(false);
+    return result;
+}
 
 /**
  * @brief Updates or adds a discovered user with complete shared file information.
- * 
+ *
+ * A hostname seen before under another address is a peer that moved, it is
+ * removed there and added again. Announcements repeating what is known only
+ * refresh the peer's last seen time.
+ *
  * @param user Complete LANDropUser object with IP, hostname, ports, and shared files
  */
 void BroadcastDiscoveryService::updatePeerWithSharedFiles(const LANDropUser &user)
 {
-    qint64 currentTime = QDateTime::currentMSecsSinceEpoch();
-    lastSeenTimes[user.ipAddress] = currentTime;
+    QString previousIP = hostAddresses.value(user.hostname);
+    if (!previousIP.isEmpty() && previousIP != user.ipAddress)
+        removePeer(previousIP);
 
-    bool found = false;
-    for (int i = 0; i < discoveredUsers.size(); ++i)
+    auto it = peers.find(user.ipAddress);
+    if (it == peers.end())
     {
-        if (discoveredUsers[i].ipAddress == user.ipAddress || discoveredUsers[i].hostname == user.hostname)
-        {
-            discoveredUsers[i] = user;
-            found = true;
-            break;
-        }
+        peers.insert(user.ipAddress, user);
+        peerOrder.append(user.ipAddress);
+        hostAddresses.insert(user.hostname, user.ipAddress);
+        emit peerAdded(user);
+        emit userListUpdated(users());
+        return;
     }
 
-    if (!found)
+    int fields = changedFields(it.value(), user);
+    if (fields == 0)
+        return;
+
+    if (fields & HostnameField)
     {
-        discoveredUsers.append(user);
+        hostAddresses.remove(it.value().hostname);
+        hostAddresses.insert(user.hostname, user.ipAddress);
     }
+    it.value() = user;
+    emit peerChanged(user, fields);
+    emit userListUpdated(users());
+}
 
-    emit userListUpdated(discoveredUsers);
+/**
+ * @brief Updates a peer that advertised a catalog version.
+ *
+ * The files already held are kept while the version matches. Otherwise
+ * the peer keeps showing them until the advertised catalog was fetched,
+ * and a peer advertising version 0 shares nothing.
+ *
+ * @param user Peer as announced, without its files
+ */
+void BroadcastDiscoveryService::updatePeerWithCatalog(LANDropUser user)
+{
+    quint64 advertised = user.catalogVersion;
+    auto known = peers.constFind(user.ipAddress);
+    if (advertised != 0 && (known == peers.constEnd() || known->catalogVersion != advertised))
+    {
+        user.catalogVersion = (known != peers.constEnd()) ? known->catalogVersion : 0;
+        user.sharedFiles = (known != peers.constEnd()) ? known->sharedFiles : QJsonArray();
+        updatePeerWithSharedFiles(user);
+        fetchCatalog(user);
+        return;
+    }
+
+    if (advertised != 0)
+        user.sharedFiles = known->sharedFiles;
+    updatePeerWithSharedFiles(user);
+}
+
+/**
+ * @brief Starts downloading a peer's catalog unless a download is running.
+ *
+ * Only the changes since the files held are asked for. A failed download
+ * is retried in full when the peer advertises itself again.
+ *
+ * @param user Peer to ask, with the files held
+ */
+void BroadcastDiscoveryService::fetchCatalog(const LANDropUser &user)
+{
+    if (catalogFetchers.contains(user.ipAddress))
+        return;
+
+    CatalogFetcher *fetcher = new CatalogFetcher(this);
+    catalogFetchers.insert(user.ipAddress, fetcher);
+    connect(fetcher, &CatalogFetcher::catalogFetched, this,
+            [this, fetcher](const QString &ip, quint64 version, quint64 generation, const QJsonArray &files)
+            {
+        catalogFetchers.remove(ip);
+        fetcher->deleteLater();
+        onCatalogFetched(ip, version, generation, files); });
+    connect(fetcher, &CatalogFetcher::fetchFailed, this, [this, fetcher](const QString &ip)
+            {
+        // qDebug() << "BroadcastDiscoveryService: Catalog of" << ip << "could not be fetched";
+        catalogFetchers.remove(ip);
+        catalogGenerations.remove(ip);
+        fetcher->deleteLater(); });
+    if (catalogGenerations.contains(user.ipAddress))
+        fetcher->setBase(user.sharedFiles, catalogGenerations.value(user.ipAddress), user.catalogVersion);
+    fetcher->fetch(user.ipAddress, user.transferPort, Protocol::versionFromDiscovery(user.version));
+}
+
+/**
+ * @brief Gives a peer the files of its fetched catalog.
+ */
+void BroadcastDiscoveryService::onCatalogFetched(const QString &ipAddress, quint64 catalogVersion, quint64 generation,
+                                                 const QJsonArray &files)
+{
+    auto it = peers.constFind(ipAddress);
+    if (it == peers.constEnd())
+        return;
+
+    catalogGenerations.insert(ipAddress, generation);
+    LANDropUser user = it.value();
+    user.sharedFiles = files;
+    user.catalogVersion = catalogVersion;
+    updatePeerWithSharedFiles(user);
+}
+
+/**
+ * @brief Compares two announcements of the same peer.
+ *
+ * Shared files are compared by catalog version, without walking the lists.
+ *
+ * @return PeerField bits of the fields that differ
+ */
+int BroadcastDiscoveryService::changedFields(const LANDropUser &before, const LANDropUser &after)
+{
+    int fields = 0;
+    if (before.hostname != after.hostname)
+        fields |= HostnameField;
+    if (before.transferPort != after.transferPort)
+        fields |= PortField;
+    if (before.version != after.version)
+        fields |= VersionField;
+    if (before.catalogVersion != after.catalogVersion || before.sharedFileCount() != after.sharedFileCount())
+        fields |= SharedFilesField;
+    return fields;
+}
+
+/**
+ * @brief Forgets a peer and emits peerRemoved().
+ *
+ * @param ipAddress Address the peer was discovered at
+ */
+void BroadcastDiscoveryService::removePeer(const QString &ipAddress)
+{
+    auto it = peers.find(ipAddress);
+    if (it == peers.end())
+        return;
+
+    if (hostAddresses.value(it.value().hostname) == ipAddress)
+        hostAddresses.remove(it.value().hostname);
+    peers.erase(it);
+    peerOrder.removeOne(ipAddress);
+    pacing.forget(ipAddress);
+    payloads.remove(ipAddress);
+    textPeers.remove(ipAddress);
+    backendPeers.remove(ipAddress);
+    heartbeats.remove(ipAddress);
+    delete catalogFetchers.take(ipAddress);
+    catalogGenerations.remove(ipAddress);
+    PathBonding::removePeer(ipAddress);
+    emit peerRemoved(ipAddress);
+}
+
+/**
+ * @brief Forgets every peer, used when discovery starts or stops.
+ */
+void BroadcastDiscoveryService::clearPeers()
+{
+    bool anyRemoved = !peerOrder.isEmpty();
+    const QStringList addresses = peerOrder;
+    for (const QString &ip : addresses)
+        removePeer(ip);
+    pacing.clear();
+    payloads.clear();
+    textPeers.clear();
+    backendPeers.clear();
+    heartbeats.clear();
+
+    if (anyRemoved)
+        emit userListUpdated(users());
 }
 
 /**
  * @brief Removes expired and invalid users from the discovered users list.
- * 
+ *
+ * A user missing two of its announcements starts a rediscovery burst, so a
+ * peer whose datagrams were lost answers before it expires.
  */
 void BroadcastDiscoveryService::cleanupExpiredUsers()
 {
-    qint64 currentTime = QDateTime::currentMSecsSinceEpoch();
     bool anyRemoved = false;
+    bool anyQuiet = false;
     QString localIP = getLocalIPAddress();
     QString localHostname = getLocalHostname();
 
-    for (int i = discoveredUsers.size() - 1; i >= 0; --i)
+    const QStringList addresses = peerOrder;
+    for (const QString &ip : addresses)
     {
-        QString ip = discoveredUsers[i].ipAddress;
-        QString hostname = discoveredUsers[i].hostname;
-        qint64 lastSeen = lastSeenTimes.value(ip, 0);
-        qint64 timeSinceLastSeen = currentTime - lastSeen;
+        QString hostname = peers.value(ip).hostname;
 
-        // Remove self-entries if they exist
+        // Remove self-entries if they exist, and expired users
         if (ip == localIP || hostname == localHostname)
         {
-            discoveredUsers.removeAt(i);
-            lastSeenTimes.remove(ip);
+            removePeer(ip);
             anyRemoved = true;
+        }
+        else if (backendPeers.contains(ip) || heartbeats.contains(ip))
+        {
+            // Withdrawn by the backend that reported it, or expired by heartbeats
             continue;
         }
-
-        // Remove expired users
-        if (timeSinceLastSeen > USER_TIMEOUT_MS)
+        else if (pacing.hasExpired(ip))
         {
-            int secondsSinceLastPing = timeSinceLastSeen / 1000;
-            discoveredUsers.removeAt(i);
-            lastSeenTimes.remove(ip);
+            removePeer(ip);
             anyRemoved = true;
         }
+        else if (pacing.wentQuiet(ip))
+        {
+            anyQuiet = true;
+        }
     }
 
     if (anyRemoved)
     {
-        emit userListUpdated(discoveredUsers);
+        emit userListUpdated(users());
     }
+    if (anyQuiet)
+        startBurst();
 }
 
 /**
@@ -511,25 +1019,44 @@ void BroadcastDiscoveryService::cleanupExpiredUsers()
  */
 void BroadcastDiscoveryService::requestUserListUpdate()
 {
-    emit userListUpdated(discoveredUsers);
+    emit userListUpdated(users());
 }
 
 /**
- * @brief Sets the shared file manager and initializes periodic file scanning.
+ * @brief Currently discovered users, in discovery order.
+ */
+QList<LANDropUser> BroadcastDiscoveryService::users() const
+{
+    QList<LANDropUser> list;
+    list.reserve(peerOrder.size());
+    for (const QString &ip : peerOrder)
+        list.append(peers.value(ip));
+    return list;
+}
+
+/**
+ * @brief Sets the shared file manager whose index is published to peers.
  *
- * Associates a SharedFileManager instance with this discovery service and
- * starts periodic scanning of shared files.
+ * The catalog is published again whenever the manager reports a change.
  *
  * @param manager Pointer to the SharedFileManager instance
  */
 void BroadcastDiscoveryService::setSharedFileManager(SharedFileManager *manager)
 {
-    sharedFileManager = manager; 
-    // Ignore the SharedFileManager and scan files directly
-    scanSharedFilesDirectly();
-    
-    // Start periodic rescanning every 10 seconds
-    fileScanTimer->start(10000);
+    if (sharedFileManager)
+        disconnect(sharedFileManager, nullptr, this, nullptr);
+
+    sharedFileManager = manager;
+    if (sharedFileManager)
+    {
+        connect(sharedFileManager, &SharedFileManager::sharedFilesChanged,
+                this, &BroadcastDiscoveryService::publishSharedFiles);
+
+        // Published again with the hashes peers download from several sources by
+        connect(sharedFileManager, &SharedFileManager::indexHashed,
+                this, &BroadcastDiscoveryService::publishSharedFiles);
+    }
+    publishSharedFiles();
 }
 
 /**
@@ -539,52 +1066,20 @@ void BroadcastDiscoveryService::setSharedFileManager(SharedFileManager *manager)
  */
 QString BroadcastDiscoveryService::getLocalHostname() const
 {
-    return QSysInfo::machineHostName();
+    return InterfaceSnapshot::shared()->hostname();
 }
 
 /**
  * @brief Retrieves the local machine's primary IP address.
  *
+ * Read from the shared InterfaceSnapshot, so self-detection costs no
+ * interface enumeration per datagram.
+ *
  * @return Local IP address as string, or empty string if no valid interface found
  */
 QString BroadcastDiscoveryService::getLocalIPAddress() const
 {
-    const QList<QNetworkInterface> interfaces = QNetworkInterface::allInterfaces();
-
-    for (const QNetworkInterface &interface : interfaces)
-    {
-        if (!(interface.flags() & QNetworkInterface::IsUp) ||
-            (interface.flags() & QNetworkInterface::IsLoopBack))
-        {
-            continue;
-        }
-
-        // Only use ethernet or wifi interfaces for local IP
-        QString name = interface.name().toLower();
-        QNetworkInterface::InterfaceType type = interface.type();
-        
-        if (type != QNetworkInterface::Ethernet && 
-            type != QNetworkInterface::Wifi &&
-            !name.contains("ethernet") &&
-            !name.contains("wifi") &&
-            !name.contains("wlan") &&
-            !name.contains("eth"))
-        {
-            continue;
-        }
-
-        for (const QNetworkAddressEntry &entry : interface.addressEntries())
-        {
-            QHostAddress ip = entry.ip();
-            if (ip.protocol() == QAbstractSocket::IPv4Protocol &&
-                !ip.isLoopback() && !ip.isMulticast())
-            {
-                return ip.toString();
-            }
-        }
-    }
-
-    return QString();
+    return InterfaceSnapshot::shared()->discoveryIP();
 }
 
 /**
@@ -13,13 +13,20 @@
 #include <QNetworkInterface>
 #include <QSysInfo>
 #include <QMap>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
 #include <QJsonArray>
 #include <QString>
 #include <QList>
 #include <QDebug>
+#include "../network/discoverymessage.h"
+#include "discoverypacing.h"
 
 // Forward declaration
 class SharedFileManager;
+class CatalogFetcher;
+class DiscoveryBackend;
 
 /**
  * @struct LANDropUser
@@ -38,11 +45,17 @@ struct LANDropUser {
     /** TCP port for file transfer connections */
     quint16 transferPort;
     
-    /** Protocol version string */
+    /** Transfer protocol version the peer advertised ("1" or "2") */
     QString version;
     
     /** JSON array of files shared by this user */
     QJsonArray sharedFiles;
+
+    /** Fingerprint of the shared files as announced, changes whenever they do */
+    quint64 catalogVersion = 0;
+
+    /** Addresses of all the user's interfaces as announced, empty if it did not list them */
+    QStringList addresses;
     
     LANDropUser() = default;
     LANDropUser(const QString &ip, const QString &host, quint16 port, const QString &ver) 
@@ -64,24 +77,97 @@ Q_DECLARE_METATYPE(LANDropUser)
  * This service handles peer discovery by broadcasting UDP packets on a fixed port
  * and listening for responses from other LANDrop instances. It maintains a list
  * of discovered users and their shared files, with automatic cleanup of expired entries.
+ *
+ * Peers announce themselves every few seconds, mostly with nothing new. The
+ * peer table is indexed by IP address, and peerAdded(), peerChanged() and
+ * peerRemoved() are only emitted for real changes, as is userListUpdated().
+ *
+ * Datagrams advertise the version of the sender's SharedCatalog instead of
+ * the files themselves, which would not fit past a few hundred files. A
+ * peer's files are fetched with a CatalogFetcher when it advertises a
+ * version not held yet. The JSON listing of older peers is still read.
+ *
+ * Announcements use the binary DiscoveryMessage format. Peers heard in the
+ * older text format are answered in text, and broadcasts are repeated in
+ * text while such peers are known.
+ * Binary announcements also list the addresses of all our interfaces,
+ * which PathBonding keeps for the peer to bond striped transfers over.
+ *
+ * Once known, peers speaking the binary format keep each other alive with
+ * heartbeats every second, one broadcast for the peers of our subnets and
+ * unicasts for the others, and are removed after missing a few, so
+ * broadcasts are only needed to find new peers and slow down meanwhile.
+ *
+ * DiscoveryBackend instances feed the same peer table by other means, an
+ * MdnsDiscoveryBackend unless disabled in Config, and a
+ * RegistryDiscoveryBackend reaching other subnets when one is configured.
  */
 class BroadcastDiscoveryService : public QObject
 {
     Q_OBJECT
 
 public:
-    explicit BroadcastDiscoveryService(QObject *parent = nullptr);
+    /** Fields of a peer reported by peerChanged(). */
+    enum PeerField : int
+    {
+        HostnameField = 0x01,
+        PortField = 0x02,
+        VersionField = 0x04,
+        SharedFilesField = 0x08
+    };
+
+    /** Counters of the datagrams read since discovery started. */
+    struct ParseStats
+    {
+        /** Datagrams parsed in full. */
+        qint64 parsed = 0;
+
+        /** Datagrams repeating the sender's previous one, not parsed again. */
+        qint64 skipped = 0;
+
+        /** @brief Share of the datagrams not parsed, 0 when none was read. */
+        double skipRate() const { return parsed + skipped > 0 ? double(skipped) / (parsed + skipped) : 0.0; }
+    };
+
+    explicit BroadcastDiscoveryService(QObject *parent = nullptr, bool start = true);
     ~BroadcastDiscoveryService();
 
     void startDiscovery();
     void stopDiscovery();
     void requestUserListUpdate();
     void setSharedFileManager(SharedFileManager *manager);
-    
+    QList<LANDropUser> users() const;
+
+    /** @brief Whether discovery runs, false if the discovery port could not be bound. */
+    bool isDiscovering() const { return discovering; }
+
+    void addBackend(DiscoveryBackend *backend);
+
+    /** @brief UDP port discovery is bound to, DISCOVERY_PORT unless it was taken. */
+    quint16 discoveryPort() const { return myDiscoveryPort; }
+
+    /** @brief Counters of the datagrams read, see ParseStats. */
+    ParseStats parseStats() const { return stats; }
+
+    /** Option of binary announcements listing the addresses of all our interfaces, comma separated */
+    static const QByteArray ADDRESSES_OPTION;
 
 signals:
     /** @brief Emitted when the complete user list is updated */
     void userListUpdated(const QList<LANDropUser> &users);
+
+    /** @brief Emitted when a peer is discovered */
+    void peerAdded(const LANDropUser &user);
+
+    /**
+     * @brief Emitted when an announcement changed a known peer.
+     * @param user Peer as announced now
+     * @param changedFields PeerField bits of what changed
+     */
+    void peerChanged(const LANDropUser &user, int changedFields);
+
+    /** @brief Emitted when a peer timed out or discovery stopped */
+    void peerRemoved(const QString &ipAddress);
     
     /** @brief Emitted when discovery service starts */
     void discoveryStarted();
@@ -97,14 +183,43 @@ private slots:
 private:
     bool findAndBindAvailablePort();
     void sendDiscoveryBroadcast();
-    void handleDiscoveryRequest(const QString &message, const QHostAddress &sender, const QString &senderIP);
-    void handleDiscoveryResponse(const QString &message, const QString &senderIP);
+    struct PeerPayload;
+    bool parseDatagram(const QByteArray &datagram, const QString &senderIP, PeerPayload *payload) const;
+    void handleAnnouncement(const PeerPayload &payload, const QHostAddress &sender);
+    bool handleRepeatedPayload(const QByteArray &datagram, const QHostAddress &sender, const QString &senderIP);
+    void sendDiscoveryResponse(const QHostAddress &receiver, quint16 port, bool binary);
+    QByteArray binaryMessage(DiscoveryMessage::Type type) const;
+    QByteArray textMessage(const QByteArray &prefix) const;
+    void broadcastDatagram(const QByteArray &message);
+    qint64 sendDatagram(const QByteArray &message, const QHostAddress &address, quint16 port);
+    LANDropUser localUser() const;
+    void updateBackends();
+    void onBackendPeerFound(const LANDropUser &user);
+    void onBackendPeerLost(const QString &ipAddress);
+    void handleHeartbeat(const DiscoveryMessage::HeartbeatMessage &heartbeat, const QHostAddress &sender,
+                         quint16 senderPort, const QString &senderIP);
+    void sendHeartbeats();
+    int heartbeatInterval() const;
     QString getLocalHostname() const;
     QString getLocalIPAddress() const;
     quint16 getTransferPort() const;
     void updatePeerWithSharedFiles(const LANDropUser &user);
-    void scanSharedFilesDirectly();
+    void updatePeerWithCatalog(LANDropUser user);
+    void fetchCatalog(const LANDropUser &user);
+    void onCatalogFetched(const QString &ipAddress, quint64 catalogVersion, quint64 generation, const QJsonArray &files);
+    bool readSharedFiles(const QStringList &parts, LANDropUser *user) const;
+    QString catalogField() const;
+    void removePeer(const QString &ipAddress);
+    void clearPeers();
+    static int changedFields(const LANDropUser &before, const LANDropUser &after);
+    void publishSharedFiles();
     bool isSelfMessage(const QString &senderIP, const QString &hostname) const;
+    static QString takeTransferProtocol(QStringList *parts);
+    bool shouldRespondTo(const QString &ipAddress);
+    void scheduleBroadcast();
+    void startBurst();
+    int broadcastInterval() const;
+    bool isAllHeartbeating() const;
 
     /** UDP socket for discovery communications */
     QUdpSocket *discoverySocket;
@@ -114,18 +229,76 @@ private:
     
     /** Timer for cleaning up expired user entries */
     QTimer *cleanupTimer;
+
+    /** Timer sending heartbeats and expiring peers that stopped sending theirs */
+    QTimer *heartbeatTimer;
     
-    /** List of currently discovered users */
-    QList<LANDropUser> discoveredUsers;
-    
-    /** Map tracking last seen times for each user */
-    QMap<QString, qint64> lastSeenTimes;
+    /** Currently discovered users by IP address */
+    QHash<QString, LANDropUser> peers;
+
+    /** IP addresses of the discovered users, in discovery order */
+    QStringList peerOrder;
+
+    /** IP address of each discovered hostname */
+    QHash<QString, QString> hostAddresses;
     
+    /** When to broadcast and answer, and when users time out */
+    DiscoveryPacing pacing;
+
+    /**
+     * @brief Last datagram of a peer and what was read from it.
+     */
+    struct PeerPayload
+    {
+        QByteArray datagram;
+        LANDropUser user;
+
+        /** Whether the datagram advertised a catalog version */
+        bool advertised = false;
+
+        /** Whether it was a discovery request, answered on discoveryPort */
+        bool request = false;
+        quint16 discoveryPort = 0;
+
+        /** Whether it was in the binary format rather than text */
+        bool binary = false;
+    };
+
+    /** Last datagram of each user, by IP address */
+    QHash<QString, PeerPayload> payloads;
+
+    /** Counters of the datagrams read */
+    ParseStats stats;
+
+    /** Users last heard in the text format, broadcast to in text as well */
+    QSet<QString> textPeers;
+
+    /** Additional discovery mechanisms, see DiscoveryBackend */
+    QList<DiscoveryBackend *> backends;
+
+    /** Users reported by a backend, which are not expired but withdrawn by it */
+    QSet<QString> backendPeers;
+
+    /**
+     * @brief Heartbeats received from a user.
+     */
+    struct PeerHeartbeat
+    {
+        quint32 sequence = 0;
+
+        /** When the user is removed unless another heartbeat arrives, in milliseconds since the epoch */
+        qint64 expires = 0;
+    };
+
+    /** Users sending heartbeats, expired by them rather than by their announcements, by IP address */
+    QHash<QString, PeerHeartbeat> heartbeats;
+
+    /** Sequence number of our next heartbeat */
+    quint32 heartbeatSequence = 0;
+
     /** Current discovery state */
     bool discovering;
     
-    /** Interval between discovery broadcasts in milliseconds */
-    int discoveryInterval;
     
     /** Our assigned discovery port */
     quint16 myDiscoveryPort;
@@ -133,21 +306,37 @@ private:
     /** Shared file manager for broadcasting file lists */
     SharedFileManager *sharedFileManager;
     
-    /** Cached shared files JSON to avoid frequent calls */
-    QString cachedSharedFilesJson;
-    
-    /** Timer for periodic file rescanning */
-    QTimer *fileScanTimer;
+    /** Catalog downloads in progress, by peer IP address */
+    QHash<QString, CatalogFetcher *> catalogFetchers;
+
+    /** Generation of each peer's catalog its files were fetched at, by IP address */
+    QHash<QString, quint64> catalogGenerations;
     
     
     /** Fixed UDP port for discovery communications */
     static const quint16 DISCOVERY_PORT = 12346;
     
-    /** Protocol version identifier */
+    /** Protocol version identifier of the text format */
     static const QString PROTOCOL_VERSION;
+
+    /** Prefix of the transfer protocol version field ("P2") ending each message */
+    static const QString TRANSFER_PROTOCOL_PREFIX;
+
+    /** Prefix of the catalog version field ("C<hex version>") in place of the files */
+    static const QString CATALOG_PREFIX;
+
+    /** First bytes of text requests and responses */
+    static const QByteArray TEXT_REQUEST_PREFIX;
+    static const QByteArray TEXT_RESPONSE_PREFIX;
     
-    /** Timeout for removing inactive users */
-    static const int USER_TIMEOUT_MS = 15000;
+    /** Interval of the timer checking for quiet and expired users */
+    static const int CLEANUP_INTERVAL_MS = 5000;
+
+    /** Interval between heartbeats, growing like broadcasts with the number of peers, see DiscoveryPacing */
+    static const int HEARTBEAT_INTERVAL_MS = 1000;
+
+    /** Heartbeat intervals of a user, in tenths, after which it is removed */
+    static const int HEARTBEAT_TIMEOUT_TENTHS = 25;
 };
 
 
@@ -0,0 +1,370 @@
+/**
+ * @file catalogsearch.cpp
+ */
+
+#include "catalogsearch.h"
+#include <QRegularExpression>
+#include <QSet>
+
+namespace
+{
+    QString fileNameOf(const QJsonObject &fileInfo)
+    {
+        QString name = fileInfo["name"].toString();
+        if (!name.isEmpty())
+            return name;
+        QString path = fileInfo["path"].toString();
+        return path.mid(path.lastIndexOf('/') + 1);
+    }
+
+    /** Sizes are announced as strings, older catalogs sent numbers. */
+    qint64 fileSizeOf(const QJsonObject &fileInfo)
+    {
+        QJsonValue size = fileInfo["size"];
+        return size.isString() ? size.toString().toLongLong() : qint64(size.toDouble());
+    }
+}
+
+/**
+ * @brief Indexes a peer's catalog as it is now.
+ *
+ * Entries whose path is indexed already are updated in place, new ones are
+ * added and the ones no longer listed removed. "directory" entries are
+ * left out.
+ *
+ * @param peer Address of the peer
+ * @param files Entries of the catalog
+ */
+void CatalogSearch::setCatalog(const QString &peer, const QJsonArray &files)
+{
+    int number = peerNumber(peer);
+    QHash<QString, int> gone = pathsOfPeer[number];
+
+    for (const QJsonValue &fileValue : files)
+    {
+        if (!fileValue.isObject())
+            continue;
+
+        QJsonObject fileInfo = fileValue.toObject();
+        if (fileInfo["type"].toString() == "directory")
+            continue;
+
+        QString path = fileInfo["path"].toString();
+        int id = pathsOfPeer[number].value(path, -1);
+        if (id >= 0)
+            update(id, fileInfo);
+        else
+            insert(number, fileInfo);
+        gone.remove(path);
+    }
+
+    for (int id : gone)
+        remove(id);
+    compact();
+}
+
+/**
+ * @brief Applies the changes of a catalog delta to the entries of a peer.
+ *
+ * @param peer Address of the peer
+ * @param changes Entries added or changed and {"path", "removed": true} for the ones removed
+ */
+void CatalogSearch::applyChanges(const QString &peer, const QJsonArray &changes)
+{
+    int number = peerNumber(peer);
+    for (const QJsonValue &changeValue : changes)
+    {
+        QJsonObject change = changeValue.toObject();
+        int id = pathsOfPeer[number].value(change["path"].toString(), -1);
+        if (change["removed"].toBool() || change["type"].toString() == "directory")
+        {
+            if (id >= 0)
+                remove(id);
+        }
+        else if (id >= 0)
+        {
+            update(id, change);
+        }
+        else if (!change["path"].toString().isEmpty())
+        {
+            insert(number, change);
+        }
+    }
+    compact();
+}
+
+/**
+ * @brief Removes every entry of a peer no longer discovered.
+ *
+ * @param peer Address of the peer
+ */
+void CatalogSearch::removePeer(const QString &peer)
+{
+    auto number = peerNumbers.constFind(peer);
+    if (number == peerNumbers.constEnd())
+        return;
+
+    const QList<int> ids = pathsOfPeer[*number].values();
+    for (int id : ids)
+        remove(id);
+    compact();
+}
+
+/**
+ * @brief Removes every entry.
+ */
+void CatalogSearch::clear()
+{
+    entries.clear();
+    pathsOfPeer.clear();
+    peers.clear();
+    peerNumbers.clear();
+    names.clear();
+    trigrams.clear();
+    live = 0;
+    postings = 0;
+    stalePostings = 0;
+}
+
+/**
+ * @brief Finds the entries matching a query.
+ *
+ * Entries whose name starts with the first word come first, then the
+ * other entries containing every word, in the order they were indexed. A
+ * query of words shorter than three letters only finds names starting
+ * with the first word; a query without words lists every entry passing
+ * the filters.
+ *
+ * @param query Words and filters
+ * @return At most Query::limit hits
+ */
+QList<CatalogSearch::Hit> CatalogSearch::search(const Query &query) const
+{
+    static const QRegularExpression whitespace("\\s+");
+    const QStringList words = query.text.toLower().split(whitespace, Qt::SkipEmptyParts);
+
+    Query filters = query;
+    filters.types.clear();
+    for (const QString &type : query.types)
+    {
+        QString normalized = type.trimmed().toLower();
+        if (normalized.startsWith('.'))
+            normalized.remove(0, 1);
+        if (!normalized.isEmpty())
+            filters.types.append(normalized);
+    }
+
+    QList<Hit> hits;
+    QSet<int> taken;
+    auto add = [&](int id)
+    {
+        const Entry &entry = entries[id];
+        Hit hit;
+        hit.peer = peers[entry.peer];
+        hit.path = entry.path;
+        hit.name = entry.name;
+        hit.size = entry.size;
+        hit.hash = entry.hash;
+        hits.append(hit);
+        taken.insert(id);
+    };
+
+    if (words.isEmpty())
+    {
+        for (int id = 0; id < entries.size() && hits.size() < query.limit; ++id)
+        {
+            if (matches(entries[id], words, filters))
+                add(id);
+        }
+        return hits;
+    }
+
+    // Names starting with the first word
+    const QString &prefix = words.first();
+    for (auto name = names.lowerBound(prefix); name != names.constEnd() && hits.size() < query.limit; ++name)
+    {
+        if (!name.key().startsWith(prefix))
+            break;
+        if (matches(entries[name.value()], words, filters))
+            add(name.value());
+    }
+
+    // Any path containing every word, verified from the rarest trigram
+    const QVector<int> *candidates = nullptr;
+    for (const QString &word : words)
+    {
+        for (int at = 0; at + 3 <= word.size(); ++at)
+        {
+            auto posting = trigrams.constFind(trigram(word, at));
+            if (posting == trigrams.constEnd())
+                return hits;
+            if (!candidates || posting->size() < candidates->size())
+                candidates = &*posting;
+        }
+    }
+    if (!candidates)
+        return hits;
+
+    for (int id : *candidates)
+    {
+        if (hits.size() >= query.limit)
+            break;
+        if (!taken.contains(id) && matches(entries[id], words, filters))
+            add(id);
+    }
+    return hits;
+}
+
+/**
+ * @brief Extension of a name, lowercase and without the dot, empty if it has none.
+ */
+QString CatalogSearch::typeOf(const QString &name)
+{
+    int dot = name.lastIndexOf('.');
+    return dot <= 0 ? QString() : name.mid(dot + 1).toLower();
+}
+
+int CatalogSearch::peerNumber(const QString &peer)
+{
+    auto number = peerNumbers.constFind(peer);
+    if (number != peerNumbers.constEnd())
+        return *number;
+
+    peers.append(peer);
+    pathsOfPeer.append(QHash<QString, int>());
+    peerNumbers.insert(peer, peers.size() - 1);
+    return peers.size() - 1;
+}
+
+void CatalogSearch::insert(int peer, const QJsonObject &fileInfo)
+{
+    Entry entry;
+    entry.peer = peer;
+    entry.path = fileInfo["path"].toString();
+    entry.name = fileNameOf(fileInfo);
+    entry.lowerPath = entry.path.toLower();
+    entry.size = fileSizeOf(fileInfo);
+    entry.hash = fileInfo["hash"].toString().toLatin1();
+    entries.append(entry);
+
+    int id = entries.size() - 1;
+    pathsOfPeer[peer].insert(entry.path, id);
+    indexEntry(id);
+    ++live;
+}
+
+/**
+ * @brief Takes the size, hash and name of an entry listed again, its path stays.
+ */
+void CatalogSearch::update(int id, const QJsonObject &fileInfo)
+{
+    Entry &entry = entries[id];
+    entry.size = fileSizeOf(fileInfo);
+    entry.hash = fileInfo["hash"].toString().toLatin1();
+
+    QString name = fileNameOf(fileInfo);
+    if (name != entry.name)
+    {
+        names.remove(entry.name.toLower(), id);
+        entry.name = name;
+        names.insert(name.toLower(), id);
+    }
+}
+
+/**
+ * @brief Drops an entry from the name map, its postings stay until the next rebuild.
+ */
+void CatalogSearch::remove(int id)
+{
+    Entry &entry = entries[id];
+    names.remove(entry.name.toLower(), id);
+    pathsOfPeer[entry.peer].remove(entry.path);
+    entry.removed = true;
+    entry.path.clear();
+    entry.name.clear();
+    entry.lowerPath.clear();
+    entry.hash.clear();
+    stalePostings += entry.trigramCount;
+    --live;
+}
+
+/**
+ * @brief Adds an entry's name and the distinct trigrams of its path.
+ */
+void CatalogSearch::indexEntry(int id)
+{
+    Entry &entry = entries[id];
+    names.insert(entry.name.toLower(), id);
+
+    QSet<quint64> seen;
+    for (int at = 0; at + 3 <= entry.lowerPath.size(); ++at)
+    {
+        quint64 gram = trigram(entry.lowerPath, at);
+        if (seen.contains(gram))
+            continue;
+        seen.insert(gram);
+        trigrams[gram].append(id);
+    }
+    entry.trigramCount = seen.size();
+    postings += seen.size();
+}
+
+/**
+ * @brief Rebuilds the index once removed entries left half the postings.
+ */
+void CatalogSearch::compact()
+{
+    if (stalePostings * 2 > postings || (live == 0 && !entries.isEmpty()))
+        rebuild();
+}
+
+/**
+ * @brief Renumbers the entries left and indexes them again.
+ */
+void CatalogSearch::rebuild()
+{
+    QVector<Entry> kept;
+    kept.reserve(live);
+    for (const Entry &entry : entries)
+    {
+        if (!entry.removed)
+            kept.append(entry);
+    }
+
+    entries.swap(kept);
+    names.clear();
+    trigrams.clear();
+    postings = 0;
+    stalePostings = 0;
+    for (QHash<QString, int> &paths : pathsOfPeer)
+        paths.clear();
+
+    for (int id = 0; id < entries.size(); ++id)
+    {
+        pathsOfPeer[entries[id].peer].insert(entries[id].path, id);
+        indexEntry(id);
+    }
+}
+
+bool CatalogSearch::matches(const Entry &entry, const QStringList &words, const Query &query) const
+{
+    if (entry.removed || entry.size < query.minSize || (query.maxSize >= 0 && entry.size > query.maxSize))
+        return false;
+    if (!query.types.isEmpty() && !query.types.contains(typeOf(entry.name)))
+        return false;
+
+    for (const QString &word : words)
+    {
+        if (!entry.lowerPath.contains(word))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief The three UTF-16 units of @p text starting at @p at, packed into one key.
+ */
+quint64 CatalogSearch::trigram(const QString &text, int at)
+{
+    return (quint64(text[at].unicode()) << 32) | (quint64(text[at + 1].unicode()) << 16) | text[at + 2].unicode();
+}
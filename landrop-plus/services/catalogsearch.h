@@ -0,0 +1,130 @@
+/**
+ * @file catalogsearch.h
+ * @brief In-memory search index over the shared catalogs of every peer
+ */
+
+#ifndef CATALOGSEARCH_H
+#define CATALOGSEARCH_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QList>
+#include <QMultiMap>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+/**
+ * @class CatalogSearch
+ * @brief Finds files by name or path among the catalogs of all peers without walking them.
+ *
+ * Every entry is indexed twice: its lowercase name in a sorted map, which
+ * answers prefix searches, and every trigram of its lowercase path in a
+ * posting list of entry numbers. A search of three letters or more only
+ * verifies the entries of the rarest trigram of the query, so a million
+ * entries answer within milliseconds.
+ *
+ * setCatalog() diffs a peer's catalog against the entries indexed for it,
+ * so a peer whose catalog changed by a few files costs the index those
+ * files only; applyChanges() takes the changes of a SharedCatalog delta as
+ * they are. Removed entries stay in the posting lists until they make up
+ * half of them, then the lists are rebuilt once.
+ */
+class CatalogSearch
+{
+public:
+    /**
+     * @brief What to search for.
+     */
+    struct Query
+    {
+        /** Words that must all appear in the path, in any case; matches by name prefix rank first */
+        QString text;
+
+        /** Smallest size in bytes */
+        qint64 minSize = 0;
+
+        /** Largest size in bytes, -1 for any */
+        qint64 maxSize = -1;
+
+        /** Lowercase extensions without the dot, any type if empty */
+        QStringList types;
+
+        /** Most hits returned */
+        int limit = 200;
+    };
+
+    /**
+     * @brief One file found.
+     */
+    struct Hit
+    {
+        QString peer;
+        QString path;
+        QString name;
+        qint64 size = 0;
+        QByteArray hash;
+    };
+
+    void setCatalog(const QString &peer, const QJsonArray &files);
+    void applyChanges(const QString &peer, const QJsonArray &changes);
+    void removePeer(const QString &peer);
+    void clear();
+
+    QList<Hit> search(const Query &query) const;
+
+    /** @brief Number of entries indexed for all peers. */
+    int size() const { return live; }
+
+    /** @brief Extension of a name as types are matched, lowercase and without the dot. */
+    static QString typeOf(const QString &name);
+
+private:
+    struct Entry
+    {
+        int peer = -1;
+        QString path;
+        QString name;
+        QString lowerPath;
+        qint64 size = 0;
+        QByteArray hash;
+        int trigramCount = 0;
+        bool removed = false;
+    };
+
+    int peerNumber(const QString &peer);
+    void insert(int peer, const QJsonObject &fileInfo);
+    void update(int id, const QJsonObject &fileInfo);
+    void remove(int id);
+    void indexEntry(int id);
+    void compact();
+    void rebuild();
+    bool matches(const Entry &entry, const QStringList &words, const Query &query) const;
+
+    static quint64 trigram(const QString &text, int at);
+
+    /** Entries by number, removed ones are kept until rebuild() */
+    QVector<Entry> entries;
+
+    /** Number of each entry by path, per peer number */
+    QVector<QHash<QString, int>> pathsOfPeer;
+
+    /** Peer addresses by number and numbers by address */
+    QStringList peers;
+    QHash<QString, int> peerNumbers;
+
+    /** Entry numbers by lowercase name */
+    QMultiMap<QString, int> names;
+
+    /** Entry numbers by path trigram, ascending */
+    QHash<quint64, QVector<int>> trigrams;
+
+    /** Entries indexed and postings left by removed ones */
+    int live = 0;
+    qint64 postings = 0;
+    qint64 stalePostings = 0;
+};
+
+#endif // CATALOGSEARCH_H
@@ -0,0 +1,152 @@
+/**
+ * @file connectionpool.cpp
+ */
+
+#include "connectionpool.h"
+#include "../config/config.h"
+#include "../network/securetransport.h"
+#include <QHostAddress>
+
+/**
+ * @brief Constructs a new ConnectionPool.
+ *
+ * @param parent Parent QObject
+ */
+ConnectionPool::ConnectionPool(QObject *parent)
+    : QObject(parent)
+{
+}
+
+/**
+ * @brief Destructor, closes every pooled connection.
+ */
+ConnectionPool::~ConnectionPool()
+{
+    clear();
+}
+
+QString ConnectionPool::key(const QString &ip, quint16 port)
+{
+    return ip + ':' + QString::number(port);
+}
+
+int ConnectionPool::idleCount(const QString &ip, quint16 port) const
+{
+    return pool.value(key(ip, port)).size();
+}
+
+/**
+ * @brief Opens a connection to a peer unless one is pooled already.
+ *
+ * @param ip Address of the peer
+ * @param port Transfer port of the peer
+ */
+void ConnectionPool::prewarm(const QString &ip, quint16 port)
+{
+    int timeout = Config::getConnectionIdleTimeout();
+    if (timeout <= 0 || port == 0 || QHostAddress(ip).isNull() || idleCount(ip, port) >= MAX_IDLE_PER_PEER)
+        return;
+
+    Idle idle;
+    idle.socket = SecureTransport::createSocket(this);
+    idle.timer = new QTimer(this);
+    idle.timer->setSingleShot(true);
+    QTcpSocket *socket = idle.socket;
+
+    idle.socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    idle.socket->setSocketOption(QAbstractSocket::KeepAliveOption, 1);
+    connect(idle.timer, &QTimer::timeout, this, [this, socket]()
+            { drop(socket, true); });
+    connect(idle.socket, &QTcpSocket::disconnected, this, [this, socket]()
+            { drop(socket, false); });
+    connect(idle.socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::errorOccurred),
+            this, [this, socket](QAbstractSocket::SocketError)
+            { drop(socket, true); });
+
+    pool[key(ip, port)].append(idle);
+    idle.timer->start(timeout * 1000);
+    SecureTransport::connectToPeer(idle.socket, ip, port);
+}
+
+/**
+ * @brief Hands out a connected pooled socket.
+ *
+ * The socket is detached from the pool: it has no parent and no connection
+ * to the pool any more. Connections still being opened stay pooled.
+ *
+ * @param ip Address of the peer
+ * @param port Transfer port of the peer
+ * @return Connected socket, null if none is ready
+ */
+QTcpSocket *ConnectionPool::take(const QString &ip, quint16 port)
+{
+    auto it = pool.find(key(ip, port));
+    if (it == pool.end())
+        return nullptr;
+
+    QList<Idle> &idle = it.value();
+    for (int i = 0; i < idle.size(); ++i)
+    {
+        // An encrypted connection is only handed out past its handshake
+        if (!SecureTransport::isReady(idle[i].socket))
+            continue;
+
+        // Data would mean the peer did not take this for a transfer connection
+        if (idle[i].socket->bytesAvailable() > 0)
+            continue;
+
+        Idle taken = idle.takeAt(i);
+        if (idle.isEmpty())
+            pool.erase(it);
+        delete taken.timer;
+        taken.socket->disconnect(this);
+        taken.socket->setParent(nullptr);
+        return taken.socket;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Closes every pooled connection.
+ */
+void ConnectionPool::clear()
+{
+    QList<QTcpSocket *> sockets;
+    for (const QList<Idle> &idle : pool)
+    {
+        for (const Idle &entry : idle)
+            sockets.append(entry.socket);
+    }
+    for (QTcpSocket *socket : sockets)
+        drop(socket, true);
+}
+
+/**
+ * @brief Removes a connection from the pool and deletes it.
+ *
+ * @param socket Pooled connection
+ * @param close Whether to close it first, false once the peer closed it
+ */
+void ConnectionPool::drop(QTcpSocket *socket, bool close)
+{
+    for (auto it = pool.begin(); it != pool.end(); ++it)
+    {
+        QList<Idle> &idle = it.value();
+        for (int i = 0; i < idle.size(); ++i)
+        {
+            if (idle[i].socket != socket)
+                continue;
+
+            Idle entry = idle.takeAt(i);
+            if (idle.isEmpty())
+                pool.erase(it);
+
+            entry.socket->disconnect(this);
+            if (close)
+                entry.socket->abort();
+            entry.socket->deleteLater();
+            entry.timer->deleteLater();
+            return;
+        }
+    }
+}
@@ -0,0 +1,65 @@
+/**
+ * @file connectionpool.h
+ * @brief Idle connections to peers kept open for the next transfer
+ */
+
+#ifndef CONNECTIONPOOL_H
+#define CONNECTIONPOOL_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QMap>
+#include <QList>
+
+/**
+ * @class ConnectionPool
+ * @brief Keeps connected, unused sockets to peers so transfers skip the TCP handshake.
+ *
+ * A transfer connection can only carry what follows its first header, so
+ * pooled connections are opened ahead of a transfer rather than recycled
+ * after one: prewarm() opens one when a peer is likely to be sent to next,
+ * and take() hands it to the sender, which writes its header right away.
+ * Receivers simply see a connection that starts talking later. Idle
+ * connections are closed after Config::getConnectionIdleTimeout() seconds
+ * or when the peer closes them.
+ *
+ * Lives on the GUI thread; a taken socket has no parent and may be moved to
+ * the sender's thread.
+ */
+class ConnectionPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ConnectionPool(QObject *parent = nullptr);
+    ~ConnectionPool();
+
+    void prewarm(const QString &ip, quint16 port);
+    QTcpSocket *take(const QString &ip, quint16 port);
+    void clear();
+
+    /** @brief Number of connections open or opening to a peer. */
+    int idleCount(const QString &ip, quint16 port) const;
+
+    /** Connections kept per peer, one covers the transfer started by a click on Send. */
+    static const int MAX_IDLE_PER_PEER = 1;
+
+private:
+    /**
+     * @brief One pooled connection and its idle timer.
+     */
+    struct Idle
+    {
+        QTcpSocket *socket = nullptr;
+        QTimer *timer = nullptr;
+    };
+
+    static QString key(const QString &ip, quint16 port);
+    void drop(QTcpSocket *socket, bool close);
+
+    /** Pooled connections by "ip:port", connected or still connecting */
+    QMap<QString, QList<Idle>> pool;
+};
+
+#endif // CONNECTIONPOOL_H
@@ -0,0 +1,232 @@
+/**
+ * @file directorywalker.cpp
+ */
+
+#include "directorywalker.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QThread>
+#include <algorithm>
+
+/**
+ * @brief Constructs a new DirectoryWalker.
+ *
+ * @param workerCount Number of listing threads, 0 to pick from the CPU count
+ * @param parent Parent QObject
+ */
+DirectoryWalker::DirectoryWalker(int workerCount, QObject *parent)
+    : QObject(parent),
+      workers(workerCount > 0 ? workerCount : qBound(2, QThread::idealThreadCount(), 8)),
+      progressTimer(new QTimer(this)),
+      queues(new Queue[workers])
+{
+    pool.setMaxThreadCount(workers);
+    connect(progressTimer, &QTimer::timeout, this, &DirectoryWalker::reportProgress);
+}
+
+/**
+ * @brief Destructor, stops the workers and waits for them.
+ */
+DirectoryWalker::~DirectoryWalker()
+{
+    cancelled.storeRelease(1);
+    wakeIdle();
+    pool.waitForDone();
+}
+
+/**
+ * @brief Starts listing a folder, finished() follows.
+ *
+ * @param folderPath Folder to list, it is the first entry of the manifest
+ */
+void DirectoryWalker::walk(const QString &folderPath)
+{
+    QFileInfo fi(folderPath);
+    basePath = fi.absolutePath();
+    rootName = fi.fileName();
+    found.clear();
+    stopped = 0;
+    listedFolders.storeRelaxed(0);
+    listedFiles.storeRelaxed(0);
+    for (int i = 0; i < workers; ++i)
+    {
+        queues[i].folders.clear();
+        queues[i].found.clear();
+    }
+
+    if (!fi.isDir() || rootName.isEmpty())
+    {
+        QMetaObject::invokeMethod(this, [this]()
+                                  { emit finished(); }, Qt::QueuedConnection);
+        return;
+    }
+
+    Archive::Entry root;
+    root.filePath = fi.absoluteFilePath();
+    root.name = rootName;
+    root.type = Archive::Directory;
+    root.modified = fi.lastModified().toMSecsSinceEpoch();
+    found.append(root);
+    queues[0].folders = {rootName};
+    outstanding.storeRelease(1);
+
+    progressTimer->start(PROGRESS_INTERVAL_MS);
+    for (int i = 0; i < workers; ++i)
+        pool.start([this, i]()
+                   { work(i); });
+}
+
+/**
+ * @brief Takes a folder from the worker's own queue, the one it found last.
+ *
+ * @param worker Index of the worker's queue
+ * @param relative Receives the folder, relative to basePath
+ * @return false if the queue is empty
+ */
+bool DirectoryWalker::takeFolder(int worker, QString *relative)
+{
+    Queue &queue = queues[worker];
+    QMutexLocker locker(&queue.mutex);
+    if (queue.folders.isEmpty())
+        return false;
+    *relative = queue.folders.takeLast();
+    return true;
+}
+
+/**
+ * @brief Takes the oldest folder of another worker's queue.
+ *
+ * Queues are tried in turn from the next worker on, locking one at a time.
+ *
+ * @param worker Index of the worker stealing
+ * @param relative Receives the folder, relative to basePath
+ * @return false if every other queue is empty
+ */
+bool DirectoryWalker::stealFolder(int worker, QString *relative)
+{
+    for (int i = 1; i < workers; ++i)
+    {
+        Queue &victim = queues[(worker + i) % workers];
+        QMutexLocker locker(&victim.mutex);
+        if (!victim.folders.isEmpty())
+        {
+            *relative = victim.folders.takeFirst();
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Wakes the workers waiting for a folder, if any.
+ */
+void DirectoryWalker::wakeIdle()
+{
+    QMutexLocker locker(&idleMutex);
+    wake.wakeAll();
+}
+
+/**
+ * @brief Lists queued folders until the tree is done.
+ *
+ * A worker with nothing to list waits while others still run, since they
+ * may queue more folders. It counts itself idle before looking at the
+ * queues once more under idleMutex, so a worker queueing folders after
+ * that look sees it and wakes it. The last worker to stop sorts the
+ * manifest and reports it.
+ *
+ * @param worker Index of the worker's queue
+ */
+void DirectoryWalker::work(int worker)
+{
+    Queue &own = queues[worker];
+    QString relative;
+    while (!cancelled.loadAcquire())
+    {
+        if (!takeFolder(worker, &relative) && !stealFolder(worker, &relative))
+        {
+            QMutexLocker locker(&idleMutex);
+            idle.fetchAndAddOrdered(1);
+            bool waiting = !cancelled.loadAcquire() && outstanding.loadAcquire() > 0 &&
+                           !takeFolder(worker, &relative) && !stealFolder(worker, &relative);
+            if (waiting)
+                wake.wait(&idleMutex);
+            idle.fetchAndAddOrdered(-1);
+            if (waiting)
+                continue;
+            if (cancelled.loadAcquire() || outstanding.loadAcquire() == 0)
+                break;
+        }
+
+        QStringList folders;
+        int files = 0;
+        const QFileInfoList infos = QDir(basePath + '/' + relative)
+                                        .entryInfoList(filters, QDir::NoSort);
+        for (const QFileInfo &info : infos)
+        {
+            if (info.isSymLink())
+                continue;
+
+            Archive::Entry entry;
+            entry.filePath = info.absoluteFilePath();
+            entry.name = relative + '/' + info.fileName();
+            entry.modified = info.lastModified().toMSecsSinceEpoch();
+            if (info.isDir())
+            {
+                entry.type = Archive::Directory;
+                folders.append(entry.name);
+            }
+            else if (info.isFile())
+            {
+                entry.size = info.size();
+                ++files;
+            }
+            else
+            {
+                // Sockets, pipes and devices have no data to send
+                continue;
+            }
+            own.found.append(entry);
+        }
+
+        listedFolders.fetchAndAddRelaxed(1);
+        listedFiles.fetchAndAddRelaxed(files);
+        if (!folders.isEmpty())
+        {
+            // Counted before the folder being listed is done, so the count never drops to 0 early
+            outstanding.fetchAndAddOrdered(folders.size());
+            {
+                QMutexLocker locker(&own.mutex);
+                own.folders.append(folders);
+            }
+            if (idle.loadAcquire() > 0)
+                wakeIdle();
+        }
+        if (outstanding.fetchAndAddOrdered(-1) == 1)
+            wakeIdle();
+    }
+
+    {
+        QMutexLocker locker(&idleMutex);
+        wake.wakeAll();
+        if (++stopped < workers || cancelled.loadAcquire())
+            return;
+    }
+
+    for (int i = 0; i < workers; ++i)
+        found.append(queues[i].found);
+    // Path order puts every folder in front of its contents
+    std::sort(found.begin(), found.end(), [](const Archive::Entry &a, const Archive::Entry &b)
+              { return a.name < b.name; });
+    QMetaObject::invokeMethod(this, [this]()
+                              {
+        progressTimer->stop();
+        reportProgress();
+        emit finished(); }, Qt::QueuedConnection);
+}
+
+void DirectoryWalker::reportProgress()
+{
+    emit progress(listedFolders.loadRelaxed(), listedFiles.loadRelaxed());
+}
@@ -0,0 +1,125 @@
+/**
+ * @file directorywalker.h
+ * @brief Background listing of a folder tree for folder transfers and sharing
+ */
+
+#ifndef DIRECTORYWALKER_H
+#define DIRECTORYWALKER_H
+
+#include <QObject>
+#include <QThreadPool>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QStringList>
+#include <QAtomicInt>
+#include <memory>
+#include <QTimer>
+#include <QDir>
+#include "../network/archive.h"
+
+/**
+ * @class DirectoryWalker
+ * @brief Lists every file and folder below a folder on worker threads.
+ *
+ * Several workers list folders at once, so the stat calls of large trees
+ * overlap instead of running one folder after the other, and the GUI thread
+ * keeps running while hundreds of thousands of entries are listed. Each
+ * worker has its own queue of folders still to list, behind its own lock,
+ * and takes the one it found last, going depth first. A worker whose queue
+ * ran dry steals from the other end of another worker's queue: the oldest
+ * folder, the one nearest the top of the tree and so likely the most work.
+ * Only an idle worker waiting for more folders takes the shared lock.
+ *
+ * The result is the manifest of a folder transfer: archive entries named
+ * relative to the parent of the folder, in path order, with folders listed
+ * before their contents so empty ones are recreated too. The shared folder
+ * index is built from the same manifest.
+ *
+ * Symbolic links are skipped, so links to files are not sent and links to
+ * folders cannot loop.
+ */
+class DirectoryWalker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DirectoryWalker(int workerCount = 0, QObject *parent = nullptr);
+    ~DirectoryWalker();
+
+    void walk(const QString &folderPath);
+
+    /** @brief Sets the QDir filters entries are listed with, before walk(). */
+    void setFilters(QDir::Filters filters) { this->filters = filters; }
+
+    /** @brief Name of the folder being walked. */
+    QString folderName() const { return rootName; }
+
+    /** @brief Entries found, valid once finished() was emitted. */
+    QList<Archive::Entry> entries() const { return found; }
+
+signals:
+    /**
+     * @brief Signal emitted on the walker's thread once the whole tree is listed.
+     *
+     * The manifest is empty if the folder could not be read.
+     */
+    void finished();
+
+    /** @brief Signal emitted periodically during a walk with the folders and files listed so far. */
+    void progress(int folders, int files);
+
+private:
+    void work(int worker);
+    bool takeFolder(int worker, QString *relative);
+    bool stealFolder(int worker, QString *relative);
+    void wakeIdle();
+    void reportProgress();
+
+    QThreadPool pool;
+    int workers;
+    QDir::Filters filters = QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System;
+
+    /** Timer emitting progress() while the workers run */
+    QTimer *progressTimer;
+
+    /** Absolute path of the folder's parent, and the folder name */
+    QString basePath;
+    QString rootName;
+
+    /**
+     * @brief Folders one worker still has to list, and the entries it found.
+     */
+    struct Queue
+    {
+        /** Guards folders, taken by the owner and by workers stealing */
+        QMutex mutex;
+
+        /** Folders to list, relative to basePath */
+        QStringList folders;
+
+        /** Entries listed, only touched by the owner until it stops */
+        QList<Archive::Entry> found;
+    };
+    std::unique_ptr<Queue[]> queues;
+
+    /** Folders queued or being listed, the tree is done at 0 */
+    QAtomicInt outstanding;
+    QAtomicInt cancelled;
+    QAtomicInt listedFolders;
+    QAtomicInt listedFiles;
+
+    /** Workers waiting for a folder, they sleep on idleMutex */
+    QAtomicInt idle;
+    QMutex idleMutex;
+    QWaitCondition wake;
+
+    /** Workers that stopped, guarded by idleMutex */
+    int stopped = 0;
+
+    QList<Archive::Entry> found;
+
+    /** Interval of progress reports */
+    static const int PROGRESS_INTERVAL_MS = 250;
+};
+
+#endif // DIRECTORYWALKER_H
@@ -0,0 +1,10 @@
+/**
+ * @file discoverybackend.cpp
+ */
+
+#include "discoverybackend.h"
+
+DiscoveryBackend::DiscoveryBackend(QObject *parent)
+    : QObject(parent)
+{
+}
@@ -0,0 +1,48 @@
+/**
+ * @file discoverybackend.h
+ * @brief Interface of additional peer discovery mechanisms
+ */
+
+#ifndef DISCOVERYBACKEND_H
+#define DISCOVERYBACKEND_H
+
+#include <QObject>
+#include "broadcastdiscoveryservice.h"
+
+/**
+ * @class DiscoveryBackend
+ * @brief Source of peers feeding the table of BroadcastDiscoveryService.
+ *
+ * Backends announce the local instance and report peers as they appear and
+ * disappear. Peers they report are not expired by the service, a backend
+ * emits peerLost() when one goes away. Peers are reported with their
+ * catalog version only, the service fetches their files.
+ */
+class DiscoveryBackend : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DiscoveryBackend(QObject *parent = nullptr);
+
+    /**
+     * @brief Starts announcing @p self and looking for peers.
+     * @return false if the backend cannot run on this machine
+     */
+    virtual bool start(const LANDropUser &self) = 0;
+
+    /** @brief Announces changed information about the local instance. */
+    virtual void update(const LANDropUser &self) = 0;
+
+    /** @brief Withdraws the announcement and forgets every peer. */
+    virtual void stop() = 0;
+
+signals:
+    /** @brief Signal emitted when a peer appeared or its announcement changed. */
+    void peerFound(const LANDropUser &user);
+
+    /** @brief Signal emitted when a peer withdrew its announcement or it expired. */
+    void peerLost(const QString &ipAddress);
+};
+
+#endif // DISCOVERYBACKEND_H
@@ -0,0 +1,186 @@
+/**
+ * @file discoverypacing.cpp
+ */
+
+#include "discoverypacing.h"
+#include <QDateTime>
+#include <QRandomGenerator>
+#include <QtGlobal>
+
+DiscoveryPacing::DiscoveryPacing(int discoveryInterval)
+    : discoveryInterval(discoveryInterval)
+{
+}
+
+/**
+ * @brief Current time of the clock, in milliseconds since the epoch.
+ */
+qint64 DiscoveryPacing::now() const
+{
+    return clock ? clock() : QDateTime::currentMSecsSinceEpoch();
+}
+
+/**
+ * @brief Interval between regular broadcasts, growing with the number of peers.
+ *
+ * The interval grows by discoveryInterval per PEERS_PER_INTERVAL peers
+ * known, up to MAX_INTERVAL_MS, to keep the traffic of a large network
+ * bounded. While every peer sends heartbeats, broadcasts only look for new
+ * peers and are sent every MAX_INTERVAL_MS.
+ *
+ * @param peerCount Peers known
+ * @param allHeartbeating Whether every one of them sends heartbeats
+ */
+int DiscoveryPacing::broadcastInterval(int peerCount, bool allHeartbeating) const
+{
+    if (peerCount > 0 && allHeartbeating)
+        return MAX_INTERVAL_MS;
+    return qMin<qint64>(MAX_INTERVAL_MS, qint64(discoveryInterval) * (1 + peerCount / PEERS_PER_INTERVAL));
+}
+
+/**
+ * @brief Delay until the next broadcast.
+ *
+ * BURST_INTERVAL_MS during a burst, broadcastInterval() otherwise, spread
+ * by up to JITTER_PERCENT either way so instances started together do not
+ * keep broadcasting in the same instant.
+ */
+int DiscoveryPacing::nextBroadcastDelay(int peerCount, bool allHeartbeating) const
+{
+    int interval = burstRemaining > 0 ? BURST_INTERVAL_MS : broadcastInterval(peerCount, allHeartbeating);
+    int spread = interval * JITTER_PERCENT / 100;
+    int offset = random ? qBound(-spread, random(-spread, spread), spread)
+                        : QRandomGenerator::global()->bounded(-spread, spread + 1);
+    return interval + offset;
+}
+
+/**
+ * @brief Starts a burst of BURST_COUNT quick broadcasts.
+ *
+ * Used on start and when a peer goes quiet, so a lost datagram or a peer
+ * that restarted is found again without waiting a whole interval.
+ *
+ * @return false if a burst is running already, true if the caller broadcasts now
+ */
+bool DiscoveryPacing::startBurst()
+{
+    if (burstRemaining > 0)
+        return false;
+
+    burstRemaining = BURST_COUNT;
+    return true;
+}
+
+/**
+ * @brief Counts a broadcast against the current burst.
+ */
+void DiscoveryPacing::broadcastSent()
+{
+    if (burstRemaining > 0)
+        --burstRemaining;
+}
+
+/**
+ * @brief Records hearing an announcement of a peer and how often it announces itself.
+ *
+ * Peers on a large network broadcast less often, the time between their
+ * announcements is smoothed to time them out accordingly.
+ */
+void DiscoveryPacing::noteHeard(const QString &ipAddress)
+{
+    qint64 currentTime = now();
+    auto seen = lastSeenTimes.constFind(ipAddress);
+    if (seen != lastSeenTimes.constEnd())
+    {
+        qint64 gap = qBound<qint64>(0, currentTime - seen.value(), MAX_INTERVAL_MS * 2);
+        qint64 interval = heardIntervals.value(ipAddress, gap);
+        heardIntervals.insert(ipAddress, (interval * 3 + gap) / 4);
+    }
+    lastSeenTimes[ipAddress] = currentTime;
+    quietPeers.remove(ipAddress);
+}
+
+/**
+ * @brief Records a heartbeat of a peer, which does not tell how often it announces itself.
+ */
+void DiscoveryPacing::noteAlive(const QString &ipAddress)
+{
+    lastSeenTimes[ipAddress] = now();
+    quietPeers.remove(ipAddress);
+}
+
+/**
+ * @brief Whether a discovery request of a peer is answered.
+ *
+ * New peers are always answered. Known ones only once per broadcast
+ * interval, as our own broadcasts reach them in between.
+ *
+ * @param known Whether the peer is known already
+ * @param interval Current broadcast interval
+ */
+bool DiscoveryPacing::shouldRespondTo(const QString &ipAddress, bool known, int interval)
+{
+    qint64 currentTime = now();
+    auto answered = lastResponseTimes.constFind(ipAddress);
+    if (known && answered != lastResponseTimes.constEnd() && currentTime - answered.value() < interval)
+        return false;
+
+    lastResponseTimes.insert(ipAddress, currentTime);
+    return true;
+}
+
+/**
+ * @brief Time after which a silent peer is removed.
+ *
+ * Three of its announcement intervals, and at least USER_TIMEOUT_MS.
+ */
+qint64 DiscoveryPacing::peerTimeout(const QString &ipAddress) const
+{
+    return qMax<qint64>(USER_TIMEOUT_MS, heardIntervals.value(ipAddress, 0) * 3);
+}
+
+/**
+ * @brief Whether a peer stayed silent for longer than peerTimeout().
+ */
+bool DiscoveryPacing::hasExpired(const QString &ipAddress) const
+{
+    return now() - lastSeenTimes.value(ipAddress, 0) > peerTimeout(ipAddress);
+}
+
+/**
+ * @brief Whether a peer just missed two of its announcements.
+ *
+ * True once, until the peer is heard again, so a burst is started for it
+ * before it expires.
+ */
+bool DiscoveryPacing::wentQuiet(const QString &ipAddress)
+{
+    if (quietPeers.contains(ipAddress) ||
+        now() - lastSeenTimes.value(ipAddress, 0) <= peerTimeout(ipAddress) * 2 / 3)
+        return false;
+
+    quietPeers.insert(ipAddress);
+    return true;
+}
+
+/**
+ * @brief Forgets the timing of a removed peer.
+ */
+void DiscoveryPacing::forget(const QString &ipAddress)
+{
+    lastSeenTimes.remove(ipAddress);
+    heardIntervals.remove(ipAddress);
+    lastResponseTimes.remove(ipAddress);
+    quietPeers.remove(ipAddress);
+}
+
+/**
+ * @brief Forgets every peer, used when discovery starts or stops.
+ */
+void DiscoveryPacing::clear()
+{
+    lastSeenTimes.clear();
+    heardIntervals.clear();
+    lastResponseTimes.clear();
+    quietPeers.clear();
+}
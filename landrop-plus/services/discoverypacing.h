@@ -0,0 +1,110 @@
+/**
+ * @file discoverypacing.h
+ * @brief Timing of discovery broadcasts, responses and peer timeouts
+ */
+
+#ifndef DISCOVERYPACING_H
+#define DISCOVERYPACING_H
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <functional>
+
+/**
+ * @class DiscoveryPacing
+ * @brief When BroadcastDiscoveryService broadcasts, answers and gives up on a peer.
+ *
+ * Every instance broadcasts and each broadcast is heard by all, so the
+ * broadcast interval grows with the number of peers and is spread
+ * randomly, requests of known peers are answered once per interval, and a
+ * peer is timed out after missing a few of its own announcements. A peer
+ * that went quiet starts a burst of quick broadcasts, once until heard
+ * again.
+ *
+ * The clock and random source can be replaced, so the timing is tested
+ * without waiting. Lives in the thread of its BroadcastDiscoveryService.
+ */
+class DiscoveryPacing
+{
+public:
+    /** Milliseconds since the epoch */
+    using Clock = std::function<qint64()>;
+
+    /** Random integer from @p lowest to @p highest, both included */
+    using Random = std::function<int(int lowest, int highest)>;
+
+    /**
+     * @param discoveryInterval Shortest interval between broadcasts, in milliseconds
+     */
+    explicit DiscoveryPacing(int discoveryInterval = 5000);
+
+    /** @brief Replaces the wall clock, an empty one restores it. */
+    void setClock(Clock clock) { this->clock = std::move(clock); }
+
+    /** @brief Replaces QRandomGenerator::global(), an empty one restores it. */
+    void setRandom(Random random) { this->random = std::move(random); }
+
+    qint64 now() const;
+
+    int broadcastInterval(int peerCount, bool allHeartbeating) const;
+    int nextBroadcastDelay(int peerCount, bool allHeartbeating) const;
+
+    bool startBurst();
+    void broadcastSent();
+    void stopBurst() { burstRemaining = 0; }
+
+    /** @brief Quick broadcasts left in the current burst. */
+    int burstLeft() const { return burstRemaining; }
+
+    void noteHeard(const QString &ipAddress);
+    void noteAlive(const QString &ipAddress);
+    bool shouldRespondTo(const QString &ipAddress, bool known, int interval);
+
+    qint64 peerTimeout(const QString &ipAddress) const;
+    bool hasExpired(const QString &ipAddress) const;
+    bool wentQuiet(const QString &ipAddress);
+
+    void forget(const QString &ipAddress);
+    void clear();
+
+    /** Timeout for removing inactive users, raised for users announcing less often */
+    static constexpr int USER_TIMEOUT_MS = 15000;
+
+    /** Longest interval between discovery broadcasts */
+    static constexpr int MAX_INTERVAL_MS = 60000;
+
+    /** Peers known per added discoveryInterval of broadcast interval */
+    static constexpr int PEERS_PER_INTERVAL = 25;
+
+    /** Random spread of each broadcast interval, in percent either way */
+    static constexpr int JITTER_PERCENT = 25;
+
+    /** Broadcasts of a rediscovery burst, and the interval between them */
+    static constexpr int BURST_COUNT = 3;
+    static constexpr int BURST_INTERVAL_MS = 1000;
+
+private:
+    Clock clock;
+    Random random;
+
+    /** Shortest interval between discovery broadcasts in milliseconds */
+    int discoveryInterval;
+
+    /** Quick broadcasts left in the current rediscovery burst */
+    int burstRemaining = 0;
+
+    /** When each user was last heard, by IP address */
+    QHash<QString, qint64> lastSeenTimes;
+
+    /** Smoothed time between two announcements of each user, by IP address */
+    QHash<QString, qint64> heardIntervals;
+
+    /** When each user was last answered, by IP address */
+    QHash<QString, qint64> lastResponseTimes;
+
+    /** Users that went quiet and already triggered a burst */
+    QSet<QString> quietPeers;
+};
+
+#endif // DISCOVERYPACING_H
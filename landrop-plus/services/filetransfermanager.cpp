@@ -4,110 +4,279 @@
 
 #include "filetransfermanager.h"
 #include "../config/config.h"
+#include "../network/protocol.h"
+#include "../network/transfermetrics.h"
+#include "../network/transfertrace.h"
+#include "../network/uploadslots.h"
+#include "../network/transferprofiles.h"
+#include "../network/progresscounter.h"
 #include <QFileInfo>
 #include <QDir>
 #include <QDebug>
 #include <QTimer>
 #include <QPointer>
 #include <QTcpSocket>
+#include <QDateTime>
+#include <algorithm>
 
 /**
  * @brief Constructs a new FileTransferManager.
  *
- * Initializes the receiver pointer, batch timer for grouping incoming transfers,
- * and session ID counter.
+ * Starts the transfer worker threads and initializes the receiver pointer,
+ * batch timer for grouping incoming transfers, and session ID counter, and
+ * loads the auto-accept rules and the transfer profiles. The profiles are
+ * read again whenever their file changes. Subscribed folders are mirrored
+ * by background jobs of the scheduler, see mirrorNextFile().
  *
  * @param parent Parent QObject for memory management
  */
 FileTransferManager::FileTransferManager(QObject *parent)
     : QObject(parent),
+      engine(new TransferEngine(0, this)),
+      connectionPool(new ConnectionPool(this)),
+      progressAggregator(new ProgressAggregator(this)),
+      metricsTimer(new QTimer(this)),
       receiver(nullptr),
+      receiverPort(0),
       batchTimer(new QTimer(this)),
-      nextSessionId(1)
+      nextSessionId(1),
+      nextTransferId(1),
+      activeTransfers(0),
+      activeInteractive(0),
+      pendingFolders(0)
 {
+    connect(progressAggregator, &ProgressAggregator::progressPublished, this, &FileTransferManager::onProgressPublished);
+
     batchTimer->setSingleShot(true);
     connect(batchTimer, &QTimer::timeout, this, [this]()
             {
         emit batchTransferRequested(pendingBatchFiles, pendingBatchSockets);
         pendingBatchFiles.clear();
         pendingBatchSockets.clear(); });
+
+    connect(metricsTimer, &QTimer::timeout, this, &FileTransferManager::publishMetrics);
+    metricsTimer->start(METRICS_INTERVAL_MS);
+
+    reloadAutoAcceptRules();
+
+    // A changed file is read once its writes settled
+    profilesWatcher = new QFileSystemWatcher(this);
+    profilesTimer = new QTimer(this);
+    profilesTimer->setSingleShot(true);
+    profilesTimer->setInterval(PROFILES_SETTLE_MS);
+    connect(profilesTimer, &QTimer::timeout, this, &FileTransferManager::reloadTransferProfiles);
+    connect(profilesWatcher, &QFileSystemWatcher::fileChanged, profilesTimer, QOverload<>::of(&QTimer::start));
+    connect(profilesWatcher, &QFileSystemWatcher::directoryChanged, profilesTimer, QOverload<>::of(&QTimer::start));
+    reloadTransferProfiles();
+
+    mirrorTimer = new QTimer(this);
+    connect(mirrorTimer, &QTimer::timeout, this, &FileTransferManager::mirrorNextFile);
+    mirrorTimer->start(MIRROR_INTERVAL_MS);
+}
+
+/**
+ * @brief Reads the auto-accept rules again from Config::getAutoAcceptRulesPath().
+ *
+ * @return false if the rules file is not valid, no rule applies then
+ */
+bool FileTransferManager::reloadAutoAcceptRules()
+{
+    // qDebug() << "FileTransferManager: Loading auto-accept rules from" << Config::getAutoAcceptRulesPath();
+    return acceptPolicy.load(Config::getAutoAcceptRulesPath());
+}
+
+/**
+ * @brief Reads the transfer profiles again from Config::getTransferProfilesPath().
+ *
+ * Running transfers take the new profiles without a restart, see
+ * TransferProfiles. Also watches the file again, since a file replaced by
+ * a rename is no longer watched.
+ *
+ * @return false if the profiles file is not valid, the profiles loaded before stay then
+ */
+bool FileTransferManager::reloadTransferProfiles()
+{
+    QString filePath = Config::getTransferProfilesPath();
+    QString folderPath = QFileInfo(filePath).absolutePath();
+    if (!profilesWatcher->files().contains(filePath) && QFileInfo::exists(filePath))
+        profilesWatcher->addPath(filePath);
+    if (!profilesWatcher->directories().contains(folderPath) && QFileInfo::exists(folderPath))
+        profilesWatcher->addPath(folderPath);
+
+    // qDebug() << "FileTransferManager: Loading transfer profiles from" << filePath;
+    return TransferProfiles::load(filePath);
 }
 
 /**
  * @brief Destructor for FileTransferManager.
  *
  * Proper cleanup by disconnecting the receiver and cleaning up all
- * active sender objects and their sessions.
+ * active sender objects and their sessions. Every transfer object is
+ * destroyed in its worker thread before the workers are stopped.
  */
 FileTransferManager::~FileTransferManager()
 {
+    // Queued transfers have no objects yet and are not started any more
+    scheduledTransfers.clear();
+
     if (receiver)
     {
         receiver->disconnect();
+        engine->destroy(receiver);
+        receiver = nullptr;
     }
 
-    for (auto it = senderToSession.begin(); it != senderToSession.end(); ++it)
+    for (auto it = transferObjects.begin(); it != transferObjects.end(); ++it)
     {
-        Sender *sender = it.key();
-        if (sender)
-        {
-            sender->disconnect();
-            delete sender;
-        }
+        QObject *object = it.key();
+        object->disconnect();
+        engine->destroy(object);
     }
-    senderToSession.clear();
+    transferObjects.clear();
     sessions.clear();
+
+    engine->shutdown();
 }
 
 /**
  * @brief Sets up the receiver server for incoming file transfers.
  *
- * Creates and configures a new Receiver instance if one doesn't exist.
- * Starts the server on the configured port and connects all receiver signals
- * to the appropriate handler methods. Updates the global port configuration
- * with the actual port being used.
+ * Creates and configures a new Receiver instance if one doesn't exist and
+ * moves it onto its own worker thread, which hands incoming connections to
+ * Config::getReceiveThreads() receiver workers. Connects all receiver signals to the
+ * appropriate handler methods, then starts the server on the configured port
+ * from the receiver's thread. Updates the global port configuration with the
+ * actual port being used.
  */
 void FileTransferManager::setupReceiver()
 {
     if (receiver)
         return;
 
-    receiver = new Receiver(this);
+    receiver = new Receiver();
+    engine->adoptDedicated(receiver);
+
+    connect(receiver, &Receiver::fileTransferRequested,
+            this, &FileTransferManager::onReceiverFileTransferRequested);
+    connect(receiver, &Receiver::batchAnnounced,
+            this, &FileTransferManager::onReceiverBatchAnnounced);
+    connect(receiver, &Receiver::transferProgressUpdated,
+            this, &FileTransferManager::onReceiverProgressUpdated);
+    connect(receiver, &Receiver::transferStatusUpdated,
+            this, &FileTransferManager::onReceiverStatusUpdated);
+    connect(receiver, &Receiver::fileReceivedSuccessfully,
+            this, &FileTransferManager::onReceiverFileReceived);
+    connect(receiver, &Receiver::transferStripeCountNegotiated,
+            this, &FileTransferManager::onReceiverStripeCountNegotiated);
+    connect(receiver, &Receiver::transferCompressionNegotiated,
+            this, &FileTransferManager::onReceiverCompressionNegotiated);
+
+    int receiveThreads = Config::getReceiveThreads();
+    if (receiveThreads <= 0)
+        receiveThreads = qBound(1, QThread::idealThreadCount(), 8);
 
-    if (!receiver->startServer())
+    bool started = false;
+    quint16 actualPort = 0;
+    Receiver *server = receiver;
+    TransferEngine::call(receiver, [server, receiveThreads, &started, &actualPort]()
+                         {
+        server->setWorkerCount(receiveThreads);
+        started = server->startServer();
+        actualPort = server->getServerPort(); });
+
+    if (!started)
     {
         // qCritical() << "FileTransferManager: Failed to start receiver server";
-        delete receiver;
+        receiver->disconnect();
+        engine->destroy(receiver);
         receiver = nullptr;
         return;
     }
 
     // Update Config::getPort() with the actual port being used
-    quint16 actualPort = receiver->getServerPort();
+    receiverPort = actualPort;
     if (Config::getPort() != actualPort)
     {
         Config::getPort() = actualPort;
     }
+}
 
-    connect(receiver, &Receiver::fileTransferRequested,
-            this, &FileTransferManager::onReceiverFileTransferRequested);
-    connect(receiver, &Receiver::transferProgressUpdated,
-            this, &FileTransferManager::onReceiverProgressUpdated);
-    connect(receiver, &Receiver::transferStatusUpdated,
-            this, &FileTransferManager::onReceiverStatusUpdated);
-    connect(receiver, &Receiver::fileReceivedSuccessfully,
-            this, &FileTransferManager::onReceiverFileReceived);
+/**
+ * @brief Accepts an incoming transfer the user approved.
+ *
+ * @param socket Connection of the transfer request
+ * @param fileName Name of the accepted file
+ * @param priority Lane the file is received in
+ * @return false if the receiver could not open the destination file
+ */
+bool FileTransferManager::acceptIncomingTransfer(QTcpSocket *socket, const QString &fileName, TransferPriority priority)
+{
+    if (!receiver)
+        return false;
+
+    bool accepted = false;
+    Receiver *target = receiver;
+    TransferEngine::call(receiver, [target, socket, fileName, priority, &accepted]()
+                         {
+        target->setTransferPriority(socket, priority);
+        accepted = target->acceptTransfer(socket, fileName); });
+    return accepted;
+}
+
+/**
+ * @brief Refuses an incoming transfer the user declined.
+ *
+ * @param socket Connection of the transfer request
+ * @param fileName Name of the refused file
+ */
+void FileTransferManager::rejectIncomingTransfer(QTcpSocket *socket, const QString &fileName)
+{
+    if (!receiver)
+        return;
+
+    Receiver *target = receiver;
+    TransferEngine::post(receiver, [target, socket, fileName]()
+                         { target->rejectTransfer(socket, fileName); });
+}
+
+/**
+ * @brief Returns the number of connections a session is transferred over.
+ *
+ * @param sessionId ID of the session
+ * @return Stripe count, 1 for single-connection or unknown sessions
+ */
+int FileTransferManager::getSessionStripeCount(int sessionId) const
+{
+    return sessions.contains(sessionId) ? sessions[sessionId].stripeCount : 1;
 }
 
 /**
- * @brief Restarts the receiver server.
+ * @brief Moves the receiver server to Config::getPort().
+ *
+ * Only the listening socket moves (see Receiver::rebind()), transfers
+ * running go on. A receiver that cannot listen anymore is replaced.
  */
 void FileTransferManager::restartReceiver()
 {
     if (receiver)
     {
+        bool rebound = false;
+        quint16 actualPort = 0;
+        Receiver *server = receiver;
+        quint16 port = quint16(Config::getPort());
+        TransferEngine::call(receiver, [server, port, &rebound, &actualPort]()
+                             {
+            rebound = server->rebind(port);
+            actualPort = server->getServerPort(); });
+        if (rebound)
+        {
+            receiverPort = actualPort;
+            Config::getPort() = actualPort;
+            return;
+        }
+
         receiver->disconnect();
-        delete receiver;
+        engine->destroy(receiver);
         receiver = nullptr;
     }
 
@@ -118,37 +287,673 @@ void FileTransferManager::restartReceiver()
 /**
  * @brief Sends files to multiple recipients.
  *
- * Creates a new transfer session and Sender instance for each file-to-recipient
- * combination.
+ * Creates a transfer session for each file-to-recipient combination. Large
+ * files sent to several recipients are relayed along a chain of them when
+ * chain relaying is enabled, multicast to all of them when multicast is
+ * enabled, or read once and fanned out to all of them.
+ * Otherwise, files that are small enough to skip striping travel to
+ * each recipient over one shared PeerSession connection; large files get a
+ * Sender of their own. With archiving enabled, files below the archive
+ * threshold are packed into one archive per recipient, shown as a single
+ * session.
+ *
+ * Every connection, fan-out, chain or multicast is queued with the
+ * scheduler, which starts as many as the transfer limits allow, higher
+ * priorities first.
  *
  * @param filePaths List of file paths to send
  * @param recipients List of users to send files to
+ * @param priority Lane of the transfers, see TransferPriority
  */
-void FileTransferManager::sendFilesToUsers(const QStringList &filePaths, const QList<LANDropUser> &recipients)
+void FileTransferManager::sendFilesToUsers(const QStringList &filePaths, const QList<LANDropUser> &recipients,
+                                           TransferPriority priority)
 {
+    QStringList ordered = filePaths;
+    if (Config::getSmallFilesFirst())
+    {
+        // Also orders the files within a batch connection
+        std::stable_sort(ordered.begin(), ordered.end(), [](const QString &a, const QString &b)
+                         { return QFileInfo(a).size() < QFileInfo(b).size(); });
+    }
+
+    QStringList perUser;
+    for (const QString &filePath : ordered)
+    {
+        bool oneToMany = recipients.size() > 1 && QFileInfo(filePath).size() >= Config::getFanoutThreshold();
+        if (oneToMany && Config::getChainRelayEnabled())
+            startChainRelay(filePath, recipients, priority);
+        else if (oneToMany && Config::getMulticastEnabled())
+            startMulticast(filePath, recipients, priority);
+        else if (oneToMany && Config::getFanoutEnabled())
+            startFanout(filePath, recipients, priority);
+        else
+            perUser.append(filePath);
+    }
+
+    for (const LANDropUser &user : recipients)
+    {
+        QStringList batch;
+        QStringList archived;
+        bool stripes = TransferProfiles::settings(user.ipAddress).stripeCount > 1;
+        for (const QString &filePath : perUser)
+        {
+            QFileInfo fi(filePath);
+            bool striped = stripes && fi.size() >= Config::getStripeThreshold();
+            if (striped)
+                startSender(filePath, user, priority);
+            else if (Config::getArchiveEnabled() && fi.size() < Config::getArchiveThreshold())
+                archived.append(filePath);
+            else
+                batch.append(filePath);
+        }
+
+        if (archived.size() > 1)
+            startArchive(Archive::entriesFor(archived), ArchiveSender::archiveName(archived.size()), user, priority);
+        else
+            batch.append(archived);
+
+        if (batch.size() > 1)
+            startPeerSession(batch, user, priority);
+        else if (!batch.isEmpty())
+            startSender(batch.first(), user, priority);
+    }
+}
+
+/**
+ * @brief Sends one file to one recipient over its own connection.
+ *
+ * @param filePath Path of the file to send
+ * @param user Recipient of the file
+ * @param priority Lane of the transfer
+ */
+void FileTransferManager::startSender(const QString &filePath, const LANDropUser &user, TransferPriority priority)
+{
+    QFileInfo fi(filePath);
+    int sessionId = createTransferSession(fi.fileName() + QString(" @%1").arg(user.ipAddress), user.ipAddress, fi.size());
+
+    scheduleTransfer({sessionId}, {user.ipAddress}, fi.size(), [this, sessionId, filePath, user, priority]()
+                     {
+        // Lives on a worker thread, signals arrive here queued
+        Sender *sender = new Sender();
+        sender->setPriority(priority);
+        engine->adopt(sender);
+        sessions[sessionId].sender = sender;
+        transferObjects.insert(sender, {sessionId});
+
+        // Connect all sender signals
+        connect(sender, &Sender::transferAccepted, this, &FileTransferManager::onSenderTransferAccepted);
+        connect(sender, &Sender::transferRefused, this, &FileTransferManager::onSenderTransferRefused);
+        connect(sender, &Sender::progressUpdated, this, &FileTransferManager::onSenderProgressUpdated);
+        connect(sender, &Sender::transferFinished, this, &FileTransferManager::onSenderTransferFinished);
+        connect(sender, &Sender::transferError, this, &FileTransferManager::onSenderTransferError);
+        connect(sender, &Sender::stripeCountNegotiated, this, &FileTransferManager::onSenderStripeCountNegotiated);
+        connect(sender, &Sender::sendStatsUpdated, this, &FileTransferManager::onSenderStatsUpdated);
+        connect(sender, &Sender::compressionNegotiated, this, &FileTransferManager::onSenderCompressionNegotiated);
+
+        QString ip = user.ipAddress;
+        quint16 port = user.transferPort;
+        int version = Protocol::versionFromDiscovery(user.version);
+        QTcpSocket *connection = takePooledConnection(ip, port, sender);
+        TransferEngine::post(sender, [sender, filePath, ip, port, version, connection]()
+                             { sender->sendFile(filePath, ip, port, version, connection); }); }, priority);
+}
+
+/**
+ * @brief Opens an idle connection to a user who is likely to be sent to next.
+ *
+ * Called when the user is selected, so the first transfer to them skips
+ * the TCP handshake. The connection closes again after
+ * Config::getConnectionIdleTimeout() seconds if nothing is sent.
+ *
+ * @param user Selected user
+ */
+void FileTransferManager::prewarmConnection(const LANDropUser &user)
+{
+    connectionPool->prewarm(user.ipAddress, user.transferPort);
+}
+
+/**
+ * @brief Takes a pooled connection to a user for a sending object.
+ *
+ * @param ip Address of the peer
+ * @param port Transfer port of the peer
+ * @param target Object the connection is handed to, it is moved to its thread
+ * @return Connected socket, null if none is pooled
+ */
+QTcpSocket *FileTransferManager::takePooledConnection(const QString &ip, quint16 port, QObject *target)
+{
+    QTcpSocket *connection = connectionPool->take(ip, port);
+    if (connection)
+        connection->moveToThread(target->thread());
+    return connection;
+}
+
+/**
+ * @brief Sends several files to one recipient over a single connection.
+ *
+ * @param filePaths Paths of the files to send
+ * @param user Recipient of the files
+ * @param priority Lane of the transfer
+ */
+void FileTransferManager::startPeerSession(const QStringList &filePaths, const LANDropUser &user, TransferPriority priority)
+{
+    QList<int> sessionIds;
+    qint64 size = 0;
     for (const QString &filePath : filePaths)
     {
         QFileInfo fi(filePath);
+        sessionIds.append(createTransferSession(fi.fileName() + QString(" @%1").arg(user.ipAddress), user.ipAddress, fi.size()));
+        size += fi.size();
+    }
+
+    scheduleTransfer(sessionIds, {user.ipAddress}, size, [this, sessionIds, filePaths, user, priority]()
+                     {
+        PeerSession *peerSession = new PeerSession();
+        peerSession->setPriority(priority);
+        engine->adopt(peerSession);
+        transferObjects.insert(peerSession, sessionIds);
+        for (int sessionId : sessionIds)
+            sessions[sessionId].peerSession = peerSession;
+
+        connect(peerSession, &PeerSession::transferAccepted, this, &FileTransferManager::onPeerTransferAccepted);
+        connect(peerSession, &PeerSession::transferRefused, this, &FileTransferManager::onPeerTransferRefused);
+        connect(peerSession, &PeerSession::progressUpdated, this, &FileTransferManager::onPeerProgressUpdated);
+        connect(peerSession, &PeerSession::transferFinished, this, &FileTransferManager::onPeerTransferFinished);
+        connect(peerSession, &PeerSession::transferError, this, &FileTransferManager::onPeerTransferError);
+        connect(peerSession, &PeerSession::sendStatsUpdated, this, &FileTransferManager::onPeerStatsUpdated);
+        connect(peerSession, &PeerSession::sessionFinished, this, &FileTransferManager::onTransferObjectFinished);
+
+        QString ip = user.ipAddress;
+        quint16 port = user.transferPort;
+        int version = Protocol::versionFromDiscovery(user.version);
+        QTcpSocket *connection = takePooledConnection(ip, port, peerSession);
+        TransferEngine::post(peerSession, [peerSession, filePaths, ip, port, version, connection]()
+                             { peerSession->sendFiles(filePaths, ip, port, version, connection); }); }, priority);
+}
+
+/**
+ * @brief Sends one file to several recipients from a single read of it.
+ *
+ * @param filePath Path of the file to send
+ * @param recipients Recipients of the file
+ * @param priority Lane the transfer is queued in, it moves in the normal lane
+ */
+void FileTransferManager::startFanout(const QString &filePath, const QList<LANDropUser> &recipients,
+                                      TransferPriority priority)
+{
+    QFileInfo fi(filePath);
+    QList<int> sessionIds;
+    QStringList peers;
+    QList<FanoutTarget> targets;
+    for (const LANDropUser &user : recipients)
+    {
+        sessionIds.append(createTransferSession(fi.fileName() + QString(" @%1").arg(user.ipAddress), user.ipAddress, fi.size()));
+        peers.append(user.ipAddress);
+
+        FanoutTarget target;
+        target.address = user.ipAddress;
+        target.port = user.transferPort;
+        target.version = Protocol::versionFromDiscovery(user.version);
+        targets.append(target);
+    }
+
+    scheduleTransfer(sessionIds, peers, fi.size(), [this, sessionIds, filePath, targets]()
+                     {
+        FanoutSender *fanout = new FanoutSender();
+        engine->adopt(fanout);
+        transferObjects.insert(fanout, sessionIds);
+        for (int sessionId : sessionIds)
+            sessions[sessionId].fanout = fanout;
+
+        // Same per-recipient signals as a batch connection's per-file ones
+        connect(fanout, &FanoutSender::transferAccepted, this, &FileTransferManager::onPeerTransferAccepted);
+        connect(fanout, &FanoutSender::transferRefused, this, &FileTransferManager::onPeerTransferRefused);
+        connect(fanout, &FanoutSender::progressUpdated, this, &FileTransferManager::onPeerProgressUpdated);
+        connect(fanout, &FanoutSender::transferFinished, this, &FileTransferManager::onPeerTransferFinished);
+        connect(fanout, &FanoutSender::transferError, this, &FileTransferManager::onPeerTransferError);
+        connect(fanout, &FanoutSender::sendStatsUpdated, this, &FileTransferManager::onPeerStatsUpdated);
+        connect(fanout, &FanoutSender::fanoutFinished, this, &FileTransferManager::onTransferObjectFinished);
+
+        TransferEngine::post(fanout, [fanout, filePath, targets]()
+                             { fanout->sendFile(filePath, targets); }); }, priority);
+}
 
+/**
+ * @brief Sends one file to the first of several recipients, which relay it along the chain.
+ *
+ * The chain follows the discovery user list; recipients discovery does not
+ * know come last, in the order given. Only the first node is seen from
+ * here, so the sessions of the nodes behind it follow its progress until
+ * it fails and the chain is re-parented.
+ *
+ * @param filePath Path of the file to send
+ * @param recipients Recipients of the file
+ * @param priority Lane the transfer is queued in, it moves in the normal lane
+ */
+void FileTransferManager::startChainRelay(const QString &filePath, const QList<LANDropUser> &recipients,
+                                          TransferPriority priority)
+{
+    QList<LANDropUser> ordered;
+    for (const LANDropUser &known : discoveredUsers)
+    {
         for (const LANDropUser &user : recipients)
         {
-            int sessionId = createTransferSession(fi.fileName() + QString(" @%1").arg(user.ipAddress), user.ipAddress);
-            TransferSession &session = sessions[sessionId];
+            if (user.ipAddress == known.ipAddress && user.transferPort == known.transferPort)
+                ordered.append(user);
+        }
+    }
+    for (const LANDropUser &user : recipients)
+    {
+        bool known = false;
+        for (const LANDropUser &other : ordered)
+            known = known || (other.ipAddress == user.ipAddress && other.transferPort == user.transferPort);
+        if (!known)
+            ordered.append(user);
+    }
+
+    QFileInfo fi(filePath);
+    QList<int> sessionIds;
+    QStringList peers;
+    QList<FanoutTarget> chain;
+    for (const LANDropUser &user : ordered)
+    {
+        sessionIds.append(createTransferSession(fi.fileName() + QString(" @%1").arg(user.ipAddress), user.ipAddress, fi.size()));
+        peers.append(user.ipAddress);
+
+        FanoutTarget node;
+        node.address = user.ipAddress;
+        node.port = user.transferPort;
+        node.version = Protocol::versionFromDiscovery(user.version);
+        chain.append(node);
+    }
+
+    // Only the first node is sent to from here
+    qint64 fileSize = fi.size();
+    QString fileName = fi.fileName();
+    scheduleTransfer(sessionIds, peers.mid(0, 1), fileSize, [this, sessionIds, filePath, fileName, fileSize, chain]()
+                     {
+        ChainRelay *relay = new ChainRelay();
+        engine->adopt(relay);
+        transferObjects.insert(relay, sessionIds);
+        for (int sessionId : sessionIds)
+            sessions[sessionId].relay = relay;
 
-            Sender *sender = new Sender(this);
-            session.sender = sender;
-            senderToSession[sender] = sessionId;
+        connect(relay, &ChainRelay::nodeAccepted, this, &FileTransferManager::onPeerTransferAccepted);
+        connect(relay, &ChainRelay::nodeRefused, this, &FileTransferManager::onPeerTransferRefused);
+        connect(relay, &ChainRelay::progressUpdated, this, &FileTransferManager::onPeerProgressUpdated);
+        connect(relay, &ChainRelay::nodeFinished, this, &FileTransferManager::onPeerTransferFinished);
+        connect(relay, &ChainRelay::nodeFailed, this, &FileTransferManager::onPeerTransferError);
+        connect(relay, &ChainRelay::relayFinished, this, &FileTransferManager::onTransferObjectFinished);
 
-            // Connect all sender signals
-            connect(sender, &Sender::transferAccepted, this, &FileTransferManager::onSenderTransferAccepted);
-            connect(sender, &Sender::transferRefused, this, &FileTransferManager::onSenderTransferRefused);
-            connect(sender, &Sender::progressUpdated, this, &FileTransferManager::onSenderProgressUpdated);
-            connect(sender, &Sender::transferFinished, this, &FileTransferManager::onSenderTransferFinished);
-            connect(sender, &Sender::transferError, this, &FileTransferManager::onSenderTransferError);
+        TransferEngine::post(relay, [relay, filePath, fileName, fileSize, chain]()
+                             {
+            relay->start(filePath, fileName, fileSize, chain, fileSize);
+            relay->finishInput(); }); }, priority);
+}
+
+/**
+ * @brief Multicasts one file to several recipients at once.
+ *
+ * @param filePath Path of the file to send
+ * @param recipients Recipients of the file
+ * @param priority Lane the transfer is queued in, it moves in the normal lane
+ */
+void FileTransferManager::startMulticast(const QString &filePath, const QList<LANDropUser> &recipients,
+                                         TransferPriority priority)
+{
+    QFileInfo fi(filePath);
+    QList<int> sessionIds;
+    QStringList peers;
+    QList<FanoutTarget> targets;
+    for (const LANDropUser &user : recipients)
+    {
+        sessionIds.append(createTransferSession(fi.fileName() + QString(" @%1").arg(user.ipAddress), user.ipAddress, fi.size()));
+        peers.append(user.ipAddress);
+
+        FanoutTarget target;
+        target.address = user.ipAddress;
+        target.port = user.transferPort;
+        target.version = Protocol::versionFromDiscovery(user.version);
+        targets.append(target);
+    }
+
+    scheduleTransfer(sessionIds, peers, fi.size(), [this, sessionIds, filePath, targets]()
+                     {
+        MulticastSender *multicast = new MulticastSender();
+        engine->adopt(multicast);
+        transferObjects.insert(multicast, sessionIds);
+        for (int sessionId : sessionIds)
+            sessions[sessionId].multicast = multicast;
 
-            sender->sendFile(filePath, user.ipAddress, user.transferPort);
+        connect(multicast, &MulticastSender::transferAccepted, this, &FileTransferManager::onPeerTransferAccepted);
+        connect(multicast, &MulticastSender::transferRefused, this, &FileTransferManager::onPeerTransferRefused);
+        connect(multicast, &MulticastSender::progressUpdated, this, &FileTransferManager::onPeerProgressUpdated);
+        connect(multicast, &MulticastSender::transferFinished, this, &FileTransferManager::onPeerTransferFinished);
+        connect(multicast, &MulticastSender::transferError, this, &FileTransferManager::onPeerTransferError);
+        connect(multicast, &MulticastSender::multicastFinished, this, &FileTransferManager::onTransferObjectFinished);
+
+        TransferEngine::post(multicast, [multicast, filePath, targets]()
+                             { multicast->sendFile(filePath, targets); }); }, priority);
+}
+
+/**
+ * @brief Sends a folder and everything below it to several recipients.
+ *
+ * The tree is listed on worker threads first. Its manifest is then cut into
+ * archive parts of at most FOLDER_PART_SIZE bytes, and each part goes to
+ * each recipient as one archive transfer through the scheduler. Receivers
+ * recreate the tree, empty folders and file modification times included,
+ * in their download folder.
+ *
+ * @param folderPath Folder to send
+ * @param recipients List of users to send the folder to
+ * @param priority Lane of the archive transfers
+ */
+void FileTransferManager::sendFolderToUsers(const QString &folderPath, const QList<LANDropUser> &recipients,
+                                            TransferPriority priority)
+{
+    DirectoryWalker *walker = new DirectoryWalker(0, this);
+    ++pendingFolders;
+    connect(walker, &DirectoryWalker::finished, this, [this, walker, recipients, priority]()
+            {
+        --pendingFolders;
+        QList<Archive::Entry> manifest = walker->entries();
+        QString name = walker->folderName();
+        walker->deleteLater();
+        if (manifest.isEmpty())
+        {
+            // qDebug() << "FileTransferManager: Cannot read folder" << name;
+            return;
+        }
+
+        // Parts keep path order, files of one folder may span two parts
+        QList<QList<Archive::Entry>> parts(1);
+        qint64 partSize = 0;
+        for (const Archive::Entry &entry : manifest)
+        {
+            qint64 entrySize = Archive::streamSize({entry});
+            if (partSize > 0 && partSize + entrySize > FOLDER_PART_SIZE)
+            {
+                parts.append(QList<Archive::Entry>());
+                partSize = 0;
+            }
+            parts.last().append(entry);
+            partSize += entrySize;
+        }
+
+        for (const LANDropUser &user : recipients)
+        {
+            for (int i = 0; i < parts.size(); ++i)
+            {
+                QString partName = parts.size() > 1 ? QString("%1 (%2 of %3)").arg(name).arg(i + 1).arg(parts.size()) : name;
+                startArchive(parts.at(i), partName, user, priority);
+            }
+        } });
+    walker->walk(folderPath);
+}
+
+/**
+ * @brief Sends files and folders to one recipient packed into one archive.
+ *
+ * The archive has a single session for all of its entries.
+ *
+ * @param entries Entries to pack, in stream order
+ * @param name Name the archive is announced and listed with
+ * @param user Recipient of the files
+ * @param priority Lane of the transfer
+ */
+void FileTransferManager::startArchive(const QList<Archive::Entry> &entries, const QString &name, const LANDropUser &user,
+                                       TransferPriority priority)
+{
+    qint64 size = Archive::streamSize(entries);
+    int sessionId = createTransferSession(name + QString(" @%1").arg(user.ipAddress), user.ipAddress, size);
+
+    scheduleTransfer({sessionId}, {user.ipAddress}, size, [this, sessionId, entries, name, user, priority]()
+                     {
+        ArchiveSender *archive = new ArchiveSender();
+        archive->setPriority(priority);
+        engine->adopt(archive);
+        transferObjects.insert(archive, {sessionId});
+        sessions[sessionId].archive = archive;
+
+        connect(archive, &ArchiveSender::transferAccepted, this, &FileTransferManager::onPeerTransferAccepted);
+        connect(archive, &ArchiveSender::transferRefused, this, &FileTransferManager::onPeerTransferRefused);
+        connect(archive, &ArchiveSender::progressUpdated, this, &FileTransferManager::onPeerProgressUpdated);
+        connect(archive, &ArchiveSender::transferFinished, this, &FileTransferManager::onPeerTransferFinished);
+        connect(archive, &ArchiveSender::transferError, this, &FileTransferManager::onPeerTransferError);
+        connect(archive, &ArchiveSender::archiveFinished, this, &FileTransferManager::onTransferObjectFinished);
+
+        QString ip = user.ipAddress;
+        quint16 port = user.transferPort;
+        int version = Protocol::versionFromDiscovery(user.version);
+        TransferEngine::post(archive, [archive, entries, name, ip, port, version]()
+                             { archive->sendEntries(entries, name, ip, port, version); }); }, priority);
+}
+
+/**
+ * @brief Queues an outgoing transfer until the transfer limits allow it to start.
+ *
+ * @param sessionIds Sessions the transfer carries
+ * @param peers Addresses the transfer connects to
+ * @param size Bytes the transfer sends to each peer
+ * @param start Creates and starts the sending object
+ * @param priority Lane of the transfer
+ */
+void FileTransferManager::scheduleTransfer(const QList<int> &sessionIds, const QStringList &peers, qint64 size,
+                                           const std::function<void()> &start, TransferPriority priority)
+{
+    ScheduledTransfer transfer;
+    transfer.id = nextTransferId++;
+    transfer.priority = priority;
+    transfer.size = size;
+    transfer.peers = peers;
+    transfer.sessionIds = sessionIds;
+    transfer.start = start;
+    transfer.queuedAt = TransferTrace::enabled() ? TransferTrace::now() : -1;
+    scheduledTransfers.insert(transfer.id, transfer);
+    for (int sessionId : sessionIds)
+        sessionToTransfer[sessionId] = transfer.id;
+
+    startQueuedTransfers();
+}
+
+/**
+ * @brief Starts queued transfers while slots are free.
+ *
+ * Transfers start by priority, then in request order, or smallest first
+ * when configured. A transfer whose peers are all busy is skipped, so it
+ * does not hold back transfers to other peers. Interactive transfers take
+ * one of Config::getInteractiveSlots() slots of their own rather than a
+ * global or per-peer one, so they never wait behind bulk transfers.
+ */
+void FileTransferManager::startQueuedTransfers()
+{
+    int maxActive = Config::getMaxActiveTransfers();
+    int maxPerPeer = Config::getMaxTransfersPerPeer();
+
+    QList<int> queued;
+    for (auto it = scheduledTransfers.constBegin(); it != scheduledTransfers.constEnd(); ++it)
+    {
+        if (!it.value().running)
+            queued.append(it.key());
+    }
+    if (Config::getSmallFilesFirst())
+    {
+        std::stable_sort(queued.begin(), queued.end(), [this](int a, int b)
+                         { return scheduledTransfers[a].size < scheduledTransfers[b].size; });
+    }
+    std::stable_sort(queued.begin(), queued.end(), [this](int a, int b)
+                     { return scheduledTransfers[a].priority > scheduledTransfers[b].priority; });
+
+    for (int id : queued)
+    {
+        auto found = scheduledTransfers.find(id);
+        if (found == scheduledTransfers.end() || found.value().running)
+            continue;
+
+        ScheduledTransfer &transfer = found.value();
+        if (transfer.priority == TransferPriority::INTERACTIVE)
+        {
+            if (activeInteractive >= Config::getInteractiveSlots())
+                continue;
+            ++activeInteractive;
+        }
+        else
+        {
+            if (maxActive > 0 && activeTransfers >= maxActive)
+                continue;
+
+            bool peerFree = true;
+            for (const QString &peer : transfer.peers)
+                peerFree = peerFree && (maxPerPeer <= 0 || activeTransfersPerPeer.value(peer) < maxPerPeer);
+            if (!peerFree)
+                continue;
+
+            ++activeTransfers;
+            for (const QString &peer : transfer.peers)
+                ++activeTransfersPerPeer[peer];
+        }
+
+        transfer.running = true;
+        TransferTrace::complete("queued", "manager", transfer.queuedAt, quint64(transfer.id));
+
+        // qDebug() << "FileTransferManager: Starting transfer" << id << "," << activeTransfers << "active";
+        std::function<void()> start = transfer.start;
+        start();
+    }
+}
+
+/**
+ * @brief Frees the slot of a transfer once all of its sessions are resolved.
+ *
+ * @param sessionId Session that finished, failed or was cancelled
+ */
+void FileTransferManager::releaseScheduledSession(int sessionId)
+{
+    if (!sessionToTransfer.contains(sessionId))
+        return;
+
+    int id = sessionToTransfer.take(sessionId);
+    auto found = scheduledTransfers.find(id);
+    if (found == scheduledTransfers.end())
+        return;
+
+    ScheduledTransfer &transfer = found.value();
+    transfer.sessionIds.removeAll(sessionId);
+    if (!transfer.sessionIds.isEmpty())
+        return;
+
+    if (transfer.running && transfer.priority == TransferPriority::INTERACTIVE)
+    {
+        --activeInteractive;
+    }
+    else if (transfer.running)
+    {
+        --activeTransfers;
+        for (const QString &peer : transfer.peers)
+        {
+            if (--activeTransfersPerPeer[peer] <= 0)
+                activeTransfersPerPeer.remove(peer);
         }
     }
+    scheduledTransfers.remove(id);
+
+    startQueuedTransfers();
+}
+
+/**
+ * @brief Number of outgoing transfers currently holding a slot.
+ */
+int FileTransferManager::getActiveTransferCount() const
+{
+    return activeTransfers + activeInteractive;
+}
+
+/**
+ * @brief Number of outgoing transfers waiting for a slot.
+ */
+int FileTransferManager::getQueuedTransferCount() const
+{
+    return scheduledTransfers.size() - activeTransfers - activeInteractive;
+}
+
+/**
+ * @brief Number of folders passed to sendFolderToUsers() still being listed.
+ *
+ * Their transfers have no session yet, they are created once the listing
+ * is complete.
+ */
+int FileTransferManager::getPendingFolderCount() const
+{
+    return pendingFolders;
+}
+
+/**
+ * @brief Publishes the scheduler and upload queues to TransferMetrics.
+ *
+ * The metrics are written to Config::getMetricsDumpPath() as well when
+ * one is set, for monitoring tools to pick up, and the TransferTrace
+ * being recorded is flushed to its file.
+ */
+void FileTransferManager::publishMetrics()
+{
+    TransferMetrics::setQueueDepth("transfersQueued", getQueuedTransferCount());
+    TransferMetrics::setQueueDepth("transfersActive", activeTransfers + activeInteractive);
+    TransferMetrics::setQueueDepth("uploadsQueued", UploadSlots::queuedCount());
+    TransferMetrics::setQueueDepth("uploadsActive", UploadSlots::activeCount());
+    TransferMetrics::setQueueDepth("pendingRequests", pendingBatchFiles.size());
+
+    QString dumpPath = Config::getMetricsDumpPath();
+    if (!dumpPath.isEmpty())
+        TransferMetrics::writeJson(dumpPath);
+
+    // A trace being recorded stays readable while the application runs
+    if (TransferTrace::enabled())
+        TransferTrace::flush();
+}
+
+/**
+ * @brief Records the users found by discovery, which set the order of relay chains.
+ *
+ * @param users Current discovery user list
+ */
+void FileTransferManager::setDiscoveredUsers(const QList<LANDropUser> &users)
+{
+    discoveredUsers = users;
+    mirror.setUsers(users);
+}
+
+/**
+ * @brief Queues the next new or changed file of a subscribed folder as a background job.
+ *
+ * One file is mirrored at a time, so mirroring holds at most one slot of
+ * the scheduler, and its job starts after those of every other lane. It
+ * is fetched by a SwarmDownload with range requests, which resumes from
+ * the blocks an earlier attempt kept. A peer that fails or does not serve
+ * ranges has the file retried later (see SubscriptionMirror::finished()).
+ */
+void FileTransferManager::mirrorNextFile()
+{
+    if (!mirrorSessions.isEmpty() || Config::getSubscribedFolders().isEmpty())
+        return;
+
+    SubscriptionMirror::Item item;
+    if (!mirror.next(&item))
+        return;
+
+    // qDebug() << "FileTransferManager: Mirroring" << item.relativePath << "from" << item.ipAddress;
+    int sessionId = createTransferSession(item.localPath, "Incoming", item.size);
+    sessions[sessionId].peerAddress = item.ipAddress;
+    mirrorSessions.insert(sessionId, item.key);
+
+    SwarmDownload::Source source;
+    source.ip = item.ipAddress;
+    source.port = item.port;
+    source.relativePath = item.relativePath;
+    scheduleTransfer({sessionId}, {item.ipAddress}, item.size, [this, sessionId, source, item]()
+                     { startSwarmDownload(sessionId, {source}, item.localPath, item.size, item.hash,
+                                          TransferPriority::BACKGROUND); },
+                     TransferPriority::BACKGROUND);
 }
 
 /**
@@ -159,9 +964,10 @@ void FileTransferManager::sendFilesToUsers(const QStringList &filePaths, const Q
  *
  * @param fileName Name of the file being transferred
  * @param recipientIP IP address of the recipient
+ * @param fileSize Bytes the transfer carries, used for its rate and remaining time
  * @return Unique session ID for tracking this transfer
  */
-int FileTransferManager::createTransferSession(const QString &fileName, const QString &recipientIP)
+int FileTransferManager::createTransferSession(const QString &fileName, const QString &recipientIP, qint64 fileSize)
 {
     int sessionId = nextSessionId++;
     TransferSession session;
@@ -170,41 +976,164 @@ int FileTransferManager::createTransferSession(const QString &fileName, const QS
     session.recipientIP = recipientIP;
     session.status = TransferStatus::WAITING;
     session.progress = 0;
+    session.fileSize = fileSize;
+
+    sessions[sessionId] = session;
+    progressAggregator->setSize(sessionId, fileSize);
+    // Emit signal to notify UI components
+    emit transferSessionCreated(sessionId, fileName, recipientIP);
+
+    return sessionId;
+}
+
+/**
+ * @brief Updates the status of a transfer session.
+ *
+ * @param sessionId ID of the session to update
+ * @param status New transfer status
+ */
+void FileTransferManager::updateSessionStatus(int sessionId, TransferStatus status)
+{
+    if (sessions.contains(sessionId))
+    {
+        TransferSession &session = sessions[sessionId];
+        bool ended = session.status == TransferStatus::FINISHED || session.status == TransferStatus::CANCELLED ||
+                     session.status == TransferStatus::ERROR;
+        session.status = status;
+        if (status == TransferStatus::IN_PROGRESS && session.startedAt < 0)
+            session.startedAt = QDateTime::currentMSecsSinceEpoch();
+
+        // Progress still pending is shown before the status it leads to
+        progressAggregator->flush();
+        emit transferStatusChanged(sessionId, status);
+
+        if (status == TransferStatus::FINISHED || status == TransferStatus::CANCELLED || status == TransferStatus::ERROR)
+        {
+            if (!ended)
+                recordHistory(sessions[sessionId]);
+            progressAggregator->remove(sessionId);
+            releaseScheduledSession(sessionId);
+            if (mirrorSessions.contains(sessionId))
+                mirror.finished(mirrorSessions.take(sessionId), status == TransferStatus::FINISHED);
+        }
+    }
+}
+
+/**
+ * @brief Appends a session that ended to the persistent history.
+ *
+ * @param session Session with its final status
+ */
+void FileTransferManager::recordHistory(const TransferSession &session)
+{
+    HistoryStore::Record record;
+    record.finishedAt = QDateTime::currentMSecsSinceEpoch();
+    record.durationMs = session.startedAt < 0 ? 0 : record.finishedAt - session.startedAt;
+    record.bytes = (session.status == TransferStatus::FINISHED) ? session.fileSize : session.fileSize * session.progress / 100;
+    record.outgoing = (session.recipientIP != "Incoming");
+    record.status = session.status;
+    record.fileName = session.fileName;
+    record.peer = record.outgoing ? session.recipientIP : session.peerAddress;
+    HistoryStore::shared()->append(record);
+}
+
+/**
+ * @brief Updates the progress of a transfer session.
+ *
+ * @param sessionId ID of the session to update
+ * @param progress Transfer progress percentage (0-100)
+ */
+void FileTransferManager::updateSessionProgress(int sessionId, int progress)
+{
+    if (sessions.contains(sessionId))
+    {
+        sessions[sessionId].progress = progress;
+        if (sessions[sessionId].startedAt < 0)
+            sessions[sessionId].startedAt = QDateTime::currentMSecsSinceEpoch();
+        progressAggregator->update(sessionId, progress);
+    }
+}
+
+/**
+ * @brief Forwards a batch of sampled progress to the UI.
+ *
+ * @param updates Sessions whose progress changed since the last batch
+ */
+void FileTransferManager::onProgressPublished(const QList<TransferProgress> &updates)
+{
+    for (const TransferProgress &update : updates)
+    {
+        auto session = sessions.find(update.sessionId);
+        if (session == sessions.end())
+            continue;
 
-    sessions[sessionId] = session;
-    // Emit signal to notify UI components
-    emit transferSessionCreated(sessionId, fileName, recipientIP);
+        // Watched sessions only report their progress here
+        session->progress = update.progress;
+        if (session->startedAt < 0)
+            session->startedAt = QDateTime::currentMSecsSinceEpoch();
+        emit transferProgressUpdated(update.sessionId, update.progress);
+    }
+    emit transferProgressBatchUpdated(updates);
+}
 
-    return sessionId;
+/**
+ * @brief Records the send window state of a session.
+ *
+ * @param sessionId ID of the session to update
+ * @param chunkSize Current chunk size in bytes
+ * @param sendWindow Current limit of queued bytes
+ * @param throughput Measured throughput in bytes per second
+ */
+void FileTransferManager::updateSessionStats(int sessionId, qint64 chunkSize, qint64 sendWindow, qint64 throughput)
+{
+    if (sessions.contains(sessionId))
+    {
+        TransferSession &session = sessions[sessionId];
+        session.chunkSize = chunkSize;
+        session.sendWindow = sendWindow;
+        session.throughput = throughput;
+    }
 }
 
 /**
- * @brief Updates the status of a transfer session.
+ * @brief Records the compression agreed for a session.
  *
  * @param sessionId ID of the session to update
- * @param status New transfer status
+ * @param codec Codec compressing the data
+ * @param level Compression level
  */
-void FileTransferManager::updateSessionStatus(int sessionId, TransferStatus status)
+void FileTransferManager::updateSessionCompression(int sessionId, const QString &codec, int level)
 {
     if (sessions.contains(sessionId))
     {
-        sessions[sessionId].status = status;
-        emit transferStatusChanged(sessionId, status);
+        sessions[sessionId].compressionCodec = codec;
+        sessions[sessionId].compressionLevel = level;
     }
 }
 
 /**
- * @brief Updates the progress of a transfer session.
+ * @brief Returns a copy of a session, including its send statistics.
+ *
+ * @param sessionId ID of the session
+ * @return The session, or a default-constructed one (id -1) if unknown
+ */
+TransferSession FileTransferManager::getSession(int sessionId) const
+{
+    return sessions.value(sessionId);
+}
+
+/**
+ * @brief Records the number of connections a session uses.
  *
  * @param sessionId ID of the session to update
- * @param progress Transfer progress percentage (0-100)
+ * @param stripeCount Negotiated stripe count
  */
-void FileTransferManager::updateSessionProgress(int sessionId, int progress)
+void FileTransferManager::updateSessionStripeCount(int sessionId, int stripeCount)
 {
     if (sessions.contains(sessionId))
     {
-        sessions[sessionId].progress = progress;
-        emit transferProgressUpdated(sessionId, progress);
+        sessions[sessionId].stripeCount = stripeCount;
+        emit transferStripeCountChanged(sessionId, stripeCount);
     }
 }
 
@@ -216,14 +1145,58 @@ void FileTransferManager::updateSessionProgress(int sessionId, int progress)
  */
 void FileTransferManager::onSenderTransferAccepted()
 {
-    Sender *sender = qobject_cast<Sender *>(this->sender());
-    if (sender && senderToSession.contains(sender))
+    int sessionId = peerSessionId(0);
+    if (sessionId >= 0)
     {
-        int sessionId = senderToSession[sender];
         updateSessionStatus(sessionId, TransferStatus::IN_PROGRESS);
     }
 }
 
+/**
+ * @brief Records the stripe count a sender agreed on with the receiver.
+ *
+ * @param stripeCount Number of connections carrying the file
+ */
+void FileTransferManager::onSenderStripeCountNegotiated(int stripeCount)
+{
+    int sessionId = peerSessionId(0);
+    if (sessionId >= 0)
+    {
+        updateSessionStripeCount(sessionId, stripeCount);
+    }
+}
+
+/**
+ * @brief Records the send window state reported by a sender.
+ *
+ * @param chunkSize Current chunk size in bytes
+ * @param sendWindow Current limit of queued bytes
+ * @param throughput Measured throughput in bytes per second
+ */
+void FileTransferManager::onSenderStatsUpdated(qint64 chunkSize, qint64 sendWindow, qint64 throughput)
+{
+    int sessionId = peerSessionId(0);
+    if (sessionId >= 0)
+    {
+        updateSessionStats(sessionId, chunkSize, sendWindow, throughput);
+    }
+}
+
+/**
+ * @brief Records the compression a sender agreed on with the receiver.
+ *
+ * @param codec Codec compressing the data
+ * @param level Compression level
+ */
+void FileTransferManager::onSenderCompressionNegotiated(const QString &codec, int level)
+{
+    int sessionId = peerSessionId(0);
+    if (sessionId >= 0)
+    {
+        updateSessionCompression(sessionId, codec, level);
+    }
+}
+
 /**
  * @brief Handles sender transfer refusal notification.
  *
@@ -232,38 +1205,16 @@ void FileTransferManager::onSenderTransferAccepted()
  */
 void FileTransferManager::onSenderTransferRefused()
 {
-    Sender *sender = qobject_cast<Sender *>(this->sender());
-    if (!sender || !senderToSession.contains(sender))
+    int sessionId = peerSessionId(0);
+    if (sessionId < 0)
     {
         return;
     }
 
-    int sessionId = senderToSession[sender];
     updateSessionStatus(sessionId, TransferStatus::CANCELLED);
 
-    // Disconnect all signals to prevent double-deletion
-    sender->disconnect();
-
-    // Use QPointer for safe deletion
-    QPointer<Sender> senderPtr(sender);
-
     // Delay cleanup to ensure UI updates are processed
-    QTimer::singleShot(500, this, [this, senderPtr, sessionId]()
-                       {
-        if (senderPtr) {
-            senderToSession.remove(senderPtr);
-            sessions.remove(sessionId);
-            delete senderPtr;
-        } else {
-            // Object was already deleted, just clean up the maps
-            sessions.remove(sessionId);
-            for (auto it = senderToSession.begin(); it != senderToSession.end(); ++it) {
-                if (it.value() == sessionId) {
-                    senderToSession.erase(it);
-                    break;
-                }
-            }
-        } });
+    retireTransferObject(this->sender(), 500);
 }
 
 /**
@@ -276,10 +1227,9 @@ void FileTransferManager::onSenderTransferRefused()
  */
 void FileTransferManager::onSenderProgressUpdated(int progress)
 {
-    Sender *sender = qobject_cast<Sender *>(this->sender());
-    if (sender && senderToSession.contains(sender))
+    int sessionId = peerSessionId(0);
+    if (sessionId >= 0)
     {
-        int sessionId = senderToSession[sender];
         updateSessionProgress(sessionId, progress);
     }
 }
@@ -292,63 +1242,178 @@ void FileTransferManager::onSenderProgressUpdated(int progress)
  */
 void FileTransferManager::onSenderTransferFinished()
 {
-    Sender *sender = qobject_cast<Sender *>(this->sender());
-    if (!sender || !senderToSession.contains(sender))
+    int sessionId = peerSessionId(0);
+    if (sessionId < 0)
     {
         return;
     }
 
-    int sessionId = senderToSession[sender];
+    // Mark as finished for completed transfers
+    updateSessionStatus(sessionId, TransferStatus::FINISHED);
+    retireTransferObject(this->sender(), 100);
+}
 
-    // Verify if the session is still active
-    if (sessions.contains(sessionId))
+/**
+ * @brief Handles sender transfer error notification.
+ *
+ * Updates the session status to ERROR when a file transfer encounters
+ * an error, but only if the transfer isn't already finished or cancelled.
+ * Safely cleans up the sender object and session data.
+ */
+void FileTransferManager::onSenderTransferError()
+{
+    int sessionId = peerSessionId(0);
+    if (sessionId < 0)
     {
-        // Mark as finished for completed transfers
-        updateSessionStatus(sessionId, TransferStatus::FINISHED);
+        return;
+    }
+
+    TransferStatus status = sessions.value(sessionId).status;
+    if (status != TransferStatus::FINISHED && status != TransferStatus::CANCELLED)
+    {
+        updateSessionStatus(sessionId, TransferStatus::ERROR);
     }
+    retireTransferObject(this->sender(), 100);
+}
 
-    // Disconnect all signals first
-    sender->disconnect();
+/**
+ * @brief Resolves the session ID of one file of the signalling batch connection.
+ *
+ * Fan-outs, chain relays and multicasts signal per recipient the same way
+ * and resolve here as well, archives and single-file senders with index 0
+ * for their only session. One hash lookup on the signalling object.
+ *
+ * @param index Position of the file in the batch, or of the fan-out recipient
+ * @return Session ID, or -1 if unknown
+ */
+int FileTransferManager::peerSessionId(int index) const
+{
+    const QList<int> sessionIds = transferObjects.value(this->sender());
+    return (index >= 0 && index < sessionIds.size()) ? sessionIds[index] : -1;
+}
 
-    // Use QPointer for safe deletion
-    QPointer<Sender> senderPtr(sender);
+/**
+ * @brief Drops a resolved single-file sending object and its session after a delay.
+ *
+ * Its signals are disconnected right away, so nothing arrives for the session
+ * any more; the session stays listed until the delay passed.
+ *
+ * @param object Sender whose only session is resolved
+ * @param delay Milliseconds to wait so UI updates are processed first
+ */
+void FileTransferManager::retireTransferObject(QObject *object, int delay)
+{
+    if (!object || !transferObjects.contains(object))
+        return;
 
-    // Delay cleanup to ensure UI updates are processed
-    QTimer::singleShot(100, this, [this, senderPtr, sessionId]()
+    object->disconnect();
+    QPointer<QObject> guard(object);
+    QTimer::singleShot(delay, this, [this, object, guard]()
                        {
-        if (senderPtr) {
-            senderToSession.remove(senderPtr);
+        for (int sessionId : transferObjects.take(object))
             sessions.remove(sessionId);
-            delete senderPtr;
-        } else {
-            // Object was already deleted, just clean up the maps
-            sessions.remove(sessionId);
-            for (auto it = senderToSession.begin(); it != senderToSession.end(); ++it) {
-                if (it.value() == sessionId) {
-                    senderToSession.erase(it);
-                    break;
-                }
-            }
-        } });
+        if (guard)
+            guard->deleteLater(); // Destroyed in its worker thread
+    });
 }
 
 /**
- * @brief Handles sender transfer error notification.
+ * @brief Drops a resolved batch transfer session after a delay.
  *
- * Updates the session status to ERROR when a file transfer encounters
- * an error, but only if the transfer isn't already finished or cancelled.
- * Safely cleans up the sender object and session data.
+ * @param sessionId ID of the session to remove
+ * @param delay Milliseconds to wait so UI updates are processed first
  */
-void FileTransferManager::onSenderTransferError()
+void FileTransferManager::releasePeerSessionEntry(int sessionId, int delay)
+{
+    QTimer::singleShot(delay, this, [this, sessionId]()
+                       { sessions.remove(sessionId); });
+}
+
+/**
+ * @brief Handles acceptance of one file of a batch connection.
+ *
+ * @param index Position of the file in the batch
+ */
+void FileTransferManager::onPeerTransferAccepted(int index)
 {
-    Sender *sender = qobject_cast<Sender *>(this->sender());
-    if (!sender || !senderToSession.contains(sender))
+    int sessionId = peerSessionId(index);
+    if (sessionId >= 0)
     {
-        return;
+        updateSessionStatus(sessionId, TransferStatus::IN_PROGRESS);
     }
+}
 
-    int sessionId = senderToSession[sender];
-    if (sessions.contains(sessionId))
+/**
+ * @brief Handles refusal of one file of a batch connection.
+ *
+ * @param index Position of the file in the batch
+ */
+void FileTransferManager::onPeerTransferRefused(int index)
+{
+    int sessionId = peerSessionId(index);
+    if (sessionId >= 0)
+    {
+        updateSessionStatus(sessionId, TransferStatus::CANCELLED);
+        releasePeerSessionEntry(sessionId, 500);
+    }
+}
+
+/**
+ * @brief Handles progress of one file of a batch connection.
+ *
+ * @param index Position of the file in the batch
+ * @param progress Transfer progress percentage
+ */
+void FileTransferManager::onPeerProgressUpdated(int index, int progress)
+{
+    int sessionId = peerSessionId(index);
+    if (sessionId >= 0)
+    {
+        updateSessionProgress(sessionId, progress);
+    }
+}
+
+/**
+ * @brief Records the send window state of one file of a batch connection.
+ *
+ * @param index Position of the file in the batch
+ * @param chunkSize Current chunk size in bytes
+ * @param sendWindow Current limit of queued bytes
+ * @param throughput Measured throughput in bytes per second
+ */
+void FileTransferManager::onPeerStatsUpdated(int index, qint64 chunkSize, qint64 sendWindow, qint64 throughput)
+{
+    int sessionId = peerSessionId(index);
+    if (sessionId >= 0)
+    {
+        updateSessionStats(sessionId, chunkSize, sendWindow, throughput);
+    }
+}
+
+/**
+ * @brief Handles completion of one file of a batch connection.
+ *
+ * @param index Position of the file in the batch
+ */
+void FileTransferManager::onPeerTransferFinished(int index)
+{
+    int sessionId = peerSessionId(index);
+    if (sessionId >= 0)
+    {
+        updateSessionStatus(sessionId, TransferStatus::FINISHED);
+        releasePeerSessionEntry(sessionId, 100);
+    }
+}
+
+/**
+ * @brief Handles failure of one file of a batch connection.
+ *
+ * @param index Position of the file in the batch
+ */
+void FileTransferManager::onPeerTransferError(int index)
+{
+    int sessionId = peerSessionId(index);
+    if (sessionId >= 0 && sessions.contains(sessionId))
     {
         TransferSession &session = sessions[sessionId];
         if (session.status != TransferStatus::FINISHED &&
@@ -356,54 +1421,172 @@ void FileTransferManager::onSenderTransferError()
         {
             updateSessionStatus(sessionId, TransferStatus::ERROR);
         }
+        releasePeerSessionEntry(sessionId, 100);
     }
+}
 
-    // Disconnect all signals first to prevent double-deletion
-    sender->disconnect();
-
-    // Use QPointer for safe deletion
-    QPointer<Sender> senderPtr(sender);
+/**
+ * @brief Cleans up a batch connection, fan-out, chain relay, multicast or
+ * archive once all of its sessions are resolved.
+ */
+void FileTransferManager::onTransferObjectFinished()
+{
+    QObject *object = this->sender();
+    if (!object || !transferObjects.contains(object))
+    {
+        return;
+    }
 
-    // Delay cleanup to ensure UI updates are processed
-    QTimer::singleShot(100, this, [this, senderPtr, sessionId]()
-                       {
-        if (senderPtr) {
-            senderToSession.remove(senderPtr);
-            sessions.remove(sessionId);
-            delete senderPtr;
-        } else {
-            // Object was already deleted, just clean up the maps
-            sessions.remove(sessionId);
-            for (auto it = senderToSession.begin(); it != senderToSession.end(); ++it) {
-                if (it.value() == sessionId) {
-                    senderToSession.erase(it);
-                    break;
-                }
-            }
-        } });
+    object->disconnect();
+    transferObjects.remove(object);
+    object->deleteLater();
 }
 
 /**
  * @brief Handles incoming file transfer requests from the receiver.
  *
- * Adds the file to the pending batch for user approval and creates a new
- * transfer session to track the incoming transfer progress.
+ * Creates a new transfer session to track the incoming transfer progress,
+ * then accepts the file at once when Config::getAutoAccept() or one of the
+ * AutoAcceptPolicy rules allows it from this sender, or adds it to the
+ * pending batch for user approval. The batch
+ * is signalled once no request came for 200 ms, or as soon as the sender's
+ * manifest is complete (see onReceiverBatchAnnounced()).
  *
  * @param fileName Name of the incoming file
  * @param fileSize Size of the incoming file as string
  * @param socket TCP socket for the file transfer
+ * @param transferId Identifier the receiver reports the transfer with
  */
-void FileTransferManager::onReceiverFileTransferRequested(const QString &fileName, const QString &fileSize, QTcpSocket *socket)
+void FileTransferManager::onReceiverFileTransferRequested(const QString &fileName, const QString &fileSize, QTcpSocket *socket,
+                                                          const QByteArray &transferId)
 {
+    // Create a new session for the incoming transfer
+    int sessionId = createTransferSession(fileName, "Incoming", fileSize.toLongLong());
+    if (socket)
+    {
+        // The same key for an IPv4 peer whether or not the socket maps it to IPv6
+        bool isIPv4 = false;
+        quint32 ipv4 = socket->peerAddress().toIPv4Address(&isIPv4);
+        sessions[sessionId].peerAddress = isIPv4 ? QHostAddress(ipv4).toString() : socket->peerAddress().toString();
+    }
+
+    receivedTransferToSession.insert(transferId, sessionId);
+    updateSessionStatus(sessionId, TransferStatus::WAITING);
+
+    // Progress is read from the worker's counter, not posted to this thread
+    progressAggregator->watch(sessionId, ProgressCounters::find(transferId));
+
+    qint64 size = fileSize.toLongLong();
+    TransferPriority priority = TransferPriority::NORMAL;
+    if (autoAccepts(socket, fileName, size, &priority))
+    {
+        // Counted against free space until it is written, the next rule checks see it
+        reservedSpace.insert(transferId, size);
+        if (!acceptIncomingTransfer(socket, fileName, priority))
+        {
+            releaseReservedSpace(transferId);
+            updateSessionStatus(sessionId, TransferStatus::ERROR);
+        }
+        return;
+    }
+
     pendingBatchFiles.insert(fileName, fileSize.toLongLong());
     pendingBatchSockets.insert(fileName, socket);
     batchTimer->start(200);
+}
 
-    // Create a new session for the incoming transfer
-    int sessionId = createTransferSession(fileName, "Incoming");
+/**
+ * @brief Asks about the whole batch of a manifest session at once.
+ *
+ * The files the sender put in its manifest leave the pending batch and
+ * are signalled with batchTransferRequested() right away, without waiting
+ * for the batch timer to guess which requests belong together.
+ *
+ * @param socket Session connection of the batch
+ */
+void FileTransferManager::onReceiverBatchAnnounced(QTcpSocket *socket)
+{
+    QMap<QString, qint64> files;
+    QMap<QString, QTcpSocket *> sockets;
+    for (auto it = pendingBatchSockets.begin(); it != pendingBatchSockets.end();)
+    {
+        if (it.value() == socket)
+        {
+            files.insert(it.key(), pendingBatchFiles.take(it.key()));
+            sockets.insert(it.key(), socket);
+            it = pendingBatchSockets.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
 
-    receivedFileToSession[fileName] = sessionId;
-    updateSessionStatus(sessionId, TransferStatus::WAITING);
+    if (pendingBatchFiles.isEmpty())
+        batchTimer->stop();
+    if (!files.isEmpty())
+        emit batchTransferRequested(files, sockets);
+}
+
+/**
+ * @brief Whether an incoming transfer is accepted without asking.
+ *
+ * Config::getAutoAccept() accepts everything, or everything from a
+ * discovered peer; otherwise the AutoAcceptPolicy rules decide, with the
+ * free space left once the files already accepted by a rule are written.
+ *
+ * @param socket Connection the transfer was offered on
+ * @param fileName Name of the offered file
+ * @param size Size of the offered file
+ * @param priority Set to the lane of the matching rule if not null, left as is otherwise
+ */
+bool FileTransferManager::autoAccepts(QTcpSocket *socket, const QString &fileName, qint64 size,
+                                      TransferPriority *priority) const
+{
+    // The receiver refuses such names, checked again as no rule may accept them
+    if (!Receiver::isSafeFileName(fileName))
+        return false;
+
+    int policy = Config::getAutoAccept();
+    if (policy >= 2)
+        return true;
+    if (!socket)
+        return false;
+
+    AutoAcceptPolicy::Request request;
+    request.fileName = fileName;
+    request.size = size;
+    request.address = socket->peerAddress();
+    for (const LANDropUser &user : discoveredUsers)
+    {
+        if (QHostAddress(user.ipAddress).isEqual(request.address, QHostAddress::ConvertV4MappedToIPv4))
+        {
+            if (policy == 1)
+                return true;
+            request.hostname = user.hostname;
+            break;
+        }
+    }
+
+    if (acceptPolicy.rules().isEmpty())
+        return false;
+
+    qint64 freeSpace = AutoAcceptPolicy::freeSpace(Config::getReceivedFilesPath());
+    if (freeSpace >= 0)
+    {
+        for (qint64 reserved : reservedSpace)
+            freeSpace -= reserved;
+        freeSpace = qMax<qint64>(0, freeSpace);
+    }
+    return acceptPolicy.accepts(request, freeSpace, priority);
+}
+
+/**
+ * @brief Stops counting a file accepted by a rule against the free space.
+ */
+void FileTransferManager::releaseReservedSpace(const QByteArray &transferId)
+{
+    reservedSpace.remove(transferId);
 }
 
 /**
@@ -411,12 +1594,13 @@ void FileTransferManager::onReceiverFileTransferRequested(const QString &fileNam
  *
  * @param fileName Name of the file being received
  * @param progress Transfer progress percentage (0-100)
+ * @param transferId Identifier of the transfer
  */
-void FileTransferManager::onReceiverProgressUpdated(const QString &fileName, int progress)
+void FileTransferManager::onReceiverProgressUpdated(const QString &fileName, int progress, const QByteArray &transferId)
 {
-    if (receivedFileToSession.contains(fileName))
+    int sessionId = receivedTransferToSession.value(transferId, -1);
+    if (sessionId >= 0)
     {
-        int sessionId = receivedFileToSession[fileName];
         updateSessionProgress(sessionId, progress);
     }
 }
@@ -426,12 +1610,16 @@ void FileTransferManager::onReceiverProgressUpdated(const QString &fileName, int
  *
  * @param fileName Name of the file being received
  * @param status New transfer status
+ * @param transferId Identifier of the transfer
  */
-void FileTransferManager::onReceiverStatusUpdated(const QString &fileName, TransferStatus status)
+void FileTransferManager::onReceiverStatusUpdated(const QString &fileName, TransferStatus status, const QByteArray &transferId)
 {
-    if (receivedFileToSession.contains(fileName))
+    if (status != TransferStatus::WAITING && status != TransferStatus::IN_PROGRESS)
+        releaseReservedSpace(transferId);
+
+    int sessionId = receivedTransferToSession.value(transferId, -1);
+    if (sessionId >= 0)
     {
-        int sessionId = receivedFileToSession[fileName];
         updateSessionStatus(sessionId, status);
     }
 }
@@ -443,71 +1631,143 @@ void FileTransferManager::onReceiverStatusUpdated(const QString &fileName, Trans
  * the completed file transfer.
  *
  * @param fileName Name of the successfully received file
+ * @param transferId Identifier of the transfer
  */
-void FileTransferManager::onReceiverFileReceived(const QString &fileName)
+void FileTransferManager::onReceiverFileReceived(const QString &fileName, const QByteArray &transferId)
 {
-    if (receivedFileToSession.contains(fileName))
+    releaseReservedSpace(transferId);
+    int sessionId = receivedTransferToSession.value(transferId, -1);
+    if (sessionId >= 0)
     {
-        int sessionId = receivedFileToSession[fileName];
         updateSessionStatus(sessionId, TransferStatus::FINISHED);
-        receivedFileToSession.remove(fileName);
+        receivedTransferToSession.remove(transferId);
+    }
+}
+
+/**
+ * @brief Handles the stripe count agreed for an incoming transfer.
+ *
+ * @param fileName Name of the file being received
+ * @param stripeCount Number of connections the sender will use
+ * @param transferId Identifier of the transfer
+ */
+void FileTransferManager::onReceiverStripeCountNegotiated(const QString &fileName, int stripeCount, const QByteArray &transferId)
+{
+    int sessionId = receivedTransferToSession.value(transferId, -1);
+    if (sessionId >= 0)
+    {
+        updateSessionStripeCount(sessionId, stripeCount);
+    }
+}
+
+/**
+ * @brief Handles the compression agreed for an incoming transfer.
+ *
+ * @param fileName Name of the file being received
+ * @param codec Codec compressing the data
+ * @param level Compression level
+ * @param transferId Identifier of the transfer
+ */
+void FileTransferManager::onReceiverCompressionNegotiated(const QString &fileName, const QString &codec, int level,
+                                                          const QByteArray &transferId)
+{
+    int sessionId = receivedTransferToSession.value(transferId, -1);
+    if (sessionId >= 0)
+    {
+        updateSessionCompression(sessionId, codec, level);
     }
 }
 
 /**
  * @brief Initiates a download request for a shared file from another user.
  *
- * Connects to the remote user's server and sends a download request for the
- * specified file. Sets up the local receiver to accept the incoming file
- * transfer and handles the download request protocol.
+ * The receiver asks the remote user's server for the file, which comes back
+ * on the same connection and goes through the usual accept flow, so the
+ * download starts after one round trip (see Receiver::requestDownload()).
+ *
+ * A byte range only fetches part of the file into the local copy, so a
+ * large file can be previewed, or a growing one followed by asking from
+ * the size of the local copy on.
  *
  * @param userIP IP address of the user sharing the file
  * @param userPort Port number of the user's file server
  * @param relativePath Relative path of the file on the remote system
  * @param fileName Name of the file to download
+ * @param offset First byte wanted
+ * @param length Bytes wanted, -1 up to the end of the file
  */
-void FileTransferManager::downloadSharedFile(const QString &userIP, quint16 userPort, const QString &relativePath, const QString &fileName)
+void FileTransferManager::downloadSharedFile(const QString &userIP, quint16 userPort, const QString &relativePath, const QString &fileName,
+                                             qint64 offset, qint64 length)
 {
     // qDebug() << "FileTransferManager: Starting download request for" << fileName << "from" << userIP << ":" << userPort;
 
     setupReceiver();
-    quint16 ourPort = receiver->getServerPort(); // Use receiver port
-
-    QTcpSocket *downloadSocket = new QTcpSocket(this);
-
-    // Use QPointer for safe deletion
-    QPointer<QTcpSocket> socketPtr(downloadSocket);
-
-    connect(downloadSocket, &QTcpSocket::connected, this, [this, socketPtr, relativePath, fileName, ourPort]()
-            {
-        if (!socketPtr) return;
+    if (!receiver)
+        return;
 
-        QString downloadRequest = QString("DOWNLOAD_REQUEST|%1|%2|%3")
-            .arg(relativePath, fileName)
-            .arg(QString::number(ourPort));
+    Receiver *target = receiver;
+    QTcpSocket *connection = takePooledConnection(userIP, userPort, receiver);
+    TransferEngine::post(receiver, [target, userIP, userPort, relativePath, fileName, connection, offset, length]()
+                         { target->requestDownload(userIP, userPort, relativePath, fileName, connection, offset, length); });
+}
 
-        socketPtr->write(downloadRequest.toUtf8());
-        socketPtr->flush();
+/**
+ * @brief Downloads a shared file from every user sharing the same contents.
+ *
+ * Each user serves different ranges of the file at the same time, faster
+ * ones more of them (see SwarmDownload). If none of them answers range
+ * requests, as older peers do not, the file is downloaded from the first
+ * one the usual way.
+ *
+ * @param sources Users whose catalogs list the file with this hash and size
+ * @param fileName Name of the file to download
+ * @param size Size of the file
+ * @param hash Hex hash of the contents
+ */
+void FileTransferManager::downloadSharedFile(const QList<SwarmDownload::Source> &sources, const QString &fileName,
+                                             qint64 size, const QByteArray &hash)
+{
+    if (sources.isEmpty())
+        return;
 
-        QTimer::singleShot(1000, this, [socketPtr]() {
-            if (socketPtr && socketPtr->state() == QAbstractSocket::ConnectedState) {
-                socketPtr->disconnectFromHost();
-            }
-        }); });
+    int sessionId = createTransferSession(fileName, "Incoming", size);
+    startSwarmDownload(sessionId, sources, fileName, size, hash, TransferPriority::NORMAL);
+}
 
-    connect(downloadSocket, &QTcpSocket::disconnected, this, [socketPtr]()
-            {
-        if (socketPtr) {
-            socketPtr->deleteLater();
-        } });
+/**
+ * @brief Runs the SwarmDownload of a session.
+ *
+ * If no source answers range requests, a download the user asked for is
+ * tried again from the first source the usual way. A mirror download is
+ * cancelled instead, its file is retried later.
+ *
+ * @param priority Lane the download reads in, see BandwidthShaper
+ */
+void FileTransferManager::startSwarmDownload(int sessionId, const QList<SwarmDownload::Source> &sources,
+                                             const QString &fileName, qint64 size, const QByteArray &hash,
+                                             TransferPriority priority)
+{
+    // Lives on a worker thread, signals arrive here queued
+    SwarmDownload *download = new SwarmDownload();
+    download->setPriority(priority);
+    engine->adopt(download);
+    transferObjects.insert(download, {sessionId});
 
-    connect(downloadSocket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::errorOccurred),
-            this, [socketPtr](QAbstractSocket::SocketError error)
+    connect(download, &SwarmDownload::progressUpdated, this, &FileTransferManager::onSenderProgressUpdated);
+    connect(download, &SwarmDownload::sourceCountChanged, this, &FileTransferManager::onSenderStripeCountNegotiated);
+    connect(download, &SwarmDownload::transferFinished, this, &FileTransferManager::onSenderTransferFinished);
+    connect(download, &SwarmDownload::transferError, this, &FileTransferManager::onSenderTransferError);
+    connect(download, &SwarmDownload::transferRefused, this, [this, download, sessionId, sources, fileName]()
             {
-        if (socketPtr) {
-            socketPtr->deleteLater();
-        } });
+        bool mirrored = mirrorSessions.contains(sessionId);
+        updateSessionStatus(sessionId, TransferStatus::CANCELLED);
+        retireTransferObject(download, 100);
+        if (mirrored)
+            return;
+        const SwarmDownload::Source &source = sources.first();
+        downloadSharedFile(source.ip, source.port, source.relativePath, fileName); });
 
-    // qDebug() << "FileTransferManager: Connecting to" << userIP << ":" << userPort << "for download request";
-    downloadSocket->connectToHost(userIP, userPort);
+    updateSessionStatus(sessionId, TransferStatus::IN_PROGRESS);
+    TransferEngine::post(download, [download, sources, fileName, size, hash]()
+                         { download->start(sources, fileName, size, hash); });
 }
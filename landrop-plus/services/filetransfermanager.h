@@ -10,11 +10,29 @@
 #include <QTimer>
 #include <QTcpSocket>
 #include <QFile>
+#include <QFileSystemWatcher>
 #include <QMap>
+#include <QHash>
+#include <QStringList>
+#include <functional>
 #include "../network/sender.h"
 #include "../network/receiver.h"
+#include "../network/peersession.h"
+#include "../network/fanoutsender.h"
+#include "../network/chainrelay.h"
+#include "../network/multicastsender.h"
+#include "../network/archivesender.h"
+#include "../network/swarmdownload.h"
 #include "../core/transferstatus.h"
+#include "../core/transferpriority.h"
+#include "subscriptionmirror.h"
 #include "broadcastdiscoveryservice.h"
+#include "transferengine.h"
+#include "directorywalker.h"
+#include "connectionpool.h"
+#include "progressaggregator.h"
+#include "autoacceptpolicy.h"
+#include "historystore.h"
 
 /**
  * @brief Structure representing an incoming file transfer request.
@@ -56,11 +74,90 @@ struct TransferSession
     /** Transfer progress percentage */
     int progress;
 
+    /** Bytes the transfer carries, 0 when unknown */
+    qint64 fileSize;
+
     /** Sender object handling this transfer */
     Sender *sender;
 
+    /** Batch connection carrying this transfer, if any */
+    PeerSession *peerSession;
+
+    /** Fan-out sending this file to several recipients, if any */
+    FanoutSender *fanout;
+
+    /** Chain relaying this file from one recipient to the next, if any */
+    ChainRelay *relay;
+
+    /** Multicast sending this file to several recipients at once, if any */
+    MulticastSender *multicast;
+
+    /** Archive carrying this file together with other small files, if any */
+    ArchiveSender *archive;
+
+    /** Number of parallel connections carrying the file */
+    int stripeCount;
+
+    /** Current chunk size of the sending connection in bytes */
+    qint64 chunkSize;
+
+    /** Current limit of queued bytes on the sending connection */
+    qint64 sendWindow;
+
+    /** Measured throughput of the sending connection in bytes per second */
+    qint64 throughput;
+
+    /** Codec compressing the file data on the wire, empty when sent plain */
+    QString compressionCodec;
+
+    /** Compression level agreed with the peer */
+    int compressionLevel;
+
+    /** Address of the sender of an incoming transfer, empty for outgoing ones or if unknown */
+    QString peerAddress;
+
+    /** Milliseconds since the epoch the transfer started moving data at, -1 before */
+    qint64 startedAt;
+
     TransferSession() : id(-1), status(TransferStatus::WAITING),
-                        progress(0), sender(nullptr) {}
+                        progress(0), fileSize(0), sender(nullptr), peerSession(nullptr), fanout(nullptr), relay(nullptr), multicast(nullptr), archive(nullptr), stripeCount(1),
+                        chunkSize(0), sendWindow(0), throughput(0), compressionLevel(0), startedAt(-1) {}
+};
+
+/**
+ * @brief Structure representing an outgoing transfer in the scheduler queue.
+ *
+ * One connection, fan-out, chain or multicast is one transfer. It holds a
+ * global slot and one slot for each peer it connects to while running; an
+ * interactive transfer holds one of Config::getInteractiveSlots() instead.
+ */
+struct ScheduledTransfer
+{
+    /** Scheduler identifier, increasing in request order */
+    int id;
+
+    /** Bytes sent to each peer, for small files first ordering */
+    qint64 size;
+
+    /** Addresses of the peers the transfer connects to */
+    QStringList peers;
+
+    /** Sessions of the transfer that are not resolved yet */
+    QList<int> sessionIds;
+
+    /** Creates and starts the sending object */
+    std::function<void()> start;
+
+    /** Whether the transfer holds its slots */
+    bool running;
+
+    /** TransferTrace::now() the transfer was queued at, -1 when not recording */
+    qint64 queuedAt;
+
+    /** Lane of the transfer, interactive ones have slots of their own */
+    TransferPriority priority;
+
+    ScheduledTransfer() : id(-1), size(0), running(false), queuedAt(-1), priority(TransferPriority::NORMAL) {}
 };
 
 /**
@@ -71,6 +168,9 @@ struct TransferSession
  * a unified interface for the application. It coordinates between Sender
  * and Receiver objects, manages transfer sessions, handles batch operations,
  * and provides progress tracking for the UI.
+ *
+ * The Sender, PeerSession and Receiver objects live on TransferEngine worker
+ * threads; this class stays on the GUI thread and only sees their signals.
  */
 class FileTransferManager : public QObject
 {
@@ -82,8 +182,27 @@ public:
 
     void setupReceiver();
     void restartReceiver();
-    void sendFilesToUsers(const QStringList &filePaths, const QList<LANDropUser> &recipients);
-    void downloadSharedFile(const QString &userIP, quint16 userPort, const QString &relativePath, const QString &fileName);
+    void sendFilesToUsers(const QStringList &filePaths, const QList<LANDropUser> &recipients,
+                          TransferPriority priority = TransferPriority::NORMAL);
+    void sendFolderToUsers(const QString &folderPath, const QList<LANDropUser> &recipients,
+                           TransferPriority priority = TransferPriority::NORMAL);
+    void downloadSharedFile(const QString &userIP, quint16 userPort, const QString &relativePath, const QString &fileName,
+                            qint64 offset = 0, qint64 length = -1);
+    void downloadSharedFile(const QList<SwarmDownload::Source> &sources, const QString &fileName, qint64 size,
+                            const QByteArray &hash);
+    bool acceptIncomingTransfer(QTcpSocket *socket, const QString &fileName,
+                                TransferPriority priority = TransferPriority::NORMAL);
+    void rejectIncomingTransfer(QTcpSocket *socket, const QString &fileName);
+    void setDiscoveredUsers(const QList<LANDropUser> &users);
+    void prewarmConnection(const LANDropUser &user);
+    int getSessionStripeCount(int sessionId) const;
+    TransferSession getSession(int sessionId) const;
+    int getActiveTransferCount() const;
+    int getQueuedTransferCount() const;
+    int getPendingFolderCount() const;
+    bool reloadAutoAcceptRules();
+    bool reloadTransferProfiles();
+    const AutoAcceptPolicy &getAutoAcceptPolicy() const { return acceptPolicy; }
     Receiver *getReceiver() const { return receiver; }
 
 signals:
@@ -97,11 +216,21 @@ signals:
 
     /**
      * @brief Signal emitted when transfer progress is updated.
+     *
+     * Sampled by ProgressAggregator, emitted for each session of a batch
+     * right before transferProgressBatchUpdated().
+     *
      * @param sessionId Session identifier.
      * @param progress Transfer progress percentage.
      */
     void transferProgressUpdated(int sessionId, int progress);
 
+    /**
+     * @brief Signal emitted at most every ProgressAggregator::PUBLISH_INTERVAL milliseconds.
+     * @param updates Progress, rate and remaining time of every session that changed.
+     */
+    void transferProgressBatchUpdated(const QList<TransferProgress> &updates);
+
     /**
      * @brief Signal emitted when transfer status changes.
      * @param sessionId Session identifier.
@@ -109,6 +238,13 @@ signals:
      */
     void transferStatusChanged(int sessionId, TransferStatus status);
 
+    /**
+     * @brief Signal emitted when a transfer is split over several connections.
+     * @param sessionId Session identifier.
+     * @param stripeCount Number of parallel connections agreed with the peer.
+     */
+    void transferStripeCountChanged(int sessionId, int stripeCount);
+
     /**
      * @brief Signal emitted when multiple file transfers are requested.
      * @param files Map of file names to file sizes.
@@ -123,29 +259,124 @@ private slots:
     void onSenderProgressUpdated(int progress);
     void onSenderTransferFinished();
     void onSenderTransferError();
-    void onReceiverFileTransferRequested(const QString &fileName, const QString &fileSize, QTcpSocket *socket);
-    void onReceiverProgressUpdated(const QString &fileName, int progress);
-    void onReceiverStatusUpdated(const QString &fileName, TransferStatus status);
-    void onReceiverFileReceived(const QString &fileName);
+    void onSenderStripeCountNegotiated(int stripeCount);
+    void onSenderStatsUpdated(qint64 chunkSize, qint64 sendWindow, qint64 throughput);
+    void onSenderCompressionNegotiated(const QString &codec, int level);
+    void onPeerTransferAccepted(int index);
+    void onPeerTransferRefused(int index);
+    void onPeerProgressUpdated(int index, int progress);
+    void onPeerTransferFinished(int index);
+    void onPeerTransferError(int index);
+    void onPeerStatsUpdated(int index, qint64 chunkSize, qint64 sendWindow, qint64 throughput);
+    void onTransferObjectFinished();
+    void onReceiverFileTransferRequested(const QString &fileName, const QString &fileSize, QTcpSocket *socket,
+                                         const QByteArray &transferId);
+    void onReceiverBatchAnnounced(QTcpSocket *socket);
+    void onReceiverProgressUpdated(const QString &fileName, int progress, const QByteArray &transferId);
+    void onReceiverStatusUpdated(const QString &fileName, TransferStatus status, const QByteArray &transferId);
+    void onReceiverFileReceived(const QString &fileName, const QByteArray &transferId);
+    void onReceiverStripeCountNegotiated(const QString &fileName, int stripeCount, const QByteArray &transferId);
+    void onReceiverCompressionNegotiated(const QString &fileName, const QString &codec, int level,
+                                         const QByteArray &transferId);
+    void onProgressPublished(const QList<TransferProgress> &updates);
+    void publishMetrics();
+    void mirrorNextFile();
 
 private:
-    int createTransferSession(const QString &fileName, const QString &recipientIP);
+    int createTransferSession(const QString &fileName, const QString &recipientIP, qint64 fileSize = 0);
+    void startSender(const QString &filePath, const LANDropUser &user, TransferPriority priority);
+    void startPeerSession(const QStringList &filePaths, const LANDropUser &user, TransferPriority priority);
+    void startFanout(const QString &filePath, const QList<LANDropUser> &recipients, TransferPriority priority);
+    void startChainRelay(const QString &filePath, const QList<LANDropUser> &recipients, TransferPriority priority);
+    void startMulticast(const QString &filePath, const QList<LANDropUser> &recipients, TransferPriority priority);
+    void startArchive(const QList<Archive::Entry> &entries, const QString &name, const LANDropUser &user,
+                      TransferPriority priority);
+    void scheduleTransfer(const QList<int> &sessionIds, const QStringList &peers, qint64 size,
+                          const std::function<void()> &start, TransferPriority priority = TransferPriority::NORMAL);
+    void startQueuedTransfers();
+    void releaseScheduledSession(int sessionId);
+    void recordHistory(const TransferSession &session);
+    QTcpSocket *takePooledConnection(const QString &ip, quint16 port, QObject *target);
+    int peerSessionId(int index) const;
+    void retireTransferObject(QObject *object, int delay);
+    void releasePeerSessionEntry(int sessionId, int delay);
     void updateSessionStatus(int sessionId, TransferStatus status);
     void updateSessionProgress(int sessionId, int progress);
+    void updateSessionStripeCount(int sessionId, int stripeCount);
+    void updateSessionStats(int sessionId, qint64 chunkSize, qint64 sendWindow, qint64 throughput);
+    void updateSessionCompression(int sessionId, const QString &codec, int level);
+    bool autoAccepts(QTcpSocket *socket, const QString &fileName, qint64 size, TransferPriority *priority = nullptr) const;
+    void releaseReservedSpace(const QByteArray &transferId);
+    void startSwarmDownload(int sessionId, const QList<SwarmDownload::Source> &sources, const QString &fileName,
+                            qint64 size, const QByteArray &hash, TransferPriority priority);
+
+    /** Worker threads running all transfer I/O */
+    TransferEngine *engine;
+
+    /** Idle connections opened ahead of transfers */
+    ConnectionPool *connectionPool;
+
+    /** Samples session progress and publishes it at a fixed rate */
+    ProgressAggregator *progressAggregator;
+
+    /** Publishes the queue depths to TransferMetrics and writes its dump, every METRICS_INTERVAL_MS */
+    QTimer *metricsTimer;
+
+    static const int METRICS_INTERVAL_MS = 1000;
 
     /** Receiver object for handling incoming transfers */
     Receiver *receiver;
 
-    /** Map of active transfer sessions indexed by session ID */
-    QMap<int, TransferSession> sessions;
+    /** Port the receiver listens on, cached on the GUI thread */
+    quint16 receiverPort;
+
+    /** Active transfer sessions indexed by session ID */
+    QHash<int, TransferSession> sessions;
+
+    /**
+     * Owner of every sending object (Sender, PeerSession, FanoutSender,
+     * ChainRelay, MulticastSender, ArchiveSender, SwarmDownload), linked to the session IDs
+     * it signals for by index: files in batch order, recipients in target or
+     * chain order, the one session of a Sender or an archive. Objects are
+     * destroyed when they leave it.
+     */
+    QHash<QObject *, QList<int>> transferObjects;
+
+    /** Largest archive stream a sent folder is split into, so its parts share the peer's slots */
+    static const qint64 FOLDER_PART_SIZE = 256LL * 1024 * 1024;
 
-    /** Map linking sender objects to their session IDs */
-    QMap<Sender *, int> senderToSession;
+    /** Users found by discovery, in the order chains are relayed in */
+    QList<LANDropUser> discoveredUsers;
 
-    /** Map linking received file names to session IDs */
-    QMap<QString, int> receivedFileToSession;
+    /** Incoming sessions by the transfer ID the receiver reports, names may repeat */
+    QHash<QByteArray, int> receivedTransferToSession;
 
-    /** Timer for batching multiple transfer requests */
+    /** Rules accepting incoming files from trusted peers */
+    AutoAcceptPolicy acceptPolicy;
+
+    /** Watches the transfer profiles file and its folder, editors often replace the file */
+    QFileSystemWatcher *profilesWatcher = nullptr;
+
+    /** Waits for a profiles file being written to be complete */
+    QTimer *profilesTimer = nullptr;
+
+    static const int PROFILES_SETTLE_MS = 200;
+
+    /** Files of the subscribed folders still to download */
+    SubscriptionMirror mirror;
+
+    /** Queues the next subscribed file every MIRROR_INTERVAL_MS while none is queued or running */
+    QTimer *mirrorTimer = nullptr;
+
+    static const int MIRROR_INTERVAL_MS = 2000;
+
+    /** Item key of the session of each mirror download, queued or running */
+    QHash<int, QString> mirrorSessions;
+
+    /** Sizes of the files accepted by a rule and still being received, by transfer ID */
+    QHash<QByteArray, qint64> reservedSpace;
+
+    /** Timer for batching the transfer requests of senders without manifests */
     QTimer *batchTimer;
 
     /** Temporary storage for pending batch files */
@@ -156,6 +387,25 @@ private:
 
     /** Counter for generating unique session IDs */
     int nextSessionId;
+
+    /** Outgoing transfers queued or running, in request order */
+    QMap<int, ScheduledTransfer> scheduledTransfers;
+
+    /** Map linking unresolved outgoing sessions to their scheduled transfer */
+    QMap<int, int> sessionToTransfer;
+
+    /** Counter for generating scheduler identifiers */
+    int nextTransferId;
+
+    /** Number of scheduled transfers running, globally and per peer address */
+    int activeTransfers;
+    QMap<QString, int> activeTransfersPerPeer;
+
+    /** Number of interactive transfers running in their own slots */
+    int activeInteractive;
+
+    /** Folders still being listed, their transfers are not scheduled yet */
+    int pendingFolders;
 };
 
 #endif // FILETRANSFERMANAGER_H
\ No newline at end of file
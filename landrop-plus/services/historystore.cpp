@@ -0,0 +1,498 @@
+/**
+ * @file historystore.cpp
+ */
+
+#include "historystore.h"
+#include "../network/blockmap.h"
+#include "../config/config.h"
+#include <QDateTime>
+#include <QMutexLocker>
+#include <QtEndian>
+
+namespace
+{
+    /** First bytes of the log, followed by the format version */
+    const QByteArray MAGIC = "LDHS";
+    const quint32 VERSION = 1;
+
+    /** Bytes before the first entry: magic and version */
+    const qint64 HEADER_SIZE = 8;
+
+    /** Bytes of an entry before its fields: length and CRC-32C */
+    const qint64 ENTRY_HEADER = 8;
+
+    /** Bytes of the fields before the file name and peer */
+    const qint64 FIXED_FIELDS = 30;
+
+    /** Bytes of an offset in the index */
+    const qint64 OFFSET_SIZE = 8;
+
+    /** Longest file name or peer stored, in UTF-8 bytes */
+    const int MAX_TEXT = 0xffff;
+
+    /**
+     * @brief End of the entry at @p offset if it is complete and its checksum matches.
+     *
+     * @return Offset right after the entry, -1 if there is none
+     */
+    qint64 entryEnd(const uchar *log, qint64 logSize, qint64 offset)
+    {
+        if (offset < HEADER_SIZE || offset + ENTRY_HEADER > logSize)
+            return -1;
+
+        qint64 length = qFromLittleEndian<quint32>(log + offset);
+        if (length < FIXED_FIELDS || offset + ENTRY_HEADER + length > logSize)
+            return -1;
+
+        quint32 checksum = qFromLittleEndian<quint32>(log + offset + 4);
+        const char *fields = reinterpret_cast<const char *>(log + offset + ENTRY_HEADER);
+        if (BlockMap::checksum(fields, length) != checksum)
+            return -1;
+        return offset + ENTRY_HEADER + length;
+    }
+
+    QByteArray encodeEntry(const HistoryStore::Record &record)
+    {
+        QByteArray name = record.fileName.toUtf8().left(MAX_TEXT);
+        QByteArray peer = record.peer.toUtf8().left(MAX_TEXT);
+
+        QByteArray fields(int(FIXED_FIELDS), Qt::Uninitialized);
+        char *out = fields.data();
+        qToLittleEndian<qint64>(record.finishedAt, out);
+        qToLittleEndian<qint64>(record.durationMs, out + 8);
+        qToLittleEndian<qint64>(record.bytes, out + 16);
+        out[24] = char(record.outgoing ? 1 : 0);
+        out[25] = char(record.status);
+        qToLittleEndian<quint16>(quint16(name.size()), out + 26);
+        qToLittleEndian<quint16>(quint16(peer.size()), out + 28);
+        fields += name;
+        fields += peer;
+
+        QByteArray entry(int(ENTRY_HEADER), Qt::Uninitialized);
+        qToLittleEndian<quint32>(quint32(fields.size()), entry.data());
+        qToLittleEndian<quint32>(BlockMap::checksum(fields), entry.data() + 4);
+        return entry + fields;
+    }
+}
+
+/**
+ * @brief Constructs a closed store, see open().
+ *
+ * @param parent Parent QObject
+ */
+HistoryStore::HistoryStore(QObject *parent)
+    : QObject(parent)
+{
+    // One writer keeps the records in the order they were appended
+    writer.setMaxThreadCount(1);
+}
+
+HistoryStore::~HistoryStore()
+{
+    close();
+}
+
+/**
+ * @brief Store of the process, opened on Config::getHistoryPath() when first used.
+ *
+ * Every FileTransferManager appends to it, so two of them never write one log.
+ */
+HistoryStore *HistoryStore::shared()
+{
+    static HistoryStore store;
+    static bool opened = store.open(Config::getHistoryPath());
+    Q_UNUSED(opened);
+    return &store;
+}
+
+/**
+ * @brief Opens or creates a log and its index.
+ *
+ * An entry cut short at the end of the log is dropped, and the entries
+ * the index lost are indexed again; nothing before them is read.
+ *
+ * @param filePath Path of the log
+ * @return false if the files cannot be opened or the log is not a history log
+ */
+bool HistoryStore::open(const QString &filePath)
+{
+    close();
+
+    logFile.setFileName(filePath);
+    indexFile.setFileName(indexPath(filePath));
+    if (!logFile.open(QIODevice::ReadWrite) || !indexFile.open(QIODevice::ReadWrite))
+    {
+        close();
+        return false;
+    }
+
+    QByteArray header = MAGIC;
+    header.resize(int(HEADER_SIZE));
+    qToLittleEndian<quint32>(VERSION, header.data() + 4);
+    if (logFile.size() < HEADER_SIZE)
+    {
+        // New log, or one whose header never reached the disk
+        logFile.resize(0);
+        indexFile.resize(0);
+        if (logFile.write(header) != HEADER_SIZE || !logFile.flush())
+        {
+            close();
+            return false;
+        }
+    }
+    else if (logFile.read(HEADER_SIZE) != header)
+    {
+        close();
+        return false;
+    }
+
+    qint64 logSize = logFile.size();
+    uchar *log = logFile.map(0, logSize);
+    if (!log)
+    {
+        close();
+        return false;
+    }
+
+    // The last offset that names a whole entry is trusted, with every one before it
+    qint64 records = indexFile.size() / OFFSET_SIZE;
+    qint64 end = HEADER_SIZE;
+    while (records > 0)
+    {
+        QByteArray offset;
+        if (indexFile.seek((records - 1) * OFFSET_SIZE))
+            offset = indexFile.read(OFFSET_SIZE);
+        qint64 entry = offset.size() == OFFSET_SIZE
+                           ? entryEnd(log, logSize, qFromLittleEndian<qint64>(offset.constData()))
+                           : -1;
+        if (entry > 0)
+        {
+            end = entry;
+            break;
+        }
+        --records;
+    }
+
+    // Entries written after the index was, e.g. before a crash
+    QByteArray missing;
+    for (qint64 next = entryEnd(log, logSize, end); next > 0;
+         next = entryEnd(log, logSize, end))
+    {
+        QByteArray offset(int(OFFSET_SIZE), Qt::Uninitialized);
+        qToLittleEndian<qint64>(end, offset.data());
+        missing += offset;
+        end = next;
+    }
+    logFile.unmap(log);
+
+    bool ok = indexFile.resize(records * OFFSET_SIZE) && indexFile.seek(records * OFFSET_SIZE) &&
+              indexFile.write(missing) == missing.size() && indexFile.flush() && logFile.resize(end) &&
+              logFile.seek(end);
+    logReader.setFileName(filePath);
+    indexReader.setFileName(indexPath(filePath));
+    if (!ok || !logReader.open(QIODevice::ReadOnly) || !indexReader.open(QIODevice::ReadOnly))
+    {
+        close();
+        return false;
+    }
+
+    {
+        QMutexLocker lock(&mutex);
+        stored = records + missing.size() / OFFSET_SIZE;
+        storedBytes = end;
+    }
+    QMutexLocker lock(&pendingMutex);
+    accepting = true;
+    return true;
+}
+
+/**
+ * @brief Writes what is queued and closes the files.
+ */
+void HistoryStore::close()
+{
+    {
+        QMutexLocker lock(&pendingMutex);
+        accepting = false;
+    }
+    flush();
+
+    QMutexLocker lock(&mutex);
+    if (logMap)
+        logReader.unmap(logMap);
+    if (indexMap)
+        indexReader.unmap(indexMap);
+    logMap = nullptr;
+    indexMap = nullptr;
+    mappedRecords = 0;
+    mappedBytes = 0;
+    logReader.close();
+    indexReader.close();
+    logFile.close();
+    indexFile.close();
+    stored = 0;
+    storedBytes = 0;
+    aggregated = false;
+    peerTotals.clear();
+    dayTotals.clear();
+}
+
+/**
+ * @brief Queues a record, it is written on the store's thread.
+ *
+ * Records appended while the store is closed are dropped.
+ */
+void HistoryStore::append(const Record &record)
+{
+    QMutexLocker lock(&pendingMutex);
+    if (!accepting)
+        return;
+
+    pending.append(record);
+    if (writing)
+        return;
+    writing = true;
+    writer.start([this]()
+                 { writePending(); });
+}
+
+/**
+ * @brief Waits until every queued record is written.
+ */
+void HistoryStore::flush()
+{
+    writer.waitForDone();
+}
+
+/**
+ * @brief Writes queued records until the queue is empty.
+ *
+ * The entries of a batch go to the log first and their offsets to the
+ * index second, so the index never names an entry that is not written.
+ */
+void HistoryStore::writePending()
+{
+    while (true)
+    {
+        QList<Record> batch;
+        {
+            QMutexLocker lock(&pendingMutex);
+            if (pending.isEmpty())
+            {
+                writing = false;
+                return;
+            }
+            batch.swap(pending);
+        }
+
+        qint64 start = logFile.pos();
+        qint64 offset = start;
+        QByteArray entries;
+        QByteArray offsets(int(batch.size() * OFFSET_SIZE), Qt::Uninitialized);
+        for (int i = 0; i < batch.size(); ++i)
+        {
+            qToLittleEndian<qint64>(offset, offsets.data() + i * OFFSET_SIZE);
+            QByteArray entry = encodeEntry(batch.at(i));
+            entries += entry;
+            offset += entry.size();
+        }
+
+        qint64 indexEnd = indexFile.pos();
+        bool ok = logFile.write(entries) == entries.size() && logFile.flush() &&
+                  indexFile.write(offsets) == offsets.size() && indexFile.flush();
+        if (!ok)
+        {
+            // qDebug() << "HistoryStore: Cannot write" << batch.size() << "records";
+            logFile.resize(start);
+            logFile.seek(start);
+            indexFile.resize(indexEnd);
+            indexFile.seek(indexEnd);
+            continue;
+        }
+
+        qint64 count = 0;
+        {
+            QMutexLocker lock(&mutex);
+            stored += batch.size();
+            storedBytes = offset;
+            if (aggregated)
+            {
+                for (const Record &record : batch)
+                    addToAggregates(record);
+            }
+            count = stored;
+        }
+        emit recordsAppended(count);
+    }
+}
+
+/**
+ * @brief Number of records written.
+ */
+qint64 HistoryStore::count() const
+{
+    QMutexLocker lock(&mutex);
+    return stored;
+}
+
+/**
+ * @brief Records written, in the order they were appended.
+ *
+ * @param first Index of the first record, 0 being the oldest
+ * @param count Most records returned
+ * @return Fewer than @p count records at the end of the history
+ */
+QList<HistoryStore::Record> HistoryStore::read(qint64 first, int count) const
+{
+    QList<Record> records;
+    QMutexLocker lock(&mutex);
+    if (first < 0 || count <= 0 || first >= stored || !mapFiles())
+        return records;
+
+    qint64 last = qMin(stored, first + count);
+    records.reserve(int(last - first));
+    for (qint64 index = first; index < last; ++index)
+    {
+        Record record;
+        decode(index, &record);
+        records.append(record);
+    }
+    return records;
+}
+
+/**
+ * @brief Records written, newest first.
+ *
+ * @param first Position of the first record, 0 being the newest
+ * @param count Most records returned
+ * @return Fewer than @p count records at the end of the history
+ */
+QList<HistoryStore::Record> HistoryStore::page(qint64 first, int count) const
+{
+    QList<Record> records;
+    QMutexLocker lock(&mutex);
+    if (first < 0 || count <= 0 || first >= stored || !mapFiles())
+        return records;
+
+    qint64 last = qMin(stored, first + count);
+    records.reserve(int(last - first));
+    for (qint64 position = first; position < last; ++position)
+    {
+        Record record;
+        decode(stored - 1 - position, &record);
+        records.append(record);
+    }
+    return records;
+}
+
+/**
+ * @brief Totals of every peer, by address.
+ */
+QMap<QString, HistoryStore::Aggregate> HistoryStore::perPeer() const
+{
+    QMutexLocker lock(&mutex);
+    buildAggregates();
+    return peerTotals;
+}
+
+/**
+ * @brief Totals of every local day transfers ended on.
+ */
+QMap<QDate, HistoryStore::Aggregate> HistoryStore::perDay() const
+{
+    QMutexLocker lock(&mutex);
+    buildAggregates();
+    return dayTotals;
+}
+
+/**
+ * @brief Maps what is stored of both files, once more whenever they grew.
+ *
+ * Called with the mutex held.
+ *
+ * @return false if nothing is stored or a file cannot be mapped
+ */
+bool HistoryStore::mapFiles() const
+{
+    if (stored == 0)
+        return false;
+    if (mappedRecords == stored && mappedBytes == storedBytes)
+        return true;
+
+    if (logMap)
+        logReader.unmap(logMap);
+    if (indexMap)
+        indexReader.unmap(indexMap);
+    logMap = logReader.map(0, storedBytes);
+    indexMap = indexReader.map(0, stored * OFFSET_SIZE);
+    if (!logMap || !indexMap)
+    {
+        mappedRecords = 0;
+        mappedBytes = 0;
+        return false;
+    }
+    mappedRecords = stored;
+    mappedBytes = storedBytes;
+    return true;
+}
+
+/**
+ * @brief Reads record @p index in append order from the mappings.
+ *
+ * Called with the mutex held and the files mapped; open() checked the entries.
+ */
+void HistoryStore::decode(qint64 index, Record *record) const
+{
+    qint64 offset = qFromLittleEndian<qint64>(indexMap + index * OFFSET_SIZE);
+    const uchar *fields = logMap + offset + ENTRY_HEADER;
+    record->finishedAt = qFromLittleEndian<qint64>(fields);
+    record->durationMs = qFromLittleEndian<qint64>(fields + 8);
+    record->bytes = qFromLittleEndian<qint64>(fields + 16);
+    record->outgoing = fields[24] != 0;
+    record->status = TransferStatus(fields[25]);
+
+    int nameLength = qFromLittleEndian<quint16>(fields + 26);
+    int peerLength = qFromLittleEndian<quint16>(fields + 28);
+    const char *text = reinterpret_cast<const char *>(fields + FIXED_FIELDS);
+    record->fileName = QString::fromUtf8(text, nameLength);
+    record->peer = QString::fromUtf8(text + nameLength, peerLength);
+}
+
+/**
+ * @brief Scans the whole log into the totals on first use.
+ *
+ * Called with the mutex held.
+ */
+void HistoryStore::buildAggregates() const
+{
+    if (aggregated)
+        return;
+
+    peerTotals.clear();
+    dayTotals.clear();
+    if (mapFiles())
+    {
+        for (qint64 index = 0; index < stored; ++index)
+        {
+            Record record;
+            decode(index, &record);
+            addToAggregates(record);
+        }
+    }
+    aggregated = true;
+}
+
+void HistoryStore::addToAggregates(const Record &record) const
+{
+    QDate day = QDateTime::fromMSecsSinceEpoch(record.finishedAt).date();
+    QList<Aggregate *> totals = {&dayTotals[day]};
+    if (!record.peer.isEmpty())
+        totals.append(&peerTotals[record.peer]);
+
+    for (Aggregate *total : totals)
+    {
+        ++total->transfers;
+        total->bytes += record.bytes;
+        total->durationMs += record.durationMs;
+    }
+}
@@ -0,0 +1,149 @@
+/**
+ * @file historystore.h
+ * @brief Append-only log of finished transfers with a memory-mapped index
+ */
+
+#ifndef HISTORYSTORE_H
+#define HISTORYSTORE_H
+
+#include <QObject>
+#include <QDate>
+#include <QFile>
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QThreadPool>
+#include "../core/transferstatus.h"
+
+/**
+ * @class HistoryStore
+ * @brief Keeps every finished transfer across restarts without holding them in memory.
+ *
+ * Records are appended as binary entries to the log at
+ * Config::getHistoryPath(): a length, the CRC-32C of the entry and its
+ * fields. The index beside it ("<log>.idx") holds the 64-bit offset of
+ * every entry, so record @c n is one lookup in the mapped index and one in
+ * the mapped log. Opening the store only checks the end of both files: an
+ * entry cut short by a crash is dropped, an entry the index missed is
+ * indexed again.
+ *
+ * append() only queues the record; a thread of the store writes the queue
+ * in batches, so the GUI thread never waits for the disk. page() serves the
+ * history view, newest first, and reads only the entries asked for.
+ * perPeer() and perDay() scan the log once on first use and are kept up to
+ * date by the writes afterwards. All functions are thread-safe.
+ *
+ * FileTransferManager appends to shared(), the store of the process, and
+ * the history view pages through it.
+ */
+class HistoryStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief One finished, failed or cancelled transfer.
+     */
+    struct Record
+    {
+        /** Milliseconds since the epoch the transfer ended at */
+        qint64 finishedAt = 0;
+
+        /** Milliseconds from the request to the end */
+        qint64 durationMs = 0;
+
+        /** Bytes transferred */
+        qint64 bytes = 0;
+
+        /** Whether the file was sent rather than received */
+        bool outgoing = true;
+
+        TransferStatus status = TransferStatus::FINISHED;
+        QString fileName;
+
+        /** Address of the other side, empty if unknown */
+        QString peer;
+    };
+
+    /**
+     * @brief Totals of the transfers of one peer or one day.
+     */
+    struct Aggregate
+    {
+        qint64 transfers = 0;
+        qint64 bytes = 0;
+        qint64 durationMs = 0;
+
+        /** @brief Average throughput over the time spent transferring, 0 if none. */
+        qint64 bytesPerSecond() const { return durationMs > 0 ? bytes * 1000 / durationMs : 0; }
+    };
+
+    explicit HistoryStore(QObject *parent = nullptr);
+    ~HistoryStore();
+
+    bool open(const QString &filePath);
+    void close();
+    void append(const Record &record);
+    void flush();
+
+    qint64 count() const;
+    QList<Record> read(qint64 first, int count) const;
+    QList<Record> page(qint64 first, int count) const;
+    QMap<QString, Aggregate> perPeer() const;
+    QMap<QDate, Aggregate> perDay() const;
+
+    /** @brief Path of the index of a log. */
+    static QString indexPath(const QString &filePath) { return filePath + ".idx"; }
+
+    static HistoryStore *shared();
+
+signals:
+    /**
+     * @brief Signal emitted from the store's thread once a batch of records is written.
+     * @param count Number of records stored
+     */
+    void recordsAppended(qint64 count);
+
+private:
+    void writePending();
+    bool mapFiles() const;
+    void decode(qint64 index, Record *record) const;
+    void buildAggregates() const;
+    void addToAggregates(const Record &record) const;
+
+    /** Writes the queue, one batch at a time. */
+    QThreadPool writer;
+
+    /** Records waiting to be written, guarded by pendingMutex. */
+    QMutex pendingMutex;
+    QList<Record> pending;
+    bool writing = false;
+    bool accepting = false;
+
+    /** Files appended to, only used by the writer once open. */
+    QFile logFile;
+    QFile indexFile;
+
+    /** Guards everything below. */
+    mutable QMutex mutex;
+
+    /** Records stored and the log bytes they take up. */
+    qint64 stored = 0;
+    qint64 storedBytes = 0;
+
+    /** Read-only mappings of both files, remapped when they grew. */
+    mutable QFile logReader;
+    mutable QFile indexReader;
+    mutable uchar *logMap = nullptr;
+    mutable uchar *indexMap = nullptr;
+    mutable qint64 mappedRecords = 0;
+    mutable qint64 mappedBytes = 0;
+
+    /** Totals, built on first use. */
+    mutable bool aggregated = false;
+    mutable QMap<QString, Aggregate> peerTotals;
+    mutable QMap<QDate, Aggregate> dayTotals;
+};
+
+#endif // HISTORYSTORE_H
@@ -0,0 +1,160 @@
+/**
+ * @file interfacesnapshot.cpp
+ */
+
+#include "interfacesnapshot.h"
+#include <QCoreApplication>
+#include <QNetworkInterface>
+#include <QPointer>
+#include <QSysInfo>
+#if QT_VERSION >= QT_VERSION_CHECK(6, 1, 0)
+#include <QNetworkInformation>
+#endif
+
+namespace
+{
+    /**
+     * @brief Whether an interface belongs to a virtual machine or container network.
+     */
+    bool isVirtualInterface(const QString &name)
+    {
+        return name.contains("virtualbox") || name.contains("vmware") ||
+               name.contains("docker") || name.contains("veth") ||
+               name.contains("br-") || name.startsWith("vbox") ||
+               name.startsWith("vmnet") || name.contains("host-only");
+    }
+
+    bool isVirtualAddress(quint32 addr)
+    {
+        return (addr & 0xFFFFFF00) == 0xC0A83800    // 192.168.56.x (VirtualBox)
+               || (addr & 0xFFFFFF00) == 0xAC110000; // 172.17.0.x (Docker default bridge)
+    }
+}
+
+/**
+ * @brief Instance shared by the services, created on first use.
+ *
+ * Owned by the application object, a new one is made if asked for after it
+ * was destroyed.
+ */
+InterfaceSnapshot *InterfaceSnapshot::shared()
+{
+    static QPointer<InterfaceSnapshot> snapshot;
+    if (!snapshot)
+        snapshot = new InterfaceSnapshot(QCoreApplication::instance());
+    return snapshot;
+}
+
+/**
+ * @brief Takes the first snapshot and subscribes to network change notifications.
+ *
+ * @param parent Parent QObject
+ */
+InterfaceSnapshot::InterfaceSnapshot(QObject *parent)
+    : QObject(parent),
+      refreshTimer(new QTimer(this))
+{
+    connect(refreshTimer, &QTimer::timeout, this, &InterfaceSnapshot::refresh);
+    refresh();
+
+    int interval = REFRESH_INTERVAL_MS;
+#if QT_VERSION >= QT_VERSION_CHECK(6, 1, 0)
+    if (QNetworkInformation::load(QNetworkInformation::Feature::Reachability))
+    {
+        connect(QNetworkInformation::instance(), &QNetworkInformation::reachabilityChanged, this,
+                &InterfaceSnapshot::refresh);
+        interval = NOTIFIED_REFRESH_INTERVAL_MS;
+    }
+#endif
+    refreshTimer->start(interval);
+}
+
+/**
+ * @brief Enumerates the interfaces again.
+ */
+void InterfaceSnapshot::refresh()
+{
+    QString discovery;
+    QString primary;
+    QList<QHostAddress> targets;
+    QList<QPair<QHostAddress, int>> local;
+    QList<QPair<QHostAddress, int>> reached;
+
+    const QList<QNetworkInterface> interfaces = QNetworkInterface::allInterfaces();
+    for (const QNetworkInterface &interface : interfaces)
+    {
+        if (!(interface.flags() & QNetworkInterface::IsUp) ||
+            (interface.flags() & QNetworkInterface::IsLoopBack))
+        {
+            continue;
+        }
+
+        // Only use ethernet or wifi interfaces for the discovery address
+        QString name = interface.name().toLower();
+        QNetworkInterface::InterfaceType type = interface.type();
+        bool physical = type == QNetworkInterface::Ethernet || type == QNetworkInterface::Wifi ||
+                        name.contains("ethernet") || name.contains("wifi") ||
+                        name.contains("wlan") || name.contains("eth");
+        bool running = interface.flags() & QNetworkInterface::IsRunning;
+
+        for (const QNetworkAddressEntry &entry : interface.addressEntries())
+        {
+            QHostAddress ip = entry.ip();
+            if (ip.protocol() != QAbstractSocket::IPv4Protocol || ip.isLoopback() || ip.isMulticast())
+                continue;
+
+            local.append(qMakePair(ip, entry.prefixLength()));
+            if (physical && discovery.isEmpty())
+                discovery = ip.toString();
+            if (primary.isEmpty() && !isVirtualInterface(name) && !isVirtualAddress(ip.toIPv4Address()))
+                primary = ip.toString();
+            if (running && !entry.broadcast().isNull())
+            {
+                reached.append(qMakePair(ip, entry.prefixLength()));
+                if (!targets.contains(entry.broadcast()))
+                    targets.append(entry.broadcast());
+            }
+        }
+    }
+
+    QString host = QSysInfo::machineHostName();
+    bool same = discovery == discoveryAddress && primary == primaryAddress && targets == broadcasts &&
+                host == localHostname && local == addresses;
+    addresses = local;
+    subnets = reached;
+    if (same)
+        return;
+
+    discoveryAddress = discovery;
+    primaryAddress = primary;
+    broadcasts = targets;
+    localHostname = host;
+    emit changed();
+}
+
+/**
+ * @brief Whether an address is one of the IPv4 addresses of our interfaces.
+ */
+bool InterfaceSnapshot::isLocalAddress(const QHostAddress &address) const
+{
+    for (const QPair<QHostAddress, int> &entry : addresses)
+    {
+        if (entry.first.isEqual(address, QHostAddress::ConvertV4MappedToIPv4))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Whether an address is on the subnet of a running interface, so it hears our broadcasts.
+ */
+bool InterfaceSnapshot::isOnLocalSubnet(const QHostAddress &address) const
+{
+    QHostAddress ipv4(address.toIPv4Address());
+    for (const QPair<QHostAddress, int> &subnet : subnets)
+    {
+        if (ipv4.isInSubnet(subnet.first, subnet.second))
+            return true;
+    }
+    return false;
+}
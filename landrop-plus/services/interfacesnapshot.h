@@ -0,0 +1,82 @@
+/**
+ * @file interfacesnapshot.h
+ * @brief Cached view of the local network interfaces
+ */
+
+#ifndef INTERFACESNAPSHOT_H
+#define INTERFACESNAPSHOT_H
+
+#include <QObject>
+#include <QTimer>
+#include <QHostAddress>
+#include <QList>
+#include <QPair>
+#include <QString>
+
+/**
+ * @class InterfaceSnapshot
+ * @brief Local addresses, broadcast targets and hostname, enumerated once.
+ *
+ * Enumerating interfaces is slow on Windows, and discovery needs the local
+ * address for every datagram it reads. The snapshot is taken again when
+ * the operating system reports a network change through
+ * QNetworkInformation, and on a slow timer where no such backend is
+ * available; changed() is emitted only when something differs.
+ *
+ * One instance is shared by BroadcastDiscoveryService and NetworkManager,
+ * it lives in the GUI thread.
+ */
+class InterfaceSnapshot : public QObject
+{
+    Q_OBJECT
+
+public:
+    static InterfaceSnapshot *shared();
+
+    explicit InterfaceSnapshot(QObject *parent = nullptr);
+
+    /**
+     * @brief First IPv4 address of an Ethernet or Wi-Fi interface, announced in discovery.
+     */
+    QString discoveryIP() const { return discoveryAddress; }
+
+    /**
+     * @brief First IPv4 address outside virtual machine and container networks.
+     */
+    QString primaryIP() const { return primaryAddress; }
+
+    /** @brief Broadcast addresses of the running IPv4 interfaces. */
+    QList<QHostAddress> broadcastAddresses() const { return broadcasts; }
+
+    bool isLocalAddress(const QHostAddress &address) const;
+    bool isOnLocalSubnet(const QHostAddress &address) const;
+
+    QString hostname() const { return localHostname; }
+
+    void refresh();
+
+signals:
+    /** @brief Emitted when a refresh found different addresses or hostname. */
+    void changed();
+
+private:
+    QString discoveryAddress;
+    QString primaryAddress;
+    QList<QHostAddress> broadcasts;
+    QString localHostname;
+
+    /** IPv4 addresses of the interfaces that are up, with their prefix length */
+    QList<QPair<QHostAddress, int>> addresses;
+
+    /** Subnets of the running interfaces reached by broadcastAddresses() */
+    QList<QPair<QHostAddress, int>> subnets;
+
+    /** Timer refreshing the snapshot in case a change was not reported */
+    QTimer *refreshTimer;
+
+    /** Refresh interval without and with operating system notifications */
+    static const int REFRESH_INTERVAL_MS = 10000;
+    static const int NOTIFIED_REFRESH_INTERVAL_MS = 60000;
+};
+
+#endif // INTERFACESNAPSHOT_H
@@ -0,0 +1,373 @@
+/**
+ * @file mdnsdiscoverybackend.cpp
+ */
+
+#include "mdnsdiscoverybackend.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QNetworkDatagram>
+#include <QRandomGenerator>
+
+const QByteArray MdnsDiscoveryBackend::SERVICE_TYPE = "_landrop._tcp.local";
+
+/**
+ * @param parent Parent QObject
+ */
+MdnsDiscoveryBackend::MdnsDiscoveryBackend(QObject *parent)
+    : DiscoveryBackend(parent),
+      timer(new QTimer(this))
+{
+    connect(timer, &QTimer::timeout, this, &MdnsDiscoveryBackend::onTick);
+}
+
+/**
+ * @brief Destructor, withdraws the announcement.
+ */
+MdnsDiscoveryBackend::~MdnsDiscoveryBackend()
+{
+    stop();
+}
+
+/**
+ * Dots would split the name into several labels, they are replaced.
+ */
+QByteArray MdnsDiscoveryBackend::instanceName(const QString &hostname)
+{
+    QByteArray label = hostname.toUtf8().replace('.', '-').left(63);
+    return label + '.' + SERVICE_TYPE;
+}
+
+Mdns::Message MdnsDiscoveryBackend::announcement(const LANDropUser &self, quint32 ttl)
+{
+    QByteArray instance = instanceName(self.hostname);
+    QByteArray host = QByteArray(instance).replace(SERVICE_TYPE, "local");
+
+    Mdns::Message message;
+    message.response = true;
+
+    Mdns::Record ptr;
+    ptr.name = SERVICE_TYPE;
+    ptr.type = Mdns::TYPE_PTR;
+    ptr.ttl = ttl;
+    ptr.target = instance;
+    message.records.append(ptr);
+
+    Mdns::Record srv;
+    srv.name = instance;
+    srv.type = Mdns::TYPE_SRV;
+    srv.ttl = ttl;
+    srv.cacheFlush = true;
+    srv.port = self.transferPort;
+    srv.target = host;
+    message.records.append(srv);
+
+    Mdns::Record txt;
+    txt.name = instance;
+    txt.type = Mdns::TYPE_TXT;
+    txt.ttl = ttl;
+    txt.cacheFlush = true;
+    txt.txt.insert("h", self.hostname.toUtf8());
+    txt.txt.insert("v", self.version.toUtf8());
+    txt.txt.insert("c", QByteArray::number(self.catalogVersion, 16));
+    message.records.append(txt);
+
+    QHostAddress address(self.ipAddress);
+    if (address.protocol() == QAbstractSocket::IPv4Protocol)
+    {
+        Mdns::Record a;
+        a.name = host;
+        a.type = Mdns::TYPE_A;
+        a.ttl = ttl;
+        a.cacheFlush = true;
+        a.address = address;
+        message.records.append(a);
+    }
+    return message;
+}
+
+/**
+ * @param instance Instance name, used for the hostname if the TXT record has none
+ * @param port Transfer port from the SRV record
+ * @param txt TXT record of the instance
+ * @param address Address of the peer
+ * @param user Receives the peer
+ */
+bool MdnsDiscoveryBackend::peerOf(const QByteArray &instance, quint16 port, const QMap<QByteArray, QByteArray> &txt,
+                                  const QHostAddress &address, LANDropUser *user)
+{
+    if (port == 0 || txt.isEmpty() || address.isNull())
+        return false;
+
+    QString hostname = QString::fromUtf8(txt.value("h"));
+    if (hostname.isEmpty())
+        hostname = QString::fromUtf8(instance.left(instance.indexOf('.')));
+
+    bool isNumber = false;
+    int version = txt.value("v").toInt(&isNumber);
+    *user = LANDropUser(address.toString(), hostname, port, QString::number(isNumber && version > 0 ? version : 1));
+    user->catalogVersion = txt.value("c").toULongLong(nullptr, 16);
+    return true;
+}
+
+/**
+ * @brief Joins the mDNS group, announces @p self and browses for peers.
+ */
+bool MdnsDiscoveryBackend::start(const LANDropUser &self)
+{
+    if (running)
+        return true;
+
+    socket = new QUdpSocket(this);
+    if (!socket->bind(QHostAddress::AnyIPv4, Mdns::PORT, QUdpSocket::ShareAddress | QUdpSocket::ReuseAddressHint) ||
+        !socket->joinMulticastGroup(Mdns::GROUP))
+    {
+        // qDebug() << "MdnsDiscoveryBackend: Port" << Mdns::PORT << "unavailable:" << socket->errorString();
+        delete socket;
+        socket = nullptr;
+        return false;
+    }
+    socket->setSocketOption(QAbstractSocket::MulticastTtlOption, 255);
+    connect(socket, &QUdpSocket::readyRead, this, &MdnsDiscoveryBackend::onReadyRead);
+
+    this->self = self;
+    running = true;
+    announcementsLeft = 2;
+    onTick();
+    sendQuery(SERVICE_TYPE, Mdns::TYPE_PTR);
+    timer->start(TICK_MS);
+    return true;
+}
+
+void MdnsDiscoveryBackend::update(const LANDropUser &self)
+{
+    LANDropUser previous = this->self;
+    this->self = self;
+    if (!running)
+        return;
+
+    if (previous.hostname != self.hostname)
+    {
+        Mdns::Message goodbye = announcement(previous, 0);
+        send(goodbye);
+    }
+    if (previous.hostname != self.hostname || previous.ipAddress != self.ipAddress ||
+        previous.transferPort != self.transferPort || previous.version != self.version ||
+        previous.catalogVersion != self.catalogVersion)
+        announcementsLeft = 2;
+}
+
+/**
+ * @brief Sends the goodbye and leaves the group.
+ */
+void MdnsDiscoveryBackend::stop()
+{
+    if (!running)
+        return;
+
+    running = false;
+    timer->stop();
+    send(announcement(self, 0));
+    socket->leaveMulticastGroup(Mdns::GROUP);
+    socket->close();
+    socket->deleteLater();
+    socket = nullptr;
+    instances.clear();
+    hostAddresses.clear();
+}
+
+void MdnsDiscoveryBackend::onReadyRead()
+{
+    while (socket && socket->hasPendingDatagrams())
+    {
+        QNetworkDatagram datagram = socket->receiveDatagram(Mdns::MAX_MESSAGE);
+        Mdns::Message message;
+        if (!datagram.isValid() || !Mdns::Message::decode(datagram.data(), &message))
+            continue;
+
+        if (message.response)
+            handleResponse(message, datagram.senderAddress());
+        else
+            handleQuery(message);
+    }
+}
+
+/**
+ * @brief Answers queries for the service type or our own names.
+ *
+ * Answers are delayed randomly by 20 to 120 ms (RFC 6762) so queries
+ * arriving together are answered once.
+ */
+void MdnsDiscoveryBackend::handleQuery(const Mdns::Message &message)
+{
+    QByteArray instance = instanceName(self.hostname);
+    QByteArray host = QByteArray(instance).replace(SERVICE_TYPE, "local");
+
+    bool asked = false;
+    for (const Mdns::Question &question : message.questions)
+    {
+        if (Mdns::sameName(question.name, SERVICE_TYPE) || Mdns::sameName(question.name, instance) ||
+            Mdns::sameName(question.name, host))
+            asked = true;
+    }
+    if (!asked || responsePending)
+        return;
+
+    responsePending = true;
+    QTimer::singleShot(QRandomGenerator::global()->bounded(20, 121), this, [this]()
+                       {
+        responsePending = false;
+        if (running)
+            send(announcement(self, RECORD_TTL)); });
+}
+
+/**
+ * @brief Caches the records of peer instances and reports complete ones.
+ */
+void MdnsDiscoveryBackend::handleResponse(const Mdns::Message &message, const QHostAddress &sender)
+{
+    QByteArray ownInstance = instanceName(self.hostname).toLower();
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QList<QByteArray> touched;
+
+    // Addresses first, they may describe hosts of records in the same message
+    for (const Mdns::Record &record : message.records)
+    {
+        if (record.type == Mdns::TYPE_A && record.ttl > 0)
+            hostAddresses.insert(record.name.toLower(), record.address);
+    }
+
+    for (const Mdns::Record &record : message.records)
+    {
+        QByteArray name = record.type == Mdns::TYPE_PTR ? record.target.toLower() : record.name.toLower();
+        if (record.type == Mdns::TYPE_A || name == ownInstance ||
+            !name.endsWith("." + SERVICE_TYPE.toLower()) ||
+            (record.type == Mdns::TYPE_PTR && !Mdns::sameName(record.name, SERVICE_TYPE)))
+            continue;
+
+        if (record.ttl == 0)
+        {
+            forgetInstance(name);
+            touched.removeAll(name);
+            continue;
+        }
+
+        Instance &instance = instances[name];
+        if (record.type == Mdns::TYPE_SRV)
+        {
+            instance.port = record.port;
+            instance.target = record.target.toLower();
+        }
+        else if (record.type == Mdns::TYPE_TXT)
+        {
+            instance.txt = record.txt;
+        }
+        instance.ttl = record.ttl;
+        instance.expires = now + qint64(record.ttl) * 1000;
+        instance.refreshQueried = false;
+        if (!touched.contains(name))
+            touched.append(name);
+    }
+
+    for (const QByteArray &name : touched)
+        reportInstance(name, sender);
+}
+
+/**
+ * @brief Emits peerFound() for an instance whose records are complete and changed.
+ *
+ * @param key Lowercased instance name
+ * @param sender Address the records came from, used without an A record
+ */
+void MdnsDiscoveryBackend::reportInstance(const QByteArray &key, const QHostAddress &sender)
+{
+    auto it = instances.find(key);
+    if (it == instances.end())
+        return;
+
+    QHostAddress address = hostAddresses.value(it->target);
+    if (address.isNull())
+        address = QHostAddress(sender.toIPv4Address());
+
+    LANDropUser user;
+    if (!peerOf(key, it->port, it->txt, address, &user))
+    {
+        // Ask for the records still missing
+        if (it->port == 0 || it->txt.isEmpty())
+            sendQuery(key, Mdns::TYPE_ANY);
+        return;
+    }
+
+    const LANDropUser &reported = it->reported;
+    if (reported.ipAddress == user.ipAddress && reported.hostname == user.hostname &&
+        reported.transferPort == user.transferPort && reported.version == user.version &&
+        reported.catalogVersion == user.catalogVersion)
+        return;
+
+    QString previousIP = reported.ipAddress;
+    it->reported = user;
+    if (!previousIP.isEmpty() && previousIP != user.ipAddress)
+        emit peerLost(previousIP);
+    emit peerFound(user);
+}
+
+/**
+ * @param key Lowercased instance name
+ */
+void MdnsDiscoveryBackend::forgetInstance(const QByteArray &key)
+{
+    Instance instance = instances.take(key);
+    if (!instance.reported.ipAddress.isEmpty())
+        emit peerLost(instance.reported.ipAddress);
+}
+
+/**
+ * @brief Sends pending announcements, refreshes records near expiry and drops expired ones.
+ */
+void MdnsDiscoveryBackend::onTick()
+{
+    if (!running)
+        return;
+
+    if (announcementsLeft > 0)
+    {
+        --announcementsLeft;
+        send(announcement(self, RECORD_TTL));
+    }
+
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QList<QByteArray> expired;
+    for (auto it = instances.begin(); it != instances.end(); ++it)
+    {
+        if (now >= it->expires)
+        {
+            expired.append(it.key());
+        }
+        else if (!it->refreshQueried && now >= it->expires - qint64(it->ttl) * 200)
+        {
+            it->refreshQueried = true;
+            sendQuery(it.key(), Mdns::TYPE_ANY);
+        }
+    }
+
+    for (const QByteArray &key : expired)
+        forgetInstance(key);
+}
+
+void MdnsDiscoveryBackend::sendQuery(const QByteArray &name, quint16 type)
+{
+    Mdns::Message query;
+    Mdns::Question question;
+    question.name = name;
+    question.type = type;
+    query.questions.append(question);
+    send(query);
+}
+
+void MdnsDiscoveryBackend::send(const Mdns::Message &message)
+{
+    if (!socket)
+        return;
+
+    qint64 result = socket->writeDatagram(message.encode(), Mdns::GROUP, Mdns::PORT);
+    // if (result < 0) qDebug() << "MdnsDiscoveryBackend: Send failed:" << socket->errorString();
+}
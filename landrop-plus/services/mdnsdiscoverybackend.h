@@ -0,0 +1,119 @@
+/**
+ * @file mdnsdiscoverybackend.h
+ * @brief DNS-SD discovery of LANDrop peers over multicast DNS
+ */
+
+#ifndef MDNSDISCOVERYBACKEND_H
+#define MDNSDISCOVERYBACKEND_H
+
+#include <QHash>
+#include <QTimer>
+#include <QUdpSocket>
+#include "discoverybackend.h"
+#include "../network/mdns.h"
+
+/**
+ * @class MdnsDiscoveryBackend
+ * @brief Announces and browses the "_landrop._tcp" DNS-SD service.
+ *
+ * Each instance is named after its hostname and carries a TXT record of
+ * "h" (hostname), "v" (transfer protocol version) and "c" (catalog version,
+ * hex). mDNS uses link-local multicast, which passes where broadcasts to
+ * 255.255.255.255 are filtered and reaches each network once instead of
+ * once per interface.
+ *
+ * Peers appear when they announce themselves or answer our query, and
+ * disappear on their goodbye or when their records expire: caches are
+ * refreshed by a query at 80% of the record lifetime (RFC 6762).
+ *
+ * The socket shares port 5353 with the system responder (Avahi, Bonjour)
+ * where it allows so; start() fails where the port is held exclusively,
+ * and discovery then relies on broadcasts alone.
+ */
+class MdnsDiscoveryBackend : public DiscoveryBackend
+{
+    Q_OBJECT
+
+public:
+    explicit MdnsDiscoveryBackend(QObject *parent = nullptr);
+    ~MdnsDiscoveryBackend();
+
+    bool start(const LANDropUser &self) override;
+    void update(const LANDropUser &self) override;
+    void stop() override;
+
+    /** Service type browsed and announced. */
+    static const QByteArray SERVICE_TYPE;
+
+    /** @brief DNS-SD instance name of a host. */
+    static QByteArray instanceName(const QString &hostname);
+
+    /**
+     * @brief Response announcing @p self, or withdrawing it with a TTL of 0.
+     */
+    static Mdns::Message announcement(const LANDropUser &self, quint32 ttl);
+
+    /**
+     * @brief Peer described by the records of one instance.
+     * @return false if the records do not name a port and TXT data
+     */
+    static bool peerOf(const QByteArray &instance, quint16 port, const QMap<QByteArray, QByteArray> &txt,
+                       const QHostAddress &address, LANDropUser *user);
+
+private slots:
+    void onReadyRead();
+    void onTick();
+
+private:
+    /**
+     * @brief Records held about one peer instance.
+     */
+    struct Instance
+    {
+        QByteArray target;
+        quint16 port = 0;
+        QMap<QByteArray, QByteArray> txt;
+
+        /** Lifetime of the records and when they expire, in milliseconds since the epoch */
+        quint32 ttl = 0;
+        qint64 expires = 0;
+
+        /** Whether a query refreshing the records was sent since they were received */
+        bool refreshQueried = false;
+
+        /** Peer last reported with peerFound(), IP address empty if none */
+        LANDropUser reported;
+    };
+
+    void handleQuery(const Mdns::Message &message);
+    void handleResponse(const Mdns::Message &message, const QHostAddress &sender);
+    void reportInstance(const QByteArray &key, const QHostAddress &sender);
+    void forgetInstance(const QByteArray &key);
+    void sendQuery(const QByteArray &name, quint16 type);
+    void send(const Mdns::Message &message);
+
+    QUdpSocket *socket = nullptr;
+    QTimer *timer;
+    LANDropUser self;
+    bool running = false;
+
+    /** Announcements still to send, RFC 6762 asks for two one second apart */
+    int announcementsLeft = 0;
+
+    /** Whether an answer to queries is waiting for its random delay */
+    bool responsePending = false;
+
+    /** Peer instances by lowercased name */
+    QHash<QByteArray, Instance> instances;
+
+    /** Addresses of A records by lowercased host name */
+    QHash<QByteArray, QHostAddress> hostAddresses;
+
+    /** Lifetime of the records announced, in seconds */
+    static const quint32 RECORD_TTL = 120;
+
+    /** Interval of the timer sending announcements and expiring records */
+    static const int TICK_MS = 1000;
+};
+
+#endif // MDNSDISCOVERYBACKEND_H
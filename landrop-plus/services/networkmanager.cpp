@@ -3,6 +3,7 @@
  */
 
 #include "networkmanager.h"
+#include "interfacesnapshot.h"
 #include <QDebug>
 
 /**
@@ -33,11 +34,16 @@ NetworkManager::~NetworkManager()
 /**
  * @brief Starts periodic network monitoring.
  *
+ * Changes of the shared InterfaceSnapshot are checked at once, the timer
+ * only re-reads the snapshot.
+ *
  * @param intervalMs Monitoring interval in milliseconds
  */
 void NetworkManager::startMonitoring(int intervalMs)
 {
     checkConnection();
+    connect(InterfaceSnapshot::shared(), &InterfaceSnapshot::changed, this, &NetworkManager::checkConnection,
+            Qt::UniqueConnection);
     monitorTimer->start(intervalMs);
 }
 
@@ -47,6 +53,7 @@ void NetworkManager::startMonitoring(int intervalMs)
 void NetworkManager::stopMonitoring()
 {
     monitorTimer->stop();
+    disconnect(InterfaceSnapshot::shared(), &InterfaceSnapshot::changed, this, &NetworkManager::checkConnection);
 }
 
 /**
@@ -86,51 +93,13 @@ void NetworkManager::updateConnectionStatus()
 /**
  * @brief Retrieves the local IP address of the primary network interface.
  *
- * Scans all network interfaces to find the first valid IPv4 address that
- * is not a loopback, multicast, or virtual machine interface. Filters out
- * common virtualization interfaces (VirtualBox, VMware, Docker) to return
- * the actual physical network adapter's IP address.
+ * Read from the shared InterfaceSnapshot, which skips virtual machine and
+ * container networks (VirtualBox, VMware, Docker) and is refreshed on
+ * network changes.
  *
  * @return Local IP address as string, or empty string if no valid interface found
  */
 QString NetworkManager::getLocalIPAddress()
 {
-    const QList<QNetworkInterface> interfaces = QNetworkInterface::allInterfaces();
-
-    for (const QNetworkInterface &interface : interfaces)
-    {
-        if (!(interface.flags() & QNetworkInterface::IsUp) ||
-            (interface.flags() & QNetworkInterface::IsLoopBack))
-        {
-            continue;
-        }
-
-        QString name = interface.name().toLower();
-        if (name.contains("virtualbox") || name.contains("vmware") ||
-            name.contains("docker") || name.contains("veth") ||
-            name.contains("br-") || name.startsWith("vbox") ||
-            name.startsWith("vmnet") || name.contains("host-only"))
-        {
-            continue;
-        }
-
-        for (const QNetworkAddressEntry &entry : interface.addressEntries())
-        {
-            QHostAddress ip = entry.ip();
-            if (ip.protocol() == QAbstractSocket::IPv4Protocol &&
-                !ip.isLoopback() && !ip.isMulticast())
-            {
-
-                quint32 addr = ip.toIPv4Address();
-                if ((addr & 0xFFFFFF00) == 0xC0A83800)
-                    continue; // 192.168.56.x (VirtualBox)
-                if ((addr & 0xFFFFFF00) == 0xAC110000)
-                    continue; // 172.17.0.x (Docker default bridge)
-
-                return ip.toString();
-            }
-        }
-    }
-
-    return QString();
-}
\ No newline at end of file
+    return InterfaceSnapshot::shared()->primaryIP();
+}
@@ -0,0 +1,165 @@
+/**
+ * @file progressaggregator.cpp
+ */
+
+#include "progressaggregator.h"
+
+/**
+ * @brief Constructs a new ProgressAggregator.
+ *
+ * @param parent Parent QObject
+ */
+ProgressAggregator::ProgressAggregator(QObject *parent)
+    : QObject(parent),
+      timer(new QTimer(this))
+{
+    qRegisterMetaType<TransferProgress>("TransferProgress");
+    qRegisterMetaType<QList<TransferProgress>>("QList<TransferProgress>");
+
+    timer->setInterval(PUBLISH_INTERVAL);
+    connect(timer, &QTimer::timeout, this, &ProgressAggregator::publish);
+    clock.start();
+}
+
+/**
+ * @brief Sets the size the rate and remaining time of a session are computed from.
+ *
+ * @param sessionId Session identifier
+ * @param size Size of the transfer in bytes
+ */
+void ProgressAggregator::setSize(int sessionId, qint64 size)
+{
+    Sample &sample = sessions[sessionId];
+    sample.published.sessionId = sessionId;
+    sample.size = qMax<qint64>(0, size);
+}
+
+/**
+ * @brief Records the latest progress of a session, published on the next tick.
+ *
+ * @param sessionId Session identifier
+ * @param progress Transfer progress percentage (0-100)
+ */
+void ProgressAggregator::update(int sessionId, int progress)
+{
+    Sample &sample = sessions[sessionId];
+    sample.published.sessionId = sessionId;
+    sample.progress = qBound(0, progress, 100);
+    dirty.insert(sessionId);
+
+    if (!timer->isActive())
+        timer->start();
+}
+
+/**
+ * @brief Reads a session's progress from the counter its worker writes from now on.
+ *
+ * The worker stops posting whole-percent updates once the counter is
+ * watched; update() still takes the ones it posts.
+ *
+ * @param sessionId Session identifier
+ * @param counter Counter of the transfer
+ */
+void ProgressAggregator::watch(int sessionId, const QSharedPointer<ProgressCounter> &counter)
+{
+    if (!counter)
+        return;
+
+    Sample &sample = sessions[sessionId];
+    sample.published.sessionId = sessionId;
+    sample.size = qMax<qint64>(0, counter->size.loadRelaxed());
+    sample.counter = counter;
+    counter->watched.storeRelaxed(1);
+    watched.insert(sessionId);
+
+    if (!timer->isActive())
+        timer->start();
+}
+
+/**
+ * @brief Forgets a session, its pending update is not published.
+ *
+ * @param sessionId Session identifier
+ */
+void ProgressAggregator::remove(int sessionId)
+{
+    auto it = sessions.find(sessionId);
+    if (it != sessions.end() && it->counter)
+        it->counter->watched.storeRelaxed(0);
+    sessions.remove(sessionId);
+    dirty.remove(sessionId);
+    watched.remove(sessionId);
+}
+
+/**
+ * @brief Publishes pending updates right away.
+ *
+ * Used before a status change, so a late progress batch never follows the
+ * final status of a session.
+ */
+void ProgressAggregator::flush()
+{
+    readCounters();
+    if (!dirty.isEmpty())
+        publish();
+}
+
+/**
+ * @brief Marks the watched sessions whose counter moved as changed.
+ */
+void ProgressAggregator::readCounters()
+{
+    for (int sessionId : std::as_const(watched))
+    {
+        Sample &sample = sessions[sessionId];
+        qint64 bytes = sample.counter->bytes.loadRelaxed();
+        if (bytes == sample.sampledBytes)
+            continue;
+
+        int progress = sample.size > 0 ? int(qBound<qint64>(0, bytes * 100 / sample.size, 100)) : 0;
+        sample.progress = qMax(sample.progress, progress);
+        dirty.insert(sessionId);
+    }
+}
+
+void ProgressAggregator::publish()
+{
+    readCounters();
+    if (dirty.isEmpty())
+    {
+        if (watched.isEmpty())
+            timer->stop();
+        return;
+    }
+
+    qint64 now = clock.elapsed();
+    QList<TransferProgress> updates;
+    for (auto it = sessions.begin(); it != sessions.end(); ++it)
+    {
+        if (!dirty.contains(it.key()))
+            continue;
+
+        Sample &sample = it.value();
+        qint64 bytes = sample.counter ? sample.counter->bytes.loadRelaxed() : sample.size * sample.progress / 100;
+        if (sample.sampledAt >= 0 && now > sample.sampledAt && bytes >= sample.sampledBytes)
+        {
+            double rate = double(bytes - sample.sampledBytes) * 1000.0 / double(now - sample.sampledAt);
+            sample.rate = sample.rate > 0 ? sample.rate + RATE_SMOOTHING * (rate - sample.rate) : rate;
+        }
+        sample.sampledBytes = bytes;
+        sample.sampledAt = now;
+
+        sample.published.progress = sample.progress;
+        sample.published.bytesPerSecond = qint64(sample.rate);
+        if (sample.progress >= 100)
+            sample.published.secondsRemaining = 0;
+        else if (sample.size > 0 && sample.rate > 0)
+            sample.published.secondsRemaining = qint64((sample.size - bytes) / sample.rate + 0.5);
+        else
+            sample.published.secondsRemaining = -1;
+        updates.append(sample.published);
+    }
+    dirty.clear();
+
+    emit progressPublished(updates);
+}
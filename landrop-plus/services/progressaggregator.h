@@ -0,0 +1,128 @@
+/**
+ * @file progressaggregator.h
+ * @brief Coalesces transfer progress into batched updates at a fixed UI rate
+ */
+
+#ifndef PROGRESSAGGREGATOR_H
+#define PROGRESSAGGREGATOR_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QSet>
+#include <QList>
+#include <QMetaType>
+#include <QSharedPointer>
+#include "../network/progresscounter.h"
+
+/**
+ * @brief Progress of one transfer session as published to the UI.
+ */
+struct TransferProgress
+{
+    /** Session identifier */
+    int sessionId = -1;
+
+    /** Transfer progress percentage (0-100) */
+    int progress = 0;
+
+    /** Smoothed transfer rate in bytes per second, 0 while unknown */
+    qint64 bytesPerSecond = 0;
+
+    /** Estimated seconds until the transfer completes, -1 while unknown */
+    qint64 secondsRemaining = -1;
+};
+
+Q_DECLARE_METATYPE(TransferProgress)
+
+/**
+ * @class ProgressAggregator
+ * @brief Samples the progress of every session and publishes it in one batch per tick.
+ *
+ * Senders and receivers report progress from their worker threads as often
+ * as it changes. update() only records the latest value; every
+ * PUBLISH_INTERVAL milliseconds the sessions that changed are published
+ * together with progressPublished(), so the GUI thread handles at most one
+ * batch per tick however many transfers run. The timer only runs while
+ * there is something to publish.
+ *
+ * The rate of a session is derived from its byte count between ticks and
+ * smoothed, the remaining time from that rate.
+ *
+ * A session can instead be watched through the ProgressCounter its worker
+ * writes: each tick reads the counter with a relaxed load, so the worker
+ * neither posts a signal per change nor waits for the GUI thread, and the
+ * rate comes from exact byte counts. The timer keeps running while a
+ * session is watched.
+ */
+class ProgressAggregator : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ProgressAggregator(QObject *parent = nullptr);
+
+    void setSize(int sessionId, qint64 size);
+    void update(int sessionId, int progress);
+    void watch(int sessionId, const QSharedPointer<ProgressCounter> &counter);
+    void remove(int sessionId);
+    void flush();
+
+    /** @brief Last published state of a session. */
+    TransferProgress progressOf(int sessionId) const { return sessions.value(sessionId).published; }
+
+    /** Milliseconds between two published batches, 20 per second. */
+    static const int PUBLISH_INTERVAL = 50;
+
+signals:
+    /**
+     * @brief Signal emitted once per tick with every session that changed.
+     * @param updates Changed sessions in session order
+     */
+    void progressPublished(const QList<TransferProgress> &updates);
+
+private:
+    /**
+     * @brief Sampling state of one session.
+     */
+    struct Sample
+    {
+        /** Size of the transfer in bytes, 0 when unknown */
+        qint64 size = 0;
+
+        /** Latest progress reported */
+        int progress = 0;
+
+        /** Bytes done and clock time when the rate was last sampled */
+        qint64 sampledBytes = 0;
+        qint64 sampledAt = -1;
+
+        /** Smoothed rate in bytes per second */
+        double rate = 0;
+
+        /** Counter read on every tick when watched */
+        QSharedPointer<ProgressCounter> counter;
+
+        TransferProgress published;
+    };
+
+    void readCounters();
+    void publish();
+
+    /** Weight of the newest sample in the smoothed rate. */
+    static constexpr double RATE_SMOOTHING = 0.3;
+
+    QMap<int, Sample> sessions;
+
+    /** Sessions updated since the last batch */
+    QSet<int> dirty;
+
+    /** Sessions read through their counter */
+    QSet<int> watched;
+
+    QTimer *timer;
+    QElapsedTimer clock;
+};
+
+#endif // PROGRESSAGGREGATOR_H
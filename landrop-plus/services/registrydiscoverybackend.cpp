@@ -0,0 +1,293 @@
+/**
+ * @file registrydiscoverybackend.cpp
+ */
+
+#include "registrydiscoverybackend.h"
+#include "../config/config.h"
+#include "../network/pathbonding.h"
+#include <QDateTime>
+#include <QNetworkDatagram>
+
+namespace
+{
+    /** @brief Address of a datagram sender, IPv4-mapped addresses as IPv4. */
+    QString addressText(const QHostAddress &address)
+    {
+        bool isIPv4 = false;
+        quint32 ipv4 = address.toIPv4Address(&isIPv4);
+        return isIPv4 ? QHostAddress(ipv4).toString() : address.toString();
+    }
+
+    /** @brief Whether @p address and @p port are one of @p servers, IPv4-mapped addresses as IPv4. */
+    bool isServer(const QList<QPair<QHostAddress, quint16>> &servers, const QHostAddress &address, quint16 port)
+    {
+        for (const QPair<QHostAddress, quint16> &server : servers)
+        {
+            if (server.second == port && server.first.isEqual(address, QHostAddress::TolerantConversion))
+                return true;
+        }
+        return false;
+    }
+
+    bool sameUser(const LANDropUser &a, const LANDropUser &b)
+    {
+        return a.ipAddress == b.ipAddress && a.hostname == b.hostname && a.transferPort == b.transferPort &&
+               a.version == b.version && a.catalogVersion == b.catalogVersion && a.addresses == b.addresses;
+    }
+}
+
+/**
+ * @param parent Parent QObject
+ */
+RegistryDiscoveryBackend::RegistryDiscoveryBackend(QObject *parent)
+    : DiscoveryBackend(parent),
+      timer(new QTimer(this))
+{
+    connect(timer, &QTimer::timeout, this, &RegistryDiscoveryBackend::onTick);
+}
+
+RegistryDiscoveryBackend::~RegistryDiscoveryBackend()
+{
+    stop();
+}
+
+bool RegistryDiscoveryBackend::isConfigured()
+{
+    return Config::getRegistryEnabled() || !servers().isEmpty();
+}
+
+QList<QPair<QHostAddress, quint16>> RegistryDiscoveryBackend::servers()
+{
+    QList<QPair<QHostAddress, quint16>> list;
+    const QStringList entries = Config::getRegistryServers().split(',', Qt::SkipEmptyParts);
+    for (const QString &entry : entries)
+    {
+        QString text = entry.trimmed();
+        QString host = text;
+        int port = Config::getRegistryPort();
+        int separator = text.lastIndexOf(':');
+        bool bracketed = text.startsWith('[');
+        if (separator > 0 && (bracketed || text.indexOf(':') == separator))
+        {
+            // "address:port" or "[IPv6 address]:port"; a bare IPv6 address has several colons
+            bool ok = false;
+            port = text.mid(separator + 1).toInt(&ok);
+            host = text.left(separator);
+            if (!ok || port <= 0 || port > 65535)
+                continue;
+        }
+        if (bracketed)
+            host = host.mid(1, host.size() - 2);
+
+        QHostAddress address(host);
+        if (!address.isNull())
+            list.append(qMakePair(address, quint16(port)));
+    }
+    return list;
+}
+
+DiscoveryMessage::Announcement RegistryDiscoveryBackend::announcementOf(const LANDropUser &user,
+                                                                         DiscoveryMessage::Type type)
+{
+    DiscoveryMessage::Announcement announcement;
+    announcement.type = type;
+    announcement.transferPort = user.transferPort;
+    announcement.transferVersion = quint8(qMax(1, user.version.toInt()));
+    announcement.catalogVersion = user.catalogVersion;
+    announcement.hostname = user.hostname;
+    if (!user.addresses.isEmpty())
+        announcement.options.insert(BroadcastDiscoveryService::ADDRESSES_OPTION, user.addresses.join(',').toUtf8());
+    return announcement;
+}
+
+LANDropUser RegistryDiscoveryBackend::userOf(const QString &address, const DiscoveryMessage::Announcement &announcement)
+{
+    LANDropUser user(address, announcement.hostname, announcement.transferPort,
+                     QString::number(announcement.transferVersion));
+    user.catalogVersion = announcement.catalogVersion;
+    QByteArray addresses = announcement.options.value(BroadcastDiscoveryService::ADDRESSES_OPTION);
+    if (!addresses.isEmpty())
+        user.addresses = QString::fromUtf8(addresses).split(',');
+    return user;
+}
+
+/**
+ * @brief Listens for registrations when serving, and registers with the servers configured.
+ * @return false if the rendezvous port is taken
+ */
+bool RegistryDiscoveryBackend::start(const LANDropUser &self)
+{
+    if (running)
+        return true;
+
+    serving = Config::getRegistryEnabled();
+    socket = new QUdpSocket(this);
+    quint16 port = serving ? quint16(Config::getRegistryPort()) : quint16(0);
+    if (!socket->bind(QHostAddress(QHostAddress::Any), port))
+    {
+        // qDebug() << "RegistryDiscoveryBackend: Port" << Config::getRegistryPort() << "unavailable:" << socket->errorString();
+        delete socket;
+        socket = nullptr;
+        return false;
+    }
+    connect(socket, &QUdpSocket::readyRead, this, &RegistryDiscoveryBackend::onReadyRead);
+
+    this->self = self;
+    this->self.addresses = PathBonding::reachableAddresses();
+    running = true;
+    registerWithServers();
+    timer->start(REGISTER_INTERVAL_MS);
+    return true;
+}
+
+/**
+ * @brief Registers again at once when the catalog or the ports changed.
+ */
+void RegistryDiscoveryBackend::update(const LANDropUser &self)
+{
+    LANDropUser current = self;
+    current.addresses = PathBonding::reachableAddresses();
+    bool changed = !sameUser(current, this->self);
+    this->self = current;
+    if (running && changed)
+        registerWithServers();
+}
+
+/**
+ * @brief Closes the socket and forgets every peer, registrations expire on the servers.
+ */
+void RegistryDiscoveryBackend::stop()
+{
+    if (!running)
+        return;
+
+    running = false;
+    timer->stop();
+    socket->close();
+    socket->deleteLater();
+    socket = nullptr;
+    peers.clear();
+}
+
+quint16 RegistryDiscoveryBackend::localPort() const
+{
+    return socket ? socket->localPort() : 0;
+}
+
+/**
+ * @brief Handles registrations, and the answers and peer lists of the servers registered with.
+ *
+ * Answers and lists from any other sender are dropped, they would let
+ * anyone on the network add peers.
+ */
+void RegistryDiscoveryBackend::onReadyRead()
+{
+    const QList<QPair<QHostAddress, quint16>> registries = servers();
+    while (socket && socket->hasPendingDatagrams())
+    {
+        QNetworkDatagram datagram = socket->receiveDatagram();
+        if (!datagram.isValid() || !DiscoveryMessage::isBinary(datagram.data()))
+            continue;
+
+        bool fromServer = isServer(registries, datagram.senderAddress(), quint16(datagram.senderPort()));
+        DiscoveryMessage::RegisteredPeers list;
+        DiscoveryMessage::Announcement announcement;
+        if (DiscoveryMessage::RegisteredPeers::decode(datagram.data(), &list))
+        {
+            if (fromServer)
+                handlePeerList(list);
+        }
+        else if (DiscoveryMessage::Announcement::decode(datagram.data(), &announcement))
+        {
+            if (announcement.type == DiscoveryMessage::Register && serving)
+                handleRegistration(datagram.senderAddress(), quint16(datagram.senderPort()), announcement);
+            else if (announcement.type == DiscoveryMessage::Response && fromServer)
+                note(userOf(addressText(datagram.senderAddress()), announcement),
+                     QDateTime::currentMSecsSinceEpoch() + EXPIRY_INTERVALS * REGISTER_INTERVAL_MS);
+        }
+    }
+}
+
+void RegistryDiscoveryBackend::onTick()
+{
+    expirePeers();
+    registerWithServers();
+}
+
+void RegistryDiscoveryBackend::registerWithServers()
+{
+    if (!socket)
+        return;
+
+    QByteArray datagram = announcementOf(self, DiscoveryMessage::Register).encode();
+    for (const QPair<QHostAddress, quint16> &server : servers())
+        socket->writeDatagram(datagram, server.first, server.second);
+}
+
+/**
+ * @brief Records a peer registering with us, answers with our announcement and the other peers.
+ */
+void RegistryDiscoveryBackend::handleRegistration(const QHostAddress &sender, quint16 port,
+                                                  const DiscoveryMessage::Announcement &announcement)
+{
+    QString address = addressText(sender);
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    note(userOf(address, announcement), now + EXPIRY_INTERVALS * REGISTER_INTERVAL_MS);
+
+    Peer &peer = peers[address];
+    peer.registered = true;
+    peer.registration = announcement;
+    peer.registration.type = DiscoveryMessage::Response;
+    peer.port = port;
+
+    DiscoveryMessage::RegisteredPeers list;
+    for (auto it = peers.constBegin(); it != peers.constEnd(); ++it)
+    {
+        if (it->registered && it.key() != address && it->expires > now)
+            list.peers.append({it.key(), it->registration});
+    }
+
+    socket->writeDatagram(announcementOf(self, DiscoveryMessage::Response).encode(), sender, port);
+    for (const QByteArray &datagram : list.encode(MAX_DATAGRAM))
+        socket->writeDatagram(datagram, sender, port);
+}
+
+void RegistryDiscoveryBackend::handlePeerList(const DiscoveryMessage::RegisteredPeers &list)
+{
+    qint64 expires = QDateTime::currentMSecsSinceEpoch() + EXPIRY_INTERVALS * REGISTER_INTERVAL_MS;
+    for (const DiscoveryMessage::RegisteredPeers::Peer &peer : list.peers)
+    {
+        if (!QHostAddress(peer.address).isNull())
+            note(userOf(peer.address, peer.announcement), expires);
+    }
+}
+
+/**
+ * @brief Keeps a peer until @p expires, reporting it when new or changed.
+ */
+void RegistryDiscoveryBackend::note(const LANDropUser &user, qint64 expires)
+{
+    Peer &peer = peers[user.ipAddress];
+    peer.expires = qMax(peer.expires, expires);
+    if (sameUser(peer.user, user))
+        return;
+
+    peer.user = user;
+    emit peerFound(user);
+}
+
+void RegistryDiscoveryBackend::expirePeers()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for (auto it = peers.begin(); it != peers.end();)
+    {
+        if (it->expires > now)
+        {
+            ++it;
+            continue;
+        }
+        QString address = it.key();
+        it = peers.erase(it);
+        emit peerLost(address);
+    }
+}
@@ -0,0 +1,119 @@
+/**
+ * @file registrydiscoverybackend.h
+ * @brief Rendezvous discovery of LANDrop peers on other subnets
+ */
+
+#ifndef REGISTRYDISCOVERYBACKEND_H
+#define REGISTRYDISCOVERYBACKEND_H
+
+#include <QHash>
+#include <QHostAddress>
+#include <QList>
+#include <QPair>
+#include <QTimer>
+#include <QUdpSocket>
+#include "discoverybackend.h"
+#include "../network/discoverymessage.h"
+
+/**
+ * @class RegistryDiscoveryBackend
+ * @brief Finds peers beyond the broadcast domain through a rendezvous instance.
+ *
+ * Broadcasts and mDNS stay within one subnet. A LANDrop instance with
+ * Config::getRegistryEnabled() set acts as a rendezvous: it listens on
+ * Config::getRegistryPort() for the announcements of the instances that
+ * list it in Config::getRegistryServers(), and answers each with its own
+ * announcement and a DiscoveryMessage::RegisteredPeers list of the others,
+ * their address as it saw them, catalog version and interface addresses.
+ *
+ * Instances register every REGISTER_INTERVAL_MS and whenever their catalog
+ * changes, so the lists also carry catalog versions between subnets.
+ * Registrations and listed peers that were not renewed for EXPIRY_INTERVALS
+ * are dropped. Only the lists pass through the rendezvous: catalogs and
+ * files are fetched from the peers directly, over routed unicast. Answers
+ * and lists are only taken from the address and port of an entry of
+ * servers(), so other senders cannot add peers.
+ *
+ * A rendezvous can itself register with other rendezvous instances; it
+ * only lists the instances registered with it, so lists never loop.
+ */
+class RegistryDiscoveryBackend : public DiscoveryBackend
+{
+    Q_OBJECT
+
+public:
+    explicit RegistryDiscoveryBackend(QObject *parent = nullptr);
+    ~RegistryDiscoveryBackend();
+
+    bool start(const LANDropUser &self) override;
+    void update(const LANDropUser &self) override;
+    void stop() override;
+
+    /** @brief Whether Config asks to serve as a rendezvous or to register with one. */
+    static bool isConfigured();
+
+    /**
+     * @brief Rendezvous instances of Config::getRegistryServers().
+     *
+     * Entries are "address", "address:port" or "[IPv6 address]:port",
+     * Config::getRegistryPort() by default; invalid ones are skipped.
+     */
+    static QList<QPair<QHostAddress, quint16>> servers();
+
+    /** @brief Announcement of @p user as registered and listed. */
+    static DiscoveryMessage::Announcement announcementOf(const LANDropUser &user, DiscoveryMessage::Type type);
+
+    /** @brief Peer at @p address described by @p announcement. */
+    static LANDropUser userOf(const QString &address, const DiscoveryMessage::Announcement &announcement);
+
+    /** @brief Port the backend receives on, 0 when stopped. */
+    quint16 localPort() const;
+
+    /** Interval between two registrations */
+    static const int REGISTER_INTERVAL_MS = 10000;
+
+    /** Registrations missed before a peer is dropped */
+    static const int EXPIRY_INTERVALS = 3;
+
+    /** Largest peer list datagram sent */
+    static const int MAX_DATAGRAM = 8192;
+
+private slots:
+    void onReadyRead();
+    void onTick();
+
+private:
+    /**
+     * @brief Peer registered with us or listed by a rendezvous.
+     */
+    struct Peer
+    {
+        LANDropUser user;
+
+        /** Announcement it registered, and the port it did so from, when registered with us */
+        DiscoveryMessage::Announcement registration;
+        quint16 port = 0;
+        bool registered = false;
+
+        /** Milliseconds since the epoch the peer is dropped at */
+        qint64 expires = 0;
+    };
+
+    void registerWithServers();
+    void handleRegistration(const QHostAddress &sender, quint16 port,
+                            const DiscoveryMessage::Announcement &announcement);
+    void handlePeerList(const DiscoveryMessage::RegisteredPeers &list);
+    void note(const LANDropUser &user, qint64 expires);
+    void expirePeers();
+
+    QUdpSocket *socket = nullptr;
+    QTimer *timer;
+    LANDropUser self;
+    bool running = false;
+    bool serving = false;
+
+    /** Peers by address */
+    QHash<QString, Peer> peers;
+};
+
+#endif // REGISTRYDISCOVERYBACKEND_H
@@ -3,36 +3,54 @@
  */
 
 #include "sharedfilemanager.h"
+#include "directorywalker.h"
 #include "../config/config.h"
+#include "../network/contentindex.h"
 #include <QJsonDocument>
 #include <QStandardPaths>
 #include <QFileInfo>
-#include <QDirIterator>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QThread>
+#include <QMutexLocker>
+#include <QCryptographicHash>
+
+const QDir::Filters SharedFileManager::LIST_FILTERS = QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot | QDir::Readable;
 
 /**
  * @brief Constructs a new SharedFileManager.
  *
- * Initializes the file system watcher and scan timer for monitoring shared files.
+ * Initializes the file system watcher and scan timer for monitoring shared files,
+ * and loads the saved index of the configured shared folder. The folder
+ * itself is only walked by startWatching(), until then the files are
+ * listed as the index last saw them.
  *
  * @param parent Parent QObject for memory management
  */
 SharedFileManager::SharedFileManager(QObject *parent)
     : QObject(parent),
       fileWatcher(new QFileSystemWatcher(this)),
-      scanTimer(new QTimer(this))
+      scanTimer(new QTimer(this)),
+      saveTimer(new QTimer(this))
 {
+    saveTimer->setSingleShot(true);
+    connect(saveTimer, &QTimer::timeout, this, &SharedFileManager::saveIndex);
+    hashPool.setMaxThreadCount(1);
+
     // Set shared folder path - use safe default if config is invalid
     QString configPath = Config::getSharedFolderPath();
     if (configPath.isEmpty() || configPath == "?" || configPath.isNull())
     {
         configPath = "./Shared Files";
     }
-    QString absoluteSharedPath = QDir::current().absoluteFilePath(configPath);
-    setSharedFolderPath(absoluteSharedPath);
+    // Only the saved index is read here, startWatching() checks it against the folder
+    sharedFolderPath = QDir::current().absoluteFilePath(configPath);
+    QDir().mkpath(sharedFolderPath);
+    loadIndex();
 
     // Setup scan timer (debounce rapid changes)
     scanTimer->setSingleShot(true);
-    connect(scanTimer, &QTimer::timeout, this, &SharedFileManager::refreshFileList);
+    connect(scanTimer, &QTimer::timeout, this, &SharedFileManager::scanPending);
 
     // Connect file watcher signals
     connect(fileWatcher, &QFileSystemWatcher::directoryChanged,
@@ -44,17 +62,22 @@ SharedFileManager::SharedFileManager(QObject *parent)
 /**
  * @brief Destructor for SharedFileManager.
  *
- * Proper cleanup by stopping file system monitoring.
+ * Proper cleanup by stopping file system monitoring, and saving the index
+ * if a save was pending.
  */
 SharedFileManager::~SharedFileManager()
 {
     stopWatching();
+    cancelHashing();
+    if (saveTimer->isActive())
+        saveIndex();
 }
 
 /**
  * @brief Sets the shared folder path and updates monitoring.
  *
- * Changes the directory being monitored for shared files.
+ * Changes the directory being monitored for shared files. The saved index
+ * is used when it belongs to that directory.
  *
  * @param path New absolute path to the shared files directory
  */
@@ -63,19 +86,28 @@ void SharedFileManager::setSharedFolderPath(const QString &path)
     if (sharedFolderPath == path)
         return;
 
+    if (saveTimer->isActive())
+        saveIndex();
     stopWatching();
+    qDeleteAll(walkers.keys());
+    walkers.clear();
+    cancelHashing();
     sharedFolderPath = path;
+    index.clear();
+    pendingDirectories.clear();
 
     // Create shared folder if it doesn't exist
     QDir().mkpath(sharedFolderPath);
 
+    loadIndex();
     refreshFileList();
 }
 
 /**
  * @brief Starts monitoring the shared files directory for changes.
  *
- * Adds the shared folder and all its subdirectories to the file system watcher.
+ * Adds the shared folder to the file system watcher, and its subdirectories
+ * as the walk of the tree finds them.
  */
 void SharedFileManager::startWatching()
 {
@@ -88,17 +120,8 @@ void SharedFileManager::startWatching()
         fileWatcher->addPath(sharedFolderPath);
     }
 
-    // Add all subdirectories to watcher
-    QDirIterator it(sharedFolderPath, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
-    while (it.hasNext())
-    {
-        QString dirPath = it.next();
-        if (!fileWatcher->directories().contains(dirPath))
-        {
-            fileWatcher->addPath(dirPath);
-        }
-    }
-
+    // Subdirectories are added as the walk finds them
+    watching = true;
     refreshFileList();
 }
 
@@ -109,6 +132,7 @@ void SharedFileManager::startWatching()
  */
 void SharedFileManager::stopWatching()
 {
+    watching = false;
     if (!fileWatcher->directories().isEmpty())
     {
         fileWatcher->removePaths(fileWatcher->directories());
@@ -120,7 +144,12 @@ void SharedFileManager::stopWatching()
 }
 
 /**
- * @brief Refreshes the shared file list and notifies listeners of changes.
+ * @brief Rescans the whole shared folder and notifies listeners.
+ *
+ * The tree is walked on worker threads; sharedFilesChanged() is emitted
+ * right away for the index as loaded, and again once the walk changed it.
+ * Only files whose size or modification time differ from the index are
+ * hashed again.
  */
 void SharedFileManager::refreshFileList()
 {
@@ -147,9 +176,480 @@ void SharedFileManager::refreshFileList()
         return;
     }
 
+    // The index as known until the walk completes
+    if (!sharedFolderPath.isEmpty())
+        walk(sharedFolderPath);
+
     emit sharedFilesChanged();
 }
 
+/**
+ * @brief Lists the indexed files the way discovery publishes them.
+ *
+ * Reads the index only, the file system is not touched. Files hashed
+ * already carry their hex hash, peers sharing the same contents are
+ * downloaded from together (see SwarmDownload).
+ */
+QJsonArray SharedFileManager::sharedFilesJson() const
+{
+    QStringList paths = index.keys();
+    paths.sort();
+
+    QJsonArray filesArray;
+    for (const QString &path : paths)
+    {
+        QJsonObject obj;
+        obj["name"] = path.mid(path.lastIndexOf('/') + 1);
+        obj["path"] = path;
+        IndexEntry entry = index.value(path);
+        obj["size"] = QString::number(entry.size);
+        obj["type"] = "file";
+        if (!entry.hash.isEmpty())
+            obj["hash"] = QString::fromLatin1(entry.hash);
+        filesArray.append(obj);
+    }
+    return filesArray;
+}
+
+/**
+ * @brief Brings the index up to date with the files of one directory.
+ *
+ * Subdirectories not watched yet are new to the index, their trees are
+ * walked in the background. Entries of files and subdirectories that are
+ * gone are dropped.
+ *
+ * @param dirPath Absolute path of a directory of the shared folder
+ * @return true if the index changed
+ */
+bool SharedFileManager::scanDirectory(const QString &dirPath)
+{
+    QString prefix = relativePath(dirPath);
+    if (prefix.startsWith(".."))
+        return false;
+    QString base = prefix.isEmpty() ? QString() : prefix + '/';
+
+    bool changed = false;
+    QSet<QString> files;
+    QSet<QString> dirs;
+    QDir dir(dirPath);
+    if (dir.exists())
+    {
+        const QStringList watched = fileWatcher->directories();
+        const QFileInfoList entries = dir.entryInfoList(LIST_FILTERS);
+        for (const QFileInfo &fileInfo : entries)
+        {
+            if (fileInfo.isDir())
+            {
+                if (fileInfo.isSymLink())
+                    continue;
+
+                // Same form as the paths walks add
+                QString subdirPath = dir.filePath(fileInfo.fileName());
+                dirs.insert(fileInfo.fileName());
+                if (!watched.contains(subdirPath))
+                    walk(subdirPath);
+                continue;
+            }
+
+            QString path = base + fileInfo.fileName();
+            files.insert(path);
+            changed |= updateEntry(path, fileInfo.size(), fileInfo.lastModified().toMSecsSinceEpoch());
+        }
+    }
+
+    // Drop files of this directory, and of subdirectories, that are gone
+    for (auto it = index.begin(); it != index.end();)
+    {
+        if (!it.key().startsWith(base))
+        {
+            ++it;
+            continue;
+        }
+        QString rest = it.key().mid(base.size());
+        int slash = rest.indexOf('/');
+        bool gone = slash < 0 ? !files.contains(it.key()) : !dirs.contains(rest.left(slash));
+        if (gone)
+        {
+            it = index.erase(it);
+            changed = true;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    return changed;
+}
+
+/**
+ * @brief Records a file's size and modification time, hashing it if they changed.
+ *
+ * @return true if the entry is new or changed
+ */
+bool SharedFileManager::updateEntry(const QString &path, qint64 size, qint64 modified)
+{
+    auto it = index.find(path);
+    if (it != index.end() && it->size == size && it->modified == modified)
+    {
+        if (!isHashed(*it))
+            queueHash(path);
+        return false;
+    }
+
+    IndexEntry entry;
+    entry.size = size;
+    entry.modified = modified;
+    index.insert(path, entry);
+    queueHash(path);
+    return true;
+}
+
+/**
+ * @brief Lists a directory tree of the shared folder on worker threads.
+ *
+ * A walk of the same directory still running is replaced.
+ *
+ * @param dirPath Absolute path of the directory
+ */
+void SharedFileManager::walk(const QString &dirPath)
+{
+    for (auto it = walkers.begin(); it != walkers.end();)
+    {
+        if (it.value() == dirPath)
+        {
+            delete it.key();
+            it = walkers.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    DirectoryWalker *walker = new DirectoryWalker(0, this);
+    walker->setFilters(LIST_FILTERS);
+    walkers.insert(walker, dirPath);
+    connect(walker, &DirectoryWalker::progress, this, &SharedFileManager::scanProgress);
+    connect(walker, &DirectoryWalker::finished, this, [this, walker]()
+            { onWalkFinished(walker); });
+    walker->walk(dirPath);
+}
+
+/**
+ * @brief Applies the tree a walk listed to the index.
+ *
+ * Files below the walked directory that the walk did not find are dropped,
+ * and the directories it found are watched.
+ */
+void SharedFileManager::onWalkFinished(DirectoryWalker *walker)
+{
+    QString dirPath = walkers.take(walker);
+    const QList<Archive::Entry> entries = walker->entries();
+    walker->deleteLater();
+
+    QString prefix = relativePath(dirPath);
+    QString base = prefix.isEmpty() ? QString() : prefix + '/';
+
+    bool changed = false;
+    QSet<QString> files;
+    QStringList watched = fileWatcher->directories();
+    for (const Archive::Entry &entry : entries)
+    {
+        if (entry.type == Archive::Directory)
+        {
+            if (watching && !watched.contains(entry.filePath))
+                fileWatcher->addPath(entry.filePath);
+            continue;
+        }
+
+        QString path = relativePath(entry.filePath);
+        files.insert(path);
+        changed |= updateEntry(path, entry.size, entry.modified);
+    }
+
+    for (auto it = index.begin(); it != index.end();)
+    {
+        if (it.key().startsWith(base) && !files.contains(it.key()))
+        {
+            it = index.erase(it);
+            changed = true;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    if (changed)
+    {
+        saveTimer->start(SAVE_DELAY_MS);
+        emit sharedFilesChanged();
+    }
+    if (walkers.isEmpty())
+        emit scanFinished();
+}
+
+/**
+ * @brief Rescans the directories reported changed.
+ */
+void SharedFileManager::scanPending()
+{
+    const QSet<QString> directories = pendingDirectories;
+    pendingDirectories.clear();
+
+    bool changed = false;
+    for (const QString &dirPath : directories)
+        changed |= scanDirectory(dirPath);
+
+    if (changed)
+    {
+        saveTimer->start(SAVE_DELAY_MS);
+        emit sharedFilesChanged();
+    }
+}
+
+/**
+ * @brief Queues a file of the index for hashing unless already under way.
+ */
+void SharedFileManager::queueHash(const QString &relativePath)
+{
+    if (hashing.contains(relativePath))
+        return;
+
+    const IndexEntry &entry = index[relativePath];
+    QString filePath = QDir(sharedFolderPath).filePath(relativePath);
+    qint64 size = entry.size;
+    qint64 modified = entry.modified;
+    // Read here, on the thread that changes the settings
+    qint64 rate = Config::getHashRateLimit();
+    quint64 generation = hashGeneration;
+    hashing.insert(relativePath);
+    hashPool.start([this, generation, rate, filePath, relativePath, size, modified]()
+                   {
+        QThread::currentThread()->setPriority(QThread::LowestPriority);
+        QByteArray hash;
+        QByteArray chunkHashes;
+        if (!hashContents(filePath, rate, &hash, &chunkHashes))
+        {
+            if (hashCanceled.loadRelaxed())
+                return;
+            hash.clear();
+            chunkHashes.clear();
+        }
+        QMetaObject::invokeMethod(this, [this, generation, relativePath, size, modified, hash, chunkHashes]()
+                                  { onFileHashed(generation, relativePath, size, modified, hash, chunkHashes); },
+                                  Qt::QueuedConnection); });
+}
+
+/**
+ * @brief Hashes a file as a whole and by HASH_CHUNK_SIZE range, on the hashing thread.
+ *
+ * Reads pause whenever the hashing budget is spent.
+ *
+ * @param filePath File to read
+ * @param rate Bytes read per second at most, 0 for no limit
+ * @param hash Receives the hex digest of the whole file
+ * @param chunkHashes Receives the raw digests of the ranges
+ * @return false if the file could not be read or hashing was cancelled
+ */
+bool SharedFileManager::hashContents(const QString &filePath, qint64 rate, QByteArray *hash, QByteArray *chunkHashes)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QCryptographicHash whole(QCryptographicHash::Blake2b_256);
+    QCryptographicHash chunk(QCryptographicHash::Blake2b_256);
+    qint64 chunkFilled = 0;
+    while (true)
+    {
+        if (hashCanceled.loadRelaxed())
+            return false;
+
+        hashBudget.setRate(rate);
+        int wait = hashBudget.delay();
+        if (wait > 0)
+        {
+            // Paused until the budget refilled, or until cancelHashing() needs the thread back
+            QMutexLocker lock(&cancelMutex);
+            if (!hashCanceled.loadRelaxed())
+                cancelWake.wait(&cancelMutex, wait);
+            continue;
+        }
+
+        QByteArray data = file.read(qMin(HASH_READ_BLOCK, HASH_CHUNK_SIZE - chunkFilled));
+        if (data.isEmpty())
+            break;
+        hashBudget.consume(data.size());
+
+        whole.addData(data);
+        chunk.addData(data);
+        chunkFilled += data.size();
+        if (chunkFilled == HASH_CHUNK_SIZE)
+        {
+            chunkHashes->append(chunk.result());
+            chunk.reset();
+            chunkFilled = 0;
+        }
+    }
+    if (file.error() != QFileDevice::NoError)
+        return false;
+
+    if (chunkFilled > 0)
+        chunkHashes->append(chunk.result());
+    *hash = whole.result().toHex();
+    return true;
+}
+
+/**
+ * @brief Stores computed hashes if the file did not change meanwhile.
+ *
+ * @param generation hashGeneration when the file was queued
+ */
+void SharedFileManager::onFileHashed(quint64 generation, const QString &relativePath, qint64 size, qint64 modified,
+                                     const QByteArray &hash, const QByteArray &chunkHashes)
+{
+    // Results of a cancelled run are dropped, even when the file was queued again since
+    if (generation != hashGeneration || !hashing.remove(relativePath))
+        return;
+
+    auto it = index.find(relativePath);
+    if (it != index.end())
+    {
+        if (it->size != size || it->modified != modified)
+        {
+            queueHash(relativePath);
+            return;
+        }
+        if (!hash.isEmpty())
+        {
+            it->hash = hash;
+            it->chunkHashes = chunkHashes;
+            ContentIndex::remember(QDir(sharedFolderPath).absoluteFilePath(relativePath), size, modified, hash);
+            saveTimer->start(SAVE_DELAY_MS);
+        }
+    }
+
+    if (hashing.isEmpty())
+        emit indexHashed();
+}
+
+/**
+ * @brief Drops the files waiting for their hash and stops the one being hashed.
+ */
+void SharedFileManager::cancelHashing()
+{
+    ++hashGeneration;
+    {
+        QMutexLocker lock(&cancelMutex);
+        hashCanceled.storeRelaxed(1);
+        cancelWake.wakeAll();
+    }
+    hashPool.clear();
+    hashPool.waitForDone();
+    hashCanceled.storeRelaxed(0);
+    hashing.clear();
+}
+
+/**
+ * @brief Digest of one HASH_CHUNK_SIZE range of an indexed file.
+ *
+ * @param relativePath Path of the file relative to the shared folder
+ * @param chunk Index of the range
+ * @return The 32 byte digest, empty if unknown
+ */
+QByteArray SharedFileManager::chunkHash(const QString &relativePath, int chunk) const
+{
+    auto it = index.constFind(relativePath);
+    if (it == index.constEnd() || !isHashed(*it) || chunk < 0 || qint64(chunk) * 32 >= it->chunkHashes.size())
+        return QByteArray();
+    return it->chunkHashes.mid(chunk * 32, 32);
+}
+
+/**
+ * @brief Whether an entry has the hash of the whole and of every range.
+ */
+bool SharedFileManager::isHashed(const IndexEntry &entry)
+{
+    qint64 chunks = (entry.size + HASH_CHUNK_SIZE - 1) / HASH_CHUNK_SIZE;
+    return !entry.hash.isEmpty() && entry.chunkHashes.size() == chunks * 32;
+}
+
+/**
+ * @brief Reads the saved index, if it was saved for the current shared folder.
+ */
+void SharedFileManager::loadIndex()
+{
+    QFile file(Config::getSharedIndexPath());
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+    if (root.value("root").toString() != sharedFolderPath)
+        return;
+
+    const QJsonArray files = root.value("files").toArray();
+    for (const QJsonValue &value : files)
+    {
+        QJsonObject obj = value.toObject();
+        QString path = obj.value("path").toString();
+        if (path.isEmpty())
+            continue;
+
+        IndexEntry entry;
+        entry.size = obj.value("size").toString().toLongLong();
+        entry.modified = obj.value("modified").toString().toLongLong();
+        entry.hash = obj.value("hash").toString().toLatin1();
+        entry.chunkHashes = QByteArray::fromBase64(obj.value("chunks").toString().toLatin1());
+        index.insert(path, entry);
+        ContentIndex::remember(QDir(sharedFolderPath).absoluteFilePath(path), entry.size, entry.modified, entry.hash);
+    }
+}
+
+/**
+ * @brief Writes the index, replacing the previous file atomically.
+ */
+void SharedFileManager::saveIndex()
+{
+    saveTimer->stop();
+    if (sharedFolderPath.isEmpty())
+        return;
+
+    QJsonArray files;
+    for (auto it = index.constBegin(); it != index.constEnd(); ++it)
+    {
+        QJsonObject obj;
+        obj["path"] = it.key();
+        obj["size"] = QString::number(it->size);
+        obj["modified"] = QString::number(it->modified);
+        if (!it->hash.isEmpty())
+        {
+            obj["hash"] = QString::fromLatin1(it->hash);
+            obj["chunks"] = QString::fromLatin1(it->chunkHashes.toBase64());
+        }
+        files.append(obj);
+    }
+
+    QJsonObject root;
+    root["root"] = sharedFolderPath;
+    root["files"] = files;
+
+    QSaveFile file(Config::getSharedIndexPath());
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    file.commit();
+}
+
+/**
+ * @brief Path of a file relative to the shared folder, empty for the folder itself.
+ */
+QString SharedFileManager::relativePath(const QString &path) const
+{
+    QString relative = QDir(sharedFolderPath).relativeFilePath(path);
+    return relative == "." ? QString() : relative;
+}
+
 /**
  * @brief Handles directory change notifications from the file system watcher.
  *
@@ -159,7 +659,7 @@ void SharedFileManager::refreshFileList()
  */
 void SharedFileManager::onDirectoryChanged(const QString &path)
 {
-    Q_UNUSED(path)
+    pendingDirectories.insert(path);
     scanDelayed();
 }
 
@@ -172,7 +672,7 @@ void SharedFileManager::onDirectoryChanged(const QString &path)
  */
 void SharedFileManager::onFileChanged(const QString &path)
 {
-    Q_UNUSED(path)
+    pendingDirectories.insert(QFileInfo(path).absolutePath());
     scanDelayed();
 }
 
@@ -184,4 +684,4 @@ void SharedFileManager::onFileChanged(const QString &path)
 void SharedFileManager::scanDelayed()
 {
     scanTimer->start(SCAN_DELAY_MS);
-}
\ No newline at end of file
+}
@@ -12,6 +12,15 @@
 #include <QJsonArray>
 #include <QJsonObject>
 #include <QDir>
+#include <QHash>
+#include <QSet>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QWaitCondition>
+#include "../network/bandwidthshaper.h"
+
+class DirectoryWalker;
 
 /**
  * @class SharedFileManager
@@ -20,18 +29,60 @@
  * This service monitors the designated shared files directory using
  * QFileSystemWatcher and provides JSON representations of available files
  * for network discovery.
+ *
+ * The files are kept in an index of relative path, size, modification time
+ * and hash, saved to Config::getSharedIndexPath() and loaded at startup so
+ * unchanged files are not hashed again. Whole trees are listed by a
+ * DirectoryWalker on worker threads, a watcher event rescans only the
+ * directory it names and walks the subdirectories new in it.
+ * sharedFilesJson() reads the index without touching the file system.
+ *
+ * Contents are hashed in the background, one file at a time on a thread of
+ * lowest priority, reading no faster than Config::getHashRateLimit(). Each
+ * file gets a hash of the whole and one per HASH_CHUNK_SIZE range, so
+ * parts of a file can be checked without reading the rest.
  */
 class SharedFileManager : public QObject
 {
     Q_OBJECT
 
 public:
+    /**
+     * @brief What the index holds about one file.
+     */
+    struct IndexEntry
+    {
+        qint64 size = 0;
+
+        /** Modification time in milliseconds since the epoch */
+        qint64 modified = 0;
+
+        /** Hex BLAKE2b-256 of the contents, empty until computed */
+        QByteArray hash;
+
+        /** Raw BLAKE2b-256 digests of the consecutive HASH_CHUNK_SIZE ranges, 32 bytes each */
+        QByteArray chunkHashes;
+    };
+
+    /** Length of the ranges hashed separately, the last one of a file may be shorter */
+    static constexpr qint64 HASH_CHUNK_SIZE = 4 * 1024 * 1024;
+
     explicit SharedFileManager(QObject *parent = nullptr);
     ~SharedFileManager();
 
     void setSharedFolderPath(const QString &path);
     QString getSharedFolderPath() const { return sharedFolderPath; }
 
+    QJsonArray sharedFilesJson() const;
+
+    /** @brief Files of the index by path relative to the shared folder. */
+    QHash<QString, IndexEntry> indexedFiles() const { return index; }
+
+    QByteArray chunkHash(const QString &relativePath, int chunk) const;
+
+    /** @brief Whether a directory tree is being walked. */
+    bool isScanning() const { return !walkers.isEmpty(); }
+
 public slots:
     void startWatching();
     void stopWatching();
@@ -41,23 +92,90 @@ signals:
     /** Signal emitted when shared files are added, removed, or modified. */
     void sharedFilesChanged();
 
+    /** Signal emitted once no file of the index waits for its hash. */
+    void indexHashed();
+
+    /** Signal emitted periodically while a tree is walked, with the folders and files listed. */
+    void scanProgress(int folders, int files);
+
+    /** Signal emitted when no walk is left running. */
+    void scanFinished();
+
 private slots:
     void onDirectoryChanged(const QString &path);
     void onFileChanged(const QString &path);
     void scanDelayed();
+    void scanPending();
 
 private:
+    bool scanDirectory(const QString &dirPath);
+    bool updateEntry(const QString &path, qint64 size, qint64 modified);
+    void walk(const QString &dirPath);
+    void onWalkFinished(DirectoryWalker *walker);
+    void queueHash(const QString &relativePath);
+    void onFileHashed(quint64 generation, const QString &relativePath, qint64 size, qint64 modified,
+                      const QByteArray &hash, const QByteArray &chunkHashes);
+    bool hashContents(const QString &filePath, qint64 rate, QByteArray *hash, QByteArray *chunkHashes);
+    void cancelHashing();
+    static bool isHashed(const IndexEntry &entry);
+    void loadIndex();
+    void saveIndex();
+    QString relativePath(const QString &path) const;
+
     /** File system watcher for monitoring the shared directory */
     QFileSystemWatcher *fileWatcher;
 
     /** Timer for delayed file system scanning to avoid excessive updates */
     QTimer *scanTimer;
 
+    /** Timer saving the index once a burst of changes is over */
+    QTimer *saveTimer;
+
     /** Path to the shared files directory */
     QString sharedFolderPath;
 
+    /** Indexed files by path relative to the shared folder */
+    QHash<QString, IndexEntry> index;
+
+    /** Directories reported changed since the last scan */
+    QSet<QString> pendingDirectories;
+
+    /** Files whose hash is being computed */
+    QSet<QString> hashing;
+
+    /** Single low priority thread hashing the files */
+    QThreadPool hashPool;
+
+    /** Set to make the hashing thread give up, for pending work to be dropped */
+    QAtomicInt hashCanceled;
+
+    /** Wakes the hashing thread from a throttling pause once hashCanceled is set */
+    QMutex cancelMutex;
+    QWaitCondition cancelWake;
+
+    /** Hashing run results belong to, a result of an earlier run is dropped */
+    quint64 hashGeneration = 0;
+
+    /** Read budget of the hashing thread, only used by that thread */
+    TokenBucket hashBudget;
+
+    /** Whether directories found by scans are added to the watcher */
+    bool watching = false;
+
+    /** Walks in progress, with the directory each lists */
+    QHash<DirectoryWalker *, QString> walkers;
+
+    /** Entries listed, the way the index has always listed them */
+    static const QDir::Filters LIST_FILTERS;
+
     /** Delay in milliseconds before scanning after file system events */
     static const int SCAN_DELAY_MS = 1000;
+
+    /** Delay in milliseconds before saving the index after a change */
+    static const int SAVE_DELAY_MS = 2000;
+
+    /** Bytes read at once while hashing */
+    static constexpr qint64 HASH_READ_BLOCK = 1024 * 1024;
 };
 
-#endif // SHAREDFILEMANAGER_H
\ No newline at end of file
+#endif // SHAREDFILEMANAGER_H
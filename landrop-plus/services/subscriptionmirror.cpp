@@ -0,0 +1,221 @@
+/**
+ * @file subscriptionmirror.cpp
+ */
+
+#include "subscriptionmirror.h"
+#include "../config/config.h"
+#include "../network/contentindex.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonObject>
+
+namespace
+{
+    /** Separates the entries of Config::getSubscribedFolders(), not valid in file names on Windows */
+    const QChar SEPARATOR('|');
+
+    QString entryOf(const QString &hostname, const QString &folder)
+    {
+        return hostname + '/' + folder;
+    }
+
+    bool inFolder(const QString &path, const QString &folder)
+    {
+        return folder.isEmpty() || path.startsWith(folder + '/');
+    }
+}
+
+QList<SubscriptionMirror::Subscription> SubscriptionMirror::subscriptions()
+{
+    QList<Subscription> list;
+    const QStringList entries = Config::getSubscribedFolders().split(SEPARATOR, Qt::SkipEmptyParts);
+    for (const QString &entry : entries)
+    {
+        int slash = entry.indexOf('/');
+        Subscription subscription;
+        subscription.hostname = slash < 0 ? entry : entry.left(slash);
+        subscription.folder = slash < 0 ? QString() : entry.mid(slash + 1);
+        while (subscription.folder.endsWith('/'))
+            subscription.folder.chop(1);
+        if (!subscription.hostname.isEmpty())
+            list.append(subscription);
+    }
+    return list;
+}
+
+bool SubscriptionMirror::isSubscribed(const QString &hostname, const QString &folder)
+{
+    for (const Subscription &subscription : subscriptions())
+    {
+        if (subscription.hostname == hostname && subscription.folder == folder)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @param hostname Hostname the peer announces
+ * @param folder Folder relative to its shared folder, "" for the whole share
+ * @param subscribed Whether to mirror the folder from now on
+ */
+void SubscriptionMirror::setSubscribed(const QString &hostname, const QString &folder, bool subscribed)
+{
+    QStringList entries;
+    for (const Subscription &subscription : subscriptions())
+    {
+        if (subscription.hostname != hostname || subscription.folder != folder)
+            entries.append(entryOf(subscription.hostname, subscription.folder));
+    }
+    if (subscribed)
+        entries.append(entryOf(hostname, folder));
+    Config::getSubscribedFolders() = entries.join(SEPARATOR);
+}
+
+/**
+ * @brief Where a file of a peer is copied to, relative to the received files folder.
+ *
+ * @param hostname Hostname the peer announces
+ * @param relativePath Path of the file in the peer's shared folder
+ * @return "hostname/relative path", empty if the path would leave the folder
+ */
+QString SubscriptionMirror::localPathOf(const QString &hostname, const QString &relativePath)
+{
+    QString host = hostname;
+    host.replace('/', '_').replace('\\', '_');
+    QString path = QDir::cleanPath(relativePath);
+    if (host.isEmpty() || host == "." || host == ".." || path.isEmpty() || path == "." || path == ".." ||
+        path.startsWith("../") || path.contains('\\') || path.contains(':') || QDir::isAbsolutePath(path))
+        return QString();
+    return host + '/' + path;
+}
+
+void SubscriptionMirror::setUsers(const QList<LANDropUser> &users)
+{
+    this->users = users;
+    scanned = false;
+}
+
+bool SubscriptionMirror::next(Item *item)
+{
+    if (!scanned || scannedSubscriptions != Config::getSubscribedFolders())
+        rescan();
+
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for (int i = 0; i < queue.size(); ++i)
+    {
+        if (retryAt.value(queue.at(i).key, 0) > now)
+            continue;
+        *item = queue.takeAt(i);
+        inFlight.insert(item->key, *item);
+        return true;
+    }
+    return false;
+}
+
+void SubscriptionMirror::finished(const QString &key, bool mirrored)
+{
+    auto it = inFlight.find(key);
+    if (it == inFlight.end())
+        return;
+
+    Item item = it.value();
+    inFlight.erase(it);
+    if (mirrored)
+    {
+        this->mirrored.insert(key, versionOf(item));
+        retryAt.remove(key);
+    }
+    else
+    {
+        retryAt.insert(key, QDateTime::currentMSecsSinceEpoch() + RETRY_DELAY_MS);
+        queue.append(item);
+    }
+}
+
+int SubscriptionMirror::pendingCount()
+{
+    if (!scanned || scannedSubscriptions != Config::getSubscribedFolders())
+        rescan();
+    return int(queue.size() + inFlight.size());
+}
+
+QString SubscriptionMirror::versionOf(const Item &item)
+{
+    return QString::number(item.size) + ':' + QString::fromLatin1(item.hash);
+}
+
+/**
+ * @brief Lists the files of the subscribed folders that are not up to date.
+ */
+void SubscriptionMirror::rescan()
+{
+    scanned = true;
+    scannedSubscriptions = Config::getSubscribedFolders();
+    queue.clear();
+
+    const QList<Subscription> list = subscriptions();
+    if (list.isEmpty())
+        return;
+
+    for (const LANDropUser &user : std::as_const(users))
+    {
+        QStringList folders;
+        for (const Subscription &subscription : list)
+        {
+            if (subscription.hostname == user.hostname)
+                folders.append(subscription.folder);
+        }
+        if (folders.isEmpty())
+            continue;
+
+        for (const QJsonValue &value : user.sharedFiles)
+        {
+            QJsonObject entry = value.toObject();
+            QString path = entry.value("path").toString();
+            if (entry.value("type").toString() != "file" || path.isEmpty())
+                continue;
+
+            bool subscribed = false;
+            for (const QString &folder : std::as_const(folders))
+                subscribed = subscribed || inFolder(path, folder);
+            if (!subscribed)
+                continue;
+
+            Item item;
+            item.key = entryOf(user.hostname, path);
+            item.localPath = localPathOf(user.hostname, path);
+            if (item.localPath.isEmpty() || inFlight.contains(item.key))
+                continue;
+            item.ipAddress = user.ipAddress;
+            item.port = user.transferPort;
+            item.relativePath = path;
+            item.fileName = entry.value("name").toString();
+            if (item.fileName.isEmpty())
+                item.fileName = path.mid(path.lastIndexOf('/') + 1);
+            item.size = entry.value("size").toVariant().toLongLong();
+            item.hash = entry.value("hash").toString().toLatin1();
+
+            auto known = mirrored.constFind(item.key);
+            bool upToDate = known != mirrored.constEnd() ? *known == versionOf(item) : isLocal(item);
+            if (!upToDate)
+                queue.append(item);
+        }
+    }
+}
+
+/**
+ * @brief Whether the received files folder holds a copy of @p item already.
+ */
+bool SubscriptionMirror::isLocal(const Item &item) const
+{
+    QString path = QDir(Config::getReceivedFilesPath()).filePath(item.localPath);
+    QFileInfo info(path);
+    if (!info.isFile() || info.size() != item.size)
+        return false;
+    if (item.hash.isEmpty())
+        return true;
+
+    QByteArray localHash = ContentIndex::hashOf(path);
+    return localHash.isEmpty() || localHash == item.hash;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file subscriptionmirror.h
+ * @brief Shared folders of other peers copied ahead of being opened
+ */
+
+#ifndef SUBSCRIPTIONMIRROR_H
+#define SUBSCRIPTIONMIRROR_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include "broadcastdiscoveryservice.h"
+
+/**
+ * @class SubscriptionMirror
+ * @brief Decides which files of the subscribed folders to download next.
+ *
+ * A subscription names a peer by hostname, so it survives address changes,
+ * and a folder of its shared folder, "" for all of it. They are kept in
+ * Config::getSubscribedFolders(). The catalogs the discovery service keeps
+ * up to date, through catalog deltas, tell which files of those folders
+ * are new or changed. Each is copied to "hostname/relative path" in the
+ * received files folder, so files of the same name in different folders
+ * keep copies of their own, and a later download of the same contents is
+ * taken from the copy (see ContentIndex).
+ *
+ * FileTransferManager queues the next file as a
+ * TransferPriority::BACKGROUND job of its scheduler, fetched with range
+ * requests by a SwarmDownload that resumes from the blocks already held,
+ * so a mirror download waits for and yields to any other transfer.
+ *
+ * A file is up to date when it was mirrored at the size and hash listed
+ * now, or, for files not mirrored in this run, when a local copy of that
+ * size exists whose recorded hash is unknown or the one listed.
+ */
+class SubscriptionMirror
+{
+public:
+    /**
+     * @brief One subscribed folder.
+     */
+    struct Subscription
+    {
+        QString hostname;
+
+        /** Folder relative to the peer's shared folder, "" for the whole share */
+        QString folder;
+    };
+
+    /**
+     * @brief A file to download.
+     */
+    struct Item
+    {
+        /** "hostname/relative path", the file's identity across address changes */
+        QString key;
+
+        QString ipAddress;
+        quint16 port = 0;
+        QString relativePath;
+        QString fileName;
+
+        /** Path of the copy relative to the received files folder, see localPathOf() */
+        QString localPath;
+
+        qint64 size = 0;
+        QByteArray hash;
+    };
+
+    /** Time a failed download waits before it is tried again. */
+    static const qint64 RETRY_DELAY_MS = 60000;
+
+    /** @brief Subscriptions of Config::getSubscribedFolders(). */
+    static QList<Subscription> subscriptions();
+
+    static bool isSubscribed(const QString &hostname, const QString &folder);
+
+    /** @brief Adds or removes a subscription in Config, the caller writes Config to its file. */
+    static void setSubscribed(const QString &hostname, const QString &folder, bool subscribed);
+
+    static QString localPathOf(const QString &hostname, const QString &relativePath);
+
+    /** @brief Catalogs of the discovered users, shared files included. */
+    void setUsers(const QList<LANDropUser> &users);
+
+    /**
+     * @brief Takes the next file to download and counts it as in flight.
+     * @return false if every subscribed file is up to date or waiting to be retried
+     */
+    bool next(Item *item);
+
+    /**
+     * @brief Ends the download of a file taken from next().
+     *
+     * @param key Key of the item
+     * @param mirrored Whether the file was received completely
+     */
+    void finished(const QString &key, bool mirrored);
+
+    /** @brief Files still to download, in flight ones included. */
+    int pendingCount();
+
+private:
+    static QString versionOf(const Item &item);
+    void rescan();
+    bool isLocal(const Item &item) const;
+
+    /** Users last set, and whether the queue was built from them */
+    QList<LANDropUser> users;
+    bool scanned = false;
+
+    /** Config::getSubscribedFolders() the queue was built for */
+    QString scannedSubscriptions;
+
+    /** Files to download, in catalog order */
+    QList<Item> queue;
+
+    /** Files taken by next() and not finished, by key */
+    QHash<QString, Item> inFlight;
+
+    /** Version each file was mirrored at in this run, by key */
+    QHash<QString, QString> mirrored;
+
+    /** Milliseconds since the epoch failed files are tried again at, by key */
+    QHash<QString, qint64> retryAt;
+};
+
+#endif // SUBSCRIPTIONMIRROR_H
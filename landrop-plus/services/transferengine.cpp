@@ -0,0 +1,116 @@
+/**
+ * @file transferengine.cpp
+ */
+
+#include "transferengine.h"
+#include "../config/config.h"
+#include "../core/transferstatus.h"
+#include <QMetaType>
+#include <QTcpSocket>
+
+/**
+ * @brief Starts the worker threads.
+ *
+ * @param workerCount Number of workers, 0 to use Config::getTransferThreads()
+ *                    or, if that is 0 too, the number of cores (at most 4)
+ * @param parent Parent QObject for memory management
+ */
+TransferEngine::TransferEngine(int workerCount, QObject *parent)
+    : QObject(parent)
+{
+    // Argument types of the signals crossing from the workers to the GUI thread
+    qRegisterMetaType<TransferStatus>("TransferStatus");
+    qRegisterMetaType<QTcpSocket *>("QTcpSocket*");
+
+    if (workerCount <= 0)
+        workerCount = Config::getTransferThreads();
+    if (workerCount <= 0)
+        workerCount = qBound(1, QThread::idealThreadCount(), 4);
+
+    for (int i = 0; i < workerCount; ++i)
+    {
+        QThread *worker = new QThread(this);
+        worker->setObjectName(QString("TransferWorker%1").arg(i));
+        worker->start();
+        workers.append(worker);
+    }
+}
+
+/**
+ * @brief Stops every worker thread.
+ */
+TransferEngine::~TransferEngine()
+{
+    shutdown();
+}
+
+/**
+ * @brief Moves an object without parent onto the next worker.
+ *
+ * @param object Object to move, must not have a parent
+ */
+void TransferEngine::adopt(QObject *object)
+{
+    if (workers.isEmpty())
+        return;
+
+    Config::publish();
+    object->moveToThread(workers[nextWorker]);
+    nextWorker = (nextWorker + 1) % workers.size();
+}
+
+/**
+ * @brief Moves an object without parent onto a thread of its own.
+ *
+ * Used for the receiver, which serves every incoming connection.
+ *
+ * @param object Object to move, must not have a parent
+ */
+void TransferEngine::adoptDedicated(QObject *object)
+{
+    if (!dedicated)
+    {
+        dedicated = new QThread(this);
+        dedicated->setObjectName("TransferReceiver");
+        dedicated->start();
+    }
+    Config::publish();
+    object->moveToThread(dedicated);
+}
+
+/**
+ * @brief Deletes an object in its own thread and waits until it is gone.
+ *
+ * QObjects owning sockets and timers must be destroyed by the thread they
+ * live in.
+ *
+ * @param object Object to delete
+ */
+void TransferEngine::destroy(QObject *object)
+{
+    if (!object)
+        return;
+    call(object, [object]()
+         { delete object; });
+}
+
+/**
+ * @brief Quits every worker event loop and waits for the threads to end.
+ *
+ * Objects living on the workers must be destroyed before, see destroy().
+ */
+void TransferEngine::shutdown()
+{
+    QList<QThread *> threads = workers;
+    if (dedicated)
+        threads.append(dedicated);
+
+    for (QThread *thread : threads)
+    {
+        thread->quit();
+        thread->wait();
+    }
+    qDeleteAll(threads);
+    workers.clear();
+    dedicated = nullptr;
+}
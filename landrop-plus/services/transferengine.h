@@ -0,0 +1,83 @@
+/**
+ * @file transferengine.h
+ * @brief Worker threads running transfer sockets and file I/O for LANDrop
+ */
+
+#ifndef TRANSFERENGINE_H
+#define TRANSFERENGINE_H
+
+#include <QObject>
+#include <QThread>
+#include <QList>
+#include <QMetaObject>
+#include "../config/config.h"
+
+/**
+ * @class TransferEngine
+ * @brief Pool of QThread workers, each running its own event loop.
+ *
+ * Senders, batch connections and the receiver are moved onto workers so
+ * socket and disk work never runs on the GUI thread. New objects are spread
+ * round-robin across the workers. Their signals reach FileTransferManager
+ * through queued connections, so only progress and status cross threads.
+ * Every hand-off publishes the settings first (see Config::publish()), so
+ * workers read the values current when the work was handed over.
+ */
+class TransferEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TransferEngine(int workerCount = 0, QObject *parent = nullptr);
+    ~TransferEngine();
+
+    void adopt(QObject *object);
+    void adoptDedicated(QObject *object);
+    void destroy(QObject *object);
+    void shutdown();
+
+    /** @brief Number of worker threads. */
+    int workerCount() const { return workers.size(); }
+
+    /**
+     * @brief Runs a function in the thread of an object, without waiting.
+     * @param context Object whose thread runs the function
+     * @param function Function to run
+     */
+    template <typename Function>
+    static void post(QObject *context, Function function)
+    {
+        Config::publish();
+        QMetaObject::invokeMethod(context, function, Qt::QueuedConnection);
+    }
+
+    /**
+     * @brief Runs a function in the thread of an object and waits for it.
+     *
+     * Runs directly when called from that thread already.
+     *
+     * @param context Object whose thread runs the function
+     * @param function Function to run
+     */
+    template <typename Function>
+    static void call(QObject *context, Function function)
+    {
+        Config::publish();
+        if (context->thread() == QThread::currentThread() || !context->thread()->isRunning())
+            function();
+        else
+            QMetaObject::invokeMethod(context, function, Qt::BlockingQueuedConnection);
+    }
+
+private:
+    /** Worker threads shared by all transfers. */
+    QList<QThread *> workers;
+
+    /** Thread reserved for the receiver, started on first use. */
+    QThread *dedicated = nullptr;
+
+    /** Index of the worker receiving the next object. */
+    int nextWorker = 0;
+};
+
+#endif // TRANSFERENGINE_H
@@ -49,9 +49,52 @@ ConfigDialog::ConfigDialog(QWidget *parent)
     bufferEdit->setPlaceholderText("e.g. 1024");
     bufferEdit->setText(QString::number(Config::getBufferSize()));
 
+    zeroCopyCheck = new QCheckBox("Send file data directly from the kernel", this);
+    zeroCopyCheck->setChecked(Config::getZeroCopyEnabled());
+
+    encryptionCheck = new QCheckBox("Encrypt transfers with TLS 1.3", this);
+    encryptionCheck->setChecked(Config::getEncryptionEnabled());
+    encryptionCheck->setToolTip("Receiving encrypted transfers needs the certificate " + Config::getTlsCertificatePath()
+                                + " and its key " + Config::getTlsKeyPath() + ", created on first use if missing");
+
+    requireEncryptionCheck = new QCheckBox("Refuse unencrypted transfers", this);
+    requireEncryptionCheck->setChecked(Config::getEncryptionRequired());
+
+    globalRateEdit = new QLineEdit(this);
+    globalRateEdit->setPlaceholderText("KiB/s, 0 for unlimited");
+    globalRateEdit->setText(QString::number(Config::getGlobalRateLimit() / 1024));
+
+    peerRateEdit = new QLineEdit(this);
+    peerRateEdit->setPlaceholderText("KiB/s, 0 for unlimited");
+    peerRateEdit->setText(QString::number(Config::getPeerRateLimit() / 1024));
+
+    sessionRateEdit = new QLineEdit(this);
+    sessionRateEdit->setPlaceholderText("KiB/s, 0 for unlimited");
+    sessionRateEdit->setText(QString::number(Config::getSessionRateLimit() / 1024));
+
+    activeTransfersEdit = new QLineEdit(this);
+    activeTransfersEdit->setPlaceholderText("0 for unlimited");
+    activeTransfersEdit->setText(QString::number(Config::getMaxActiveTransfers()));
+
+    peerTransfersEdit = new QLineEdit(this);
+    peerTransfersEdit->setPlaceholderText("0 for unlimited");
+    peerTransfersEdit->setText(QString::number(Config::getMaxTransfersPerPeer()));
+
+    smallFirstCheck = new QCheckBox("Start queued transfers smallest first", this);
+    smallFirstCheck->setChecked(Config::getSmallFilesFirst());
+
     formLayout->addRow("Download path", downloadPathLayout);
     formLayout->addRow("Port number", portEdit);
     formLayout->addRow("Buffer size", bufferEdit);
+    formLayout->addRow("Zero-copy", zeroCopyCheck);
+    formLayout->addRow("Encryption", encryptionCheck);
+    formLayout->addRow("", requireEncryptionCheck);
+    formLayout->addRow("Total rate limit (KiB/s)", globalRateEdit);
+    formLayout->addRow("Rate limit per peer (KiB/s)", peerRateEdit);
+    formLayout->addRow("Rate limit per transfer (KiB/s)", sessionRateEdit);
+    formLayout->addRow("Simultaneous transfers", activeTransfersEdit);
+    formLayout->addRow("Simultaneous transfers per peer", peerTransfersEdit);
+    formLayout->addRow("Queue order", smallFirstCheck);
 
     saveButton = new QPushButton("Save", this);
     cancelButton = new QPushButton("Cancel", this);
@@ -73,6 +116,15 @@ ConfigDialog::ConfigDialog(QWidget *parent)
             downloadPathEdit->setText(Config::getReceivedFilesPath());
             portEdit->setText(QString::number(Config::getPort()));
             bufferEdit->setText(QString::number(Config::getBufferSize()));
+            zeroCopyCheck->setChecked(Config::getZeroCopyEnabled());
+            encryptionCheck->setChecked(Config::getEncryptionEnabled());
+            requireEncryptionCheck->setChecked(Config::getEncryptionRequired());
+            globalRateEdit->setText(QString::number(Config::getGlobalRateLimit() / 1024));
+            peerRateEdit->setText(QString::number(Config::getPeerRateLimit() / 1024));
+            sessionRateEdit->setText(QString::number(Config::getSessionRateLimit() / 1024));
+            activeTransfersEdit->setText(QString::number(Config::getMaxActiveTransfers()));
+            peerTransfersEdit->setText(QString::number(Config::getMaxTransfersPerPeer()));
+            smallFirstCheck->setChecked(Config::getSmallFilesFirst());
         } });
 
     setWindowTitle("LANDrop - settings");
@@ -93,6 +145,66 @@ int ConfigDialog::getBufferSize() const
     return bufferEdit->text().toInt();
 }
 
+bool ConfigDialog::getZeroCopyEnabled() const
+{
+    return zeroCopyCheck->isChecked();
+}
+
+bool ConfigDialog::getEncryptionEnabled() const
+{
+    return encryptionCheck->isChecked();
+}
+
+bool ConfigDialog::getEncryptionRequired() const
+{
+    return requireEncryptionCheck->isChecked();
+}
+
+/**
+ * @brief Total rate limit entered by the user, in bytes per second.
+ */
+qint64 ConfigDialog::getGlobalRateLimit() const
+{
+    return qMax<qint64>(0, globalRateEdit->text().toLongLong()) * 1024;
+}
+
+/**
+ * @brief Rate limit per peer entered by the user, in bytes per second.
+ */
+qint64 ConfigDialog::getPeerRateLimit() const
+{
+    return qMax<qint64>(0, peerRateEdit->text().toLongLong()) * 1024;
+}
+
+/**
+ * @brief Rate limit per transfer entered by the user, in bytes per second.
+ */
+qint64 ConfigDialog::getSessionRateLimit() const
+{
+    return qMax<qint64>(0, sessionRateEdit->text().toLongLong()) * 1024;
+}
+
+/**
+ * @brief Number of outgoing transfers running at once entered by the user.
+ */
+int ConfigDialog::getMaxActiveTransfers() const
+{
+    return qMax(0, activeTransfersEdit->text().toInt());
+}
+
+/**
+ * @brief Number of outgoing transfers running at once to each peer entered by the user.
+ */
+int ConfigDialog::getMaxTransfersPerPeer() const
+{
+    return qMax(0, peerTransfersEdit->text().toInt());
+}
+
+bool ConfigDialog::getSmallFilesFirst() const
+{
+    return smallFirstCheck->isChecked();
+}
+
 /**
  * @brief Opens a directory selection dialog for choosing the download path.
  *
@@ -12,6 +12,7 @@
 #include <QPushButton>
 #include <QFormLayout>
 #include <QLabel>
+#include <QCheckBox>
 
 /**
  * @class ConfigDialog
@@ -31,6 +32,15 @@ public:
     QString getDownloadPath() const;
     int getPort() const;
     int getBufferSize() const;
+    bool getZeroCopyEnabled() const;
+    bool getEncryptionEnabled() const;
+    bool getEncryptionRequired() const;
+    qint64 getGlobalRateLimit() const;
+    qint64 getPeerRateLimit() const;
+    qint64 getSessionRateLimit() const;
+    int getMaxActiveTransfers() const;
+    int getMaxTransfersPerPeer() const;
+    bool getSmallFilesFirst() const;
 
 private slots:
     void selectDownloadDirectory();
@@ -42,6 +52,21 @@ private:
     /** Text inputs for port and buffer size */
     QLineEdit *portEdit, *bufferEdit;
 
+    /** Toggle for the kernel zero-copy send path */
+    QCheckBox *zeroCopyCheck;
+
+    /** Toggles for TLS encryption of transfer connections, and for refusing plain ones */
+    QCheckBox *encryptionCheck, *requireEncryptionCheck;
+
+    /** Bandwidth caps in KiB/s, 0 for unlimited */
+    QLineEdit *globalRateEdit, *peerRateEdit, *sessionRateEdit;
+
+    /** Limits of outgoing transfers running at once, 0 for unlimited */
+    QLineEdit *activeTransfersEdit, *peerTransfersEdit;
+
+    /** Toggle for starting queued transfers smallest first */
+    QCheckBox *smallFirstCheck;
+
     /** Button to open directory browser for download path selection */
     QPushButton *downloadBrowseButton;
 
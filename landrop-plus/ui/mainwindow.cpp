@@ -8,12 +8,14 @@
 #include "userlistwidget.h"
 #include "sendfilewidget.h"
 #include "transferhistorywidget.h"
-#include "transferitemwidget.h"
 #include "sharedfileswidget.h"
 #include "configdialog.h"
+#include "statsdialog.h"
 #include "../config/config.h"
 #include "../services/sharedfilemanager.h"
 #include "../services/broadcastdiscoveryservice.h"
+#include "../network/transfermetrics.h"
+#include "../network/securetransport.h"
 
 #include <QStatusBar>
 #include <QVBoxLayout>
@@ -21,13 +23,16 @@
 #include <QMenuBar>
 #include <QDir>
 #include <QFile>
+#include <QMessageBox>
 #include <QTcpSocket>
+#include <QTimer>
 
 /**
  * @brief Constructs the main application window.
  *
- * Initializes the LANDrop main window by setting up all core services first,
- * then building the user interface.
+ * Initializes the LANDrop main window by creating all core services first,
+ * then building the user interface. The services are only started once the
+ * event loop runs (see startServices()), so the window shows right away.
  *
  * @param parent Parent widget
  */
@@ -38,19 +43,30 @@ MainWindow::MainWindow(QWidget *parent)
       sharedFileManager(nullptr),
       discoveryService(nullptr)
 {
+    startupClock.start();
     setupServices();
     setupUI();
+    TransferMetrics::setStartupPhase("window", startupClock.elapsed());
+
+    QTimer::singleShot(0, this, &MainWindow::startServices);
 }
 
 /**
- * @brief Initializes all core services and establishes their connections.
+ * @brief Creates all core services and establishes their connections.
+ *
+ * Nothing listens or walks the disk yet, apart from reading the saved
+ * index of the shared folder.
  */
 void MainWindow::setupServices()
 {
     networkManager = new NetworkManager(this);
     transferManager = new FileTransferManager(this);
+
+    QElapsedTimer clock;
+    clock.start();
     sharedFileManager = new SharedFileManager(this);
-    discoveryService = new BroadcastDiscoveryService(this);
+    TransferMetrics::setStartupPhase("sharedIndex", clock.elapsed());
+    discoveryService = new BroadcastDiscoveryService(this, false);
     
     // Connect SharedFileManager directly to DiscoveryService
     discoveryService->setSharedFileManager(sharedFileManager);
@@ -64,15 +80,46 @@ void MainWindow::setupServices()
             this, &MainWindow::onBatchTransferRequested);
     connect(transferManager, &FileTransferManager::transferSessionCreated,
             this, &MainWindow::onTransferSessionCreated);
-    connect(transferManager, &FileTransferManager::transferProgressUpdated,
+    connect(transferManager, &FileTransferManager::transferProgressBatchUpdated,
             this, &MainWindow::onTransferProgressUpdated);
     connect(transferManager, &FileTransferManager::transferStatusChanged,
             this, &MainWindow::onTransferStatusChanged);
+}
 
+/**
+ * @brief Starts the services in the background, one event loop pass each.
+ *
+ * The receiver comes first, discovery then announces the port it got.
+ * The shared folder is listed from its saved index until it is walked to
+ * check it, SHARED_VERIFY_DELAY_MS later. Every step is recorded as a
+ * startup phase of TransferMetrics, "ready" being the time from the start
+ * of the window to discovery running.
+ */
+void MainWindow::startServices()
+{
+    QElapsedTimer clock;
+    clock.start();
     transferManager->setupReceiver();
-    
-    // Start watching shared folder
-    sharedFileManager->startWatching();
+    checkEncryption();
+    TransferMetrics::setStartupPhase("receiver", clock.elapsed());
+
+    QTimer::singleShot(0, this, [this]()
+                       {
+        QElapsedTimer clock;
+        clock.start();
+        networkManager->startMonitoring();
+        TransferMetrics::setStartupPhase("network", clock.restart());
+        discoveryService->startDiscovery();
+        TransferMetrics::setStartupPhase("discovery", clock.elapsed());
+        TransferMetrics::setStartupPhase("ready", startupClock.elapsed()); });
+
+    QTimer::singleShot(SHARED_VERIFY_DELAY_MS, this, [this]()
+                       {
+        QElapsedTimer clock;
+        clock.start();
+        connect(sharedFileManager, &SharedFileManager::scanFinished, this, [clock]()
+                { TransferMetrics::setStartupPhase("sharedVerify", clock.elapsed()); }, Qt::SingleShotConnection);
+        sharedFileManager->startWatching(); });
 }
 
 /**
@@ -85,20 +132,35 @@ void MainWindow::setupUI()
     auto *split = new QSplitter(Qt::Horizontal, this);
     auto *userList = new UserListWidget(discoveryService, this);
     transferHistoryWidget = new TransferHistoryWidget(this);
+    transferHistoryWidget->setHistoryStore(HistoryStore::shared());
     sendFileWidget = new SendFileWidget(transferHistoryWidget, transferManager, this);
     sharedFilesWidget = new SharedFilesWidget(this);
 
     // Connect user selection to send file widget
     connect(userList, &UserListWidget::userSelected,
             sendFileWidget, &SendFileWidget::setRecipientUser);
+
+    // Connect ahead of time, the selected user is likely to be sent to next
+    connect(userList, &UserListWidget::userSelected,
+            transferManager, &FileTransferManager::prewarmConnection);
     
     // Connect shared files widget directly to discovery service
+    connect(discoveryService, &BroadcastDiscoveryService::peerAdded,
+            sharedFilesWidget, &SharedFilesWidget::onPeerAdded);
+    connect(discoveryService, &BroadcastDiscoveryService::peerChanged,
+            sharedFilesWidget, &SharedFilesWidget::onPeerChanged);
+    connect(discoveryService, &BroadcastDiscoveryService::peerRemoved,
+            sharedFilesWidget, &SharedFilesWidget::onPeerRemoved);
+
+    // Relay chains follow the discovery user list
     connect(discoveryService, &BroadcastDiscoveryService::userListUpdated,
-            sharedFilesWidget, &SharedFilesWidget::onUserListUpdated);
+            transferManager, &FileTransferManager::setDiscoveredUsers);
     
     // Connect shared file download requests
     connect(sharedFilesWidget, &SharedFilesWidget::downloadRequested,
             this, &MainWindow::onSharedFileDownloadRequested);
+    connect(sharedFilesWidget, &SharedFilesWidget::swarmDownloadRequested,
+            this, &MainWindow::onSharedFileSwarmDownloadRequested);
 
     // Configure splitter layout
     split->addWidget(userList);
@@ -129,9 +191,6 @@ void MainWindow::setupUI()
     sharedFilesWidget->setSharedFileManager(sharedFileManager);
 
     createMenuBar();
-    
-    // Start network monitoring after UI is fully set up
-    networkManager->startMonitoring();
 }
 
 /**
@@ -182,8 +241,10 @@ void MainWindow::onNetworkStatusChanged(NetworkManager::ConnectionStatus status)
  * @brief Handles batch file transfer requests from remote users.
  *
  * Shows a dialog for the user to approve or reject multiple incoming file transfers.
- * For each accepted file, prepares the destination path and sets up the receiver.
- * For rejected files or if the dialog is cancelled, sends rejection responses.
+ * Accepted files are handed to the transfer manager, which opens the destination
+ * and answers the sender. Rejected files, or all of them if the dialog is
+ * cancelled, are refused. The files of a sender's manifest are answered
+ * together, in one reply sent once the last of them is decided.
  *
  * @param files Map of file names to their sizes for the batch request
  * @param sockets Map of file names to their corresponding TCP sockets
@@ -199,29 +260,11 @@ void MainWindow::onBatchTransferRequested(const QMap<QString, qint64> &files, co
             QTcpSocket *socket = sockets.value(fileName);
             if (results.value(fileName))
             {
-                socket->write("OK\n");
-                socket->flush();
-                QDir dir(Config::getReceivedFilesPath());
-                dir.mkpath(".");
-                QString fullPath = dir.filePath(fileName);
-                QFile *file = new QFile(fullPath);
-                if (!file->open(QIODevice::WriteOnly))
-                {
-                    delete file;
-                    socket->write("NO\n");
-                    socket->flush();
-                    socket->disconnectFromHost();
-                }
-                else
-                {
-                    transferManager->getReceiver()->setFile(socket, file);
-                }
+                transferManager->acceptIncomingTransfer(socket, fileName);
             }
             else
             {
-                socket->write("NO\n");
-                socket->flush();
-                socket->disconnectFromHost();
+                transferManager->rejectIncomingTransfer(socket, fileName);
             }
         }
     }
@@ -229,10 +272,7 @@ void MainWindow::onBatchTransferRequested(const QMap<QString, qint64> &files, co
     {
         for (const QString &fileName : files.keys())
         {
-            QTcpSocket *socket = sockets.value(fileName);
-            socket->write("NO\n");
-            socket->flush();
-            socket->disconnectFromHost();
+            transferManager->rejectIncomingTransfer(sockets.value(fileName), fileName);
         }
     }
 }
@@ -240,8 +280,7 @@ void MainWindow::onBatchTransferRequested(const QMap<QString, qint64> &files, co
 /**
  * @brief Handles creation of new file transfer sessions.
  *
- * Creates a new transfer item widget and adds it to the transfer history
- * when a new file transfer session is initiated.
+ * Adds the new file transfer session to the top of the transfer history.
  *
  * @param sessionId Unique identifier for the transfer session
  * @param fileName Name of the file being transferred
@@ -249,25 +288,23 @@ void MainWindow::onBatchTransferRequested(const QMap<QString, qint64> &files, co
  */
 void MainWindow::onTransferSessionCreated(int sessionId, const QString &fileName, const QString &recipient)
 {
-    TransferItemWidget::TransferDirection direction =
-        (recipient == "Incoming") ? TransferItemWidget::TransferDirection::RECEIVE
-                                  : TransferItemWidget::TransferDirection::SEND;
+    TransferHistoryModel::TransferDirection direction =
+        (recipient == "Incoming") ? TransferHistoryModel::TransferDirection::RECEIVE
+                                  : TransferHistoryModel::TransferDirection::SEND;
 
-    TransferItemWidget *item = new TransferItemWidget(fileName, direction);
-    transferHistoryWidget->addTransferItem(sessionId, item);
+    transferHistoryWidget->addTransfer(sessionId, fileName, direction);
 }
 
 /**
  * @brief Handles transfer progress updates.
  *
- * Updates the progress display for a specific transfer session.
+ * Updates the progress display of every session in a published batch.
  *
- * @param sessionId Session identifier for the transfer
- * @param progress Progress percentage
+ * @param updates Progress, rate and remaining time of the changed sessions
  */
-void MainWindow::onTransferProgressUpdated(int sessionId, int progress)
+void MainWindow::onTransferProgressUpdated(const QList<TransferProgress> &updates)
 {
-    transferHistoryWidget->updateProgress(sessionId, progress);
+    transferHistoryWidget->updateProgress(updates);
 }
 
 /**
@@ -295,7 +332,10 @@ void MainWindow::createMenuBar()
     connect(modifyConfigAction, &QAction::triggered, this, &MainWindow::modifyConfig);
     QAction *aboutAction = new QAction("&About LANDrop", this);
     connect(aboutAction, &QAction::triggered, this, &MainWindow::about);
+    QAction *statisticsAction = new QAction("S&tatistics", this);
+    connect(statisticsAction, &QAction::triggered, this, &MainWindow::showStatistics);
     configMenu->addAction(modifyConfigAction);
+    configMenu->addAction(statisticsAction);
     configMenu->addAction(aboutAction);
 
     setMenuBar(menuBar);
@@ -316,7 +356,20 @@ void MainWindow::modifyConfig()
         Config::getReceivedFilesPath() = configDialog.getDownloadPath();
         Config::getPort() = configDialog.getPort();
         Config::getBufferSize() = configDialog.getBufferSize();
+        Config::getZeroCopyEnabled() = configDialog.getZeroCopyEnabled();
+        // New connections follow, running ones keep their transport
+        Config::getEncryptionEnabled() = configDialog.getEncryptionEnabled();
+        Config::getEncryptionRequired() = configDialog.getEncryptionRequired();
+        // Running transfers pick up new caps with their next block
+        Config::getGlobalRateLimit() = configDialog.getGlobalRateLimit();
+        Config::getPeerRateLimit() = configDialog.getPeerRateLimit();
+        Config::getSessionRateLimit() = configDialog.getSessionRateLimit();
+        // Queued transfers follow the new limits as running ones finish
+        Config::getMaxActiveTransfers() = configDialog.getMaxActiveTransfers();
+        Config::getMaxTransfersPerPeer() = configDialog.getMaxTransfersPerPeer();
+        Config::getSmallFilesFirst() = configDialog.getSmallFilesFirst();
         Config::writeToFile();
+        checkEncryption();
         
         // Handle port change if needed
         if (oldPort != Config::getPort())
@@ -326,6 +379,16 @@ void MainWindow::modifyConfig()
     }
 }
 
+/**
+ * @brief Loads or creates the TLS certificate when encryption is on, and says so if it cannot.
+ */
+void MainWindow::checkEncryption()
+{
+    QString error;
+    if ((Config::getEncryptionEnabled() || Config::getEncryptionRequired()) && !SecureTransport::prepareServer(&error))
+        QMessageBox::warning(this, "LANDrop - encryption", error);
+}
+
 /**
  * @brief Shows the About dialog with application information.
  */
@@ -334,6 +397,16 @@ void MainWindow::about()
     (new AboutDialog(this))->exec();
 }
 
+/**
+ * @brief Opens the statistics dialog, which stays open next to the main window.
+ */
+void MainWindow::showStatistics()
+{
+    StatsDialog *dialog = new StatsDialog(this);
+    dialog->setAttribute(Qt::WA_DeleteOnClose);
+    dialog->show();
+}
+
 /**
  * @brief Handles port configuration changes.
  *
@@ -379,6 +452,27 @@ void MainWindow::onSharedFileDownloadRequested(const QString &userIP, quint16 us
     }
 }
 
+/**
+ * @brief Handles downloads of a shared file several users share.
+ *
+ * @param sources Users sharing the same contents
+ * @param fileName Name of the file to download
+ * @param size Size of the file
+ * @param hash Hex hash of the contents
+ */
+void MainWindow::onSharedFileSwarmDownloadRequested(const QList<SwarmDownload::Source> &sources, const QString &fileName,
+                                                    qint64 size, const QByteArray &hash)
+{
+    if (transferManager)
+    {
+        transferManager->downloadSharedFile(sources, fileName, size, hash);
+        if (statusBar)
+        {
+            statusBar->showMessage(QString("Downloading %1 from %2 users...").arg(fileName).arg(sources.size()), 3000);
+        }
+    }
+}
+
 /**
  * @brief Destructor for MainWindow.
  */
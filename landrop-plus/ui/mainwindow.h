@@ -9,6 +9,7 @@
 #include <QMainWindow>
 #include <QLabel>
 #include <QStatusBar>
+#include <QElapsedTimer>
 #include "../services/networkmanager.h"
 #include "../services/filetransfermanager.h"
 #include "../core/transferstatus.h"
@@ -32,22 +33,34 @@ public:
 private slots:
     void modifyConfig();
     void about();
+    void showStatistics();
 
 private slots:
     void onNetworkStatusChanged(NetworkManager::ConnectionStatus status);
     void onIPAddressChanged(const QString &newIP);
     void onBatchTransferRequested(const QMap<QString, qint64> &files, const QMap<QString, QTcpSocket *> &sockets);
     void onTransferSessionCreated(int sessionId, const QString &fileName, const QString &recipient);
-    void onTransferProgressUpdated(int sessionId, int progress);
+    void onTransferProgressUpdated(const QList<TransferProgress> &updates);
     void onTransferStatusChanged(int sessionId, TransferStatus status);
     void onPortChanged(int newPort);
     void onSharedFileDownloadRequested(const QString &userIP, quint16 userPort, const QString &relativePath, const QString &fileName);
+    void onSharedFileSwarmDownloadRequested(const QList<SwarmDownload::Source> &sources, const QString &fileName,
+                                            qint64 size, const QByteArray &hash);
+
+    void startServices();
 
 private:
     void createMenuBar();
     void setupServices();
+    void checkEncryption();
     void setupUI();
 
+    /** Delay before the shared folder is walked to check the saved index */
+    static const int SHARED_VERIFY_DELAY_MS = 2000;
+
+    /** Running since the window started being built, for the startup phases */
+    QElapsedTimer startupClock;
+
     /** Status bar label showing current IP address */
     QLabel *ipLabel;
 
@@ -4,7 +4,6 @@
 
 #include "sendfilewidget.h"
 #include "../config/config.h"
-#include "transferitemwidget.h"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QPushButton>
@@ -50,6 +49,9 @@ void SendFileWidget::setupUI()
     QPushButton *selectFileButton = new QPushButton("Select file");
     selectFileButton->setStyleSheet(Config::getButtonStyleSheet());
 
+    QPushButton *selectFolderButton = new QPushButton("Select folder");
+    selectFolderButton->setStyleSheet(Config::getButtonStyleSheet());
+
     fileListWidget = new QListWidget();
     fileListWidget->setStyleSheet("font-size: 12px; color: gray;");
     fileListWidget->setSelectionMode(QAbstractItemView::NoSelection);
@@ -63,17 +65,28 @@ void SendFileWidget::setupUI()
     recipientInput->setPlaceholderText("Recipient address");
     recipientInput->setMinimumHeight(30);
 
+    priorityInput = new QComboBox;
+    priorityInput->addItem("Background", int(TransferPriority::BACKGROUND));
+    priorityInput->addItem("Normal", int(TransferPriority::NORMAL));
+    priorityInput->addItem("Interactive", int(TransferPriority::INTERACTIVE));
+    priorityInput->setCurrentIndex(1);
+    priorityInput->setMinimumHeight(30);
+
     QPushButton *sendButton = new QPushButton("SEND");
     sendButton->setStyleSheet(Config::getButtonStyleSheet());
 
     connect(selectFileButton, &QPushButton::clicked, this, &SendFileWidget::onSelectFilesClicked);
+    connect(selectFolderButton, &QPushButton::clicked, this, &SendFileWidget::onSelectFolderClicked);
     connect(sendButton, &QPushButton::clicked, this, &SendFileWidget::onSendButtonClicked);
 
     layout->addWidget(title);
     layout->addWidget(selectFileButton);
+    layout->addWidget(selectFolderButton);
     layout->addItem(new QSpacerItem(20, 30, QSizePolicy::Minimum, QSizePolicy::Fixed));
     layout->addWidget(new QLabel("Recipient"));
     layout->addWidget(recipientInput);
+    layout->addWidget(new QLabel("Priority"));
+    layout->addWidget(priorityInput);
     layout->addItem(new QSpacerItem(20, 30, QSizePolicy::Minimum, QSizePolicy::Fixed));
     layout->addWidget(sendButton);
     layout->addItem(new QSpacerItem(20, 30, QSizePolicy::Minimum, QSizePolicy::Fixed));
@@ -111,40 +124,67 @@ void SendFileWidget::onSelectFilesClicked()
             return;
         }
 
-        QWidget *itemWidget = new QWidget();
-        QHBoxLayout *itemLayout = new QHBoxLayout(itemWidget);
-        itemLayout->setContentsMargins(0, 0, 0, 0);
-
-        QLabel *fileLabel = new QLabel(fileInfo.fileName());
-        QPushButton *deleteButton = new QPushButton("X");
-        deleteButton->setStyleSheet("background-color: red; color: white; border: none; padding: 0px;");
-        deleteButton->setMinimumSize(15, 15);
-        deleteButton->setMaximumSize(15, 15);
-
-        itemLayout->addWidget(fileLabel);
-        itemLayout->addWidget(deleteButton);
-
-        QListWidgetItem *listItem = new QListWidgetItem();
-        listItem->setSizeHint(itemWidget->sizeHint());
-        listItem->setData(Qt::UserRole, filePath);
-        fileListWidget->addItem(listItem);
-        fileListWidget->setItemWidget(listItem, itemWidget);
-
-        connect(deleteButton, &QPushButton::clicked, this, [this, listItem, itemWidget]()
-                {
-            fileListWidget->takeItem(fileListWidget->row(listItem));
-            delete itemWidget;
-            fileListWidget->update(); });
+        addSelectedPath(filePath, fileInfo.fileName());
     }
 }
 
+/**
+ * @brief Handles folder selection button clicks.
+ *
+ * Adds the chosen folder to the list widget; the whole tree below it is
+ * sent, empty folders included.
+ */
+void SendFileWidget::onSelectFolderClicked()
+{
+    QString folderPath = QFileDialog::getExistingDirectory(this, "Select Folder");
+    if (folderPath.isEmpty())
+        return;
+
+    addSelectedPath(folderPath, QFileInfo(folderPath).fileName() + "/");
+}
+
+/**
+ * @brief Adds a file or folder to the list widget with its delete button.
+ *
+ * @param path Path stored in the UserRole data of the item
+ * @param label Text shown for the item
+ */
+void SendFileWidget::addSelectedPath(const QString &path, const QString &label)
+{
+    QWidget *itemWidget = new QWidget();
+    QHBoxLayout *itemLayout = new QHBoxLayout(itemWidget);
+    itemLayout->setContentsMargins(0, 0, 0, 0);
+
+    QLabel *fileLabel = new QLabel(label);
+    QPushButton *deleteButton = new QPushButton("X");
+    deleteButton->setStyleSheet("background-color: red; color: white; border: none; padding: 0px;");
+    deleteButton->setMinimumSize(15, 15);
+    deleteButton->setMaximumSize(15, 15);
+
+    itemLayout->addWidget(fileLabel);
+    itemLayout->addWidget(deleteButton);
+
+    QListWidgetItem *listItem = new QListWidgetItem();
+    listItem->setSizeHint(itemWidget->sizeHint());
+    listItem->setData(Qt::UserRole, path);
+    fileListWidget->addItem(listItem);
+    fileListWidget->setItemWidget(listItem, itemWidget);
+
+    connect(deleteButton, &QPushButton::clicked, this, [this, listItem, itemWidget]()
+            {
+        fileListWidget->takeItem(fileListWidget->row(listItem));
+        delete itemWidget;
+        fileListWidget->update(); });
+}
+
 /**
  * @brief Handles send button clicks to initiate file transfers.
  *
  * Validates that files are selected and recipients are specified, processes
  * recipient IP addresses, and initiates the file transfer operation through
  * the FileTransferManager. Supports both discovered users (with correct ports)
- * and manually entered IP addresses (using default port).
+ * and manually entered IP addresses (using default port). Selected folders
+ * are sent as folder transfers, the files together as one request.
  */
 void SendFileWidget::onSendButtonClicked()
 {
@@ -168,7 +208,15 @@ void SendFileWidget::onSendButtonClicked()
         return;
     }
 
-    QStringList filePaths = getSelectedFilePaths();
+    QStringList filePaths;
+    QStringList folderPaths;
+    for (const QString &path : getSelectedFilePaths())
+    {
+        if (QFileInfo(path).isDir())
+            folderPaths << path;
+        else
+            filePaths << path;
+    }
     clearFileList();
 
     // Build user list with port information
@@ -188,7 +236,11 @@ void SendFileWidget::onSendButtonClicked()
         }
     }
 
-    transferManager->sendFilesToUsers(filePaths, usersWithPorts);
+    TransferPriority priority = TransferPriority(priorityInput->currentData().toInt());
+    if (!filePaths.isEmpty())
+        transferManager->sendFilesToUsers(filePaths, usersWithPorts, priority);
+    for (const QString &folderPath : folderPaths)
+        transferManager->sendFolderToUsers(folderPath, usersWithPorts, priority);
 }
 
 /**
@@ -10,6 +10,7 @@
 #include <QListWidget>
 #include <QFileInfo>
 #include <QLineEdit>
+#include <QComboBox>
 #include <QScrollArea>
 #include <QVBoxLayout>
 #include "../services/filetransfermanager.h"
@@ -17,7 +18,6 @@
 #include "transferhistorywidget.h"
 
 class TransferHistoryWidget;
-class TransferItemWidget;
 
 /**
  * @class SendFileWidget
@@ -41,11 +41,13 @@ public slots:
 private slots:
     void onSendButtonClicked();
     void onSelectFilesClicked();
+    void onSelectFolderClicked();
 
 private:
     void setupUI();
     QStringList validateRecipients(const QString &input) const;
     QStringList getSelectedFilePaths() const;
+    void addSelectedPath(const QString &path, const QString &label);
     void clearFileList();
 
     /** List widget showing selected files for transfer */
@@ -54,6 +56,9 @@ private:
     /** Text input for recipient IP addresses or hostnames */
     QLineEdit *recipientInput;
     
+    /** Combo box choosing the priority lane of the next transfers */
+    QComboBox *priorityInput;
+    
     /** Scroll area containing the file list */
     QScrollArea *scrollArea;
     
@@ -4,6 +4,7 @@
 
 #include "sharedfileswidget.h"
 #include "../services/sharedfilemanager.h"
+#include "../services/subscriptionmirror.h"
 #include "../config/config.h"
 #include <QHeaderView>
 #include <QMessageBox>
@@ -53,6 +54,13 @@ void SharedFilesWidget::setupUI()
     statusLabel->setStyleSheet("color: gray; font-style: italic;");
     mainLayout->addWidget(statusLabel);
 
+    // Search box over the files of every user
+    searchInput = new QLineEdit(this);
+    searchInput->setPlaceholderText("Search files (type:mp4 >100M <2G)");
+    searchInput->setClearButtonEnabled(true);
+    connect(searchInput, &QLineEdit::textChanged, this, &SharedFilesWidget::onSearchChanged);
+    mainLayout->addWidget(searchInput);
+
     // Tree widget for files - more compact
     treeWidget = new QTreeWidget(this);
     treeWidget->setHeaderLabels({"Name", "Size", "Type"});
@@ -68,14 +76,39 @@ void SharedFilesWidget::setupUI()
 
     connect(treeWidget, &QTreeWidget::itemDoubleClicked,
             this, &SharedFilesWidget::onItemDoubleClicked);
+    connect(treeWidget, &QTreeWidget::itemExpanded,
+            this, &SharedFilesWidget::onItemExpanded);
     connect(treeWidget, &QTreeWidget::itemSelectionChanged,
             this, [this]()
             {
                 QTreeWidgetItem *item = treeWidget->currentItem();
-                downloadButton->setEnabled(item && item->data(0, IsDownloadableRole).toBool()); });
+                downloadButton->setEnabled(item && item->data(0, IsDownloadableRole).toBool());
+                updateSubscribeButton(); });
 
     mainLayout->addWidget(treeWidget, 1);
 
+    // Flat list of the search matches
+    resultsWidget = new QTreeWidget(this);
+    resultsWidget->setHeaderLabels({"Name", "Size", "User"});
+    resultsWidget->setAlternatingRowColors(true);
+    resultsWidget->setRootIsDecorated(false);
+    resultsWidget->setUniformRowHeights(true);
+    resultsWidget->header()->setStretchLastSection(false);
+    resultsWidget->header()->setSectionResizeMode(0, QHeaderView::Stretch);
+    resultsWidget->header()->setSectionResizeMode(1, QHeaderView::ResizeToContents);
+    resultsWidget->header()->setSectionResizeMode(2, QHeaderView::ResizeToContents);
+    resultsWidget->hide();
+
+    connect(resultsWidget, &QTreeWidget::itemDoubleClicked,
+            this, &SharedFilesWidget::onItemDoubleClicked);
+    connect(resultsWidget, &QTreeWidget::itemSelectionChanged,
+            this, [this]()
+            {
+                QTreeWidgetItem *item = resultsWidget->currentItem();
+                downloadButton->setEnabled(item && item->data(0, IsDownloadableRole).toBool()); });
+
+    mainLayout->addWidget(resultsWidget, 1);
+
     // Button layout
     QHBoxLayout *buttonLayout = new QHBoxLayout();
     buttonLayout->setSpacing(4);
@@ -86,6 +119,13 @@ void SharedFilesWidget::setupUI()
     downloadButton->setMaximumHeight(28);
     connect(downloadButton, &QPushButton::clicked, this, &SharedFilesWidget::onDownloadButtonClicked);
 
+    subscribeButton = new QPushButton("Subscribe", this);
+    subscribeButton->setStyleSheet(Config::getButtonStyleSheet());
+    subscribeButton->setEnabled(false);
+    subscribeButton->setMaximumHeight(28);
+    subscribeButton->setToolTip("Mirror the new and changed files of the selected folder in the background");
+    connect(subscribeButton, &QPushButton::clicked, this, &SharedFilesWidget::onSubscribeButtonClicked);
+
     openFolderButton = new QPushButton("Shared Folder", this);
     openFolderButton->setStyleSheet(Config::getButtonStyleSheet());
     openFolderButton->setMaximumHeight(28);
@@ -97,6 +137,7 @@ void SharedFilesWidget::setupUI()
     connect(refreshButton, &QPushButton::clicked, this, &SharedFilesWidget::onRefreshClicked);
 
     buttonLayout->addWidget(downloadButton);
+    buttonLayout->addWidget(subscribeButton);
     buttonLayout->addStretch();
     buttonLayout->addWidget(openFolderButton);
     buttonLayout->addWidget(refreshButton);
@@ -107,68 +148,155 @@ void SharedFilesWidget::setupUI()
 /**
  * @brief Sets the shared file manager instance.
  *
+ * The status label shows the progress of its scans of the shared folder.
+ *
  * @param manager Pointer to the SharedFileManager instance
  */
 void SharedFilesWidget::setSharedFileManager(SharedFileManager *manager)
 {
+    if (sharedFileManager)
+        disconnect(sharedFileManager, nullptr, this, nullptr);
+
     sharedFileManager = manager;
+    if (sharedFileManager)
+    {
+        connect(sharedFileManager, &SharedFileManager::scanProgress,
+                this, &SharedFilesWidget::onScanProgress);
+        connect(sharedFileManager, &SharedFileManager::scanFinished,
+                this, &SharedFilesWidget::updateStatus);
+    }
 }
 
 /**
- * @brief Handles updates to the list of discovered users.
+ * @brief Shows how far the scan of the local shared folder got.
  *
- * Called when the BroadcastDiscoveryService discovers new users or updates
- * existing user information.
+ * @param folders Folders listed so far
+ * @param files Files found so far
+ */
+void SharedFilesWidget::onScanProgress(int folders, int files)
+{
+    statusLabel->setText(QString("Indexing your shared folder: %1 files in %2 folders...")
+                             .arg(files)
+                             .arg(folders));
+}
+
+/**
+ * @brief Shows the shared files of a newly discovered user.
  *
- * @param users List of currently discovered LANDrop users
+ * @param user The discovered LANDrop user
  */
-void SharedFilesWidget::onUserListUpdated(const QList<LANDropUser> &users)
+void SharedFilesWidget::onPeerAdded(const LANDropUser &user)
 {
-    qDebug() << "SharedFilesWidget: Received user list with" << users.size() << "users";
+    discoveredUsers.insert(user.ipAddress, user);
+    showUser(user, true);
+    updateStatus();
+    if (resultsWidget->isVisible())
+        onSearchChanged();
+}
 
-    discoveredUsers = users;
-    populateUserFiles();
+/**
+ * @brief Applies what changed in a user's announcement.
+ *
+ * File items are only diffed when the transfer port they download from
+ * changed, or the shared files did and the catalog version is not the one
+ * already shown.
+ *
+ * @param user The user as announced now
+ * @param changedFields BroadcastDiscoveryService::PeerField bits of what changed
+ */
+void SharedFilesWidget::onPeerChanged(const LANDropUser &user, int changedFields)
+{
+    auto shown = catalogTrees.constFind(user.ipAddress);
+    bool catalogChanged = (changedFields & BroadcastDiscoveryService::SharedFilesField) &&
+                          (shown == catalogTrees.constEnd() || shown->version != user.catalogVersion);
+    bool filesChanged = catalogChanged || (changedFields & BroadcastDiscoveryService::PortField);
+    discoveredUsers.insert(user.ipAddress, user);
+    showUser(user, filesChanged);
+    updateStatus();
+    if (filesChanged && resultsWidget->isVisible())
+        onSearchChanged();
 }
 
 /**
- * @brief Rebuilds the shared files tree with current user data.
+ * @brief Removes the files of a user that is no longer discovered.
  *
- * Clears the existing tree and repopulates it with shared files from all
- * discovered users. Preserves the current selection if the previously
- * selected file is still available after the refresh.
+ * @param ipAddress Address the user was discovered at
+ */
+void SharedFilesWidget::onPeerRemoved(const QString &ipAddress)
+{
+    discoveredUsers.remove(ipAddress);
+    removeUserItem(ipAddress);
+    updateStatus();
+    if (resultsWidget->isVisible())
+        onSearchChanged();
+}
+
+/**
+ * @brief Diffs the files of every discovered user again.
  */
 void SharedFilesWidget::populateUserFiles()
 {
-    qDebug() << "SharedFilesWidget: Rebuilding shared files tree";
+    for (const LANDropUser &user : discoveredUsers)
+        showUser(user, true);
+    updateStatus();
+}
 
-    // Save current selection
-    QString selectedUserIP;
-    QString selectedFilePath;
+/**
+ * @brief Adds, updates or removes the tree item of one user.
+ *
+ * @param user The user to show
+ * @param filesChanged Whether the user's file items must be diffed
+ */
+void SharedFilesWidget::showUser(const LANDropUser &user, bool filesChanged)
+{
+    if (!user.hasSharedFiles())
+    {
+        removeUserItem(user.ipAddress);
+        return;
+    }
 
-    QTreeWidgetItem *selectedItem = treeWidget->currentItem();
-    if (selectedItem && selectedItem->data(0, IsDownloadableRole).toBool())
+    QTreeWidgetItem *userItem = userItems.value(user.ipAddress);
+    if (!userItem)
     {
-        selectedUserIP = selectedItem->data(0, UserIPRole).toString();
-        selectedFilePath = selectedItem->data(0, FilePathRole).toString();
-        qDebug() << "SharedFilesWidget: Preserving selection:" << selectedUserIP << selectedFilePath;
+        userItem = addUserToTree(user);
+        userItems.insert(user.ipAddress, userItem);
+        userItem->setExpanded(true);
+        return;
     }
 
-    treeWidget->clear();
+    updateUserItem(userItem, user);
+    if (filesChanged)
+        applyCatalog(userItem, user);
+}
 
+/**
+ * @brief Deletes a user's item and the file items below it.
+ *
+ * @param ipAddress Address of the user
+ */
+void SharedFilesWidget::removeUserItem(const QString &ipAddress)
+{
+    delete userItems.take(ipAddress);
+    catalogTrees.remove(ipAddress);
+    searchIndex.removePeer(ipAddress);
+}
+
+/**
+ * @brief Shows the number of shared files and users on the status label.
+ */
+void SharedFilesWidget::updateStatus()
+{
     int totalFiles = 0;
     int usersWithFiles = 0;
-
     for (const LANDropUser &user : discoveredUsers)
     {
         if (user.hasSharedFiles())
         {
-            addUserToTree(user);
             totalFiles += user.sharedFileCount();
             usersWithFiles++;
         }
     }
 
-    // Update status
     QString currentSharedFolder = QDir::current().absoluteFilePath("./Shared Files");
 
     if (usersWithFiles == 0)
@@ -182,31 +310,6 @@ void SharedFilesWidget::populateUserFiles()
                                  .arg(usersWithFiles)
                                  .arg(currentSharedFolder));
     }
-
-    // Expand all user nodes by default
-    treeWidget->expandAll();
-
-    // Try to restore previous selection
-    if (!selectedUserIP.isEmpty() && !selectedFilePath.isEmpty())
-    {
-        for (int i = 0; i < treeWidget->topLevelItemCount(); ++i)
-        {
-            QTreeWidgetItem *userItem = treeWidget->topLevelItem(i);
-            for (int j = 0; j < userItem->childCount(); ++j)
-            {
-                QTreeWidgetItem *child = userItem->child(j);
-                if (child->data(0, UserIPRole).toString() == selectedUserIP &&
-                    child->data(0, FilePathRole).toString() == selectedFilePath)
-                {
-                    treeWidget->setCurrentItem(child);
-                    treeWidget->scrollToItem(child);
-                    qDebug() << "SharedFilesWidget: Restored selection";
-                    return;
-                }
-            }
-        }
-        qDebug() << "SharedFilesWidget: Previous selection not found in refreshed tree.";
-    }
 }
 
 /**
@@ -216,15 +319,13 @@ void SharedFilesWidget::populateUserFiles()
  * shared files as child items.
  *
  * @param user LANDropUser containing shared file information
+ * @return The user's top-level item
  */
-void SharedFilesWidget::addUserToTree(const LANDropUser &user)
+QTreeWidgetItem *SharedFilesWidget::addUserToTree(const LANDropUser &user)
 {
     // Create user root item
     QTreeWidgetItem *userItem = new QTreeWidgetItem(treeWidget);
-    userItem->setText(0, QString("📁 %1 (%2)").arg(user.hostname, user.ipAddress));
-    userItem->setText(1, "");
     userItem->setText(2, "User");
-    userItem->setData(0, UserIPRole, user.ipAddress);
     userItem->setData(0, IsDownloadableRole, false);
 
     // Style user item
@@ -233,38 +334,180 @@ void SharedFilesWidget::addUserToTree(const LANDropUser &user)
     userItem->setFont(0, font);
     userItem->setBackground(0, QColor(240, 248, 255));
 
-    // Add shared files
-    for (const QJsonValue &fileValue : user.sharedFiles)
+    updateUserItem(userItem, user);
+    applyCatalog(userItem, user);
+    return userItem;
+}
+
+/**
+ * @brief Refreshes the name, address and port shown for a user.
+ *
+ * @param userItem Top-level item of the user
+ * @param user Current information about the user
+ */
+void SharedFilesWidget::updateUserItem(QTreeWidgetItem *userItem, const LANDropUser &user)
+{
+    userItem->setText(0, QString("📁 %1 (%2)").arg(user.hostname, user.ipAddress));
+    userItem->setData(0, UserIPRole, user.ipAddress);
+    userItem->setData(0, UserPortRole, user.transferPort);
+    userItem->setText(2, SubscriptionMirror::isSubscribed(user.hostname, QString()) ? "Subscribed" : "User");
+}
+
+/**
+ * @brief Arranges a catalog by folder.
+ *
+ * Folders are taken from the file paths; "directory" entries of older
+ * catalogs add nothing to them and are left out.
+ *
+ * @param files Entries of the catalog
+ * @param version Catalog version the entries belong to
+ * @return The catalog's folders and files, by parent folder
+ */
+SharedFilesWidget::CatalogTree SharedFilesWidget::buildTree(const QJsonArray &files, quint64 version)
+{
+    CatalogTree tree;
+    tree.version = version;
+    for (const QJsonValue &fileValue : files)
     {
-        if (fileValue.isObject())
+        if (!fileValue.isObject())
+            continue;
+
+        QJsonObject fileInfo = fileValue.toObject();
+        if (fileInfo["type"].toString() == "directory")
+            continue;
+
+        QString path = fileInfo["path"].toString();
+        int slash = path.lastIndexOf('/');
+        QString folder = slash < 0 ? QString() : path.left(slash);
+        tree.files[folder].append(fileInfo);
+
+        // Register the folder and the ancestors not seen yet
+        while (!folder.isEmpty() && !tree.folders.contains(folder))
         {
-            addFileToUser(userItem, fileValue.toObject(), user.ipAddress, user.transferPort);
+            tree.folders.insert(folder, QStringList());
+            slash = folder.lastIndexOf('/');
+            QString parent = slash < 0 ? QString() : folder.left(slash);
+            tree.folders[parent].append(folder);
+            folder = parent;
         }
     }
+    return tree;
+}
+
+/**
+ * @brief Applies a user's catalog to the items below their item.
+ *
+ * The catalog is arranged by folder, then the user's item and the folders
+ * already expanded are diffed against it.
+ *
+ * @param userItem Top-level item of the user
+ * @param user LANDropUser containing shared file information
+ */
+void SharedFilesWidget::applyCatalog(QTreeWidgetItem *userItem, const LANDropUser &user)
+{
+    catalogTrees.insert(user.ipAddress, buildTree(user.sharedFiles, user.catalogVersion));
+    searchIndex.setCatalog(user.ipAddress, user.sharedFiles);
+    populateFolder(userItem, QString());
 
     // Set file count in user item
     userItem->setText(1, QString("(%1 files)").arg(user.sharedFileCount()));
 }
 
 /**
- * @brief Adds a file item as a child of a user item.
+ * @brief Shows the subfolders and files of one folder below its item.
  *
- * @param userItem Parent user item in the tree
- * @param fileInfo JSON object containing file metadata
+ * Children are matched by relative path: kept ones are updated in place,
+ * new ones added in one batch and the ones no longer shared deleted.
+ * Subfolders that were expanded before are diffed the same way, the others
+ * are left empty until expanded.
+ *
+ * @param parentItem Item of the user for the shared folder, or of a folder
+ * @param folderPath Path of the folder relative to the shared folder
+ */
+void SharedFilesWidget::populateFolder(QTreeWidgetItem *parentItem, const QString &folderPath)
+{
+    QString userIP = parentItem->data(0, UserIPRole).toString();
+    quint16 userPort = parentItem->data(0, UserPortRole).toUInt();
+    const CatalogTree &tree = catalogTrees[userIP];
+
+    QHash<QString, QTreeWidgetItem *> shown;
+    for (int i = 0; i < parentItem->childCount(); ++i)
+    {
+        QTreeWidgetItem *child = parentItem->child(i);
+        shown.insert(child->data(0, FilePathRole).toString(), child);
+    }
+
+    QList<QTreeWidgetItem *> added;
+    for (const QString &subfolder : tree.folders.value(folderPath))
+    {
+        QTreeWidgetItem *folderItem = shown.take(subfolder);
+        if (!folderItem)
+        {
+            added.append(createFolderItem(subfolder, userIP, userPort));
+            continue;
+        }
+
+        folderItem->setData(0, UserIPRole, userIP);
+        folderItem->setData(0, UserPortRole, userPort);
+        if (folderItem->data(0, IsPopulatedRole).toBool())
+            populateFolder(folderItem, subfolder);
+    }
+
+    for (const QJsonObject &fileInfo : tree.files.value(folderPath))
+    {
+        QTreeWidgetItem *fileItem = shown.take(fileInfo["path"].toString());
+        if (fileItem)
+            updateFileItem(fileItem, fileInfo, userIP, userPort);
+        else
+            added.append(createFileItem(fileInfo, userIP, userPort));
+    }
+
+    // Entries no longer shared, a deleted item leaves its parent
+    qDeleteAll(shown);
+    parentItem->addChildren(added);
+    parentItem->setData(0, IsPopulatedRole, true);
+}
+
+/**
+ * @brief Creates the item of a folder, its children follow on expansion.
+ *
+ * @param folderPath Path of the folder relative to the shared folder
  * @param userIP IP address of the file owner
  * @param userPort Port number for file transfer
+ * @return Configured QTreeWidgetItem for the folder
  */
-void SharedFilesWidget::addFileToUser(QTreeWidgetItem *userItem, const QJsonObject &fileInfo, const QString &userIP, quint16 userPort)
+QTreeWidgetItem *SharedFilesWidget::createFolderItem(const QString &folderPath, const QString &userIP, quint16 userPort)
 {
-    QTreeWidgetItem *fileItem = createFileItem(fileInfo, userIP, userPort);
-    userItem->addChild(fileItem);
+    QTreeWidgetItem *item = new QTreeWidgetItem();
+    item->setText(0, "📁 " + folderPath.mid(folderPath.lastIndexOf('/') + 1));
+    bool subscribed = SubscriptionMirror::isSubscribed(discoveredUsers.value(userIP).hostname, folderPath);
+    item->setText(2, subscribed ? "Subscribed" : "Folder");
+    item->setChildIndicatorPolicy(QTreeWidgetItem::ShowIndicator);
+    item->setData(0, IsDownloadableRole, false);
+    item->setData(0, IsPopulatedRole, false);
+    item->setData(0, UserIPRole, userIP);
+    item->setData(0, UserPortRole, userPort);
+    item->setData(0, FilePathRole, folderPath);
+    item->setData(0, FileTypeRole, "folder");
+    return item;
 }
 
 /**
- * @brief Creates a tree widget item for a shared file.
+ * @brief Creates the children of a folder the first time it is expanded.
  *
- * Parses file information from JSON and creates a configured
- * tree item with appropriate icons, metadata, and styling.
+ * @param item The tree item that was expanded
+ */
+void SharedFilesWidget::onItemExpanded(QTreeWidgetItem *item)
+{
+    if (item->data(0, FileTypeRole).toString() != "folder" || item->data(0, IsPopulatedRole).toBool())
+        return;
+
+    populateFolder(item, item->data(0, FilePathRole).toString());
+    item->setChildIndicatorPolicy(QTreeWidgetItem::DontShowIndicatorWhenChildless);
+}
+
+/**
+ * @brief Creates a tree widget item for a shared file.
  *
  * @param fileInfo JSON object containing file metadata
  * @param userIP IP address of the file owner
@@ -274,7 +517,25 @@ void SharedFilesWidget::addFileToUser(QTreeWidgetItem *userItem, const QJsonObje
 QTreeWidgetItem *SharedFilesWidget::createFileItem(const QJsonObject &fileInfo, const QString &userIP, quint16 userPort)
 {
     QTreeWidgetItem *item = new QTreeWidgetItem();
+    item->setData(0, IsDownloadableRole, true);
+    updateFileItem(item, fileInfo, userIP, userPort);
+    return item;
+}
 
+/**
+ * @brief Shows a shared file's metadata on its tree item.
+ *
+ * Parses file information from JSON and sets the item's texts, icon and
+ * transfer details. Unchanged values are left alone by the item, so
+ * updating a kept file does not repaint it.
+ *
+ * @param item Tree item of the file
+ * @param fileInfo JSON object containing file metadata
+ * @param userIP IP address of the file owner
+ * @param userPort Port number for file transfer
+ */
+void SharedFilesWidget::updateFileItem(QTreeWidgetItem *item, const QJsonObject &fileInfo, const QString &userIP, quint16 userPort)
+{
     QString name = fileInfo["name"].toString();
     QString type = fileInfo["type"].toString();
     qint64 size = fileInfo["size"].toString().toLongLong();
@@ -290,9 +551,8 @@ QTreeWidgetItem *SharedFilesWidget::createFileItem(const QJsonObject &fileInfo,
     item->setData(0, UserPortRole, userPort);
     item->setData(0, FilePathRole, relativePath);
     item->setData(0, FileTypeRole, type);
-    item->setData(0, IsDownloadableRole, true);
-
-    return item;
+    item->setData(0, FileHashRole, fileInfo["hash"].toString().toLatin1());
+    item->setData(0, FileSizeRole, size);
 }
 
 /**
@@ -313,15 +573,69 @@ void SharedFilesWidget::onItemDoubleClicked(QTreeWidgetItem *item, int column)
     }
 }
 
+/**
+ * @brief Subscribes to the selected user or folder, or stops mirroring it.
+ *
+ * The subscription is written to the configuration file at once; files
+ * mirrored so far stay in the received files folder.
+ */
+void SharedFilesWidget::onSubscribeButtonClicked()
+{
+    QTreeWidgetItem *item = treeWidget->currentItem();
+    QString hostname;
+    QString folder;
+    if (!subscriptionOf(item, &hostname, &folder))
+        return;
+
+    bool subscribed = !SubscriptionMirror::isSubscribed(hostname, folder);
+    SubscriptionMirror::setSubscribed(hostname, folder, subscribed);
+    Config::writeToFile();
+
+    if (item->parent())
+        item->setText(2, subscribed ? "Subscribed" : "Folder");
+    else
+        item->setText(2, subscribed ? "Subscribed" : "User");
+    updateSubscribeButton();
+}
+
+/**
+ * @brief Subscription a tree item stands for: a folder, or the whole share of a user item.
+ *
+ * @return false for files and items of users whose hostname is unknown
+ */
+bool SharedFilesWidget::subscriptionOf(QTreeWidgetItem *item, QString *hostname, QString *folder) const
+{
+    if (!item)
+        return false;
+
+    bool isFolder = item->data(0, FileTypeRole).toString() == "folder";
+    if (item->parent() && !isFolder)
+        return false;
+
+    *hostname = discoveredUsers.value(item->data(0, UserIPRole).toString()).hostname;
+    *folder = isFolder ? item->data(0, FilePathRole).toString() : QString();
+    return !hostname->isEmpty();
+}
+
+void SharedFilesWidget::updateSubscribeButton()
+{
+    QString hostname;
+    QString folder;
+    bool enabled = !treeWidget->isHidden() && subscriptionOf(treeWidget->currentItem(), &hostname, &folder);
+    subscribeButton->setEnabled(enabled);
+    subscribeButton->setText(enabled && SubscriptionMirror::isSubscribed(hostname, folder) ? "Unsubscribe" : "Subscribe");
+}
+
 /**
  * @brief Handles download button clicks and double-click downloads.
  *
  * Extracts file information from the selected tree item and emits a
- * download request signal with the necessary transfer details.
+ * download request signal with the necessary transfer details. A file
+ * other peers share with the same hash is asked for from all of them.
  */
 void SharedFilesWidget::onDownloadButtonClicked()
 {
-    QTreeWidgetItem *item = treeWidget->currentItem();
+    QTreeWidgetItem *item = currentFileItem();
     if (!item || !item->data(0, IsDownloadableRole).toBool())
     {
         return;
@@ -341,9 +655,156 @@ void SharedFilesWidget::onDownloadButtonClicked()
     qDebug() << "  - original text:" << item->text(0);
     */
 
+    QByteArray hash = item->data(0, FileHashRole).toByteArray();
+    qint64 size = item->data(0, FileSizeRole).toLongLong();
+    QList<SwarmDownload::Source> sources = sourcesOf(hash, size);
+    if (sources.size() > 1)
+    {
+        emit swarmDownloadRequested(sources, fileName, size, hash);
+        return;
+    }
+
     emit downloadRequested(userIP, userPort, relativePath, fileName);
 }
 
+/**
+ * @brief Selected item of the search matches while searching, of the tree otherwise.
+ */
+QTreeWidgetItem *SharedFilesWidget::currentFileItem() const
+{
+    return resultsWidget->isVisible() ? resultsWidget->currentItem() : treeWidget->currentItem();
+}
+
+/**
+ * @brief Lists the files of every user matching the search box, or shows the tree again once it is empty.
+ */
+void SharedFilesWidget::onSearchChanged()
+{
+    CatalogSearch::Query query = parseSearch(searchInput->text());
+    bool searching = !searchInput->text().trimmed().isEmpty();
+    treeWidget->setVisible(!searching);
+    resultsWidget->setVisible(searching);
+    resultsWidget->clear();
+    updateSubscribeButton();
+    if (!searching)
+    {
+        QTreeWidgetItem *item = treeWidget->currentItem();
+        downloadButton->setEnabled(item && item->data(0, IsDownloadableRole).toBool());
+        return;
+    }
+
+    QList<QTreeWidgetItem *> items;
+    const QList<CatalogSearch::Hit> hits = searchIndex.search(query);
+    for (const CatalogSearch::Hit &hit : hits)
+    {
+        auto user = discoveredUsers.constFind(hit.peer);
+        if (user == discoveredUsers.constEnd())
+            continue;
+
+        QJsonObject fileInfo;
+        fileInfo["name"] = hit.name;
+        fileInfo["path"] = hit.path;
+        fileInfo["size"] = QString::number(hit.size);
+        fileInfo["hash"] = QString::fromLatin1(hit.hash);
+        fileInfo["type"] = "file";
+
+        QTreeWidgetItem *item = createFileItem(fileInfo, user->ipAddress, user->transferPort);
+        item->setText(2, user->hostname);
+        item->setToolTip(0, hit.path);
+        items.append(item);
+    }
+    resultsWidget->addTopLevelItems(items);
+    downloadButton->setEnabled(false);
+}
+
+/**
+ * @brief Splits the text of the search box into words and filters.
+ *
+ * "type:" takes a comma-separated list of extensions, ">" and "<" a size
+ * with an optional K, M or G suffix.
+ *
+ * @param text Text of the search box
+ * @return The query to run
+ */
+CatalogSearch::Query SharedFilesWidget::parseSearch(const QString &text)
+{
+    auto parseSize = [](QString value, qint64 *size)
+    {
+        qint64 unit = 1;
+        QChar suffix = value.isEmpty() ? QChar() : value.back().toUpper();
+        if (suffix == 'K' || suffix == 'M' || suffix == 'G')
+        {
+            unit = suffix == 'K' ? 1024 : suffix == 'M' ? 1024 * 1024 : 1024 * 1024 * 1024;
+            value.chop(1);
+        }
+        bool ok = false;
+        double number = value.toDouble(&ok);
+        if (ok && number >= 0)
+            *size = qint64(number * unit);
+        return ok;
+    };
+
+    CatalogSearch::Query query;
+    QStringList words;
+    const QStringList tokens = text.split(' ', Qt::SkipEmptyParts);
+    for (const QString &token : tokens)
+    {
+        if (token.startsWith("type:", Qt::CaseInsensitive))
+            query.types.append(token.mid(5).split(',', Qt::SkipEmptyParts));
+        else if (token.startsWith('>') && parseSize(token.mid(1), &query.minSize))
+            continue;
+        else if (token.startsWith('<') && parseSize(token.mid(1), &query.maxSize))
+            continue;
+        else
+            words.append(token);
+    }
+    query.text = words.join(' ');
+    return query;
+}
+
+/**
+ * @brief Peers whose catalogs list a file with the given contents.
+ *
+ * @param hash Hex hash of the contents, nothing is found for an empty one
+ * @param size Size of the file
+ * @return One source per peer
+ */
+QList<SwarmDownload::Source> SharedFilesWidget::sourcesOf(const QByteArray &hash, qint64 size) const
+{
+    QList<SwarmDownload::Source> sources;
+    if (hash.isEmpty())
+        return sources;
+
+    QString wanted = QString::fromLatin1(hash);
+    for (auto tree = catalogTrees.constBegin(); tree != catalogTrees.constEnd(); ++tree)
+    {
+        auto user = discoveredUsers.constFind(tree.key());
+        if (user == discoveredUsers.constEnd())
+            continue;
+
+        bool found = false;
+        for (const QList<QJsonObject> &files : tree->files)
+        {
+            for (const QJsonObject &fileInfo : files)
+            {
+                if (fileInfo["hash"].toString() != wanted || fileInfo["size"].toString().toLongLong() != size)
+                    continue;
+
+                SwarmDownload::Source source;
+                source.ip = user->ipAddress;
+                source.port = user->transferPort;
+                source.relativePath = fileInfo["path"].toString();
+                sources.append(source);
+                found = true;
+                break;
+            }
+            if (found)
+                break;
+        }
+    }
+    return sources;
+}
+
 /**
  * @brief Opens the local shared files folder in the system file manager.
  */
@@ -357,8 +818,8 @@ void SharedFilesWidget::onOpenSharedFolderClicked()
 /**
  * @brief Handles refresh button clicks.
  *
- * Manually triggers a refresh of the shared files display by rebuilding
- * the tree with current user data.
+ * Manually triggers a refresh of the shared files display by diffing the
+ * files of every user again.
  */
 void SharedFilesWidget::onRefreshClicked()
 {
@@ -13,8 +13,12 @@
 #include <QHBoxLayout>
 #include <QLabel>
 #include <QPushButton>
+#include <QLineEdit>
 #include <QJsonObject>
+#include <QHash>
 #include "../services/broadcastdiscoveryservice.h"
+#include "../network/swarmdownload.h"
+#include "../services/catalogsearch.h"
 
 class SharedFileManager;
 
@@ -24,6 +28,27 @@ class SharedFileManager;
  *
  * This widget provides a user interface for browsing and downloading files shared by other
  * LANDrop users on the network. It displays users and their shared files in a tree structure.
+ *
+ * The tree follows the discovery service's peer changes instead of being
+ * rebuilt: a peer whose shared files changed only has its added, removed
+ * and changed files applied. Items that stay keep their selection and
+ * expansion.
+ *
+ * Files in subfolders of a peer's shared folder are shown below folder
+ * items, whose children are only created when the folder is first
+ * expanded; a catalog of a hundred thousand files costs items for the
+ * folders opened, not for every file.
+ *
+ * A file whose hash and size several peers list is downloaded from all of
+ * them at once (see SwarmDownload).
+ *
+ * The search box looks the files of every peer up in a CatalogSearch index
+ * kept up to date with the tree, and lists the matches in place of it.
+ * Besides words, a search takes "type:mp4,mkv", ">100M" and "<2G" filters.
+ *
+ * A selected user or folder can be subscribed to; FileTransferManager then
+ * mirrors its new and changed files in the background, see
+ * SubscriptionMirror.
  */
 class SharedFilesWidget : public QWidget
 {
@@ -35,32 +60,80 @@ public:
     void setSharedFileManager(SharedFileManager *manager);
 
 public slots:
-    void onUserListUpdated(const QList<LANDropUser> &users);
+    void onPeerAdded(const LANDropUser &user);
+    void onPeerChanged(const LANDropUser &user, int changedFields);
+    void onPeerRemoved(const QString &ipAddress);
 
 signals:
     /** Emitted when user requests to download a shared file */
     void downloadRequested(const QString &userIP, quint16 userPort, const QString &relativePath, const QString &fileName);
 
+    /** Emitted instead of downloadRequested() when several peers share the same contents */
+    void swarmDownloadRequested(const QList<SwarmDownload::Source> &sources, const QString &fileName, qint64 size,
+                                const QByteArray &hash);
+
 private slots:
     void onItemDoubleClicked(QTreeWidgetItem *item, int column);
+    void onItemExpanded(QTreeWidgetItem *item);
+    void onScanProgress(int folders, int files);
     void onDownloadButtonClicked();
+    void onSubscribeButtonClicked();
     void onOpenSharedFolderClicked();
     void onRefreshClicked();
+    void onSearchChanged();
 
 private:
+    /**
+     * @brief A peer's catalog arranged by folder.
+     */
+    struct CatalogTree
+    {
+        /** Subfolder paths by the path of their parent, "" for the shared folder */
+        QHash<QString, QStringList> folders;
+
+        /** File entries by the path of their folder */
+        QHash<QString, QList<QJsonObject>> files;
+
+        /** Catalog version the tree was built from */
+        quint64 version = 0;
+    };
+
+    static CatalogTree buildTree(const QJsonArray &files, quint64 version);
+
     void setupUI();
     void populateUserFiles();
-    void addUserToTree(const LANDropUser &user);
-    void addFileToUser(QTreeWidgetItem *userItem, const QJsonObject &fileInfo, const QString &userIP, quint16 userPort);
+    void showUser(const LANDropUser &user, bool filesChanged);
+    void removeUserItem(const QString &ipAddress);
+    void updateStatus();
+    QTreeWidgetItem *addUserToTree(const LANDropUser &user);
+    void updateUserItem(QTreeWidgetItem *userItem, const LANDropUser &user);
+    void applyCatalog(QTreeWidgetItem *userItem, const LANDropUser &user);
+    void populateFolder(QTreeWidgetItem *parentItem, const QString &folderPath);
+    QTreeWidgetItem *createFolderItem(const QString &folderPath, const QString &userIP, quint16 userPort);
     QTreeWidgetItem* createFileItem(const QJsonObject &fileInfo, const QString &userIP, quint16 userPort);
+    void updateFileItem(QTreeWidgetItem *item, const QJsonObject &fileInfo, const QString &userIP, quint16 userPort);
     QString formatFileSize(qint64 bytes) const;
+    QList<SwarmDownload::Source> sourcesOf(const QByteArray &hash, qint64 size) const;
+    QTreeWidgetItem *currentFileItem() const;
+    bool subscriptionOf(QTreeWidgetItem *item, QString *hostname, QString *folder) const;
+    void updateSubscribeButton();
+    static CatalogSearch::Query parseSearch(const QString &text);
 
     /** Tree widget displaying users and their shared files */
     QTreeWidget *treeWidget;
+
+    /** Box searching the files of every user */
+    QLineEdit *searchInput;
+
+    /** Matches of the search, shown instead of the tree while searching */
+    QTreeWidget *resultsWidget;
     
     /** Button to download selected file */
     QPushButton *downloadButton;
     
+    /** Button to subscribe to the selected user or folder, or to stop */
+    QPushButton *subscribeButton;
+
     /** Button to open local shared folder */
     QPushButton *openFolderButton;
     
@@ -70,8 +143,17 @@ private:
     /** Label showing status and shared folders information */
     QLabel *statusLabel;
     
-    /** List of currently discovered users with their shared files */
-    QList<LANDropUser> discoveredUsers;
+    /** Currently discovered users with their shared files, by IP address */
+    QHash<QString, LANDropUser> discoveredUsers;
+
+    /** Top-level item of each user shown, by IP address */
+    QHash<QString, QTreeWidgetItem *> userItems;
+
+    /** Catalog of each user shown arranged by folder, by IP address */
+    QHash<QString, CatalogTree> catalogTrees;
+
+    /** Files of every user shown, by name and path */
+    CatalogSearch searchIndex;
     
     /** Manager for local shared file operations */
     SharedFileManager *sharedFileManager;
@@ -82,6 +164,9 @@ private:
     static const int FilePathRole = Qt::UserRole + 3;
     static const int FileTypeRole = Qt::UserRole + 4;
     static const int IsDownloadableRole = Qt::UserRole + 5;
+    static const int IsPopulatedRole = Qt::UserRole + 6;
+    static const int FileHashRole = Qt::UserRole + 7;
+    static const int FileSizeRole = Qt::UserRole + 8;
 };
 
 #endif // SHAREDFILESWIDGET_H
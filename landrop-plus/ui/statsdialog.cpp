@@ -0,0 +1,105 @@
+/**
+ * @file statsdialog.cpp
+ */
+
+#include "statsdialog.h"
+#include "../network/transfermetrics.h"
+#include <QHeaderView>
+#include <QLocale>
+
+/**
+ * @brief Constructs the dialog and shows the current metrics.
+ *
+ * @param parent Parent widget for the dialog
+ */
+StatsDialog::StatsDialog(QWidget *parent)
+    : QDialog{parent},
+      refreshTimer(new QTimer(this))
+{
+    setWindowTitle("LANDrop - statistics");
+    resize(760, 420);
+
+    summary = new QLabel();
+    summary->setTextInteractionFlags(Qt::TextSelectableByMouse);
+
+    sessionList = new QTreeWidget();
+    sessionList->setRootIsDecorated(false);
+    sessionList->setHeaderLabels({"File", "Peer", "Direction", "State", "Transferred", "Rate", "Average",
+                                  "Connect", "First byte", "Network wait", "Disk wait"});
+    sessionList->header()->setSectionResizeMode(0, QHeaderView::Stretch);
+
+    mainLayout = new QVBoxLayout();
+    setLayout(mainLayout);
+    mainLayout->addWidget(summary);
+    mainLayout->addWidget(sessionList);
+
+    connect(refreshTimer, &QTimer::timeout, this, &StatsDialog::refresh);
+    refreshTimer->start(REFRESH_INTERVAL_MS);
+    refresh();
+}
+
+/**
+ * @brief Reads the metrics again and updates the summary and session list.
+ */
+void StatsDialog::refresh()
+{
+    QLocale locale;
+    auto rate = [&locale](qint64 bytesPerSecond)
+    {
+        return locale.formattedDataSize(bytesPerSecond) + "/s";
+    };
+    auto milliseconds = [](qint64 value)
+    {
+        return value < 0 ? QString("-") : QString::number(value) + " ms";
+    };
+
+    TransferMetrics::Totals totals = TransferMetrics::totals();
+    QString text = QString("Sent: %1 (%2)    Received: %3 (%4)\n")
+                       .arg(locale.formattedDataSize(totals.bytesSent), rate(totals.sendRate),
+                            locale.formattedDataSize(totals.bytesReceived), rate(totals.receiveRate));
+    text += QString("Sessions: %1 started, %2 finished, %3 failed, %4 refused\n")
+                .arg(totals.sessionsStarted)
+                .arg(totals.sessionsFinished)
+                .arg(totals.sessionsFailed)
+                .arg(totals.sessionsRefused);
+    text += QString("Discovery: %1 sent (%2/s), %3 received (%4/s)")
+                .arg(totals.discoverySent)
+                .arg(totals.discoverySendRate)
+                .arg(totals.discoveryReceived)
+                .arg(totals.discoveryReceiveRate);
+
+    QStringList queues;
+    for (auto it = totals.queueDepths.constBegin(); it != totals.queueDepths.constEnd(); ++it)
+        queues << QString("%1 %2").arg(it.key()).arg(it.value());
+    if (!queues.isEmpty())
+        text += "\nQueues: " + queues.join(", ");
+
+    QStringList phases;
+    for (const QPair<QString, qint64> &entry : totals.startupPhases)
+        phases << QString("%1 %2").arg(entry.first, milliseconds(entry.second));
+    if (!phases.isEmpty())
+        text += "\nStartup: " + phases.join(", ");
+    summary->setText(text);
+
+    static const char *states[] = {"Running", "Finished", "Failed", "Refused"};
+    sessionList->clear();
+    for (const TransferMetrics::SessionStats &stats : TransferMetrics::sessions())
+    {
+        QString transferred = locale.formattedDataSize(stats.bytes);
+        if (stats.size > 0)
+            transferred += " / " + locale.formattedDataSize(stats.size);
+
+        QTreeWidgetItem *item = new QTreeWidgetItem(sessionList);
+        item->setText(0, stats.fileName);
+        item->setText(1, stats.peer);
+        item->setText(2, stats.direction == TransferMetrics::Direction::Send ? "Send" : "Receive");
+        item->setText(3, states[int(stats.outcome)]);
+        item->setText(4, transferred);
+        item->setText(5, rate(stats.rate));
+        item->setText(6, rate(stats.averageRate));
+        item->setText(7, milliseconds(stats.handshakeMs));
+        item->setText(8, milliseconds(stats.firstByteMs));
+        item->setText(9, milliseconds(stats.networkWaitUs / 1000));
+        item->setText(10, milliseconds(stats.diskWaitUs / 1000));
+    }
+}
@@ -0,0 +1,39 @@
+/**
+ * @file statsdialog.h
+ * @brief Dialog showing the transfer metrics of this process
+ */
+
+#ifndef STATSDIALOG_H
+#define STATSDIALOG_H
+
+#include <QDialog>
+#include <QLabel>
+#include <QTimer>
+#include <QTreeWidget>
+#include <QBoxLayout>
+
+/**
+ * @class StatsDialog
+ * @brief Shows the totals, queue depths and recent sessions of TransferMetrics.
+ *
+ * Refreshed every REFRESH_INTERVAL_MS while open.
+ */
+class StatsDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    explicit StatsDialog(QWidget *parent = nullptr);
+
+    static const int REFRESH_INTERVAL_MS = 1000;
+
+private slots:
+    void refresh();
+
+private:
+    QLabel *summary;
+    QTreeWidget *sessionList;
+    QVBoxLayout *mainLayout;
+    QTimer *refreshTimer;
+};
+
+#endif // STATSDIALOG_H
@@ -0,0 +1,237 @@
+/**
+ * @file transferhistorymodel.cpp
+ */
+
+#include "transferhistorymodel.h"
+
+/**
+ * @brief Constructs an empty history model.
+ *
+ * @param parent Parent QObject
+ */
+TransferHistoryModel::TransferHistoryModel(QObject *parent)
+    : QAbstractListModel(parent),
+      pages(CACHED_PAGES)
+{
+}
+
+/**
+ * @brief Lists the records a store holds now below the sessions of this run.
+ *
+ * Sessions of this run reach the store as they end, they are listed once
+ * as sessions.
+ *
+ * @param store Store of earlier transfers, null to list none
+ */
+void TransferHistoryModel::setStore(const HistoryStore *store)
+{
+    beginResetModel();
+    this->store = store;
+    storedRows = store ? store->count() : 0;
+    pages.clear();
+    endResetModel();
+}
+
+int TransferHistoryModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : int(entries.size() + storedRows);
+}
+
+QVariant TransferHistoryModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() < 0 || index.row() >= rowCount())
+        return QVariant();
+    if (index.row() >= entries.size())
+        return storedData(index.row() - int(entries.size()), role);
+
+    const Entry &entry = entries.at(rowOf(index.row()));
+    switch (role)
+    {
+    case Qt::DisplayRole:
+    case Qt::ToolTipRole:
+        return entry.fileName;
+    case SessionIdRole:
+        return entry.sessionId;
+    case DirectionRole:
+        return int(entry.direction);
+    case StatusRole:
+        return int(entry.status);
+    case ProgressRole:
+        return entry.progress;
+    case RateRole:
+        return entry.bytesPerSecond;
+    case RemainingRole:
+        return entry.secondsRemaining;
+    default:
+        return QVariant();
+    }
+}
+
+/**
+ * @brief Data of a record of the store, reading its page if it is not cached.
+ *
+ * @param row Row below the sessions of this run
+ */
+QVariant TransferHistoryModel::storedData(int row, int role) const
+{
+    // Newest first; records stored since are not listed, so indices stay put
+    qint64 index = storedRows - 1 - row;
+    qint64 first = index - index % PAGE_SIZE;
+    QList<HistoryStore::Record> *page = pages.object(first);
+    if (!page)
+    {
+        page = new QList<HistoryStore::Record>(store->read(first, PAGE_SIZE));
+        pages.insert(first, page);
+    }
+    if (index - first >= page->size())
+        return QVariant();
+
+    const HistoryStore::Record &record = page->at(int(index - first));
+    switch (role)
+    {
+    case Qt::DisplayRole:
+    case Qt::ToolTipRole:
+        return record.fileName;
+    case SessionIdRole:
+        return -1;
+    case DirectionRole:
+        return int(record.outgoing ? TransferDirection::SEND : TransferDirection::RECEIVE);
+    case StatusRole:
+        return int(record.status);
+    case ProgressRole:
+        return record.status == TransferStatus::FINISHED ? 100 : 0;
+    case RateRole:
+        return qint64(0);
+    case RemainingRole:
+        return qint64(-1);
+    default:
+        return QVariant();
+    }
+}
+
+/**
+ * @brief Adds a session on top of the history.
+ *
+ * @param sessionId Unique identifier for the transfer session
+ * @param fileName Name shown for the transfer
+ * @param direction Whether the file is sent or received
+ */
+void TransferHistoryModel::addTransfer(int sessionId, const QString &fileName, TransferDirection direction)
+{
+    if (positions.contains(sessionId))
+        return;
+
+    Entry entry;
+    entry.sessionId = sessionId;
+    entry.fileName = fileName;
+    entry.direction = direction;
+
+    beginInsertRows(QModelIndex(), 0, 0);
+    positions.insert(sessionId, int(entries.size()));
+    entries.append(entry);
+    endInsertRows();
+}
+
+/**
+ * @brief Records progress, a complete transfer is shown as finished.
+ *
+ * Cancelled and failed sessions keep their status.
+ *
+ * @return Whether anything displayed changed
+ */
+bool TransferHistoryModel::applyProgress(Entry &entry, int percent)
+{
+    bool changed = (entry.progress != percent);
+    entry.progress = percent;
+
+    if (entry.status == TransferStatus::WAITING || entry.status == TransferStatus::IN_PROGRESS)
+    {
+        TransferStatus next = (percent == 100) ? TransferStatus::FINISHED : TransferStatus::IN_PROGRESS;
+        changed = changed || entry.status != next;
+        entry.status = next;
+    }
+    return changed;
+}
+
+/**
+ * @brief Updates the progress of one session.
+ *
+ * @param sessionId Unique identifier for the transfer session
+ * @param percent Progress percentage (0-100)
+ */
+void TransferHistoryModel::updateProgress(int sessionId, int percent)
+{
+    int position = positions.value(sessionId, -1);
+    if (position < 0 || !applyProgress(entries[position], percent))
+        return;
+
+    QModelIndex changed = index(rowOf(position));
+    emit dataChanged(changed, changed);
+}
+
+/**
+ * @brief Applies one published progress batch.
+ *
+ * The rows of the batch are reported as one changed range, the view only
+ * repaints the part of it that is visible.
+ *
+ * @param updates Progress, rate and remaining time of the changed sessions
+ */
+void TransferHistoryModel::updateProgress(const QList<TransferProgress> &updates)
+{
+    int first = -1;
+    int last = -1;
+    for (const TransferProgress &update : updates)
+    {
+        int position = positions.value(update.sessionId, -1);
+        if (position < 0)
+            continue;
+
+        Entry &entry = entries[position];
+        bool changed = applyProgress(entry, update.progress);
+        if (entry.bytesPerSecond != update.bytesPerSecond || entry.secondsRemaining != update.secondsRemaining)
+        {
+            entry.bytesPerSecond = update.bytesPerSecond;
+            entry.secondsRemaining = update.secondsRemaining;
+            changed = true;
+        }
+        if (!changed)
+            continue;
+
+        int row = rowOf(position);
+        first = (first < 0) ? row : qMin(first, row);
+        last = qMax(last, row);
+    }
+
+    if (first >= 0)
+        emit dataChanged(index(first), index(last));
+}
+
+/**
+ * @brief Sets the status of one session.
+ *
+ * @param sessionId Unique identifier for the transfer session
+ * @param status New status of the transfer
+ */
+void TransferHistoryModel::setStatus(int sessionId, TransferStatus status)
+{
+    int position = positions.value(sessionId, -1);
+    if (position < 0)
+        return;
+
+    Entry &entry = entries[position];
+    if (entry.status == status)
+        return;
+
+    entry.status = status;
+    if (status == TransferStatus::FINISHED)
+        entry.progress = 100;
+    if (status != TransferStatus::IN_PROGRESS)
+    {
+        entry.bytesPerSecond = 0;
+        entry.secondsRemaining = -1;
+    }
+
+    QModelIndex changed = index(rowOf(position));
+    emit dataChanged(changed, changed);
+}
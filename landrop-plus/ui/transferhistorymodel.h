@@ -0,0 +1,109 @@
+/**
+ * @file transferhistorymodel.h
+ * @brief List model of every transfer session shown in the history
+ */
+
+#ifndef TRANSFERHISTORYMODEL_H
+#define TRANSFERHISTORYMODEL_H
+
+#include <QAbstractListModel>
+#include <QCache>
+#include <QList>
+#include <QHash>
+#include <QString>
+#include "../core/transferstatus.h"
+#include "../services/progressaggregator.h"
+#include "../services/historystore.h"
+
+/**
+ * @class TransferHistoryModel
+ * @brief Holds the state of each transfer session as one row, newest first.
+ *
+ * The history keeps sessions that FileTransferManager already dropped, so
+ * the model stores its own copy of what is displayed: a few fields per row
+ * instead of a widget tree. Rows are appended internally and presented in
+ * reverse, so adding a session never moves the stored rows and a session ID
+ * resolves to its row with one hash lookup.
+ *
+ * With a HistoryStore set, the transfers it held before are listed below
+ * the sessions of this run. They are read a page of PAGE_SIZE rows at a
+ * time as the view shows them, and the last pages read are cached.
+ */
+class TransferHistoryModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @enum TransferDirection
+     * @brief Represents the direction of the file transfer.
+     */
+    enum class TransferDirection
+    {
+        SEND,   /**< Outgoing file transfer */
+        RECEIVE /**< Incoming file transfer */
+    };
+
+    /** Data roles of a row, Qt::DisplayRole is the file name. */
+    enum Role
+    {
+        SessionIdRole = Qt::UserRole + 1,
+        DirectionRole,
+        StatusRole,
+        ProgressRole,
+        RateRole,
+        RemainingRole
+    };
+
+    /** Rows of the store read at once. */
+    static const int PAGE_SIZE = 64;
+
+    /** Pages of the store kept in memory. */
+    static const int CACHED_PAGES = 16;
+
+    explicit TransferHistoryModel(QObject *parent = nullptr);
+
+    void setStore(const HistoryStore *store);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    void addTransfer(int sessionId, const QString &fileName, TransferDirection direction);
+    void updateProgress(int sessionId, int percent);
+    void updateProgress(const QList<TransferProgress> &updates);
+    void setStatus(int sessionId, TransferStatus status);
+
+private:
+    /**
+     * @brief Displayed state of one session.
+     */
+    struct Entry
+    {
+        int sessionId = -1;
+        QString fileName;
+        TransferDirection direction = TransferDirection::SEND;
+        TransferStatus status = TransferStatus::WAITING;
+        int progress = 0;
+        qint64 bytesPerSecond = 0;
+        qint64 secondsRemaining = -1;
+    };
+
+    bool applyProgress(Entry &entry, int percent);
+    int rowOf(int position) const { return int(entries.size()) - 1 - position; }
+    QVariant storedData(int row, int role) const;
+
+    /** Sessions in the order they were added */
+    QList<Entry> entries;
+
+    /** Position of each session in entries */
+    QHash<int, int> positions;
+
+    /** Store of earlier transfers and the number of its records listed */
+    const HistoryStore *store = nullptr;
+    qint64 storedRows = 0;
+
+    /** Pages of the store last read, by index of their first record */
+    mutable QCache<qint64, QList<HistoryStore::Record>> pages;
+};
+
+#endif // TRANSFERHISTORYMODEL_H
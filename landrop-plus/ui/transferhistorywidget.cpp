@@ -3,10 +3,10 @@
  */
 
 #include "transferhistorywidget.h"
-#include "transferitemwidget.h"
+#include "transferitemdelegate.h"
 #include "../config/config.h"
 
-#include <QScrollArea>
+#include <QListView>
 #include <QVBoxLayout>
 #include <QPushButton>
 #include <QDesktopServices>
@@ -21,7 +21,8 @@
  * @param parent
  */
 TransferHistoryWidget::TransferHistoryWidget(QWidget *parent)
-    : QWidget(parent)
+    : QWidget(parent),
+      model(new TransferHistoryModel(this))
 {
     auto *mainLayout = new QVBoxLayout(this);
     mainLayout->setContentsMargins(10, 10, 10, 10);
@@ -32,15 +33,14 @@ TransferHistoryWidget::TransferHistoryWidget(QWidget *parent)
     title->setStyleSheet("font-weight: bold; font-size: 16px;");
     mainLayout->addWidget(title);
 
-    // Scrollable area
-    scrollArea = new QScrollArea(this);
-    scrollArea->setWidgetResizable(true);
-    container = new QWidget;
-    itemsLayout = new QVBoxLayout(container);
-    itemsLayout->setAlignment(Qt::AlignTop);
-    container->setLayout(itemsLayout);
-    scrollArea->setWidget(container);
-    mainLayout->addWidget(scrollArea, 1);
+    // Session list, every row has the delegate's height
+    listView = new QListView(this);
+    listView->setModel(model);
+    listView->setItemDelegate(new TransferItemDelegate(listView));
+    listView->setUniformItemSizes(true);
+    listView->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+    listView->setSelectionMode(QAbstractItemView::NoSelection);
+    mainLayout->addWidget(listView, 1);
 
     // Reception folder button
     openFolderButton = new QPushButton("Open reception folder", this);
@@ -56,15 +56,16 @@ TransferHistoryWidget::TransferHistoryWidget(QWidget *parent)
 }
 
 /**
- * @brief Adds a new transfer item to the history widget
+ * @brief Adds a new transfer to the top of the history
  *
  * @param sessionId Unique identifier for the transfer session
- * @param item Transfer item widget to be added
+ * @param fileName Name of the file being transferred
+ * @param direction Whether the file is sent or received
  */
-void TransferHistoryWidget::addTransferItem(int sessionId, TransferItemWidget *item)
+void TransferHistoryWidget::addTransfer(int sessionId, const QString &fileName,
+                                        TransferHistoryModel::TransferDirection direction)
 {
-    items[sessionId] = item;
-    itemsLayout->insertWidget(0, item);
+    model->addTransfer(sessionId, fileName, direction);
 }
 
 /**
@@ -75,8 +76,30 @@ void TransferHistoryWidget::addTransferItem(int sessionId, TransferItemWidget *i
  */
 void TransferHistoryWidget::updateProgress(int id, int percent)
 {
-    if (items.contains(id))
-        items[id]->updateProgress(percent);
+    model->updateProgress(id, percent);
+}
+
+/**
+ * @brief Applies one published progress batch to the listed transfers
+ *
+ * The model reports the whole batch as one changed range, so the view
+ * repaints once per batch.
+ *
+ * @param updates Progress, rate and remaining time of the changed sessions
+ */
+void TransferHistoryWidget::updateProgress(const QList<TransferProgress> &updates)
+{
+    model->updateProgress(updates);
+}
+
+/**
+ * @brief Lists the transfers of earlier runs below the current ones
+ *
+ * @param store Persistent history, read page by page as the view scrolls
+ */
+void TransferHistoryWidget::setHistoryStore(const HistoryStore *store)
+{
+    model->setStore(store);
 }
 
 /**
@@ -87,6 +110,5 @@ void TransferHistoryWidget::updateProgress(int id, int percent)
  */
 void TransferHistoryWidget::setStatus(int id, TransferStatus status)
 {
-    if (items.contains(id))
-        items[id]->setStatus(status);
+    model->setStatus(id, status);
 }
@@ -7,19 +7,20 @@
 #define TRANSFERHISTORYWIDGET_H
 
 #include <QWidget>
-#include <QMap>
 #include "../core/transferstatus.h"
+#include "../services/progressaggregator.h"
+#include "transferhistorymodel.h"
 
-class QScrollArea;
-class QVBoxLayout;
+class QListView;
 class QPushButton;
-class TransferItemWidget;
 
 /**
  * @class TransferHistoryWidget
  * @brief Widget that displays a scrollable list of file transfer operations.
  *
- * This widget provides a view of all file transfer sessions.
+ * This widget provides a view of all file transfer sessions. Sessions are
+ * rows of a TransferHistoryModel painted by a TransferItemDelegate, so only
+ * the visible rows cost anything to draw however long the history grows.
  * Provides access to received files through folder navigation.
  */
 class TransferHistoryWidget : public QWidget
@@ -28,22 +29,18 @@ class TransferHistoryWidget : public QWidget
 public:
     explicit TransferHistoryWidget(QWidget *parent = nullptr);
 
-    void addTransferItem(int sessionId, TransferItemWidget *item);
+    void addTransfer(int sessionId, const QString &fileName, TransferHistoryModel::TransferDirection direction);
     void updateProgress(int id, int percent);
+    void updateProgress(const QList<TransferProgress> &updates);
     void setStatus(int id, TransferStatus status);
+    void setHistoryStore(const HistoryStore *store);
 
 private:
-    /** Map of transfer session IDs to their corresponding widget items */
-    QMap<int, TransferItemWidget *> items;
+    /** State of every transfer session shown */
+    TransferHistoryModel *model;
 
-    /** Scroll area for displaying the items */
-    QScrollArea *scrollArea;
-
-    /** Container widget for the scrollable content */
-    QWidget *container;
-
-    /** Layout for arranging transfer item widgets */
-    QVBoxLayout *itemsLayout;
+    /** View painting the visible sessions */
+    QListView *listView;
 
     /** Button for opening the received files folder */
     QPushButton *openFolderButton;
@@ -0,0 +1,140 @@
+/**
+ * @file transferitemdelegate.cpp
+ */
+
+#include "transferitemdelegate.h"
+#include "transferhistorymodel.h"
+#include <QPainter>
+#include <QLocale>
+#include <QFontMetrics>
+
+/**
+ * @brief Constructs a new transfer item delegate.
+ *
+ * @param parent Parent QObject
+ */
+TransferItemDelegate::TransferItemDelegate(QObject *parent)
+    : QStyledItemDelegate(parent)
+{
+}
+
+QString TransferItemDelegate::statusText(TransferStatus status)
+{
+    switch (status)
+    {
+    case TransferStatus::IN_PROGRESS:
+        return "In progress";
+    case TransferStatus::FINISHED:
+        return "Finished";
+    case TransferStatus::CANCELLED:
+        return "Cancelled";
+    case TransferStatus::ERROR:
+        return "Error";
+    default:
+        return "Waiting";
+    }
+}
+
+QColor TransferItemDelegate::statusColor(TransferStatus status)
+{
+    switch (status)
+    {
+    case TransferStatus::IN_PROGRESS:
+        return Qt::blue;
+    case TransferStatus::FINISHED:
+        return QColor("#4CAF50");
+    case TransferStatus::CANCELLED:
+    case TransferStatus::ERROR:
+        return Qt::red;
+    default:
+        return Qt::gray;
+    }
+}
+
+/**
+ * @brief Text drawn on the progress bar.
+ *
+ * @param percent Progress percentage
+ * @param bytesPerSecond Transfer rate, 0 while unknown
+ * @param secondsRemaining Estimated time left, -1 while unknown
+ */
+QString TransferItemDelegate::progressText(int percent, qint64 bytesPerSecond, qint64 secondsRemaining)
+{
+    QString text = QString("%1%").arg(percent);
+    if (bytesPerSecond > 0)
+    {
+        text += "   " + QLocale().formattedDataSize(bytesPerSecond) + "/s";
+        if (secondsRemaining >= 0)
+            text += QString("   %1:%2 left").arg(secondsRemaining / 60).arg(secondsRemaining % 60, 2, 10, QChar('0'));
+    }
+    return text;
+}
+
+/**
+ * @brief Paints one row: file name, progress bar and status line.
+ */
+void TransferItemDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    TransferStatus status = TransferStatus(index.data(TransferHistoryModel::StatusRole).toInt());
+    int percent = index.data(TransferHistoryModel::ProgressRole).toInt();
+    bool receiving = index.data(TransferHistoryModel::DirectionRole).toInt() ==
+                     int(TransferHistoryModel::TransferDirection::RECEIVE);
+
+    painter->save();
+
+    QRect content = option.rect.adjusted(MARGIN_H, MARGIN_V, -MARGIN_H, -MARGIN_V);
+    QFont bold = option.font;
+    bold.setBold(true);
+    QFontMetrics metrics(bold);
+    painter->setFont(bold);
+
+    // File name
+    QRect nameRect(content.left(), content.top(), content.width(), metrics.height());
+    painter->setPen(option.palette.color(QPalette::Text));
+    painter->drawText(nameRect, Qt::AlignLeft | Qt::AlignVCenter,
+                      metrics.elidedText(index.data(Qt::DisplayRole).toString(), Qt::ElideMiddle, nameRect.width()));
+
+    // Progress bar, filled red once the transfer was cancelled or failed
+    QRect barRect(content.left(), nameRect.bottom() + SPACING, content.width(), BAR_HEIGHT);
+    bool failed = (status == TransferStatus::CANCELLED || status == TransferStatus::ERROR);
+    painter->setRenderHint(QPainter::Antialiasing);
+    painter->setPen(Qt::gray);
+    painter->setBrush(failed ? QColor(Qt::red) : option.palette.color(QPalette::Base));
+    painter->drawRoundedRect(barRect, 5, 5);
+    if (!failed && percent > 0)
+    {
+        QRect chunk = barRect.adjusted(1, 1, -1, -1);
+        chunk.setWidth(chunk.width() * qBound(0, percent, 100) / 100);
+        painter->setPen(Qt::NoPen);
+        painter->setBrush(status == TransferStatus::FINISHED ? QColor("#4CAF50") : QColor("#66aaff"));
+        painter->drawRoundedRect(chunk, 4, 4);
+    }
+    QString barText = (status == TransferStatus::IN_PROGRESS)
+                          ? progressText(percent, index.data(TransferHistoryModel::RateRole).toLongLong(),
+                                         index.data(TransferHistoryModel::RemainingRole).toLongLong())
+                          : QString("%1%").arg(percent);
+    painter->setPen(option.palette.color(QPalette::Text));
+    painter->setFont(option.font);
+    painter->drawText(barRect, Qt::AlignCenter, barText);
+
+    // Status and direction
+    QRect statusRect(content.left(), barRect.bottom() + SPACING, content.width(), metrics.height());
+    painter->setFont(bold);
+    painter->setPen(statusColor(status));
+    painter->drawText(statusRect, Qt::AlignLeft | Qt::AlignVCenter,
+                      QString("Status : %1     Type : %2").arg(statusText(status), receiving ? "Reception" : "Sending"));
+
+    painter->restore();
+}
+
+/**
+ * @brief Every row has the height of a name line, the bar and a status line.
+ */
+QSize TransferItemDelegate::sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    Q_UNUSED(index);
+    QFont bold = option.font;
+    bold.setBold(true);
+    int line = QFontMetrics(bold).height();
+    return QSize(option.rect.width(), 2 * MARGIN_V + 2 * line + BAR_HEIGHT + 2 * SPACING);
+}
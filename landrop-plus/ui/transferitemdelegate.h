@@ -0,0 +1,47 @@
+/**
+ * @file transferitemdelegate.h
+ * @brief Paints one transfer of the history: name, progress bar and status
+ */
+
+#ifndef TRANSFERITEMDELEGATE_H
+#define TRANSFERITEMDELEGATE_H
+
+#include <QStyledItemDelegate>
+#include <QColor>
+#include "../core/transferstatus.h"
+
+/**
+ * @class TransferItemDelegate
+ * @brief Draws the rows of a TransferHistoryModel without any widget per row.
+ *
+ * Each row shows the file name in bold, a progress bar with the percentage,
+ * rate and remaining time, and a status line colored by status, the way a
+ * transfer item looked as a widget. Rows all have the same height, so the
+ * view lays out tens of thousands of them without asking for each size.
+ */
+class TransferItemDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    explicit TransferItemDelegate(QObject *parent = nullptr);
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+
+    static QString statusText(TransferStatus status);
+    static QString progressText(int percent, qint64 bytesPerSecond, qint64 secondsRemaining);
+
+private:
+    static QColor statusColor(TransferStatus status);
+
+    /** Space around the content of a row and between its lines. */
+    static const int MARGIN_H = 10;
+    static const int MARGIN_V = 5;
+    static const int SPACING = 5;
+
+    /** Height of the progress bar. */
+    static const int BAR_HEIGHT = 20;
+};
+
+#endif // TRANSFERITEMDELEGATE_H
@@ -0,0 +1,230 @@
+/**
+ * @file userlistmodel.cpp
+ */
+
+#include "userlistmodel.h"
+#include <algorithm>
+
+/**
+ * @brief Constructs an empty user list model.
+ *
+ * @param parent Parent QObject
+ */
+UserListModel::UserListModel(QObject *parent)
+    : QAbstractListModel(parent),
+      refreshTimer(new QTimer(this))
+{
+    refreshTimer->setSingleShot(true);
+    refreshTimer->setInterval(REFRESH_INTERVAL_MS);
+    connect(refreshTimer, &QTimer::timeout, this, &UserListModel::flush);
+}
+
+int UserListModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : int(entries.size());
+}
+
+QVariant UserListModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() < 0 || index.row() >= entries.size())
+        return QVariant();
+
+    const Entry &entry = entries.at(index.row());
+    switch (role)
+    {
+    case Qt::DisplayRole:
+        return QString("%1 [%2]").arg(entry.hostname, entry.ipAddress);
+    case Qt::ToolTipRole:
+        return entry.addresses.isEmpty() ? entry.ipAddress : entry.addresses.join(", ");
+    case IpAddressRole:
+        return entry.ipAddress;
+    case HostnameRole:
+        return entry.hostname;
+    case PortRole:
+        return entry.transferPort;
+    case VersionRole:
+        return entry.version;
+    default:
+        return QVariant();
+    }
+}
+
+/**
+ * @param row Row of the user
+ * @return The user to connect to, default-constructed for an invalid row
+ */
+LANDropUser UserListModel::user(int row) const
+{
+    if (row < 0 || row >= entries.size())
+        return LANDropUser();
+
+    const Entry &entry = entries.at(row);
+    LANDropUser user(entry.ipAddress, entry.hostname, entry.transferPort, entry.version);
+    user.addresses = entry.addresses;
+    return user;
+}
+
+/**
+ * @param users Users to list, in order
+ */
+void UserListModel::setUsers(const QList<LANDropUser> &users)
+{
+    refreshTimer->stop();
+    pending.clear();
+    pendingOrder.clear();
+
+    beginResetModel();
+    entries.clear();
+    rows.clear();
+    for (const LANDropUser &user : users)
+    {
+        if (rows.contains(user.ipAddress))
+            continue;
+        rows.insert(user.ipAddress, int(entries.size()));
+        entries.append(entryOf(user));
+    }
+    endResetModel();
+    emit refreshed(int(entries.size()));
+}
+
+/**
+ * @brief Removes, updates then appends the rows of the users with pending events.
+ */
+void UserListModel::flush()
+{
+    refreshTimer->stop();
+    if (pending.isEmpty())
+        return;
+
+    // Removals from the bottom up, so the rows above keep their numbers
+    QList<int> removed;
+    for (auto it = pending.constBegin(); it != pending.constEnd(); ++it)
+    {
+        auto row = rows.constFind(it.key());
+        if (it->removed && row != rows.constEnd())
+            removed.append(*row);
+    }
+    std::sort(removed.begin(), removed.end(), std::greater<int>());
+    for (int row : removed)
+    {
+        beginRemoveRows(QModelIndex(), row, row);
+        rows.remove(entries.at(row).ipAddress);
+        entries.removeAt(row);
+        endRemoveRows();
+    }
+    if (!removed.isEmpty())
+        reindex(removed.last());
+
+    QList<Entry> added;
+    for (const QString &ipAddress : std::as_const(pendingOrder))
+    {
+        const Pending &event = pending[ipAddress];
+        if (event.removed)
+            continue;
+
+        auto row = rows.constFind(ipAddress);
+        if (row == rows.constEnd())
+        {
+            added.append(event.entry);
+        }
+        else if (!(entries.at(*row) == event.entry))
+        {
+            entries[*row] = event.entry;
+            QModelIndex changed = index(*row);
+            emit dataChanged(changed, changed);
+        }
+    }
+    pending.clear();
+    pendingOrder.clear();
+
+    if (!added.isEmpty())
+    {
+        int first = int(entries.size());
+        beginInsertRows(QModelIndex(), first, first + int(added.size()) - 1);
+        for (const Entry &entry : std::as_const(added))
+        {
+            rows.insert(entry.ipAddress, int(entries.size()));
+            entries.append(entry);
+        }
+        endInsertRows();
+    }
+    emit refreshed(int(entries.size()));
+}
+
+/**
+ * @param user The discovered LANDrop user
+ */
+void UserListModel::onPeerAdded(const LANDropUser &user)
+{
+    Pending event;
+    event.entry = entryOf(user);
+    schedule(user.ipAddress, event);
+}
+
+/**
+ * @brief Updates the row of a user, changes to its shared files alone leave it as it is.
+ *
+ * @param user The user as announced now
+ * @param changedFields BroadcastDiscoveryService::PeerField bits of what changed
+ */
+void UserListModel::onPeerChanged(const LANDropUser &user, int changedFields)
+{
+    if (changedFields == BroadcastDiscoveryService::SharedFilesField && rows.contains(user.ipAddress) &&
+        !pending.contains(user.ipAddress))
+        return;
+    onPeerAdded(user);
+}
+
+/**
+ * @param ipAddress Address the user was discovered at
+ */
+void UserListModel::onPeerRemoved(const QString &ipAddress)
+{
+    Pending event;
+    event.removed = true;
+    schedule(ipAddress, event);
+}
+
+/**
+ * @brief Displayed fields of a user, its shared files are left out.
+ */
+UserListModel::Entry UserListModel::entryOf(const LANDropUser &user)
+{
+    Entry entry;
+    entry.ipAddress = user.ipAddress;
+    entry.hostname = user.hostname;
+    entry.transferPort = user.transferPort;
+    entry.version = user.version;
+    entry.addresses = user.addresses;
+    return entry;
+}
+
+/**
+ * @brief Keeps the latest event of a user and starts the refresh timer if it is idle.
+ */
+void UserListModel::schedule(const QString &ipAddress, const Pending &event)
+{
+    auto it = pending.find(ipAddress);
+    if (it == pending.end())
+    {
+        pending.insert(ipAddress, event);
+        pendingOrder.append(ipAddress);
+    }
+    else
+    {
+        *it = event;
+    }
+
+    // The first event of a burst starts the timer, later ones do not push it back
+    if (!refreshTimer->isActive())
+        refreshTimer->start();
+}
+
+/**
+ * @brief Renumbers the rows from @p from on after rows were removed.
+ */
+void UserListModel::reindex(int from)
+{
+    for (int row = from; row < entries.size(); ++row)
+        rows.insert(entries.at(row).ipAddress, row);
+}
@@ -0,0 +1,113 @@
+/**
+ * @file userlistmodel.h
+ * @brief List model of the LANDrop users discovered on the network
+ */
+
+#ifndef USERLISTMODEL_H
+#define USERLISTMODEL_H
+
+#include <QAbstractListModel>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+#include "../services/broadcastdiscoveryservice.h"
+
+/**
+ * @class UserListModel
+ * @brief Holds one row per discovered user, fed by the peer events of the discovery service.
+ *
+ * Discovery reports a peer on every datagram it changes, far more often
+ * than a list needs redrawing. Events are collected and applied together
+ * at most every REFRESH_INTERVAL_MS: removed rows are removed, changed rows
+ * signal dataChanged() and new rows are appended, so views keep their
+ * selection and scroll position. A row holds only what is displayed and
+ * needed to connect, never the user's shared files.
+ */
+class UserListModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    /** Data roles of a row, Qt::DisplayRole is "hostname [address]". */
+    enum Role
+    {
+        IpAddressRole = Qt::UserRole + 1,
+        HostnameRole,
+        PortRole,
+        VersionRole
+    };
+
+    /** Shortest interval between two refreshes of the rows. */
+    static const int REFRESH_INTERVAL_MS = 250;
+
+    explicit UserListModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    /** @brief User of a row, without its shared files. */
+    LANDropUser user(int row) const;
+
+    /** @brief Replaces every row at once, dropping the events not applied yet. */
+    void setUsers(const QList<LANDropUser> &users);
+
+    /** @brief Applies the events collected so far without waiting for the timer. */
+    void flush();
+
+public slots:
+    void onPeerAdded(const LANDropUser &user);
+    void onPeerChanged(const LANDropUser &user, int changedFields);
+    void onPeerRemoved(const QString &ipAddress);
+
+signals:
+    /** @brief Emitted after pending events were applied, with the number of rows. */
+    void refreshed(int userCount);
+
+private:
+    /**
+     * @brief Displayed state of one user.
+     */
+    struct Entry
+    {
+        QString ipAddress;
+        QString hostname;
+        quint16 transferPort = 0;
+        QString version;
+        QStringList addresses;
+
+        bool operator==(const Entry &other) const
+        {
+            return ipAddress == other.ipAddress && hostname == other.hostname &&
+                   transferPort == other.transferPort && version == other.version && addresses == other.addresses;
+        }
+    };
+
+    /**
+     * @brief Latest event of one user since the last refresh.
+     */
+    struct Pending
+    {
+        Entry entry;
+        bool removed = false;
+    };
+
+    static Entry entryOf(const LANDropUser &user);
+    void schedule(const QString &ipAddress, const Pending &pending);
+    void reindex(int from);
+
+    /** Rows in display order */
+    QList<Entry> entries;
+
+    /** Row of each user, by IP address */
+    QHash<QString, int> rows;
+
+    /** Events not applied yet, by IP address, and the order users were added in */
+    QHash<QString, Pending> pending;
+    QStringList pendingOrder;
+
+    QTimer *refreshTimer;
+};
+
+#endif // USERLISTMODEL_H
@@ -6,7 +6,6 @@
 #include "../config/config.h"
 #include "../services/sharedfilemanager.h"
 #include <QVBoxLayout>
-#include <QListWidgetItem>
 
 /**
  * @brief Constructs the UserListWidget and initializes the user discovery service.
@@ -18,15 +17,20 @@
  * @param parent Parent widget for this widget
  */
 UserListWidget::UserListWidget(BroadcastDiscoveryService *discovery, QWidget *parent)
-    : QWidget(parent), discoveryService(discovery)
+    : QWidget(parent), model(new UserListModel(this)), discoveryService(discovery)
 {
     setupUI();
 
-    // Connect to user list updates
-    connect(discoveryService, &BroadcastDiscoveryService::userListUpdated,
-            this, &UserListWidget::onUserListUpdated);
+    // Connect peer updates to the model, which applies them in batches
+    connect(discoveryService, &BroadcastDiscoveryService::peerAdded,
+            model, &UserListModel::onPeerAdded);
+    connect(discoveryService, &BroadcastDiscoveryService::peerChanged,
+            model, &UserListModel::onPeerChanged);
+    connect(discoveryService, &BroadcastDiscoveryService::peerRemoved,
+            model, &UserListModel::onPeerRemoved);
+    connect(model, &UserListModel::refreshed, this, &UserListWidget::onUsersRefreshed);
 
-    connect(listWidget, &QListWidget::itemClicked, this, &UserListWidget::onItemClicked);
+    connect(listView, &QListView::clicked, this, &UserListWidget::onItemClicked);
     connect(refreshButton, &QPushButton::clicked, this, &UserListWidget::triggerUIUpdate);
 
     // Initial update
@@ -55,7 +59,11 @@ void UserListWidget::setupUI()
     QLabel *title = new QLabel("Available Users", this);
     title->setStyleSheet("font-weight: bold; font-size: 16px;");
 
-    listWidget = new QListWidget(this);
+    listView = new QListView(this);
+    listView->setModel(model);
+    listView->setSelectionMode(QAbstractItemView::SingleSelection);
+    listView->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    listView->setUniformItemSizes(true);
     refreshButton = new QPushButton("Refresh", this);
     refreshButton->setStyleSheet(Config::getButtonStyleSheet());
 
@@ -65,68 +73,44 @@ void UserListWidget::setupUI()
 
     layout->addWidget(title);
     layout->addWidget(statusLabel);
-    layout->addWidget(listWidget);
+    layout->addWidget(listView);
     layout->addWidget(refreshButton);
 }
 
 /**
- * @brief Updates the user list display with the latest discovered users.
+ * @brief Updates the status once the model applied a batch of peer changes.
  *
- * Completely rebuilds the list widget with the provided users. Each list item
- * displays the hostname and IP address, while storing the complete LANDropUser
- * object in the item's user data for later access.
- *
- * @param users Complete list of currently discovered LANDrop users
+ * @param userCount Number of users listed now
  */
-void UserListWidget::onUserListUpdated(const QList<LANDropUser> &users)
+void UserListWidget::onUsersRefreshed(int userCount)
 {
-    // qDebug() << "UserListWidget: list contains" << users.size() << "users";
-
-    listWidget->clear();
-
-    for (const LANDropUser &user : users)
-    {
-        QString displayText = QString("%1 [%2]").arg(user.hostname, user.ipAddress);
-        QListWidgetItem *item = new QListWidgetItem(displayText);
-
-        QVariant userData;
-        userData.setValue(user);
-        item->setData(Qt::UserRole, userData);
-
-        listWidget->addItem(item);
-    }
-
-    updateStatusLabel(users.size());
+    updateStatusLabel(userCount);
     setState(false);
 }
 
 /**
  * @brief Handles item click events in the user list.
  *
- * @param item The QListWidgetItem that was clicked
+ * @param index Index of the row that was clicked
  */
-void UserListWidget::onItemClicked(QListWidgetItem *item)
+void UserListWidget::onItemClicked(const QModelIndex &index)
 {
-    // Get complete user data
-    QVariant userData = item->data(Qt::UserRole);
-    LANDropUser user = userData.value<LANDropUser>();
-
     // Emit signal with user information
-    emit userSelected(user);
+    emit userSelected(model->user(index.row()));
 }
 
 /**
  * @brief Triggers a manual UI update to refresh the user list.
  *
- * Sets the state to discovering, updates the status label, and requests
- * an update from the discovery service.
+ * Sets the state to discovering, updates the status label, and shows the
+ * users currently known to the discovery service again.
  */
 void UserListWidget::triggerUIUpdate()
 {
     setState(true);
     statusLabel->setText("Refreshing user list...");
 
-    discoveryService->requestUserListUpdate();
+    model->setUsers(discoveryService->users());
 }
 
 /**
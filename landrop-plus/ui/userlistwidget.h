@@ -9,10 +9,10 @@
 #include <QWidget>
 #include <QVBoxLayout>
 #include <QLabel>
-#include <QListWidget>
-#include <QListWidgetItem>
+#include <QListView>
 #include <QPushButton>
 #include "../services/broadcastdiscoveryservice.h"
+#include "userlistmodel.h"
 
 /**
  * @class UserListWidget
@@ -21,7 +21,8 @@
  * This widget integrates with the BroadcastDiscoveryService to show available users
  * and allows selection for file transfers. It provides automatic refresh functionality
  * and manual refresh controls, displaying user information including hostnames,
- * IP addresses.
+ * IP addresses. Rows come from a UserListModel that applies the peer changes
+ * the discovery service reports at a bounded rate, so the selection survives.
  */
 class UserListWidget : public QWidget
 {
@@ -32,8 +33,8 @@ public:
     ~UserListWidget();
 
 private slots:
-    void onUserListUpdated(const QList<LANDropUser> &users);
-    void onItemClicked(QListWidgetItem *item);
+    void onUsersRefreshed(int userCount);
+    void onItemClicked(const QModelIndex &index);
 
 signals:
     /** Emitted when a user is selected */
@@ -45,8 +46,11 @@ private:
     void updateStatusLabel(int userCount);
     void triggerUIUpdate();
 
-    /** List widget displaying discovered users */
-    QListWidget *listWidget;
+    /** View displaying discovered users */
+    QListView *listView;
+
+    /** Rows of the discovered users */
+    UserListModel *model;
 
     /** Button to manually refresh the user list */
     QPushButton *refreshButton;
@@ -0,0 +1,99 @@
+/**
+ * @file test_daemon.cpp
+ * @brief Tests of the landropd daemon, run as its own process
+ *
+ * Test Coverage:
+ * - Transfers accepted unattended with --auto-accept all (loopback)
+ * - Transfer names leaving the received files folder refused (loopback)
+ */
+
+#include "../landrop-plus/network/protocol.h"
+#include <QtTest>
+#include <QDir>
+#include <QFile>
+#include <QProcess>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+
+class TestDaemon : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void test_refuses_unsafe_names_unattended();
+
+private:
+    static quint16 freePort();
+};
+
+/**
+ * @brief Port nothing listens on at the moment.
+ */
+quint16 TestDaemon::freePort()
+{
+    QTcpServer server;
+    if (!server.listen(QHostAddress::LocalHost, 0))
+        return 0;
+    quint16 port = server.serverPort();
+    server.close();
+    return port;
+}
+
+/**
+ * @brief Tests that landropd accepting everything still refuses a header climbing out of its folder
+ */
+void TestDaemon::test_refuses_unsafe_names_unattended()
+{
+    QTemporaryDir rootDir;
+    QVERIFY(rootDir.isValid());
+    QString receivePath = rootDir.filePath("received");
+    quint16 port = freePort();
+    QVERIFY(port != 0);
+
+    QProcess daemon;
+    daemon.setProcessChannelMode(QProcess::MergedChannels);
+    daemon.start(LANDROPD_PATH, {"--settings", rootDir.filePath("settings.json"), "--receive-dir", receivePath,
+                                 "--share-dir", rootDir.filePath("shared"), "--port", QString::number(port),
+                                 "--auto-accept", "all", "--no-discovery"});
+    QVERIFY(daemon.waitForStarted(5000));
+    QByteArray output;
+    QTRY_VERIFY_WITH_TIMEOUT((output += daemon.readAll()).contains("Listening on port"), 10000);
+
+    // Refused before it is accepted: the connection closes unanswered
+    QTcpSocket escaping;
+    escaping.connectToHost(QHostAddress::LocalHost, port);
+    QVERIFY(escaping.waitForConnected(3000));
+    Protocol::TransferHeader header;
+    header.fileName = "../escaped.txt";
+    header.fileSize = 4;
+    escaping.write(header.encode());
+    escaping.write("data");
+    QTRY_COMPARE_WITH_TIMEOUT(escaping.state(), QAbstractSocket::UnconnectedState, 5000);
+    QVERIFY(!escaping.canReadLine());
+
+    // A plain name is still accepted without asking
+    QTcpSocket plain;
+    plain.connectToHost(QHostAddress::LocalHost, port);
+    QVERIFY(plain.waitForConnected(3000));
+    header.fileName = "kept.txt";
+    plain.write(header.encode());
+    QTRY_VERIFY_WITH_TIMEOUT(plain.canReadLine(), 5000);
+    Protocol::TransferReply reply;
+    QVERIFY(Protocol::TransferReply::decode(plain.readLine(), &reply));
+    QVERIFY(reply.accepted);
+    plain.write("data");
+    plain.flush();
+    QTRY_COMPARE_WITH_TIMEOUT(QFileInfo(QDir(receivePath).filePath("kept.txt")).size(), qint64(4), 10000);
+
+    QVERIFY(!QFile::exists(rootDir.filePath("escaped.txt")));
+    QCOMPARE(daemon.state(), QProcess::Running);
+
+    daemon.terminate();
+    if (!daemon.waitForFinished(5000))
+        daemon.kill();
+}
+
+QTEST_MAIN(TestDaemon)
+
+#include "test_daemon.moc"
@@ -9,14 +9,30 @@
  * - Service stability and crash prevention
  * - JSON message format validation (mock data)
  * - LANDropUser struct methods (hasSharedFiles, sharedFileCount)
+ * - Binary discovery datagram encoding
+ * - Heartbeats keeping peers, and their expiry
+ * - peerAdded, peerChanged with the fields changed, and peerRemoved only for real changes
+ * - Broadcast intervals, jitter, bursts and answers with a test clock
+ * - DNS-SD announcement records
+ * - Registry answers and peer lists taken from the configured servers only
  */
 
 #include "../landrop-plus/services/broadcastdiscoveryservice.h"
 #include "../landrop-plus/services/sharedfilemanager.h"
+#include "../landrop-plus/network/discoverymessage.h"
+#include "../landrop-plus/services/mdnsdiscoverybackend.h"
+#include "../landrop-plus/services/registrydiscoverybackend.h"
+#include "../landrop-plus/config/config.h"
+#include "../landrop-plus/services/catalogsearch.h"
+#include "../landrop-plus/services/discoverypacing.h"
 #include <QtTest>
 #include <QSignalSpy>
 #include <QJsonObject>
+#include <QJsonArray>
+#include <QJsonDocument>
 #include <QCoreApplication>
+#include <QUdpSocket>
+#include <QElapsedTimer>
 
 class TestBroadcastDiscoveryService : public QObject
 {
@@ -30,6 +46,15 @@ private slots:
     void test_discovery_message_format();
     void test_discovery_does_not_crash();
     void test_LANDropUser_struct_methods();
+    void test_parse_stats_skip_rate();
+    void test_binary_message_round_trip();
+    void test_heartbeats_keep_and_expire_peers();
+    void test_peer_changes_are_reported_once();
+    void test_broadcast_pacing();
+    void test_response_suppression_and_quiet_peers();
+    void test_mdns_announcement_round_trip();
+    void test_catalog_search_index();
+    void test_registry_lists_peers_of_other_subnets();
 
 private:
     QJsonObject createTestDiscoveryMessage(const QString &hostname, const QString &ip, quint16 port);
@@ -63,6 +88,13 @@ void TestBroadcastDiscoveryService::test_startDiscovery()
     BroadcastDiscoveryService discovery;
     
     QVERIFY(true); // verify no crash in lifecycle
+
+    // Started later when asked to
+    BroadcastDiscoveryService deferred(nullptr, false);
+    QVERIFY(!deferred.isDiscovering());
+    QSignalSpy startedSpy(&deferred, &BroadcastDiscoveryService::discoveryStarted);
+    deferred.startDiscovery();
+    QCOMPARE(startedSpy.count(), deferred.isDiscovering() ? 1 : 0);
 }
 
 /**
@@ -196,6 +228,660 @@ void TestBroadcastDiscoveryService::test_LANDropUser_struct_methods()
     QCOMPARE(userWithFiles.version, "V1");
 }
 
+/**
+ * @brief Tests the share of repeated datagrams reported by ParseStats
+ */
+void TestBroadcastDiscoveryService::test_parse_stats_skip_rate()
+{
+    BroadcastDiscoveryService service;
+    QCOMPARE(service.parseStats().skipRate(), 0.0);
+
+    BroadcastDiscoveryService::ParseStats stats;
+    stats.parsed = 1;
+    stats.skipped = 3;
+    QCOMPARE(stats.skipRate(), 0.75);
+
+    service.stopDiscovery();
+}
+
+/**
+ * @brief Tests encoding and decoding of binary discovery datagrams
+ */
+void TestBroadcastDiscoveryService::test_binary_message_round_trip()
+{
+    DiscoveryMessage::Announcement sent;
+    sent.type = DiscoveryMessage::Response;
+    sent.discoveryPort = 12346;
+    sent.transferPort = 5555;
+    sent.transferVersion = 2;
+    sent.catalogVersion = 0x0123456789abcdefULL;
+    sent.hostname = QString::fromUtf8("Poste-\xc3\xa9t\xc3\xa9|1");
+    sent.options.insert("os", "linux");
+
+    QByteArray datagram = sent.encode();
+    QVERIFY(DiscoveryMessage::isBinary(datagram));
+
+    DiscoveryMessage::Announcement received;
+    QVERIFY(DiscoveryMessage::Announcement::decode(datagram, &received));
+    QCOMPARE(received.type, DiscoveryMessage::Response);
+    QCOMPARE(received.discoveryPort, quint16(12346));
+    QCOMPARE(received.transferPort, quint16(5555));
+    QCOMPARE(received.transferVersion, quint8(2));
+    QCOMPARE(received.catalogVersion, sent.catalogVersion);
+    QCOMPARE(received.hostname, sent.hostname);
+    QCOMPARE(received.options.value("os"), QByteArray("linux"));
+
+    // Truncated datagrams and text messages are rejected
+    QVERIFY(!DiscoveryMessage::Announcement::decode(datagram.left(datagram.size() - 1), &received));
+    QVERIFY(!DiscoveryMessage::Announcement::decode("LANDROP_DISCOVERY_V1|12346|5555|host|C0|P2", &received));
+
+    // Heartbeats are told apart from announcements
+    DiscoveryMessage::HeartbeatMessage beat;
+    beat.sequence = 0xfffffffeu;
+    beat.interval = 1000;
+    beat.catalogVersion = sent.catalogVersion;
+    QByteArray beatDatagram = beat.encode();
+    QCOMPARE(beatDatagram.size(), DiscoveryMessage::HEARTBEAT_SIZE);
+
+    DiscoveryMessage::HeartbeatMessage receivedBeat;
+    QVERIFY(DiscoveryMessage::HeartbeatMessage::decode(beatDatagram, &receivedBeat));
+    QCOMPARE(receivedBeat.sequence, beat.sequence);
+    QCOMPARE(receivedBeat.interval, beat.interval);
+    QCOMPARE(receivedBeat.catalogVersion, beat.catalogVersion);
+    QVERIFY(!DiscoveryMessage::Announcement::decode(beatDatagram, &received));
+    QVERIFY(!DiscoveryMessage::HeartbeatMessage::decode(datagram, &receivedBeat));
+    QVERIFY(!DiscoveryMessage::HeartbeatMessage::decode(beatDatagram.left(beatDatagram.size() - 1), &receivedBeat));
+}
+
+/**
+ * @brief Tests that repeated announcements are silent and each change is reported once with its fields
+ */
+void TestBroadcastDiscoveryService::test_peer_changes_are_reported_once()
+{
+    BroadcastDiscoveryService service;
+    if (!service.isDiscovering())
+        QSKIP("Discovery port not available");
+
+    QSignalSpy added(&service, &BroadcastDiscoveryService::peerAdded);
+    QSignalSpy changed(&service, &BroadcastDiscoveryService::peerChanged);
+    QSignalSpy removed(&service, &BroadcastDiscoveryService::peerRemoved);
+
+    QUdpSocket peer;
+    QVERIFY(peer.bind(QHostAddress(QHostAddress::LocalHost), 0));
+    QHostAddress serviceAddress(QHostAddress::LocalHost);
+
+    DiscoveryMessage::Announcement announcement;
+    announcement.type = DiscoveryMessage::Response;
+    announcement.discoveryPort = peer.localPort();
+    announcement.transferPort = 5555;
+    announcement.transferVersion = 2;
+    announcement.hostname = "changing-peer";
+    peer.writeDatagram(announcement.encode(), serviceAddress, service.discoveryPort());
+    QTRY_COMPARE(added.count(), 1);
+    QCOMPARE(added.at(0).at(0).value<LANDropUser>().ipAddress, QString("127.0.0.1"));
+
+    // The same announcement again changes nothing
+    peer.writeDatagram(announcement.encode(), serviceAddress, service.discoveryPort());
+    peer.writeDatagram(announcement.encode(), serviceAddress, service.discoveryPort());
+    QTest::qWait(100);
+    QCOMPARE(added.count(), 1);
+    QCOMPARE(changed.count(), 0);
+
+    // A new transfer port is one change of that field
+    announcement.transferPort = 5560;
+    peer.writeDatagram(announcement.encode(), serviceAddress, service.discoveryPort());
+    peer.writeDatagram(announcement.encode(), serviceAddress, service.discoveryPort());
+    QTRY_COMPARE(changed.count(), 1);
+    QTest::qWait(100);
+    QCOMPARE(changed.count(), 1);
+    QCOMPARE(changed.at(0).at(1).toInt(), int(BroadcastDiscoveryService::PortField));
+    QCOMPARE(changed.at(0).at(0).value<LANDropUser>().transferPort, quint16(5560));
+
+    // Older peers list their files, versioned by the listing's hash
+    auto textResponse = [&peer](const QString &hostname, const QJsonArray &files)
+    {
+        return QString("LANDROP_RESPONSE_V1|%1|5560|%2|%3|P2")
+            .arg(peer.localPort())
+            .arg(hostname, QString::fromUtf8(QJsonDocument(files).toJson(QJsonDocument::Compact)))
+            .toUtf8();
+    };
+    QJsonObject file;
+    file["name"] = "a.txt";
+    file["path"] = "a.txt";
+    file["size"] = "1";
+    QJsonArray files = {file};
+    peer.writeDatagram(textResponse("changing-peer", files), serviceAddress, service.discoveryPort());
+    peer.writeDatagram(textResponse("changing-peer", files), serviceAddress, service.discoveryPort());
+    QTRY_COMPARE(changed.count(), 2);
+    QTest::qWait(100);
+    QCOMPARE(changed.count(), 2);
+    QCOMPARE(changed.at(1).at(1).toInt(), int(BroadcastDiscoveryService::SharedFilesField));
+    LANDropUser listed = changed.at(1).at(0).value<LANDropUser>();
+    QCOMPARE(listed.sharedFileCount(), 1);
+    QVERIFY(listed.catalogVersion != 0);
+
+    // Another catalog version, then another hostname, each reported alone
+    file["name"] = "b.txt";
+    file["path"] = "b.txt";
+    files.append(file);
+    peer.writeDatagram(textResponse("changing-peer", files), serviceAddress, service.discoveryPort());
+    QTRY_COMPARE(changed.count(), 3);
+    QCOMPARE(changed.at(2).at(1).toInt(), int(BroadcastDiscoveryService::SharedFilesField));
+    QVERIFY(changed.at(2).at(0).value<LANDropUser>().catalogVersion != listed.catalogVersion);
+    peer.writeDatagram(textResponse("renamed-peer", files), serviceAddress, service.discoveryPort());
+    QTRY_COMPARE(changed.count(), 4);
+    QCOMPARE(changed.at(3).at(1).toInt(), int(BroadcastDiscoveryService::HostnameField));
+    QTest::qWait(100);
+    QCOMPARE(changed.count(), 4);
+    QCOMPARE(added.count(), 1);
+    QCOMPARE(removed.count(), 0);
+
+    // A host heard from another address moved: removed there, added here
+    QUdpSocket moved;
+    if (!moved.bind(QHostAddress("127.0.0.2"), 0))
+        QSKIP("No second loopback address");
+    announcement.hostname = "renamed-peer";
+    announcement.discoveryPort = moved.localPort();
+    moved.writeDatagram(announcement.encode(), serviceAddress, service.discoveryPort());
+    QTRY_COMPARE(removed.count(), 1);
+    QCOMPARE(removed.at(0).at(0).toString(), QString("127.0.0.1"));
+    QTRY_COMPARE(added.count(), 2);
+    QCOMPARE(added.at(1).at(0).value<LANDropUser>().ipAddress, QString("127.0.0.2"));
+    QCOMPARE(changed.count(), 4);
+}
+
+/**
+ * @brief Tests that heartbeats keep a peer known and that it expires 2.5 intervals after the last one
+ */
+void TestBroadcastDiscoveryService::test_heartbeats_keep_and_expire_peers()
+{
+    BroadcastDiscoveryService service;
+    if (!service.isDiscovering())
+        QSKIP("Discovery port not available");
+
+    QSignalSpy added(&service, &BroadcastDiscoveryService::peerAdded);
+    QSignalSpy removed(&service, &BroadcastDiscoveryService::peerRemoved);
+
+    QUdpSocket peer;
+    QVERIFY(peer.bind(QHostAddress(QHostAddress::LocalHost), 0));
+    QHostAddress serviceAddress(QHostAddress::LocalHost);
+
+    DiscoveryMessage::Announcement announcement;
+    announcement.type = DiscoveryMessage::Response;
+    announcement.discoveryPort = peer.localPort();
+    announcement.transferPort = 5555;
+    announcement.transferVersion = 2;
+    announcement.hostname = "heartbeat-peer";
+    peer.writeDatagram(announcement.encode(), serviceAddress, service.discoveryPort());
+    QTRY_COMPARE(added.count(), 1);
+
+    // Off the discovery port, the peer is sent unicast heartbeats
+    bool heard = false;
+    QElapsedTimer waited;
+    waited.start();
+    while (!heard && waited.elapsed() < 5000)
+    {
+        while (peer.hasPendingDatagrams())
+        {
+            QByteArray datagram(int(peer.pendingDatagramSize()), Qt::Uninitialized);
+            datagram.resize(int(peer.readDatagram(datagram.data(), datagram.size())));
+            DiscoveryMessage::HeartbeatMessage beat;
+            if (DiscoveryMessage::HeartbeatMessage::decode(datagram, &beat))
+            {
+                QVERIFY(beat.interval >= 1000);
+                heard = true;
+            }
+        }
+        QTest::qWait(10);
+    }
+    QVERIFY(heard);
+
+    // Heartbeats every interval keep the peer past the announcement timeout it would have otherwise
+    DiscoveryMessage::HeartbeatMessage beat;
+    beat.interval = 200;
+    QElapsedTimer lastBeat;
+    for (int i = 0; i < 15; ++i)
+    {
+        ++beat.sequence;
+        peer.writeDatagram(beat.encode(), serviceAddress, service.discoveryPort());
+        lastBeat.start();
+        QTest::qWait(100);
+    }
+    QCOMPARE(removed.count(), 0);
+    QCOMPARE(service.users().size(), 1);
+
+    // Not before 2.5 intervals after the last heartbeat, and within our next heartbeat
+    QTRY_COMPARE_WITH_TIMEOUT(removed.count(), 1, 3000);
+    QVERIFY(lastBeat.elapsed() >= 500);
+    QCOMPARE(removed.at(0).at(0).toString(), QString("127.0.0.1"));
+    QVERIFY(service.users().isEmpty());
+}
+
+/**
+ * @brief Tests the growth of the broadcast interval with the peers, its jitter and bursts
+ */
+void TestBroadcastDiscoveryService::test_broadcast_pacing()
+{
+    DiscoveryPacing pacing(5000);
+    qint64 clock = 1000000;
+    pacing.setClock([&clock]() { return clock; });
+    QCOMPARE(pacing.now(), qint64(1000000));
+
+    // One more discovery interval per PEERS_PER_INTERVAL peers, up to MAX_INTERVAL_MS
+    QCOMPARE(pacing.broadcastInterval(0, false), 5000);
+    QCOMPARE(pacing.broadcastInterval(DiscoveryPacing::PEERS_PER_INTERVAL - 1, false), 5000);
+    QCOMPARE(pacing.broadcastInterval(DiscoveryPacing::PEERS_PER_INTERVAL, false), 10000);
+    QCOMPARE(pacing.broadcastInterval(DiscoveryPacing::PEERS_PER_INTERVAL * 2, false), 15000);
+    QCOMPARE(pacing.broadcastInterval(100000, false), int(DiscoveryPacing::MAX_INTERVAL_MS));
+
+    // Peers all sending heartbeats leave broadcasts to finding new ones
+    QCOMPARE(pacing.broadcastInterval(3, true), int(DiscoveryPacing::MAX_INTERVAL_MS));
+    QCOMPARE(pacing.broadcastInterval(0, true), 5000);
+
+    // Spread by up to JITTER_PERCENT either way
+    int lowestAsked = 0;
+    int highestAsked = 0;
+    int pick = 0;
+    pacing.setRandom([&](int lowest, int highest)
+                     {
+        lowestAsked = lowest;
+        highestAsked = highest;
+        return pick < 0 ? lowest : (pick > 0 ? highest : 0); });
+    QCOMPARE(pacing.nextBroadcastDelay(0, false), 5000);
+    QCOMPARE(lowestAsked, -1250);
+    QCOMPARE(highestAsked, 1250);
+    pick = -1;
+    QCOMPARE(pacing.nextBroadcastDelay(0, false), 3750);
+    pick = 1;
+    QCOMPARE(pacing.nextBroadcastDelay(DiscoveryPacing::PEERS_PER_INTERVAL, false), 12500);
+
+    // A source out of range is held to the spread
+    pacing.setRandom([](int, int) { return 1000000; });
+    QCOMPARE(pacing.nextBroadcastDelay(0, false), 6250);
+
+    pacing.setRandom(DiscoveryPacing::Random());
+    for (int i = 0; i < 100; ++i)
+    {
+        int delay = pacing.nextBroadcastDelay(0, false);
+        QVERIFY(delay >= 3750 && delay <= 6250);
+    }
+
+    // A burst broadcasts BURST_COUNT times BURST_INTERVAL_MS apart, and is not restarted meanwhile
+    pick = 0;
+    pacing.setRandom([&](int lowest, int highest)
+                     {
+        lowestAsked = lowest;
+        highestAsked = highest;
+        return 0; });
+    QVERIFY(pacing.startBurst());
+    QCOMPARE(pacing.burstLeft(), int(DiscoveryPacing::BURST_COUNT));
+    QVERIFY(!pacing.startBurst());
+    for (int i = 0; i < DiscoveryPacing::BURST_COUNT; ++i)
+    {
+        QCOMPARE(pacing.nextBroadcastDelay(100, false), int(DiscoveryPacing::BURST_INTERVAL_MS));
+        QCOMPARE(highestAsked, DiscoveryPacing::BURST_INTERVAL_MS * DiscoveryPacing::JITTER_PERCENT / 100);
+        pacing.broadcastSent();
+    }
+    QCOMPARE(pacing.burstLeft(), 0);
+    QCOMPARE(pacing.nextBroadcastDelay(100, false), 25000);
+    pacing.broadcastSent();
+    QCOMPARE(pacing.burstLeft(), 0);
+
+    QVERIFY(pacing.startBurst());
+    pacing.stopBurst();
+    QCOMPARE(pacing.burstLeft(), 0);
+}
+
+/**
+ * @brief Tests that known peers are answered once per interval, and when peers go quiet and expire
+ */
+void TestBroadcastDiscoveryService::test_response_suppression_and_quiet_peers()
+{
+    DiscoveryPacing pacing(5000);
+    qint64 clock = 1000000;
+    pacing.setClock([&clock]() { return clock; });
+    const QString peer("10.0.0.2");
+
+    // New peers are always answered, known ones once per broadcast interval
+    QVERIFY(pacing.shouldRespondTo(peer, false, 5000));
+    QVERIFY(pacing.shouldRespondTo(peer, false, 5000));
+    QVERIFY(!pacing.shouldRespondTo(peer, true, 5000));
+    clock += 4999;
+    QVERIFY(!pacing.shouldRespondTo(peer, true, 5000));
+    clock += 1;
+    QVERIFY(pacing.shouldRespondTo(peer, true, 5000));
+    QVERIFY(!pacing.shouldRespondTo(peer, true, 5000));
+    QVERIFY(pacing.shouldRespondTo("10.0.0.3", true, 5000));
+    pacing.forget(peer);
+    QVERIFY(pacing.shouldRespondTo(peer, true, 5000));
+
+    // Quiet after two thirds of the timeout, once until heard again, then expired
+    pacing.noteHeard(peer);
+    QCOMPARE(pacing.peerTimeout(peer), qint64(DiscoveryPacing::USER_TIMEOUT_MS));
+    clock += 10000;
+    QVERIFY(!pacing.wentQuiet(peer));
+    QVERIFY(!pacing.hasExpired(peer));
+    clock += 1;
+    QVERIFY(pacing.wentQuiet(peer));
+    QVERIFY(!pacing.wentQuiet(peer));
+    clock += 4999;
+    QVERIFY(!pacing.hasExpired(peer));
+    clock += 1;
+    QVERIFY(pacing.hasExpired(peer));
+
+    // A heartbeat keeps the peer without changing its announcement interval
+    pacing.noteAlive(peer);
+    QVERIFY(!pacing.hasExpired(peer));
+    QCOMPARE(pacing.peerTimeout(peer), qint64(DiscoveryPacing::USER_TIMEOUT_MS));
+    clock += 10001;
+    QVERIFY(pacing.wentQuiet(peer));
+
+    // Peers announcing less often are given three of their intervals
+    const QString slow("10.0.0.4");
+    pacing.noteHeard(slow);
+    clock += 20000;
+    pacing.noteHeard(slow);
+    QCOMPARE(pacing.peerTimeout(slow), qint64(60000));
+    clock += 40000;
+    QVERIFY(!pacing.wentQuiet(slow));
+    clock += 1;
+    QVERIFY(pacing.wentQuiet(slow));
+    clock += 19999;
+    QVERIFY(!pacing.hasExpired(slow));
+    clock += 1;
+    QVERIFY(pacing.hasExpired(slow));
+
+    // The smoothed interval follows a change slowly, and long gaps count as 2 * MAX_INTERVAL_MS
+    clock += 1000000;
+    pacing.noteHeard(slow);
+    QCOMPARE(pacing.peerTimeout(slow), qint64((20000 * 3 + DiscoveryPacing::MAX_INTERVAL_MS * 2) / 4 * 3));
+
+    pacing.clear();
+    QVERIFY(pacing.hasExpired(slow));
+    QCOMPARE(pacing.peerTimeout(slow), qint64(DiscoveryPacing::USER_TIMEOUT_MS));
+}
+
+/**
+ * @brief Tests that a DNS-SD announcement decodes to the announced peer
+ */
+void TestBroadcastDiscoveryService::test_mdns_announcement_round_trip()
+{
+    LANDropUser self("192.168.1.20", "office.pc", 5556, "2");
+    self.catalogVersion = 0xbeefULL;
+
+    Mdns::Message decoded;
+    QVERIFY(Mdns::Message::decode(MdnsDiscoveryBackend::announcement(self, 120).encode(), &decoded));
+    QVERIFY(decoded.response);
+    QCOMPARE(decoded.records.size(), 4);
+
+    QByteArray instance = MdnsDiscoveryBackend::instanceName(self.hostname);
+    QCOMPARE(instance, QByteArray("office-pc._landrop._tcp.local"));
+
+    quint16 port = 0;
+    QMap<QByteArray, QByteArray> txt;
+    QHostAddress address;
+    for (const Mdns::Record &record : decoded.records)
+    {
+        QCOMPARE(record.ttl, quint32(120));
+        if (record.type == Mdns::TYPE_PTR)
+            QCOMPARE(record.target, instance);
+        else if (record.type == Mdns::TYPE_SRV)
+            port = record.port;
+        else if (record.type == Mdns::TYPE_TXT)
+            txt = record.txt;
+        else if (record.type == Mdns::TYPE_A)
+            address = record.address;
+    }
+
+    LANDropUser peer;
+    QVERIFY(MdnsDiscoveryBackend::peerOf(instance, port, txt, address, &peer));
+    QCOMPARE(peer.ipAddress, self.ipAddress);
+    QCOMPARE(peer.hostname, self.hostname);
+    QCOMPARE(peer.transferPort, self.transferPort);
+    QCOMPARE(peer.version, self.version);
+    QCOMPARE(peer.catalogVersion, self.catalogVersion);
+
+    // A goodbye withdraws every record
+    QVERIFY(Mdns::Message::decode(MdnsDiscoveryBackend::announcement(self, 0).encode(), &decoded));
+    for (const Mdns::Record &record : decoded.records)
+        QCOMPARE(record.ttl, quint32(0));
+}
+
+/**
+ * @brief Tests that the catalog search finds files by prefix and trigram, filters them and follows changes
+ */
+void TestBroadcastDiscoveryService::test_catalog_search_index()
+{
+    auto entry = [](const QString &path, qint64 size)
+    {
+        QJsonObject fileInfo;
+        fileInfo["name"] = path.mid(path.lastIndexOf('/') + 1);
+        fileInfo["path"] = path;
+        fileInfo["size"] = QString::number(size);
+        fileInfo["type"] = "file";
+        return fileInfo;
+    };
+
+    QJsonArray first;
+    first.append(entry("Movies/Holiday 2024.mp4", 700 * 1024 * 1024));
+    first.append(entry("Movies/holiday notes.txt", 2048));
+    first.append(entry("Music/Summer/track01.flac", 30 * 1024 * 1024));
+    QJsonArray second;
+    second.append(entry("Backups/photos-holiday.zip", 1024 * 1024));
+
+    CatalogSearch index;
+    index.setCatalog("192.168.1.10", first);
+    index.setCatalog("192.168.1.11", second);
+    QCOMPARE(index.size(), 4);
+
+    // Names starting with the word come first, then paths containing it
+    CatalogSearch::Query query;
+    query.text = "HOLIDAY";
+    QList<CatalogSearch::Hit> hits = index.search(query);
+    QCOMPARE(hits.size(), 3);
+    QVERIFY(hits[0].name.startsWith("Holiday", Qt::CaseInsensitive));
+    QVERIFY(hits[1].name.startsWith("holiday", Qt::CaseInsensitive));
+    QCOMPARE(hits[2].peer, QString("192.168.1.11"));
+
+    // Every word must appear, short words only match name prefixes
+    query.text = "summer flac";
+    QCOMPARE(index.search(query).size(), 1);
+    query.text = "tr";
+    QCOMPARE(index.search(query).size(), 1);
+    query.text = "xyz";
+    QVERIFY(index.search(query).isEmpty());
+
+    // Size and type filters
+    query.text = "holiday";
+    query.minSize = 1024 * 1024;
+    QCOMPARE(index.search(query).size(), 2);
+    query.types = QStringList{".MP4"};
+    hits = index.search(query);
+    QCOMPARE(hits.size(), 1);
+    QCOMPARE(hits[0].path, QString("Movies/Holiday 2024.mp4"));
+
+    // Filters alone list every match
+    query = CatalogSearch::Query();
+    query.maxSize = 4096;
+    QCOMPARE(index.search(query).size(), 1);
+
+    // A changed catalog only moves what changed, a delta applies as sent
+    first.removeAt(1);
+    first.append(entry("Movies/Holiday 2025.mp4", 800 * 1024 * 1024));
+    index.setCatalog("192.168.1.10", first);
+    QCOMPARE(index.size(), 4);
+    query = CatalogSearch::Query();
+    query.text = "holiday 202";
+    QCOMPARE(index.search(query).size(), 2);
+
+    QJsonObject removed;
+    removed["path"] = "Movies/Holiday 2024.mp4";
+    removed["removed"] = true;
+    index.applyChanges("192.168.1.10", QJsonArray{removed, entry("Movies/notes.txt", 10)});
+    QCOMPARE(index.size(), 4);
+    hits = index.search(query);
+    QCOMPARE(hits.size(), 1);
+    QCOMPARE(hits[0].path, QString("Movies/Holiday 2025.mp4"));
+
+    // Removing peers compacts the postings without losing the others
+    index.removePeer("192.168.1.10");
+    QCOMPARE(index.size(), 1);
+    query.text = "holiday";
+    hits = index.search(query);
+    QCOMPARE(hits.size(), 1);
+    QCOMPARE(hits[0].peer, QString("192.168.1.11"));
+    index.removePeer("192.168.1.11");
+    QCOMPARE(index.size(), 0);
+    QVERIFY(index.search(query).isEmpty());
+}
+
+void TestBroadcastDiscoveryService::test_registry_lists_peers_of_other_subnets()
+{
+    // Lists too long for one datagram are split, every part decodes on its own
+    DiscoveryMessage::RegisteredPeers list;
+    for (int i = 0; i < 40; ++i)
+    {
+        LANDropUser user(QString("10.0.%1.7").arg(i), QString("host-%1").arg(i), 5556, "2");
+        user.catalogVersion = quint64(i) << 40;
+        list.peers.append({user.ipAddress, RegistryDiscoveryBackend::announcementOf(user, DiscoveryMessage::Response)});
+    }
+    QList<QByteArray> datagrams = list.encode(512);
+    QVERIFY(datagrams.size() > 1);
+    QList<DiscoveryMessage::RegisteredPeers::Peer> received;
+    for (const QByteArray &datagram : datagrams)
+    {
+        QVERIFY(datagram.size() <= 512);
+        DiscoveryMessage::RegisteredPeers part;
+        QVERIFY(DiscoveryMessage::RegisteredPeers::decode(datagram, &part));
+        received += part.peers;
+    }
+    QCOMPARE(received.size(), 40);
+    QCOMPARE(received[39].address, QString("10.0.39.7"));
+    QCOMPARE(received[39].announcement.catalogVersion, quint64(39) << 40);
+    QCOMPARE(DiscoveryMessage::RegisteredPeers().encode(512).size(), 1);
+    QVERIFY(!DiscoveryMessage::RegisteredPeers::decode(datagrams[0].left(datagrams[0].size() - 1), &list));
+
+    const bool enabled = Config::getRegistryEnabled();
+    const int registryPort = Config::getRegistryPort();
+    const QString registryServers = Config::getRegistryServers();
+
+    Config::getRegistryPort() = 12347;
+    Config::getRegistryServers() = "192.168.2.1, 10.1.0.1:4000,[fe80::1]:4001, fe80::2, nonsense, 10.1.0.2:0";
+    QList<QPair<QHostAddress, quint16>> servers = RegistryDiscoveryBackend::servers();
+    QCOMPARE(servers.size(), 4);
+    QCOMPARE(servers[0].second, quint16(12347));
+    QCOMPARE(servers[1].first, QHostAddress("10.1.0.1"));
+    QCOMPARE(servers[1].second, quint16(4000));
+    QCOMPARE(servers[2].first, QHostAddress("fe80::1"));
+    QCOMPARE(servers[2].second, quint16(4001));
+    QCOMPARE(servers[3].first, QHostAddress("fe80::2"));
+
+    // A rendezvous notes a registration and answers with itself and the peers registered before
+    QUdpSocket probe;
+    QVERIFY(probe.bind(QHostAddress(QHostAddress::LocalHost), 0));
+    QUdpSocket client;
+    QVERIFY(client.bind(QHostAddress(QHostAddress::LocalHost), 0));
+    Config::getRegistryEnabled() = true;
+    Config::getRegistryPort() = probe.localPort();
+    Config::getRegistryServers() = QString();
+    probe.close();
+
+    RegistryDiscoveryBackend registry;
+    QSignalSpy found(&registry, &DiscoveryBackend::peerFound);
+    LANDropUser self("192.168.1.20", "rendezvous", 5556, "2");
+    QVERIFY(registry.start(self));
+    QCOMPARE(registry.localPort(), quint16(Config::getRegistryPort()));
+
+    LANDropUser remote("10.0.0.9", "remote.pc", 5560, "2");
+    remote.catalogVersion = 77;
+    QByteArray registration = RegistryDiscoveryBackend::announcementOf(remote, DiscoveryMessage::Register).encode();
+    client.writeDatagram(registration, QHostAddress(QHostAddress::LocalHost), registry.localPort());
+
+    QTRY_COMPARE(found.count(), 1);
+    LANDropUser registered = found.at(0).at(0).value<LANDropUser>();
+    QCOMPARE(registered.ipAddress, QString("127.0.0.1"));
+    QCOMPARE(registered.hostname, remote.hostname);
+    QCOMPARE(registered.transferPort, remote.transferPort);
+    QCOMPARE(registered.catalogVersion, remote.catalogVersion);
+
+    bool answered = false;
+    bool listed = false;
+    QTRY_VERIFY(client.hasPendingDatagrams());
+    for (int attempt = 0; attempt < 50 && !(answered && listed); ++attempt)
+    {
+        while (client.hasPendingDatagrams())
+        {
+            QByteArray datagram = client.receiveDatagram().data();
+            DiscoveryMessage::Announcement announcement;
+            DiscoveryMessage::RegisteredPeers peers;
+            if (DiscoveryMessage::RegisteredPeers::decode(datagram, &peers))
+            {
+                // The registrant itself is never listed back
+                QVERIFY(peers.peers.isEmpty());
+                listed = true;
+            }
+            else if (DiscoveryMessage::Announcement::decode(datagram, &announcement))
+            {
+                QCOMPARE(announcement.type, DiscoveryMessage::Response);
+                QCOMPARE(announcement.hostname, self.hostname);
+                answered = true;
+            }
+        }
+        QTest::qWait(10);
+    }
+    QVERIFY(answered);
+    QVERIFY(listed);
+
+    // A new catalog version is reported again, the same one is not
+    remote.catalogVersion = 78;
+    client.writeDatagram(RegistryDiscoveryBackend::announcementOf(remote, DiscoveryMessage::Register).encode(),
+                         QHostAddress(QHostAddress::LocalHost), registry.localPort());
+    client.writeDatagram(RegistryDiscoveryBackend::announcementOf(remote, DiscoveryMessage::Register).encode(),
+                         QHostAddress(QHostAddress::LocalHost), registry.localPort());
+    QTRY_COMPARE(found.count(), 2);
+    QTest::qWait(50);
+    QCOMPARE(found.count(), 2);
+    QCOMPARE(found.at(1).at(0).value<LANDropUser>().catalogVersion, quint64(78));
+
+    registry.stop();
+    QCOMPARE(registry.localPort(), quint16(0));
+
+    // A registrant takes answers and lists from its servers only
+    QUdpSocket server;
+    QVERIFY(server.bind(QHostAddress(QHostAddress::LocalHost), 0));
+    QUdpSocket stranger;
+    QVERIFY(stranger.bind(QHostAddress(QHostAddress::LocalHost), 0));
+    Config::getRegistryEnabled() = false;
+    Config::getRegistryServers() = QString("127.0.0.1:%1").arg(server.localPort());
+    RegistryDiscoveryBackend registrant;
+    QSignalSpy relayed(&registrant, &DiscoveryBackend::peerFound);
+    QVERIFY(registrant.start(self));
+    QTRY_VERIFY(server.hasPendingDatagrams());
+    quint16 registrantPort = quint16(server.receiveDatagram().senderPort());
+    QCOMPARE(registrantPort, registrant.localPort());
+
+    DiscoveryMessage::RegisteredPeers forged;
+    forged.peers.append({QString("10.9.9.9"), RegistryDiscoveryBackend::announcementOf(remote, DiscoveryMessage::Response)});
+    QByteArray answer = RegistryDiscoveryBackend::announcementOf(remote, DiscoveryMessage::Response).encode();
+    stranger.writeDatagram(forged.encode(RegistryDiscoveryBackend::MAX_DATAGRAM).first(), QHostAddress(QHostAddress::LocalHost), registrantPort);
+    stranger.writeDatagram(answer, QHostAddress(QHostAddress::LocalHost), registrantPort);
+    QTest::qWait(100);
+    QCOMPARE(relayed.count(), 0);
+
+    server.writeDatagram(forged.encode(RegistryDiscoveryBackend::MAX_DATAGRAM).first(), QHostAddress(QHostAddress::LocalHost), registrantPort);
+    server.writeDatagram(answer, QHostAddress(QHostAddress::LocalHost), registrantPort);
+    QTRY_COMPARE(relayed.count(), 2);
+    QStringList addresses = {relayed.at(0).at(0).value<LANDropUser>().ipAddress,
+                             relayed.at(1).at(0).value<LANDropUser>().ipAddress};
+    addresses.sort();
+    QCOMPARE(addresses, QStringList({"10.9.9.9", "127.0.0.1"}));
+    registrant.stop();
+
+    Config::getRegistryEnabled() = enabled;
+    Config::getRegistryPort() = registryPort;
+    Config::getRegistryServers() = registryServers;
+}
+
 QTEST_MAIN(TestBroadcastDiscoveryService)
 
 #include "test_discoveryservice.moc"
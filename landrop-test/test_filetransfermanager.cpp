@@ -8,14 +8,36 @@
  * - Batch file sending method calls with LANDropUser data
  * - Signal spy configuration and monitoring
  * - Service integration without network dependencies
+ * - Transfer engine worker placement and cross-thread calls
+ * - Transfer scheduler limits, queue order and concurrency
+ * - Folder transfers: parallel tree walk and recreated tree
+ * - Connection pool: pre-warmed connection reuse and idle timeout
+ * - Progress aggregator: batched updates, rate and remaining time
+ * - Auto-accept policy of incoming transfers
+ * - Auto-accept rules by peer, size, file pattern and free space
+ * - Persistent history: paged reads, aggregates and recovery after a crash
  */
 
 #include "../landrop-plus/services/filetransfermanager.h"
 #include "../landrop-plus/services/broadcastdiscoveryservice.h"
+#include "../landrop-plus/services/transferengine.h"
+#include "../landrop-plus/services/directorywalker.h"
+#include "../landrop-plus/services/connectionpool.h"
+#include "../landrop-plus/services/progressaggregator.h"
+#include "../landrop-plus/ui/transferhistorymodel.h"
+#include "../landrop-plus/ui/userlistmodel.h"
+#include "../landrop-plus/services/historystore.h"
+#include "../landrop-plus/services/subscriptionmirror.h"
+#include "../landrop-plus/network/progresscounter.h"
+#include "../landrop-plus/config/config.h"
 #include <QtTest>
 #include <QSignalSpy>
 #include <QTemporaryDir>
 #include <QFile>
+#include <QThread>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QSet>
 
 class TestFileTransferManager : public QObject
 {
@@ -31,6 +53,20 @@ private slots:
     void test_downloadSharedFile_correct_params();
     void test_sendFilesToUsers();
     void test_signals_emitted();
+    void test_transfer_engine_workers();
+    void test_scheduler_limits_and_order();
+    void test_scheduler_concurrency();
+    void test_send_folder();
+    void test_connection_pool_prewarm();
+    void test_progress_aggregator_batches();
+    void test_history_model_rows();
+    void test_history_store_pages_and_recovers();
+    void test_auto_accept_policy();
+    void test_auto_accept_refuses_unsafe_names();
+    void test_auto_accept_rules();
+    void test_user_list_model_batches_peer_events();
+    void test_subscription_mirror_picks_new_and_changed_files();
+    void test_progress_counters_are_read_without_signals();
 
 private:
     void createTestFile(const QString &filePath, const QString &content = "test content");
@@ -182,6 +218,931 @@ void TestFileTransferManager::test_signals_emitted()
     QVERIFY(true); // verify no crash
 }
 
+/**
+ * @brief Tests that adopted objects run on distinct worker threads
+ */
+void TestFileTransferManager::test_transfer_engine_workers()
+{
+    TransferEngine engine(2);
+    QCOMPARE(engine.workerCount(), 2);
+
+    QObject *first = new QObject();
+    QObject *second = new QObject();
+    engine.adopt(first);
+    engine.adopt(second);
+
+    QVERIFY(first->thread() != QThread::currentThread());
+    QVERIFY(second->thread() != QThread::currentThread());
+    QVERIFY(first->thread() != second->thread());
+
+    // Blocking calls run in the object's own thread
+    QThread *ranOn = nullptr;
+    TransferEngine::call(first, [&ranOn]() { ranOn = QThread::currentThread(); });
+    QCOMPARE(ranOn, first->thread());
+
+    // Workers read the settings published when work was handed to them, never the GUI thread's copy
+    const int previousSlots = Config::getUploadSlots();
+    Config::getUploadSlots() = 7;
+    int seen = 0;
+    TransferEngine::call(first, [&seen]() { seen = Config::getUploadSlots(); });
+    QCOMPARE(seen, 7);
+
+    Config::getUploadSlots() = 9;
+    QMetaObject::invokeMethod(first, [&seen]() { seen = Config::getUploadSlots(); }, Qt::BlockingQueuedConnection);
+    QCOMPARE(seen, 7);
+    Config::publish();
+    QMetaObject::invokeMethod(first, [&seen]() { seen = Config::getUploadSlots(); }, Qt::BlockingQueuedConnection);
+    QCOMPARE(seen, 9);
+    Config::getUploadSlots() = previousSlots;
+    Config::publish();
+
+    engine.destroy(first);
+    engine.destroy(second);
+    engine.shutdown();
+    QCOMPARE(engine.workerCount(), 0);
+}
+
+/**
+ * @brief Tests that queued sessions wait for free slots, smallest first
+ */
+void TestFileTransferManager::test_scheduler_limits_and_order()
+{
+    Config::reset();
+    // One Sender per file, so every file is a transfer of its own
+    Config::getStripeCount() = 2;
+    Config::getStripeThreshold() = 1;
+    Config::getFanoutEnabled() = false;
+    Config::getMaxActiveTransfers() = 2;
+    Config::getMaxTransfersPerPeer() = 1;
+    Config::getSmallFilesFirst() = true;
+
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QStringList files;
+    for (int i = 0; i < 3; ++i)
+    {
+        QString path = tempDir.path() + QString("/file%1.txt").arg(i);
+        createTestFile(path, QString(300 - i * 100, 'x'));
+        files.append(path);
+    }
+
+    // Two peers that never answer, so started transfers keep their slot
+    QTcpServer first;
+    QTcpServer second;
+    QVERIFY(first.listen(QHostAddress("127.0.0.1")));
+    QVERIFY(second.listen(QHostAddress("127.0.0.2")));
+    QList<LANDropUser> users;
+    users.append(LANDropUser("127.0.0.1", "first", first.serverPort(), "1"));
+    users.append(LANDropUser("127.0.0.2", "second", second.serverPort(), "1"));
+
+    FileTransferManager manager;
+    QSignalSpy sessionSpy(&manager, &FileTransferManager::transferSessionCreated);
+    manager.sendFilesToUsers(files, users);
+
+    // Every session exists up front, only one transfer per peer runs
+    QCOMPARE(sessionSpy.count(), 6);
+    QCOMPARE(manager.getActiveTransferCount(), 2);
+    QCOMPARE(manager.getQueuedTransferCount(), 4);
+    for (const QList<QVariant> &arguments : sessionSpy)
+    {
+        TransferStatus status = manager.getSession(arguments.at(0).toInt()).status;
+        QCOMPARE(status, TransferStatus::WAITING);
+    }
+
+    QTRY_VERIFY_WITH_TIMEOUT(first.hasPendingConnections(), 5000);
+    QTcpSocket *socket = first.nextPendingConnection();
+    QTRY_VERIFY_WITH_TIMEOUT(socket->canReadLine(), 5000);
+    QVERIFY(socket->readLine().startsWith("file2.txt|"));
+    QVERIFY(!first.hasPendingConnections());
+
+    // Refusing the smallest file lets the next one to that peer start
+    socket->write("NO\n");
+    QTRY_VERIFY_WITH_TIMEOUT(first.hasPendingConnections(), 5000);
+    QTcpSocket *next = first.nextPendingConnection();
+    QTRY_VERIFY_WITH_TIMEOUT(next->canReadLine(), 5000);
+    QVERIFY(next->readLine().startsWith("file1.txt|"));
+    QCOMPARE(manager.getActiveTransferCount(), 2);
+    QCOMPARE(manager.getQueuedTransferCount(), 3);
+
+    // An interactive transfer takes a slot of its own instead of waiting
+    QString urgent = tempDir.path() + "/urgent.txt";
+    createTestFile(urgent, "now");
+    manager.sendFilesToUsers({urgent}, {users.first()}, TransferPriority::INTERACTIVE);
+    QCOMPARE(manager.getActiveTransferCount(), 3);
+    QCOMPARE(manager.getQueuedTransferCount(), 3);
+    QTRY_VERIFY_WITH_TIMEOUT(first.hasPendingConnections(), 5000);
+    QTcpSocket *interactive = first.nextPendingConnection();
+    QTRY_VERIFY_WITH_TIMEOUT(interactive->canReadLine(), 5000);
+    QVERIFY(interactive->readLine().startsWith("urgent.txt|"));
+
+    Config::reset();
+}
+
+/**
+ * @brief Tests that many transfers to a receiver all arrive, in request order and never above the limit
+ *
+ * A transfer only starts among the first finished + limit ones requested,
+ * and the running count stays within the limit while every file arrives.
+ */
+void TestFileTransferManager::test_scheduler_concurrency()
+{
+    QTemporaryDir sourceDir;
+    QVERIFY(sourceDir.isValid());
+    const int fileCount = 16;
+    const int fileSize = 64 * 1024;
+    QStringList files;
+    for (int i = 0; i < fileCount; ++i)
+    {
+        QString path = sourceDir.path() + QString("/file%1.bin").arg(i);
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(QByteArray(fileSize, char('a' + i % 26)));
+        file.close();
+        files.append(path);
+    }
+
+    for (int limit : {0, 3})
+    {
+        Config::reset();
+        QTemporaryDir targetDir;
+        QVERIFY(targetDir.isValid());
+        Config::getReceivedFilesPath() = targetDir.path();
+        // One Sender per file, so every file is a transfer of its own
+        Config::getStripeCount() = 2;
+        Config::getStripeThreshold() = 1;
+        Config::getMaxActiveTransfers() = limit;
+        Config::getMaxTransfersPerPeer() = 0;
+
+        Receiver receiver;
+        QVERIFY(receiver.startServer(0));
+        connect(&receiver, &Receiver::fileTransferRequested, &receiver,
+                [&receiver](const QString &, const QString &, QTcpSocket *socket) {
+            receiver.acceptTransfer(socket);
+        });
+        QSignalSpy receivedSpy(&receiver, &Receiver::fileReceivedSuccessfully);
+
+        FileTransferManager manager;
+        QList<int> requested;
+        QSet<int> started;
+        QSet<int> ended;
+        int mostRunning = 0;
+        bool inOrder = true;
+        bool withinLimit = true;
+        connect(&manager, &FileTransferManager::transferSessionCreated, &manager,
+                [&requested](int sessionId, const QString &, const QString &) { requested.append(sessionId); });
+        connect(&manager, &FileTransferManager::transferStatusChanged, &manager,
+                [&](int sessionId, TransferStatus status)
+                {
+            if (status == TransferStatus::IN_PROGRESS && !started.contains(sessionId))
+            {
+                if (limit > 0 && requested.indexOf(sessionId) >= int(ended.size()) + limit)
+                    inOrder = false;
+                started.insert(sessionId);
+            }
+            else if (status == TransferStatus::FINISHED || status == TransferStatus::ERROR ||
+                     status == TransferStatus::CANCELLED)
+            {
+                ended.insert(sessionId);
+            }
+            mostRunning = qMax(mostRunning, manager.getActiveTransferCount());
+            if (limit > 0 && manager.getActiveTransferCount() > limit)
+                withinLimit = false;
+        });
+
+        manager.sendFilesToUsers(files, {LANDropUser("127.0.0.1", "receiver", receiver.getServerPort(), "1")});
+        QCOMPARE(requested.size(), fileCount);
+        QCOMPARE(manager.getActiveTransferCount(), limit > 0 ? limit : fileCount);
+        QCOMPARE(manager.getQueuedTransferCount(), limit > 0 ? fileCount - limit : 0);
+
+        QTRY_COMPARE_WITH_TIMEOUT(receivedSpy.count(), fileCount, 30000);
+        QTRY_COMPARE_WITH_TIMEOUT(int(ended.size()), fileCount, 10000);
+        QCOMPARE(int(started.size()), fileCount);
+        QVERIFY(inOrder);
+        QVERIFY(withinLimit);
+        if (limit > 0)
+            QCOMPARE(mostRunning, limit);
+        QCOMPARE(manager.getActiveTransferCount(), 0);
+        QCOMPARE(manager.getQueuedTransferCount(), 0);
+        for (int sessionId : std::as_const(requested))
+            QCOMPARE(manager.getSession(sessionId).status, TransferStatus::FINISHED);
+    }
+
+    Config::reset();
+}
+
+/**
+ * @brief Tests that a folder is listed in path order and recreated with its empty folders and times
+ */
+void TestFileTransferManager::test_send_folder()
+{
+    Config::reset();
+    QTemporaryDir sourceDir;
+    QTemporaryDir targetDir;
+    QVERIFY(sourceDir.isValid() && targetDir.isValid());
+    Config::getReceivedFilesPath() = targetDir.path();
+
+    QDir source(sourceDir.path());
+    QVERIFY(source.mkpath("tree/sub/deep") && source.mkpath("tree/empty"));
+    const QDateTime stamp = QDateTime::fromSecsSinceEpoch(1577836800);
+    const QMap<QString, QByteArray> files = {
+        {"tree/a.txt", "alpha"},
+        {"tree/sub/b.bin", QByteArray(70000, 'b')},
+        {"tree/sub/deep/c.txt", QByteArray()}};
+    for (auto it = files.begin(); it != files.end(); ++it)
+    {
+        QFile file(source.filePath(it.key()));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(it.value());
+        QVERIFY(file.setFileTime(stamp, QFileDevice::FileModificationTime));
+        file.close();
+    }
+
+    DirectoryWalker walker(3);
+    QSignalSpy walkedSpy(&walker, &DirectoryWalker::finished);
+    walker.walk(source.filePath("tree"));
+    QVERIFY(walkedSpy.wait(10000));
+    QStringList names;
+    for (const Archive::Entry &entry : walker.entries())
+        names << entry.name;
+    QCOMPARE(names, QStringList({"tree", "tree/a.txt", "tree/empty", "tree/sub", "tree/sub/b.bin",
+                                 "tree/sub/deep", "tree/sub/deep/c.txt"}));
+
+    Receiver receiver;
+    QVERIFY(receiver.startServer(0));
+    connect(&receiver, &Receiver::fileTransferRequested, &receiver,
+            [&receiver](const QString &, const QString &, QTcpSocket *socket) {
+        receiver.acceptTransfer(socket);
+    });
+    QSignalSpy receivedSpy(&receiver, &Receiver::fileReceivedSuccessfully);
+
+    FileTransferManager manager;
+    manager.sendFolderToUsers(source.filePath("tree"), {LANDropUser("127.0.0.1", "peer", receiver.getServerPort(), "1")});
+    QCOMPARE(manager.getPendingFolderCount(), 1);
+    QTRY_COMPARE_WITH_TIMEOUT(receivedSpy.count(), 1, 10000);
+    QCOMPARE(manager.getPendingFolderCount(), 0);
+    QCOMPARE(receivedSpy.first().at(0).toString(), QString("tree"));
+
+    QDir target(targetDir.path());
+    QVERIFY(QFileInfo(target.filePath("tree/empty")).isDir());
+    for (auto it = files.begin(); it != files.end(); ++it)
+    {
+        QFile file(target.filePath(it.key()));
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QCOMPARE(file.readAll(), it.value());
+        QCOMPARE(QFileInfo(file).lastModified().toSecsSinceEpoch(), stamp.toSecsSinceEpoch());
+    }
+
+    Config::reset();
+}
+
+/**
+ * @brief Tests that a pre-warmed connection carries the next transfer and idle ones expire
+ */
+void TestFileTransferManager::test_connection_pool_prewarm()
+{
+    Config::reset();
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QString path = tempDir.path() + "/warm.txt";
+    createTestFile(path, "warm");
+
+    QTcpServer server;
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+    LANDropUser user("127.0.0.1", "peer", server.serverPort(), "1");
+
+    FileTransferManager manager;
+    manager.prewarmConnection(user);
+    QTRY_VERIFY_WITH_TIMEOUT(server.hasPendingConnections(), 5000);
+    QTcpSocket *socket = server.nextPendingConnection();
+
+    // Selecting the user again keeps the one pooled connection
+    manager.prewarmConnection(user);
+
+    // Give the pooled socket time to see the connection complete
+    QTest::qWait(200);
+    manager.sendFilesToUsers({path}, {user});
+    QTRY_VERIFY_WITH_TIMEOUT(socket->canReadLine(), 5000);
+    QVERIFY(socket->readLine().startsWith("warm.txt|4"));
+    QVERIFY(!server.hasPendingConnections());
+
+    // Unused connections are closed once idle for too long
+    Config::getConnectionIdleTimeout() = 1;
+    ConnectionPool pool;
+    pool.prewarm("127.0.0.1", server.serverPort());
+    QCOMPARE(pool.idleCount("127.0.0.1", server.serverPort()), 1);
+    QTRY_VERIFY_WITH_TIMEOUT(server.hasPendingConnections(), 5000);
+    QTcpSocket *idle = server.nextPendingConnection();
+    QTRY_COMPARE_WITH_TIMEOUT(idle->state(), QAbstractSocket::UnconnectedState, 5000);
+    QCOMPARE(pool.idleCount("127.0.0.1", server.serverPort()), 0);
+    QVERIFY(pool.take("127.0.0.1", server.serverPort()) == nullptr);
+
+    Config::reset();
+}
+
+/**
+ * @brief Tests that many progress updates are published as one batch per tick
+ */
+void TestFileTransferManager::test_progress_aggregator_batches()
+{
+    ProgressAggregator aggregator;
+    QSignalSpy spy(&aggregator, &ProgressAggregator::progressPublished);
+    aggregator.setSize(1, 100 * 1024 * 1024);
+    aggregator.setSize(2, 1000);
+
+    // Thousands of reports between two ticks end in a single batch
+    for (int i = 0; i < 5000; ++i)
+    {
+        aggregator.update(1, i / 500);
+        aggregator.update(2, 50);
+    }
+    QCOMPARE(spy.count(), 0);
+    QTRY_COMPARE_WITH_TIMEOUT(spy.count(), 1, 1000);
+    QList<TransferProgress> updates = spy.at(0).at(0).value<QList<TransferProgress>>();
+    QCOMPARE(updates.size(), 2);
+    QCOMPARE(updates.at(0).sessionId, 1);
+    QCOMPARE(updates.at(0).progress, 9);
+    QCOMPARE(updates.at(1).progress, 50);
+
+    // Nothing changed, nothing published
+    QTest::qWait(ProgressAggregator::PUBLISH_INTERVAL * 3);
+    QCOMPARE(spy.count(), 1);
+
+    // The rate follows the bytes done between samples, the remaining time that rate
+    QTest::qWait(100);
+    aggregator.update(1, 19);
+    aggregator.flush();
+    QCOMPARE(spy.count(), 2);
+    TransferProgress sample = spy.at(1).at(0).value<QList<TransferProgress>>().at(0);
+    QCOMPARE(sample.progress, 19);
+    QVERIFY(sample.bytesPerSecond > 0);
+    QVERIFY(sample.secondsRemaining > 0);
+    QCOMPARE(aggregator.progressOf(1).progress, 19);
+
+    // A removed session is not published any more
+    aggregator.update(2, 80);
+    aggregator.remove(2);
+    aggregator.flush();
+    QCOMPARE(spy.count(), 2);
+}
+
+/**
+ * @brief Tests the history model: newest sessions first, batched updates as one range
+ */
+void TestFileTransferManager::test_history_model_rows()
+{
+    TransferHistoryModel model;
+    for (int id = 0; id < 10000; ++id)
+        model.addTransfer(id, QString("file%1.txt").arg(id), TransferHistoryModel::TransferDirection::SEND);
+    model.addTransfer(5, "duplicate.txt", TransferHistoryModel::TransferDirection::SEND);
+    QCOMPARE(model.rowCount(), 10000);
+    QCOMPARE(model.index(0).data().toString(), QString("file9999.txt"));
+    QCOMPARE(model.index(9999).data(TransferHistoryModel::SessionIdRole).toInt(), 0);
+
+    // A batch for scattered sessions is one dataChanged() over their rows
+    QSignalSpy changedSpy(&model, &QAbstractItemModel::dataChanged);
+    QList<TransferProgress> updates;
+    for (int id : {9990, 9995, 9998})
+    {
+        TransferProgress update;
+        update.sessionId = id;
+        update.progress = 40;
+        update.bytesPerSecond = 1024;
+        update.secondsRemaining = 3;
+        updates.append(update);
+    }
+    model.updateProgress(updates);
+    QCOMPARE(changedSpy.count(), 1);
+    QCOMPARE(changedSpy.at(0).at(0).value<QModelIndex>().row(), 1);
+    QCOMPARE(changedSpy.at(0).at(1).value<QModelIndex>().row(), 9);
+    QModelIndex row = model.index(9999 - 9995);
+    QCOMPARE(row.data(TransferHistoryModel::ProgressRole).toInt(), 40);
+    QCOMPARE(row.data(TransferHistoryModel::StatusRole).toInt(), int(TransferStatus::IN_PROGRESS));
+    QCOMPARE(row.data(TransferHistoryModel::RateRole).toLongLong(), qint64(1024));
+
+    // Unchanged progress is not reported again, a final status clears the rate
+    model.updateProgress(updates);
+    QCOMPARE(changedSpy.count(), 1);
+    model.setStatus(9995, TransferStatus::FINISHED);
+    QCOMPARE(row.data(TransferHistoryModel::ProgressRole).toInt(), 100);
+    QCOMPARE(row.data(TransferHistoryModel::RateRole).toLongLong(), qint64(0));
+
+    // Progress does not bring a cancelled transfer back
+    model.setStatus(9998, TransferStatus::CANCELLED);
+    model.updateProgress(9998, 60);
+    QCOMPARE(model.index(1).data(TransferHistoryModel::StatusRole).toInt(), int(TransferStatus::CANCELLED));
+}
+
+/**
+ * @brief Tests the history log: newest first pages, totals, a torn tail and the model below live rows
+ */
+void TestFileTransferManager::test_history_store_pages_and_recovers()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QString path = tempDir.filePath("history.log");
+    const qint64 day = 24 * 3600 * 1000;
+    const qint64 start = QDateTime(QDate(2026, 3, 1), QTime(12, 0)).toMSecsSinceEpoch();
+
+    HistoryStore store;
+    QVERIFY(store.open(path));
+    QCOMPARE(store.count(), qint64(0));
+    for (int i = 0; i < 1000; ++i)
+    {
+        HistoryStore::Record record;
+        record.finishedAt = start + (i < 600 ? 0 : day);
+        record.durationMs = 10;
+        record.bytes = 1000;
+        record.outgoing = (i % 2 == 0);
+        record.fileName = QString("file%1.txt").arg(i);
+        record.peer = (i % 2 == 0) ? "10.0.0.1" : "10.0.0.2";
+        store.append(record);
+    }
+    store.flush();
+    QCOMPARE(store.count(), qint64(1000));
+
+    QList<HistoryStore::Record> newest = store.page(0, 3);
+    QCOMPARE(newest.size(), 3);
+    QCOMPARE(newest.first().fileName, QString("file999.txt"));
+    QVERIFY(!newest.first().outgoing);
+    QCOMPARE(store.page(998, 10).size(), 2);
+    QCOMPARE(store.page(998, 10).last().fileName, QString("file0.txt"));
+
+    QMap<QString, HistoryStore::Aggregate> peers = store.perPeer();
+    QCOMPARE(peers.size(), 2);
+    QCOMPARE(peers.value("10.0.0.1").transfers, qint64(500));
+    QCOMPARE(peers.value("10.0.0.1").bytesPerSecond(), qint64(100000));
+    QMap<QDate, HistoryStore::Aggregate> days = store.perDay();
+    QCOMPARE(days.size(), 2);
+    QCOMPARE(days.value(QDate(2026, 3, 1)).transfers, qint64(600));
+
+    // Totals follow the writes once built
+    HistoryStore::Record late;
+    late.finishedAt = start + day;
+    late.bytes = 5000;
+    late.fileName = "late.txt";
+    late.peer = "10.0.0.3";
+    store.append(late);
+    store.flush();
+    QCOMPARE(store.perPeer().value("10.0.0.3").bytes, qint64(5000));
+    store.close();
+
+    // A crash lost the last offset and left half an entry behind
+    QFile index(HistoryStore::indexPath(path));
+    QVERIFY(index.resize(index.size() - 8));
+    QFile log(path);
+    qint64 logSize = log.size();
+    QVERIFY(log.open(QIODevice::Append));
+    log.write(QByteArray("\x40\0\0\0\1\2", 6));
+    log.close();
+
+    QVERIFY(store.open(path));
+    QCOMPARE(store.count(), qint64(1001));
+    QCOMPARE(store.page(0, 1).first().fileName, QString("late.txt"));
+    QCOMPARE(QFileInfo(path).size(), logSize);
+
+    // Earlier transfers are listed below the sessions of this run
+    TransferHistoryModel model;
+    model.addTransfer(1, "live.txt", TransferHistoryModel::TransferDirection::SEND);
+    model.setStore(&store);
+    QCOMPARE(model.rowCount(), 1002);
+    QCOMPARE(model.index(0).data().toString(), QString("live.txt"));
+    QCOMPARE(model.index(1).data().toString(), QString("late.txt"));
+    QCOMPARE(model.index(1001).data().toString(), QString("file0.txt"));
+    QCOMPARE(model.index(1001).data(TransferHistoryModel::ProgressRole).toInt(), 100);
+}
+
+/**
+ * @brief Tests that the auto-accept policy accepts incoming transfers without a batch request
+ */
+void TestFileTransferManager::test_auto_accept_policy()
+{
+    Config::reset();
+    QTemporaryDir sourceDir;
+    QTemporaryDir targetDir;
+    QVERIFY(sourceDir.isValid() && targetDir.isValid());
+    Config::getReceivedFilesPath() = targetDir.path();
+    Config::getPort() = 0;
+    Config::getAutoAccept() = 2;
+
+    FileTransferManager receiving;
+    QSignalSpy batchSpy(&receiving, &FileTransferManager::batchTransferRequested);
+    receiving.setupReceiver();
+    QVERIFY(receiving.getReceiver());
+    const LANDropUser self("127.0.0.1", "self", quint16(Config::getPort()), "2");
+
+    // Everyone is accepted
+    QString first = sourceDir.filePath("first.txt");
+    createTestFile(first, "accepted without asking");
+    FileTransferManager sending;
+    sending.sendFilesToUsers({first}, {self});
+    QTRY_VERIFY_WITH_TIMEOUT(QFile::exists(targetDir.filePath("first.txt")) &&
+                                 QFileInfo(targetDir.filePath("first.txt")).size() == 23, 10000);
+    QTRY_COMPARE_WITH_TIMEOUT(sending.getActiveTransferCount(), 0, 5000);
+    QCOMPARE(batchSpy.count(), 0);
+
+    // Only discovered peers are accepted, an unknown sender is asked about
+    Config::getAutoAccept() = 1;
+    QString second = sourceDir.filePath("second.txt");
+    createTestFile(second, "asked about");
+    sending.sendFilesToUsers({second}, {self});
+    QVERIFY(batchSpy.wait(5000));
+    QMap<QString, qint64> requested = batchSpy.first().at(0).value<QMap<QString, qint64>>();
+    QCOMPARE(requested.keys(), QStringList({"second.txt"}));
+    QMap<QString, QTcpSocket *> sockets = batchSpy.first().at(1).value<QMap<QString, QTcpSocket *>>();
+    receiving.rejectIncomingTransfer(sockets.value("second.txt"), "second.txt");
+    QTRY_COMPARE_WITH_TIMEOUT(sending.getActiveTransferCount(), 0, 5000);
+
+    // Once the sender is known, it is accepted too
+    receiving.setDiscoveredUsers({self});
+    QString third = sourceDir.filePath("third.txt");
+    createTestFile(third, "known peer");
+    sending.sendFilesToUsers({third}, {self});
+    QTRY_VERIFY_WITH_TIMEOUT(QFileInfo(targetDir.filePath("third.txt")).size() == 10, 10000);
+    QCOMPARE(batchSpy.count(), 1);
+    QVERIFY(!QFile::exists(targetDir.filePath("second.txt")));
+
+    Config::reset();
+}
+
+/**
+ * @brief Tests that names leaving the received files folder are refused even when everything is accepted
+ */
+void TestFileTransferManager::test_auto_accept_refuses_unsafe_names()
+{
+    QVERIFY(Receiver::isSafeFileName("notes.txt"));
+    QVERIFY(Receiver::isSafeFileName("..hidden"));
+    for (const QString &name : {QString(), QString("."), QString(".."), QString("../x.log"), QString("a/b.txt"),
+                                QString("..\\x.log"), QString("/etc/passwd"), QString("C:x.log"), QString("C:\\x.log")})
+        QVERIFY2(!Receiver::isSafeFileName(name), qPrintable(name));
+
+    Config::reset();
+    QTemporaryDir rootDir;
+    QVERIFY(rootDir.isValid());
+    QString targetPath = rootDir.filePath("received");
+    QVERIFY(QDir().mkpath(targetPath));
+    Config::getReceivedFilesPath() = targetPath;
+    Config::getPort() = 0;
+    Config::getAutoAccept() = 2;
+
+    FileTransferManager receiving;
+    receiving.setupReceiver();
+    QVERIFY(receiving.getReceiver());
+    QSignalSpy requestedSpy(receiving.getReceiver(), &Receiver::fileTransferRequested);
+
+    // A header whose name climbs out of the folder closes the connection unanswered
+    for (const QString &name : {QString("../escaped.log"), QString(rootDir.filePath("absolute.log"))})
+    {
+        QTcpSocket client;
+        client.connectToHost(QHostAddress::LocalHost, quint16(Config::getPort()));
+        QVERIFY(client.waitForConnected(3000));
+        Protocol::TransferHeader header;
+        header.fileName = name;
+        header.fileSize = 4;
+        client.write(header.encode());
+        client.write("data");
+        QTRY_COMPARE_WITH_TIMEOUT(client.state(), QAbstractSocket::UnconnectedState, 5000);
+        QVERIFY(!client.canReadLine());
+    }
+
+    // The same on a session connection, for a file announced after the first
+    QTcpSocket session;
+    session.connectToHost(QHostAddress::LocalHost, quint16(Config::getPort()));
+    QVERIFY(session.waitForConnected(3000));
+    Protocol::TransferHeader first;
+    first.fileName = "first.log";
+    first.fileSize = 4;
+    first.options.insert("session", "2");
+    first.options.insert("manifest", "1");
+    Protocol::TransferHeader second;
+    second.fileName = "../second.log";
+    second.fileSize = 4;
+    session.write(first.encode());
+    session.write(second.encode());
+    QTRY_COMPARE_WITH_TIMEOUT(session.state(), QAbstractSocket::UnconnectedState, 5000);
+
+    QCOMPARE(requestedSpy.count(), 0);
+    QCOMPARE(receiving.getActiveTransferCount(), 0);
+    QVERIFY(!QFile::exists(rootDir.filePath("escaped.log")));
+    QVERIFY(!QFile::exists(rootDir.filePath("absolute.log")));
+    QVERIFY(!QFile::exists(rootDir.filePath("second.log")));
+    QVERIFY(QDir(targetPath).entryList(QDir::Files).isEmpty());
+
+    Config::reset();
+}
+
+/**
+ * @brief Tests auto-accept rules, alone and deciding incoming transfers
+ */
+void TestFileTransferManager::test_auto_accept_rules()
+{
+    Config::reset();
+    QTemporaryDir sourceDir;
+    QTemporaryDir targetDir;
+    QVERIFY(sourceDir.isValid() && targetDir.isValid());
+
+    AutoAcceptPolicy::Rule rule;
+    rule.peer = "build-*";
+    rule.patterns = QStringList({"*.log", "*.tar.gz"});
+    rule.maxSize = 1000;
+    AutoAcceptPolicy policy;
+    policy.setRules({rule});
+
+    AutoAcceptPolicy::Request request;
+    request.fileName = "logs/nightly.LOG";
+    request.size = 1000;
+    request.address = QHostAddress("10.0.0.7");
+    request.hostname = "build-01";
+    QVERIFY(policy.accepts(request, -1));
+    request.size = 1001;
+    QVERIFY(!policy.accepts(request, -1)); // Too large
+    request.size = 10;
+    request.fileName = "setup.exe";
+    QVERIFY(!policy.accepts(request, -1)); // Pattern
+    request.fileName = "nightly.tar.gz";
+    request.hostname = "laptop";
+    QVERIFY(!policy.accepts(request, -1)); // Peer
+
+    // Addresses, subnets and free space
+    rule = AutoAcceptPolicy::Rule();
+    rule.peer = "10.0.0.0/24";
+    rule.minFreeSpace = 100;
+    policy.setRules({rule});
+    QVERIFY(policy.accepts(request, 110));
+    QVERIFY(!policy.accepts(request, 109));
+    QVERIFY(!policy.accepts(request, -1));
+    request.address = QHostAddress("::ffff:10.0.0.9");
+    QVERIFY(policy.accepts(request, 110));
+    request.address = QHostAddress("10.0.1.1");
+    QVERIFY(!policy.accepts(request, 110));
+    QVERIFY(AutoAcceptPolicy::freeSpace(targetDir.filePath("not/created/yet")) > 0);
+
+    // Rules files
+    QString rulesPath = sourceDir.filePath("rules.json");
+    QVERIFY(policy.load(sourceDir.filePath("missing.json")));
+    QVERIFY(policy.rules().isEmpty());
+    createTestFile(rulesPath, "{\"peer\": 1}");
+    QVERIFY(!policy.load(rulesPath));
+    createTestFile(rulesPath, "[{\"peer\": \"127.0.0.1\", \"patterns\": [\"*.log\"], \"maxSize\": 100}]");
+    QVERIFY(policy.load(rulesPath));
+    QCOMPARE(policy.rules().size(), 1);
+    QCOMPARE(policy.rules().first().maxSize, qint64(100));
+    QCOMPARE(policy.rules().first().minFreeSpace, qint64(0));
+    QCOMPARE(policy.rules().first().priority, TransferPriority::NORMAL);
+
+    // The lane of the matching rule is reported
+    AutoAcceptPolicy lanes;
+    AutoAcceptPolicy::Rule background;
+    background.patterns = QStringList{"*.iso"};
+    background.priority = TransferPriority::BACKGROUND;
+    lanes.setRules({background});
+    AutoAcceptPolicy::Request image;
+    image.fileName = "disk.iso";
+    TransferPriority priority = TransferPriority::NORMAL;
+    QVERIFY(lanes.accepts(image, -1, &priority));
+    QCOMPARE(priority, TransferPriority::BACKGROUND);
+
+    // A matching file streams in at once, the others are asked about
+    Config::getReceivedFilesPath() = targetDir.path();
+    Config::getAutoAcceptRulesPath() = rulesPath;
+    Config::getPort() = 0;
+    FileTransferManager receiving;
+    QCOMPARE(receiving.getAutoAcceptPolicy().rules().size(), 1);
+    QSignalSpy batchSpy(&receiving, &FileTransferManager::batchTransferRequested);
+    receiving.setupReceiver();
+    QVERIFY(receiving.getReceiver());
+    const LANDropUser self("127.0.0.1", "self", quint16(Config::getPort()), "2");
+
+    QString trusted = sourceDir.filePath("build.log");
+    createTestFile(trusted, "accepted by a rule");
+    FileTransferManager sending;
+    sending.sendFilesToUsers({trusted}, {self});
+    QTRY_VERIFY_WITH_TIMEOUT(QFileInfo(targetDir.filePath("build.log")).size() == 18, 10000);
+    QTRY_COMPARE_WITH_TIMEOUT(sending.getActiveTransferCount(), 0, 5000);
+    QCOMPARE(batchSpy.count(), 0);
+
+    QString other = sourceDir.filePath("notes.txt");
+    createTestFile(other, "asked about");
+    sending.sendFilesToUsers({other}, {self});
+    QVERIFY(batchSpy.wait(5000));
+    QMap<QString, QTcpSocket *> sockets = batchSpy.first().at(1).value<QMap<QString, QTcpSocket *>>();
+    receiving.rejectIncomingTransfer(sockets.value("notes.txt"), "notes.txt");
+    QTRY_COMPARE_WITH_TIMEOUT(sending.getActiveTransferCount(), 0, 5000);
+    QVERIFY(!QFile::exists(targetDir.filePath("notes.txt")));
+
+    Config::reset();
+}
+
+void TestFileTransferManager::test_user_list_model_batches_peer_events()
+{
+    UserListModel model;
+    QSignalSpy inserted(&model, &QAbstractItemModel::rowsInserted);
+    QSignalSpy changed(&model, &QAbstractItemModel::dataChanged);
+    QSignalSpy reset(&model, &QAbstractItemModel::modelReset);
+    QSignalSpy refreshed(&model, &UserListModel::refreshed);
+
+    LANDropUser alpha("192.168.1.10", "alpha", 5556, "2");
+    LANDropUser beta("192.168.1.11", "beta", 5556, "2");
+    beta.sharedFiles.append(QJsonObject{{"name", "big.iso"}});
+
+    // A burst of events is applied at once, a peer gone before it shows is never listed
+    model.onPeerAdded(alpha);
+    model.onPeerAdded(beta);
+    model.onPeerAdded(LANDropUser("192.168.1.12", "gone", 5556, "2"));
+    model.onPeerRemoved("192.168.1.12");
+    QCOMPARE(model.rowCount(), 0);
+    QTRY_COMPARE(refreshed.count(), 1);
+    QCOMPARE(model.rowCount(), 2);
+    QCOMPARE(inserted.count(), 1);
+    QCOMPARE(model.index(0).data().toString(), QString("alpha [192.168.1.10]"));
+    QCOMPARE(model.index(1).data(UserListModel::HostnameRole).toString(), QString("beta"));
+
+    // Rows hold no catalog, and catalog changes alone leave them alone
+    QVERIFY(!model.user(1).hasSharedFiles());
+    QCOMPARE(model.user(1).transferPort, quint16(5556));
+    beta.sharedFiles.append(QJsonObject{{"name", "small.txt"}});
+    model.onPeerChanged(beta, BroadcastDiscoveryService::SharedFilesField);
+    model.flush();
+    QCOMPARE(refreshed.count(), 1);
+
+    // Changes update rows in place, the last event of a user wins
+    beta.transferPort = 6000;
+    model.onPeerChanged(beta, BroadcastDiscoveryService::PortField);
+    beta.hostname = "beta2";
+    model.onPeerChanged(beta, BroadcastDiscoveryService::HostnameField);
+    model.flush();
+    QCOMPARE(changed.count(), 1);
+    QCOMPARE(model.index(1).data(UserListModel::PortRole).toInt(), 6000);
+    QCOMPARE(model.index(1).data(UserListModel::HostnameRole).toString(), QString("beta2"));
+    QCOMPARE(inserted.count(), 1);
+    QCOMPARE(reset.count(), 0);
+
+    // Removing a row renumbers the ones below it
+    model.onPeerRemoved(alpha.ipAddress);
+    model.onPeerAdded(LANDropUser("192.168.1.13", "gamma", 5556, "2"));
+    model.flush();
+    QCOMPARE(model.rowCount(), 2);
+    QCOMPARE(model.index(0).data(UserListModel::IpAddressRole).toString(), beta.ipAddress);
+    beta.transferPort = 6001;
+    model.onPeerChanged(beta, BroadcastDiscoveryService::PortField);
+    model.flush();
+    QCOMPARE(model.index(0).data(UserListModel::PortRole).toInt(), 6001);
+    QCOMPARE(model.index(1).data(UserListModel::HostnameRole).toString(), QString("gamma"));
+
+    // A refresh replaces every row
+    model.onPeerAdded(alpha);
+    model.setUsers({alpha});
+    QCOMPARE(reset.count(), 1);
+    QCOMPARE(model.rowCount(), 1);
+    QCOMPARE(refreshed.last().at(0).toInt(), 1);
+    QTest::qWait(UserListModel::REFRESH_INTERVAL_MS + 50);
+    QCOMPARE(model.rowCount(), 1);
+}
+
+void TestFileTransferManager::test_subscription_mirror_picks_new_and_changed_files()
+{
+    QTemporaryDir receivedDir;
+    QVERIFY(receivedDir.isValid());
+    const QString receivedPath = Config::getReceivedFilesPath();
+    const QString subscribedFolders = Config::getSubscribedFolders();
+    Config::getReceivedFilesPath() = receivedDir.path();
+    Config::getSubscribedFolders() = QString();
+
+    SubscriptionMirror::setSubscribed("studio", "Photos", true);
+    SubscriptionMirror::setSubscribed("studio", "Music/", true);
+    SubscriptionMirror::setSubscribed("studio", "Music", false);
+    QVERIFY(SubscriptionMirror::isSubscribed("studio", "Photos"));
+    QVERIFY(!SubscriptionMirror::isSubscribed("studio", "Music"));
+    QCOMPARE(SubscriptionMirror::subscriptions().size(), 1);
+
+    auto entry = [](const QString &path, qint64 size, const QString &hash)
+    {
+        QJsonObject fileInfo;
+        fileInfo["name"] = path.mid(path.lastIndexOf('/') + 1);
+        fileInfo["path"] = path;
+        fileInfo["size"] = QString::number(size);
+        fileInfo["type"] = "file";
+        fileInfo["hash"] = hash;
+        return fileInfo;
+    };
+    LANDropUser studio("192.168.1.30", "studio", 5556, "2");
+    studio.sharedFiles.append(entry("Photos/a.jpg", 4, "aa"));
+    studio.sharedFiles.append(entry("Photos/2024/b.jpg", 6, "bb"));
+    studio.sharedFiles.append(entry("Photoshop/c.psd", 8, "cc"));
+    studio.sharedFiles.append(entry("d.txt", 2, "dd"));
+    studio.sharedFiles.append(entry("Photos/old/a.jpg", 4, "a2"));
+    studio.sharedFiles.append(entry("Photos/../../escape.jpg", 1, "xx"));
+    LANDropUser other("192.168.1.31", "other", 5556, "2");
+    other.sharedFiles.append(entry("Photos/e.jpg", 4, "ee"));
+
+    // Copies are kept by peer and relative path, never outside the received files folder
+    QCOMPARE(SubscriptionMirror::localPathOf("studio", "Photos/a.jpg"), QString("studio/Photos/a.jpg"));
+    QCOMPARE(SubscriptionMirror::localPathOf("st/u\\dio", "a.jpg"), QString("st_u_dio/a.jpg"));
+    QVERIFY(SubscriptionMirror::localPathOf("studio", "Photos/../../escape.jpg").isEmpty());
+    QVERIFY(SubscriptionMirror::localPathOf("studio", "/etc/passwd").isEmpty());
+    QVERIFY(SubscriptionMirror::localPathOf("..", "a.jpg").isEmpty());
+
+    // A copy of the same size is already local
+    QVERIFY(QDir(receivedDir.path()).mkpath("studio/Photos"));
+    QFile local(QDir(receivedDir.path()).filePath("studio/Photos/a.jpg"));
+    QVERIFY(local.open(QIODevice::WriteOnly));
+    local.write("1234");
+    local.close();
+
+    SubscriptionMirror mirror;
+    mirror.setUsers({studio, other});
+    QCOMPARE(mirror.pendingCount(), 2);
+
+    SubscriptionMirror::Item item;
+    QVERIFY(mirror.next(&item));
+    QCOMPARE(item.key, QString("studio/Photos/2024/b.jpg"));
+    QCOMPARE(item.ipAddress, studio.ipAddress);
+    QCOMPARE(item.relativePath, QString("Photos/2024/b.jpg"));
+    QCOMPARE(item.fileName, QString("b.jpg"));
+    QCOMPARE(item.localPath, QString("studio/Photos/2024/b.jpg"));
+    QCOMPARE(item.size, qint64(6));
+
+    // A file of the same name in another folder is not taken for the local copy
+    SubscriptionMirror::Item sameName;
+    QVERIFY(mirror.next(&sameName));
+    QCOMPARE(sameName.localPath, QString("studio/Photos/old/a.jpg"));
+    mirror.finished(sameName.key, true);
+    QVERIFY(!mirror.next(&sameName));
+
+    QFile mirrored(QDir(receivedDir.path()).filePath(sameName.localPath));
+    QVERIFY(QDir(receivedDir.path()).mkpath("studio/Photos/old"));
+    QVERIFY(mirrored.open(QIODevice::WriteOnly));
+    mirrored.write("abcd");
+    mirrored.close();
+
+    // A failed file waits before it is tried again, a mirrored one is done until it changes
+    mirror.finished(item.key, false);
+    QCOMPARE(mirror.pendingCount(), 1);
+    QVERIFY(!mirror.next(&item));
+
+    SubscriptionMirror retried;
+    retried.setUsers({studio});
+    QVERIFY(retried.next(&item));
+    retried.finished(item.key, true);
+    retried.setUsers({studio});
+    QCOMPARE(retried.pendingCount(), 0);
+
+    studio.sharedFiles[1] = entry("Photos/2024/b.jpg", 7, "b2");
+    studio.sharedFiles.append(entry("Photos/new.jpg", 1, "nn"));
+    retried.setUsers({studio});
+    QCOMPARE(retried.pendingCount(), 2);
+    QVERIFY(retried.next(&item));
+    QCOMPARE(item.size, qint64(7));
+
+    // Subscriptions are read again when they change
+    Config::getSubscribedFolders() = QString();
+    QCOMPARE(retried.pendingCount(), 1);
+    QVERIFY(!retried.next(&item));
+
+    Config::getReceivedFilesPath() = receivedPath;
+    Config::getSubscribedFolders() = subscribedFolders;
+}
+
+/**
+ * @brief Tests that watched counters are published without progress updates
+ */
+void TestFileTransferManager::test_progress_counters_are_read_without_signals()
+{
+    QCOMPARE(int(alignof(ProgressCounter)), 64);
+
+    // Counters are found by transfer ID while someone holds them
+    QSharedPointer<ProgressCounter> counter = ProgressCounters::open("transfer-a", 1000);
+    QCOMPARE(ProgressCounters::find("transfer-a"), counter);
+    QVERIFY(ProgressCounters::find("transfer-b").isNull());
+    {
+        QSharedPointer<ProgressCounter> released = ProgressCounters::open("transfer-b", 10);
+        QVERIFY(!ProgressCounters::find("transfer-b").isNull());
+    }
+    QVERIFY(ProgressCounters::find("transfer-b").isNull());
+
+    ProgressAggregator aggregator;
+    QSignalSpy spy(&aggregator, &ProgressAggregator::progressPublished);
+    aggregator.watch(1, counter);
+    QCOMPARE(counter->watched.loadRelaxed(), 1);
+
+    // The worker only stores bytes, the aggregator reads them on its tick
+    counter->bytes.storeRelaxed(250);
+    QTRY_COMPARE_WITH_TIMEOUT(spy.count(), 1, 1000);
+    QCOMPARE(aggregator.progressOf(1).progress, 25);
+
+    counter->bytes.storeRelaxed(1000);
+    aggregator.flush();
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(aggregator.progressOf(1).progress, 100);
+
+    // Nothing changed, nothing published
+    QTest::qWait(ProgressAggregator::PUBLISH_INTERVAL * 3);
+    QCOMPARE(spy.count(), 2);
+
+    // A removed session sends its worker back to progress signals
+    aggregator.remove(1);
+    QCOMPARE(counter->watched.loadRelaxed(), 0);
+}
+
 QTEST_MAIN(TestFileTransferManager)
 
-#include "test_filetransfermanager.moc"
\ No newline at end of file
+#include "test_filetransfermanager.moc"
@@ -9,9 +9,11 @@
  * - Signal spy configuration
  * - Monitoring interval configuration
  * - ConnectionStatus enum validation
+ * - Shared interface snapshot
  */
 
 #include "../landrop-plus/services/networkmanager.h"
+#include "../landrop-plus/services/interfacesnapshot.h"
 #include <QtTest>
 #include <QSignalSpy>
 #include <QNetworkInterface>
@@ -31,6 +33,7 @@ private slots:
     void test_stopMonitoring();
     void test_setMonitoringInterval();
     void test_getConnectionStatus();
+    void test_shared_interface_snapshot();
 
 private:
     bool isValidIPAddress(const QString &ip);
@@ -183,6 +186,25 @@ void TestNetworkManager::test_getConnectionStatus()
             updatedStatus == NetworkManager::ConnectionStatus::CONNECTED);
 }
 
+/**
+ * @brief Tests that the manager reads the shared snapshot, and that an
+ * unchanged refresh reports nothing
+ */
+void TestNetworkManager::test_shared_interface_snapshot()
+{
+    InterfaceSnapshot *snapshot = InterfaceSnapshot::shared();
+    QCOMPARE(InterfaceSnapshot::shared(), snapshot);
+
+    NetworkManager manager;
+    manager.checkConnection();
+    QCOMPARE(manager.getCurrentIP(), snapshot->primaryIP());
+
+    QSignalSpy changedSpy(snapshot, &InterfaceSnapshot::changed);
+    snapshot->refresh();
+    snapshot->refresh();
+    QVERIFY(changedSpy.count() <= 1);
+}
+
 QTEST_MAIN(TestNetworkManager)
 
 #include "test_networkmanager.moc"
\ No newline at end of file
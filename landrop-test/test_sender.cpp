@@ -8,16 +8,36 @@
  * - Method execution without network operations
  * - Error handling with invalid inputs
  * - Crash prevention during various scenarios
+ * - Kernel zero-copy chunk delivery over a loopback connection
+ * - Transfer source selection and shared memory-mapped windows
+ * - Adaptive send window bounds under a backed-up queue
+ * - Compression frames and the incompressible-data pause
+ * - Token-bucket bandwidth caps
+ * - Fan-out of one file to several receivers within the lag window (loopback)
+ * - Racing connections over every announced address of a peer (loopback)
  */
 
 #include "../landrop-plus/network/sender.h"
+#include "../landrop-plus/network/zerocopy.h"
+#include "../landrop-plus/network/transfersource.h"
+#include "../landrop-plus/network/sendwindow.h"
+#include "../landrop-plus/network/compression.h"
+#include "../landrop-plus/network/bandwidthshaper.h"
+#include "../landrop-plus/network/fanoutsender.h"
+#include "../landrop-plus/network/bufferpool.h"
+#include "../landrop-plus/network/connectionrace.h"
+#include "../landrop-plus/network/pathbonding.h"
 #include <QtTest>
 #include <QSignalSpy>
+#include <QBuffer>
 #include <QTcpServer>
 #include <QTemporaryDir>
 #include <QFile>
 #include <QTimer>
 #include <QThread>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QtEndian>
 
 class TestSender : public QObject {
     Q_OBJECT
@@ -27,6 +47,17 @@ private slots:
     void test_file_transfer_accepted();
     void test_file_transfer_refused();
     void test_file_transfer_error();
+    void test_zero_copy_chunk();
+    void test_mapped_source_shares_window();
+    void test_read_ahead_source_reads_in_order();
+    void test_buffer_pool_reuses_blocks();
+    void test_send_window_shrinks_when_queue_backs_up();
+    void test_compression_frames_round_trip();
+    void test_bandwidth_caps_pause_and_lift();
+    void test_bandwidth_lanes_yield();
+    void test_fanout_reads_once_for_all_receivers();
+    void test_connection_race_takes_answering_address();
+    void test_read_ahead_source_resumes_when_ready();
 
 private:
     void createTestFile(const QString &filePath, const QString &content = "test content");
@@ -126,6 +157,469 @@ void TestSender::test_file_transfer_error() {
     QVERIFY(true); // verify no crash
 }
 
+/**
+ * @brief Tests that ZeroCopy::sendFileChunk delivers file bytes at the requested offset
+ */
+void TestSender::test_zero_copy_chunk() {
+    if (!ZeroCopy::isSupported())
+        QSKIP("No kernel send path on this platform");
+
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QString filePath = tempDir.path() + "/zerocopy.txt";
+    createTestFile(filePath, "0123456789");
+
+    QTcpServer server;
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+
+    QTcpSocket client;
+    client.connectToHost(QHostAddress::LocalHost, server.serverPort());
+    QVERIFY(client.waitForConnected(3000));
+    QVERIFY(server.waitForNewConnection(3000));
+    QTcpSocket *peer = server.nextPendingConnection();
+    QVERIFY(peer != nullptr);
+
+    QFile file(filePath);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE(ZeroCopy::sendFileChunk(client.socketDescriptor(), file.handle(), 4, 6), qint64(6));
+
+    QByteArray received;
+    while (received.size() < 6 && peer->waitForReadyRead(3000))
+        received += peer->readAll();
+    QCOMPARE(received, QByteArray("456789"));
+}
+
+/**
+ * @brief Tests that large files get a mapped source and readers share one mapping
+ */
+void TestSender::test_mapped_source_shares_window() {
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QString filePath = tempDir.path() + "/mapped.txt";
+    createTestFile(filePath, "mapped file content");
+
+    qint64 oldThreshold = Config::getMappedSourceThreshold();
+    Config::getMappedSourceThreshold() = 1;
+    QScopedPointer<TransferSource> first(TransferSource::create(filePath));
+    QScopedPointer<TransferSource> second(TransferSource::create(filePath));
+    Config::getMappedSourceThreshold() = oldThreshold;
+
+    QVERIFY(dynamic_cast<MappedFileSource *>(first.data()) != nullptr);
+    QVERIFY(first->open());
+    QVERIFY(second->open());
+
+    const char *firstData = nullptr;
+    const char *secondData = nullptr;
+    QCOMPARE(first->readChunk(7, 4, &firstData), qint64(4));
+    QCOMPARE(QByteArray(firstData, 4), QByteArray("file"));
+    QCOMPARE(second->readChunk(7, 4, &secondData), qint64(4));
+    QCOMPARE(firstData, secondData);
+
+    const char *endData = nullptr;
+    QCOMPARE(first->readChunk(first->size(), 4, &endData), qint64(0));
+}
+
+/**
+ * @brief Tests that the read-ahead source returns the file across block boundaries and after a jump
+ */
+void TestSender::test_read_ahead_source_reads_in_order() {
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QString filePath = tempDir.path() + "/ahead.bin";
+    QByteArray content(int(ReadAheadSource::BLOCK_SIZE * 3 + 123), '\0');
+    for (int i = 0; i < content.size(); ++i)
+        content[i] = char((i * 13) % 253);
+    QFile file(filePath);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(content);
+    file.close();
+
+    qint64 oldThreshold = Config::getMappedSourceThreshold();
+    Config::getMappedSourceThreshold() = 0;
+    QScopedPointer<TransferSource> source(TransferSource::create(filePath));
+    Config::getMappedSourceThreshold() = oldThreshold;
+    QVERIFY(dynamic_cast<ReadAheadSource *>(source.data()) != nullptr);
+    QVERIFY(source->open());
+    QCOMPARE(source->size(), qint64(content.size()));
+
+    QByteArray read;
+    const char *data = nullptr;
+    qint64 length;
+    while ((length = source->readChunk(read.size(), 300000, &data)) > 0)
+        read.append(data, int(length));
+    QCOMPARE(length, qint64(0));
+    QCOMPARE(read, content);
+
+    // A jump back starts reading ahead from there
+    QCOMPARE(source->readChunk(10, 4, &data), qint64(4));
+    QCOMPARE(QByteArray(data, 4), content.mid(10, 4));
+    source->close();
+}
+
+/**
+ * @brief Tests that released buffers are handed out again instead of allocated
+ */
+void TestSender::test_buffer_pool_reuses_blocks() {
+    const qint64 size = 123 * 1024;
+    BufferPool::clear();
+    BufferPool::resetStats();
+
+    QByteArray first = BufferPool::acquire(size);
+    QCOMPARE(first.size(), int(size));
+    const char *address = first.constData();
+    first.resize(100);
+    BufferPool::release(first);
+    QVERIFY(first.isEmpty());
+    QCOMPARE(BufferPool::stats().idleBytes, size);
+
+    // Steady state: the same block comes back at its full size
+    for (int i = 0; i < 10; ++i) {
+        QByteArray again = BufferPool::acquire(size);
+        QCOMPARE(again.size(), int(size));
+        QCOMPARE(again.constData(), address);
+        BufferPool::release(again);
+    }
+    BufferPool::Stats stats = BufferPool::stats();
+    QCOMPARE(stats.allocations, qint64(1));
+    QCOMPARE(stats.reuses, qint64(10));
+    QCOMPARE(stats.peakIdleBytes, size);
+
+    // A buffer still shared elsewhere is not taken back
+    QByteArray pooled = BufferPool::acquire(size);
+    QByteArray copy = pooled;
+    BufferPool::release(pooled);
+    QCOMPARE(BufferPool::stats().idleBytes, qint64(0));
+    QCOMPARE(copy.size(), int(size));
+
+    BufferPool::clear();
+}
+
+/**
+ * @brief Tests that a slow peer shrinks the window but never below its floor
+ */
+void TestSender::test_send_window_shrinks_when_queue_backs_up() {
+    AdaptiveSendWindow window;
+    QCOMPARE(window.chunkSize(), qint64(Config::getBufferSize()));
+    qint64 initial = window.highWater();
+    QVERIFY(initial <= Config::getMaxSendWindow());
+    QCOMPARE(window.lowWater(), initial / 2);
+
+    // 64 KiB drained per ~60 ms while 4 MiB stay queued: several seconds of backlog
+    for (int i = 0; i < 4; ++i) {
+        QTest::qWait(60);
+        window.recordWritten(64 * 1024, 4 * 1024 * 1024);
+    }
+
+    QVERIFY(window.throughput() > 0);
+    QVERIFY(window.queueDelay() > 40);
+    QVERIFY(window.highWater() < initial);
+    QVERIFY(window.highWater() >= 64 * 1024);
+    QVERIFY(window.chunkSize() >= 16 * 1024);
+}
+
+/**
+ * @brief Tests that text compresses, random data pauses compression, and frames decode
+ */
+void TestSender::test_compression_frames_round_trip() {
+    QByteArray text;
+    while (text.size() < 64 * 1024)
+        text.append("2024-01-01 12:00:00 INFO transfer finished in 42 ms\n");
+
+    QByteArray noise;
+    quint32 seed = 7;
+    for (int i = 0; i < 64 * 1024; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        noise.append(char(seed >> 16));
+    }
+
+    BlockCompressor compressor(1);
+    QByteArray wire = compressor.encode(text.constData(), text.size());
+    QVERIFY(wire.size() < text.size() / 3);
+    QCOMPARE(wire.at(0), 'Z');
+
+    QByteArray expected = text;
+    for (int i = 0; i < 4; ++i) {
+        wire += compressor.encode(noise.constData(), noise.size());
+        expected += noise;
+    }
+    // Four incompressible chunks in a row pause compression
+    QVERIFY(!compressor.isActive());
+    QCOMPARE(compressor.rawBytes(), qint64(expected.size()));
+    QCOMPARE(compressor.wireBytes(), qint64(wire.size()));
+
+    // Incomplete frames and whatever follows the data stay unread
+    QByteArray decoded;
+    QBuffer partial;
+    partial.setData(wire.left(40003));
+    partial.open(QIODevice::ReadOnly);
+    QVERIFY(Compression::readFrames(&partial, expected.size(), &decoded));
+    QVERIFY(partial.pos() < 40003);
+
+    QBuffer rest;
+    rest.setData(wire.mid(partial.pos()) + "HASH|00\n");
+    rest.open(QIODevice::ReadOnly);
+    QVERIFY(Compression::readFrames(&rest, expected.size() - decoded.size(), &decoded));
+    QCOMPARE(decoded, expected);
+    QCOMPARE(rest.readAll(), QByteArray("HASH|00\n"));
+
+    QBuffer broken;
+    broken.setData(QByteArray("X\0\0\0\1a", 6));
+    broken.open(QIODevice::ReadOnly);
+    QVERIFY(!Compression::readFrames(&broken, 1, &decoded));
+
+    // A 'Z' frame announcing more than the range still expected is refused before it is inflated
+    QByteArray packed = qCompress(QByteArray(1000, 'a'));
+    QByteArray bomb("Z\0\0\0\0", 5);
+    qToBigEndian<quint32>(quint32(packed.size()), bomb.data() + 1);
+    bomb += packed;
+    QBuffer oversized;
+    oversized.setData(bomb);
+    oversized.open(QIODevice::ReadOnly);
+    QVERIFY(!Compression::readFrames(&oversized, 999, &decoded));
+    qToBigEndian<quint32>(quint32(Compression::MAX_FRAME + 1), bomb.data() + 5);
+    oversized.close();
+    oversized.setData(bomb);
+    oversized.open(QIODevice::ReadOnly);
+    QVERIFY(!Compression::readFrames(&oversized, Compression::MAX_FRAME * 2, &decoded));
+}
+
+/**
+ * @brief Tests that a capped bucket pauses after its burst and a lifted cap applies at once
+ */
+void TestSender::test_bandwidth_caps_pause_and_lift() {
+    TokenBucket bucket;
+    QCOMPARE(bucket.delay(), 0); // Unlimited
+
+    bucket.setRate(1024 * 1024);
+    QCOMPARE(bucket.delay(), 0);
+    bucket.consume(768 * 1024); // Burst of 256 KiB plus half a second on credit
+    int wait = bucket.delay();
+    QVERIFY(wait > 300 && wait <= 1000);
+
+    bucket.setRate(0);
+    QCOMPARE(bucket.delay(), 0);
+
+    // The shared caps are read from Config on every call
+    QVERIFY(!BandwidthShaper::isLimited());
+    QCOMPARE(BandwidthShaper::step(1024 * 1024), qint64(1024 * 1024));
+    Config::getPeerRateLimit() = 512 * 1024;
+    QVERIFY(BandwidthShaper::isLimited());
+    QCOMPARE(BandwidthShaper::step(1024 * 1024), BandwidthShaper::MAX_STEP);
+
+    TokenBucket session;
+    QCOMPARE(BandwidthShaper::delay("10.0.0.7", &session), 0);
+    BandwidthShaper::consume("::ffff:10.0.0.7", &session, 1024 * 1024);
+    QVERIFY(BandwidthShaper::delay("10.0.0.7", &session) > 0); // Same peer seen as IPv4-mapped
+    QCOMPARE(BandwidthShaper::delay("10.0.0.8", &session), 0);
+
+    Config::getPeerRateLimit() = 0;
+    QCOMPARE(BandwidthShaper::delay("10.0.0.7", &session), 0);
+}
+
+/**
+ * @brief Tests that a background connection yields while an interactive one moves data
+ */
+void TestSender::test_bandwidth_lanes_yield() {
+    qint64 previousYield = Config::getYieldRate();
+    Config::getYieldRate() = 64 * 1024;
+
+    TokenBucket bulk;
+    bulk.setPriority(TransferPriority::BACKGROUND);
+    TokenBucket interactive;
+    interactive.setPriority(TransferPriority::INTERACTIVE);
+
+    // Alone, the background lane is not held back
+    BandwidthShaper::consume("10.0.0.7", &bulk, 1024 * 1024);
+    QCOMPARE(BandwidthShaper::delay("10.0.0.7", &bulk), 0);
+
+    BandwidthShaper::consume("10.0.0.8", &interactive, 64 * 1024);
+    QVERIFY(BandwidthShaper::isLimited());
+
+    // Without a cap only the outranked lane is shaped, the others stay off the shared lock
+    TokenBucket other;
+    other.setPriority(TransferPriority::INTERACTIVE);
+    QVERIFY(!BandwidthShaper::isShaping(&interactive));
+    QVERIFY(!BandwidthShaper::isShaping(&other));
+    QVERIFY(!BandwidthShaper::isShaping(nullptr));
+    QVERIFY(BandwidthShaper::isShaping(&bulk));
+    Config::getGlobalRateLimit() = 100 * 1024 * 1024;
+    QVERIFY(BandwidthShaper::isShaping(&interactive));
+    Config::getGlobalRateLimit() = 0;
+    QCOMPARE(BandwidthShaper::delay("10.0.0.8", &interactive), 0);
+    QCOMPARE(BandwidthShaper::delay("10.0.0.7", &bulk), 0); // Burst of the yield rate
+    BandwidthShaper::consume("10.0.0.7", &bulk, 64 * 1024);
+    QVERIFY(BandwidthShaper::delay("10.0.0.7", &bulk) > 0);
+    QCOMPARE(BandwidthShaper::delay("10.0.0.8", &interactive), 0);
+
+    // Once the interactive lane is idle the background one runs free again
+    QTest::qWait(BandwidthShaper::LANE_ACTIVE_MS + 100);
+    QCOMPARE(BandwidthShaper::delay("10.0.0.7", &bulk), 0);
+
+    Config::getYieldRate() = previousYield;
+}
+
+/**
+ * @brief Tests that a fan-out delivers the same data to a fast and a slow receiver
+ *
+ * The slow receiver only reads a little at a time, so the fast one runs
+ * ahead until the lag window stops reading from the file.
+ */
+void TestSender::test_fanout_reads_once_for_all_receivers() {
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QString filePath = tempDir.path() + "/fanout.bin";
+    QByteArray content;
+    for (int i = 0; i < 8 * 1024 * 1024; ++i)
+        content.append(char((i * 7) % 251));
+    QFile source(filePath);
+    QVERIFY(source.open(QIODevice::WriteOnly));
+    source.write(content);
+    source.close();
+    QByteArray trailer = Protocol::encodeTrailer(Protocol::VERSION_1,
+                                                 QCryptographicHash::hash(content, QCryptographicHash::Blake2b_256));
+
+    qint64 previousWindow = Config::getFanoutWindow();
+    Config::getFanoutWindow() = 1024 * 1024;
+
+    QTcpServer servers[2];
+    QTcpSocket *peers[2] = {nullptr, nullptr};
+    QByteArray received[2];
+    bool answered[2] = {false, false};
+    QList<FanoutTarget> targets;
+    for (int i = 0; i < 2; ++i) {
+        QVERIFY(servers[i].listen(QHostAddress::LocalHost));
+        FanoutTarget target;
+        target.address = "127.0.0.1";
+        target.port = servers[i].serverPort();
+        targets.append(target);
+    }
+
+    // Reads the header, accepts with a trailer and collects the data
+    auto serve = [&](int i, qint64 maxRead) {
+        if (!peers[i] && servers[i].hasPendingConnections()) {
+            peers[i] = servers[i].nextPendingConnection();
+            peers[i]->setReadBufferSize(256 * 1024);
+        }
+        if (!peers[i])
+            return;
+        if (!answered[i] && peers[i]->canReadLine()) {
+            peers[i]->readLine();
+            peers[i]->write("OK|hash=blake2b\n");
+            answered[i] = true;
+        }
+        if (answered[i])
+            received[i] += peers[i]->read(maxRead);
+    };
+
+    FanoutSender fanout;
+    QSignalSpy finishedSpy(&fanout, &FanoutSender::transferFinished);
+    QSignalSpy doneSpy(&fanout, &FanoutSender::fanoutFinished);
+    QSignalSpy errorSpy(&fanout, &FanoutSender::transferError);
+    fanout.sendFile(filePath, targets);
+
+    qint64 expected = content.size() + trailer.size();
+    qint64 maxBuffered = 0;
+    QElapsedTimer timer;
+    timer.start();
+    while ((received[0].size() < expected || received[1].size() < expected) && timer.elapsed() < 20000) {
+        serve(0, expected);
+        serve(1, 128 * 1024);
+        maxBuffered = qMax(maxBuffered, fanout.getBufferedBytes());
+        QTest::qWait(2);
+    }
+
+    QCOMPARE(errorSpy.count(), 0);
+    QCOMPARE(received[0], content + trailer);
+    QCOMPARE(received[1], content + trailer);
+    QVERIFY(maxBuffered <= Config::getFanoutWindow() + 256 * 1024);
+    QTRY_COMPARE_WITH_TIMEOUT(doneSpy.count(), 1, 5000);
+    QCOMPARE(finishedSpy.count(), 2);
+
+    Config::getFanoutWindow() = previousWindow;
+}
+
+/**
+ * @brief The address a peer was discovered at does not answer, another one it announced does.
+ *
+ * The first attempt goes to a documentation address nobody answers at; the
+ * loopback attempt starts after the stagger and wins, and is tried first
+ * the next time.
+ */
+void TestSender::test_connection_race_takes_answering_address() {
+    QTcpServer server;
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+
+    const QString peer = "192.0.2.1";
+    PathBonding::setPeerAddresses(peer, QStringList() << peer << "127.0.0.1");
+    QCOMPARE(ConnectionRace::candidates(peer), QStringList() << peer << "127.0.0.1");
+
+    ConnectionRace race;
+    QSignalSpy establishedSpy(&race, &ConnectionRace::established);
+    QSignalSpy failedSpy(&race, &ConnectionRace::failed);
+    QElapsedTimer timer;
+    timer.start();
+    race.start(peer, server.serverPort());
+
+    QTRY_COMPARE_WITH_TIMEOUT(establishedSpy.count(), 1, 5000);
+    QVERIFY(timer.elapsed() < 5000);
+    QCOMPARE(failedSpy.count(), 0);
+    QCOMPARE(establishedSpy.first().at(1).toString(), QString("127.0.0.1"));
+    QVERIFY(!race.isRunning());
+    QCOMPARE(ConnectionRace::candidates(peer).first(), QString("127.0.0.1"));
+
+    QTcpSocket *socket = establishedSpy.first().at(0).value<QTcpSocket *>();
+    QVERIFY(socket);
+    QCOMPARE(socket->state(), QAbstractSocket::ConnectedState);
+    delete socket;
+
+    ConnectionRace::remember(peer, peer);
+    PathBonding::removePeer(peer);
+}
+
+/**
+ * @brief Tests that a late read-ahead block calls back once read, and not after close()
+ */
+void TestSender::test_read_ahead_source_resumes_when_ready() {
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QString filePath = tempDir.path() + "/late.bin";
+    QByteArray content(int(ReadAheadSource::BLOCK_SIZE * 3), '\0');
+    for (int i = 0; i < content.size(); ++i)
+        content[i] = char((i * 7) % 251);
+    QFile file(filePath);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(content);
+    file.close();
+
+    int oldDepth = Config::getDiskQueueDepth();
+    Config::getDiskQueueDepth() = 1;
+    ReadAheadSource source(filePath);
+    QVERIFY(source.open());
+    Config::getDiskQueueDepth() = oldDepth;
+
+    QObject context;
+    int resumed = 0;
+    auto resume = [&resumed]() { ++resumed; };
+    if (!source.readyAt(0, &context, resume))
+        QTRY_COMPARE(resumed, 1);
+    QVERIFY(source.readyAt(0, &context, resume));
+
+    // The next block is read while the first one is sent
+    const char *data = nullptr;
+    QCOMPARE(source.readChunk(0, 16, &data), qint64(16));
+    QCOMPARE(QByteArray(data, 16), content.left(16));
+    QTRY_VERIFY(source.readyAt(ReadAheadSource::BLOCK_SIZE, &context, resume));
+    QCOMPARE(source.readChunk(ReadAheadSource::BLOCK_SIZE, 16, &data), qint64(16));
+    QCOMPARE(QByteArray(data, 16), content.mid(int(ReadAheadSource::BLOCK_SIZE), 16));
+
+    // A waiter closed before its block arrived is not called
+    resumed = 0;
+    source.readyAt(ReadAheadSource::BLOCK_SIZE * 2 + 1, &context, resume);
+    source.close();
+    QTest::qWait(50);
+    QCOMPARE(resumed, 0);
+}
+
 QTEST_MAIN(TestSender)
 
 #include "test_sender.moc"
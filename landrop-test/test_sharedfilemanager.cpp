@@ -7,14 +7,23 @@
  * - File list refresh and signal emission
  * - File system watching start/stop functionality
  * - JSON representation access
+ * - Index hashing and persistence
+ * - Startup listing from the saved index, checked later
+ * - Chunk hashes, hashing throttle and cancellation
+ * - Parallel walks of a nested tree matching a serial listing
  */
 
 #include "../landrop-plus/services/sharedfilemanager.h"
+#include "../landrop-plus/services/directorywalker.h"
+#include "../landrop-plus/config/config.h"
 #include <QtTest>
 #include <QSignalSpy>
 #include <QDir>
+#include <QDirIterator>
 #include <QFile>
 #include <QTemporaryDir>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
 
 class TestSharedFileManager : public QObject
 {
@@ -29,6 +38,9 @@ private slots:
     void test_startWatching_adds_paths();
     void test_stopWatching();
     void test_getSharedFilesJson();
+    void test_index_persists_hashes();
+    void test_hashing_is_throttled_and_cancelled();
+    void test_walker_matches_serial_listing();
 
 private:
     void createTestFile(const QString &dirPath, const QString &fileName, const QString &content = "test content");
@@ -128,6 +140,228 @@ void TestSharedFileManager::test_getSharedFilesJson()
     QVERIFY(true); // verify no crash
 }
 
+/**
+ * @brief Tests that the walked index lists subfolder files and keeps hashes across instances
+ */
+void TestSharedFileManager::test_index_persists_hashes()
+{
+    QTemporaryDir tempDir;
+    QTemporaryDir indexDir;
+    QVERIFY(tempDir.isValid());
+    QVERIFY(indexDir.isValid());
+    Config::getSharedIndexPath() = indexDir.filePath("index.json");
+
+    QVERIFY(QDir(tempDir.path()).mkdir("sub"));
+    createTestFile(tempDir.path(), "a.txt");
+    createTestFile(tempDir.filePath("sub"), "b.txt", "other content");
+
+    QByteArray hash;
+    {
+        SharedFileManager manager;
+        QSignalSpy scanSpy(&manager, &SharedFileManager::scanFinished);
+        QSignalSpy hashedSpy(&manager, &SharedFileManager::indexHashed);
+        manager.setSharedFolderPath(tempDir.path());
+        QVERIFY(manager.isScanning());
+        QVERIFY(scanSpy.wait(5000));
+
+        QJsonArray files = manager.sharedFilesJson();
+        QCOMPARE(files.size(), 2);
+        QCOMPARE(files[0].toObject()["path"].toString(), QString("a.txt"));
+        QCOMPARE(files[1].toObject()["path"].toString(), QString("sub/b.txt"));
+        QCOMPARE(files[1].toObject()["name"].toString(), QString("b.txt"));
+        QCOMPARE(files[1].toObject()["size"].toString(), QString("13"));
+
+        QVERIFY(hashedSpy.count() > 0 || hashedSpy.wait(5000));
+        hash = manager.indexedFiles().value("sub/b.txt").hash;
+        QByteArray expected = QCryptographicHash::hash("other content", QCryptographicHash::Blake2b_256);
+        QCOMPARE(hash, expected.toHex());
+
+        // A file shorter than a chunk has one range, hashed like the whole
+        QCOMPARE(manager.chunkHash("sub/b.txt", 0), expected);
+        QVERIFY(manager.chunkHash("sub/b.txt", 1).isEmpty());
+
+        // Removing a file drops it from the index
+        QVERIFY(QFile::remove(tempDir.filePath("a.txt")));
+        manager.refreshFileList();
+        QVERIFY(scanSpy.wait(5000));
+        QCOMPARE(manager.sharedFilesJson().size(), 1);
+    }
+
+    // A new instance reads the hash from the saved index instead of hashing
+    SharedFileManager manager;
+    QSignalSpy scanSpy(&manager, &SharedFileManager::scanFinished);
+    QSignalSpy hashedSpy(&manager, &SharedFileManager::indexHashed);
+    manager.setSharedFolderPath(tempDir.path());
+    QCOMPARE(manager.indexedFiles().value("sub/b.txt").hash, hash);
+    QVERIFY(scanSpy.wait(5000));
+    QCOMPARE(manager.indexedFiles().value("sub/b.txt").hash, hash);
+    QCOMPARE(hashedSpy.count(), 0);
+
+    // At startup the saved index is listed at once, the folder is walked by startWatching()
+    QString previousFolder = Config::getSharedFolderPath();
+    Config::getSharedFolderPath() = tempDir.path();
+    {
+        SharedFileManager startup;
+        QVERIFY(!startup.isScanning());
+        QCOMPARE(startup.sharedFilesJson().size(), 1);
+        QCOMPARE(startup.indexedFiles().value("sub/b.txt").hash, hash);
+
+        createTestFile(tempDir.path(), "c.txt");
+        QSignalSpy startupScanSpy(&startup, &SharedFileManager::scanFinished);
+        startup.startWatching();
+        QVERIFY(startup.isScanning());
+        QVERIFY(startupScanSpy.wait(5000));
+        QCOMPARE(startup.sharedFilesJson().size(), 2);
+    }
+    Config::getSharedFolderPath() = previousFolder;
+
+    Config::getSharedIndexPath() = "./shared-index.json";
+}
+
+/**
+ * @brief Tests chunk hashes of a multi-chunk file, the hashing budget and cancelling a throttled run
+ */
+void TestSharedFileManager::test_hashing_is_throttled_and_cancelled()
+{
+    const qint64 chunkSize = SharedFileManager::HASH_CHUNK_SIZE;
+    QTemporaryDir tempDir;
+    QTemporaryDir otherDir;
+    QTemporaryDir indexDir;
+    QVERIFY(tempDir.isValid());
+    QVERIFY(otherDir.isValid());
+    QVERIFY(indexDir.isValid());
+    Config::getSharedIndexPath() = indexDir.filePath("index.json");
+    const qint64 previousRate = Config::getHashRateLimit();
+
+    QByteArray content(int(chunkSize + chunkSize / 2), Qt::Uninitialized);
+    for (int i = 0; i < content.size(); ++i)
+        content[i] = char((i * 31) % 251);
+    QFile file(QDir(tempDir.path()).filePath("big.bin"));
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(content);
+    file.close();
+
+    // 6 MiB at 4 MiB/s, after a burst of a quarter second's worth
+    Config::getHashRateLimit() = 4 * 1024 * 1024;
+    {
+        SharedFileManager manager;
+        QSignalSpy scanSpy(&manager, &SharedFileManager::scanFinished);
+        QSignalSpy hashedSpy(&manager, &SharedFileManager::indexHashed);
+        QElapsedTimer clock;
+        clock.start();
+        manager.setSharedFolderPath(tempDir.path());
+        QVERIFY(scanSpy.wait(5000));
+
+        // Listed but not hashed yet, so no range is known
+        QVERIFY(manager.indexedFiles().value("big.bin").hash.isEmpty());
+        QVERIFY(manager.chunkHash("big.bin", 0).isEmpty());
+
+        QVERIFY(hashedSpy.wait(10000));
+        QVERIFY(clock.elapsed() >= 900);
+
+        QCOMPARE(manager.indexedFiles().value("big.bin").hash,
+                 QCryptographicHash::hash(content, QCryptographicHash::Blake2b_256).toHex());
+        QCOMPARE(manager.chunkHash("big.bin", 0),
+                 QCryptographicHash::hash(content.left(int(chunkSize)), QCryptographicHash::Blake2b_256));
+        QCOMPARE(manager.chunkHash("big.bin", 1),
+                 QCryptographicHash::hash(content.mid(int(chunkSize)), QCryptographicHash::Blake2b_256));
+        QVERIFY(manager.chunkHash("big.bin", 2).isEmpty());
+        QVERIFY(manager.chunkHash("big.bin", -1).isEmpty());
+        QVERIFY(manager.chunkHash("missing.bin", 0).isEmpty());
+    }
+
+    // A run paused by its budget gives the thread back at once, and its result is dropped
+    QFile::remove(Config::getSharedIndexPath());
+    Config::getHashRateLimit() = 64 * 1024;
+    SharedFileManager manager;
+    QSignalSpy scanSpy(&manager, &SharedFileManager::scanFinished);
+    QSignalSpy hashedSpy(&manager, &SharedFileManager::indexHashed);
+    manager.setSharedFolderPath(tempDir.path());
+    QVERIFY(scanSpy.wait(5000));
+    QTest::qWait(300);
+
+    QElapsedTimer cancelClock;
+    cancelClock.start();
+    manager.setSharedFolderPath(otherDir.path());
+    QVERIFY(cancelClock.elapsed() < 500);
+    QTest::qWait(200);
+    QCOMPARE(hashedSpy.count(), 0);
+    QVERIFY(!manager.indexedFiles().contains("big.bin"));
+
+    Config::getHashRateLimit() = previousRate;
+    Config::getSharedIndexPath() = "./shared-index.json";
+}
+
+/**
+ * @brief Tests that walks with one and with several workers list a nested tree like a serial listing
+ */
+void TestSharedFileManager::test_walker_matches_serial_listing()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QDir root(tempDir.path());
+
+    // Four levels of three folders each, files at every level, some folders empty
+    QStringList level = {"tree"};
+    QVERIFY(root.mkpath("tree"));
+    for (int depth = 0; depth < 4; ++depth)
+    {
+        QStringList next;
+        for (const QString &folder : std::as_const(level))
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                QString child = folder + QString("/d%1").arg(i);
+                QVERIFY(root.mkpath(child));
+                next.append(child);
+            }
+            for (int i = 0; i < depth + 1; ++i)
+                createTestFile(root.filePath(folder), QString("f%1.txt").arg(i), folder);
+        }
+        level = next;
+    }
+
+    QStringList expected = {"tree"};
+    QHash<QString, qint64> sizes;
+    QDirIterator it(root.filePath("tree"), QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System,
+                    QDirIterator::Subdirectories);
+    while (it.hasNext())
+    {
+        it.next();
+        QString name = root.relativeFilePath(it.filePath());
+        expected.append(name);
+        if (it.fileInfo().isFile())
+            sizes.insert(name, it.fileInfo().size());
+    }
+    std::sort(expected.begin(), expected.end());
+    QCOMPARE(expected.size(), 1 + 3 + 9 + 27 + 81 + 1 + 3 * 2 + 9 * 3 + 27 * 4);
+
+    for (int workers : {1, 2, 6})
+    {
+        DirectoryWalker walker(workers);
+        QSignalSpy finishedSpy(&walker, &DirectoryWalker::finished);
+        QSignalSpy progressSpy(&walker, &DirectoryWalker::progress);
+        walker.walk(root.filePath("tree"));
+        QVERIFY(finishedSpy.wait(10000));
+
+        QStringList names;
+        for (const Archive::Entry &entry : walker.entries())
+        {
+            names.append(entry.name);
+            bool isFolder = entry.type == Archive::Directory;
+            QCOMPARE(isFolder, !sizes.contains(entry.name));
+            if (!isFolder)
+                QCOMPARE(entry.size, sizes.value(entry.name));
+        }
+        QCOMPARE(names, expected);
+
+        // The last report counts every folder and file
+        QVERIFY(!progressSpy.isEmpty());
+        QCOMPARE(progressSpy.last().at(0).toInt(), 1 + 3 + 9 + 27 + 81);
+        QCOMPARE(progressSpy.last().at(1).toInt(), int(sizes.size()));
+    }
+}
+
 QTEST_MAIN(TestSharedFileManager)
 
-#include "test_sharedfilemanager.moc"
\ No newline at end of file
+#include "test_sharedfilemanager.moc"
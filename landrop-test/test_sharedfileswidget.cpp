@@ -0,0 +1,218 @@
+/**
+ * @file test_sharedfileswidget.cpp
+ * @brief Unit tests for SharedFilesWidget class
+ *
+ * Test Coverage:
+ * - Folder items filled when first expanded, only expanded ones kept up to date
+ * - Catalog changes applied to the changed peer only, keeping expansion and selection
+ * - Announcements with the catalog version shown leaving the items alone
+ */
+
+#include "../landrop-plus/ui/sharedfileswidget.h"
+#include "../landrop-plus/config/config.h"
+#include <QtTest>
+#include <QJsonArray>
+#include <QJsonObject>
+
+namespace
+{
+    /** Roles SharedFilesWidget keeps on its items */
+    const int UserPortRole = Qt::UserRole + 2;
+    const int FilePathRole = Qt::UserRole + 3;
+    const int IsPopulatedRole = Qt::UserRole + 6;
+
+    QJsonObject fileEntry(const QString &path, qint64 size)
+    {
+        QJsonObject entry;
+        entry["name"] = path.mid(path.lastIndexOf('/') + 1);
+        entry["path"] = path;
+        entry["type"] = "file";
+        entry["size"] = QString::number(size);
+        return entry;
+    }
+
+    LANDropUser userWith(const QString &ipAddress, const QStringList &paths, quint64 catalogVersion)
+    {
+        LANDropUser user(ipAddress, "host-" + ipAddress, 5556, "2");
+        for (const QString &path : paths)
+            user.sharedFiles.append(fileEntry(path, path.size()));
+        user.catalogVersion = catalogVersion;
+        return user;
+    }
+}
+
+class TestSharedFilesWidget : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+    void test_folders_are_filled_when_expanded();
+    void test_changes_diff_only_the_changed_peer();
+
+private:
+    static QTreeWidget *treeOf(SharedFilesWidget &widget);
+    static QTreeWidgetItem *childOf(QTreeWidgetItem *parent, const QString &path);
+    static QStringList childPaths(QTreeWidgetItem *parent);
+};
+
+void TestSharedFilesWidget::init()
+{
+    Config::reset();
+}
+
+void TestSharedFilesWidget::cleanup()
+{
+    Config::reset();
+}
+
+/**
+ * @brief Tree of users and their files, the other tree widget lists search matches.
+ */
+QTreeWidget *TestSharedFilesWidget::treeOf(SharedFilesWidget &widget)
+{
+    for (QTreeWidget *tree : widget.findChildren<QTreeWidget *>())
+    {
+        if (tree->headerItem()->text(2) == "Type")
+            return tree;
+    }
+    return nullptr;
+}
+
+QTreeWidgetItem *TestSharedFilesWidget::childOf(QTreeWidgetItem *parent, const QString &path)
+{
+    for (int i = 0; parent && i < parent->childCount(); ++i)
+    {
+        if (parent->child(i)->data(0, FilePathRole).toString() == path)
+            return parent->child(i);
+    }
+    return nullptr;
+}
+
+QStringList TestSharedFilesWidget::childPaths(QTreeWidgetItem *parent)
+{
+    QStringList paths;
+    for (int i = 0; i < parent->childCount(); ++i)
+        paths.append(parent->child(i)->data(0, FilePathRole).toString());
+    paths.sort();
+    return paths;
+}
+
+/**
+ * @brief Tests that folder items get their children on first expansion and only expanded ones follow changes
+ */
+void TestSharedFilesWidget::test_folders_are_filled_when_expanded()
+{
+    SharedFilesWidget widget;
+    QTreeWidget *tree = treeOf(widget);
+    QVERIFY(tree);
+
+    widget.onPeerAdded(userWith("10.0.0.2", {"top.txt", "docs/a.txt", "docs/sub/b.txt", "music/c.mp3"}, 1));
+    QCOMPARE(tree->topLevelItemCount(), 1);
+    QTreeWidgetItem *userItem = tree->topLevelItem(0);
+    QCOMPARE(childPaths(userItem), QStringList({"docs", "music", "top.txt"}));
+
+    // Folders are shown collapsed and empty
+    QTreeWidgetItem *docs = childOf(userItem, "docs");
+    QVERIFY(docs);
+    QCOMPARE(docs->childCount(), 0);
+    QVERIFY(!docs->data(0, IsPopulatedRole).toBool());
+    QCOMPARE(docs->childIndicatorPolicy(), QTreeWidgetItem::ShowIndicator);
+
+    docs->setExpanded(true);
+    QVERIFY(docs->data(0, IsPopulatedRole).toBool());
+    QCOMPARE(childPaths(docs), QStringList({"docs/a.txt", "docs/sub"}));
+    QTreeWidgetItem *sub = childOf(docs, "docs/sub");
+    QVERIFY(sub);
+    QCOMPARE(sub->childCount(), 0);
+
+    // A new catalog updates the expanded folder and leaves the others empty
+    widget.onPeerChanged(userWith("10.0.0.2", {"top.txt", "docs/a.txt", "docs/new.txt", "docs/sub/b.txt",
+                                               "docs/sub/d.txt", "music/c.mp3"}, 2),
+                         BroadcastDiscoveryService::SharedFilesField);
+    QCOMPARE(childOf(userItem, "docs"), docs);
+    QCOMPARE(childPaths(docs), QStringList({"docs/a.txt", "docs/new.txt", "docs/sub"}));
+    QCOMPARE(childOf(docs, "docs/sub"), sub);
+    QCOMPARE(sub->childCount(), 0);
+    QCOMPARE(childOf(userItem, "music")->childCount(), 0);
+
+    // The deeper folder is filled from the latest catalog
+    sub->setExpanded(true);
+    QCOMPARE(childPaths(sub), QStringList({"docs/sub/b.txt", "docs/sub/d.txt"}));
+}
+
+/**
+ * @brief Tests that a new catalog only touches the changed peer's items and keeps expansion and selection
+ */
+void TestSharedFilesWidget::test_changes_diff_only_the_changed_peer()
+{
+    SharedFilesWidget widget;
+    QTreeWidget *tree = treeOf(widget);
+    QVERIFY(tree);
+
+    widget.onPeerAdded(userWith("10.0.0.2", {"a.txt", "docs/b.txt"}, 1));
+    widget.onPeerAdded(userWith("10.0.0.3", {"c.txt", "d.txt"}, 7));
+    QCOMPARE(tree->topLevelItemCount(), 2);
+    QTreeWidgetItem *first = nullptr;
+    QTreeWidgetItem *second = nullptr;
+    for (int i = 0; i < tree->topLevelItemCount(); ++i)
+    {
+        QTreeWidgetItem *item = tree->topLevelItem(i);
+        if (item->text(0).contains("10.0.0.2"))
+            first = item;
+        else
+            second = item;
+    }
+    QVERIFY(first && second);
+
+    QTreeWidgetItem *kept = childOf(first, "a.txt");
+    QTreeWidgetItem *docs = childOf(first, "docs");
+    QVERIFY(kept && docs);
+    docs->setExpanded(true);
+    QTreeWidgetItem *selected = childOf(docs, "docs/b.txt");
+    QVERIFY(selected);
+    tree->setCurrentItem(selected);
+    QList<QTreeWidgetItem *> secondItems = {childOf(second, "c.txt"), childOf(second, "d.txt")};
+
+    // The first peer shares one more file and drops none
+    widget.onPeerChanged(userWith("10.0.0.2", {"a.txt", "docs/b.txt", "docs/e.txt"}, 2),
+                         BroadcastDiscoveryService::SharedFilesField);
+    QCOMPARE(childOf(first, "a.txt"), kept);
+    QCOMPARE(childOf(first, "docs"), docs);
+    QVERIFY(docs->isExpanded());
+    QCOMPARE(childOf(docs, "docs/b.txt"), selected);
+    QCOMPARE(tree->currentItem(), selected);
+    QVERIFY(selected->isSelected());
+    QCOMPARE(childPaths(docs), QStringList({"docs/b.txt", "docs/e.txt"}));
+    QCOMPARE(QList<QTreeWidgetItem *>({childOf(second, "c.txt"), childOf(second, "d.txt")}), secondItems);
+
+    // A file removed leaves with its item only
+    widget.onPeerChanged(userWith("10.0.0.2", {"a.txt", "docs/b.txt"}, 3),
+                         BroadcastDiscoveryService::SharedFilesField);
+    QCOMPARE(childPaths(docs), QStringList({"docs/b.txt"}));
+    QCOMPARE(childOf(docs, "docs/b.txt"), selected);
+    QCOMPARE(tree->currentItem(), selected);
+
+    // The catalog version shown already: nothing is diffed
+    widget.onPeerChanged(userWith("10.0.0.3", {"c.txt", "d.txt", "f.txt"}, 7),
+                         BroadcastDiscoveryService::SharedFilesField);
+    QCOMPARE(childPaths(second), QStringList({"c.txt", "d.txt"}));
+    QCOMPARE(QList<QTreeWidgetItem *>({childOf(second, "c.txt"), childOf(second, "d.txt")}), secondItems);
+
+    // Nor when only the hostname changed
+    widget.onPeerChanged(userWith("10.0.0.3", {"c.txt", "d.txt", "f.txt"}, 8),
+                         BroadcastDiscoveryService::HostnameField);
+    QCOMPARE(childPaths(second), QStringList({"c.txt", "d.txt"}));
+
+    // A new port is applied to the items kept
+    LANDropUser moved = userWith("10.0.0.3", {"c.txt", "d.txt"}, 7);
+    moved.transferPort = 6000;
+    widget.onPeerChanged(moved, BroadcastDiscoveryService::PortField);
+    QCOMPARE(QList<QTreeWidgetItem *>({childOf(second, "c.txt"), childOf(second, "d.txt")}), secondItems);
+    QCOMPARE(secondItems[0]->data(0, UserPortRole).toUInt(), 6000u);
+}
+
+QTEST_MAIN(TestSharedFilesWidget)
+
+#include "test_sharedfileswidget.moc"